@@ -17,6 +17,7 @@
 #include "../../../source/API/soul_patch/helper_classes/soul_patch_CompilerCacheFolder.h"
 
 #include "PatchLoaderComponent.h"
+#include "PatchLoadTest.h"
 
 //==============================================================================
 struct SOULPatchHostDemoApp  : public juce::JUCEApplication
@@ -27,8 +28,25 @@ struct SOULPatchHostDemoApp  : public juce::JUCEApplication
     const juce::String getApplicationVersion() override    { return ProjectInfo::versionString; }
     bool moreThanOneInstanceAllowed() override             { return true; }
 
-    void initialise (const juce::String&) override              { mainWindow = std::make_unique<MainWindow>(); }
-    void shutdown() override                                    { mainWindow.reset(); }
+    void initialise (const juce::String&) override
+    {
+        auto args = getCommandLineParameterArray();
+
+        if (PatchLoadTest::Options::isLoadTestCommandLine (args))
+        {
+            loadTest = std::make_unique<PatchLoadTest> (PatchLoadTest::Options::fromCommandLine (args),
+                                                        [this] (int exitCode)
+                                                        {
+                                                            setApplicationReturnValue (exitCode);
+                                                            quit();
+                                                        });
+            return;
+        }
+
+        mainWindow = std::make_unique<MainWindow>();
+    }
+
+    void shutdown() override                                    { loadTest.reset(); mainWindow.reset(); }
     void systemRequestedQuit() override                         { quit(); }
     void anotherInstanceStarted (const juce::String&) override  {}
 
@@ -60,6 +78,7 @@ struct SOULPatchHostDemoApp  : public juce::JUCEApplication
     };
 
     std::unique_ptr<MainWindow> mainWindow;
+    std::unique_ptr<PatchLoadTest> loadTest;
 };
 
 //==============================================================================
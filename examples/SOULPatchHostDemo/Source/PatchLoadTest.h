@@ -0,0 +1,411 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#pragma once
+
+#include <iostream>
+#include <numeric>
+
+#if JUCE_LINUX
+ #include <unistd.h>
+#elif JUCE_MAC
+ #include <mach/mach.h>
+#endif
+
+/**
+    A headless stress test, which loads increasing numbers of copies of a patch through
+    the SOULPatchAudioPluginFormat, and renders them all on one thread with synthetic audio
+    and MIDI, to find out how many instances of it a core can handle.
+
+    For each number of instances, it reports:
+     - the time it took for all of the instances to compile and become playable
+     - the growth in the process's resident memory, divided by the number of instances
+     - the 50th and 99th percentile times to render one block of all the instances
+     - the number of xruns, i.e. blocks that took longer to render than they take to play
+
+    The app runs it instead of opening its window when it's launched like this:
+
+        SOULPatchHostDemo --load-test <patch file> [--instances 1,2,4,8,16] [--rate 44100]
+                          [--block 256] [--seconds 10] [--csv <file>] [--library <patch DLL>]
+
+    The results are printed to stdout, and also written to the CSV file if one is given.
+    Stopping at the first number of instances which causes any xruns is left to whoever
+    reads the results, so that the whole curve is always available.
+*/
+struct PatchLoadTest  : private juce::Timer
+{
+    struct Options
+    {
+        juce::File patchFile, library, csvFile;
+        juce::Array<int> instanceCounts { 1, 2, 4, 8, 16 };
+        double sampleRate = 44100.0;
+        int blockSize = 256;
+        double secondsToRender = 10.0;
+        double compileTimeoutSeconds = 300.0;
+
+        static bool isLoadTestCommandLine (const juce::StringArray& args)
+        {
+            return args.contains ("--load-test");
+        }
+
+        static Options fromCommandLine (const juce::StringArray& args)
+        {
+            auto getOption = [&] (const char* name) -> juce::String
+            {
+                auto index = args.indexOf (name);
+                return index >= 0 ? args[index + 1] : juce::String();
+            };
+
+            auto getFile = [] (const juce::String& path) -> juce::File
+            {
+                return path.isEmpty() ? juce::File() : juce::File::getCurrentWorkingDirectory().getChildFile (path);
+            };
+
+            Options o;
+            o.patchFile = getFile (getOption ("--load-test"));
+            o.library = getFile (getOption ("--library"));
+            o.csvFile = getFile (getOption ("--csv"));
+
+            if (args.contains ("--instances"))
+            {
+                o.instanceCounts.clear();
+
+                for (auto& n : juce::StringArray::fromTokens (getOption ("--instances"), ",", {}))
+                    if (n.getIntValue() > 0)
+                        o.instanceCounts.add (n.getIntValue());
+            }
+
+            if (args.contains ("--rate"))     o.sampleRate = getOption ("--rate").getDoubleValue();
+            if (args.contains ("--block"))    o.blockSize = getOption ("--block").getIntValue();
+            if (args.contains ("--seconds"))  o.secondsToRender = getOption ("--seconds").getDoubleValue();
+
+            return o;
+        }
+    };
+
+    /** Starts the test. When it has finished, the callback is called on the message thread
+        with a suitable exit code for the app.
+    */
+    PatchLoadTest (Options optionsToUse, std::function<void(int exitCode)> onFinished)
+        : options (std::move (optionsToUse)), finishedCallback (std::move (onFinished))
+    {
+        start();
+    }
+
+    ~PatchLoadTest() override
+    {
+        stopTimer();
+        renderThread.stopThread (10000);
+        instances.clear();
+        patchFormat.reset();
+    }
+
+private:
+    //==============================================================================
+    void start()
+    {
+        if (options.library == juce::File())
+            options.library = PatchLoaderComponent::lookForSOULPatchDLL();
+
+        if (! options.patchFile.existsAsFile())
+            return fail ("Can't find the patch file: " + options.patchFile.getFullPathName());
+
+        if (options.instanceCounts.isEmpty() || options.sampleRate <= 0 || options.blockSize <= 0 || options.secondsToRender <= 0)
+            return fail ("Invalid load test settings");
+
+        if (! options.library.existsAsFile())
+            return fail ("Can't find the SOUL patch DLL");
+
+        patchFormat = std::make_unique<soul::patch::SOULPatchAudioPluginFormat> (options.library.getFullPathName(),
+                                                                                 [this] (soul::patch::SOULPatchAudioProcessor& p) { instanceCompiled (p); });
+
+        if (! patchFormat->initialisedSuccessfully())
+            return fail ("Failed to load the patch DLL at " + options.library.getFullPathName());
+
+        std::cout << "Load test: " << options.patchFile.getFullPathName() << std::endl
+                  << options.sampleRate << " Hz, " << options.blockSize << " frame blocks, "
+                  << options.secondsToRender << " seconds per run" << std::endl << std::endl
+                  << juce::String ("instances").paddedLeft (' ', 10) << juce::String ("compile s").paddedLeft (' ', 12)
+                  << juce::String ("MB/inst").paddedLeft (' ', 10) << juce::String ("p50 ms").paddedLeft (' ', 10)
+                  << juce::String ("p99 ms").paddedLeft (' ', 10) << juce::String ("load %").paddedLeft (' ', 10)
+                  << juce::String ("xruns").paddedLeft (' ', 8) << std::endl;
+
+        startNextRun();
+    }
+
+    struct Result
+    {
+        int numInstances = 0;
+        double compileSeconds = 0, megabytesPerInstance = 0, p50Milliseconds = 0, p99Milliseconds = 0, load = 0;
+        int numXRuns = 0;
+    };
+
+    struct RenderThread  : public juce::Thread
+    {
+        RenderThread (PatchLoadTest& t) : juce::Thread ("SOUL load test render"), owner (t) {}
+        void run() override   { owner.renderInstances(); }
+
+        PatchLoadTest& owner;
+    };
+
+    Options options;
+    std::function<void(int)> finishedCallback;
+    std::unique_ptr<soul::patch::SOULPatchAudioPluginFormat> patchFormat;
+    std::vector<std::unique_ptr<juce::AudioPluginInstance>> instances;
+    juce::Array<soul::patch::SOULPatchAudioProcessor*> compiledInstances;
+    RenderThread renderThread { *this };
+
+    int runIndex = 0;
+    juce::int64 memoryBeforeRun = 0;
+    double runStartTime = 0;
+    Result currentResult;
+    std::vector<double> blockTimes;
+    juce::Array<Result> results;
+
+    //==============================================================================
+    void startNextRun()
+    {
+        if (runIndex >= options.instanceCounts.size())
+            return finish();
+
+        currentResult = {};
+        currentResult.numInstances = options.instanceCounts[runIndex++];
+        compiledInstances.clear();
+        memoryBeforeRun = getResidentMemoryBytes();
+        runStartTime = juce::Time::getMillisecondCounterHiRes();
+
+        juce::PluginDescription desc;
+        desc.pluginFormatName = soul::patch::SOULPatchAudioProcessor::getPluginFormatName();
+        desc.fileOrIdentifier = options.patchFile.getFullPathName();
+
+        for (int i = 0; i < currentResult.numInstances; ++i)
+        {
+            patchFormat->createPluginInstance (desc, options.sampleRate, options.blockSize,
+                                               [this] (std::unique_ptr<juce::AudioPluginInstance> newInstance, const juce::String& error)
+                                               {
+                                                   if (newInstance == nullptr)
+                                                       return fail (error);
+
+                                                   // The compile is started by the first call to prepareToPlay
+                                                   newInstance->prepareToPlay (options.sampleRate, options.blockSize);
+                                                   instances.push_back (std::move (newInstance));
+                                               });
+
+            if (instances.size() != (size_t) (i + 1))
+                return;
+        }
+
+        startTimer (100);
+    }
+
+    // Called on the message thread when each instance has finished compiling
+    void instanceCompiled (soul::patch::SOULPatchAudioProcessor& processor)
+    {
+        if (compiledInstances.contains (&processor) || renderThread.isThreadRunning())
+            return;
+
+        processor.reinitialise();
+
+        if (! processor.isPlayable())
+            return fail ("The patch failed to compile:\n" + processor.getCompileError());
+
+        // Now that the processor knows its buses, it needs to be prepared again
+        processor.prepareToPlay (options.sampleRate, options.blockSize);
+        compiledInstances.add (&processor);
+
+        if (compiledInstances.size() == currentResult.numInstances)
+        {
+            currentResult.compileSeconds = (juce::Time::getMillisecondCounterHiRes() - runStartTime) / 1000.0;
+            renderThread.startThread (juce::Thread::realtimeAudioPriority);
+        }
+    }
+
+    void timerCallback() override
+    {
+        if (! renderThread.isThreadRunning() && compiledInstances.size() == currentResult.numInstances)
+        {
+            stopTimer();
+            renderThread.waitForThreadToExit (-1);
+            return finishRun();
+        }
+
+        if (compiledInstances.size() < currentResult.numInstances
+             && juce::Time::getMillisecondCounterHiRes() - runStartTime > options.compileTimeoutSeconds * 1000.0)
+            fail ("Timed out waiting for the instances to compile");
+    }
+
+    void finishRun()
+    {
+        if (auto memoryAfterRun = getResidentMemoryBytes())
+            if (memoryBeforeRun > 0)
+                currentResult.megabytesPerInstance = (double) (memoryAfterRun - memoryBeforeRun)
+                                                       / (1024.0 * 1024.0 * currentResult.numInstances);
+
+        std::sort (blockTimes.begin(), blockTimes.end());
+
+        if (! blockTimes.empty())
+        {
+            auto blockDuration = options.blockSize / options.sampleRate;
+            auto getPercentile = [this] (double p) { return blockTimes[std::min (blockTimes.size() - 1, (size_t) (p * (double) blockTimes.size()))]; };
+
+            currentResult.p50Milliseconds = getPercentile (0.5) * 1000.0;
+            currentResult.p99Milliseconds = getPercentile (0.99) * 1000.0;
+            currentResult.load = std::accumulate (blockTimes.begin(), blockTimes.end(), 0.0) / (blockDuration * (double) blockTimes.size());
+            currentResult.numXRuns = (int) std::count_if (blockTimes.begin(), blockTimes.end(), [=] (double t) { return t > blockDuration; });
+        }
+
+        results.add (currentResult);
+
+        std::cout << juce::String (currentResult.numInstances).paddedLeft (' ', 10)
+                  << juce::String (currentResult.compileSeconds, 2).paddedLeft (' ', 12)
+                  << juce::String (currentResult.megabytesPerInstance, 2).paddedLeft (' ', 10)
+                  << juce::String (currentResult.p50Milliseconds, 3).paddedLeft (' ', 10)
+                  << juce::String (currentResult.p99Milliseconds, 3).paddedLeft (' ', 10)
+                  << juce::String (currentResult.load * 100.0, 1).paddedLeft (' ', 10)
+                  << juce::String (currentResult.numXRuns).paddedLeft (' ', 8) << std::endl;
+
+        instances.clear();
+        compiledInstances.clear();
+        startNextRun();
+    }
+
+    void finish()
+    {
+        if (options.csvFile != juce::File())
+        {
+            juce::String csv ("instances,compile_seconds,mb_per_instance,p50_ms,p99_ms,load,xruns\n");
+
+            for (auto& r : results)
+                csv << r.numInstances << "," << r.compileSeconds << "," << r.megabytesPerInstance << ","
+                    << r.p50Milliseconds << "," << r.p99Milliseconds << "," << r.load << "," << r.numXRuns << "\n";
+
+            if (! options.csvFile.replaceWithText (csv))
+                return fail ("Failed to write " + options.csvFile.getFullPathName());
+        }
+
+        finishWithExitCode (0);
+    }
+
+    void fail (const juce::String& error)
+    {
+        std::cerr << error << std::endl;
+        finishWithExitCode (1);
+    }
+
+    void finishWithExitCode (int exitCode)
+    {
+        stopTimer();
+
+        // This may be called from inside a callback from one of the instances, so the
+        // owner is told on a later message
+        juce::MessageManager::callAsync ([callback = finishedCallback, exitCode] { callback (exitCode); });
+        finishedCallback = [] (int) {};
+    }
+
+    //==============================================================================
+    // Runs on the render thread. Only the calls to processBlock() are timed, so the time
+    // spent generating the test input isn't counted.
+    void renderInstances()
+    {
+        auto numBlocks = (int) std::ceil (options.secondsToRender * options.sampleRate / options.blockSize);
+        int numChannels = 1;
+
+        for (auto& i : instances)
+            numChannels = std::max ({ numChannels, i->getTotalNumInputChannels(), i->getTotalNumOutputChannels() });
+
+        juce::AudioBuffer<float> input (numChannels, options.blockSize), audio (numChannels, options.blockSize);
+        juce::MidiBuffer midi;
+
+        blockTimes.clear();
+        blockTimes.reserve ((size_t) numBlocks);
+
+        for (int block = 0; block < numBlocks && ! renderThread.threadShouldExit(); ++block)
+        {
+            auto blockStart = (juce::int64) block * options.blockSize;
+            createSyntheticAudio (input, blockStart);
+            juce::int64 ticks = 0;
+
+            for (size_t i = 0; i < instances.size(); ++i)
+            {
+                audio.makeCopyOf (input, true);
+                createSyntheticMIDI (midi, blockStart, (int) i);
+
+                auto start = juce::Time::getHighResolutionTicks();
+                instances[i]->processBlock (audio, midi);
+                ticks += juce::Time::getHighResolutionTicks() - start;
+            }
+
+            blockTimes.push_back (juce::Time::highResolutionTicksToSeconds (ticks));
+        }
+    }
+
+    void createSyntheticAudio (juce::AudioBuffer<float>& buffer, juce::int64 startFrame) const
+    {
+        auto phaseIncrement = juce::MathConstants<double>::twoPi * 220.0 / options.sampleRate;
+
+        for (int i = 0; i < buffer.getNumSamples(); ++i)
+        {
+            auto sample = (float) (0.25 * std::sin (phaseIncrement * (double) (startFrame + i)));
+
+            for (int chan = 0; chan < buffer.getNumChannels(); ++chan)
+                buffer.setSample (chan, i, sample);
+        }
+    }
+
+    // Each instance gets a three-note chord every half second, held for a quarter of a
+    // second, transposed by a different amount so that the instances aren't all identical
+    void createSyntheticMIDI (juce::MidiBuffer& midi, juce::int64 startFrame, int instanceIndex) const
+    {
+        midi.clear();
+        auto framesPerNote = std::max ((juce::int64) 2, (juce::int64) (options.sampleRate / 2));
+        auto rootNote = 48 + (instanceIndex % 12);
+
+        for (int i = 0; i < options.blockSize; ++i)
+        {
+            auto positionInNote = (startFrame + i) % framesPerNote;
+
+            for (auto interval : { 0, 4, 7 })
+            {
+                if (positionInNote == 0)
+                    midi.addEvent (juce::MidiMessage::noteOn (1, rootNote + interval, (juce::uint8) 100), i);
+                else if (positionInNote == framesPerNote / 2)
+                    midi.addEvent (juce::MidiMessage::noteOff (1, rootNote + interval), i);
+            }
+        }
+    }
+
+    static juce::int64 getResidentMemoryBytes()
+    {
+       #if JUCE_LINUX
+        auto fields = juce::StringArray::fromTokens (juce::File ("/proc/self/statm").loadFileAsString(), false);
+        return fields[1].getLargeIntValue() * (juce::int64) sysconf (_SC_PAGESIZE);
+       #elif JUCE_MAC
+        mach_task_basic_info info;
+        mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+
+        if (task_info (mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t) &info, &count) == KERN_SUCCESS)
+            return (juce::int64) info.resident_size;
+
+        return 0;
+       #else
+        return 0;
+       #endif
+    }
+};
@@ -26,6 +26,7 @@
 
 #include <vector>
 #include <string>
+#include <unordered_map>
 #include <cstring>
 #include <algorithm>
 #include <memory>
@@ -477,6 +478,7 @@ public:
 
     //==============================================================================
     ValueView withDictionary (StringDictionary* newDictionary)      { return ValueView (type, data, newDictionary); }
+    StringDictionary* getDictionary() const                         { return stringDictionary; }
 
     void* getRawData()                   { return data; }
     const void* getRawData() const       { return data; }
@@ -739,7 +741,15 @@ private:
     {
         Handle getHandleForString (std::string_view text) override;
         std::string_view getStringForHandle (Handle handle) const override;
+        Handle addString (std::string);
+        void clear();
+
         std::vector<std::string> strings;
+
+    private:
+        // Maps the hash of each string to its handle, so that looking up a string doesn't
+        // need to compare it with all the others
+        std::unordered_multimap<size_t, decltype (Handle::handle)> handlesByHash;
     };
 
     std::vector<uint8_t> packedData;
@@ -1855,7 +1865,7 @@ inline Value& Value::operator= (const ValueView& source)
     value.type = source.type;
     value.data = packedData.data();
     memcpy (value.data, source.getRawData(), getRawDataSize());
-    dictionary.strings.clear();
+    dictionary.clear();
 
     if (source.stringDictionary != nullptr && source.getType().usesStrings())
         importStringHandles (value, *source.stringDictionary);
@@ -2137,7 +2147,7 @@ inline Value Value::deserialise (InputData& input)
         v.dictionary.strings.reserve (numStrings);
 
         for (uint32_t i = 0; i < numStrings; ++i)
-            v.dictionary.strings.push_back (Type::SerialisationHelpers::readNullTerminatedString (input));
+            v.dictionary.addString (Type::SerialisationHelpers::readNullTerminatedString (input));
     }
 
     Type::SerialisationHelpers::expect (input.end == input.start);
@@ -2247,12 +2257,27 @@ inline Value::SimpleStringDictionary::Handle Value::SimpleStringDictionary::getH
     if (text.empty())
         return {};
 
-    for (decltype(Handle::handle) i = 0; i < strings.size(); ++i)
-        if (strings[i] == text)
-            return { i + 1 };
+    auto matches = handlesByHash.equal_range (std::hash<std::string_view>() (text));
+
+    for (auto i = matches.first; i != matches.second; ++i)
+        if (strings[i->second - 1] == text)
+            return { i->second };
+
+    return addString (std::string (text));
+}
 
-    strings.push_back (std::string (text));
-    return { static_cast<decltype(Handle::handle)> (strings.size()) };
+inline Value::SimpleStringDictionary::Handle Value::SimpleStringDictionary::addString (std::string text)
+{
+    strings.push_back (std::move (text));
+    auto handle = static_cast<decltype(Handle::handle)> (strings.size());
+    handlesByHash.insert ({ std::hash<std::string_view>() (strings.back()), handle });
+    return { handle };
+}
+
+inline void Value::SimpleStringDictionary::clear()
+{
+    strings.clear();
+    handlesByHash.clear();
 }
 
 inline std::string_view Value::SimpleStringDictionary::getStringForHandle (Handle handle) const
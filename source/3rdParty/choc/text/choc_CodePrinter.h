@@ -26,6 +26,8 @@
 
 #include <string>
 #include <vector>
+#include <functional>
+#include <algorithm>
 #include "choc_FloatToString.h"
 #include "choc_StringUtilities.h"
 
@@ -42,9 +44,32 @@ struct CodePrinter
     CodePrinter (CodePrinter&&) = default;
     CodePrinter (const CodePrinter&) = default;
 
-    /** Returns the finished contents of the stream as a string. */
+    /** Creates a printer which expects to produce roughly this many bytes of text.
+        Finished lines are kept in chunks of about this size, so a big output doesn't need
+        to keep reallocating and copying one huge block.
+    */
+    explicit CodePrinter (size_t expectedSize);
+
+    /** A function which is given each chunk of finished text. */
+    using OutputFunction = std::function<void(std::string_view)>;
+
+    /** Creates a printer which passes its text to a function as it goes, rather than
+        holding it all in memory. The text arrives in chunks of roughly the given size, and
+        you must call flush() when you've finished writing to send the last of it.
+    */
+    explicit CodePrinter (OutputFunction, size_t chunkSize = 65536);
+
+    /** Returns the finished contents of the stream as a string.
+        If the printer was given an OutputFunction, this only includes whatever hasn't
+        already been sent to it.
+    */
     std::string toString() const;
 
+    /** Sends all the remaining text to the OutputFunction, including any unfinished line.
+        If there's no OutputFunction, this does nothing.
+    */
+    void flush();
+
     //==============================================================================
     CodePrinter& operator<< (const char*);
     CodePrinter& operator<< (const std::string&);
@@ -122,13 +147,21 @@ private:
         std::string line;
     };
 
+    // Only the last line is held as a Line, because that's the only one that can still
+    // change. Earlier ones are formatted and moved into the chunk list, or sent to the output.
     std::vector<Line> lines;
+    std::vector<std::string> chunks;
+    std::string currentChunk;
+    size_t chunkSize = 16384;
+    OutputFunction output;
     int indent = 0, tabSize = 4;
     size_t lineWrapLength = 0;
     std::string newLineString = "\n",
                 sectionBreakString = "//==============================================================================";
 
     void append (std::string);
+    void writeLine (const Line&);
+    void writePendingLines (size_t numToKeep);
     void writeBlock (std::string_view);
     void startNewLine();
     bool isLastLineEmpty() const;
@@ -229,10 +262,24 @@ inline CodePrinter::Indent CodePrinter::createIndent (size_t size, char ob, char
 inline CodePrinter::Indent CodePrinter::createIndentWithBraces()                      { return createIndent ('{', '}'); }
 inline CodePrinter::Indent CodePrinter::createIndentWithBraces (size_t size)          { return createIndent (size, '{', '}'); }
 
+inline CodePrinter::CodePrinter (size_t expectedSize)
+    : chunkSize (std::max (expectedSize, static_cast<size_t> (1024)))
+{
+}
+
+inline CodePrinter::CodePrinter (OutputFunction o, size_t size)
+    : chunkSize (std::max (size, static_cast<size_t> (1024))), output (std::move (o))
+{
+    CHOC_ASSERT (output != nullptr);
+}
+
 inline std::string CodePrinter::toString() const
 {
     std::string s;
-    auto totalLen = lines.size() * newLineString.length() + 1;
+    auto totalLen = currentChunk.length() + lines.size() * newLineString.length() + 1;
+
+    for (auto& c : chunks)
+        totalLen += c.length();
 
     for (auto& l : lines)
         if (auto contentLen = getLengthWithTrimmedEnd (l.line))
@@ -240,6 +287,11 @@ inline std::string CodePrinter::toString() const
 
     s.reserve (totalLen);
 
+    for (auto& c : chunks)
+        s.append (c);
+
+    s.append (currentChunk);
+
     for (auto& l : lines)
     {
         if (auto contentLen = getLengthWithTrimmedEnd (l.line))
@@ -254,6 +306,61 @@ inline std::string CodePrinter::toString() const
     return s;
 }
 
+inline void CodePrinter::flush()
+{
+    if (output != nullptr)
+    {
+        writePendingLines (0);
+
+        if (! currentChunk.empty())
+        {
+            output (currentChunk);
+            currentChunk.clear();
+        }
+    }
+}
+
+inline void CodePrinter::writeLine (const Line& l)
+{
+    if (currentChunk.capacity() < chunkSize)
+        currentChunk.reserve (chunkSize);
+
+    if (auto contentLen = getLengthWithTrimmedEnd (l.line))
+    {
+        currentChunk.append (l.indent, ' ');
+        currentChunk.append (l.line, 0, contentLen);
+    }
+
+    currentChunk.append (newLineString);
+
+    if (currentChunk.length() >= chunkSize)
+    {
+        if (output != nullptr)
+        {
+            output (currentChunk);
+            currentChunk.clear();
+        }
+        else
+        {
+            chunks.push_back (std::move (currentChunk));
+            currentChunk = {};
+        }
+    }
+}
+
+inline void CodePrinter::writePendingLines (size_t numToKeep)
+{
+    if (lines.size() > numToKeep)
+    {
+        auto numToWrite = lines.size() - numToKeep;
+
+        for (size_t i = 0; i < numToWrite; ++i)
+            writeLine (lines[i]);
+
+        lines.erase (lines.begin(), lines.begin() + static_cast<std::vector<Line>::difference_type> (numToWrite));
+    }
+}
+
 static inline size_t findLineSplitPoint (std::string_view text, size_t targetLength)
 {
     size_t pos = 0;
@@ -283,9 +390,14 @@ inline void CodePrinter::append (std::string s)
     if (! s.empty())
     {
         if (isLastLineActive())
+        {
             lines.back().line += std::move (s);
+        }
         else
+        {
+            writePendingLines (0);
             lines.push_back ({ static_cast<size_t> (indent), std::move (s) });
+        }
 
         while (lineWrapLength != 0 && lines.back().line.length() > lineWrapLength)
         {
@@ -33,8 +33,8 @@ namespace choc::text
 //==============================================================================
 /** Converts a 32-bit float to an accurate, round-trip-safe string.
 
-    The algorithm used is "Grisu3" from the paper "Printing Floating-Point Numbers
-    Quickly and Accurately with Integers" by Florian Loitsch.
+    The algorithm used is "Ryu" from the paper "Ryu: Fast Float-to-String Conversion"
+    by Ulf Adams, which always finds the shortest string that will round-trip.
 */
 std::string floatToString (float value);
 
@@ -49,8 +49,13 @@ std::string floatToString (double value);
 //==============================================================================
 /** Helper class containing its own buffer for converting a float or double to a string.
 
-    The algorithm is "Grisu3" from the paper "Printing Floating-Point Numbers
-    Quickly and Accurately with Integers" by Florian Loitsch.
+    For doubles, the algorithm is "Grisu3" from the paper "Printing Floating-Point Numbers
+    Quickly and Accurately with Integers" by Florian Loitsch. For floats, it's "Ryu" from
+    the paper "Ryu: Fast Float-to-String Conversion" by Ulf Adams, which only needs 64-bit
+    arithmetic for a 32-bit value, so is several times faster.
+
+    Because this doesn't allocate anything, it's also the best way to write a large number
+    of values into a single string or stream.
 
     To use, just construct a FloatToStringBuffer with the value, and use its begin()/end()
     methods to iterate the result. Or use the floatToString() functions to just convert a
@@ -286,8 +291,16 @@ private:
             floatBits &= ~signMask;
         }
 
-        if (floatBits == nanBits)  return write (pos, 'n', 'a', 'n');
-        if (floatBits == infBits)  return write (pos, 'i', 'n', 'f');
+        if ((floatBits & exponentMask) == exponentMask)
+            return (floatBits & significandMask) != 0 ? write (pos, 'n', 'a', 'n')
+                                                      : write (pos, 'i', 'n', 'f');
+
+        if constexpr (sizeof (FloatOrDouble) == 4)
+        {
+            auto shortest = getShortestDecimal (static_cast<uint32_t> (floatBits));
+            auto totalLength = writeDecimalDigits (pos, shortest.digits);
+            return addDecimalPointAndExponent (pos, totalLength, shortest.exponent, maxDecimalPlaces < 0 ? defaultNumDecimalPlaces : maxDecimalPlaces);
+        }
 
         auto v = MantissaAndExponent::create (floatBits, floatBits & significandMask);
         Limits limits (v);
@@ -315,6 +328,231 @@ private:
         return writeAsExponentNotation (pos, totalLength, mantissaDigits - 1);
     }
 
+    //==============================================================================
+    /** The shortest decimal that will round-trip to a float is digits * 10 ^ exponent. */
+    struct ShortestDecimal
+    {
+        uint32_t digits;
+        int exponent;
+    };
+
+    static ShortestDecimal getShortestDecimal (uint32_t floatBits)
+    {
+        constexpr int floatBias = 127, pow5InverseBitCount = 59, pow5BitCount = 61;
+
+        static constexpr uint64_t pow5InverseSplit[] =
+        {
+            0x0800000000000001ull, 0x0666666666666667ull, 0x051eb851eb851eb9ull, 0x04189374bc6a7efaull,
+            0x068db8bac710cb2aull, 0x053e2d6238da3c22ull, 0x0431bde82d7b634eull, 0x06b5fca6af2bd216ull,
+            0x055e63b88c230e78ull, 0x044b82fa09b5a52dull, 0x06df37f675ef6eaeull, 0x057f5ff85e592558ull,
+            0x0465e6604b7a8447ull, 0x0709709a125da071ull, 0x05a126e1a84ae6c1ull, 0x0480ebe7b9d58567ull,
+            0x0734aca5f6226f0bull, 0x05c3bd5191b525a3ull, 0x049c97747490eae9ull, 0x0760f253edb4ab0eull,
+            0x05e72843249088d8ull, 0x04b8ed0283a6d3e0ull, 0x078e480405d7b966ull, 0x060b6cd004ac9452ull,
+            0x04d5f0a66a23a9dbull, 0x07bcb43d769f762bull, 0x063090312bb2c4efull, 0x04f3a68dbc8f03f3ull,
+            0x07ec3daf94180651ull, 0x065697bfa9acd1daull, 0x051212ffbaf0a7e2ull
+        };
+
+        static constexpr uint64_t pow5Split[] =
+        {
+            0x1000000000000000ull, 0x1400000000000000ull, 0x1900000000000000ull, 0x1f40000000000000ull,
+            0x1388000000000000ull, 0x186a000000000000ull, 0x1e84800000000000ull, 0x1312d00000000000ull,
+            0x17d7840000000000ull, 0x1dcd650000000000ull, 0x12a05f2000000000ull, 0x174876e800000000ull,
+            0x1d1a94a200000000ull, 0x12309ce540000000ull, 0x16bcc41e90000000ull, 0x1c6bf52634000000ull,
+            0x11c37937e0800000ull, 0x16345785d8a00000ull, 0x1bc16d674ec80000ull, 0x1158e460913d0000ull,
+            0x15af1d78b58c4000ull, 0x1b1ae4d6e2ef5000ull, 0x10f0cf064dd59200ull, 0x152d02c7e14af680ull,
+            0x1a784379d99db420ull, 0x108b2a2c28029094ull, 0x14adf4b7320334b9ull, 0x19d971e4fe8401e7ull,
+            0x1027e72f1f128130ull, 0x1431e0fae6d7217cull, 0x193e5939a08ce9dbull, 0x1f8def8808b02452ull,
+            0x13b8b5b5056e16b3ull, 0x18a6e32246c99c60ull, 0x1ed09bead87c0378ull, 0x13426172c74d822bull,
+            0x1812f9cf7920e2b6ull, 0x1e17b84357691b64ull, 0x12ced32a16a1b11eull, 0x178287f49c4a1d66ull,
+            0x1d6329f1c35ca4bfull, 0x125dfa371a19e6f7ull, 0x16f578c4e0a060b5ull, 0x1cb2d6f618c878e3ull,
+            0x11efc659cf7d4b8dull, 0x166bb7f0435c9e71ull, 0x1c06a5ec5433c60dull
+        };
+
+        auto pow5Bits   = [] (int e)  { return static_cast<int> (((static_cast<uint32_t> (e) * 1217359u) >> 19) + 1); };
+        auto log10Pow2  = [] (int e)  { return static_cast<uint32_t> ((static_cast<uint32_t> (e) * 78913u) >> 18); };
+        auto log10Pow5  = [] (int e)  { return static_cast<uint32_t> ((static_cast<uint32_t> (e) * 732923u) >> 20); };
+
+        auto isMultipleOfPowerOf5 = [] (uint32_t value, uint32_t power)
+        {
+            uint32_t count = 0;
+
+            for (; value % 5 == 0; value /= 5)
+                ++count;
+
+            return count >= power;
+        };
+
+        auto isMultipleOfPowerOf2 = [] (uint32_t value, uint32_t power)  { return (value & ((1u << power) - 1)) == 0; };
+
+        auto mulShift = [] (uint32_t m, uint64_t factor, int shift)
+        {
+            auto low  = static_cast<uint64_t> (m) * static_cast<uint32_t> (factor);
+            auto high = static_cast<uint64_t> (m) * static_cast<uint32_t> (factor >> 32);
+            return static_cast<uint32_t> (((low >> 32) + high) >> (shift - 32));
+        };
+
+        auto ieeeExponent = static_cast<uint32_t> ((floatBits & exponentMask) >> numSignificandBits);
+        auto ieeeMantissa = static_cast<uint32_t> (floatBits & significandMask);
+
+        auto e2 = ieeeExponent == 0 ? 1 - floatBias - numSignificandBits - 2
+                                    : static_cast<int> (ieeeExponent) - floatBias - numSignificandBits - 2;
+        auto m2 = ieeeExponent == 0 ? ieeeMantissa : (static_cast<uint32_t> (hiddenBit) | ieeeMantissa);
+        bool acceptBounds = (m2 & 1) == 0;
+
+        // The value and the half-way points to its neighbours, all multiplied by 4
+        auto mv = 4 * m2;
+        auto mp = 4 * m2 + 2;
+        uint32_t mmShift = ieeeMantissa != 0 || ieeeExponent <= 1;
+        auto mm = 4 * m2 - 1 - mmShift;
+
+        uint32_t vr, vp, vm;
+        int e10;
+        bool vmIsTrailingZeros = false, vrIsTrailingZeros = false;
+        uint32_t lastRemovedDigit = 0;
+
+        if (e2 >= 0)
+        {
+            auto q = log10Pow2 (e2);
+            e10 = static_cast<int> (q);
+            auto k = pow5InverseBitCount + pow5Bits (static_cast<int> (q)) - 1;
+            auto i = -e2 + static_cast<int> (q) + k;
+            vr = mulShift (mv, pow5InverseSplit[q], i);
+            vp = mulShift (mp, pow5InverseSplit[q], i);
+            vm = mulShift (mm, pow5InverseSplit[q], i);
+
+            if (q != 0 && (vp - 1) / 10 <= vm / 10)
+            {
+                auto l = pow5InverseBitCount + pow5Bits (static_cast<int> (q - 1)) - 1;
+                lastRemovedDigit = mulShift (mv, pow5InverseSplit[q - 1], -e2 + static_cast<int> (q) - 1 + l) % 10;
+            }
+
+            if (q <= 9)
+            {
+                // Only one of mp, mv, and mm can be a multiple of 5, if any
+                if (mv % 5 == 0)
+                    vrIsTrailingZeros = isMultipleOfPowerOf5 (mv, q);
+                else if (acceptBounds)
+                    vmIsTrailingZeros = isMultipleOfPowerOf5 (mm, q);
+                else
+                    vp -= isMultipleOfPowerOf5 (mp, q) ? 1 : 0;
+            }
+        }
+        else
+        {
+            auto q = log10Pow5 (-e2);
+            e10 = static_cast<int> (q) + e2;
+            auto i = -e2 - static_cast<int> (q);
+            auto k = pow5Bits (i) - pow5BitCount;
+            auto j = static_cast<int> (q) - k;
+            vr = mulShift (mv, pow5Split[i], j);
+            vp = mulShift (mp, pow5Split[i], j);
+            vm = mulShift (mm, pow5Split[i], j);
+
+            if (q != 0 && (vp - 1) / 10 <= vm / 10)
+            {
+                j = static_cast<int> (q) - 1 - (pow5Bits (i + 1) - pow5BitCount);
+                lastRemovedDigit = mulShift (mv, pow5Split[i + 1], j) % 10;
+            }
+
+            if (q <= 1)
+            {
+                // mv = 4 * m2, so it always has at least two trailing zero bits
+                vrIsTrailingZeros = true;
+
+                if (acceptBounds)
+                    vmIsTrailingZeros = mmShift == 1;
+                else
+                    --vp;
+            }
+            else if (q < 31)
+            {
+                vrIsTrailingZeros = isMultipleOfPowerOf2 (mv, q - 1);
+            }
+        }
+
+        // Remove digits until the bounds would no longer be distinguishable
+        int removed = 0;
+        uint32_t output;
+
+        if (vmIsTrailingZeros || vrIsTrailingZeros)
+        {
+            for (; vp / 10 > vm / 10; ++removed)
+            {
+                vmIsTrailingZeros &= vm % 10 == 0;
+                vrIsTrailingZeros &= lastRemovedDigit == 0;
+                lastRemovedDigit = vr % 10;
+                vr /= 10;
+                vp /= 10;
+                vm /= 10;
+            }
+
+            if (vmIsTrailingZeros)
+            {
+                for (; vm % 10 == 0; ++removed)
+                {
+                    vrIsTrailingZeros &= lastRemovedDigit == 0;
+                    lastRemovedDigit = vr % 10;
+                    vr /= 10;
+                    vp /= 10;
+                    vm /= 10;
+                }
+            }
+
+            // Round to even if the exact value ends in 5
+            if (vrIsTrailingZeros && lastRemovedDigit == 5 && vr % 2 == 0)
+                lastRemovedDigit = 4;
+
+            output = vr + (((vr == vm && (! acceptBounds || ! vmIsTrailingZeros)) || lastRemovedDigit >= 5) ? 1 : 0);
+        }
+        else
+        {
+            for (; vp / 10 > vm / 10; ++removed)
+            {
+                lastRemovedDigit = vr % 10;
+                vr /= 10;
+                vp /= 10;
+                vm /= 10;
+            }
+
+            output = vr + ((vr == vm || lastRemovedDigit >= 5) ? 1 : 0);
+        }
+
+        // Rounding up can leave a trailing zero, which doesn't need to be printed
+        for (; output % 10 == 0; output /= 10)
+            ++removed;
+
+        return { output, e10 + removed };
+    }
+
+    static uint32_t writeDecimalDigits (char* dest, uint32_t n)
+    {
+        static constexpr char digitPairs[] = "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+                                             "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+                                             "8081828384858687888990919293949596979899";
+
+        auto length = static_cast<uint32_t> (math::getNumDecimalDigits (n));
+        auto pos = dest + length;
+
+        for (; n >= 100; n /= 100)
+        {
+            auto pair = digitPairs + (n % 100) * 2;
+            *--pos = pair[1];
+            *--pos = pair[0];
+        }
+
+        if (n >= 10)
+        {
+            *--pos = digitPairs[n * 2 + 1];
+            *--pos = digitPairs[n * 2];
+        }
+        else
+        {
+            *--pos = static_cast<char> ('0' + n);
+        }
+
+        return length;
+    }
+
     static uint64_t getFloatBits (double value)    { uint64_t i; memcpy (&i, &value, sizeof (i)); return i; }
     static uint64_t getFloatBits (float value)     { uint32_t i; memcpy (&i, &value, sizeof (i)); return i; }
     static bool isZero (uint64_t floatBits)        { return (floatBits & (exponentMask | significandMask)) == 0; }
@@ -325,8 +563,6 @@ private:
     static constexpr uint64_t  hiddenBit                = 1ull << numSignificandBits;
     static constexpr uint64_t  significandMask          = hiddenBit - 1;
     static constexpr uint64_t  exponentMask             = sizeof (FloatOrDouble) == 8 ? 0x7ff0000000000000ull : 0x7f800000ull;
-    static constexpr uint64_t  nanBits                  = sizeof (FloatOrDouble) == 8 ? 0x7ff8000000000000ull : 0x7fc00000ull;
-    static constexpr uint64_t  infBits                  = sizeof (FloatOrDouble) == 8 ? 0x7ff0000000000000ull : 0x7f800000ull;
     static constexpr uint32_t  powersOf10[]             = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
 
     static MantissaAndExponent createPowerOf10 (int exponentBase2, int& K)
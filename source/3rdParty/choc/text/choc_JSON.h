@@ -52,6 +52,34 @@ value::Value parse (text::UTF8Pointer);
 */
 value::Value parse (std::string_view);
 
+/** Parses some JSON text, calling methods on a handler object for each item that it
+    finds, rather than building a choc::value::Value. This avoids allocating anything
+    for the items that the caller isn't interested in.
+
+    The handler must have these methods, which are called in the order that the items
+    appear in the text:
+    @code
+        void onNull();
+        void onBool (bool);
+        void onInt (int64_t);
+        void onDouble (double);
+        void onString (std::string_view);
+        void onArrayStart();
+        void onArrayEnd();
+        void onObjectStart();
+        void onMemberName (std::string_view);   // called before each member's value
+        void onObjectEnd();
+    @endcode
+
+    A string that contains no escape sequences is passed as a view directly into the
+    source text. Otherwise it's unescaped into a temporary buffer which is re-used for
+    the next string, so the views passed to onString() and onMemberName() are only valid
+    until the next call to one of them. Any errors will result in a ParseError exception
+    being thrown.
+*/
+template <typename Handler>
+void parseWithHandler (std::string_view, Handler&);
+
 //==============================================================================
 /** Formats a value as a JSON string. */
 std::string toString (const value::ValueView&);
@@ -231,235 +259,395 @@ static inline LineAndColumn getLineAndColumn (StringType start, StringType targe
     throw ParseError { error, pos.line, pos.column };
 }
 
-inline value::Value parse (text::UTF8Pointer text)
+template <typename Handler>
+struct Parser
 {
-    struct Parser
+    text::UTF8Pointer source, current;
+    Handler& handler;
+    std::string unescapedString;
+
+    bool isEOF() const            { return current.empty(); }
+    uint32_t peek() const         { return *current; }
+    uint32_t pop()                { return current.popFirstChar(); }
+    bool popIf (char c)           { return current.skipIfStartsWith (c); }
+    bool popIf (const char* c)    { return current.skipIfStartsWith (c); }
+
+    static bool isWhitespace (uint32_t c)   { return c == ' ' || (c <= 13 && c >= 9); }
+    void skipWhitespace()                   { auto p = current; while (isWhitespace (p.popFirstChar())) current = p; }
+
+    [[noreturn]] void throwError (const char* error, text::UTF8Pointer errorPos)    { throwParseError (error, source, errorPos); }
+    [[noreturn]] void throwError (const char* error)                                { throwError (error, current); }
+
+    void parseTopLevel()
     {
-        text::UTF8Pointer source, current;
+        skipWhitespace();
 
-        bool isEOF() const            { return current.empty(); }
-        uint32_t peek() const         { return *current; }
-        uint32_t pop()                { return current.popFirstChar(); }
-        bool popIf (char c)           { return current.skipIfStartsWith (c); }
-        bool popIf (const char* c)    { return current.skipIfStartsWith (c); }
+        if (popIf ('[')) return parseArray();
+        if (popIf ('{')) return parseObject();
+        if (! isEOF()) throwError ("Expected an object or array");
+    }
 
-        static bool isWhitespace (uint32_t c)   { return c == ' ' || (c <= 13 && c >= 9); }
-        void skipWhitespace()                   { auto p = current; while (isWhitespace (p.popFirstChar())) current = p; }
+    void parseArray()
+    {
+        handler.onArrayStart();
+        auto arrayStart = current;
 
-        [[noreturn]] void throwError (const char* error, text::UTF8Pointer errorPos)    { throwParseError (error, source, errorPos); }
-        [[noreturn]] void throwError (const char* error)                                { throwError (error, current); }
+        skipWhitespace();
+        if (popIf (']')) return handler.onArrayEnd();
 
-        value::Value parseTopLevel()
+        for (;;)
         {
             skipWhitespace();
+            if (isEOF())  throwError ("Unexpected EOF in array declaration", arrayStart);
+
+            parseValue();
+            skipWhitespace();
 
-            if (popIf ('[')) return parseArray();
-            if (popIf ('{')) return parseObject();
-            if (! isEOF()) throwError ("Expected an object or array");
-            return {};
+            if (popIf (',')) continue;
+            if (popIf (']')) break;
+            throwError ("Expected ',' or ']'");
         }
 
-        value::Value parseArray()
+        handler.onArrayEnd();
+    }
+
+    void parseObject()
+    {
+        handler.onObjectStart();
+        auto objectStart = current;
+
+        skipWhitespace();
+        if (popIf ('}')) return handler.onObjectEnd();
+
+        for (;;)
         {
-            auto result = value::createEmptyArray();
-            auto arrayStart = current;
+            skipWhitespace();
+            if (isEOF())  throwError ("Unexpected EOF in object declaration", objectStart);
+
+            if (! popIf ('"')) throwError ("Expected a name");
+            auto errorPos = current;
+            auto name = parseString();
 
+            if (name.empty())
+                throwError ("Property names cannot be empty", errorPos);
+
+            handler.onMemberName (name);
+            skipWhitespace();
+            errorPos = current;
+            if (! popIf (':')) throwError ("Expected ':'");
+            parseValue();
             skipWhitespace();
-            if (popIf (']')) return result;
 
-            for (;;)
-            {
-                skipWhitespace();
-                if (isEOF())  throwError ("Unexpected EOF in array declaration", arrayStart);
+            if (popIf (',')) continue;
+            if (popIf ('}')) break;
+            throwError ("Expected ',' or '}'");
+        }
 
-                result.addArrayElement (parseValue());
-                skipWhitespace();
+        handler.onObjectEnd();
+    }
 
-                if (popIf (',')) continue;
-                if (popIf (']')) break;
-                throwError ("Expected ',' or ']'");
-            }
+    void parseValue()
+    {
+        skipWhitespace();
+        auto startPos = current;
 
-            return result;
+        switch (pop())
+        {
+            case '[':                                 return parseArray();
+            case '{':                                 return parseObject();
+            case '"':                                 return handler.onString (parseString());
+            case '-':                                 skipWhitespace(); return parseNumber (true);
+            case '0': case '1': case '2':
+            case '3': case '4': case '5':
+            case '6': case '7': case '8': case '9':   current = startPos; return parseNumber (false);
+            default:                                  break;
         }
 
-        value::Value parseObject()
+        current = startPos;
+        if (popIf ("null"))   return handler.onNull();
+        if (popIf ("true"))   return handler.onBool (true);
+        if (popIf ("false"))  return handler.onBool (false);
+
+        throwError ("Syntax error");
+    }
+
+    void parseNumber (bool negate)
+    {
+        auto startPos = current;
+        bool isDouble = false;
+
+        for (;;)
         {
-            auto result = value::createObject ("JSON");
-            auto objectStart = current;
+            auto lastPos = current;
+            auto c = pop();
 
-            skipWhitespace();
-            if (popIf ('}')) return result;
+            if (c >= '0' && c <= '9')
+                continue;
+
+            if (! isDouble && (c == 'e' || c == 'E' || c == '.'))
+            {
+                isDouble = true;
+                continue;
+            }
 
-            for (;;)
+            if (isWhitespace (c) || c == ',' || c == '}' || c == ']' || c == 0)
             {
-                skipWhitespace();
-                if (isEOF())  throwError ("Unexpected EOF in object declaration", objectStart);
+                current = lastPos;
+                char* endOfParsedNumber = nullptr;
 
-                if (! popIf ('"')) throwError ("Expected a name");
-                auto errorPos = current;
-                auto name = parseString ('"');
+                if (! isDouble)
+                {
+                    auto v = std::strtoll (startPos.data(), &endOfParsedNumber, 10);
 
-                if (name.empty())
-                    throwError ("Property names cannot be empty", errorPos);
+                    if (endOfParsedNumber == lastPos.data()
+                         && v != std::numeric_limits<long long>::max()
+                         && v != std::numeric_limits<long long>::min())
+                        return handler.onInt (static_cast<int64_t> (negate ? -v : v));
+                }
 
-                skipWhitespace();
-                errorPos = current;
-                if (! popIf (':')) throwError ("Expected ':'");
-                result.addMember (std::move (name), parseValue());
-                skipWhitespace();
+                auto v = std::strtod (startPos.data(), &endOfParsedNumber);
 
-                if (popIf (',')) continue;
-                if (popIf ('}')) break;
-                throwError ("Expected ',' or '}'");
+                if (endOfParsedNumber == lastPos.data())
+                    return handler.onDouble (negate ? -v : v);
             }
 
-            return result;
+            throwError ("Syntax error in number", lastPos);
         }
+    }
 
-        value::Value parseValue()
-        {
-            skipWhitespace();
-            auto startPos = current;
+    /** Parses a string whose opening quote has already been read. Unless it needs
+        unescaping, this returns a view of the source text.
+    */
+    std::string_view parseString()
+    {
+        auto start = current.data();
+        auto end = start;
 
-            switch (pop())
+        for (;; ++end)
+        {
+            if (*end == '"')
             {
-                case '[':                                 return parseArray();
-                case '{':                                 return parseObject();
-                case '"':                                 return value::createString (parseString ('"'));
-                case '-':                                 skipWhitespace(); return parseNumber (true);
-                case '0': case '1': case '2':
-                case '3': case '4': case '5':
-                case '6': case '7': case '8': case '9':   current = startPos; return parseNumber (false);
-                default:                                  break;
+                current = text::UTF8Pointer (end + 1);
+                return std::string_view (start, static_cast<size_t> (end - start));
             }
 
-            current = startPos;
-            if (popIf ("null"))   return {};
-            if (popIf ("true"))   return value::createBool (true);
-            if (popIf ("false"))  return value::createBool (false);
+            if (*end == '\\')
+                break;
 
-            throwError ("Syntax error");
+            if (*end == 0)
+                throwError ("Unexpected EOF in string constant", text::UTF8Pointer (end));
         }
 
-        value::Value parseNumber (bool negate)
+        unescapedString.assign (start, static_cast<size_t> (end - start));
+        current = text::UTF8Pointer (end);
+
+        for (;;)
         {
-            auto startPos = current;
-            bool isDouble = false;
+            auto errorPos = current;
+
+            if (isEOF())
+                throwError ("Unexpected EOF in string constant", errorPos);
 
-            for (;;)
+            auto c = pop();
+
+            if (c == '"')
+                break;
+
+            if (c == '\\')
             {
-                auto lastPos = current;
-                auto c = pop();
+                errorPos = current;
 
-                if (c >= '0' && c <= '9')
-                    continue;
+                if (isEOF())
+                    throwError ("Unexpected EOF in string constant", errorPos);
 
-                if (! isDouble && (c == 'e' || c == 'E' || c == '.'))
+                c = pop();
+
+                switch (c)
                 {
-                    isDouble = true;
-                    continue;
+                    case 'a':  c = '\a'; break;
+                    case 'b':  c = '\b'; break;
+                    case 'f':  c = '\f'; break;
+                    case 'n':  c = '\n'; break;
+                    case 'r':  c = '\r'; break;
+                    case 't':  c = '\t'; break;
+                    case 'u':  c = parseUnicodeCharacterNumber (false); break;
+                    default:   break;
                 }
+            }
 
-                if (isWhitespace (c) || c == ',' || c == '}' || c == ']' || c == 0)
-                {
-                    current = lastPos;
-                    char* endOfParsedNumber = nullptr;
+            char utf8Bytes[8];
+            auto numBytes = text::convertUnicodeCodepointToUTF8 (utf8Bytes, c);
+            unescapedString.append (utf8Bytes, numBytes);
+        }
 
-                    if (! isDouble)
-                    {
-                        auto v = std::strtoll (startPos.data(), &endOfParsedNumber, 10);
+        return unescapedString;
+    }
 
-                        if (endOfParsedNumber == lastPos.data()
-                             && v != std::numeric_limits<long long>::max()
-                             && v != std::numeric_limits<long long>::min())
-                            return value::createInt64 (static_cast<int64_t> (negate ? -v : v));
-                    }
+    uint32_t parseUnicodeCharacterNumber (bool isLowSurrogate)
+    {
+        uint32_t result = 0;
 
-                    auto v = std::strtod (startPos.data(), &endOfParsedNumber);
+        for (int i = 4; --i >= 0;)
+        {
+            auto errorPos = current;
+            auto digit = pop();
 
-                    if (endOfParsedNumber == lastPos.data())
-                        return value::createFloat64 (negate ? -v : v);
-                }
+            if (digit >= '0' && digit <= '9')         digit -= '0';
+            else if (digit >= 'a' && digit <= 'f')    digit = 10 + (digit - 'a');
+            else if (digit >= 'A' && digit <= 'F')    digit = 10 + (digit - 'A');
+            else throwError ("Syntax error in unicode character", errorPos);
 
-                throwError ("Syntax error in number", lastPos);
-            }
+            result = (result << 4) + digit;
         }
 
-        std::string parseString (uint32_t terminatingQuote)
+        if (isLowSurrogate && ! text::isUnicodeLowSurrogate (result))
+            throwError ("Expected a unicode low surrogate codepoint");
+
+        if (text::isUnicodeHighSurrogate (result))
         {
-            std::ostringstream s;
+            if (! isLowSurrogate && popIf ("\\u"))
+                return text::createUnicodeFromHighAndLowSurrogates (result, parseUnicodeCharacterNumber (true));
 
-            for (;;)
-            {
-                auto c = pop();
+            throwError ("Expected a unicode low surrogate codepoint");
+        }
 
-                if (c == terminatingQuote)
-                    break;
+        return result;
+    }
+};
 
-                if (c == '\\')
-                {
-                    auto errorPos = current;
-                    c = pop();
-
-                    switch (c)
-                    {
-                        case 'a':  c = '\a'; break;
-                        case 'b':  c = '\b'; break;
-                        case 'f':  c = '\f'; break;
-                        case 'n':  c = '\n'; break;
-                        case 'r':  c = '\r'; break;
-                        case 't':  c = '\t'; break;
-                        case 'u':  c = parseUnicodeCharacterNumber (false); break;
-                        case 0:    throwError ("Unexpected EOF in string constant", errorPos);
-                        default:   break;
-                    }
-                }
+/** The handler that parse() uses to build a value::Value.
 
-                char utf8Bytes[8];
-                auto numBytes = text::convertUnicodeCodepointToUTF8 (utf8Bytes, c);
+    Appending elements to an array one at a time means re-building its type for each one,
+    so the numbers at the start of an array are collected separately. If the array turns
+    out to contain only numbers, it becomes a packed array of int64 or, if any of them has
+    a fractional part or exponent, of float64. Otherwise the numbers are added as normal
+    elements when the first item that isn't a number appears.
+*/
+struct ValueBuilder
+{
+    value::Value result;
 
-                for (uint32_t i = 0; i < numBytes; ++i)
-                    s << utf8Bytes[i];
-            }
+    void onNull()                        { add ({}); }
+    void onBool (bool b)                 { add (value::createBool (b)); }
+    void onString (std::string_view s)   { add (value::createString (s)); }
 
-            return s.str();
+    void onInt (int64_t n)
+    {
+        if (auto c = getPackableArray())
+            return c->numbers.push_back ({ static_cast<double> (n), n, false });
+
+        add (value::createInt64 (n));
+    }
+
+    void onDouble (double n)
+    {
+        if (auto c = getPackableArray())
+        {
+            c->hasDoubles = true;
+            return c->numbers.push_back ({ n, 0, true });
         }
 
-        uint32_t parseUnicodeCharacterNumber (bool isLowSurrogate)
+        add (value::createFloat64 (n));
+    }
+
+    void onArrayStart()                        { startContainer (value::createEmptyArray(), true); }
+    void onObjectStart()                       { startContainer (value::createObject ("JSON"), false); }
+    void onMemberName (std::string_view name)  { stack.back().memberName = name; }
+    void onObjectEnd()                         { endContainer(); }
+
+    void onArrayEnd()
+    {
+        auto& c = stack.back();
+
+        if (c.canPack && ! c.numbers.empty())
         {
-            uint32_t result = 0;
+            auto size = static_cast<uint32_t> (c.numbers.size());
 
-            for (int i = 4; --i >= 0;)
-            {
-                auto errorPos = current;
-                auto digit = pop();
+            if (c.hasDoubles)
+                c.value = value::createArray (size, [&] (uint32_t i) { return c.numbers[i].doubleValue; });
+            else
+                c.value = value::createArray (size, [&] (uint32_t i) { return c.numbers[i].intValue; });
+        }
 
-                if (digit >= '0' && digit <= '9')         digit -= '0';
-                else if (digit >= 'a' && digit <= 'f')    digit = 10 + (digit - 'a');
-                else if (digit >= 'A' && digit <= 'F')    digit = 10 + (digit - 'A');
-                else throwError ("Syntax error in unicode character", errorPos);
+        endContainer();
+    }
 
-                result = (result << 4) + digit;
-            }
+private:
+    struct Number
+    {
+        double doubleValue;
+        int64_t intValue;
+        bool isDouble;
+    };
 
-            if (isLowSurrogate && ! text::isUnicodeLowSurrogate (result))
-                throwError ("Expected a unicode low surrogate codepoint");
+    struct Container
+    {
+        value::Value value;
+        std::string memberName;
+        bool isArray = false, canPack = true, hasDoubles = false;
+        std::vector<Number> numbers;
+    };
 
-            if (text::isUnicodeHighSurrogate (result))
-            {
-                if (! isLowSurrogate && popIf ("\\u"))
-                    return text::createUnicodeFromHighAndLowSurrogates (result, parseUnicodeCharacterNumber (true));
+    std::vector<Container> stack;
 
-                throwError ("Expected a unicode low surrogate codepoint");
-            }
+    Container* getPackableArray()
+    {
+        if (! stack.empty() && stack.back().isArray && stack.back().canPack)
+            return std::addressof (stack.back());
 
-            return result;
+        return nullptr;
+    }
+
+    void add (value::Value v)
+    {
+        if (stack.empty())
+        {
+            result = std::move (v);
+            return;
         }
-    };
 
-    Parser p { text, text };
-    return p.parseTopLevel();
+        auto& c = stack.back();
+
+        if (! c.isArray)
+            return c.value.addMember (std::move (c.memberName), std::move (v));
+
+        if (c.canPack)
+        {
+            c.canPack = false;
+
+            for (auto& n : c.numbers)
+            {
+                if (n.isDouble)
+                    c.value.addArrayElement (n.doubleValue);
+                else
+                    c.value.addArrayElement (n.intValue);
+            }
+        }
+
+        c.value.addArrayElement (std::move (v));
+    }
+
+    void startContainer (value::Value v, bool isArray)
+    {
+        stack.emplace_back();
+        stack.back().value = std::move (v);
+        stack.back().isArray = isArray;
+    }
+
+    void endContainer()
+    {
+        auto v = std::move (stack.back().value);
+        stack.pop_back();
+        add (std::move (v));
+    }
+};
+
+inline value::Value parse (text::UTF8Pointer text)
+{
+    ValueBuilder builder;
+    Parser<ValueBuilder> p { text, text, builder, {} };
+    p.parseTopLevel();
+    return std::move (builder.result);
 }
 
 inline value::Value parse (const char* text, size_t numbytes)
@@ -474,6 +662,18 @@ inline value::Value parse (const char* text, size_t numbytes)
 
 inline value::Value parse (std::string_view text)       { return parse (text.data(), text.length()); }
 
+template <typename Handler>
+void parseWithHandler (std::string_view text, Handler& handler)
+{
+    CHOC_ASSERT (text.data() != nullptr);
+
+    if (auto error = text::findInvalidUTF8Data (text.data(), text.length()))
+        throwParseError ("Illegal UTF8 data", text::UTF8Pointer (text.data()), text::UTF8Pointer (error));
+
+    Parser<Handler> p { text::UTF8Pointer (text.data()), text::UTF8Pointer (text.data()), handler, {} };
+    p.parseTopLevel();
+}
+
 
 } // namespace choc::json
 
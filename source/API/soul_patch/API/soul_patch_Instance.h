@@ -43,6 +43,26 @@ public:
         If no entry is found for this key, the method returns 0.
     */
     virtual uint64_t readItemFromCache (const char* key, void* destAddress, uint64_t destSize) = 0;
+
+    /** A read-only block of data returned by getItemView(). */
+    class ItemView  : public RefCountedBase
+    {
+    public:
+        using Ptr = RefCountingPtr<ItemView>;
+
+        /** Returns the item's data, which remains valid for as long as this object exists. */
+        virtual const void* getData() = 0;
+
+        /** Returns the size of the item's data in bytes. */
+        virtual uint64_t getSize() = 0;
+    };
+
+    /** Returns a read-only view of an item without copying it, e.g. by memory-mapping the
+        file that holds it.
+        If no entry is found for this key, or the cache can't provide a view of it, this
+        returns nullptr, and the caller will fall back to using readItemFromCache().
+    */
+    virtual ItemView* getItemView (const char* key)     { (void) key; return nullptr; }
 };
 
 //==============================================================================
@@ -106,6 +126,10 @@ public:
 
     If one of these objects is provided to the PatchInstance::compileNewPlayer() method,
     then it will be called with any messages.
+
+    The messages are formatted and delivered on a background thread which belongs to
+    the player, rather than on the thread that calls PatchPlayer::render(), so they may
+    arrive a short while after the audio which produced them.
 */
 class ConsoleMessageHandler  : public RefCountedBase
 {
@@ -160,6 +184,18 @@ public:
                                            SourceFilePreprocessor* preprocessor,
                                            ExternalDataProvider* externalDataProvider,
                                            ConsoleMessageHandler* consoleHandler) = 0;
+
+    /** Asks the instance to keep some spare players ready, so that compileNewPlayer() can
+        hand one of them out straight away instead of building it.
+
+        Once a call to compileNewPlayer() has succeeded, the instance builds spare players with
+        the same configuration and callbacks in the background, until it has this many.
+        A later call which uses an identical configuration and callbacks is given one of the
+        spares, as long as none of the patch's files have changed, and a replacement is built.
+        While spares are being built, the instance holds a reference to the callbacks, and they
+        may be called on one of the library's compile threads. The default of zero keeps no spares.
+    */
+    virtual void setNumSparePlayers (uint32_t numPlayers)      { (void) numPlayers; }
 };
 
 
@@ -50,6 +50,26 @@ struct MIDIMessage
     uint8_t data[4];
 };
 
+//==============================================================================
+/** A time-stamped value for one of a player's parameters.
+    @see PatchPlayer::RenderContext
+*/
+struct ParameterAutomationPoint
+{
+    /** The frame index is a sample offset into the current block of data being
+        processed by a call to PatchPlayer::render().
+    */
+    uint32_t frameIndex;
+
+    /** The index of the parameter in the list returned by PatchPlayer::getParameters(). */
+    uint32_t parameterIndex;
+
+    /** The value that the parameter should have at this frame. Unlike Parameter::setValue(),
+        this isn't clamped or quantised, so it should already be a legal value.
+    */
+    float value;
+};
+
 //==============================================================================
 /** Gives information about one of the patch's buses.
     Currently this is a minimal bus description, just providing the number of
@@ -89,12 +109,68 @@ struct Parameter  : public RefCountedBase
     virtual Span<const char*> getPropertyNames() const = 0;
 };
 
+//==============================================================================
+/** Timing figures for one of the nodes that a player renders.
+    @see PatchPlayer::getNodeTimings
+*/
+struct NodeTiming
+{
+    String::Ptr name;
+    uint64_t numBlocks = 0, totalNanoseconds = 0, maxNanoseconds = 0;
+};
+
+//==============================================================================
+/** A static estimate of the cost of one of the processors or graphs in a patch.
+    @see PatchPlayer::getCostEstimates
+*/
+struct CostEstimate
+{
+    /** Used for the operation counts if the code contains loops which can't be bounded. */
+    static constexpr uint64_t unbounded = ~(uint64_t) 0;
+
+    String::Ptr name;
+
+    /** The number of bytes of state that the processor or graph needs. */
+    uint64_t stateSize = 0;
+
+    /** Upper bounds on the number of operations needed to render a frame, and to handle an event. */
+    uint64_t maxOperationsPerFrame = 0, maxOperationsPerEvent = 0;
+};
+
+//==============================================================================
+/** An estimate of the memory that a PatchPlayer is using, in bytes.
+    @see PatchPlayer::getMemoryUsage()
+*/
+struct MemoryUsage
+{
+    uint64_t programSize = 0;       ///< The compiled program's data structures, including its constant table and string dictionary
+    uint64_t codeSize = 0;          ///< The code that was generated for the program
+    uint64_t stateSize = 0;         ///< The processors' state, plus the copies of it that are used by reset()
+    uint64_t streamBufferSize = 0;  ///< The buffers for the audio, MIDI and events passing through the patch's endpoints
+    uint64_t constantDataSize = 0;  ///< The player's own copies of the program's constants
+    uint64_t externalDataSize = 0;  ///< The player's own copies of the data that was loaded for external variables
+
+    /** Constant and external data which is shared with any other players that have loaded the
+        same data, so it only needs to be counted once for all of them.
+    */
+    uint64_t sharedDataSize = 0;
+};
+
 //==============================================================================
 /** Holds the settings needed when compiling an instance of a PatchPlayer. */
 struct PatchPlayerConfiguration
 {
     double sampleRate = 0;
     uint32_t maxFramesPerBlock = 0;
+
+    /** Set this for players which will only be used for offline, faster-than-realtime rendering.
+        It lets the player render each call in blocks as large as maxFramesPerBlock, rather than
+        splitting it into the smaller chunks that keep parameter changes responsive in realtime use.
+    */
+    bool isOfflineRender = false;
+
+    /** The optimisation level to build with, from 0 to 3, or -1 for the default. */
+    int optimisationLevel = -1;
 };
 
 //==============================================================================
@@ -217,6 +293,23 @@ public:
             maximumMIDIMessagesOut, and numMIDIMessagesOut will return a larger number to
             indicate how many would have been added if it had been possible. */
         uint32_t numMIDIMessagesOut;
+
+        /** An optional array of parameter values to apply during this block, sorted by frameIndex.
+            See the numParameterAutomationPoints variable for the number of points.
+
+            These don't make the player split the block up any further than it would anyway.
+            Within each chunk that it renders, a parameter which is a stream ramps from the start
+            of the chunk to the value of its last point in that chunk, arriving exactly on that
+            point's frame. Other parameters take the value of their last point in the chunk at
+            the start of it. A chunk ends at each incoming MIDI message, and is never longer than
+            512 frames unless the player is an offline one.
+
+            Afterwards, each automated parameter's getValue() returns its last automated value.
+        */
+        const ParameterAutomationPoint* parameterAutomation = nullptr;
+
+        /** Number of points in the parameterAutomation array */
+        uint32_t numParameterAutomationPoints = 0;
     };
 
     /** Renders the next block of audio.
@@ -224,6 +317,49 @@ public:
         MIDI data that is needed.
     */
     virtual RenderResult render (RenderContext&) = 0;
+
+    //==============================================================================
+    /** Turns on or off the measurement of how long each node of the patch takes to
+        render, and resets any timings that were gathered previously.
+    */
+    virtual void setProfilingEnabled (bool shouldProfile) = 0;
+
+    /** Returns the per-node timings gathered since profiling was enabled.
+        This is intended to be called from a background thread while the player is rendering.
+        The list that is returned remains valid until the next call to this method.
+    */
+    virtual Span<NodeTiming> getNodeTimings() = 0;
+
+    //==============================================================================
+    /** Copies the player's internal state, such as the contents of its delay lines and
+        envelopes, into a binary blob which can be passed to restoreState() later.
+        If dest is nullptr or destSize is too small, this returns the size that's needed.
+        It returns 0 if the player can't save its state.
+        Calls to this method must not be made concurrently with the render() method!
+    */
+    virtual uint64_t saveState (void* dest, uint64_t destSize) = 0;
+
+    /** Restores a state that was returned by saveState(). The blob is tagged with a hash of
+        the program and its build settings, and this will fail and return false if it doesn't
+        match this player's. The parameter values aren't part of the state.
+        Calls to this method must not be made concurrently with the render() method!
+    */
+    virtual bool restoreState (const void* data, uint64_t size) = 0;
+
+    //==============================================================================
+    /** Returns an estimate of the state size and worst-case processing cost of the patch's main
+        processor, followed by one for each of the processors and graphs that it uses.
+        These are worked out by the compiler without running any code, so they can be used to
+        decide whether there's enough headroom to run a patch before it starts rendering.
+        The operation counts are only a rough guide, and will be CostEstimate::unbounded if the
+        code contains loops whose length depends on things like incoming data.
+    */
+    virtual Span<CostEstimate> getCostEstimates() const = 0;
+
+    /** Returns an estimate of the memory that the player is using, so that a host can work out
+        how many players will fit on a machine. This can be called from any thread.
+    */
+    virtual MemoryUsage getMemoryUsage() const = 0;
 };
 
 } // namespace patch
@@ -15,6 +15,8 @@
 
 #include "../API/soul_patch.h"
 #include "../../soul_venue/soul_ProgramDefinitions.h"
+#include "soul_patch_CompileService.h"
+#include "soul_patch_FileWatcher.h"
 
 namespace soul
 {
@@ -30,11 +32,15 @@ namespace patch
 
     NOTE: Unlike a normal AudioProcessor, you also need to provide a callback
     function using the askHostToReinitialise parameter - the object will
-    use its own background thread to recompile the SOUL code, and will use
-    this callback to tell the host when its configuration has changed.
+    recompile the SOUL code on a background thread, and will use this callback
+    to tell the host when its configuration has changed.
+
+    The compilation is done by a PatchCompileService which is shared by all the
+    processors in the process, so loading a large number of them at once won't
+    start more compiles than there are cores.
 */
 struct SOULPatchAudioProcessor    : public juce::AudioPluginInstance,
-                                    private juce::Thread,
+                                    private juce::Timer,
                                     private juce::AsyncUpdater
 {
     /** Creates a SOULPatchAudioProcessor from a PatchInstance.
@@ -48,7 +54,9 @@ struct SOULPatchAudioProcessor    : public juce::AudioPluginInstance,
                                     for external variable data
         @param millisecondsBetweenFileChangeChecks determines how often the class will re-scan the source
                                     files to see whether they've changed and might need to be re-compiled.
-                                    Set this to 0 or less to disable checking.
+                                    Set this to 0 or less to disable checking. Where the patch's folder can
+                                    be watched for changes by the shared PatchFileWatcher, it's only
+                                    re-scanned when something in it changes, and this is ignored.
     */
     SOULPatchAudioProcessor (soul::patch::PatchInstance::Ptr patchToLoad,
                              soul::patch::CompilerCache::Ptr compilerCache = {},
@@ -56,8 +64,7 @@ struct SOULPatchAudioProcessor    : public juce::AudioPluginInstance,
                              soul::patch::ExternalDataProvider::Ptr externalDataProvider = {},
                              soul::patch::ConsoleMessageHandler::Ptr consoleMessageHandler = {},
                              int millisecondsBetweenFileChangeChecks = 1000)
-       : juce::Thread ("SOUL Compiler"),
-         patch (std::move (patchToLoad)),
+       : patch (std::move (patchToLoad)),
          cache (std::move (compilerCache)),
          preprocessor (std::move (sourcePreprocessor)),
          externalData (std::move (externalDataProvider)),
@@ -65,14 +72,26 @@ struct SOULPatchAudioProcessor    : public juce::AudioPluginInstance,
          millisecsBetweenFileChecks (millisecondsBetweenFileChangeChecks <= 0 ? -1 : millisecondsBetweenFileChangeChecks)
     {
         jassert (patch != nullptr);
-        startThread (3);
+
+        compileJob.function = [this] { compileIfNeeded(); };
+        compileJob.key = String::Ptr (patch->getLocation()->getAbsolutePath()).toString<std::string>();
+        fileWatcherClient.callback = [this] { compileService->addJob (compileJob); };
+
+        if (millisecsBetweenFileChecks > 0)
+            if (! fileWatcher->addClient (fileWatcherClient, getParentFolderPath (compileJob.key)))
+                startTimer (millisecsBetweenFileChecks);
     }
 
     ~SOULPatchAudioProcessor() override
     {
-        stopThread (100000);
+        stopTimer();
+        fileWatcher->removeClient (fileWatcherClient);
+        compileService->removeJob (compileJob);
+        cancelPendingUpdate();
+        releaseHotSwappedPlayers();
         player = {};
         patch = {};
+        deleteFrozenAudio();
     }
 
     //==============================================================================
@@ -89,12 +108,26 @@ struct SOULPatchAudioProcessor    : public juce::AudioPluginInstance,
         parameter list and other properties. After calling reinitialise(), the host
         can call prepareToPlay again and start playing the processor again.
 
-        The processor has its own background thread that re-compiles new SOUL patch
-        code behind the scenes while the plugin is still running, and once it has a
+        The processor re-compiles new SOUL patch code on a background thread
+        behind the scenes while the plugin is still running, and once it has a
         new build ready, it triggers a call to this function from the message thread.
+
+        If the new build has exactly the same buses and parameters as the one that is
+        currently running, the host isn't asked to do anything: the new player is
+        swapped in by the audio thread at the start of a block, with a one-block
+        crossfade from the old one, and the current parameter values are carried over.
     */
     std::function<void()> askHostToReinitialise;
 
+    /** The optimisation level to build the player with while the host is rendering offline.
+        When the host calls setNonRealtime(), a new player is built in the background for the
+        new mode and hot-swapped in when it's ready, as long as its buses and parameters match.
+        An offline player renders in chunks as large as the host's blocks rather than at most
+        512 frames, and can be built with a higher optimisation level than is used for live
+        playback, where a shorter build time matters more.
+    */
+    int offlineOptimisationLevel = 3;
+
     //==============================================================================
     /** This method should be called by the host when the processor is not being
         run, in response to the askHostToReinitialise function. It causes a refresh
@@ -108,6 +141,13 @@ struct SOULPatchAudioProcessor    : public juce::AudioPluginInstance,
         description = desc->description;
         showMIDIKeyboard = desc->isInstrument;
 
+        // The host has stopped the processor, so any player that was hot-swapped in
+        // can now be made the main one.
+        if (replacementPlayer == nullptr)
+            replacementPlayer = std::move (hotSwappedPlayer);
+
+        releaseHotSwappedPlayers();
+
         if (replacementPlayer != nullptr)
         {
             updateLastState();
@@ -133,12 +173,151 @@ struct SOULPatchAudioProcessor    : public juce::AudioPluginInstance,
         return errors.joinIntoString ("\n");
     }
 
+    /** Sets the priority with which this processor's compile jobs are run, relative to
+        those of other processors. Higher numbers are compiled first, so a host might use
+        this to get its visible or record-armed tracks ready before the others.
+    */
+    void setCompilePriority (int newPriority)
+    {
+        compileService->setPriority (compileJob, newPriority);
+    }
+
     /** Returns true if the patch compiled with no errors and can be played */
     bool isPlayable() const
     {
         return player != nullptr && player->isPlayable();
     }
 
+    //==============================================================================
+    /** Supplies the input for freeze(). It's called for each block with an empty buffer
+        to fill with the track's incoming audio, using the processor's own input channel
+        layout, and an empty MidiBuffer for its incoming MIDI. The startFrame is the position
+        of the block relative to the start of the render.
+    */
+    using FreezeInputSource = std::function<void(juce::AudioBuffer<float>& audio, juce::MidiBuffer& midi, juce::int64 startFrame)>;
+
+    /** Renders the patch's output into a temporary file, and then releases the player,
+        along with its compiled code and any external data that it loaded, until unfreeze()
+        is called. While frozen, processBlock() plays back the rendered audio at the host's
+        current timeline position, so a track that isn't being edited costs little more
+        than reading a memory-mapped file.
+
+        The render covers numFrames from the start of the host's timeline, and starts from
+        a freshly-reset player. If getInput is null, the player is given silence and no MIDI.
+
+        Like reinitialise(), this must only be called while the host isn't calling
+        processBlock(). It returns false, and leaves the processor unchanged, if the patch
+        isn't playable or the file can't be written.
+    */
+    bool freeze (juce::int64 numFrames, const FreezeInputSource& getInput = {})
+    {
+        if (isFrozen() || ! isPlayable() || numFrames <= 0 || numPatchOutputChannels == 0)
+            return false;
+
+        auto config = getConfigCopy();
+        auto file = juce::File::createTempFile (".wav");
+        std::unique_ptr<juce::AudioFormatWriter> writer;
+
+        {
+            auto stream = std::unique_ptr<juce::FileOutputStream> (file.createOutputStream());
+
+            if (stream != nullptr)
+                writer.reset (juce::WavAudioFormat().createWriterFor (stream.get(), config.sampleRate,
+                                                                      (unsigned int) numPatchOutputChannels, 32, {}, 0));
+
+            if (writer == nullptr)
+            {
+                stream.reset();
+                file.deleteFile();
+                return false;
+            }
+
+            stream.release();
+        }
+
+        // The state is stored so that unfreeze() can carry on from where the player was
+        updateLastState();
+
+        auto& playerToRender = getRenderingPlayer();
+        playerToRender.reset();
+
+        auto blockSize = (int) config.maxFramesPerBlock;
+        juce::MidiBuffer midi;
+        bool renderedOK = true;
+
+        for (juce::int64 startFrame = 0; startFrame < numFrames && renderedOK; startFrame += blockSize)
+        {
+            auto numFramesThisBlock = (int) std::min ((juce::int64) blockSize, numFrames - startFrame);
+
+            inputBuffer.setSize (juce::jmax (numPatchInputChannels, getTotalNumInputChannels()), numFramesThisBlock, false, false, true);
+            inputBuffer.clear();
+            outputBuffer.setSize (numPatchOutputChannels, numFramesThisBlock, false, false, true);
+            outputBuffer.clear();
+            midi.clear();
+
+            if (getInput != nullptr)
+                getInput (inputBuffer, midi, startFrame);
+
+            if (preprocessInputData != nullptr)
+                preprocessInputData (inputBuffer);
+
+            auto rc = createRenderContext ((uint32_t) numFramesThisBlock);
+            rc.numMIDIMessagesIn = copyIncomingMIDI (midi);
+            rc.maximumMIDIMessagesOut = 0;
+
+            renderedOK = playerToRender.render (rc) == PatchPlayer::RenderResult::ok
+                          && writer->writeFromAudioSampleBuffer (outputBuffer, 0, numFramesThisBlock);
+        }
+
+        writer.reset();
+
+        if (renderedOK)
+            frozenAudio.reset (juce::WavAudioFormat().createMemoryMappedReader (file));
+
+        if (frozenAudio == nullptr || ! frozenAudio->mapEntireFile())
+        {
+            frozenAudio.reset();
+            file.deleteFile();
+            applyLastStateToPlayer (playerToRender);
+            return false;
+        }
+
+        frozenFile = file;
+        frozen = true;
+        compileService->removeJob (compileJob);
+        cancelPendingUpdate();
+        releaseHotSwappedPlayers();
+        hotSwappedPlayer = {};
+        replacementPlayer = {};
+        lastCompiledPlayer = {};
+        player = {};
+        return true;
+    }
+
+    /** Deletes the audio rendered by freeze(), and starts building a new player. When it's
+        ready, the host is asked to reinitialise the processor as it would be after a code
+        change, and the new player is given the parameter values and internal state that the
+        old one had when it was frozen. Until then, the processor outputs silence.
+
+        Like reinitialise(), this must only be called while the host isn't calling
+        processBlock().
+    */
+    void unfreeze()
+    {
+        if (isFrozen())
+        {
+            deleteFrozenAudio();
+            frozen = false;
+            compileService->addJob (compileJob);
+        }
+    }
+
+    /** Returns true if the processor is playing back audio rendered by freeze(). */
+    bool isFrozen() const
+    {
+        return frozen;
+    }
+
     //==============================================================================
     void fillInPluginDescription (juce::PluginDescription& d) const override
     {
@@ -234,8 +413,15 @@ struct SOULPatchAudioProcessor    : public juce::AudioPluginInstance,
     //==============================================================================
     void prepareToPlay (double sampleRate, int maxBlockSize) override
     {
-        const juce::ScopedLock sl (configLock);
-        currentConfig = { sampleRate, (uint32_t) maxBlockSize };
+        {
+            const juce::ScopedLock sl (configLock);
+            currentConfig = createConfig (sampleRate, (uint32_t) maxBlockSize, isNonRealtime());
+        }
+
+        // The frozen audio is only any use at the sample rate it was rendered at
+        if (frozenAudio != nullptr && frozenAudio->sampleRate != sampleRate)
+            unfreeze();
+
         messageSpaceIn.resize (1024);
         messageSpaceOut.resize (1024);
         preprocessInputData = nullptr;
@@ -249,7 +435,14 @@ struct SOULPatchAudioProcessor    : public juce::AudioPluginInstance,
         {
             numPatchInputChannels  = countTotalBusChannels (player->getInputBuses());
             numPatchOutputChannels = countTotalBusChannels (player->getOutputBuses());
+        }
+        else if (frozenAudio != nullptr)
+        {
+            numPatchOutputChannels = (int) frozenAudio->numChannels;
+        }
 
+        if (player != nullptr || frozenAudio != nullptr)
+        {
             auto pluginBuses = getBusesLayout();
 
             // We'll do some fairly rough heuristics here to handle simple
@@ -269,7 +462,11 @@ struct SOULPatchAudioProcessor    : public juce::AudioPluginInstance,
 
             if (numPatchOutputChannels == 2 && pluginBuses.getMainOutputChannels() == 1)
                 postprocessOutputData = stereoToMono;
+
+            fadeOutBuffer.setSize (juce::jmax (numPatchOutputChannels, getTotalNumOutputChannels()), maxBlockSize);
         }
+
+        compileService->addJob (compileJob);
     }
 
     void releaseResources() override
@@ -290,9 +487,20 @@ struct SOULPatchAudioProcessor    : public juce::AudioPluginInstance,
         inputBuffer.setSize (juce::jmax (numPatchInputChannels, getTotalNumInputChannels()), numFrames, false, false, true);
         inputBuffer.clear();
 
-        if (player != nullptr && player->isPlayable() && (! isSuspended()))
+        if (frozenAudio != nullptr)
         {
-            soul::patch::PatchPlayer::RenderContext rc;
+            if (! isSuspended())
+                readFrozenAudio (numFrames);
+
+            midi.clear();
+        }
+        else if (player != nullptr && player->isPlayable() && (! isSuspended()))
+        {
+            auto playerToFadeOut = startNextHotSwap();
+            auto& playerToRender = hotSwapRenderer != nullptr ? *hotSwapRenderer : *player;
+
+            if (hotSwapRenderer != nullptr)
+                copyParameterValues (*player, *hotSwapRenderer);
 
             for (int i = 0; i < getTotalNumInputChannels(); i++)
                 inputBuffer.copyFrom (i, 0, audio, i, 0, numFrames);
@@ -300,48 +508,34 @@ struct SOULPatchAudioProcessor    : public juce::AudioPluginInstance,
             if (preprocessInputData != nullptr)
                 preprocessInputData (inputBuffer);
 
-            // we're reinterpret-casting between these types to avoid having to include choc::midi::ShortMessage in
-            // the public patch API headers, so this just checks that the layout is actually the same.
-            static_assert (sizeof (MIDIEvent) == sizeof (soul::patch::MIDIMessage));
-
-            rc.inputChannels = inputBuffer.getArrayOfWritePointers();
-            rc.numInputChannels = (uint32_t) numPatchInputChannels;
-            rc.outputChannels = outputBuffer.getArrayOfWritePointers();
-            rc.numOutputChannels = (uint32_t) numPatchOutputChannels;
-            rc.numFrames = (uint32_t) numFrames;
-            rc.incomingMIDI = reinterpret_cast<const soul::patch::MIDIMessage*> (std::addressof (messageSpaceIn[0]));
-            rc.numMIDIMessagesIn = 0;
-            rc.outgoingMIDI = reinterpret_cast<soul::patch::MIDIMessage*> (std::addressof (messageSpaceOut[0]));
-            rc.maximumMIDIMessagesOut = (uint32_t) messageSpaceOut.size();
-            rc.numMIDIMessagesOut = 0;
+            auto rc = createRenderContext ((uint32_t) numFrames);
 
             midiKeyboardState.processNextMidiBuffer (midi, 0, numFrames, true);
 
             if (! midi.isEmpty())
             {
-                auto maxEvents = messageSpaceIn.size();
+                rc.numMIDIMessagesIn = copyIncomingMIDI (midi);
+                midi.clear();
+            }
 
-                auto iter = midi.cbegin();
-                auto end = midi.cend();
-                size_t i = 0;
+            if (playerToFadeOut != nullptr)
+                renderFadeOut (*playerToFadeOut, rc);
 
-                while (i < maxEvents && iter != end)
-                {
-                    auto message = *iter++;
+            auto result = playerToRender.render (rc);
+            juce::ignoreUnused (result);
+            jassert (result == PatchPlayer::RenderResult::ok);
 
-                    if (message.numBytes < 4)
-                        messageSpaceIn[i++] = { static_cast<uint32_t> (message.samplePosition),
-                                                { message.data[0], message.data[1], message.data[2] } };
+            if (playerToFadeOut != nullptr)
+            {
+                for (int i = 0; i < numPatchOutputChannels; ++i)
+                {
+                    outputBuffer.applyGainRamp (i, 0, numFrames, 0.0f, 1.0f);
+                    outputBuffer.addFromWithRamp (i, 0, fadeOutBuffer.getReadPointer (i), numFrames, 1.0f, 0.0f);
                 }
 
-                rc.numMIDIMessagesIn = (uint32_t) i;
-                midi.clear();
+                retiredHotSwap.store (playerToFadeOut);
             }
 
-            auto result = player->render (rc);
-            juce::ignoreUnused (result);
-            jassert (result == PatchPlayer::RenderResult::ok);
-
             if (rc.numMIDIMessagesOut != 0)
             {
                 // The numMIDIMessagesOut value could be greater than the buffer size we provided,
@@ -453,10 +647,25 @@ struct SOULPatchAudioProcessor    : public juce::AudioPluginInstance,
     {
         if (player != nullptr)
             player->reset();
+
+        if (hotSwapRenderer != nullptr)
+            hotSwapRenderer->reset();
+
+        frozenPlaybackPosition = 0;
     }
 
     //==============================================================================
-    void setNonRealtime (bool /*isNonRealtime*/) noexcept override {}
+    void setNonRealtime (bool shouldBeNonRealtime) noexcept override
+    {
+        juce::AudioProcessor::setNonRealtime (shouldBeNonRealtime);
+
+        {
+            const juce::ScopedLock sl (configLock);
+            currentConfig = createConfig (currentConfig.sampleRate, currentConfig.maxFramesPerBlock, shouldBeNonRealtime);
+        }
+
+        compileService->addJob (compileJob);
+    }
 
 private:
     soul::patch::PatchInstance::Ptr patch;
@@ -467,7 +676,23 @@ private:
 
     juce::String name, description;
 
-    soul::patch::PatchPlayer::Ptr player, replacementPlayer;
+    soul::patch::PatchPlayer::Ptr player, replacementPlayer, lastCompiledPlayer;
+
+    std::shared_ptr<PatchCompileService> compileService { PatchCompileService::getSharedInstance() };
+    PatchCompileService::Job compileJob;
+
+    std::shared_ptr<PatchFileWatcher> fileWatcher { PatchFileWatcher::getSharedInstance() };
+    PatchFileWatcher::Client fileWatcherClient;
+
+    // A player that can replace the current one without the host reinitialising is
+    // passed to the audio thread through these. Each pointer holds a reference to its
+    // player: pendingHotSwap is set by the message thread and taken by the audio thread,
+    // which renders hotSwapRenderer in place of player, and which puts the player that it
+    // has finished with into retiredHotSwap so that it's released on another thread.
+    soul::patch::PatchPlayer::Ptr hotSwappedPlayer;
+    std::atomic<soul::patch::PatchPlayer*> pendingHotSwap { nullptr }, retiredHotSwap { nullptr };
+    soul::patch::PatchPlayer* hotSwapRenderer = nullptr;
+    juce::AudioBuffer<float> fadeOutBuffer;
 
     juce::CriticalSection configLock;
     soul::patch::PatchPlayerConfiguration currentConfig;
@@ -482,6 +707,13 @@ private:
     juce::MidiKeyboardState midiKeyboardState;
     bool showMIDIKeyboard = false;
 
+    // While frozen, the player is released and this plays back what it rendered. The flag is
+    // checked by the compile thread, so that it doesn't build a new player in the meantime.
+    std::unique_ptr<juce::MemoryMappedAudioFormatReader> frozenAudio;
+    juce::File frozenFile;
+    juce::int64 frozenPlaybackPosition = 0;
+    std::atomic<bool> frozen { false };
+
     juce::ValueTree lastValidState;
 
     struct IDs
@@ -491,6 +723,7 @@ private:
                                version      { "version" },
                                PARAM        { "PARAM" },
                                value        { "value" },
+                               state        { "state" },
                                EDITORS      { "EDITORS" };
     };
 
@@ -503,6 +736,16 @@ private:
         return currentConfig;
     }
 
+    soul::patch::PatchPlayerConfiguration createConfig (double sampleRate, uint32_t maxBlockSize, bool offline) const
+    {
+        soul::patch::PatchPlayerConfiguration config;
+        config.sampleRate = sampleRate;
+        config.maxFramesPerBlock = maxBlockSize;
+        config.isOfflineRender = offline;
+        config.optimisationLevel = offline ? offlineOptimisationLevel : -1;
+        return config;
+    }
+
     static bool getFlagState (const soul::patch::Parameter& param, const char* flagName, bool defaultState)
     {
         if (auto flag = String::Ptr (param.getProperty (flagName)))
@@ -526,42 +769,243 @@ private:
         return {};
     }
 
+    static std::string getParentFolderPath (const std::string& path)
+    {
+        auto lastSlash = path.find_last_of ("/\\");
+        return lastSlash == std::string::npos ? std::string() : path.substr (0, lastSlash);
+    }
+
     //==============================================================================
-    void run() override
+    void timerCallback() override
     {
-        while (! threadShouldExit())
+        compileService->addJob (compileJob);
+    }
+
+    // This is run by the compile service, which never runs more than one instance of
+    // the same job at a time
+    void compileIfNeeded()
+    {
+        if (replacementPlayer == nullptr && ! frozen)
         {
-            if (replacementPlayer == nullptr)
-            {
-                auto config = getConfigCopy();
+            auto config = getConfigCopy();
 
-                if (config.sampleRate != 0 && config.maxFramesPerBlock != 0)
+            if (config.sampleRate != 0 && config.maxFramesPerBlock != 0)
+            {
+                if (lastCompiledPlayer == nullptr || lastCompiledPlayer->needsRebuilding (config))
                 {
-                    if (player == nullptr || player->needsRebuilding (currentConfig))
-                    {
-                        auto newPlayer = soul::patch::PatchPlayer::Ptr (patch->compileNewPlayer (currentConfig, cache.get(),
-                                                                                                 preprocessor.get(), externalData.get(),
-                                                                                                 consoleHandler.get()));
-
-                        if (threadShouldExit())
-                            return;
-
-                        replacementPlayer = newPlayer;
-                        triggerAsyncUpdate();
-                    }
+                    auto newPlayer = soul::patch::PatchPlayer::Ptr (patch->compileNewPlayer (config, cache.get(),
+                                                                                             preprocessor.get(), externalData.get(),
+                                                                                             consoleHandler.get()));
+
+                    lastCompiledPlayer = newPlayer;
+                    replacementPlayer = newPlayer;
+                    triggerAsyncUpdate();
                 }
             }
-
-            wait (millisecsBetweenFileChecks);
         }
+
+        releaseRef (retiredHotSwap.exchange (nullptr));
     }
 
     void handleAsyncUpdate() override
     {
+        if (replacementPlayer != nullptr && player != nullptr && canHotSwap (*player, *replacementPlayer))
+        {
+            copyParameterValues (*player, *replacementPlayer);
+            hotSwappedPlayer = std::move (replacementPlayer);
+            releaseRef (retiredHotSwap.exchange (nullptr));
+            releaseRef (pendingHotSwap.exchange (hotSwappedPlayer.incrementAndGetPointer()));
+            return;
+        }
+
         if (askHostToReinitialise != nullptr)
             askHostToReinitialise();
     }
 
+    //==============================================================================
+    static void releaseRef (soul::patch::PatchPlayer* p)
+    {
+        if (p != nullptr)
+            p->release();
+    }
+
+    void releaseHotSwappedPlayers()
+    {
+        releaseRef (pendingHotSwap.exchange (nullptr));
+        releaseRef (retiredHotSwap.exchange (nullptr));
+        releaseRef (hotSwapRenderer);
+        hotSwapRenderer = nullptr;
+    }
+
+    /** A new player can replace the old one while audio is running as long as nothing
+        that the host has been told about has changed.
+    */
+    static bool canHotSwap (soul::patch::PatchPlayer& oldPlayer, soul::patch::PatchPlayer& newPlayer)
+    {
+        if (! (oldPlayer.isPlayable() && newPlayer.isPlayable()))
+            return false;
+
+        auto busesMatch = [] (Span<soul::patch::Bus> a, Span<soul::patch::Bus> b)
+        {
+            if (a.size() != b.size())
+                return false;
+
+            for (uint32_t i = 0; i < a.size(); ++i)
+                if (a[i].numChannels != b[i].numChannels)
+                    return false;
+
+            return true;
+        };
+
+        if (! (busesMatch (oldPlayer.getInputBuses(), newPlayer.getInputBuses())
+                && busesMatch (oldPlayer.getOutputBuses(), newPlayer.getOutputBuses())))
+            return false;
+
+        auto oldParams = oldPlayer.getParameters();
+        auto newParams = newPlayer.getParameters();
+
+        if (oldParams.size() != newParams.size())
+            return false;
+
+        for (uint32_t i = 0; i < oldParams.size(); ++i)
+        {
+            auto& p1 = *oldParams[i];
+            auto& p2 = *newParams[i];
+
+            if (p1.ID.toString<std::string>() != p2.ID.toString<std::string>()
+                 || p1.minValue != p2.minValue || p1.maxValue != p2.maxValue || p1.step != p2.step)
+                return false;
+        }
+
+        return true;
+    }
+
+    /** Sets any parameters in the destination whose values differ from the source. The two
+        players must have passed canHotSwap().
+    */
+    static void copyParameterValues (soul::patch::PatchPlayer& source, soul::patch::PatchPlayer& dest)
+    {
+        auto sourceParams = source.getParameters();
+        auto destParams = dest.getParameters();
+
+        for (uint32_t i = 0; i < sourceParams.size(); ++i)
+        {
+            auto value = sourceParams[i]->getValue();
+
+            if (destParams[i]->getValue() != value)
+                destParams[i]->setValue (value);
+        }
+    }
+
+    /** Called by the audio thread at the start of a block. If a new player is waiting,
+        this makes it the one to render, and returns the previous one, which should be
+        faded out during this block.
+    */
+    soul::patch::PatchPlayer* startNextHotSwap()
+    {
+        // If the last retired player hasn't been collected yet, leave the new one until
+        // a later block rather than releasing anything on the audio thread. When rendering
+        // offline there's no deadline to miss, so it's simply released here.
+        if (retiredHotSwap.load() != nullptr)
+        {
+            if (! isNonRealtime())
+                return nullptr;
+
+            releaseRef (retiredHotSwap.exchange (nullptr));
+        }
+
+        if (auto incoming = pendingHotSwap.exchange (nullptr))
+        {
+            auto previous = hotSwapRenderer != nullptr ? hotSwapRenderer
+                                                       : player.incrementAndGetPointer();
+            hotSwapRenderer = incoming;
+            return previous;
+        }
+
+        return nullptr;
+    }
+
+    soul::patch::PatchPlayer::RenderContext createRenderContext (uint32_t numFrames)
+    {
+        // we're reinterpret-casting between these types to avoid having to include choc::midi::ShortMessage in
+        // the public patch API headers, so this just checks that the layout is actually the same.
+        static_assert (sizeof (MIDIEvent) == sizeof (soul::patch::MIDIMessage));
+
+        soul::patch::PatchPlayer::RenderContext rc;
+        rc.inputChannels = inputBuffer.getArrayOfWritePointers();
+        rc.numInputChannels = (uint32_t) numPatchInputChannels;
+        rc.outputChannels = outputBuffer.getArrayOfWritePointers();
+        rc.numOutputChannels = (uint32_t) numPatchOutputChannels;
+        rc.numFrames = numFrames;
+        rc.incomingMIDI = reinterpret_cast<const soul::patch::MIDIMessage*> (std::addressof (messageSpaceIn[0]));
+        rc.numMIDIMessagesIn = 0;
+        rc.outgoingMIDI = reinterpret_cast<soul::patch::MIDIMessage*> (std::addressof (messageSpaceOut[0]));
+        rc.maximumMIDIMessagesOut = (uint32_t) messageSpaceOut.size();
+        rc.numMIDIMessagesOut = 0;
+        return rc;
+    }
+
+    /** Copies as many short messages as will fit into messageSpaceIn, and returns the number copied. */
+    uint32_t copyIncomingMIDI (const juce::MidiBuffer& midi)
+    {
+        auto maxEvents = messageSpaceIn.size();
+
+        auto iter = midi.cbegin();
+        auto end = midi.cend();
+        size_t i = 0;
+
+        while (i < maxEvents && iter != end)
+        {
+            auto message = *iter++;
+
+            if (message.numBytes < 4)
+                messageSpaceIn[i++] = { static_cast<uint32_t> (message.samplePosition),
+                                        { message.data[0], message.data[1], message.data[2] } };
+        }
+
+        return (uint32_t) i;
+    }
+
+    /** Fills the output buffer from the frozen audio, at the host's position. If the host
+        doesn't have a play head, the audio is played from the start after each reset().
+    */
+    void readFrozenAudio (int numFrames)
+    {
+        juce::AudioPlayHead::CurrentPositionInfo position;
+
+        if (auto playHead = getPlayHead())
+        {
+            if (! playHead->getCurrentPosition (position) || ! position.isPlaying)
+                return;
+
+            frozenPlaybackPosition = position.timeInSamples;
+        }
+
+        frozenAudio->read (&outputBuffer, 0, numFrames, frozenPlaybackPosition, true, true);
+        frozenPlaybackPosition += numFrames;
+    }
+
+    void deleteFrozenAudio()
+    {
+        if (frozenAudio != nullptr)
+        {
+            frozenAudio.reset();
+            frozenFile.deleteFile();
+            frozenFile = juce::File();
+        }
+    }
+
+    void renderFadeOut (soul::patch::PatchPlayer& playerToFadeOut, const soul::patch::PatchPlayer::RenderContext& context)
+    {
+        fadeOutBuffer.setSize (outputBuffer.getNumChannels(), (int) context.numFrames, false, false, true);
+        fadeOutBuffer.clear();
+
+        auto rc = context;
+        rc.outputChannels = fadeOutBuffer.getArrayOfWritePointers();
+        rc.maximumMIDIMessagesOut = 0;
+        playerToFadeOut.render (rc);
+    }
+
     bool isMatchingStateType (const juce::ValueTree& state) const
     {
         return state.hasType (ids.SOULPatch)
@@ -591,6 +1035,11 @@ private:
                 state.addChild (param, -1, nullptr);
             }
 
+            auto internalState = saveInternalState();
+
+            if (internalState.getSize() != 0)
+                state.setProperty (ids.state, std::move (internalState), nullptr);
+
             lastValidState = std::move (state);
         }
     }
@@ -606,9 +1055,47 @@ private:
                 if (auto* value = paramState.getPropertyPointer (ids.value))
                     param->setValue (*value);
             }
+
+            // The player will refuse a state that was saved from a different build of the patch
+            if (auto internalState = lastValidState.getProperty (ids.state).getBinaryData())
+            {
+                const juce::ScopedLock sl (getCallbackLock());
+                playerToApplyTo.restoreState (internalState->getData(), internalState->getSize());
+            }
         }
     }
 
+    /** Returns a copy of the internal state of the player that's currently being rendered,
+        or an empty block if it can't save its state. The callback lock is held while the
+        state is copied, so that it can't change half way through.
+    */
+    juce::MemoryBlock saveInternalState()
+    {
+        juce::MemoryBlock data;
+        uint64_t size = 0;
+
+        {
+            const juce::ScopedLock sl (getCallbackLock());
+            size = getRenderingPlayer().saveState (nullptr, 0);
+        }
+
+        if (size != 0)
+        {
+            data.setSize ((size_t) size);
+            const juce::ScopedLock sl (getCallbackLock());
+
+            if (getRenderingPlayer().saveState (data.getData(), size) != size)
+                data.reset();
+        }
+
+        return data;
+    }
+
+    soul::patch::PatchPlayer& getRenderingPlayer() const
+    {
+        return hotSwapRenderer != nullptr ? *hotSwapRenderer : *player;
+    }
+
     //==============================================================================
     struct PatchParameter  : public juce::AudioProcessorParameterWithID
     {
@@ -0,0 +1,240 @@
+/*
+     _____ _____ _____ __
+    |   __|     |  |  |  |
+    |__   |  |  |  |  |  |__
+    |_____|_____|_____|_____|
+
+    Copyright (c) 2018 - ROLI Ltd.
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <condition_variable>
+
+namespace soul
+{
+namespace patch
+{
+
+//==============================================================================
+/**
+    A pool of worker threads which runs patch compilation jobs for any number of clients.
+
+    Rather than each processor compiling on its own thread, which makes a host that opens
+    a session full of patches start dozens of compiles at once, they can all share this
+    service, which runs at most a fixed number of jobs at a time, highest priority first.
+
+    Jobs which have the same non-empty key are never run at the same time, so that if two
+    clients are compiling the same patch, the second one can pick up the result from the
+    first one's compiler cache rather than doing the same work in parallel.
+*/
+struct PatchCompileService
+{
+    /** Creates a service with the given number of threads. If this is zero, it'll use as
+        many threads as there are hardware cores.
+    */
+    PatchCompileService (uint32_t numThreads = 0)
+    {
+        if (numThreads == 0)
+            numThreads = std::max (1u, std::thread::hardware_concurrency());
+
+        for (uint32_t i = 0; i < numThreads; ++i)
+            threads.emplace_back ([this] { run(); });
+    }
+
+    ~PatchCompileService()
+    {
+        {
+            std::lock_guard<std::mutex> lock (mutex);
+            shouldExit = true;
+        }
+
+        jobAdded.notify_all();
+
+        for (auto& t : threads)
+            t.join();
+    }
+
+    PatchCompileService (const PatchCompileService&) = delete;
+    PatchCompileService& operator= (const PatchCompileService&) = delete;
+
+    /** Returns a service which is shared by all the clients in the process. This is
+        created when first needed, and deleted when the last client lets go of it.
+    */
+    static std::shared_ptr<PatchCompileService> getSharedInstance()
+    {
+        static std::mutex instanceLock;
+        static std::weak_ptr<PatchCompileService> instance;
+
+        std::lock_guard<std::mutex> lock (instanceLock);
+        auto service = instance.lock();
+
+        if (service == nullptr)
+        {
+            service = std::make_shared<PatchCompileService>();
+            instance = service;
+        }
+
+        return service;
+    }
+
+    //==============================================================================
+    /** A task that the service can run. The client owns this object, and must call
+        removeJob() before deleting it.
+    */
+    struct Job
+    {
+        /** The function to run on one of the worker threads. */
+        std::function<void()> function;
+
+        /** Jobs with the same non-empty key won't be run concurrently. */
+        std::string key;
+
+    private:
+        friend struct PatchCompileService;
+        int priority = 0;
+        uint64_t order = 0;
+        bool isQueued = false, isRunning = false, needsToRunAgain = false;
+    };
+
+    /** Queues a job to be run. If it's already waiting to run, this does nothing, and if
+        it's currently running, it'll be run again when it finishes.
+    */
+    void addJob (Job& job)
+    {
+        {
+            std::lock_guard<std::mutex> lock (mutex);
+
+            if (job.isRunning)
+            {
+                job.needsToRunAgain = true;
+                return;
+            }
+
+            enqueue (job);
+        }
+
+        jobAdded.notify_one();
+    }
+
+    /** Changes the priority of a job. Jobs with higher numbers are run first, and jobs
+        with equal priority are run in the order they were added.
+    */
+    void setPriority (Job& job, int newPriority)
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        job.priority = newPriority;
+    }
+
+    /** Removes a job from the queue, waiting for it to finish if it's currently running.
+        This mustn't be called from within the job itself.
+    */
+    void removeJob (Job& job)
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+        job.needsToRunAgain = false;
+
+        if (job.isQueued)
+        {
+            queue.erase (std::find (queue.begin(), queue.end(), &job));
+            job.isQueued = false;
+        }
+
+        jobFinished.wait (lock, [&] { return ! job.isRunning; });
+    }
+
+private:
+    //==============================================================================
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable jobAdded, jobFinished;
+    std::vector<Job*> queue, running;
+    uint64_t nextOrder = 0;
+    bool shouldExit = false;
+
+    void enqueue (Job& job)
+    {
+        if (! job.isQueued)
+        {
+            job.isQueued = true;
+            job.order = nextOrder++;
+            queue.push_back (std::addressof (job));
+        }
+    }
+
+    bool isKeyRunning (const std::string& key) const
+    {
+        if (! key.empty())
+            for (auto j : running)
+                if (j->key == key)
+                    return true;
+
+        return false;
+    }
+
+    std::vector<Job*>::iterator findNextJob()
+    {
+        auto best = queue.end();
+
+        for (auto i = queue.begin(); i != queue.end(); ++i)
+        {
+            auto& j = **i;
+
+            if (isKeyRunning (j.key))
+                continue;
+
+            if (best == queue.end() || j.priority > (*best)->priority
+                 || (j.priority == (*best)->priority && j.order < (*best)->order))
+                best = i;
+        }
+
+        return best;
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+
+        for (;;)
+        {
+            auto next = queue.end();
+            jobAdded.wait (lock, [&] { return shouldExit || (next = findNextJob()) != queue.end(); });
+
+            if (shouldExit)
+                return;
+
+            auto& job = **next;
+            queue.erase (next);
+            job.isQueued = false;
+            job.isRunning = true;
+            running.push_back (std::addressof (job));
+
+            lock.unlock();
+            job.function();
+            lock.lock();
+
+            running.erase (std::find (running.begin(), running.end(), std::addressof (job)));
+            job.isRunning = false;
+
+            if (job.needsToRunAgain)
+            {
+                job.needsToRunAgain = false;
+                enqueue (job);
+            }
+
+            // A job that was held back because its key was in use may now be runnable
+            jobAdded.notify_all();
+            jobFinished.notify_all();
+        }
+    }
+};
+
+} // namespace patch
+} // namespace soul
@@ -14,6 +14,14 @@
 #endif
 
 #include "../API/soul_patch.h"
+#include <list>
+#include <deque>
+#include <array>
+#include <mutex>
+#include <thread>
+#include <limits>
+#include <unordered_map>
+#include <condition_variable>
 
 #if __clang__
  #pragma clang diagnostic push
@@ -29,83 +37,191 @@ namespace patch
 /**
     Implements a simple CompilerCache that stores the cached object code chunks
     as files in a folder.
+
+    The folder is only scanned once, when the cache is created, and after that an
+    in-memory index of the items and their sizes is kept. The index is split into shards
+    with their own locks, so threads using different keys don't block each other, and no
+    file I/O is done while a lock is held.
+
+    New items are written to the folder on a background thread (via a temporary file
+    which is then renamed, so a reader never sees a partially-written item), and are
+    served from memory until that has finished. When the cache exceeds its limits, the
+    least-recently-used items are removed one at a time as new ones are added.
 */
 struct CompilerCacheFolder final  : public CompilerCache
 {
-    /** Creates a cache in the given folder (which must exist!) */
-    CompilerCacheFolder (juce::File cacheFolder, uint32_t maxNumFilesToCache)
-       : folder (std::move (cacheFolder)), maxNumFiles (maxNumFilesToCache)
+    /** Creates a cache in the given folder (which must exist!)
+        When the cache holds more than maxNumFilesToCache items, or if maxTotalBytesToCache
+        is non-zero and the items' total size exceeds it, the least-recently-used items
+        will be deleted.
+    */
+    CompilerCacheFolder (juce::File cacheFolder, uint32_t maxNumFilesToCache, uint64_t maxTotalBytesToCache = 0)
+       : folder (std::move (cacheFolder)), maxNumFiles (maxNumFilesToCache), maxTotalBytes (maxTotalBytesToCache)
     {
-        purgeOldestFiles (maxNumFiles);
+        loadIndex();
+        writerThread = std::thread ([this] { runWriter(); });
+        purgeIfNeeded();
     }
 
-    ~CompilerCacheFolder() = default;
+    ~CompilerCacheFolder()
+    {
+        {
+            std::lock_guard<std::mutex> lock (writeQueueLock);
+            shouldExit = true;
+        }
+
+        writeQueueChanged.notify_all();
+        writerThread.join();
+    }
 
     void storeItemInCache (const char* key, const void* sourceData, uint64_t size) override
     {
-        juce::ScopedLock sl (lock);
-        auto file = getFileForKey (key);
-        file.replaceWithData (sourceData, (size_t) size);
-        purgeOldestFiles (maxNumFiles);
+        auto data = std::make_shared<const std::vector<char>> (static_cast<const char*> (sourceData),
+                                                               static_cast<const char*> (sourceData) + size);
+        std::string keyString (key);
+        auto& shard = getShard (keyString);
+
+        {
+            std::lock_guard<std::mutex> lock (shard.lock);
+            auto existing = shard.index.find (keyString);
+
+            if (existing != shard.index.end())
+            {
+                totalBytes -= existing->second->size;
+                --numFiles;
+                shard.items.erase (existing->second);
+            }
+
+            shard.items.push_front ({ keyString, size, ++accessCounter, data });
+            shard.index[keyString] = shard.items.begin();
+            totalBytes += size;
+            ++numFiles;
+        }
+
+        addWriteOperation ({ WriteOperation::Type::write, std::move (keyString), std::move (data) });
+        purgeIfNeeded();
     }
 
     uint64_t readItemFromCache (const char* key, void* destAddress, uint64_t destSize) override
     {
-        juce::ScopedLock sl (lock);
-        auto file = getFileForKey (key);
-        auto fileSize = (uint64_t) file.getSize();
+        std::string keyString (key);
+        auto& shard = getShard (keyString);
+        std::shared_ptr<const std::vector<char>> pendingData;
+        uint64_t size = 0;
 
-        if (fileSize == 0)
-            return 0;
+        {
+            std::lock_guard<std::mutex> lock (shard.lock);
+            auto found = shard.index.find (keyString);
+
+            if (found == shard.index.end())
+                return 0;
 
-        if (destAddress == nullptr || destSize < fileSize)
-            return fileSize;
+            auto& item = *found->second;
+            size = item.size;
+
+            if (destAddress == nullptr || destSize < size)
+                return size;
+
+            item.lastAccess = ++accessCounter;
+            shard.items.splice (shard.items.begin(), shard.items, found->second);
+            pendingData = item.pendingData;
+        }
+
+        if (pendingData != nullptr)
+        {
+            std::memcpy (destAddress, pendingData->data(), (size_t) size);
+            return size;
+        }
 
         auto readEntireFile = [&]() -> bool
         {
-            juce::FileInputStream fin (file);
-            return fin.openedOk() && fin.read (destAddress, (int) fileSize) == (int) fileSize;
+            juce::FileInputStream fin (getFileForKey (key));
+            return fin.openedOk() && fin.read (destAddress, (int) size) == (int) size;
         };
 
         if (! readEntireFile())
+        {
+            // the file has been deleted or damaged by something else, so forget about it
+            removeItem (keyString, false);
             return 0;
+        }
 
-        file.setLastModificationTime (juce::Time::getCurrentTime());
-        return fileSize;
+        // the modification time records the order in which items were used, for the
+        // next time the folder is scanned
+        addWriteOperation ({ WriteOperation::Type::touch, std::move (keyString), {} });
+        return size;
     }
 
-    bool purgeOldestFiles (uint32_t maxNumFilesToRetain) const
+    /** Returns a view of an item which is either still waiting to be written, or has been
+        memory-mapped from its file, so that it doesn't need to be copied.
+    */
+    ItemView* getItemView (const char* key) override
     {
-        juce::ScopedLock sl (lock);
-
-        struct FileAndDate
+        struct View final  : public ItemView
         {
-            juce::File file;
-            juce::Time modificationTime;
+            const void* getData() override      { return data != nullptr ? data->data() : mappedFile->getData(); }
+            uint64_t getSize() override         { return size; }
 
-            bool operator< (const FileAndDate& other) const noexcept     { return modificationTime < other.modificationTime; }
+            int addRef() noexcept override   { return ++refCount; }
+            int release() noexcept override  { auto newCount = --refCount; if (newCount == 0) delete this; return newCount; }
+
+            std::atomic<int> refCount { 1 };
+            std::shared_ptr<const std::vector<char>> data;
+            std::unique_ptr<juce::MemoryMappedFile> mappedFile;
+            uint64_t size = 0;
         };
 
-        std::vector<FileAndDate> files;
-        juce::Time modificationTime;
-        bool anyFailed = false;
+        std::string keyString (key);
+        auto& shard = getShard (keyString);
+        auto view = std::make_unique<View>();
+
+        {
+            std::lock_guard<std::mutex> lock (shard.lock);
+            auto found = shard.index.find (keyString);
+
+            if (found == shard.index.end())
+                return {};
 
-        for (auto i : juce::RangedDirectoryIterator (folder, false, getFilePrefix() + "*", juce::File::findFiles))
-            files.push_back ({ i.getFile(), modificationTime });
+            auto& item = *found->second;
+            item.lastAccess = ++accessCounter;
+            shard.items.splice (shard.items.begin(), shard.items, found->second);
+            view->data = item.pendingData;
+            view->size = item.size;
+        }
 
-        if (files.size() > maxNumFilesToRetain)
+        if (view->data == nullptr)
         {
-            std::sort (files.begin(), files.end());
+            view->mappedFile = std::make_unique<juce::MemoryMappedFile> (getFileForKey (key), juce::MemoryMappedFile::readOnly);
+
+            if (view->mappedFile->getData() == nullptr || (uint64_t) view->mappedFile->getSize() != view->size)
+            {
+                removeItem (keyString, false);
+                return {};
+            }
 
-            for (size_t i = 0; i < files.size() - maxNumFilesToRetain; ++i)
-                if (! files[i].file.deleteFile())
-                    anyFailed = true;
+            addWriteOperation ({ WriteOperation::Type::touch, std::move (keyString), {} });
         }
 
-        return ! anyFailed;
+        return view.release();
+    }
+
+    /** Deletes the least-recently-used items until no more than the given number remain.
+        This waits for any pending writes to finish, and returns false if any files
+        couldn't be deleted.
+    */
+    bool purgeOldestFiles (uint32_t maxNumFilesToRetain)
+    {
+        while (numFiles > maxNumFilesToRetain)
+            if (! removeLeastRecentlyUsedItem())
+                break;
+
+        std::unique_lock<std::mutex> lock (writeQueueLock);
+        writeQueueChanged.wait (lock, [this] { return writeQueue.empty() && ! isWriting; });
+        return ! anyDeletionsFailed.exchange (false);
     }
 
     static std::string getFilePrefix()                       { return "soul_patch_cache_"; }
+    static std::string getTempFilePrefix()                   { return "soul_patch_temp_"; }
     static std::string getFileName (const char* cacheKey)    { return getFilePrefix() + cacheKey; }
     juce::File getFileForKey (const char* cacheKey) const    { return folder.getChildFile (getFileName (cacheKey)); }
 
@@ -113,10 +229,215 @@ struct CompilerCacheFolder final  : public CompilerCache
     int release() noexcept override  { auto newCount = --refCount; if (newCount == 0) delete this; return newCount; }
 
 private:
+    //==============================================================================
+    struct Item
+    {
+        std::string key;
+        uint64_t size, lastAccess;
+        std::shared_ptr<const std::vector<char>> pendingData; // kept until it has been written to disk
+    };
+
+    struct Shard
+    {
+        std::mutex lock;
+        std::list<Item> items; // most-recently-used first
+        std::unordered_map<std::string, std::list<Item>::iterator> index;
+    };
+
+    struct WriteOperation
+    {
+        enum class Type { write, remove, touch };
+
+        Type type;
+        std::string key;
+        std::shared_ptr<const std::vector<char>> data;
+    };
+
     std::atomic<int> refCount { 1 };
     juce::File folder;
     uint32_t maxNumFiles;
-    juce::CriticalSection lock;
+    uint64_t maxTotalBytes;
+
+    std::array<Shard, 16> shards;
+    std::atomic<uint64_t> accessCounter { 0 }, totalBytes { 0 };
+    std::atomic<uint32_t> numFiles { 0 };
+
+    std::thread writerThread;
+    std::mutex writeQueueLock;
+    std::condition_variable writeQueueChanged;
+    std::deque<WriteOperation> writeQueue;
+    bool isWriting = false, shouldExit = false;
+    std::atomic<bool> anyDeletionsFailed { false };
+
+    Shard& getShard (const std::string& key)
+    {
+        return shards[std::hash<std::string>() (key) % shards.size()];
+    }
+
+    void loadIndex()
+    {
+        struct FileAndDate
+        {
+            std::string key;
+            uint64_t size;
+            juce::Time modificationTime;
+
+            bool operator< (const FileAndDate& other) const noexcept     { return modificationTime < other.modificationTime; }
+        };
+
+        std::vector<FileAndDate> files;
+
+        for (auto& i : juce::RangedDirectoryIterator (folder, false, getFilePrefix() + "*", juce::File::findFiles))
+            files.push_back ({ i.getFile().getFileName().substring ((int) getFilePrefix().length()).toStdString(),
+                               (uint64_t) i.getFileSize(), i.getModificationTime() });
+
+        std::sort (files.begin(), files.end());
+
+        for (auto& f : files)
+        {
+            auto& shard = getShard (f.key);
+            shard.items.push_front ({ f.key, f.size, ++accessCounter, {} });
+            shard.index[f.key] = shard.items.begin();
+            totalBytes += f.size;
+            ++numFiles;
+        }
+
+        // clear up any temporary files left behind by a process that didn't finish writing them
+        for (auto& i : juce::RangedDirectoryIterator (folder, false, getTempFilePrefix() + "*", juce::File::findFiles))
+            i.getFile().deleteFile();
+    }
+
+    bool isOverLimit() const
+    {
+        return numFiles > maxNumFiles || (maxTotalBytes != 0 && totalBytes > maxTotalBytes);
+    }
+
+    void purgeIfNeeded()
+    {
+        while (isOverLimit())
+            if (! removeLeastRecentlyUsedItem())
+                break;
+    }
+
+    bool removeLeastRecentlyUsedItem()
+    {
+        for (;;)
+        {
+            Shard* oldestShard = nullptr;
+            std::string oldestKey;
+            auto oldestAccess = std::numeric_limits<uint64_t>::max();
+
+            for (auto& shard : shards)
+            {
+                std::lock_guard<std::mutex> lock (shard.lock);
+
+                if (! shard.items.empty() && shard.items.back().lastAccess < oldestAccess)
+                {
+                    oldestShard = std::addressof (shard);
+                    oldestKey = shard.items.back().key;
+                    oldestAccess = shard.items.back().lastAccess;
+                }
+            }
+
+            if (oldestShard == nullptr)
+                return false;
+
+            // another thread may have used or removed this item in the meantime
+            if (removeItem (oldestKey, true, oldestAccess))
+                return true;
+        }
+    }
+
+    bool removeItem (const std::string& key, bool deleteFile, uint64_t expectedLastAccess = 0)
+    {
+        auto& shard = getShard (key);
+
+        {
+            std::lock_guard<std::mutex> lock (shard.lock);
+            auto found = shard.index.find (key);
+
+            if (found == shard.index.end())
+                return false;
+
+            if (expectedLastAccess != 0 && found->second->lastAccess != expectedLastAccess)
+                return false;
+
+            totalBytes -= found->second->size;
+            --numFiles;
+            shard.items.erase (found->second);
+            shard.index.erase (found);
+        }
+
+        if (deleteFile)
+            addWriteOperation ({ WriteOperation::Type::remove, key, {} });
+
+        return true;
+    }
+
+    //==============================================================================
+    void addWriteOperation (WriteOperation op)
+    {
+        {
+            std::lock_guard<std::mutex> lock (writeQueueLock);
+            writeQueue.push_back (std::move (op));
+        }
+
+        writeQueueChanged.notify_all();
+    }
+
+    void runWriter()
+    {
+        std::unique_lock<std::mutex> lock (writeQueueLock);
+
+        for (;;)
+        {
+            writeQueueChanged.wait (lock, [this] { return shouldExit || ! writeQueue.empty(); });
+
+            if (writeQueue.empty())
+                return;
+
+            auto op = std::move (writeQueue.front());
+            writeQueue.pop_front();
+            isWriting = true;
+
+            lock.unlock();
+            perform (op);
+            lock.lock();
+
+            isWriting = false;
+            writeQueueChanged.notify_all();
+        }
+    }
+
+    void perform (const WriteOperation& op)
+    {
+        auto file = getFileForKey (op.key.c_str());
+
+        if (op.type == WriteOperation::Type::remove)
+        {
+            if (! file.deleteFile())
+                anyDeletionsFailed = true;
+        }
+        else if (op.type == WriteOperation::Type::touch)
+        {
+            file.setLastModificationTime (juce::Time::getCurrentTime());
+        }
+        else
+        {
+            auto tempFile = folder.getChildFile (getTempFilePrefix() + op.key);
+
+            if (tempFile.replaceWithData (op.data->data(), op.data->size()))
+                if (! tempFile.moveFileTo (file))
+                    tempFile.deleteFile();
+
+            auto& shard = getShard (op.key);
+            std::lock_guard<std::mutex> lock (shard.lock);
+            auto found = shard.index.find (op.key);
+
+            if (found != shard.index.end() && found->second->pendingData == op.data)
+                found->second->pendingData.reset();
+        }
+    }
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (CompilerCacheFolder)
 };
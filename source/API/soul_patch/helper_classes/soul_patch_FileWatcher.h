@@ -0,0 +1,322 @@
+/*
+     _____ _____ _____ __
+    |   __|     |  |  |  |
+    |__   |  |  |  |  |  |__
+    |_____|_____|_____|_____|
+
+    Copyright (c) 2018 - ROLI Ltd.
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <functional>
+#include <algorithm>
+
+#if defined (__linux__)
+ #define SOUL_PATCH_FILE_WATCHER_USES_INOTIFY 1
+ #include <sys/inotify.h>
+ #include <sys/stat.h>
+ #include <poll.h>
+ #include <unistd.h>
+ #include <dirent.h>
+#else
+ #define SOUL_PATCH_FILE_WATCHER_USES_INOTIFY 0
+#endif
+
+namespace soul
+{
+namespace patch
+{
+
+//==============================================================================
+/**
+    Tells clients when anything changes inside the folders that contain their patches.
+
+    Rather than each processor polling the modification times of all its files, which
+    becomes a constant load on the filesystem once there are hundreds of them, they can all
+    share this service, which uses a single OS notification handle and thread. Clients
+    that are watching the same folder share the same set of OS watches.
+
+    Notifications are only available for folders on the local filesystem, and currently
+    only on Linux (using inotify). If addClient() returns false, the client should fall
+    back to polling for changes itself.
+*/
+struct PatchFileWatcher
+{
+    PatchFileWatcher()
+    {
+       #if SOUL_PATCH_FILE_WATCHER_USES_INOTIFY
+        notifyHandle = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+
+        if (notifyHandle >= 0 && pipe (wakeupPipe) == 0)
+            thread = std::thread ([this] { run(); });
+       #endif
+    }
+
+    ~PatchFileWatcher()
+    {
+       #if SOUL_PATCH_FILE_WATCHER_USES_INOTIFY
+        if (thread.joinable())
+        {
+            char c = 0;
+            (void) ! write (wakeupPipe[1], &c, 1);
+            thread.join();
+            close (wakeupPipe[0]);
+            close (wakeupPipe[1]);
+        }
+
+        if (notifyHandle >= 0)
+            close (notifyHandle);
+       #endif
+    }
+
+    PatchFileWatcher (const PatchFileWatcher&) = delete;
+    PatchFileWatcher& operator= (const PatchFileWatcher&) = delete;
+
+    /** Returns a watcher which is shared by all the clients in the process. This is
+        created when first needed, and deleted when the last client lets go of it.
+    */
+    static std::shared_ptr<PatchFileWatcher> getSharedInstance()
+    {
+        static std::mutex instanceLock;
+        static std::weak_ptr<PatchFileWatcher> instance;
+
+        std::lock_guard<std::mutex> lock (instanceLock);
+        auto watcher = instance.lock();
+
+        if (watcher == nullptr)
+        {
+            watcher = std::make_shared<PatchFileWatcher>();
+            instance = watcher;
+        }
+
+        return watcher;
+    }
+
+    //==============================================================================
+private:
+    struct Folder;
+
+public:
+    /** Something that wants to know about changes to a folder. The client owns this
+        object, and must call removeClient() before deleting it.
+    */
+    struct Client
+    {
+        /** Called on the watcher's thread when anything in the folder or its sub-folders
+            changes. This should return quickly, and mustn't add or remove clients.
+        */
+        std::function<void()> callback;
+
+    private:
+        friend struct PatchFileWatcher;
+        Folder* folder = nullptr;
+    };
+
+    /** Starts sending the client notifications about changes to the given folder.
+        Returns false if notifications aren't available for this folder, in which case
+        the client will need to poll for changes instead.
+    */
+    bool addClient (Client& client, const std::string& folderPath)
+    {
+        removeClient (client);
+
+       #if SOUL_PATCH_FILE_WATCHER_USES_INOTIFY
+        if (! thread.joinable() || ! isLocalFolder (folderPath))
+            return false;
+
+        std::lock_guard<std::mutex> lock (mutex);
+
+        for (auto& f : folders)
+        {
+            if (f->path == folderPath)
+            {
+                f->clients.push_back (std::addressof (client));
+                client.folder = f.get();
+                return true;
+            }
+        }
+
+        auto folder = std::make_unique<Folder>();
+        folder->path = folderPath;
+        addWatches (*folder, folderPath);
+
+        if (folder->watches.empty())
+            return false;
+
+        folder->clients.push_back (std::addressof (client));
+        client.folder = folder.get();
+        folders.push_back (std::move (folder));
+        return true;
+       #else
+        (void) folderPath;
+        return false;
+       #endif
+    }
+
+    /** Stops sending notifications to a client. When this returns, the client's
+        callback is guaranteed not to be running.
+    */
+    void removeClient (Client& client)
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+
+        if (auto folder = client.folder)
+        {
+            client.folder = nullptr;
+            folder->clients.erase (std::find (folder->clients.begin(), folder->clients.end(), std::addressof (client)));
+
+            if (folder->clients.empty())
+            {
+               #if SOUL_PATCH_FILE_WATCHER_USES_INOTIFY
+                auto watches = std::move (folder->watches);
+               #endif
+
+                folders.erase (std::find_if (folders.begin(), folders.end(),
+                                             [=] (const std::unique_ptr<Folder>& f) { return f.get() == folder; }));
+
+               #if SOUL_PATCH_FILE_WATCHER_USES_INOTIFY
+                for (auto& w : watches)
+                    if (! isWatchInUse (w.descriptor))
+                        inotify_rm_watch (notifyHandle, w.descriptor);
+               #endif
+            }
+        }
+    }
+
+private:
+    //==============================================================================
+    struct Watch
+    {
+        int descriptor;
+        std::string path;
+    };
+
+    struct Folder
+    {
+        std::string path;
+        std::vector<Watch> watches;
+        std::vector<Client*> clients;
+    };
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Folder>> folders;
+    std::thread thread;
+
+   #if SOUL_PATCH_FILE_WATCHER_USES_INOTIFY
+    int notifyHandle = -1;
+    int wakeupPipe[2] = { -1, -1 };
+
+    static bool isLocalFolder (const std::string& path)
+    {
+        struct stat info;
+        return ! path.empty() && path[0] == '/' && stat (path.c_str(), &info) == 0 && S_ISDIR (info.st_mode);
+    }
+
+    // symlinks aren't followed, so that a link back up the tree can't make this recurse forever
+    static bool isRealSubFolder (const dirent& entry, const std::string& path)
+    {
+        if (entry.d_type != DT_UNKNOWN)
+            return entry.d_type == DT_DIR;
+
+        struct stat info;
+        return lstat (path.c_str(), &info) == 0 && S_ISDIR (info.st_mode);
+    }
+
+    // inotify watches aren't recursive, so each sub-folder needs a watch of its own
+    void addWatches (Folder& folder, const std::string& path)
+    {
+        auto wd = inotify_add_watch (notifyHandle, path.c_str(),
+                                     IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE
+                                       | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+
+        if (wd < 0)
+            return;
+
+        folder.watches.push_back ({ wd, path });
+
+        if (auto dir = opendir (path.c_str()))
+        {
+            while (auto entry = readdir (dir))
+            {
+                std::string name (entry->d_name);
+                auto childPath = path + "/" + name;
+
+                if (name != "." && name != ".." && isRealSubFolder (*entry, childPath))
+                    addWatches (folder, childPath);
+            }
+
+            closedir (dir);
+        }
+    }
+
+    void handleEvent (const inotify_event& event)
+    {
+        // nested folders can share a watch, so every folder that uses it needs to be told
+        for (auto& f : folders)
+        {
+            for (size_t i = 0; i < f->watches.size(); ++i)
+            {
+                if (f->watches[i].descriptor == event.wd)
+                {
+                    if ((event.mask & IN_CREATE) != 0 && (event.mask & IN_ISDIR) != 0 && event.len > 0)
+                        addWatches (*f, f->watches[i].path + "/" + event.name);
+
+                    for (auto c : f->clients)
+                        c->callback();
+
+                    break;
+                }
+            }
+        }
+    }
+
+    bool isWatchInUse (int descriptor) const
+    {
+        for (auto& f : folders)
+            for (auto& w : f->watches)
+                if (w.descriptor == descriptor)
+                    return true;
+
+        return false;
+    }
+
+    void run()
+    {
+        alignas (inotify_event) char buffer[4096];
+
+        for (;;)
+        {
+            pollfd fds[2] = { { notifyHandle, POLLIN, 0 }, { wakeupPipe[0], POLLIN, 0 } };
+
+            if (poll (fds, 2, -1) < 0)
+                continue;
+
+            if (fds[1].revents != 0)
+                return;
+
+            auto numRead = read (notifyHandle, buffer, sizeof (buffer));
+
+            if (numRead <= 0)
+                continue;
+
+            std::lock_guard<std::mutex> lock (mutex);
+
+            for (ssize_t pos = 0; pos < numRead;)
+            {
+                auto& event = *reinterpret_cast<const inotify_event*> (buffer + pos);
+                handleEvent (event);
+                pos += static_cast<ssize_t> (sizeof (inotify_event) + event.len);
+            }
+        }
+    }
+   #endif
+};
+
+} // namespace patch
+} // namespace soul
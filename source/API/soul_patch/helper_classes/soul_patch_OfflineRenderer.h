@@ -0,0 +1,203 @@
+/*
+     _____ _____ _____ __
+    |   __|     |  |  |  |
+    |__   |  |  |  |  |  |__
+    |_____|_____|_____|_____|
+
+    Copyright (c) 2018 - ROLI Ltd.
+*/
+
+#pragma once
+
+#include "../API/soul_patch.h"
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#if __clang__
+ #pragma clang diagnostic push
+ #pragma clang diagnostic ignored "-Wnon-virtual-dtor"
+#endif
+
+namespace soul
+{
+namespace patch
+{
+
+//==============================================================================
+/**
+    Renders PatchPlayers offline, as fast as possible, rather than from a realtime
+    audio callback.
+
+    Each Job describes a complete render: the player to use, the whole input and output
+    buffers, and the MIDI sequence to feed into it. The job is chopped into blocks of
+    blockSize frames, which should normally be the same as the maxFramesPerBlock that
+    the player was compiled with. For best results, players used here should be compiled
+    with a large maxFramesPerBlock and with PatchPlayerConfiguration::isOfflineRender set.
+
+    Because independent players don't share any state, renderInParallel() can bounce a
+    whole batch of jobs using all the available cores.
+*/
+struct OfflineRenderer
+{
+    struct Job
+    {
+        /** The player to render. This must have been compiled successfully. */
+        PatchPlayer::Ptr player;
+
+        /** The number of frames to render in each call to PatchPlayer::render(). This must not
+            exceed the maxFramesPerBlock that the player was compiled with.
+        */
+        uint32_t blockSize = 0;
+
+        /** The total number of frames to render. */
+        uint64_t numFrames = 0;
+
+        /** Input and output channel pointers, each of which must contain numFrames samples. */
+        const float* const* inputChannels = nullptr;
+        float* const* outputChannels = nullptr;
+        uint32_t numInputChannels = 0, numOutputChannels = 0;
+
+        /** The MIDI to play, sorted by frameIndex, where the frame index is relative to the start
+            of the whole render rather than to a block.
+        */
+        const MIDIMessage* incomingMIDI = nullptr;
+        uint32_t numMIDIMessagesIn = 0;
+
+        /** Parameter automation to apply, sorted by frameIndex, where the frame index is relative
+            to the start of the whole render rather than to a block.
+            @see PatchPlayer::RenderContext::parameterAutomation
+        */
+        const ParameterAutomationPoint* parameterAutomation = nullptr;
+        uint32_t numParameterAutomationPoints = 0;
+
+        /** Any MIDI produced by the player is appended to this, with frame indexes relative to
+            the start of the whole render.
+        */
+        std::vector<MIDIMessage> outgoingMIDI;
+
+        /** After rendering, this holds the result of the last call to PatchPlayer::render(). */
+        PatchPlayer::RenderResult result = PatchPlayer::RenderResult::ok;
+    };
+
+    /** Renders a single job on the calling thread.
+        Rendering stops early if any of the calls to PatchPlayer::render() fail, and the
+        failure is returned and also stored in the job's result.
+    */
+    static PatchPlayer::RenderResult render (Job& job)
+    {
+        if (job.player == nullptr || job.blockSize == 0)
+            return job.result = PatchPlayer::RenderResult::noProgramLoaded;
+
+        constexpr uint32_t maxMIDIOutPerBlock = 1024;
+        std::vector<const float*> inputs (job.numInputChannels);
+        std::vector<float*> outputs (job.numOutputChannels);
+        std::vector<MIDIMessage> midiIn, midiOut (maxMIDIOutPerBlock);
+        auto nextMIDIIn = job.incomingMIDI;
+        auto endMIDIIn = job.incomingMIDI + job.numMIDIMessagesIn;
+        std::vector<ParameterAutomationPoint> automation;
+        auto nextAutomationPoint = job.parameterAutomation;
+        auto endAutomation = job.parameterAutomation + job.numParameterAutomationPoints;
+
+        PatchPlayer::RenderContext rc;
+        rc.inputChannels = inputs.data();
+        rc.outputChannels = outputs.data();
+        rc.outgoingMIDI = midiOut.data();
+        rc.numInputChannels = job.numInputChannels;
+        rc.numOutputChannels = job.numOutputChannels;
+        rc.maximumMIDIMessagesOut = maxMIDIOutPerBlock;
+
+        for (uint64_t start = 0; start < job.numFrames; start += rc.numFrames)
+        {
+            rc.numFrames = static_cast<uint32_t> (std::min (static_cast<uint64_t> (job.blockSize), job.numFrames - start));
+
+            for (uint32_t i = 0; i < job.numInputChannels; ++i)
+                inputs[i] = job.inputChannels[i] + start;
+
+            for (uint32_t i = 0; i < job.numOutputChannels; ++i)
+                outputs[i] = job.outputChannels[i] + start;
+
+            midiIn.clear();
+
+            while (nextMIDIIn != endMIDIIn && nextMIDIIn->frameIndex < start + rc.numFrames)
+            {
+                auto m = *nextMIDIIn++;
+                m.frameIndex = static_cast<uint32_t> (m.frameIndex > start ? m.frameIndex - start : 0);
+                midiIn.push_back (m);
+            }
+
+            automation.clear();
+
+            while (nextAutomationPoint != endAutomation && nextAutomationPoint->frameIndex < start + rc.numFrames)
+            {
+                auto p = *nextAutomationPoint++;
+                p.frameIndex = static_cast<uint32_t> (p.frameIndex > start ? p.frameIndex - start : 0);
+                automation.push_back (p);
+            }
+
+            rc.incomingMIDI = midiIn.data();
+            rc.numMIDIMessagesIn = static_cast<uint32_t> (midiIn.size());
+            rc.parameterAutomation = automation.data();
+            rc.numParameterAutomationPoints = static_cast<uint32_t> (automation.size());
+            rc.numMIDIMessagesOut = 0;
+
+            job.result = job.player->render (rc);
+
+            if (job.result != PatchPlayer::RenderResult::ok)
+                return job.result;
+
+            for (uint32_t i = 0; i < std::min (rc.numMIDIMessagesOut, maxMIDIOutPerBlock); ++i)
+            {
+                auto m = midiOut[i];
+                m.frameIndex = static_cast<uint32_t> (m.frameIndex + start);
+                job.outgoingMIDI.push_back (m);
+            }
+        }
+
+        return job.result;
+    }
+
+    /** Renders a batch of independent jobs, sharing them out between a set of worker threads.
+        Each job must use a different PatchPlayer. If numThreads is 0, it will use as many
+        threads as there are hardware cores. This returns when all the jobs are finished.
+    */
+    static void renderInParallel (Job* jobs, size_t numJobs, uint32_t numThreads = 0)
+    {
+        if (numThreads == 0)
+            numThreads = std::max (1u, std::thread::hardware_concurrency());
+
+        numThreads = static_cast<uint32_t> (std::min (static_cast<size_t> (numThreads), numJobs));
+        std::atomic<size_t> nextJob { 0 };
+
+        auto renderNextJobs = [&]
+        {
+            for (;;)
+            {
+                auto index = nextJob++;
+
+                if (index >= numJobs)
+                    break;
+
+                render (jobs[index]);
+            }
+        };
+
+        std::vector<std::thread> threads;
+
+        for (uint32_t i = 1; i < numThreads; ++i)
+            threads.emplace_back (renderNextJobs);
+
+        renderNextJobs();
+
+        for (auto& t : threads)
+            t.join();
+    }
+};
+
+} // namespace patch
+} // namespace soul
+
+#if __clang__
+ #pragma clang diagnostic pop
+#endif
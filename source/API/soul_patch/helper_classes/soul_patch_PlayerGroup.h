@@ -0,0 +1,173 @@
+/*
+     _____ _____ _____ __
+    |   __|     |  |  |  |
+    |__   |  |  |  |  |  |__
+    |_____|_____|_____|_____|
+
+    Copyright (c) 2018 - ROLI Ltd.
+*/
+
+#pragma once
+
+#include "../API/soul_patch.h"
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+#if __clang__
+ #pragma clang diagnostic push
+ #pragma clang diagnostic ignored "-Wnon-virtual-dtor"
+#endif
+
+namespace soul
+{
+namespace patch
+{
+
+//==============================================================================
+/**
+    Renders a set of independent PatchPlayers for one block, sharing them out between a
+    pool of worker threads.
+
+    This is designed for hosts that run many players from a single audio callback: each
+    call to render() takes a list of tasks, each of which has its own player and its own
+    RenderContext, and returns once every task has been rendered. The calling thread joins
+    in with the rendering, and idle threads grab the next unrendered task, so the load is
+    balanced even when the players' costs differ.
+
+    A player must not appear in more than one task in the same call.
+*/
+struct PatchPlayerGroup
+{
+    /** Creates a group with the given number of background threads. If this is zero, all
+        the rendering is done by the thread that calls render().
+    */
+    PatchPlayerGroup (uint32_t numWorkerThreads)
+    {
+        for (uint32_t i = 0; i < numWorkerThreads; ++i)
+            threads.emplace_back ([this] { run(); });
+    }
+
+    ~PatchPlayerGroup()
+    {
+        {
+            std::lock_guard<std::mutex> lock (mutex);
+            shouldExit = true;
+        }
+
+        wakeUp.notify_all();
+
+        for (auto& t : threads)
+            t.join();
+    }
+
+    PatchPlayerGroup (const PatchPlayerGroup&) = delete;
+    PatchPlayerGroup& operator= (const PatchPlayerGroup&) = delete;
+
+    /** One of the players to render, with the buffers to use. */
+    struct Task
+    {
+        PatchPlayer* player = nullptr;
+        PatchPlayer::RenderContext context;
+
+        /** After a call to render(), this holds the value returned by the player. */
+        PatchPlayer::RenderResult result = PatchPlayer::RenderResult::ok;
+    };
+
+    /** Renders all the given tasks, returning when they're all finished. */
+    void render (Task* tasks, uint32_t numTasks)
+    {
+        if (numTasks == 0)
+            return;
+
+        Round round;
+
+        {
+            std::lock_guard<std::mutex> lock (mutex);
+            current = { current.number + 1, tasks, numTasks };
+            round = current;
+            numTasksRemaining = numTasks;
+            nextTask = static_cast<uint64_t> (round.number) << 32;
+        }
+
+        wakeUp.notify_all();
+        renderTasks (round);
+
+        while (numTasksRemaining.load() != 0)
+            std::this_thread::yield();
+    }
+
+private:
+    //==============================================================================
+    struct Round
+    {
+        uint32_t number = 0;
+        Task* tasks = nullptr;
+        uint32_t numTasks = 0;
+    };
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    Round current;
+    bool shouldExit = false;
+    std::atomic<uint32_t> numTasksRemaining { 0 };
+
+    // The round number is kept in the top half of this so that a thread which is late to
+    // finish one round can't claim an index belonging to the next one.
+    std::atomic<uint64_t> nextTask { 0 };
+
+    void run()
+    {
+        uint32_t lastRoundRendered = 0;
+
+        for (;;)
+        {
+            Round round;
+
+            {
+                std::unique_lock<std::mutex> lock (mutex);
+                wakeUp.wait (lock, [&] { return shouldExit || current.number != lastRoundRendered; });
+
+                if (shouldExit)
+                    return;
+
+                round = current;
+                lastRoundRendered = current.number;
+            }
+
+            renderTasks (round);
+        }
+    }
+
+    void renderTasks (const Round& round)
+    {
+        for (;;)
+        {
+            auto next = nextTask.load();
+            uint32_t index;
+
+            do
+            {
+                index = static_cast<uint32_t> (next);
+
+                if (static_cast<uint32_t> (next >> 32) != round.number || index >= round.numTasks)
+                    return;
+            }
+            while (! nextTask.compare_exchange_weak (next, next + 1));
+
+            auto& task = round.tasks[index];
+            task.result = task.player->render (task.context);
+            --numTasksRemaining;
+        }
+    }
+};
+
+} // namespace patch
+} // namespace soul
+
+#if __clang__
+ #pragma clang diagnostic pop
+#endif
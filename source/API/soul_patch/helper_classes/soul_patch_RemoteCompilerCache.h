@@ -0,0 +1,236 @@
+/*
+     _____ _____ _____ __
+    |   __|     |  |  |  |
+    |__   |  |  |  |  |  |__
+    |_____|_____|_____|_____|
+
+    Copyright (c) 2018 - ROLI Ltd.
+*/
+
+#pragma once
+
+#ifndef JUCE_CORE_H_INCLUDED
+ #error "this header is designed to be included in JUCE projects that contain the juce_core module"
+#endif
+
+#include "../API/soul_patch.h"
+#include <mutex>
+#include <chrono>
+#include <unordered_map>
+
+#if __clang__
+ #pragma clang diagnostic push
+ #pragma clang diagnostic ignored "-Wnon-virtual-dtor"
+#endif
+
+namespace soul
+{
+namespace patch
+{
+
+//==============================================================================
+/**
+    The interface to a shared key-value store, such as an HTTP server or a Redis
+    instance, which a RemoteCompilerCache uses to share compiled code between machines.
+
+    Keys are hashes of the content that the item was built from, so an item never changes
+    once it has been stored. Implementations must be safe to call from multiple threads.
+*/
+struct RemoteCompilerCacheStore
+{
+    virtual ~RemoteCompilerCacheStore() = default;
+
+    /** Fetches an item, returning false if the store doesn't have one for this key. */
+    virtual bool fetchItem (const std::string& key, juce::MemoryBlock& result) = 0;
+
+    /** Uploads an item. Failures can be ignored, as they just mean that another machine
+        will need to rebuild the item.
+    */
+    virtual void storeItem (const std::string& key, const void* data, uint64_t size) = 0;
+};
+
+//==============================================================================
+/**
+    A RemoteCompilerCacheStore which keeps each item at a URL made from a base URL and the
+    item's key. Items are fetched with a GET request, and stored with a PUT.
+*/
+struct HTTPCompilerCacheStore final  : public RemoteCompilerCacheStore
+{
+    HTTPCompilerCacheStore (juce::URL baseURL, int timeoutMilliseconds = 5000)
+        : base (std::move (baseURL)), timeoutMs (timeoutMilliseconds)
+    {
+    }
+
+    bool fetchItem (const std::string& key, juce::MemoryBlock& result) override
+    {
+        int statusCode = 0;
+
+        if (auto stream = getURLForKey (key).createInputStream (juce::URL::InputStreamOptions (juce::URL::ParameterHandling::inAddress)
+                                                                  .withConnectionTimeoutMs (timeoutMs)
+                                                                  .withStatusCode (&statusCode)))
+        {
+            if (statusCode == 200)
+            {
+                result.reset();
+                stream->readIntoMemoryBlock (result);
+                return result.getSize() != 0;
+            }
+        }
+
+        return false;
+    }
+
+    void storeItem (const std::string& key, const void* data, uint64_t size) override
+    {
+        auto url = getURLForKey (key).withPOSTData (juce::MemoryBlock (data, (size_t) size));
+
+        if (auto stream = url.createInputStream (juce::URL::InputStreamOptions (juce::URL::ParameterHandling::inPostData)
+                                                   .withConnectionTimeoutMs (timeoutMs)
+                                                   .withHttpRequestCmd ("PUT")
+                                                   .withExtraHeaders ("Content-Type: application/octet-stream")))
+            stream->readEntireStreamAsString();
+    }
+
+private:
+    juce::URL base;
+    int timeoutMs;
+
+    juce::URL getURLForKey (const std::string& key) const     { return base.getChildURL (key); }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (HTTPCompilerCacheStore)
+};
+
+//==============================================================================
+/**
+    A CompilerCache which sits in front of a RemoteCompilerCacheStore, so that a farm of
+    machines which all build the same patches only needs to compile each item once.
+
+    Items are looked for in a local cache first (e.g. a CompilerCacheFolder), then in the
+    remote store, and anything fetched from the remote store is copied into the local
+    cache. Keys which the remote store didn't have are remembered for a while, so that a
+    machine which is building something new doesn't ask for each of its items repeatedly.
+*/
+struct RemoteCompilerCache final  : public CompilerCache
+{
+    /** Creates a cache that uses a local cache (which must not be null) in front of a
+        remote store. The keyPrefix is added to the keys used in the remote store, so that
+        machines running incompatible compiler versions can share it without conflicts.
+    */
+    RemoteCompilerCache (CompilerCache::Ptr localCache,
+                         std::unique_ptr<RemoteCompilerCacheStore> remoteStore,
+                         std::string keyPrefix = {},
+                         std::chrono::milliseconds timeToRememberMissingItems = std::chrono::seconds (30))
+       : local (std::move (localCache)), remote (std::move (remoteStore)),
+         prefix (std::move (keyPrefix)), negativeCacheTimeout (timeToRememberMissingItems)
+    {
+        jassert (local != nullptr && remote != nullptr);
+    }
+
+    ~RemoteCompilerCache() = default;
+
+    void storeItemInCache (const char* key, const void* sourceData, uint64_t size) override
+    {
+        local->storeItemInCache (key, sourceData, size);
+        remote->storeItem (prefix + key, sourceData, size);
+        forgetMissingItem (key);
+    }
+
+    uint64_t readItemFromCache (const char* key, void* destAddress, uint64_t destSize) override
+    {
+        if (auto size = local->readItemFromCache (key, destAddress, destSize))
+            return size;
+
+        if (fetchFromRemoteStore (key))
+            return local->readItemFromCache (key, destAddress, destSize);
+
+        return 0;
+    }
+
+    ItemView* getItemView (const char* key) override
+    {
+        if (auto view = local->getItemView (key))
+            return view;
+
+        if (fetchFromRemoteStore (key))
+            return local->getItemView (key);
+
+        return {};
+    }
+
+    int addRef() noexcept override   { return ++refCount; }
+    int release() noexcept override  { auto newCount = --refCount; if (newCount == 0) delete this; return newCount; }
+
+private:
+    //==============================================================================
+    using Clock = std::chrono::steady_clock;
+
+    std::atomic<int> refCount { 1 };
+    CompilerCache::Ptr local;
+    std::unique_ptr<RemoteCompilerCacheStore> remote;
+    std::string prefix;
+    Clock::duration negativeCacheTimeout;
+
+    std::mutex missingItemsLock;
+    std::unordered_map<std::string, Clock::time_point> missingItems;
+
+    bool fetchFromRemoteStore (const char* key)
+    {
+        if (isKnownToBeMissing (key))
+            return false;
+
+        juce::MemoryBlock data;
+
+        if (remote->fetchItem (prefix + key, data))
+        {
+            local->storeItemInCache (key, data.getData(), data.getSize());
+            return true;
+        }
+
+        addMissingItem (key);
+        return false;
+    }
+
+    bool isKnownToBeMissing (const std::string& key)
+    {
+        std::lock_guard<std::mutex> lock (missingItemsLock);
+        auto found = missingItems.find (key);
+
+        if (found == missingItems.end())
+            return false;
+
+        if (Clock::now() < found->second)
+            return true;
+
+        missingItems.erase (found);
+        return false;
+    }
+
+    void addMissingItem (const std::string& key)
+    {
+        std::lock_guard<std::mutex> lock (missingItemsLock);
+        auto now = Clock::now();
+
+        // stop the list growing without limit when lots of new items are being built
+        if (missingItems.size() > 10000)
+            for (auto i = missingItems.begin(); i != missingItems.end();)
+                i = (i->second <= now ? missingItems.erase (i) : std::next (i));
+
+        missingItems[key] = now + negativeCacheTimeout;
+    }
+
+    void forgetMissingItem (const std::string& key)
+    {
+        std::lock_guard<std::mutex> lock (missingItemsLock);
+        missingItems.erase (key);
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (RemoteCompilerCache)
+};
+
+
+} // namespace patch
+} // namespace soul
+
+#if __clang__
+ #pragma clang diagnostic pop
+#endif
@@ -17,6 +17,7 @@
 
 #include <string>
 #include <vector>
+#include <memory>
 #include "../../3rdParty/choc/containers/choc_Value.h"
 #include "../../3rdParty/choc/audio/choc_MIDI.h"
 
@@ -147,9 +148,21 @@ struct BuildSettings
     size_t       maxStateSize       = 0;
     int          optimisationLevel  = -1;
     int32_t      sessionID          = 0;
+    uint32_t     maxCompilerThreads = 1;     ///< Allows parts of the compilation to be shared out between worker threads
     std::string  mainProcessor;
 
+    /** If this is set, processors which have a [[ reducedPrecision ]] annotation are compiled
+        with their float64 values lowered to float32. This is intended for embedded targets
+        where double precision arithmetic is slow or emulated.
+    */
+    bool         allowReducedPrecision = false;
+
     choc::value::Value customSettings;
+
+    /** The largest maxBlockSize that the compiler and linker will accept. Offline renderers can
+        use anything up to this, so that the per-block overhead is spread over more frames.
+    */
+    static constexpr uint32_t maxSupportedBlockSize = 65536;
 };
 
 /**
@@ -161,6 +174,14 @@ struct BuildBundle
     struct SourceFile
     {
         std::string filename, content;
+
+        /** If this is set, it holds the file's content instead of the content string.
+            The compiler keeps a reference to this buffer rather than copying it, which
+            avoids duplicating very large source files.
+        */
+        std::shared_ptr<const std::string> sharedContent = {};
+
+        const std::string& getContent() const     { return sharedContent != nullptr ? *sharedContent : content; }
     };
 
     std::vector<SourceFile> sourceFiles;
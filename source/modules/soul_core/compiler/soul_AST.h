@@ -150,9 +150,10 @@ struct AST
         template <typename Type>
         Identifier get (const Type& newString)  { return identifiers.get (newString); }
 
+        /** Deletes all the objects, but keeps the pool's memory blocks for re-use. */
         void clear()
         {
-            pool.clear();
+            pool.reset();
             identifiers.clear();
         }
 
@@ -568,6 +569,16 @@ struct AST
         {
             auto targetName = search.partiallyQualifiedPath.getLastPart();
 
+            if (auto index = getNameIndex (targetName))
+            {
+                auto found = index->entries.find (targetName);
+
+                if (found != index->entries.end())
+                    found->second.addResults (search);
+
+                return;
+            }
+
             if (search.findVariables)
                 search.addFirstWithName (getVariables(), targetName);
 
@@ -605,6 +616,121 @@ struct AST
         bool isFullyResolved = false;
 
     private:
+        //==============================================================================
+        /** Modules with a lot of declarations are searched using a hash index, which is
+            built when first needed and rebuilt whenever any of the declaration lists
+            changes size.
+        */
+        struct NameIndex
+        {
+            struct Entry
+            {
+                pool_ptr<VariableDeclaration> variable;
+                pool_ptr<StructDeclaration> structDeclaration;
+                pool_ptr<UsingDeclaration> usingDeclaration;
+                ArrayWithPreallocation<pool_ref<Function>, 2> functions;
+                pool_ptr<EndpointDeclaration> endpoint;
+                pool_ptr<ModuleBase> subModule;
+                pool_ptr<ProcessorAliasDeclaration> processorAlias;
+
+                void addResults (NameSearch& search) const
+                {
+                    if (search.findVariables && variable != nullptr)
+                        search.addResult (*variable);
+
+                    if (search.findTypes)
+                    {
+                        if (structDeclaration != nullptr)  search.addResult (*structDeclaration);
+                        if (usingDeclaration != nullptr)   search.addResult (*usingDeclaration);
+                    }
+
+                    if (search.findFunctions)
+                        for (auto& f : functions)
+                            if (search.requiredNumFunctionArgs < 0
+                                 || f->parameters.size() == static_cast<uint32_t> (search.requiredNumFunctionArgs))
+                                search.addResult (f);
+
+                    if (search.findEndpoints && endpoint != nullptr)
+                        search.addResult (*endpoint);
+
+                    if (search.findProcessorsAndNamespaces)
+                    {
+                        if (subModule != nullptr)       search.addResult (*subModule);
+                        if (processorAlias != nullptr)  search.addResult (*processorAlias);
+                    }
+                }
+
+                bool allNamesMatch (Identifier targetName) const
+                {
+                    for (auto& f : functions)
+                        if (f->name != targetName)
+                            return false;
+
+                    return (variable == nullptr           || variable->name == targetName)
+                        && (structDeclaration == nullptr  || structDeclaration->name == targetName)
+                        && (usingDeclaration == nullptr   || usingDeclaration->name == targetName)
+                        && (endpoint == nullptr           || endpoint->name == targetName)
+                        && (subModule == nullptr          || subModule->name == targetName)
+                        && (processorAlias == nullptr     || processorAlias->name == targetName);
+                }
+            };
+
+            using ListSizes = std::array<size_t, 7>;
+
+            std::unordered_map<Identifier, Entry, Identifier::Hash> entries;
+            ListSizes listSizes = {};
+            bool isBuilt = false;
+        };
+
+        static constexpr size_t minDeclarationsForNameIndex = 32;
+        mutable NameIndex nameIndex;
+
+        NameIndex::ListSizes getDeclarationListSizes() const
+        {
+            return { getVariables().size(), getStructDeclarations().size(), getUsingDeclarations().size(),
+                     getFunctions().size(), getEndpoints().size(), getSubModules().size(), getProcessorAliases().size() };
+        }
+
+        const NameIndex* getNameIndex (Identifier targetName) const
+        {
+            auto sizes = getDeclarationListSizes();
+            size_t total = 0;
+
+            for (auto size : sizes)
+                total += size;
+
+            if (total < minDeclarationsForNameIndex)
+                return nullptr;
+
+            if (! (nameIndex.isBuilt && nameIndex.listSizes == sizes))
+                rebuildNameIndex (sizes);
+
+            // If an item has been renamed since the index was built, it'll need refreshing
+            auto found = nameIndex.entries.find (targetName);
+
+            if (found != nameIndex.entries.end() && ! found->second.allNamesMatch (targetName))
+                rebuildNameIndex (sizes);
+
+            return std::addressof (nameIndex);
+        }
+
+        void rebuildNameIndex (const NameIndex::ListSizes& sizes) const
+        {
+            auto& entries = nameIndex.entries;
+            entries.clear();
+
+            for (auto& v : getVariables())            { auto& e = entries[v->name]; if (e.variable == nullptr)           e.variable = v; }
+            for (auto& s : getStructDeclarations())   { auto& e = entries[s->name]; if (e.structDeclaration == nullptr)  e.structDeclaration = s; }
+            for (auto& u : getUsingDeclarations())    { auto& e = entries[u->name]; if (e.usingDeclaration == nullptr)   e.usingDeclaration = u; }
+            for (auto& f : getFunctions())            { entries[f->name].functions.push_back (f); }
+            for (auto& ep : getEndpoints())           { auto& e = entries[ep->name]; if (e.endpoint == nullptr)          e.endpoint = ep; }
+            for (auto& m : getSubModules())           { auto& e = entries[m->name]; if (e.subModule == nullptr)          e.subModule = m; }
+            for (auto& a : getProcessorAliases())     { auto& e = entries[a->name]; if (e.processorAlias == nullptr)     e.processorAlias = a; }
+
+            nameIndex.listSizes = sizes;
+            nameIndex.isBuilt = true;
+        }
+
         size_t countEndpoints (bool countInputs) const
         {
             size_t num = 0;
@@ -1186,6 +1312,12 @@ struct AST
         std::vector<pool_ref<UsingDeclaration>> genericSpecialisations;
         pool_ptr<Function> originalGenericFunction;
         pool_ptr<FunctionCall> originalCallLeadingToSpecialisation;
+
+        /** For a generic function, the specialisations that have been created so far, keyed by their
+            names (which encode the argument types), so that callers with the same argument types can
+            share them without anything being re-parsed or searched for.
+        */
+        std::unordered_map<Identifier, pool_ref<Function>, Identifier::Hash> specialisationCache;
         Annotation annotation;
         IntrinsicType intrinsic = IntrinsicType::none;
         bool eventFunction = false;
@@ -33,10 +33,16 @@ Compiler::Compiler()
 void Compiler::reset()
 {
     topLevelNamespace.reset();
+    specialisedProcessors.clear();
+    specialisingGraphs.clear();
+    moduleKeys.clear();
     allocator.clear();
     auto rootNamespaceName = allocator.get (Program::getRootNamespaceName());
     topLevelNamespace = allocator.allocate<AST::Namespace> (AST::Context(), rootNamespaceName);
-    addDefaultBuiltInLibrary();
+
+    // The built-in library gets added when the first code is, so that a Compiler which has
+    // just been reset at the end of link() doesn't compile a copy that will never be used
+    hasBuiltInLibrary = false;
 }
 
 bool Compiler::addCode (CompileMessageList& messageList, CodeLocation code)
@@ -49,6 +55,9 @@ bool Compiler::addCode (CompileMessageList& messageList, CodeLocation code)
         if (code.isEmpty())
             code.throwError (Errors::emptyProgram());
 
+        if (! hasBuiltInLibrary)
+            addDefaultBuiltInLibrary();
+
         SOUL_LOG_TIME_OF_SCOPE ("initial resolution pass: " + code.getFilename());
         soul::CompileMessageHandler handler (messageList);
         compile (std::move (code));
@@ -61,7 +70,9 @@ bool Compiler::addCode (CompileMessageList& messageList, CodeLocation code)
 
 void Compiler::addDefaultBuiltInLibrary()
 {
+    BuildReport::Phase phase ("built-in library", std::addressof (allocator.pool));
     CompileMessageList list;
+    hasBuiltInLibrary = true;
 
     try
     {
@@ -73,8 +84,12 @@ void Compiler::addDefaultBuiltInLibrary()
         compile (getSystemModule ("soul.midi"));
         compile (getSystemModule ("soul.notes"));
         compile (getSystemModule ("soul.frequency"));
+        compile (getSystemModule ("soul.convolution"));
+        compile (getSystemModule ("soul.wavetable"));
         compile (getSystemModule ("soul.mixing"));
+        compile (getSystemModule ("soul.oversampling"));
         compile (getSystemModule ("soul.noise"));
+        compile (getSystemModule ("soul.delay"));
     }
     catch (soul::AbortCompilationException)
     {
@@ -83,7 +98,8 @@ void Compiler::addDefaultBuiltInLibrary()
 }
 
 static void sanityCheckBuildSettings (const BuildSettings& settings,
-                                      uint32_t minBlockSize = 1, uint32_t maxBlockSize = 65536)
+                                      uint32_t minBlockSize = 1, uint32_t maxBlockSize = BuildSettings::maxSupportedBlockSize,
+                                      uint32_t maxCompilerThreads = 256)
 {
     if (settings.maxBlockSize != 0 && (settings.maxBlockSize < minBlockSize || settings.maxBlockSize > maxBlockSize))
         CodeLocation().throwError (Errors::unsupportedBlockSize());
@@ -95,19 +111,154 @@ static void sanityCheckBuildSettings (const BuildSettings& settings,
 
     if (settings.optimisationLevel < -1 || settings.optimisationLevel > 3)
         CodeLocation().throwError (Errors::unsupportedOptimisationLevel());
+
+    if (settings.maxCompilerThreads > maxCompilerThreads)
+        CodeLocation().throwError (Errors::unsupportedNumberOfCompilerThreads());
+}
+
+static bool getCustomFlag (const BuildSettings& settings, const char* name)
+{
+    auto& custom = settings.customSettings;
+    return custom.isObject() && custom.hasObjectMember (name) && custom[name].getWithDefault<bool> (false);
+}
+
+static bool shouldCreateBuildReport (const BuildSettings& settings)
+{
+    return getCustomFlag (settings, "buildReport");
 }
 
 //==============================================================================
 Program Compiler::build (CompileMessageList& messageList, const BuildBundle& bundle)
+{
+    return build (messageList, bundle, true, nullptr);
+}
+
+Program Compiler::buildUnoptimised (CompileMessageList& messageList, const BuildBundle& bundle)
+{
+    return build (messageList, bundle, false, nullptr);
+}
+
+Program Compiler::build (CompileMessageList& messageList, const BuildBundle& bundle,
+                         bool shouldOptimise, IncrementalBuildCache* incrementalCache)
 {
     sanityCheckBuildSettings (bundle.settings);
+
+    std::unique_ptr<BuildReport::Recorder> reportRecorder;
+
+    if (shouldCreateBuildReport (bundle.settings))
+        reportRecorder = std::make_unique<BuildReport::Recorder> (messageList.buildReport);
+
+    BuildReport::Phase phase ("build");
     Compiler c;
 
+    if (incrementalCache != nullptr)
+    {
+        BuildReport::Phase hashPhase ("declaration hashes");
+        c.incrementalCache = incrementalCache;
+
+        for (auto& d : getTopLevelDeclarationHashes (bundle))
+            c.declarationKeys[d.name] += d.hash;
+    }
+
     for (auto& file : bundle.sourceFiles)
         if (! c.addCode (messageList, CodeLocation::createFromSourceFile (file)))
             return {};
 
-    return c.link (messageList, bundle.settings);
+    return c.link (messageList, bundle.settings, shouldOptimise);
+}
+
+Program Compiler::build (CompileMessageList& messageList, const BuildBundle& bundle, LinkerCache* cache,
+                         Program* unoptimisedProgram, IncrementalBuildCache* incrementalCache)
+{
+    if (unoptimisedProgram != nullptr)
+    {
+        *unoptimisedProgram = {};
+
+        if (cache == nullptr)
+        {
+            *unoptimisedProgram = build (messageList, bundle, false, incrementalCache);
+
+            if (unoptimisedProgram->isEmpty())
+                return {};
+
+            auto program = unoptimisedProgram->clone();
+            return optimise (messageList, program, bundle.settings, incrementalCache) ? program : Program();
+        }
+    }
+
+    if (cache == nullptr)
+        return build (messageList, bundle, true, incrementalCache);
+
+    std::unique_ptr<BuildReport::Recorder> reportRecorder;
+
+    if (shouldCreateBuildReport (bundle.settings))
+        reportRecorder = std::make_unique<BuildReport::Recorder> (messageList.buildReport);
+
+    auto key = "program" + getBuildHash (bundle);
+    BuildReport::Phase phase ("read from cache");
+
+    if (auto view = cache->getItemView (key.c_str()))
+    {
+        CompileMessageList errors;
+        auto program = Program::createFromBinary (errors, view->getData(), static_cast<size_t> (view->getSize()));
+
+        if (! program.isEmpty())
+        {
+            Trace::addInstantEvent ("cache", "linker cache hit");
+            return program;
+        }
+    }
+    else if (auto size = cache->readItem (key.c_str(), nullptr, 0))
+    {
+        std::vector<uint8_t> data (static_cast<size_t> (size));
+
+        if (cache->readItem (key.c_str(), data.data(), size) == size)
+        {
+            CompileMessageList errors;
+            auto program = Program::createFromBinary (errors, data.data(), data.size());
+
+            if (! program.isEmpty())
+            {
+                Trace::addInstantEvent ("cache", "linker cache hit");
+                return program;
+            }
+        }
+    }
+
+    Trace::addInstantEvent ("cache", "linker cache miss");
+    auto program = build (messageList, bundle, nullptr, unoptimisedProgram, incrementalCache);
+
+    if (! program.isEmpty())
+    {
+        auto data = program.toBinary();
+        cache->storeItem (key.c_str(), data.data(), data.size());
+    }
+
+    return program;
+}
+
+std::string Compiler::getBuildHash (const BuildBundle& bundle)
+{
+    HashBuilder hash;
+
+    for (auto& file : bundle.sourceFiles)
+        hash << file.filename << file.getContent();
+
+    auto& settings = bundle.settings;
+
+    hash << std::to_string (settings.sampleRate)
+         << std::to_string (settings.maxBlockSize)
+         << std::to_string (settings.maxStateSize)
+         << std::to_string (settings.optimisationLevel)
+         << std::to_string (settings.sessionID)
+         << settings.mainProcessor
+         << std::to_string (settings.allowReducedPrecision);
+
+    // NB: the custom settings include things like block profiles, which change the code that's generated
+    if (! settings.customSettings.isVoid())
+        hash << choc::json::toString (settings.customSettings);
+
+    return hash.toString();
 }
 
 std::vector<pool_ref<AST::ModuleBase>> Compiler::parseTopLevelDeclarations (AST::Allocator& allocator, CodeLocation code,
@@ -116,16 +267,129 @@ std::vector<pool_ref<AST::ModuleBase>> Compiler::parseTopLevelDeclarations (AST:
     return StructuralParser::parseTopLevelDeclarations (allocator, code, parentNamespace);
 }
 
+//==============================================================================
+struct DeclarationTokenHasher  : public Tokeniser<Keyword::Matcher,
+                                                  StandardOperatorMatcher,
+                                                  StandardIdentifierMatcher>
+{
+    DeclarationTokenHasher (const CodeLocation& start) : Tokeniser (start) {}
+
+    [[noreturn]] void throwError (const CompileMessage& message) const override
+    {
+        location.throwError (message);
+    }
+
+    std::string getHashOfTokensBefore (const char* end)
+    {
+        HashBuilder hash;
+
+        while (! matches (Token::eof) && (end == nullptr || location.location.getAddress() < end))
+        {
+            hash << std::string (currentType.text) << ' ';
+
+            if (matches (Token::identifier))
+                identifiers.insert (currentStringValue);
+
+            if (matchesAny (Token::identifier, Token::literalString))
+                hash << currentStringValue << ' ';
+            else if (matchesAny (Token::literalInt32, Token::literalInt64))
+                hash << std::to_string (literalIntValue) << ' ';
+            else if (matchesAny (Token::literalFloat32, Token::literalFloat64))
+                hash << choc::text::floatToString (literalDoubleValue) << ' ';
+
+            skip();
+        }
+
+        return hash.toString();
+    }
+
+    std::unordered_set<std::string> identifiers;
+};
+
+std::vector<Compiler::DeclarationHash> Compiler::getTopLevelDeclarationHashes (const BuildBundle& bundle)
+{
+    std::vector<DeclarationHash> results;
+    std::vector<std::unordered_set<std::string>> identifiersUsed;
+    CompileMessageList messages;
+
+    try
+    {
+        CompileMessageHandler handler (messages);
+
+        for (auto& file : bundle.sourceFiles)
+        {
+            AST::Allocator tempAllocator;
+            auto& ns = tempAllocator.allocate<AST::Namespace> (AST::Context(), tempAllocator.get (Program::getRootNamespaceName()));
+            auto modules = parseTopLevelDeclarations (tempAllocator, CodeLocation::createFromSourceFile (file), ns);
+
+            for (size_t i = 0; i < modules.size(); ++i)
+            {
+                auto& start = modules[i]->context.location;
+                auto end = i + 1 < modules.size() ? modules[i + 1]->context.location.location.getAddress() : nullptr;
+
+                DeclarationTokenHasher hasher (start);
+                results.push_back ({ modules[i]->name.toString(), hasher.getHashOfTokensBefore (end) });
+                identifiersUsed.push_back (std::move (hasher.identifiers));
+            }
+        }
+    }
+    catch (AbortCompilationException) { return {}; }
+
+    // Another top-level declaration can only be used by mentioning its name, apart from one with the
+    // same name, which is merged with it. These are followed recursively, and the hashes of all the
+    // declarations that were found are added to each one's own.
+    std::vector<DeclarationHash> combined;
+
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        std::vector<size_t> dependencies { i };
+
+        for (size_t next = 0; next < dependencies.size(); ++next)
+        {
+            auto& source = results[dependencies[next]];
+            auto& identifiers = identifiersUsed[dependencies[next]];
+
+            for (size_t j = 0; j < results.size(); ++j)
+                if (! contains (dependencies, j)
+                     && (results[j].name == source.name || identifiers.find (results[j].name) != identifiers.end()))
+                    dependencies.push_back (j);
+        }
+
+        std::sort (dependencies.begin(), dependencies.end());
+        HashBuilder hash;
+
+        for (auto d : dependencies)
+            hash << results[d].name << results[d].hash;
+
+        combined.push_back ({ results[i].name, hash.toString() });
+    }
+
+    return combined;
+}
+
 //==============================================================================
 void Compiler::compile (CodeLocation code)
 {
     SOUL_LOG_TIME_OF_SCOPE ("compile: " + code.getFilename());
+    BuildReport::Phase phase ("compile", code.getFilename(), std::addressof (allocator.pool));
+
+    std::vector<pool_ref<AST::ModuleBase>> modules;
 
-    for (auto& m : StructuralParser::parseTopLevelDeclarations (allocator, code, *topLevelNamespace))
-        SanityCheckPass::runPreResolution (m);
+    {
+        BuildReport::Phase parsePhase ("tokenise and parse", std::addressof (allocator.pool));
+        modules = StructuralParser::parseTopLevelDeclarations (allocator, code, *topLevelNamespace);
+    }
+
+    {
+        BuildReport::Phase sanityCheckPhase ("sanity check (pre-resolution)", std::addressof (allocator.pool));
+
+        for (auto& m : modules)
+            SanityCheckPass::runPreResolution (m);
+    }
 
     ResolutionPass::run (allocator, *topLevelNamespace, true);
 
+    BuildReport::Phase finalPhase ("duplicate name check", std::addressof (allocator.pool));
     ASTUtilities::mergeDuplicateNamespaces (*topLevelNamespace);
     SanityCheckPass::runDuplicateNameChecker (*topLevelNamespace);
 }
@@ -170,6 +434,11 @@ AST::ProcessorBase& Compiler::findMainProcessor (const BuildSettings& settings)
 }
 
 Program Compiler::link (CompileMessageList& messageList, const BuildSettings& settings)
+{
+    return link (messageList, settings, true);
+}
+
+Program Compiler::link (CompileMessageList& messageList, const BuildSettings& settings, bool shouldOptimise)
 {
     if (messageList.hasErrors())
         return {};
@@ -178,23 +447,30 @@ Program Compiler::link (CompileMessageList& messageList, const BuildSettings& se
     {
         CompileMessageHandler handler (messageList);
         sanityCheckBuildSettings (settings);
-        return link (messageList, findMainProcessor (settings));
+        return link (messageList, settings, findMainProcessor (settings), shouldOptimise);
     }
     catch (AbortCompilationException) {}
 
     return {};
 }
 
-Program Compiler::link (CompileMessageList& messageList, AST::ProcessorBase& processorToRun)
+Program Compiler::link (CompileMessageList& messageList, const BuildSettings& settings,
+                        AST::ProcessorBase& processorToRun, bool shouldOptimise)
 {
     try
     {
         SOUL_LOG_TIME_OF_SCOPE ("link time");
+        BuildReport::Phase phase ("link");
         CompileMessageHandler handler (messageList);
-        resolveProcessorInstances (processorToRun);
-        ASTUtilities::resolveHoistedEndpoints (allocator, *topLevelNamespace);
-        ASTUtilities::mergeDuplicateNamespaces (*topLevelNamespace);
-        ASTUtilities::removeModulesWithSpecialisationParams (*topLevelNamespace);
+
+        {
+            BuildReport::Phase resolvePhase ("resolve processor instances", std::addressof (allocator.pool));
+            resolveProcessorInstances (processorToRun);
+            ASTUtilities::resolveHoistedEndpoints (allocator, *topLevelNamespace);
+            ASTUtilities::mergeDuplicateNamespaces (*topLevelNamespace);
+            ASTUtilities::removeModulesWithSpecialisationParams (*topLevelNamespace);
+        }
+
         ResolutionPass::run (allocator, *topLevelNamespace, true);
         ResolutionPass::run (allocator, *topLevelNamespace, false);
         createImplicitProcessorInstances (*topLevelNamespace);
@@ -202,16 +478,37 @@ Program Compiler::link (CompileMessageList& messageList, AST::ProcessorBase& pro
 
         Program program;
         program.getStringDictionary() = allocator.stringDictionary;  // Bring the existing string dictionary along so that the handles match
-        compileAllModules (*topLevelNamespace, program, processorToRun);
-        heart::Utilities::inlineFunctionsThatUseAdvanceOrStreams<Optimisations> (program);
-        heart::Checker::sanityCheck (program);
+        program.getAllocator().identifiers.shareWith (allocator.identifiers);  // ..and the identifiers, so that names can be compared directly
+        auto heartPool = std::addressof (program.getAllocator().pool);
+
+        {
+            BuildReport::Phase generatorPhase ("HEART generation", heartPool);
+            compileAllModules (*topLevelNamespace, program, processorToRun, settings.maxCompilerThreads);
+        }
+
+        {
+            BuildReport::Phase inlinerPhase ("inline advance and stream functions", heartPool);
+            heart::Utilities::inlineFunctionsThatUseAdvanceOrStreams<Optimisations> (program);
+        }
+
+        {
+            BuildReport::Phase checkerPhase ("HEART checker", heartPool);
+            heart::Checker::sanityCheck (program, settings.maxCompilerThreads);
+        }
+
+        if (incrementalCache != nullptr)
+            incrementalCache->moduleKeys = std::move (moduleKeys);
+
         reset();
 
         SOUL_LOG (program.getMainProcessorOrThrowError().originalFullName + ": linked HEART",
-                  [&] { return program.toHEART(); });
+                  [&] { return program.toHEART (settings.maxCompilerThreads); });
 
         heart::Checker::testHEARTRoundTrip (program);
-        optimise (program);
+
+        if (shouldOptimise)
+            optimise (program, settings, incrementalCache);
+
         return program;
     }
     catch (AbortCompilationException) {}
@@ -219,10 +516,129 @@ Program Compiler::link (CompileMessageList& messageList, AST::ProcessorBase& pro
     return {};
 }
 
-void Compiler::optimise (Program& program)
+bool Compiler::optimise (CompileMessageList& messageList, Program& program, const BuildSettings& settings,
+                         IncrementalBuildCache* incrementalCache)
+{
+    std::unique_ptr<BuildReport::Recorder> reportRecorder;
+
+    if (shouldCreateBuildReport (settings))
+        reportRecorder = std::make_unique<BuildReport::Recorder> (messageList.buildReport);
+
+    try
+    {
+        CompileMessageHandler handler (messageList);
+        sanityCheckBuildSettings (settings);
+        optimise (program, settings, incrementalCache);
+        return true;
+    }
+    catch (AbortCompilationException) {}
+
+    return false;
+}
+
+void Compiler::optimise (Program& program, const BuildSettings& settings, IncrementalBuildCache* incrementalCache)
 {
-    Optimisations::optimiseFunctionBlocks (program);
-    Optimisations::removeUnusedVariables (program);
+    auto heartPool = std::addressof (program.getAllocator().pool);
+    auto profile = BlockProfile::fromSettings (settings);
+    std::vector<std::string> fusedModules;
+
+    if (settings.optimisationLevel != 0)
+    {
+        BuildReport::Phase phase ("fuse processors", heartPool);
+        fusedModules = ProcessorFusion::apply (program);
+    }
+
+    if (getCustomFlag (settings, BlockProfile::instrumentSetting))
+    {
+        BuildReport::Phase phase ("instrument blocks", heartPool);
+        BlockProfile::instrument (program);
+    }
+
+    if (settings.optimisationLevel != 0)
+    {
+        BuildReport::Phase phase ("evaluate initial state", heartPool);
+
+        if (incrementalCache != nullptr)
+        {
+            // A module that another processor was fused into no longer matches its declaration,
+            // and the block profile settings change what gets instrumented
+            auto settingsKey = choc::json::toString (settings.customSettings);
+
+            InitialStateEvaluator::apply (program, settings.sampleRate, [&] (const Module& m) -> std::string
+            {
+                auto key = incrementalCache->moduleKeys.find (m.fullName);
+
+                if (key == incrementalCache->moduleKeys.end() || key->second.empty() || contains (fusedModules, m.fullName))
+                    return {};
+
+                return key->second + settingsKey;
+            }, std::addressof (incrementalCache->initialStates));
+        }
+        else
+        {
+            InitialStateEvaluator::apply (program, settings.sampleRate);
+        }
+    }
+
+    {
+        BuildReport::Phase phase ("inline small functions", heartPool);
+        Optimisations::inlineFunctionsWithinBudget (program, settings.optimisationLevel, profile);
+    }
+
+    if (settings.allowReducedPrecision)
+    {
+        BuildReport::Phase phase ("reduce precision", heartPool);
+        PrecisionReduction::apply (program);
+    }
+
+    {
+        BuildReport::Phase phase ("constant propagation", heartPool);
+        Optimisations::propagateConstants (program);
+    }
+
+    {
+        BuildReport::Phase phase ("optimise function blocks", heartPool);
+        Optimisations::optimiseFunctionBlocks (program, settings.maxCompilerThreads);
+    }
+
+    if (getCustomFlag (settings, ProcessorArrayPacking::setting))
+    {
+        BuildReport::Phase phase ("pack processor arrays", heartPool);
+        ProcessorArrayPacking::apply (program);
+    }
+
+    {
+        BuildReport::Phase phase ("vectorise loops", heartPool);
+        Optimisations::vectoriseLoops (program);
+    }
+
+    {
+        BuildReport::Phase phase ("loop optimisations", heartPool);
+        Optimisations::optimiseLoops (program);
+    }
+
+    {
+        BuildReport::Phase phase ("remove unused variables", heartPool);
+        Optimisations::removeUnusedVariables (program);
+    }
+
+    if (! profile.isEmpty())
+    {
+        BuildReport::Phase phase ("move cold blocks", heartPool);
+        Optimisations::moveColdBlocksToEnd (program, profile);
+    }
+
+    if (settings.optimisationLevel != 0)
+    {
+        BuildReport::Phase phase ("state layout", heartPool);
+        StateLayout::apply (program);
+    }
+
+    if (getCustomFlag (settings, "flatFunctionBodies"))
+    {
+        BuildReport::Phase phase ("flatten function bodies", heartPool);
+        heart::FlatFunction::flattenProgram (program);
+    }
 }
 
 void Compiler::resolveProcessorInstances (AST::ProcessorBase& processor)
@@ -262,7 +678,9 @@ void Compiler::recursivelyResolveProcessorInstances (pool_ref<AST::ProcessorBase
             resolvedTargets.push_back (target);
             bool alreadyUsed = contains (usedProcessorInstances, target);
             auto resolvedProcessor = createSpecialisedInstance (*graph, i, target, alreadyUsed);
-            recursivelyResolveProcessorInstances (resolvedProcessor, usedProcessorInstances);
+
+            if (! contains (usedProcessorInstances, resolvedProcessor))
+                recursivelyResolveProcessorInstances (resolvedProcessor, usedProcessorInstances);
         }
 
         SOUL_ASSERT (resolvedTargets.size() == graph->processorInstances.size());
@@ -323,6 +741,71 @@ static std::string createSpecialisationNameSuffix (AST::Graph& graph, const AST:
                                                + "_" + processorInstance.instanceName->toString());
 }
 
+static bool areIdenticalSpecialisationArgs (AST::Expression& a, AST::Expression& b)
+{
+    if (AST::isResolvedAsType (a) || AST::isResolvedAsType (b))
+        return AST::isResolvedAsType (a) && AST::isResolvedAsType (b)
+                && a.resolveAsType().isIdentical (b.resolveAsType());
+
+    if (auto pa = cast<AST::ProcessorRef> (a))
+        if (auto pb = cast<AST::ProcessorRef> (b))
+            return pa->processor == pb->processor;
+
+    if (auto va = cast<AST::VariableRef> (a))
+        if (auto vb = cast<AST::VariableRef> (b))
+            return va->variable->isExternal && va->variable == vb->variable;
+
+    if (AST::isResolvedAsConstant (a) && AST::isResolvedAsConstant (b))
+        return a.getAsConstant()->value == b.getAsConstant()->value;
+
+    return false;
+}
+
+// Instances can only share a specialised clone if nothing inside it can tell them
+// apart, which rules out graphs and any processor that reads processor.id
+static bool canShareSpecialisation (AST::ProcessorBase& target)
+{
+    if (target.isGraph())
+        return false;
+
+    struct ProcessorIDFinder  : public ASTVisitor
+    {
+        void visit (AST::ProcessorProperty& p) override
+        {
+            if (p.property == heart::ProcessorProperty::Property::id)
+                found = true;
+        }
+
+        bool found = false;
+    };
+
+    ProcessorIDFinder finder;
+    finder.visitObject (target);
+    return ! finder.found;
+}
+
+pool_ptr<AST::ProcessorBase> Compiler::findExistingSpecialisation (const AST::ProcessorBase& target,
+                                                                   const AST::ProcessorInstance& processorInstance) const
+{
+    auto& args = processorInstance.specialisationArgs;
+
+    for (auto& s : specialisedProcessors)
+    {
+        if (s.target == target && s.args.size() == args.size())
+        {
+            bool allIdentical = true;
+
+            for (size_t i = 0; i < args.size() && allIdentical; ++i)
+                allIdentical = areIdenticalSpecialisationArgs (s.args[i], args[i]);
+
+            if (allIdentical)
+                return s.specialised;
+        }
+    }
+
+    return {};
+}
+
 pool_ref<AST::ProcessorBase> Compiler::createSpecialisedInstance (AST::Graph& graph,
                                                                   AST::ProcessorInstance& processorInstance,
                                                                   AST::ProcessorBase& target, bool mustCreateClone)
@@ -332,6 +815,19 @@ pool_ref<AST::ProcessorBase> Compiler::createSpecialisedInstance (AST::Graph& gr
     if (target.getSpecialisationParameters().size() != numParams)
         processorInstance.context.throwError (Errors::wrongNumArgsForProcessor (target.getFullyQualifiedPath()));
 
+    bool shareable = numParams != 0 && canShareSpecialisation (target);
+
+    if (shareable)
+    {
+        if (auto existing = findExistingSpecialisation (target, processorInstance))
+        {
+            processorInstance.targetProcessor = allocator.allocate<AST::ProcessorRef> (processorInstance.context, *existing);
+            processorInstance.specialisationArgs.clear();
+            return *existing;
+        }
+    }
+
+    auto originalArgs = processorInstance.specialisationArgs;
     pool_ref<AST::ProcessorBase> specialised (target);
 
     if (numParams != 0)
@@ -419,6 +915,9 @@ pool_ref<AST::ProcessorBase> Compiler::createSpecialisedInstance (AST::Graph& gr
         }
     }
 
+    if (numParams != 0 && incrementalCache != nullptr)
+        specialisingGraphs.push_back ({ specialised, graph });
+
     specialised->specialisationParams.clear();
     processorInstance.targetProcessor = allocator.allocate<AST::ProcessorRef> (processorInstance.context, specialised);
     processorInstance.specialisationArgs.clear();
@@ -426,6 +925,9 @@ pool_ref<AST::ProcessorBase> Compiler::createSpecialisedInstance (AST::Graph& gr
     // Since this clone isn't resolved, do this now
     ResolutionPass::run (allocator, specialised, true);
 
+    if (shareable)
+        specialisedProcessors.push_back ({ target, specialised, std::move (originalArgs) });
+
     return specialised;
 }
 
@@ -446,8 +948,36 @@ static Module& createHEARTModule (Program& p, pool_ptr<AST::ModuleBase> module,
     return p.addProcessor (index);
 }
 
+std::string Compiler::getModuleKey (const AST::ModuleBase& module) const
+{
+    auto topLevelModule = std::addressof (module);
+
+    while (auto parent = topLevelModule->getParentScope())
+    {
+        auto parentModule = parent->getAsModule();
+
+        if (parentModule == nullptr || parentModule->getParentScope() == nullptr)
+            break;
+
+        topLevelModule = parentModule;
+    }
+
+    // Anything that didn't come from the bundle's own declarations is part of the built-in library
+    auto name = topLevelModule->name.toString();
+    auto declarationKey = declarationKeys.find (name);
+    HashBuilder key;
+    key << (declarationKey != declarationKeys.end() ? declarationKey->second : "library " + name);
+
+    // A specialised clone also depends on the arguments that the graph gave it
+    for (auto& s : specialisingGraphs)
+        if (std::addressof (s.first.get()) == std::addressof (module))
+            key << getModuleKey (s.second);
+
+    return key.toString();
+}
+
 void Compiler::compileAllModules (const AST::Namespace& parentNamespace, Program& program,
-                                  AST::ProcessorBase& processorToRun)
+                                  AST::ProcessorBase& processorToRun, uint32_t numThreads)
 {
     std::vector<pool_ref<AST::ModuleBase>> soulModules;
     ASTUtilities::findAllModulesToCompile (parentNamespace, soulModules);
@@ -457,7 +987,16 @@ void Compiler::compileAllModules (const AST::Namespace& parentNamespace, Program
     for (auto& m : soulModules)
         heartModules.push_back (createHEARTModule (program, m, m == processorToRun));
 
-    HEARTGenerator::build (soulModules, heartModules);
+    HEARTGenerator::build (soulModules, heartModules, numThreads);
+
+    if (incrementalCache != nullptr)
+        for (size_t i = 0; i < soulModules.size(); ++i)
+            moduleKeys[heartModules[i]->fullName] = getModuleKey (soulModules[i]);
+
+    {
+        BuildReport::Phase phase ("performance warnings");
+        PerformanceLintPass::run (soulModules);
+    }
 }
 
 } // namespace soul
@@ -21,6 +21,8 @@
 namespace soul
 {
 
+class LinkerCache;
+
 //==============================================================================
 /**
     Compiles and links some source code to create a Program that can be
@@ -35,12 +37,46 @@ class Compiler  final
 public:
     Compiler();
 
+    struct IncrementalBuildCache;
+
     /** This static method runs a complete build and link for a BuildBundle, and returns
         the resulting program.
     */
     static Program build (CompileMessageList& messageList,
                           const BuildBundle& buildBundle);
 
+    /** Runs a complete build like the other build() method, but first looks in the cache
+        for a program that was previously built from an identical BuildBundle. If one is
+        found, the program is restored from it without compiling anything, and if not, the
+        newly built program is added to the cache. The cache may be nullptr.
+
+        If unoptimisedProgram isn't null and the program has to be compiled, it's set to the
+        program as buildUnoptimised() would have returned it, so the caller can keep it and
+        optimise a copy for different settings later, without compiling the source again.
+
+        If an IncrementalBuildCache is supplied, any work that it holds from an earlier build
+        for declarations which haven't changed is re-used, and the cache is updated with the
+        results of this build.
+    */
+    static Program build (CompileMessageList& messageList,
+                          const BuildBundle& buildBundle,
+                          LinkerCache* cache,
+                          Program* unoptimisedProgram = nullptr,
+                          IncrementalBuildCache* incrementalCache = nullptr);
+
+    /** Runs the parsing, resolution and linking stages of a build, but not the optimisation
+        passes. None of these stages depend on the sample rate or block size in the settings,
+        so a copy of the program that this returns can be passed to optimise() to create the
+        finished program for any sample rate and block size.
+    */
+    static Program buildUnoptimised (CompileMessageList& messageList,
+                                     const BuildBundle& buildBundle);
+
+    /** Returns a hash of the source files and all the settings in a BuildBundle that can
+        affect the program which it builds.
+    */
+    static std::string getBuildHash (const BuildBundle&);
+
     /** Compiles a chunk of code which is expected to contain a list of top-level
         processor/graph/namespace decls, and these are added to the program.
     */
@@ -57,15 +93,107 @@ public:
                                                                              CodeLocation code,
                                                                              AST::Namespace& parentNamespace);
 
+    //==============================================================================
+    /** A hash of the tokens in one of the top-level declarations in a chunk of code.
+        Because it's made from the tokens rather than the raw text, it stays the same
+        when only the whitespace or comments in a declaration have been altered.
+        @see getTopLevelDeclarationHashes
+    */
+    struct DeclarationHash
+    {
+        std::string name, hash;
+
+        bool operator== (const DeclarationHash& other) const    { return name == other.name && hash == other.hash; }
+        bool operator!= (const DeclarationHash& other) const    { return ! operator== (other); }
+    };
+
+    /** Parses all the files in a BuildBundle, and returns a hash for each of the top-level
+        processors, graphs and namespaces that they declare.
+        As well as a declaration's own tokens, each hash covers the hashes of all the other
+        top-level declarations that it mentions by name, directly or indirectly, and of any
+        others with the same name (which get merged with it), so a change to a declaration
+        also changes the hashes of everything that depends on it.
+        If two bundles produce the same list of hashes and are built with the same settings,
+        then they'll also compile to the same program, so this can be used to avoid re-building
+        code that hasn't really changed. If any of the files fail to parse, this returns an
+        empty list.
+    */
+    static std::vector<DeclarationHash> getTopLevelDeclarationHashes (const BuildBundle&);
+
+    //==============================================================================
+    /** Keeps the results of the slowest per-processor stage of a build, the evaluation of
+        each processor's initial state, so that when some code is edited and rebuilt, it only
+        has to be repeated for the processors whose top-level declarations have changed, or
+        depend on one that has.
+
+        The results are looked up using the declaration hashes from getTopLevelDeclarationHashes(),
+        combined with those of the graph that specialised a processor, if it's a specialised
+        clone. To use it, pass the same object to build() each time the code is rebuilt, and to
+        optimise() when re-optimising the unoptimised program that the last build produced.
+        It isn't thread-safe, so builds which share one must not run at the same time.
+    */
+    struct IncrementalBuildCache
+    {
+        /** The outcome of evaluating a processor's init function. */
+        struct InitialState
+        {
+            std::string stateVariables;    ///< The names and types of the processor's state, as a safety-check
+            bool wasReplaced = false;      ///< True if the init function was replaced by the values below
+            std::vector<std::pair<std::string, std::vector<uint8_t>>> values;
+        };
+
+        /** The key for each module in the most recently linked program, by name. Modules
+            that are missing from this, or have an empty key, are always processed again.
+        */
+        std::unordered_map<std::string, std::string> moduleKeys;
+
+        /** The initial states that were used by the most recent call to optimise(). */
+        std::unordered_map<std::string, InitialState> initialStates;
+    };
+
+    /** Runs the optimisation passes that build() applies to a linked program, using the
+        optimisation level and other options in the settings. This can be used to re-optimise
+        a copy of a program which was originally built at a lower level.
+    */
+    static void optimise (Program&, const BuildSettings&, IncrementalBuildCache* incrementalCache = nullptr);
+
+    /** Runs optimise() on a program, adding any errors to the message list instead of throwing
+        them, and returning false if it fails. Along with buildUnoptimised(), this lets a program
+        be specialised for a new sample rate or block size without compiling the source again.
+    */
+    static bool optimise (CompileMessageList&, Program&, const BuildSettings&,
+                          IncrementalBuildCache* incrementalCache = nullptr);
+
 private:
     //==============================================================================
     AST::Allocator allocator;
     pool_ptr<AST::Namespace> topLevelNamespace;
 
+    /** Remembers each specialised clone that was created from a set of arguments, so that
+        other instances with the same target and identical arguments can share it.
+    */
+    struct SpecialisedProcessor
+    {
+        pool_ref<AST::ProcessorBase> target, specialised;
+        std::vector<pool_ref<AST::Expression>> args;
+    };
+
+    std::vector<SpecialisedProcessor> specialisedProcessors;
+
+    /** The graph whose processor instance each specialised clone was made for. */
+    std::vector<std::pair<pool_ref<AST::ProcessorBase>, pool_ref<AST::Graph>>> specialisingGraphs;
+
+    bool hasBuiltInLibrary = false;
+    IncrementalBuildCache* incrementalCache = nullptr;
+    std::unordered_map<std::string, std::string> declarationKeys, moduleKeys;
+
     void reset();
     void addDefaultBuiltInLibrary();
     void compile (CodeLocation);
-    Program link (CompileMessageList&, AST::ProcessorBase& processorToRun);
+    static Program build (CompileMessageList&, const BuildBundle&, bool shouldOptimise, IncrementalBuildCache*);
+    Program link (CompileMessageList&, const BuildSettings&, bool shouldOptimise);
+    Program link (CompileMessageList&, const BuildSettings&, AST::ProcessorBase& processorToRun, bool shouldOptimise);
+    std::string getModuleKey (const AST::ModuleBase&) const;
     void resolveProcessorInstances (AST::ProcessorBase&);
     AST::ProcessorBase& findMainProcessor (const BuildSettings&);
 
@@ -73,10 +201,10 @@ private:
     void createImplicitProcessorInstanceIfNeeded (AST::Graph&, AST::QualifiedIdentifier& path);
     void createImplicitProcessorInstances (AST::ModuleBase&);
     pool_ref<AST::ProcessorBase> createSpecialisedInstance (AST::Graph&, AST::ProcessorInstance&, AST::ProcessorBase& target, bool mustCreateClone);
+    pool_ptr<AST::ProcessorBase> findExistingSpecialisation (const AST::ProcessorBase& target, const AST::ProcessorInstance&) const;
 
     pool_ref<AST::ProcessorBase> addClone (const AST::ProcessorBase&, const std::string& nameRoot);
-    void compileAllModules (const AST::Namespace& parentNamespace, Program&, AST::ProcessorBase& processorToRun);
-    void optimise (Program&);
+    void compileAllModules (const AST::Namespace& parentNamespace, Program&, AST::ProcessorBase& processorToRun, uint32_t numThreads);
 };
 
 } // namespace soul
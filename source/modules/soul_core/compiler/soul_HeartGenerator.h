@@ -29,25 +29,60 @@ struct HEARTGenerator  : public ASTVisitor
 {
     static void build (ArrayView<pool_ref<AST::ModuleBase>> sourceModules,
                        ArrayView<pool_ref<Module>> targetModules,
+                       uint32_t numThreads = 1,
                        uint32_t maxNestedExpressionDepth = 255)
     {
-        for (auto& m : sourceModules)
-            SanityCheckPass::runPostResolution (m);
+        {
+            BuildReport::Phase phase ("sanity check (post-resolution)");
+            SanityCheckPass::runPostResolution (sourceModules, numThreads);
+        }
 
         std::vector<HEARTGenerator> generators;
 
         for (size_t i = 0; i < sourceModules.size(); ++i)
-            generators.push_back ({ sourceModules[i], targetModules[i], maxNestedExpressionDepth });
+            generators.push_back ({ sourceModules[i], targetModules[i], targetModules[i]->allocator, maxNestedExpressionDepth });
 
         for (size_t i = 0; i < sourceModules.size(); ++i)
             generators[i].visitObject (sourceModules[i]);
+
+        // Once every module's declarations exist, a function body only adds objects to its own
+        // module, so the bodies can be generated on worker threads, each with its own allocator.
+        // The same two phases are used when there's only one thread, so the result doesn't
+        // depend on the number of threads.
+        auto numBatches = std::min ((size_t) numThreads, generators.size());
+
+        if (numBatches <= 1)
+        {
+            for (auto& g : generators)
+                g.generateFunctionBodies();
+
+            return;
+        }
+
+        auto batchSize = (generators.size() + numBatches - 1) / numBatches;
+        std::vector<heart::Allocator> allocators;
+        std::mutex lock;
+
+        for (size_t i = 0; i < numBatches; ++i)
+            allocators.emplace_back (targetModules.front()->program.getAllocator(), lock);
+
+        runCompileTasksInParallel (numBatches, numThreads, [&] (size_t batch)
+        {
+            auto end = std::min (generators.size(), (batch + 1) * batchSize);
+
+            for (auto i = batch * batchSize; i < end; ++i)
+                HEARTGenerator (generators[i], allocators[batch]).generateFunctionBodies();
+        });
+
+        for (auto& a : allocators)
+            targetModules.front()->program.getAllocator().pool.absorb (a.pool);
     }
 
 private:
     using super = ASTVisitor;
 
-    HEARTGenerator (AST::ModuleBase& source, Module& targetModule, uint32_t maxDepth)
-        : module (targetModule), builder (targetModule), maxExpressionDepth (maxDepth)
+    HEARTGenerator (AST::ModuleBase& source, Module& targetModule, heart::Allocator& a, uint32_t maxDepth)
+        : sourceModule (source), module (targetModule), allocator (a), builder (targetModule, a), maxExpressionDepth (maxDepth)
     {
         auto path = source.getFullyQualifiedPath();
         module.shortName = path.getLastPart().toString();
@@ -60,7 +95,7 @@ private:
             {
                 if (! f->isGeneric())
                 {
-                    auto& af = module.allocate<heart::Function>();
+                    auto& af = allocator.allocate<heart::Function>();
                     af.name = getFunctionName (f);
                     module.functions.push_back (af);
                     f->generatedFunction = af;
@@ -74,9 +109,20 @@ private:
                     addExternalVariable (v);
     }
 
+    /** Creates a generator for a module that has already been declared, which allocates
+        the objects for its function bodies from a different allocator.
+    */
+    HEARTGenerator (const HEARTGenerator& declared, heart::Allocator& a)
+        : sourceGraph (declared.sourceGraph), sourceProcessor (declared.sourceProcessor), sourceModule (declared.sourceModule),
+          module (declared.module), allocator (a), builder (declared.module, a), maxExpressionDepth (declared.maxExpressionDepth)
+    {
+    }
+
     pool_ptr<const AST::Graph> sourceGraph;
     pool_ptr<const AST::Processor> sourceProcessor;
+    AST::ModuleBase& sourceModule;
     Module& module;
+    heart::Allocator& allocator;
 
     uint32_t loopIndex = 0, ifIndex = 0;
     bool parsingStateVariables = false;
@@ -90,7 +136,7 @@ private:
     //==============================================================================
     Identifier convertIdentifier (Identifier i)
     {
-        return module.allocator.get (i);
+        return allocator.get (i);
     }
 
     static std::string getOriginalModulePath (IdentifierPath path)
@@ -104,8 +150,8 @@ private:
     heart::Variable& createVariableDeclaration (AST::VariableDeclaration& v,
                                                 heart::Variable::Role role)
     {
-        auto& av = module.allocate<heart::Variable> (v.context.location, v.getType(),
-                                                     convertIdentifier (v.name), role);
+        auto& av = allocator.allocate<heart::Variable> (v.context.location, v.getType(),
+                                                        convertIdentifier (v.name), role);
         v.generatedVariable = av;
         av.annotation = v.annotation.toPlainAnnotation (module.program.getStringDictionary());
         return av;
@@ -159,9 +205,6 @@ private:
         parsingStateVariables = true;
         super::visit (p);
         parsingStateVariables = false;
-
-        createInitFunction();
-        generateFunctions (p.functions);
     }
 
     void visit (AST::Graph& g) override
@@ -180,8 +223,16 @@ private:
         for (auto& f : n.functions)   visitObject (f);
         for (auto& s : n.structures)  visitObject (s);
         for (auto& u : n.usings)      visitObject (u);
+    }
+
+    /** Generates the code for the module's functions, after all the modules have been visited. */
+    void generateFunctionBodies()
+    {
+        if (sourceProcessor != nullptr)
+            createInitFunction();
 
-        generateFunctions (n.functions);
+        if (auto fns = sourceModule.getFunctionList())
+            generateFunctions (*fns);
     }
 
     //==============================================================================
@@ -191,7 +242,7 @@ private:
 
         if (e.isInput)
         {
-            auto& i = module.allocate<heart::InputDeclaration> (e.context.location);
+            auto& i = allocator.allocate<heart::InputDeclaration> (e.context.location);
             i.name = convertIdentifier (e.name);
             i.index = (uint32_t) module.inputs.size();
             i.endpointType = e.details->endpointType;
@@ -207,7 +258,7 @@ private:
         }
         else
         {
-            auto& o = module.allocate<heart::OutputDeclaration> (e.context.location);
+            auto& o = allocator.allocate<heart::OutputDeclaration> (e.context.location);
             o.name = convertIdentifier (e.name);
             o.index = (uint32_t) module.outputs.size();
             o.endpointType = e.details->endpointType;
@@ -225,14 +276,14 @@ private:
 
     void visit (AST::Connection& conn) override
     {
-        auto& c = module.allocate<heart::Connection> (conn.context.location);
+        auto& c = allocator.allocate<heart::Connection> (conn.context.location);
         module.connections.push_back (c);
 
         c.sourceProcessor     = getOrAddProcessorInstance (*conn.source.processorName);
         c.destProcessor       = getOrAddProcessorInstance (*conn.dest.processorName);
-        c.sourceEndpoint      = conn.source.endpoint;
+        c.sourceEndpoint      = convertIdentifier (conn.source.endpoint);
         c.sourceEndpointIndex = getEndpointIndex (conn.source.endpointIndex);
-        c.destEndpoint        = conn.dest.endpoint;
+        c.destEndpoint        = convertIdentifier (conn.dest.endpoint);
         c.destEndpointIndex   = getEndpointIndex (conn.dest.endpointIndex);
         c.interpolationType   = conn.interpolationType;
         c.delayLength         = getDelayLength (conn.delayLength);
@@ -302,7 +353,7 @@ private:
             {
                 auto& targetProcessor = sourceGraph->findSingleMatchingProcessor (i);
 
-                auto& p = module.allocate<heart::ProcessorInstance>();
+                auto& p = allocator.allocate<heart::ProcessorInstance>();
                 p.instanceName = processorName.path.toString();
                 p.sourceName = targetProcessor.getFullyQualifiedPath().toString();
                 p.arraySize = getProcessorArraySize (i->arraySize).value_or (1);
@@ -359,10 +410,10 @@ private:
         {
             auto name = heart::getEventFunctionName (nameRoot, f.parameters[0]->getType());
             SOUL_ASSERT (module.findFunction (name) == nullptr);
-            return module.allocator.get (name);
+            return allocator.get (name);
         }
 
-        return module.allocator.get (addSuffixToMakeUnique (nameRoot,
+        return allocator.get (addSuffixToMakeUnique (nameRoot,
                                                             [this] (const std::string& name)
                                                             {
                                                                 return module.findFunction (name) != nullptr;
@@ -377,9 +428,9 @@ private:
 
     void createInitFunction()
     {
-        auto& af = module.allocate<heart::Function>();
+        auto& af = allocator.allocate<heart::Function>();
 
-        af.name = module.allocator.get (heart::getSystemInitFunctionName());
+        af.name = allocator.get (heart::getSystemInitFunctionName());
         af.functionType = heart::FunctionType::systemInit();
         af.returnType = soul::Type (soul::PrimitiveType::void_);
 
@@ -429,7 +480,7 @@ private:
             {
                 // This will fail if the function isn't void but some blocks terminate without returning a value,
                 // however, we'll make sure they're not unreachable before flagging this as an error
-                Optimisations::optimiseFunctionBlocks (af, module.allocator);
+                Optimisations::optimiseFunctionBlocks (af, allocator);
 
                 if (! builder.checkFunctionBlocksForTermination())
                     f.context.throwError (Errors::notAllControlPathsReturnAValue (f.name));
@@ -520,7 +571,7 @@ private:
         if (++expressionDepth < maxExpressionDepth)
         {
             if (auto c = e.getAsConstant())
-                return module.allocator.allocate<heart::Constant> (c->context.location, c->value);
+                return allocator.allocate<heart::Constant> (c->context.location, c->value);
 
             if (auto v = cast<AST::VariableRef> (e))
             {
@@ -596,7 +647,7 @@ private:
                 if (module.isNamespace())
                     pp->context.throwError (Errors::processorPropertyUsedOutsideDecl());
 
-                return module.allocator.allocate<heart::ProcessorProperty> (pp->context.location, pp->property);
+                return allocator.allocate<heart::ProcessorProperty> (pp->context.location, pp->property);
             }
         }
 
@@ -632,7 +683,7 @@ private:
         auto constValue = resolved.getAsConstant();
 
         if (constValue.isValid() && TypeRules::canSilentlyCastTo (targetType, constValue))
-            return module.allocate<heart::Constant> (e.context.location, constValue.castToTypeExpectingSuccess (targetType));
+            return allocator.allocate<heart::Constant> (e.context.location, constValue.castToTypeExpectingSuccess (targetType));
 
         if (! TypeRules::canSilentlyCastTo (targetType, resolvedType))
             e.context.throwError (Errors::expectedExpressionOfType (targetType.getDescription()));
@@ -657,14 +708,14 @@ private:
             auto range = subscript.getResolvedSliceRange();
             SOUL_ASSERT (arrayOrVectorType.isValidArrayOrVectorRange (range.start, range.end));
 
-            auto& result = builder.module.allocate<heart::ArrayElement> (subscript.context.location, source, range.start, range.end);
+            auto& result = allocator.allocate<heart::ArrayElement> (subscript.context.location, source, range.start, range.end);
             result.suppressWrapWarning = subscript.suppressWrapWarning;
             result.isRangeTrusted = true;
             return result;
         }
 
         auto& index = evaluateAsExpression (*subscript.startIndex);
-        auto& result = builder.module.allocate<heart::ArrayElement> (subscript.context.location, source, index);
+        auto& result = allocator.allocate<heart::ArrayElement> (subscript.context.location, source, index);
         result.suppressWrapWarning = subscript.suppressWrapWarning;
         result.optimiseDynamicIndexIfPossible();
         return result;
@@ -803,10 +854,10 @@ private:
         auto& falseBlock  = builder.createBlock ("@ternary_false_", labelIndex);
         auto& endBlock    = builder.createBlock ("@ternary_end_", labelIndex);
 
-        auto& paramVar = module.allocate<heart::Variable> (t.context.location,
-                                                           targetVar.getType().removeReferenceIfPresent(),
-                                                           module.allocator.get ("$_T" + std::to_string (labelIndex)),
-                                                           heart::Variable::Role::parameter);
+        auto& paramVar = allocator.allocate<heart::Variable> (t.context.location,
+                                                              targetVar.getType().removeReferenceIfPresent(),
+                                                              allocator.get ("$_T" + std::to_string (labelIndex)),
+                                                              heart::Variable::Role::parameter);
 
         endBlock.addParameter (paramVar);
 
@@ -863,8 +914,8 @@ private:
     {
         SOUL_ASSERT (call.targetFunction.generatedFunction != nullptr);
 
-        auto& fc = module.allocate<heart::FunctionCall> (call.context.location, targetVariable,
-                                                         call.targetFunction.generatedFunction);
+        auto& fc = allocator.allocate<heart::FunctionCall> (call.context.location, targetVariable,
+                                                            call.targetFunction.generatedFunction);
 
         for (size_t i = 0; i < call.getNumArguments(); ++i)
         {
@@ -1008,7 +1059,7 @@ private:
 
         auto& oldValue = builder.createRegisterVariable (type);
         builder.addAssignment (oldValue, dest);
-        auto& one = module.allocator.allocate<heart::Constant> (p.context.location, Value::createInt32 (1).castToTypeExpectingSuccess (type));
+        auto& one = allocator.allocate<heart::Constant> (p.context.location, Value::createInt32 (1).castToTypeExpectingSuccess (type));
         auto& incrementedValue = builder.createBinaryOp (p.context.location, oldValue, one, op);
 
         if (resultDestVar == nullptr)
@@ -44,10 +44,12 @@ namespace Keyword
     {
         static TokenType match (int len, UTF8Reader p) noexcept
         {
-            #define SOUL_COMPARE_KEYWORD(name, str) if (len == (int) sizeof (str) - 1 && p.startsWith (str)) return name;
-            SOUL_KEYWORDS (SOUL_COMPARE_KEYWORD)
-            #undef SOUL_COMPARE_KEYWORD
-            return {};
+            #define SOUL_LIST_KEYWORD(name, str) name,
+            static constexpr TokenType keywords[] = { SOUL_KEYWORDS (SOUL_LIST_KEYWORD) };
+            #undef SOUL_LIST_KEYWORD
+
+            static constexpr KeywordHashTable<256> table (keywords);
+            return table.match (len, p.getAddress());
         }
     };
 }
@@ -1388,6 +1390,135 @@ private:
         return e;
     }
 
+    /** Array types aren't resolved until the resolution pass, but the simple cases, where
+        the element type is a primitive and the size is a literal, can be worked out in advance.
+    */
+    static std::optional<Type> getTypeIfKnownWhileParsing (AST::Expression& e)
+    {
+        if (AST::isResolvedAsType (e))
+            return e.resolveAsType();
+
+        if (auto meta = cast<AST::TypeMetaFunction> (e))
+            if (meta->operation == AST::TypeMetaFunction::Op::makeConst)
+                if (auto type = getTypeIfKnownWhileParsing (meta->source))
+                    return type->createConstIfNotPresent();
+
+        if (auto subscript = cast<AST::SubscriptWithBrackets> (e))
+        {
+            if (AST::isResolvedAsType (subscript->lhs.get()))
+            {
+                auto elementType = subscript->lhs->resolveAsType();
+
+                if (elementType.isPrimitive())
+                {
+                    if (subscript->rhs == nullptr)
+                        return elementType.createUnsizedArray();
+
+                    if (auto size = cast<AST::Constant> (subscript->rhs))
+                        if (size->value.getType().isPrimitiveInteger() && Type::canBeSafelyCastToArraySize (size->value.getAsInt64()))
+                            return elementType.createArray (static_cast<Type::ArraySize> (size->value.getAsInt64()));
+                }
+            }
+        }
+
+        return {};
+    }
+
+    /** Big lookup tables can have a huge number of elements, so rather than creating an AST node
+        for each of them, a bracketed list of numeric literals for an array or vector type that's
+        already known is read straight into a single constant. If the list turns out to contain
+        anything else, the parser is rewound and this returns nullptr, so that it can be parsed
+        as a normal expression.
+    */
+    pool_ptr<AST::Constant> tryParsingPackedConstantList (const AST::Context& context, const Type& targetType,
+                                                          bool isVariableInitialiser)
+    {
+        if (! targetType.isArrayOrVector() || targetType.isReference())
+            return {};
+
+        auto elementType = targetType.getElementType().removeConstIfPresent();
+
+        if (! (elementType.isPrimitive() && (elementType.isFloatingPoint() || elementType.isInteger())))
+            return {};
+
+        auto startPos = getCurrentTokeniserPosition();
+        expect (Operator::openParen);
+
+        auto firstLiteralType = currentType;
+        bool isIntLiteral = matchesAny (Token::literalInt32, Token::literalInt64);
+        std::vector<int64_t> intValues;
+        std::vector<double> floatValues;
+
+        auto getElementValue = [&] (size_t index) -> Value
+        {
+            if (firstLiteralType == Token::literalInt32)   return Value::createInt32 (intValues[index]);
+            if (firstLiteralType == Token::literalInt64)   return Value::createInt64 (intValues[index]);
+            if (firstLiteralType == Token::literalFloat32) return Value ((float) floatValues[index]);
+            return Value (floatValues[index]);
+        };
+
+        auto rewind = [&]
+        {
+            resetPosition (startPos);
+            return pool_ptr<AST::Constant>();
+        };
+
+        if (! (isIntLiteral || matchesAny (Token::literalFloat32, Token::literalFloat64)))
+            return rewind();
+
+        for (;;)
+        {
+            if (! matches (firstLiteralType))
+                return rewind();
+
+            if (isIntLiteral)
+                intValues.push_back (literalIntValue);
+            else
+                floatValues.push_back (literalDoubleValue);
+
+            skip();
+
+            if (matchIf (Operator::closeParen))
+                break;
+
+            if (! matchIf (Operator::comma))
+                return rewind();
+
+            // (a trailing comma is only allowed in the argument list of a cast)
+            if (! isVariableInitialiser && matchIf (Operator::closeParen))
+                break;
+        }
+
+        if (isVariableInitialiser && ! matchesAny (Operator::semicolon, Operator::comma))
+            return rewind();
+
+        auto numElements = isIntLiteral ? intValues.size() : floatValues.size();
+
+        if (numElements < 2 || ! TypeRules::canCastTo (elementType, getElementValue (0).getType()))
+            return rewind();
+
+        auto arrayType = targetType.removeConstIfPresent();
+
+        if (arrayType.isUnsizedArray())
+        {
+            if (numElements * elementType.getPackedSizeInBytes() > Type::maxPackedObjectSize)
+                return rewind();
+
+            arrayType = arrayType.createCopyWithNewArraySize (TypeRules::checkArraySizeAndThrowErrorIfIllegal (context, numElements));
+        }
+        else if (arrayType.getArrayOrVectorSize() != numElements)
+        {
+            return rewind();
+        }
+
+        auto result = Value::zeroInitialiser (arrayType);
+
+        for (size_t i = 0; i < numElements; ++i)
+            result.modifySubElementInPlace (i, getElementValue (i).castToTypeExpectingSuccess (elementType));
+
+        return allocate<AST::Constant> (context, std::move (result));
+    }
+
     AST::Expression& createLiteral (Value v)
     {
         auto& lit = allocate<AST::Constant> (getContext(), v);
@@ -1463,6 +1594,11 @@ private:
         if (matches (Operator::dot))
             return parseDotOperator (expression);
 
+        if (matches (Operator::openParen))
+            if (auto type = getTypeIfKnownWhileParsing (expression))
+                if (auto packedList = tryParsingPackedConstantList (expression.context, *type, false))
+                    return parseSuffixes (*packedList);
+
         if (matchIf (Operator::openParen))
         {
             auto& args = parseCommaSeparatedListOfExpressions (false, false);
@@ -1776,7 +1912,11 @@ private:
                 if (isExternal)
                     throwError (Errors::externalNeedsInitialiser());
 
-                initialValue = parseSuffixes (parseExpression());
+                if (auto type = getTypeIfKnownWhileParsing (declaredType))
+                    initialValue = tryParsingPackedConstantList (getContext(), *type, true);
+
+                if (initialValue == nullptr)
+                    initialValue = parseSuffixes (parseExpression());
             }
             else
             {
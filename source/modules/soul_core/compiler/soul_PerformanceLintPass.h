@@ -0,0 +1,567 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul
+{
+
+//==============================================================================
+/**
+    Looks for code which is legal but likely to be slow, and emits performance warnings
+    about it.
+
+    This runs on the resolved AST, because that still has the loops and source locations
+    which the warnings need to refer to. Code from the built-in library isn't checked
+    itself, but a call from user code into a slow library function is reported at the
+    call site.
+*/
+struct PerformanceLintPass  final
+{
+    static void run (ArrayView<pool_ref<AST::ModuleBase>> modules)
+    {
+        for (auto& m : modules)
+            if (auto p = cast<AST::Processor> (m))
+                if (! isInternalCode (p->context))
+                    Checker (*p).visitObject (*p);
+    }
+
+    /** Nested loops are reported if they perform at least this many iterations in total. */
+    static constexpr int64_t maxNestedLoopIterations = 16384;
+
+    /** Struct or array copies in event handlers are reported if they're at least this many bytes. */
+    static constexpr size_t maxEventHandlerCopySize = 1024;
+
+private:
+    static bool isInternalCode (const AST::Context& context)
+    {
+        auto& source = context.location.sourceCode;
+        return source != nullptr && source->isInternal;
+    }
+
+    static std::optional<int64_t> getConstantInt (AST::Expression& e)
+    {
+        if (auto c = e.getAsConstant())
+            if (c->value.getType().isInteger())
+                return c->value.getAsInt64();
+
+        return {};
+    }
+
+    static pool_ptr<AST::VariableDeclaration> getTargetVariable (AST::Expression& e)
+    {
+        if (auto v = cast<AST::VariableRef> (e))            return v->variable;
+        if (auto a = cast<AST::ArrayElementRef> (e))        return getTargetVariable (*a->object);
+        if (auto s = cast<AST::StructMemberRef> (e))        return getTargetVariable (s->object);
+
+        return {};
+    }
+
+    /** Returns the number of times a loop will run, if it can easily be worked out. */
+    static std::optional<int64_t> getNumIterations (AST::LoopStatement& loop)
+    {
+        if (loop.numIterations != nullptr)
+            return getConstantInt (*loop.numIterations);
+
+        // Looks for the "for (int i = start; i < end; ++i)" pattern
+        if (loop.iterator == nullptr || loop.condition == nullptr)
+            return {};
+
+        auto op = cast<AST::BinaryOperator> (loop.condition);
+
+        if (op == nullptr || (op->operation != BinaryOp::Op::lessThan && op->operation != BinaryOp::Op::lessThanOrEqual))
+            return {};
+
+        auto counter = cast<AST::VariableRef> (op->lhs);
+        auto increment = cast<AST::PreOrPostIncOrDec> (loop.iterator);
+        auto end = getConstantInt (op->rhs);
+
+        if (counter == nullptr || increment == nullptr || ! increment->isIncrement || ! end
+             || getTargetVariable (increment->target).get() != counter->variable.getPointer())
+            return {};
+
+        int64_t start = 0;
+
+        if (auto init = counter->variable->initialValue)
+            if (auto value = getConstantInt (*init))
+                start = *value;
+
+        auto num = *end - start + (op->operation == BinaryOp::Op::lessThanOrEqual ? 1 : 0);
+
+        if (num <= 0)
+            return {};
+
+        return num;
+    }
+
+    //==============================================================================
+    /** Finds the largest number of iterations done by nested counted loops in some code,
+        including the code in any functions that it calls.
+    */
+    struct NestedLoopCost
+    {
+        int64_t numIterations = 1;
+        int depth = 0;
+
+        bool isBiggerThan (const NestedLoopCost& other) const
+        {
+            return numIterations > other.numIterations || (numIterations == other.numIterations && depth > other.depth);
+        }
+
+        NestedLoopCost nestedInside (const NestedLoopCost& outer) const
+        {
+            constexpr int64_t maxCount = (int64_t) 1 << 40;
+            return { std::min (maxCount, numIterations * outer.numIterations), depth + outer.depth };
+        }
+    };
+
+    struct NestedLoopCostFinder  : public ASTVisitor
+    {
+        using super = ASTVisitor;
+
+        std::unordered_map<const AST::Function*, NestedLoopCost>& cache;
+        NestedLoopCost current, largest;
+
+        NestedLoopCostFinder (std::unordered_map<const AST::Function*, NestedLoopCost>& c) : cache (c) {}
+
+        static NestedLoopCost getCost (AST::Function& f, std::unordered_map<const AST::Function*, NestedLoopCost>& cache)
+        {
+            auto found = cache.find (std::addressof (f));
+
+            if (found != cache.end())
+                return found->second;
+
+            // A placeholder stops recursive functions from looping forever
+            cache[std::addressof (f)] = {};
+
+            NestedLoopCostFinder finder (cache);
+
+            if (f.block != nullptr)
+                finder.visitObject (*f.block);
+
+            cache[std::addressof (f)] = finder.largest;
+            return finder.largest;
+        }
+
+        void visit (AST::LoopStatement& l) override
+        {
+            auto outer = current;
+
+            if (auto num = getNumIterations (l))
+                current = NestedLoopCost { *num, 1 }.nestedInside (outer);
+
+            record (current);
+            super::visit (l);
+            current = outer;
+        }
+
+        void visit (AST::FunctionCall& c) override
+        {
+            super::visit (c);
+
+            if (! c.targetFunction.isIntrinsic())
+                record (getCost (c.targetFunction, cache).nestedInside (current));
+        }
+
+        void record (const NestedLoopCost& cost)
+        {
+            if (cost.isBiggerThan (largest))
+                largest = cost;
+        }
+    };
+
+    //==============================================================================
+    /** Finds all the variables which might be changed by some code, including state
+        variables which are changed by any functions that it calls.
+    */
+    struct ModifiedVariableFinder  : public ASTVisitor
+    {
+        using super = ASTVisitor;
+
+        std::unordered_set<const AST::VariableDeclaration*> modified;
+        std::unordered_set<const AST::Function*> functionsVisited;
+
+        void visit (AST::VariableDeclaration& v) override
+        {
+            modified.insert (std::addressof (v));
+            super::visit (v);
+        }
+
+        void visit (AST::Assignment& a) override
+        {
+            markModified (a.target);
+            super::visit (a);
+        }
+
+        void visit (AST::PreOrPostIncOrDec& p) override
+        {
+            markModified (p.target);
+            super::visit (p);
+        }
+
+        void visit (AST::FunctionCall& c) override
+        {
+            super::visit (c);
+            auto& f = c.targetFunction;
+
+            if (c.arguments != nullptr)
+            {
+                for (size_t i = 0; i < c.arguments->items.size() && i < f.parameters.size(); ++i)
+                {
+                    auto paramType = f.parameters[i]->getType();
+
+                    if (paramType.isReference() && ! paramType.isConst())
+                        markModified (c.arguments->items[i]);
+                }
+            }
+
+            if (f.block != nullptr && functionsVisited.insert (std::addressof (f)).second)
+                visitObject (*f.block);
+        }
+
+        void markModified (AST::Expression& target)
+        {
+            if (auto v = getTargetVariable (target))
+                modified.insert (v.get());
+        }
+    };
+
+    //==============================================================================
+    struct Checker  : public ASTVisitor
+    {
+        using super = ASTVisitor;
+
+        Checker (AST::Processor& p)
+        {
+            // Only the code which runs while audio is being rendered is checked, so that
+            // things like building a table in init() aren't reported
+            for (auto& f : p.functions)
+                if (f->isRunFunction() || f->isEventFunction())
+                    addRenderingFunction (f);
+        }
+
+        void visit (AST::Function& f) override
+        {
+            if (f.isGeneric() || f.block == nullptr || renderingFunctions.find (std::addressof (f)) == renderingFunctions.end())
+                return;
+
+            currentFunction = f;
+            loops.clear();
+            numEnclosingConditionals = 0;
+            super::visit (f);
+            currentFunction = {};
+        }
+
+        void visit (AST::LoopStatement& l) override
+        {
+            LoopInfo info { l, getNumIterations (l), containsAdvance (l), numEnclosingConditionals, {} };
+
+            if (info.isSampleLoop)
+            {
+                ModifiedVariableFinder finder;
+                finder.visitObject (l);
+                info.modifiedVariables = std::move (finder.modified);
+            }
+            else
+            {
+                checkNestedLoopCost (l, info.numIterations ? NestedLoopCost { *info.numIterations, 1 } : NestedLoopCost());
+            }
+
+            loops.push_back (std::move (info));
+            super::visit (l);
+            loops.pop_back();
+        }
+
+        void visit (AST::IfStatement& i) override
+        {
+            ++numEnclosingConditionals;
+            super::visit (i);
+            --numEnclosingConditionals;
+        }
+
+        void visit (AST::TernaryOp& t) override
+        {
+            ++numEnclosingConditionals;
+            super::visit (t);
+            --numEnclosingConditionals;
+        }
+
+        void visit (AST::FunctionCall& c) override
+        {
+            super::visit (c);
+            auto& f = c.targetFunction;
+
+            if (f.isIntrinsic())
+            {
+                if (isExpensiveIntrinsic (f.intrinsic))
+                    checkForLoopInvariantCall (c);
+            }
+            else
+            {
+                checkNestedLoopCost (c, NestedLoopCostFinder::getCost (f, loopCosts));
+            }
+
+            if (isInEventFunction() && c.arguments != nullptr)
+                for (size_t i = 0; i < c.arguments->items.size() && i < f.parameters.size(); ++i)
+                    if (! f.parameters[i]->getType().isReference())
+                        checkCopySize (c.arguments->items[i], f.parameters[i]->getType());
+        }
+
+        void visit (AST::VariableDeclaration& v) override
+        {
+            super::visit (v);
+
+            if (isInEventFunction() && v.initialValue != nullptr && getTargetVariable (*v.initialValue) != nullptr)
+                checkCopySize (*v.initialValue, v.getType());
+        }
+
+        void visit (AST::ArrayElementRef& a) override
+        {
+            super::visit (a);
+
+            if (a.isSlice || a.startIndex == nullptr || ! isInCountedLoop())
+                return;
+
+            auto& index = *a.startIndex;
+
+            if (getConstantInt (index))
+                return;
+
+            // An index which has been cast to a wrap<> type, or one passed to at(), gets wrapped
+            // with a modulo if the size isn't a power of 2
+            if (auto typeCast = cast<AST::TypeCast> (index))
+            {
+                if (typeCast->targetType.isWrapped() && is_type<AST::BinaryOperator> (typeCast->source))
+                    checkWrapSize (index, (int64_t) typeCast->targetType.getBoundedIntLimit());
+            }
+            else if (a.suppressWrapWarning && is_type<AST::BinaryOperator> (index))
+            {
+                auto arrayType = a.object->getResultType();
+
+                if (arrayType.isFixedSizeArray() || arrayType.isVector())
+                    checkWrapSize (index, (int64_t) arrayType.getArrayOrVectorSize());
+            }
+        }
+
+        void visit (AST::WriteToEndpoint& w) override
+        {
+            super::visit (w);
+
+            if (auto output = cast<AST::OutputEndpointRef> (w.target))
+                if (ASTUtilities::isConsoleEndpoint (output->output))
+                    if (currentFunction != nullptr && currentFunction->isRunFunction())
+                        if (auto sampleLoop = getInnermostSampleLoop())
+                            if (numEnclosingConditionals == sampleLoop->numEnclosingConditionals)
+                                emitWarning (w.context, Warnings::consoleWriteOnEverySample());
+        }
+
+    private:
+        struct LoopInfo
+        {
+            AST::LoopStatement& loop;
+            std::optional<int64_t> numIterations;
+            bool isSampleLoop = false;
+            int numEnclosingConditionals = 0;
+            std::unordered_set<const AST::VariableDeclaration*> modifiedVariables;
+        };
+
+        pool_ptr<AST::Function> currentFunction;
+        std::vector<LoopInfo> loops;
+        int numEnclosingConditionals = 0;
+        std::unordered_set<const AST::Function*> renderingFunctions;
+        std::unordered_map<const AST::Function*, NestedLoopCost> loopCosts;
+        std::unordered_set<const char*> locationsReported;
+
+        void addRenderingFunction (AST::Function& f)
+        {
+            struct CallFinder  : public ASTVisitor
+            {
+                Checker& owner;
+                CallFinder (Checker& c) : owner (c) {}
+                void visit (AST::FunctionCall& c) override   { ASTVisitor::visit (c); owner.addRenderingFunction (c.targetFunction); }
+            };
+
+            if (f.isIntrinsic() || f.block == nullptr || ! renderingFunctions.insert (std::addressof (f)).second)
+                return;
+
+            CallFinder finder (*this);
+            finder.visitObject (*f.block);
+        }
+
+        /** Some expressions, such as the target of a += operator, appear more than once in
+            the AST, so this makes sure each place in the code is only reported once.
+        */
+        void emitWarning (const AST::Context& context, CompileMessage message)
+        {
+            if (locationsReported.insert (context.location.location.getAddress()).second)
+                context.location.emitMessage (std::move (message));
+        }
+
+        bool isInEventFunction() const
+        {
+            return currentFunction != nullptr && currentFunction->isEventFunction();
+        }
+
+        bool isInCountedLoop() const
+        {
+            return ! loops.empty() && ! loops.back().isSampleLoop && loops.back().numIterations.has_value();
+        }
+
+        const LoopInfo* getInnermostSampleLoop() const
+        {
+            for (auto l = loops.rbegin(); l != loops.rend(); ++l)
+                if (l->isSampleLoop)
+                    return std::addressof (*l);
+
+            return nullptr;
+        }
+
+        static bool containsAdvance (AST::LoopStatement& l)
+        {
+            struct AdvanceFinder  : public ASTVisitor
+            {
+                bool found = false;
+                void visit (AST::AdvanceClock&) override   { found = true; }
+            };
+
+            AdvanceFinder finder;
+            finder.visitObject (l);
+            return finder.found;
+        }
+
+        /** Multiplies the cost of some code by the counted loops that it's inside, and
+            if that's too much, reports it once, at the outermost of those loops.
+        */
+        template <typename ObjectType>
+        void checkNestedLoopCost (ObjectType& object, NestedLoopCost cost)
+        {
+            const LoopInfo* outermost = nullptr;
+
+            for (auto l = loops.rbegin(); l != loops.rend(); ++l)
+            {
+                if (l->isSampleLoop || ! l->numIterations)
+                    break;
+
+                cost = cost.nestedInside ({ *l->numIterations, 1 });
+                outermost = std::addressof (*l);
+            }
+
+            if (cost.depth < 2 || cost.numIterations < maxNestedLoopIterations)
+                return;
+
+            if (outermost != nullptr)
+            {
+                emitWarning (outermost->loop.context, Warnings::nestedLoopsHaveTooManyIterations (std::to_string (cost.numIterations)));
+            }
+            else if constexpr (std::is_same<ObjectType, AST::FunctionCall>::value)
+            {
+                auto& f = object.targetFunction;
+                auto& name = f.originalGenericFunction != nullptr ? f.originalGenericFunction->name : f.name;
+                emitWarning (object.context, Warnings::callHasNestedLoopsWithTooManyIterations (name, std::to_string (cost.numIterations)));
+            }
+        }
+
+        static bool isExpensiveIntrinsic (IntrinsicType type)
+        {
+            switch (type)
+            {
+                case IntrinsicType::sqrt:   case IntrinsicType::pow:    case IntrinsicType::exp:
+                case IntrinsicType::log:    case IntrinsicType::log10:  case IntrinsicType::sin:
+                case IntrinsicType::cos:    case IntrinsicType::tan:    case IntrinsicType::sinh:
+                case IntrinsicType::cosh:   case IntrinsicType::tanh:   case IntrinsicType::asinh:
+                case IntrinsicType::acosh:  case IntrinsicType::atanh:  case IntrinsicType::asin:
+                case IntrinsicType::acos:   case IntrinsicType::atan:   case IntrinsicType::atan2:
+                    return true;
+
+                default:
+                    return false;
+            }
+        }
+
+        void checkForLoopInvariantCall (AST::FunctionCall& c)
+        {
+            if (currentFunction == nullptr || ! currentFunction->isRunFunction() || c.arguments == nullptr)
+                return;
+
+            auto sampleLoop = getInnermostSampleLoop();
+
+            if (sampleLoop == nullptr)
+                return;
+
+            for (auto& arg : c.arguments->items)
+                if (! isLoopInvariant (arg, *sampleLoop))
+                    return;
+
+            emitWarning (c.context, Warnings::loopInvariantIntrinsicCall (std::string (getIntrinsicName (c.targetFunction.intrinsic))));
+        }
+
+        /** Returns true if an expression only depends on constants and variables which aren't
+            changed inside the loop.
+        */
+        bool isLoopInvariant (AST::Expression& e, const LoopInfo& loop) const
+        {
+            if (e.getAsConstant() != nullptr)               return true;
+            if (is_type<AST::ProcessorProperty> (e))        return true;
+
+            if (auto v = cast<AST::VariableRef> (e))
+                return loop.modifiedVariables.find (v->variable.getPointer()) == loop.modifiedVariables.end();
+
+            if (auto b = cast<AST::BinaryOperator> (e))     return isLoopInvariant (b->lhs, loop) && isLoopInvariant (b->rhs, loop);
+            if (auto u = cast<AST::UnaryOperator> (e))      return isLoopInvariant (u->source, loop);
+            if (auto t = cast<AST::TypeCast> (e))           return isLoopInvariant (t->source, loop);
+            if (auto s = cast<AST::StructMemberRef> (e))    return isLoopInvariant (s->object, loop);
+
+            if (auto a = cast<AST::ArrayElementRef> (e))
+                return ! a->isSlice && a->startIndex != nullptr
+                        && isLoopInvariant (*a->object, loop) && isLoopInvariant (*a->startIndex, loop);
+
+            if (auto t = cast<AST::TernaryOp> (e))
+                return isLoopInvariant (t->condition, loop) && isLoopInvariant (t->trueBranch, loop) && isLoopInvariant (t->falseBranch, loop);
+
+            if (auto list = cast<AST::CommaSeparatedList> (e))
+            {
+                for (auto& item : list->items)
+                    if (! isLoopInvariant (item, loop))
+                        return false;
+
+                return true;
+            }
+
+            return false;
+        }
+
+        void checkCopySize (AST::Expression& source, const Type& type)
+        {
+            if (! (type.isStruct() || type.isFixedSizeArray()))
+                return;
+
+            auto size = type.getPackedSizeInBytes();
+
+            if (size >= maxEventHandlerCopySize)
+                emitWarning (source.context, Warnings::largeCopyInEventHandler (getReadableDescriptionOfByteSize (size)));
+        }
+
+        void checkWrapSize (AST::Expression& index, int64_t size)
+        {
+            if (size > 0 && ! choc::math::isPowerOf2 (size))
+                emitWarning (index.context, Warnings::wrappedIndexPreventsVectorisation (std::to_string (size)));
+        }
+    };
+};
+
+} // namespace soul
@@ -30,7 +30,9 @@ struct ResolutionPass  final
 {
     static void run (AST::Allocator& a, AST::ModuleBase& m, bool ignoreTypeAndConstantErrors)
     {
-        ResolutionPass (a, m).run (ignoreTypeAndConstantErrors);
+        BuildReport::Phase phase (ignoreTypeAndConstantErrors ? "resolution pass (ignoring errors)" : "resolution pass",
+                                  std::addressof (a.pool));
+        ResolutionPass (a, m).run (ignoreTypeAndConstantErrors, true);
     }
 
 private:
@@ -60,7 +62,7 @@ private:
         }
     };
 
-    RunStats run (bool ignoreTypeAndConstantErrors)
+    RunStats run (bool ignoreTypeAndConstantErrors, bool isOutermostModule = false)
     {
         RunStats runStats;
 
@@ -69,6 +71,7 @@ private:
 
         for (;;)
         {
+            BuildReport::Phase phase (isOutermostModule ? "iteration" : nullptr, std::addressof (allocator.pool));
             runStats.clear();
 
             tryPass<QualifiedIdentifierResolver> (runStats, true);
@@ -1769,12 +1772,23 @@ private:
                                                                 Identifier specialisedFunctionName, ArrayView<Type> callerArgumentTypes,
                                                                 bool shouldIgnoreErrors)
         {
+            auto& cache = genericFunction.specialisationCache;
+            auto cached = cache.find (specialisedFunctionName);
+
+            if (cached != cache.end())
+                return cached->second;
+
             auto parentScope = genericFunction.getParentScope();
             SOUL_ASSERT (parentScope != nullptr);
 
             for (auto& f : parentScope->getFunctions())
+            {
                 if (f->name == specialisedFunctionName && f->originalGenericFunction == genericFunction)
+                {
+                    cache.emplace (specialisedFunctionName, f);
                     return f;
+                }
+            }
 
             auto& newFunction = StructuralParser::cloneFunction (allocator, genericFunction);
             newFunction.name = specialisedFunctionName;
@@ -1790,6 +1804,7 @@ private:
                 return {};
             }
 
+            cache.emplace (specialisedFunctionName, newFunction);
             return newFunction;
         }
 
@@ -33,18 +33,41 @@ struct SanityCheckPass  final
         checkOverallStructure (module);
     }
 
-    /** After the AST is resolved, this pass checks for more subtle errors */
+    /** After the AST is resolved, this pass checks for more subtle errors.
+        All of the checks are made in a single traversal of the module and its sub-modules.
+    */
     static void runPostResolution (AST::ModuleBase& module)
     {
-        runEventFunctionChecker (module);
-        runDuplicateNameChecker (module);
-        PostResolutionChecks().visitObject (module);
-        PreAndPostIncOperatorCheck().ASTVisitor::visitObject (module);
+        PostResolutionChecks (true).visitObject (module);
     }
 
-    static void runEventFunctionChecker (AST::ModuleBase& module)
+    /** Runs the post-resolution checks on a list of modules which includes all the sub-modules
+        of any namespaces in it (e.g. as created by ASTUtilities::findAllModulesToCompile()),
+        so each module is only traversed once. If numThreads is more than 1, the modules are
+        shared out between that many threads.
+    */
+    static void runPostResolution (ArrayView<pool_ref<AST::ModuleBase>> modules, uint32_t numThreads)
     {
-        EventFunctionChecker().visitObject (module);
+        if (numThreads <= 1 || modules.size() <= 1)
+        {
+            for (auto& m : modules)
+                PostResolutionChecks (false).visitObject (m);
+
+            return;
+        }
+
+        // The checks only read the AST, apart from the Structure objects which struct
+        // declarations create on demand, and which can be shared between modules.
+        for (auto& m : modules)
+            if (auto structs = m->getStructList())
+                for (auto& s : *structs)
+                    if (s->isResolved())
+                        s->getStruct();
+
+        runCompileTasksInParallel (modules.size(), numThreads, [&] (size_t i)
+        {
+            PostResolutionChecks (false).visitObject (modules[i]);
+        });
     }
 
     static void runDuplicateNameChecker (AST::ModuleBase& module)
@@ -294,161 +317,190 @@ private:
     }
 
     //==============================================================================
-    struct EventFunctionChecker : public ASTVisitor
+    static void checkEventFunctions (AST::Processor& p)
     {
-        using super = ASTVisitor;
-
-        void visit (AST::Processor& p) override
+        for (auto& f : p.functions)
         {
-            super::visit (p);
-
-            soul::DuplicateNameChecker duplicateNameChecker;
-
-            for (auto& e : p.getEndpoints())   duplicateNameChecker.check (e->name, e->context);
-            for (auto& v : p.stateVariables)   duplicateNameChecker.check (v->name, v->context);
-            for (auto& s : p.structures)       duplicateNameChecker.check (s->name, s->context);
-            for (auto& u : p.usings)           duplicateNameChecker.check (u->name, u->context);
-
-            // (functions must be scanned last)
-            for (auto& f : p.functions)
+            if (f->isEventFunction())
             {
-                if (f->isEventFunction())
-                {
-                    bool nameFound = false;
+                bool nameFound = false;
 
-                    for (auto& e : p.getEndpoints())
+                for (auto& e : p.getEndpoints())
+                {
+                    if (e->isInput && e->name == f->name)
                     {
-                        if (e->isInput && e->name == f->name)
+                        nameFound = true;
+                        SOUL_ASSERT (e->details != nullptr);
+
+                        if (e->details->arraySize == nullptr && f->parameters.size() == 1)
                         {
-                            nameFound = true;
-                            SOUL_ASSERT (e->details != nullptr);
-
-                            if (e->details->arraySize == nullptr && f->parameters.size() == 1)
-                            {
-                                auto eventType = f->parameters.front()->getType().removeConstIfPresent().removeReferenceIfPresent();
-                                auto types = e->details->getResolvedDataTypes();
-
-                                if (! eventType.isPresentIn (types))
-                                    f->context.throwError (Errors::eventFunctionInvalidType (f->name, eventType.getDescription()));
-                            }
-                            else if (e->details->arraySize != nullptr && f->parameters.size() == 2)
-                            {
-                                auto indexType = f->parameters.front()->getType().removeConstIfPresent().removeReferenceIfPresent();
-                                auto eventType = f->parameters.back()->getType().removeConstIfPresent().removeReferenceIfPresent();
-                                auto types = e->details->getResolvedDataTypes();
-
-                                if (! indexType.isInteger())
-                                    f->context.throwError (Errors::eventFunctionIndexInvalid());
-
-                               if (! eventType.isPresentIn (types))
-                                   f->context.throwError (Errors::eventFunctionInvalidType (f->name, eventType.getDescription()));
-                            }
-                            else
-                            {
-                                f->context.throwError (Errors::eventFunctionInvalidArguments());
-                            }
+                            auto eventType = f->parameters.front()->getType().removeConstIfPresent().removeReferenceIfPresent();
+                            auto types = e->details->getResolvedDataTypes();
+
+                            if (! eventType.isPresentIn (types))
+                                f->context.throwError (Errors::eventFunctionInvalidType (f->name, eventType.getDescription()));
                         }
-                   }
+                        else if (e->details->arraySize != nullptr && f->parameters.size() == 2)
+                        {
+                            auto indexType = f->parameters.front()->getType().removeConstIfPresent().removeReferenceIfPresent();
+                            auto eventType = f->parameters.back()->getType().removeConstIfPresent().removeReferenceIfPresent();
+                            auto types = e->details->getResolvedDataTypes();
+
+                            if (! indexType.isInteger())
+                                f->context.throwError (Errors::eventFunctionIndexInvalid());
 
-                    if (! nameFound)
-                        f->context.throwError (Errors::noSuchInputEvent (f->name));
+                            if (! eventType.isPresentIn (types))
+                                f->context.throwError (Errors::eventFunctionInvalidType (f->name, eventType.getDescription()));
+                        }
+                        else
+                        {
+                            f->context.throwError (Errors::eventFunctionInvalidArguments());
+                        }
+                    }
                 }
+
+                if (! nameFound)
+                    f->context.throwError (Errors::noSuchInputEvent (f->name));
             }
         }
-    };
+    }
 
     //==============================================================================
-    struct DuplicateNameChecker  : public ASTVisitor
+    static void checkDuplicateNames (AST::Processor& p)
     {
-        using super = ASTVisitor;
+        soul::DuplicateNameChecker duplicateNameChecker;
 
-        void visit (AST::Processor& p) override
-        {
-            super::visit (p);
-            soul::DuplicateNameChecker duplicateNameChecker;
+        for (auto& e : p.endpoints)        duplicateNameChecker.check (e->name, e->context);
+        for (auto& v : p.stateVariables)   duplicateNameChecker.check (v->name, v->context);
+        for (auto& s : p.structures)       duplicateNameChecker.check (s->name, s->context);
+        for (auto& u : p.usings)           duplicateNameChecker.check (u->name, u->context);
 
-            for (auto& e : p.endpoints)        duplicateNameChecker.check (e->name, e->context);
-            for (auto& v : p.stateVariables)   duplicateNameChecker.check (v->name, v->context);
-            for (auto& s : p.structures)       duplicateNameChecker.check (s->name, s->context);
-            for (auto& u : p.usings)           duplicateNameChecker.check (u->name, u->context);
+        // (functions must be scanned last)
+        for (auto& f : p.functions)
+            if (! f->isEventFunction())
+                duplicateNameChecker.checkWithoutAdding (f->name, f->nameLocation);
 
-            // (functions must be scanned last)
-            for (auto& f : p.functions)
-                if (! f->isEventFunction())
-                    duplicateNameChecker.checkWithoutAdding (f->name, f->nameLocation);
+        for (auto& m : p.getSubModules())
+            duplicateNameChecker.check (m->name, m->context);
+    }
 
-            for (auto& m : p.getSubModules())
-                duplicateNameChecker.check (m->name, m->context);
-        }
+    static void checkDuplicateNames (AST::Annotation& a)
+    {
+        soul::DuplicateNameChecker duplicateNameChecker;
 
-        void visit (AST::Annotation& a) override
-        {
-            super::visit (a);
-            soul::DuplicateNameChecker duplicateNameChecker;
+        for (auto& p : a.properties)
+            duplicateNameChecker.check (p.name->path.toString(), p.name->context);
+    }
 
-            for (auto& p : a.properties)
-                duplicateNameChecker.check (p.name->path.toString(), p.name->context);
-        }
+    static void checkDuplicateNames (AST::Graph& g)
+    {
+        soul::DuplicateNameChecker duplicateNameChecker;
 
-        void visit (AST::Graph& g) override
-        {
-            soul::DuplicateNameChecker duplicateNameChecker;
+        for (auto& e : g.getEndpoints())
+            duplicateNameChecker.check (e->name, e->context);
+    }
 
-            for (auto& e : g.getEndpoints())
-                duplicateNameChecker.check (e->name, e->context);
-        }
+    static void checkDuplicateNames (AST::Namespace& n)
+    {
+        soul::DuplicateNameChecker duplicateNameChecker;
 
-        void visit (AST::Namespace& n) override
-        {
-            soul::DuplicateNameChecker duplicateNameChecker;
+        for (auto& s : n.structures)    duplicateNameChecker.check (s->name, s->context);
+        for (auto& u : n.usings)        duplicateNameChecker.check (u->name, u->context);
+        for (auto& m : n.subModules)    duplicateNameChecker.check (m->name, m->context);
+        for (auto& c : n.constants)     duplicateNameChecker.check (c->name, c->context);
 
-            for (auto& s : n.structures)    duplicateNameChecker.check (s->name, s->context);
-            for (auto& u : n.usings)        duplicateNameChecker.check (u->name, u->context);
-            for (auto& m : n.subModules)    duplicateNameChecker.check (m->name, m->context);
-            for (auto& c : n.constants)     duplicateNameChecker.check (c->name, c->context);
+        // (functions must be scanned last)
+        for (auto& f : n.functions)     duplicateNameChecker.checkWithoutAdding (f->name, f->nameLocation);
+    }
 
-            // (functions must be scanned last)
-            for (auto& f : n.functions)     duplicateNameChecker.checkWithoutAdding (f->name, f->nameLocation);
-        }
+    static void checkDuplicateNames (AST::Block& b)
+    {
+        soul::DuplicateNameChecker duplicateNameChecker;
 
-        void visit (AST::Block& b) override
-        {
-            super::visit (b);
-            soul::DuplicateNameChecker duplicateNameChecker;
+        for (auto& s : b.statements)
+            if (auto v = cast<AST::VariableDeclaration> (s))
+                duplicateNameChecker.check (v->name, v->context);
+    }
 
-            for (auto& s : b.statements)
-                if (auto v = cast<AST::VariableDeclaration> (s))
-                    duplicateNameChecker.check (v->name, v->context);
-        }
+    static void checkDuplicateNames (AST::Function& f)
+    {
+        soul::DuplicateNameChecker duplicateNameChecker;
 
-        void visit (AST::Function& f) override
-        {
-            super::visit (f);
-            soul::DuplicateNameChecker duplicateNameChecker;
+        for (auto& param : f.parameters)
+            duplicateNameChecker.check (param->name, param->context);
+    }
 
-            for (auto& param : f.parameters)
-                duplicateNameChecker.check (param->name, param->context);
-        }
+    static void checkDuplicateNames (AST::StructDeclaration& s)
+    {
+        soul::DuplicateNameChecker duplicateNameChecker;
 
-        void visit (AST::StructDeclaration& s) override
-        {
-            super::visit (s);
-            soul::DuplicateNameChecker duplicateNameChecker;
+        for (auto& m : s.getMembers())
+            duplicateNameChecker.check (m.name, s.context);
+    }
 
-            for (auto& m : s.getMembers())
-                duplicateNameChecker.check (m.name, s.context);
-        }
+    //==============================================================================
+    struct DuplicateNameChecker  : public ASTVisitor
+    {
+        using super = ASTVisitor;
+
+        void visit (AST::Processor& p) override          { super::visit (p); checkDuplicateNames (p); }
+        void visit (AST::Annotation& a) override         { super::visit (a); checkDuplicateNames (a); }
+        void visit (AST::Graph& g) override              { checkDuplicateNames (g); }
+        void visit (AST::Namespace& n) override          { checkDuplicateNames (n); }
+        void visit (AST::Block& b) override              { super::visit (b); checkDuplicateNames (b); }
+        void visit (AST::Function& f) override           { super::visit (f); checkDuplicateNames (f); }
+        void visit (AST::StructDeclaration& s) override  { super::visit (s); checkDuplicateNames (s); }
     };
 
     //==============================================================================
+    /** Makes all the post-resolution checks in a single traversal of the AST. */
     struct PostResolutionChecks  : public ASTVisitor
     {
+        PostResolutionChecks (bool shouldCheckSubModules) : checkSubModules (shouldCheckSubModules) {}
+
         using super = ASTVisitor;
+        using super::visitObject;
+        using VariableList = ArrayWithPreallocation<pool_ref<AST::VariableDeclaration>, 16>;
+
+        const bool checkSubModules;
+        pool_ptr<AST::ModuleBase> currentModule;
+        bool isInsideGenericFunction = false;
+        VariableList* variablesModified = nullptr;
+        VariableList* variablesReferenced = nullptr;
+
+        void visitObject (AST::ModuleBase& m) override
+        {
+            if (currentModule != nullptr && ! checkSubModules)
+                return;
+
+            auto oldModule = currentModule;
+            currentModule = m;
+            super::visitObject (m);
+            currentModule = oldModule;
+        }
+
+        // The names declared inside graphs and namespaces are only checked at the top level
+        bool shouldCheckNestedNames() const      { return currentModule != nullptr && currentModule->isProcessor(); }
+
+        void visitObject (AST::Statement& s) override
+        {
+            VariableList modified, referenced;
+            auto oldMod = variablesModified;
+            auto oldRef = variablesReferenced;
+            variablesModified = std::addressof (modified);
+            variablesReferenced = std::addressof (referenced);
+            super::visitObject (s);
+            variablesModified = oldMod;
+            variablesReferenced = oldRef;
+        }
 
         void visit (AST::VariableDeclaration& v) override
         {
             super::visit (v);
 
+            if (isInsideGenericFunction)
+                return;
+
             if (v.declaredType == nullptr)
                 throwErrorIfNotReadableValue (*v.initialValue);
             else
@@ -470,6 +522,8 @@ private:
         void visit (AST::Processor& p) override
         {
             super::visit (p);
+            checkDuplicateNames (p);
+            checkEventFunctions (p);
             checkForDuplicateFunctions (p.functions);
 
             for (auto input : p.endpoints)
@@ -484,6 +538,7 @@ private:
         void visit (AST::Graph& g) override
         {
             super::visit (g);
+            checkDuplicateNames (g);
 
             for (auto input : g.endpoints)
                 if (input->details != nullptr)
@@ -496,6 +551,7 @@ private:
         void visit (AST::Namespace& n) override
         {
             super::visit (n);
+            checkDuplicateNames (n);
             checkForDuplicateFunctions (n.functions);
 
             for (auto& v : n.constants)
@@ -505,7 +561,15 @@ private:
 
         void visit (AST::Function& f) override
         {
-            if (! f.isGeneric())
+            if (f.isGeneric())
+            {
+                // A generic function's body isn't resolved, so only the checks that
+                // don't depend on types can be made on it
+                isInsideGenericFunction = true;
+                super::visit (f);
+                isInsideGenericFunction = false;
+            }
+            else
             {
                 for (auto& p : f.parameters)
                     if (p->getType().isVoid())
@@ -513,6 +577,25 @@ private:
 
                 super::visit (f);
             }
+
+            if (shouldCheckNestedNames())
+                checkDuplicateNames (f);
+        }
+
+        void visit (AST::Block& b) override
+        {
+            super::visit (b);
+
+            if (shouldCheckNestedNames())
+                checkDuplicateNames (b);
+        }
+
+        void visit (AST::Annotation& a) override
+        {
+            super::visit (a);
+
+            if (shouldCheckNestedNames())
+                checkDuplicateNames (a);
         }
 
         void visit (AST::StructDeclaration& s) override
@@ -521,6 +604,9 @@ private:
             super::visit (s);
             recursiveTypeDeclVisitStack.pop();
 
+            if (shouldCheckNestedNames())
+                checkDuplicateNames (s);
+
             for (auto& m : s.getMembers())
                 if (m.type->getConstness() == AST::Constness::definitelyConst)
                     m.type->context.throwError (Errors::memberCannotBeConst());
@@ -566,7 +652,7 @@ private:
         {
             super::visit (u);
 
-            if (! UnaryOp::isTypeSuitable (u.operation, u.source->getResultType()))
+            if (! isInsideGenericFunction && ! UnaryOp::isTypeSuitable (u.operation, u.source->getResultType()))
                 u.source->context.throwError (Errors::wrongTypeForUnary());
         }
 
@@ -574,7 +660,7 @@ private:
         {
             super::visit (b);
 
-            if (BinaryOp::isComparisonOperator (b.operation))
+            if (! isInsideGenericFunction && BinaryOp::isComparisonOperator (b.operation))
             {
                 auto lhsConst = b.lhs->getAsConstant();
                 auto rhsConst = b.rhs->getAsConstant();
@@ -617,28 +703,6 @@ private:
                 }
             }
         }
-    };
-
-    //==============================================================================
-    struct PreAndPostIncOperatorCheck  : public ASTVisitor
-    {
-        using super = ASTVisitor;
-        using VariableList = ArrayWithPreallocation<pool_ref<AST::VariableDeclaration>, 16>;
-        VariableList* variablesModified = nullptr;
-        VariableList* variablesReferenced = nullptr;
-        bool isInsidePreIncOp = false;
-
-        void visitObject (AST::Statement& s) override
-        {
-            VariableList modified, referenced;
-            auto oldMod = variablesModified;
-            auto oldRef = variablesReferenced;
-            variablesModified = std::addressof (modified);
-            variablesReferenced = std::addressof (referenced);
-            super::visitObject (s);
-            variablesModified = oldMod;
-            variablesReferenced = oldRef;
-        }
 
         void visit (AST::VariableRef& v) override
         {
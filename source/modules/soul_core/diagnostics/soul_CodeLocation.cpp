@@ -26,21 +26,42 @@ namespace soul
 {
 
 //==============================================================================
-SourceCodeText::SourceCodeText (std::string file, std::string text, bool internal)
+SourceCodeText::SourceCodeText (std::string file, SharedBuffer text, bool internal)
    : filename (std::move (file)),
-     content (std::move (text)),
+     buffer (std::move (text)),
+     content (*buffer),
      utf8 (content.c_str()),
      isInternal (internal)
 {}
 
 SourceCodeText::Ptr SourceCodeText::createForFile (std::string file, std::string text)
 {
+    return createForFile (std::move (file), std::make_shared<const std::string> (std::move (text)));
+}
+
+SourceCodeText::Ptr SourceCodeText::createForFile (std::string file, SharedBuffer text)
+{
+    SOUL_ASSERT (text != nullptr);
     return Ptr (*new SourceCodeText (std::move (file), std::move (text), false));
 }
 
 SourceCodeText::Ptr SourceCodeText::createInternal (std::string name, std::string text)
 {
-    return Ptr (*new SourceCodeText (std::move (name), std::move (text), true));
+    return Ptr (*new SourceCodeText (std::move (name), std::make_shared<const std::string> (std::move (text)), true));
+}
+
+const std::vector<size_t>& SourceCodeText::getLineStartOffsets() const
+{
+    std::call_once (lineStartOffsetsFlag, [this]
+    {
+        lineStartOffsets.push_back (0);
+
+        for (size_t i = 0; i < content.size(); ++i)
+            if (content[i] == '\n')
+                lineStartOffsets.push_back (i + 1);
+    });
+
+    return lineStartOffsets;
 }
 
 //==============================================================================
@@ -56,8 +77,18 @@ CodeLocation CodeLocation::createFromString (std::string filename, std::string t
     return code;
 }
 
+CodeLocation CodeLocation::createFromSharedBuffer (std::string filename, SourceCodeText::SharedBuffer text)
+{
+    CodeLocation code (SourceCodeText::createForFile (std::move (filename), std::move (text)));
+    code.validateUTF8();
+    return code;
+}
+
 CodeLocation CodeLocation::createFromSourceFile (const BuildBundle::SourceFile& f)
 {
+    if (f.sharedContent != nullptr)
+        return createFromSharedBuffer (f.filename, f.sharedContent);
+
     return createFromString (f.filename, f.content);
 }
 
@@ -89,13 +120,22 @@ CodeLocation::LineAndColumn CodeLocation::getLineAndColumn() const
     if (sourceCode == nullptr)
         return { 0, 0 };
 
-    LineAndColumn lc = { 1, 1 };
+    auto start = sourceCode->utf8.getAddress();
+    auto address = location.getAddress();
 
-    for (auto i = sourceCode->utf8; i < location && ! i.isEmpty(); ++i)
-    {
+    if (address == nullptr || address <= start)
+        return { 1, 1 };
+
+    auto& lineStarts = sourceCode->getLineStartOffsets();
+    auto offset = static_cast<size_t> (address - start);
+    auto line = static_cast<size_t> (std::upper_bound (lineStarts.begin(), lineStarts.end(), offset) - lineStarts.begin());
+
+    LineAndColumn lc = { static_cast<uint32_t> (line), 1 };
+
+    // The column is counted in characters rather than bytes, so this still has to walk
+    // along the line
+    for (UTF8Reader i (start + lineStarts[line - 1]); i < location && ! i.isEmpty(); ++i)
         ++lc.column;
-        if (*i == '\n')  { lc.column = 1; lc.line++; }
-    }
 
     return lc;
 }
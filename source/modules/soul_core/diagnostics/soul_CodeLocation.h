@@ -22,22 +22,38 @@ namespace soul
 {
 
 //==============================================================================
-/** A ref-counted holder for a source code string. */
+/** A ref-counted holder for a source code string.
+    The text can be held in a buffer that's shared with its creator, so that the code
+    can be tokenised in place without taking a copy of it.
+*/
 struct SourceCodeText  final : public RefCountedObject
 {
     using Ptr = RefCountedPtr<SourceCodeText>;
+    using SharedBuffer = std::shared_ptr<const std::string>;
 
     static Ptr createForFile (std::string filename, std::string text);
+    static Ptr createForFile (std::string filename, SharedBuffer text);
     static Ptr createInternal (std::string name, std::string text);
 
-    const std::string filename, content;
+    const std::string filename;
+    const SharedBuffer buffer;
+    const std::string& content;
     const UTF8Reader utf8;
     const bool isInternal;
 
+    /** Returns the byte offset at which each line of the text starts. This is built the first
+        time it's needed, so that finding the line of a location is a binary search rather than
+        a scan of the whole text.
+    */
+    const std::vector<size_t>& getLineStartOffsets() const;
+
 private:
     SourceCodeText() = delete;
     SourceCodeText (const SourceCodeText&) = delete;
-    SourceCodeText (std::string, std::string, bool internal);
+    SourceCodeText (std::string, SharedBuffer, bool internal);
+
+    mutable std::vector<size_t> lineStartOffsets;
+    mutable std::once_flag lineStartOffsetsFlag;
 };
 
 
@@ -57,6 +73,7 @@ struct CodeLocation   final
         an error if it's dodgy.
     */
     static CodeLocation createFromString (std::string filename, std::string text);
+    static CodeLocation createFromSharedBuffer (std::string filename, SourceCodeText::SharedBuffer text);
     static CodeLocation createFromSourceFile (const BuildBundle::SourceFile&);
     void validateUTF8() const;
 
@@ -174,6 +174,7 @@ bool CompileMessageList::hasInternalCompilerErrors() const
 void CompileMessageList::clear()
 {
     messages.clear();
+    buildReport.clear();
 }
 
 std::string CompileMessageList::toString() const
@@ -242,6 +243,35 @@ void catchParseErrors (std::function<void()>&& functionToPerform)
     catch (ErrorWasIgnoredException) {}
 }
 
+//==============================================================================
+void runCompileTasksInParallel (size_t numTasks, uint32_t numThreads, const std::function<void(size_t)>& task)
+{
+    std::vector<CompileMessageList> taskMessages (numTasks);
+    std::vector<char> taskFailed (numTasks, 0);
+
+    runTasksInParallel (numTasks, numThreads, [&] (size_t index)
+    {
+        try
+        {
+            CompileMessageHandler handler (taskMessages[index]);
+            task (index);
+        }
+        catch (AbortCompilationException)
+        {
+            taskFailed[index] = 1;
+        }
+    });
+
+    for (size_t i = 0; i < numTasks; ++i)
+    {
+        for (auto& m : taskMessages[i].messages)
+            emitMessage (m);
+
+        if (taskFailed[i])
+            throw AbortCompilationException();
+    }
+}
+
 //==============================================================================
 void emitMessage (const CompileMessageGroup& messageGroup)
 {
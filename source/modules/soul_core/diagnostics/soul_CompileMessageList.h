@@ -100,6 +100,12 @@ struct CompileMessageList  final
 
     /** The raw list of messages. */
     std::vector<CompileMessage> messages;
+
+    /** If a build was asked to produce one, this contains a breakdown of where
+        its time and memory went.
+        To enable it, set a "buildReport" property to true in BuildSettings::customSettings.
+    */
+    BuildReport buildReport;
 };
 
 //==============================================================================
@@ -131,6 +137,17 @@ void catchParseErrors (std::function<void()>&& functionToPerform);
 /** Throwing one of these in any compile task will stop the current compilation. */
 struct AbortCompilationException {};
 
+//==============================================================================
+/** Runs a set of compile tasks across some worker threads (see runTasksInParallel()).
+
+    Each task gets its own message handler while it runs. When they've all finished, the
+    messages that were produced are passed on to the calling thread's handler in task order,
+    stopping after the first task which failed, and in that case an AbortCompilationException
+    is then thrown. This means that the messages and outcome are the same as if the tasks had
+    been run one after the other on the calling thread.
+*/
+void runCompileTasksInParallel (size_t numTasks, uint32_t numThreads, const std::function<void(size_t taskIndex)>& task);
+
 //==============================================================================
 /** Sends an error or warning message to the current message handler. */
 void emitMessage (CompileMessage);
@@ -73,6 +73,7 @@ namespace soul
     X(graphCannotHaveSpecialisations,       "Graphs cannot have type specialisations") \
     X(processorSpecialisationNotAllowed,    "Processor specialisations may only be used in graphs") \
     X(wrongAPIVersion,                      "Cannot parse code that was generated by a later version of the API") \
+    X(invalidBinaryProgram,                 "The binary program data is corrupt or was created by a different version") \
     X(semicolonAfterBrace,                  "A brace-enclosed declaration should not be followed by a semicolon") \
     X(nameInUse,                            "The name $Q0$ is already in use") \
     X(alreadyProcessorWithName,             "There is already a processor called $Q0$ visible in this scope") \
@@ -278,6 +279,7 @@ namespace soul
     X(unsupportedSampleRate,                "Unsupported sample rate") \
     X(unsupportedOptimisationLevel,         "Unsupported optimisation level") \
     X(unsupportedNumChannels,               "Unsupported number of channels") \
+    X(unsupportedNumberOfCompilerThreads,   "Unsupported number of compiler threads") \
 
 #define SOUL_ERRORS_RUNTIME(X) \
     X(customRuntimeError,                   "$0$") \
@@ -288,11 +290,18 @@ namespace soul
     X(cannotReadFile,                       "Failed to read from file $Q0$") \
     X(cannotLoadLibrary,                    "Cannot load library $Q0$") \
     X(processTookTooLong,                   "Processing took too long") \
+    X(buildCancelled,                       "The build was cancelled") \
 
 
 //==============================================================================
 #define SOUL_WARNINGS_PERFORMANCE(X) \
     X(indexHasRuntimeOverhead,              "Performance warning: the type of this array index could not be proven to be safe, so a runtime check was added") \
+    X(nestedLoopsHaveTooManyIterations,     "Performance warning: these nested loops perform $0$ iterations each time they run") \
+    X(callHasNestedLoopsWithTooManyIterations, "Performance warning: the call to $Q0$ performs $1$ iterations of nested loops each time it runs") \
+    X(loopInvariantIntrinsicCall,           "Performance warning: this call to $Q0$ is made on every sample, but its arguments don't change inside the loop, so it could be calculated less often") \
+    X(largeCopyInEventHandler,              "Performance warning: this copies $0$ of data in an event handler") \
+    X(wrappedIndexPreventsVectorisation,    "Performance warning: wrapping this index to $0$, which isn't a power of 2, needs a division on every iteration and prevents the loop being vectorised") \
+    X(consoleWriteOnEverySample,            "Performance warning: this writes to the console on every sample, which will slow down rendering") \
 
 #define SOUL_WARNINGS_SYNTAX(X) \
     X(localVariableShadow,                  "The variable $Q0$ shadows another local variable with the same name") \
@@ -25,31 +25,236 @@
 namespace soul
 {
 
+//==============================================================================
+struct Logger::LoggerHolder
+{
+    LoggerHolder()
+    {
+        messages.reset (queueSize);
+        realtimeMessages.reset (realtimeQueueSize);
+    }
+
+    ~LoggerHolder()
+    {
+        setCallback (nullptr);
+    }
+
+    void setCallback (LoggingFunction newCallback)
+    {
+        std::lock_guard<std::mutex> l (callbackLock);
+        enabled = false;
+        stopDispatcher();
+        callback = std::move (newCallback);
+
+        if (callback != nullptr)
+        {
+            enabled = true;
+            startDispatcher();
+        }
+    }
+
+    void push (Message&& message)
+    {
+        if (! enabled)
+            return;
+
+        auto m = new Message (std::move (message));
+
+        while (! messages.push (m))
+        {
+            // If the callback itself is logging, there's nobody else to make space
+            if (isDispatchThread || ! enabled)
+            {
+                delete m;
+                ++numDropped;
+                return;
+            }
+
+            wakeDispatcher.notify_one();
+            std::this_thread::yield();
+        }
+
+        ++numQueued;
+        wakeDispatcher.notify_one();
+    }
+
+    void pushRealtime (const char* description, const char* detail) noexcept
+    {
+        if (! enabled)
+            return;
+
+        RealtimeMessage m;
+        copyTruncated (m.description, description);
+        copyTruncated (m.detail, detail);
+
+        if (! realtimeMessages.push (m))
+            ++numDropped;
+    }
+
+    void flush()
+    {
+        if (isDispatchThread)
+            return;
+
+        auto target = numQueued.load();
+        std::unique_lock<std::mutex> l (signalLock);
+        wakeDispatcher.notify_one();
+        messagesDelivered.wait (l, [&] { return ! dispatcherRunning || numDelivered >= target; });
+    }
+
+    std::atomic<bool> enabled { false };
+
+private:
+    struct RealtimeMessage
+    {
+        char description[64];
+        char detail[192];
+    };
+
+    static constexpr uint32_t queueSize = 4096;
+    static constexpr uint32_t realtimeQueueSize = 1024;
+
+    // The realtime queue isn't signalled, so this is how often it gets checked
+    static constexpr auto pollInterval = std::chrono::milliseconds (10);
+
+    MultipleWriterFIFO<Message*> messages;
+    MultipleWriterFIFO<RealtimeMessage> realtimeMessages;
+    std::atomic<uint64_t> numQueued { 0 }, numDelivered { 0 };
+    std::atomic<uint32_t> numDropped { 0 };
+
+    std::mutex callbackLock;
+    LoggingFunction callback;
+    std::thread dispatchThread;
+
+    std::mutex signalLock;
+    std::condition_variable wakeDispatcher, messagesDelivered;
+    bool shouldStop = false, dispatcherRunning = false;
+
+    static inline thread_local bool isDispatchThread = false;
+
+    template <size_t size>
+    static void copyTruncated (char (&dest)[size], const char* source) noexcept
+    {
+        size_t i = 0;
+
+        if (source != nullptr)
+            for (; i < size - 1 && source[i] != 0; ++i)
+                dest[i] = source[i];
+
+        dest[i] = 0;
+    }
+
+    void startDispatcher()
+    {
+        {
+            std::lock_guard<std::mutex> l (signalLock);
+            shouldStop = false;
+            dispatcherRunning = true;
+        }
+
+        dispatchThread = std::thread ([this] { run(); });
+    }
+
+    void stopDispatcher()
+    {
+        if (! dispatchThread.joinable())
+            return;
+
+        {
+            std::lock_guard<std::mutex> l (signalLock);
+            shouldStop = true;
+        }
+
+        wakeDispatcher.notify_one();
+        dispatchThread.join();
+
+        {
+            std::lock_guard<std::mutex> l (signalLock);
+            dispatcherRunning = false;
+        }
+
+        messagesDelivered.notify_all();
+    }
+
+    void run()
+    {
+        isDispatchThread = true;
+
+        for (;;)
+        {
+            deliverQueuedMessages();
+
+            std::unique_lock<std::mutex> l (signalLock);
+            messagesDelivered.notify_all();
+
+            if (shouldStop)
+                break;
+
+            wakeDispatcher.wait_for (l, pollInterval);
+        }
+
+        deliverQueuedMessages();
+    }
+
+    void deliverQueuedMessages()
+    {
+        Message* message;
+        RealtimeMessage realtimeMessage;
+
+        while (messages.pop (message))
+        {
+            std::unique_ptr<Message> m (message);
+            deliver (*m);
+            ++numDelivered;
+        }
+
+        while (realtimeMessages.pop (realtimeMessage))
+            deliver ({ realtimeMessage.description, realtimeMessage.detail });
+
+        if (auto numLost = numDropped.exchange (0))
+            deliver ({ "Logger", std::to_string (numLost) + " messages were dropped because the log queue was full" });
+    }
+
+    void deliver (const Message& m)
+    {
+        try
+        {
+            callback (m);
+        }
+        catch (...) {}
+    }
+};
+
 //==============================================================================
 void Logger::log (std::string description, std::string detail)
 {
-    log ({ std::move (description), std::move (detail) });
+    getCallbackHolder().push ({ std::move (description), std::move (detail) });
 }
 
 void Logger::log (std::string description, const std::function<std::string()>& detail)
 {
-    log ({ std::move (description), detail != nullptr ? detail() : std::string() });
+    if (isLoggingEnabled())
+        getCallbackHolder().push ({ std::move (description), detail != nullptr ? detail() : std::string() });
 }
 
 void Logger::log (const Message& message)
 {
-    auto& holder = getCallbackHolder();
-    std::lock_guard<std::mutex> g (holder.lock);
+    getCallbackHolder().push (Message (message));
+}
+
+void Logger::logFromRealtimeThread (const char* description, const char* detail) noexcept
+{
+    getCallbackHolder().pushRealtime (description, detail);
+}
 
-    if (holder.callback != nullptr)
-        holder.callback (message);
+void Logger::flush()
+{
+    getCallbackHolder().flush();
 }
 
 void Logger::setLogFunction (LoggingFunction f)
 {
-    auto& holder = getCallbackHolder();
-    std::lock_guard<std::mutex> g (holder.lock);
-    holder.callback = f;
+    getCallbackHolder().setCallback (std::move (f));
 }
 
 void Logger::clearLogFunction()
@@ -59,9 +264,7 @@ void Logger::clearLogFunction()
 
 bool Logger::isLoggingEnabled() noexcept
 {
-    auto& holder = getCallbackHolder();
-    std::lock_guard<std::mutex> g (holder.lock);
-    return holder.callback != nullptr;
+    return getCallbackHolder().enabled;
 }
 
 Logger::LoggerHolder& Logger::getCallbackHolder()
@@ -24,6 +24,11 @@ namespace soul
 //==============================================================================
 /**
     Channels general log messages through a customisable callback function.
+
+    Messages are put into a lock-free queue which any number of threads can write to,
+    and a background thread calls the callback with them, so threads which log at the
+    same time don't block each other, and don't have to wait for the callback. The
+    messages from each thread are delivered in the order it logged them.
 */
 class Logger  final
 {
@@ -34,10 +39,14 @@ public:
         std::string description, detail;
     };
 
-    /** A user-supplied callback that can be registered with setLogFunction(). */
+    /** A user-supplied callback that can be registered with setLogFunction().
+        It's called on the logger's own background thread.
+    */
     using LoggingFunction = std::function<void(const Message&)>;
 
-    /** Logs a message */
+    /** Logs a message.
+        If the queue is full, this waits for the background thread to make space.
+    */
     static void log (std::string description, std::string detail);
 
     /** Logs a message via a lambda that will only called if a logging
@@ -50,7 +59,22 @@ public:
     /** Logs a message. */
     static void log (const Message&);
 
-    /** Installs a user-supplied logging callback. */
+    /** Logs a message without allocating or blocking, so that it can be called on a
+        realtime thread. The strings are truncated to a fixed length, and if the queue
+        for these messages is full, the message is dropped, and the number of dropped
+        messages gets logged later on. These messages go through a separate queue, so
+        they may not be interleaved exactly with the ones from the other log() methods.
+    */
+    static void logFromRealtimeThread (const char* description, const char* detail) noexcept;
+
+    /** Waits until all the messages which were logged before this call have been passed
+        to the callback.
+    */
+    static void flush();
+
+    /** Installs a user-supplied logging callback.
+        Any messages which are still queued are delivered to the old callback first.
+    */
     static void setLogFunction (LoggingFunction);
 
     /** Removes any currently installed logging callback. */
@@ -60,12 +84,7 @@ public:
     static bool isLoggingEnabled() noexcept;
 
 private:
-    struct LoggerHolder
-    {
-        std::mutex lock;
-        LoggingFunction callback;
-    };
-
+    struct LoggerHolder;
     static LoggerHolder& getCallbackHolder();
 };
 
@@ -50,6 +50,290 @@ std::string ScopedTimer::getElapsedTimeDescription() const
     return getDescriptionOfTimeInSeconds (getElapsedSeconds());
 }
 
+//==============================================================================
+struct TraceEvent
+{
+    const char* category;
+    const char* name;
+    int64_t startTime, duration;
+    uint32_t threadID;
+    bool isInstant;
+};
+
+struct TraceThreadBuffer
+{
+    std::vector<TraceEvent> events = std::vector<TraceEvent> (Trace::maxEventsPerThread);
+    std::atomic<uint32_t> numEvents { 0 }, session { 0 };
+    std::atomic<bool> inUse { true };
+};
+
+struct TraceState
+{
+    std::mutex lock;
+    std::vector<std::unique_ptr<TraceThreadBuffer>> buffers;  // (these are never deleted, so threads can safely keep pointers to them)
+    std::atomic<bool> active { false };
+    std::atomic<uint32_t> session { 0 }, nextThreadID { 1 };
+    std::atomic<int64_t> startTime { 0 };
+
+    static TraceState& get()
+    {
+        static TraceState state;
+        return state;
+    }
+};
+
+/** When a thread finishes, its buffer is handed on to the next new thread that needs one. */
+struct TraceThreadHolder
+{
+    ~TraceThreadHolder()
+    {
+        if (buffer != nullptr)
+            buffer->inUse = false;
+    }
+
+    TraceThreadBuffer* buffer = nullptr;
+    uint32_t threadID = 0;
+};
+
+static thread_local TraceThreadHolder traceThreadHolder;
+
+static int64_t getTraceTime() noexcept
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void addTraceEvent (const char* category, const char* name, int64_t start, int64_t duration, bool isInstant)
+{
+    auto& state = TraceState::get();
+    auto& holder = traceThreadHolder;
+
+    if (holder.buffer == nullptr)
+    {
+        std::lock_guard<std::mutex> l (state.lock);
+
+        for (auto& b : state.buffers)
+        {
+            if (! b->inUse.load())
+            {
+                b->inUse = true;
+                holder.buffer = b.get();
+                break;
+            }
+        }
+
+        if (holder.buffer == nullptr)
+        {
+            state.buffers.push_back (std::make_unique<TraceThreadBuffer>());
+            holder.buffer = state.buffers.back().get();
+        }
+
+        holder.threadID = state.nextThreadID++;
+    }
+
+    auto& buffer = *holder.buffer;
+    auto session = state.session.load (std::memory_order_acquire);
+
+    if (buffer.session.load (std::memory_order_relaxed) != session)
+    {
+        buffer.numEvents.store (0, std::memory_order_relaxed);
+        buffer.session.store (session, std::memory_order_release);
+    }
+
+    auto index = buffer.numEvents.load (std::memory_order_relaxed);
+
+    if (index < buffer.events.size())
+    {
+        buffer.events[index] = { category, name, start, duration, holder.threadID, isInstant };
+        buffer.numEvents.store (index + 1, std::memory_order_release);
+    }
+}
+
+void Trace::start()
+{
+    auto& state = TraceState::get();
+    state.startTime = getTraceTime();
+    ++state.session;
+    state.active = true;
+}
+
+void Trace::stop()
+{
+    TraceState::get().active = false;
+}
+
+bool Trace::isActive() noexcept
+{
+    return TraceState::get().active.load (std::memory_order_relaxed);
+}
+
+void Trace::addInstantEvent (const char* category, const char* name) noexcept
+{
+    if (isActive())
+        addTraceEvent (category, name, getTraceTime(), 0, true);
+}
+
+std::string Trace::toChromeTraceJSON()
+{
+    auto& state = TraceState::get();
+    auto session = state.session.load();
+    auto startTime = state.startTime.load();
+    std::ostringstream out;
+    bool isFirst = true;
+
+    auto toMicroseconds = [] (int64_t nanoseconds)
+    {
+        return choc::text::floatToString (static_cast<double> (nanoseconds) / 1000.0);
+    };
+
+    out << "{\"traceEvents\":[";
+
+    std::lock_guard<std::mutex> l (state.lock);
+
+    for (auto& b : state.buffers)
+    {
+        if (b->session.load (std::memory_order_acquire) != session)
+            continue;
+
+        auto numEvents = b->numEvents.load (std::memory_order_acquire);
+
+        for (uint32_t i = 0; i < numEvents; ++i)
+        {
+            auto& e = b->events[i];
+
+            out << (isFirst ? "\n" : ",\n")
+                << "{\"name\":" << choc::json::getEscapedQuotedString (e.name)
+                << ",\"cat\":" << choc::json::getEscapedQuotedString (e.category)
+                << ",\"ph\":" << (e.isInstant ? "\"i\",\"s\":\"t\"" : "\"X\"")
+                << ",\"ts\":" << toMicroseconds (e.startTime - startTime);
+
+            if (! e.isInstant)
+                out << ",\"dur\":" << toMicroseconds (e.duration);
+
+            out << ",\"pid\":1,\"tid\":" << e.threadID << "}";
+            isFirst = false;
+        }
+    }
+
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return out.str();
+}
+
+Trace::ScopedEvent::ScopedEvent (const char* c, const char* n) noexcept
+    : category (c), name (n), isRecording (n != nullptr && isActive())
+{
+    if (isRecording)
+        startTime = getTraceTime();
+}
+
+Trace::ScopedEvent::~ScopedEvent()
+{
+    if (isRecording && isActive())
+        addTraceEvent (category, name, startTime, getTraceTime() - startTime, false);
+}
+
+//==============================================================================
+static thread_local BuildReport::Recorder* currentBuildReportRecorder = nullptr;
+
+BuildReport::Recorder::Recorder (BuildReport& r)  : report (r), previous (currentBuildReportRecorder)
+{
+    currentBuildReportRecorder = this;
+}
+
+BuildReport::Recorder::~Recorder()
+{
+    currentBuildReportRecorder = previous;
+}
+
+BuildReport::Phase::Phase (const char* name, const PoolAllocator* poolToMeasure)
+    : traceEvent ("build", name), recorder (name != nullptr ? currentBuildReportRecorder : nullptr), pool (poolToMeasure)
+{
+    if (recorder != nullptr)
+        begin (name);
+}
+
+BuildReport::Phase::Phase (const char* name, const std::string& detail, const PoolAllocator* poolToMeasure)
+    : traceEvent ("build", name), recorder (currentBuildReportRecorder), pool (poolToMeasure)
+{
+    if (recorder != nullptr)
+        begin (name + (": " + detail));
+}
+
+void BuildReport::Phase::begin (std::string name)
+{
+    auto& phases = recorder->report.phases;
+    index = phases.size();
+    phases.push_back ({ std::move (name), recorder->currentDepth++ });
+
+    if (pool != nullptr)
+    {
+        startAllocations = pool->getNumAllocations();
+        startBytes = pool->getNumBytesUsed();
+    }
+
+    start = clock::now();
+}
+
+BuildReport::Phase::~Phase()
+{
+    if (recorder != nullptr)
+    {
+        auto& result = recorder->report.phases[index];
+        result.seconds = toSeconds (clock::now() - start);
+        --(recorder->currentDepth);
+
+        // (the pool may have been cleared during the phase, in which case there's nothing useful to report)
+        if (pool != nullptr && pool->getNumAllocations() >= startAllocations)
+        {
+            result.numPoolAllocations = pool->getNumAllocations() - startAllocations;
+            result.numPoolBytes = pool->getNumBytesUsed() - startBytes;
+        }
+    }
+}
+
+std::string BuildReport::toString() const
+{
+    std::vector<std::string> names;
+    size_t longestName = 0;
+
+    for (auto& p : phases)
+    {
+        names.push_back (repeatedCharacter (' ', p.depth * 2) + p.name);
+        longestName = std::max (longestName, names.back().length());
+    }
+
+    std::ostringstream out;
+
+    for (size_t i = 0; i < phases.size(); ++i)
+    {
+        auto& p = phases[i];
+
+        out << padded (names[i], (int) longestName + 2)
+            << padded (getDescriptionOfTimeInSeconds (p.seconds), 12);
+
+        if (p.numPoolAllocations != 0)
+            out << p.numPoolAllocations << " objects, " << p.numPoolBytes << " bytes";
+
+        out << std::endl;
+    }
+
+    return out.str();
+}
+
+choc::value::Value BuildReport::toValue() const
+{
+    auto result = choc::value::createEmptyArray();
+
+    for (auto& p : phases)
+        result.addArrayElement (choc::value::createObject ("BuildPhase",
+                                                           "name", p.name,
+                                                           "depth", static_cast<int32_t> (p.depth),
+                                                           "seconds", p.seconds,
+                                                           "poolAllocations", static_cast<int64_t> (p.numPoolAllocations),
+                                                           "poolBytes", static_cast<int64_t> (p.numPoolBytes)));
+
+    return result;
+}
+
 //==============================================================================
 CPULoadMeasurer::CPULoadMeasurer() { reset(); }
 
@@ -98,6 +382,95 @@ float CPULoadMeasurer::getCurrentLoad() const
    #endif
 }
 
+//==============================================================================
+void ProcessingTimeAccumulator::reset()
+{
+    numMeasurements = 0;
+    totalNanoseconds = 0;
+    maxNanoseconds = 0;
+}
+
+void ProcessingTimeAccumulator::addMeasurement (std::chrono::nanoseconds duration) noexcept
+{
+    auto nanoseconds = static_cast<uint64_t> (std::max (duration.count(), static_cast<decltype (duration.count())> (0)));
+
+    // Only the rendering thread writes these, so they don't need read-modify-write atomics
+    numMeasurements.store (getNumMeasurements() + 1, std::memory_order_relaxed);
+    totalNanoseconds.store (getTotalNanoseconds() + nanoseconds, std::memory_order_relaxed);
+
+    if (nanoseconds > getMaxNanoseconds())
+        maxNanoseconds.store (nanoseconds, std::memory_order_relaxed);
+}
+
+//==============================================================================
+static constexpr double histogramBucketsPerOctave = 4.0;
+
+void BlockTimeHistogram::reset()
+{
+    totals.reset();
+
+    for (auto& count : bucketCounts)
+        count = 0;
+}
+
+void BlockTimeHistogram::addMeasurement (std::chrono::nanoseconds duration) noexcept
+{
+    totals.addMeasurement (duration);
+
+    auto microseconds = static_cast<double> (duration.count()) / 1000.0;
+    size_t bucket = 0;
+
+    if (microseconds > 1.0)
+        bucket = std::min (numBuckets - 1, static_cast<size_t> (std::ceil (std::log2 (microseconds) * histogramBucketsPerOctave)));
+
+    auto& count = bucketCounts[bucket];
+    count.store (count.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+BlockTimeHistogram::Snapshot BlockTimeHistogram::getSnapshot() const
+{
+    Snapshot s;
+    s.numBlocks = totals.getNumMeasurements();
+    s.maxMicroseconds = static_cast<double> (totals.getMaxNanoseconds()) / 1000.0;
+
+    if (s.numBlocks != 0)
+        s.averageMicroseconds = static_cast<double> (totals.getTotalNanoseconds()) / (1000.0 * static_cast<double> (s.numBlocks));
+
+    for (auto& count : bucketCounts)
+        s.bucketCounts.push_back (count.load (std::memory_order_relaxed));
+
+    return s;
+}
+
+double BlockTimeHistogram::getBucketLimitMicroseconds (size_t bucketIndex)
+{
+    return std::pow (2.0, static_cast<double> (bucketIndex) / histogramBucketsPerOctave);
+}
+
+double BlockTimeHistogram::Snapshot::getPercentileMicroseconds (double proportion) const
+{
+    uint64_t total = 0;
+
+    for (auto count : bucketCounts)
+        total += count;
+
+    if (total == 0)
+        return 0;
+
+    auto target = static_cast<uint64_t> (std::ceil (std::clamp (proportion, 0.0, 1.0) * static_cast<double> (total)));
+    uint64_t numSoFar = 0;
+
+    for (size_t i = 0; i < bucketCounts.size(); ++i)
+    {
+        numSoFar += bucketCounts[i];
+
+        if (numSoFar >= target && numSoFar != 0)
+            return std::min (getBucketLimitMicroseconds (i), maxMicroseconds);
+    }
+
+    return maxMicroseconds;
+}
+
 float getBelaLoadFromString (const std::string& input)
 {
     for (auto& l : choc::text::splitIntoLines (input, true))
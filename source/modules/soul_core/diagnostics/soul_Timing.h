@@ -41,6 +41,120 @@ private:
 #define SOUL_LOG_TIME_OF_SCOPE(description) \
     const ScopedTimer timer_ ## __LINE__ (description);
 
+//==============================================================================
+/** Records a timeline of events from any number of threads, which can be exported in the
+    Chrome trace event format, and viewed with chrome://tracing or Perfetto.
+
+    Nothing is recorded until start() is called. Each thread writes its events into its own
+    fixed-size buffer without locking, and when a thread's buffer is full, any further events
+    that it adds are dropped. A thread's buffer is allocated the first time it records an event.
+
+    Only the pointers to the category and name strings are stored, so these must be string
+    literals, or other strings that will outlive the trace.
+*/
+struct Trace
+{
+    static constexpr uint32_t maxEventsPerThread = 32768;
+
+    /** Clears any previous events and starts recording. */
+    static void start();
+    /** Stops recording. The events that were recorded can still be exported. */
+    static void stop();
+    static bool isActive() noexcept;
+
+    /** Returns the events from the most recent trace, as a Chrome trace JSON object. */
+    static std::string toChromeTraceJSON();
+
+    /** Adds an event which marks a single moment, such as a cache hit. */
+    static void addInstantEvent (const char* category, const char* name) noexcept;
+
+    /** Adds an event covering the lifetime of this object, if a trace is being recorded. */
+    struct ScopedEvent
+    {
+        ScopedEvent (const char* category, const char* name) noexcept;
+        ~ScopedEvent();
+
+    private:
+        const char* category;
+        const char* name;
+        int64_t startTime = 0;
+        bool isRecording;
+    };
+};
+
+#define SOUL_TRACE_SCOPE(category, name) \
+    const soul::Trace::ScopedEvent traceEvent_ ## __LINE__ (category, name);
+
+//==============================================================================
+/** A breakdown of the time taken and memory allocated by each phase of a build.
+
+    To get a report, create a BuildReport::Recorder on the thread that's doing the
+    build. While it exists, any BuildReport::Phase objects that are created on that
+    thread will add their results to the report. When there's no recorder, a Phase
+    does nothing, so they can be left in the compiler at very little cost.
+*/
+struct BuildReport
+{
+    struct PhaseResult
+    {
+        std::string name;
+        uint32_t depth = 0;             ///< The number of outer phases that this one was nested inside
+        double seconds = 0;
+        size_t numPoolAllocations = 0;  ///< The number of objects created in the phase's PoolAllocator
+        size_t numPoolBytes = 0;        ///< The number of bytes used by those objects
+    };
+
+    std::vector<PhaseResult> phases;
+
+    bool isEmpty() const                { return phases.empty(); }
+    void clear()                        { phases.clear(); }
+
+    /** Returns a human-readable table of the phases. */
+    std::string toString() const;
+
+    /** Returns the phases as an array of objects, e.g. for converting to JSON. */
+    choc::value::Value toValue() const;
+
+    struct Phase;
+
+    //==============================================================================
+    /** Directs the results of any phases on the current thread into a report. */
+    struct Recorder
+    {
+        Recorder (BuildReport&);
+        ~Recorder();
+
+    private:
+        BuildReport& report;
+        Recorder* previous;
+        uint32_t currentDepth = 0;
+        friend struct Phase;
+    };
+
+    /** Measures a phase of the build, if there's a Recorder active on this thread.
+        If a PoolAllocator is provided, the objects that are allocated from it during the
+        phase are counted. A null name creates a phase which isn't recorded.
+        While a Trace is being recorded, each named phase is also added to it.
+    */
+    struct Phase
+    {
+        Phase (const char* name, const PoolAllocator* poolToMeasure = nullptr);
+        Phase (const char* name, const std::string& detail, const PoolAllocator* poolToMeasure = nullptr);
+        ~Phase();
+
+    private:
+        using clock = std::chrono::high_resolution_clock;
+
+        Trace::ScopedEvent traceEvent;
+        Recorder* recorder;
+        const PoolAllocator* pool;
+        size_t index = 0, startAllocations = 0, startBytes = 0;
+        clock::time_point start;
+
+        void begin (std::string name);
+    };
+};
+
 // Helper method to read the bela audio load
 float getBelaLoadFromString (const std::string& input);
 
@@ -64,5 +178,60 @@ private:
     double runningProportion = 0;
 };
 
+//==============================================================================
+/** Accumulates the time spent in an operation which is repeated for every block, such
+    as rendering one node of a graph. Measurements are added by the rendering thread without
+    locking, and the totals can be read from any other thread.
+*/
+struct ProcessingTimeAccumulator
+{
+    ProcessingTimeAccumulator() = default;
+
+    void reset();
+    void addMeasurement (std::chrono::nanoseconds duration) noexcept;
+
+    uint64_t getNumMeasurements() const noexcept    { return numMeasurements.load (std::memory_order_relaxed); }
+    uint64_t getTotalNanoseconds() const noexcept   { return totalNanoseconds.load (std::memory_order_relaxed); }
+    uint64_t getMaxNanoseconds() const noexcept     { return maxNanoseconds.load (std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> numMeasurements { 0 }, totalNanoseconds { 0 }, maxNanoseconds { 0 };
+};
+
+//==============================================================================
+/** Keeps a histogram of block render times, so that latency percentiles can be reported.
+    The render thread adds measurements without locking, and any other thread can take a
+    snapshot of the figures. The buckets are logarithmic, with four per octave, starting at
+    one microsecond.
+*/
+struct BlockTimeHistogram
+{
+    BlockTimeHistogram() = default;
+
+    static constexpr size_t numBuckets = 84;
+
+    void reset();
+    void addMeasurement (std::chrono::nanoseconds duration) noexcept;
+
+    struct Snapshot
+    {
+        uint64_t numBlocks = 0;
+        double averageMicroseconds = 0, maxMicroseconds = 0;
+        std::vector<uint64_t> bucketCounts;
+
+        /** Returns an upper bound for the time taken by the given proportion (0 to 1) of blocks. */
+        double getPercentileMicroseconds (double proportion) const;
+    };
+
+    Snapshot getSnapshot() const;
+
+    /** Returns the longest time, in microseconds, that's counted by the given bucket. */
+    static double getBucketLimitMicroseconds (size_t bucketIndex);
+
+private:
+    ProcessingTimeAccumulator totals;
+    std::atomic<uint64_t> bucketCounts[numBuckets] = {};
+};
+
 
 } // namespace soul
@@ -81,6 +81,7 @@ namespace CompileTimeIntrinsicEvaluation
     static double   atan2_d        (double a, double b)                    { return std::atan2 (a, b); }
     static bool     isnan_d        (double n)                              { return std::isnan (n); }
     static bool     isinf_d        (double n)                              { return std::isinf (n); }
+    static double   fma_d          (double a, double b, double c)          { return a * b + c; }
 
     Value perform (IntrinsicType i, ArrayView<Value> args, bool isFloat)
     {
@@ -123,41 +124,265 @@ namespace CompileTimeIntrinsicEvaluation
             case IntrinsicType::get_array_size:          return {};
             case IntrinsicType::read:                    return {};
             case IntrinsicType::readLinearInterpolated:  return {};
+            case IntrinsicType::fft:                     return {};
+            case IntrinsicType::dot:                     return {};
+            case IntrinsicType::sumOfSquares:            return {};
+            case IntrinsicType::minElement:              return {};
+            case IntrinsicType::maxElement:              return {};
+            case IntrinsicType::maxAbsElement:           return {};
+            case IntrinsicType::multiplyAccumulate:      return {};
+            case IntrinsicType::addScaled:               return {};
+            case IntrinsicType::fastSin:                 return {};
+            case IntrinsicType::fastCos:                 return {};
+            case IntrinsicType::fastExp:                 return {};
+            case IntrinsicType::fastTanh:                return {};
+            case IntrinsicType::fma:                     return perform (args, fma_d);
+            case IntrinsicType::select:                  return {};
+            case IntrinsicType::shuffle:                 return {};
         }
 
         return {};
     }
-}
 
-Value performIntrinsic (IntrinsicType i, ArrayView<Value> args)
-{
-    auto argType = args.front().getType();
+    static bool isElementWise (IntrinsicType i)
+    {
+        switch (i)
+        {
+            case IntrinsicType::none:
+            case IntrinsicType::roundToInt:
+            case IntrinsicType::sum:
+            case IntrinsicType::product:
+            case IntrinsicType::get_array_size:
+            case IntrinsicType::read:
+            case IntrinsicType::readLinearInterpolated:
+            case IntrinsicType::fft:
+            case IntrinsicType::dot:
+            case IntrinsicType::sumOfSquares:
+            case IntrinsicType::minElement:
+            case IntrinsicType::maxElement:
+            case IntrinsicType::maxAbsElement:
+            case IntrinsicType::multiplyAccumulate:
+            case IntrinsicType::addScaled:
+            case IntrinsicType::fastSin:
+            case IntrinsicType::fastCos:
+            case IntrinsicType::fastExp:
+            case IntrinsicType::fastTanh:
+            case IntrinsicType::shuffle:
+                return false;
 
-    for (auto& a : args)
+            default:
+                return true;
+        }
+    }
+
+    static bool isNumericArray (const Type& t)
+    {
+        return (t.isVector() || t.isFixedSizeArray())
+                 && (t.getElementType().isPrimitiveInteger() || t.getElementType().isPrimitiveFloat());
+    }
+
+    static Value performScalar (IntrinsicType i, ArrayView<Value> args)
     {
-        const auto& t = a.getType();
+        if (i == IntrinsicType::select)
+        {
+            if (args.size() != 3 || ! args[0].getType().isPrimitiveBool())
+                return {};
+
+            return args[0].getAsBool() ? args[1] : args[2];
+        }
+
+        auto argType = args.front().getType();
+
+        for (auto& a : args)
+        {
+            const auto& t = a.getType();
+
+            if (! (t.isPrimitiveInteger() || t.isPrimitiveFloat()))
+                return {};
+
+            if (! TypeRules::canPassAsArgumentTo (argType, t, false))
+                argType = t;
+        }
+
+        ArrayWithPreallocation<Value, 4> castArgs;
+
+        for (auto& a : args)
+            castArgs.push_back (a.castToTypeExpectingSuccess (argType));
 
-        if (! (t.isPrimitiveInteger() || t.isPrimitiveFloat()))
+        auto result = perform (i, castArgs, argType.isFloatingPoint());
+
+        if (! result.isValid())
             return {};
 
-        if (! TypeRules::canPassAsArgumentTo (argType, t, false))
-            argType = t;
+        if (result.getType().isBool())
+            return result;
+
+        return result.castToTypeExpectingSuccess (argType.withConstAndRefFlags (false, false));
     }
 
-    ArrayWithPreallocation<Value, 4> castArgs;
+    /** Applies a scalar intrinsic to each element of some vector arguments, where any scalar
+        arguments are used for every element.
+    */
+    static Value performElementWise (IntrinsicType i, ArrayView<Value> args, uint32_t vectorSize)
+    {
+        ArrayWithPreallocation<Value, 8> elements;
+
+        for (uint32_t element = 0; element < vectorSize; ++element)
+        {
+            ArrayWithPreallocation<Value, 4> elementArgs;
 
-    for (auto& a : args)
-        castArgs.push_back (a.castToTypeExpectingSuccess (argType));
+            for (auto& a : args)
+                elementArgs.push_back (a.getType().isVector() ? a.getSubElement (element) : a);
+
+            auto result = performScalar (i, elementArgs);
+
+            if (! result.isValid())
+                return {};
+
+            elements.push_back (std::move (result));
+        }
+
+        return Value::createArrayOrVector (Type::createVector (elements.front().getType().getPrimitiveType(), vectorSize), elements);
+    }
+
+    /** Folds an array or vector into a single value. The elements are combined in the same order as
+        the library functions use, so that float results are rounded identically. (The library splits
+        vectors of more than 8 elements into chunks, so float sums of those are left alone).
+    */
+    static Value performReduction (IntrinsicType i, ArrayView<Value> args)
+    {
+        auto& type = args.front().getType();
+
+        if (! isNumericArray (type))
+            return {};
+
+        auto size = type.getArrayOrVectorSize();
+        auto isFloat = type.getElementType().isFloatingPoint();
+
+        if (i == IntrinsicType::minElement || i == IntrinsicType::maxElement || i == IntrinsicType::maxAbsElement)
+        {
+            if (args.size() != 1 || size == 0)
+                return {};
+
+            auto op = i == IntrinsicType::minElement ? IntrinsicType::min : IntrinsicType::max;
+            auto getElement = [&] (size_t index)
+            {
+                Value element[] = { args[0].getSubElement (index) };
+                return i == IntrinsicType::maxAbsElement ? performScalar (IntrinsicType::abs, element) : element[0];
+            };
+
+            auto result = getElement (0);
+
+            for (size_t n = 1; n < size && result.isValid(); ++n)
+            {
+                Value pair[] = { result, getElement (n) };
+                result = performScalar (op, pair);
+            }
+
+            return result;
+        }
 
-    auto result = CompileTimeIntrinsicEvaluation::perform (i, castArgs, argType.isFloatingPoint());
+        if (isFloat && type.isVector() && size > 8)
+            return {};
+
+        auto combine = [] (Value a, Value b, BinaryOp::Op op)
+        {
+            if (! BinaryOp::apply (a, std::move (b), op, [] (CompileMessage) {}))
+                return Value();
+
+            return a;
+        };
+
+        if (i == IntrinsicType::sum || i == IntrinsicType::product)
+        {
+            if (args.size() != 1 || size == 0)
+                return {};
+
+            auto op = i == IntrinsicType::sum ? BinaryOp::Op::add : BinaryOp::Op::multiply;
+            auto result = args[0].getSubElement (0);
+
+            for (size_t n = 1; n < size && result.isValid(); ++n)
+                result = combine (result, args[0].getSubElement (n), op);
+
+            return result;
+        }
+
+        if (i == IntrinsicType::dot || i == IntrinsicType::sumOfSquares)
+        {
+            auto& a = args[0];
+            auto& b = args[args.size() - 1];
+
+            if ((i == IntrinsicType::dot) != (args.size() == 2) || ! a.getType().isIdentical (b.getType()))
+                return {};
+
+            auto getProduct = [&] (size_t n) { return combine (a.getSubElement (n), b.getSubElement (n), BinaryOp::Op::multiply); };
+
+            // The vector version adds up the products, whereas the array one adds each to a zero total
+            auto result = type.isVector() ? getProduct (0) : Value::zeroInitialiser (type.getElementType());
+
+            for (size_t n = type.isVector() ? 1 : 0; n < size && result.isValid(); ++n)
+                result = combine (result, getProduct (n), BinaryOp::Op::add);
+
+            return result;
+        }
+
+        return {};
+    }
+
+    static Value performShuffle (ArrayView<Value> args)
+    {
+        if (args.size() != 2 || ! (args[0].getType().isVector() && args[1].getType().isVector()))
+            return {};
 
-    if (! result.isValid())
+        auto size = args[0].getType().getVectorSize();
+
+        if (args[1].getType().getVectorSize() != size || ! args[1].getType().getElementType().isInteger())
+            return {};
+
+        ArrayWithPreallocation<Value, 8> elements;
+
+        for (size_t n = 0; n < size; ++n)
+        {
+            auto index = args[1].getSubElement (n).getAsInt64() % static_cast<int64_t> (size);
+            elements.push_back (args[0].getSubElement (static_cast<size_t> (index < 0 ? index + static_cast<int64_t> (size) : index)));
+        }
+
+        return Value::createArrayOrVector (args[0].getType().withConstAndRefFlags (false, false), elements);
+    }
+}
+
+Value performIntrinsic (IntrinsicType i, ArrayView<Value> args)
+{
+    using namespace CompileTimeIntrinsicEvaluation;
+
+    if (args.empty())
         return {};
 
-    if (result.getType().isBool())
-        return result;
+    if (i == IntrinsicType::shuffle)
+        return performShuffle (args);
+
+    if (! isElementWise (i))
+        return performReduction (i, args);
+
+    uint32_t vectorSize = 0;
+
+    for (auto& a : args)
+    {
+        if (a.getType().isVector())
+        {
+            auto size = static_cast<uint32_t> (a.getType().getVectorSize());
+
+            if (vectorSize != 0 && vectorSize != size)
+                return {};
+
+            vectorSize = size;
+        }
+    }
+
+    if (vectorSize != 0)
+        return performElementWise (i, args, vectorSize);
 
-    return result.castToTypeExpectingSuccess (argType.withConstAndRefFlags (false, false));
+    return performScalar (i, args);
 }
 
 #define SOUL_INTRINSICS(X) \
@@ -197,6 +422,21 @@ Value performIntrinsic (IntrinsicType i, ArrayView<Value> args)
     X(get_array_size) \
     X(read) \
     X(readLinearInterpolated) \
+    X(fft) \
+    X(dot) \
+    X(sumOfSquares) \
+    X(minElement) \
+    X(maxElement) \
+    X(maxAbsElement) \
+    X(multiplyAccumulate) \
+    X(addScaled) \
+    X(fastSin) \
+    X(fastCos) \
+    X(fastExp) \
+    X(fastTanh) \
+    X(fma) \
+    X(select) \
+    X(shuffle) \
 
 IntrinsicType getIntrinsicTypeFromName (std::string_view s)
 {
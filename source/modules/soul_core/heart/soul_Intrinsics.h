@@ -59,10 +59,29 @@ namespace soul
         product,
         get_array_size,
         read,
-        readLinearInterpolated
+        readLinearInterpolated,
+        fft,
+        dot,
+        sumOfSquares,
+        minElement,
+        maxElement,
+        maxAbsElement,
+        multiplyAccumulate,
+        addScaled,
+        fastSin,
+        fastCos,
+        fastExp,
+        fastTanh,
+        fma,
+        select,
+        shuffle
     };
 
-    /** Used for compile-time evaluation of an intrinsic function */
+    /** Used for compile-time evaluation of an intrinsic function. Element-wise intrinsics can be
+        given vector arguments (along with scalars, which are used for every element), and the
+        reductions such as minElement() can be given arrays or vectors. If the call can't be
+        evaluated, this returns an invalid Value.
+    */
     Value performIntrinsic (IntrinsicType, ArrayView<Value> args);
 
     /** All intrinsics have function declarations in a dedicated namespace with this name. */
@@ -103,6 +103,21 @@ pool_ptr<heart::Variable> Module::findStateVariable (const std::string& name) co
     return {};
 }
 
+template <typename Type>
+static pool_ptr<Type> findItemWithName (const std::vector<pool_ref<Type>>& items, Identifier name)
+{
+    for (auto& i : items)
+        if (i->name == name)
+            return i;
+
+    return {};
+}
+
+pool_ptr<heart::Function> Module::findFunction (Identifier name) const               { return findItemWithName (functions, name); }
+pool_ptr<heart::Variable> Module::findStateVariable (Identifier name) const          { return findItemWithName (stateVariables, name); }
+pool_ptr<heart::InputDeclaration> Module::findInput (Identifier name) const          { return findItemWithName (inputs, name); }
+pool_ptr<heart::OutputDeclaration> Module::findOutput (Identifier name) const        { return findItemWithName (outputs, name); }
+
 Structure& Module::addStruct (std::string name)
 {
     SOUL_ASSERT (findStruct (name) == nullptr); // name clash!
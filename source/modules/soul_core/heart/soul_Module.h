@@ -71,6 +71,15 @@ public:
     pool_ptr<heart::InputDeclaration>  findInput  (const std::string& name) const;
     pool_ptr<heart::OutputDeclaration> findOutput (const std::string& name) const;
 
+    //==============================================================================
+    /** These versions compare the identifiers directly rather than their strings, so the
+        name must have come from the same Identifier::Pool as the program that owns this module.
+    */
+    pool_ptr<heart::Function> findFunction (Identifier name) const;
+    pool_ptr<heart::Variable> findStateVariable (Identifier name) const;
+    pool_ptr<heart::InputDeclaration>  findInput  (Identifier name) const;
+    pool_ptr<heart::OutputDeclaration> findOutput (Identifier name) const;
+
     //==============================================================================
     Structure& addStruct (std::string name);
     Structure& addStructCopy (Structure&);
@@ -87,6 +87,12 @@ struct ModuleCloner
     std::unordered_map<pool_ref<const heart::Block>, pool_ptr<heart::Block>> blockMappings;
     std::unordered_map<pool_ref<const heart::ProcessorInstance>, pool_ptr<heart::ProcessorInstance>> processorInstanceMappings;
 
+    /** When cloning into a different program, these must be set to move any constant and string
+        handles into that program's tables.
+    */
+    Value::ConstantHandleMapper constantHandleMapper;
+    Value::StringHandleMapper stringHandleMapper;
+
     heart::Block& getRemappedBlock (heart::Block& old)
     {
         auto& b = blockMappings[old];
@@ -94,9 +100,14 @@ struct ModuleCloner
         return *b;
     }
 
-    Value getRemappedValue (Value v)
+    Value getRemappedValue (const Value& v)
     {
-        return v.cloneWithEquivalentType (cloneType (v.getType()));
+        auto result = v.getType().refersToStruct() ? v.cloneWithEquivalentType (cloneType (v.getType())) : v;
+
+        if (constantHandleMapper != nullptr)
+            result.remapHandles (constantHandleMapper, stringHandleMapper);
+
+        return result;
     }
 
     heart::Expression& cloneExpression (heart::Expression& old)
@@ -143,8 +154,8 @@ struct ModuleCloner
 
     heart::Variable& getRemappedVariable (heart::Variable& old)
     {
-        auto v = variableMappings[old];
-        return v == nullptr ? cloneVariable (old) : *v;
+        auto v = variableMappings.find (old);
+        return v == variableMappings.end() ? cloneVariable (old) : *v->second;
     }
 
     heart::Function& getRemappedFunction (heart::Function& old)
@@ -170,6 +181,10 @@ struct ModuleCloner
 
     static Type cloneType (StructMappings& structMappings, const Type& t)
     {
+        // Most types don't involve any structs, and these can just be shared with the old module
+        if (! t.refersToStruct())
+            return t;
+
         if (t.isStruct())
         {
             auto s = structMappings[t.getStruct().get()];
@@ -234,10 +249,10 @@ struct ModuleCloner
         auto& c = newModule.allocate<heart::Connection> (old.location);
         c.interpolationType   = old.interpolationType;
         c.sourceProcessor     = getRemappedProcessorInstance (old.sourceProcessor);
-        c.sourceEndpoint      = old.sourceEndpoint;
+        c.sourceEndpoint      = newModule.allocator.get (old.sourceEndpoint);
         c.sourceEndpointIndex = old.sourceEndpointIndex;
         c.destProcessor       = getRemappedProcessorInstance (old.destProcessor);
-        c.destEndpoint        = old.destEndpoint;
+        c.destEndpoint        = newModule.allocator.get (old.destEndpoint);
         c.destEndpointIndex   = old.destEndpointIndex;
         c.delayLength         = old.delayLength;
         return c;
@@ -272,7 +287,8 @@ struct ModuleCloner
         auto& v = newModule.allocate<heart::Variable> (old.location, cloneType (old.type),
                                                        newModule.allocator.get (old.name),
                                                        old.role);
-        v.externalHandle = old.externalHandle;
+        v.externalHandle = (old.externalHandle != 0 && constantHandleMapper != nullptr) ? constantHandleMapper (old.externalHandle)
+                                                                                        : old.externalHandle;
         v.annotation = old.annotation;
         mapping = v;
         return v;
@@ -317,6 +333,7 @@ struct ModuleCloner
     void clone (heart::Block& b, const heart::Block& old)
     {
         LinkedList<heart::Statement>::Iterator last;
+        b.parameters.reserve (old.parameters.size());
 
         for (auto p : old.parameters)
             b.parameters.push_back (cloneVariable (p));
@@ -451,6 +468,10 @@ struct ModuleCloner
         f.hasNoBody = old.hasNoBody;
         f.annotation = old.annotation;
 
+        f.parameters.reserve (old.parameters.size());
+        f.blocks.reserve (old.blocks.size());
+        blockMappings.reserve (old.blocks.size());
+
         for (auto& p : old.parameters)
             f.parameters.push_back (cloneVariable (p));
 
@@ -311,6 +311,9 @@ namespace BinaryOp
         return false;
     }
 
+    /** Performs the operation on two constants, replacing lhs with the result. Vectors are
+        evaluated element by element. Returns false if the operation can't be evaluated.
+    */
     template <typename HandleError>
     inline bool apply (Value& lhs, Value rhs, Op op, HandleError&& handleError)
     {
@@ -322,6 +325,24 @@ namespace BinaryOp
         if (! (lhs.isValid() && rhs.isValid()))
             return {};
 
+        if (types.operandType.isVector())
+        {
+            ArrayWithPreallocation<Value, 8> elements;
+
+            for (size_t i = 0; i < types.operandType.getVectorSize(); ++i)
+            {
+                auto element = lhs.getSubElement (i);
+
+                if (! apply (element, rhs.getSubElement (i), op, handleError))
+                    return false;
+
+                elements.push_back (std::move (element));
+            }
+
+            lhs = Value::createArrayOrVector (types.resultType, elements);
+            return true;
+        }
+
         if (op == Op::equals)              { lhs = Value (lhs == rhs); return true; }
         if (op == Op::notEquals)           { lhs = Value (lhs != rhs); return true; }
 
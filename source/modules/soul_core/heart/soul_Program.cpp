@@ -169,6 +169,105 @@ struct Program::ProgramImpl  : public RefCountedObject
         return newProgram;
     }
 
+    Module& addCopyOfProgram (const ProgramImpl& source, const std::string& namespaceName)
+    {
+        auto sourceMain = source.getMainProcessor();
+
+        if (sourceMain == nullptr)
+            CodeLocation().throwError (Errors::emptyProgram());
+
+        Program program (*this, false);
+        ModuleCloner::FunctionMappings functionMappings;
+        ModuleCloner::StructMappings structMappings;
+        ModuleCloner::VariableMappings variableMappings;
+        std::unordered_map<ConstantTable::Handle, ConstantTable::Handle> constantMappings;
+        std::vector<ModuleCloner> cloners;
+        pool_ptr<Module> newMain;
+
+        // The source's tables will have handles which clash with ours, so every handle that gets
+        // copied is replaced by the one for the same content in this program's tables
+        Value::StringHandleMapper mapString = [&] (StringDictionary::Handle h)
+        {
+            return stringDictionary.getHandleForString (source.stringDictionary.getStringForHandle (h));
+        };
+
+        Value::ConstantHandleMapper mapConstant;
+
+        mapConstant = [&] (ConstantTable::Handle h) -> ConstantTable::Handle
+        {
+            if (h == 0)
+                return 0;
+
+            auto found = constantMappings.find (h);
+
+            if (found != constantMappings.end())
+                return found->second;
+
+            auto sourceValue = source.constantTable.getValueForHandle (h);
+            SOUL_ASSERT (sourceValue != nullptr);
+            auto value = cloneValue (structMappings, *sourceValue);
+            value.remapHandles (mapConstant, mapString);
+            return constantMappings[h] = constantTable.getHandleForValue (std::move (value));
+        };
+
+        auto rootName = std::string (getRootNamespaceName());
+        auto rootPrefix = rootName + "::";
+
+        for (auto& m : source.modules)
+        {
+            auto& newModule = allocator.allocate<Module> (program, m);
+            newModule.sampleRate = m->sampleRate;
+            newModule.annotation.remove ("main");
+
+            if (m->fullName == rootName)
+            {
+                newModule.shortName = namespaceName;
+                newModule.fullName = rootPrefix + namespaceName;
+            }
+            else
+            {
+                newModule.fullName = renameIntoNamespace (m->fullName, namespaceName);
+            }
+
+            newModule.originalFullName = m->originalFullName.empty() ? namespaceName
+                                                                     : TokenisedPathString::join (namespaceName, m->originalFullName);
+
+            if (m == sourceMain)
+                newMain = newModule;
+
+            insert (-1, newModule);
+            cloners.emplace_back (m, newModule, functionMappings, structMappings, variableMappings);
+            cloners.back().constantHandleMapper = mapConstant;
+            cloners.back().stringHandleMapper = mapString;
+        }
+
+        for (auto& c : cloners)
+            c.createStructPlaceholders();
+
+        for (auto& c : cloners)
+            c.cloneStructAndFunctionPlaceholders();
+
+        for (auto& c : cloners)
+        {
+            c.clone();
+
+            for (auto& instance : c.newModule.processorInstances)
+                instance->sourceName = renameIntoNamespace (instance->sourceName, namespaceName);
+        }
+
+        return *newMain;
+    }
+
+    static std::string renameIntoNamespace (const std::string& fullName, const std::string& namespaceName)
+    {
+        auto rootName = std::string (getRootNamespaceName());
+
+        if (startsWith (fullName, rootName + "::"))
+            return TokenisedPathString::join (rootName, TokenisedPathString::join (namespaceName, fullName.substr (rootName.length() + 2)));
+
+        return TokenisedPathString::join (namespaceName, fullName);
+    }
+
     std::string getVariableNameWithQualificationIfNeeded (const Module& context, const heart::Variable& v) const
     {
         if (v.isState())
@@ -255,6 +354,9 @@ struct Program::ProgramImpl  : public RefCountedObject
 
     static Value cloneValue (ModuleCloner::StructMappings& structMappings, const Value& v)
     {
+        if (! v.getType().refersToStruct())
+            return v;
+
         Value newValue (v);
         newValue.getMutableType() = ModuleCloner::cloneType (structMappings, v.getType());
         return newValue;
@@ -271,14 +373,14 @@ Program::Program (Program&&) = default;
 Program& Program::operator= (const Program&) = default;
 Program& Program::operator= (Program&&) = default;
 
-Program Program::createFromHEART (CompileMessageList& messageList, CodeLocation asmCode)
+Program Program::createFromHEART (CompileMessageList& messageList, CodeLocation asmCode, uint32_t numThreads)
 {
     try
     {
         CompileMessageHandler handler (messageList);
-        auto program = heart::Parser::parse (std::move (asmCode));
+        auto program = heart::Parser::parse (std::move (asmCode), numThreads);
 
-        heart::Checker::sanityCheck (program);
+        heart::Checker::sanityCheck (program, numThreads);
 
         return program;
     }
@@ -287,10 +389,56 @@ Program Program::createFromHEART (CompileMessageList& messageList, CodeLocation
     return {};
 }
 
+Program Program::createFromTrustedHEART (CompileMessageList& messageList, CodeLocation asmCode, uint32_t numThreads)
+{
+    try
+    {
+        CompileMessageHandler handler (messageList);
+        return heart::Parser::parse (std::move (asmCode), numThreads);
+    }
+    catch (AbortCompilationException) {}
+
+    return {};
+}
+
+std::string Program::toCpp (CompileMessageList& messageList, const BuildSettings& settings, const std::string& className) const
+{
+    try
+    {
+        CompileMessageHandler handler (messageList);
+        auto program = clone();
+        return CppGenerator::generate (program, settings, className);
+    }
+    catch (AbortCompilationException) {}
+
+    return {};
+}
+
+Program Program::createFromBinary (CompileMessageList& messageList, const void* data, size_t size)
+{
+    try
+    {
+        CompileMessageHandler handler (messageList);
+        return heart::BinaryFormat::read (data, size);
+    }
+    catch (AbortCompilationException) {}
+
+    return {};
+}
+
+Program Program::createChain (CompileMessageList& messageList, const std::vector<Program>& programs,
+                              const std::vector<std::string>& stageNames)
+{
+    return ProgramChain::create (messageList, programs, stageNames);
+}
+
 Program Program::clone() const                                                          { return pimpl->clone(); }
+Module& Program::addCopyOfProgram (const Program& source, const std::string& namespaceName) { return pimpl->addCopyOfProgram (*source.pimpl, namespaceName); }
 bool Program::isEmpty() const                                                           { return getModules().empty(); }
 Program::operator bool() const                                                          { return ! isEmpty(); }
-std::string Program::toHEART() const                                                    { return heart::Printer::getDump (*this); }
+std::string Program::toHEART (uint32_t numThreads) const                                { return heart::Printer::getDump (*this, numThreads); }
+void Program::writeHEART (const std::function<void(std::string_view)>& output, uint32_t numThreads) const  { heart::Printer::write (*this, output, numThreads); }
+std::vector<uint8_t> Program::toBinary() const                                          { return heart::BinaryFormat::write (*this); }
 const std::vector<pool_ref<Module>>& Program::getModules() const                        { return pimpl->modules; }
 void Program::removeModule (Module& module)                                             { return pimpl->removeModule (module); }
 
@@ -311,15 +459,28 @@ ConstantTable& Program::getConstantTable()
 const ConstantTable& Program::getConstantTable() const                                  { return pimpl->constantTable; }
 std::vector<pool_ref<heart::Variable>> Program::getExternalVariables() const            { return pimpl->getExternalVariables(); }
 uint32_t Program::getModuleID (Module& m, uint32_t arraySize)                           { return pimpl->getModuleID (m, arraySize); }
+Program::CostEstimate Program::getCostEstimate (const Module& m) const                  { return CostEstimator::estimate (*this, m); }
 const char* Program::getRootNamespaceName()                                             { return "_root"; }
 std::string Program::stripRootNamespaceFromQualifiedPath (std::string path)             { return TokenisedPathString::removeTopLevelNameIfPresent (path, getRootNamespaceName()); }
 
+Program::MemoryUsage Program::getMemoryUsage() const
+{
+    auto& pool = pimpl->allocator.pool;
+
+    MemoryUsage m;
+    m.poolBytesAllocated    = pool.getNumBytesAllocated();
+    m.poolBytesUsed         = pool.getNumBytesUsed();
+    m.numPoolObjects        = pool.getNumAllocations();
+    m.identifierBytes       = pimpl->allocator.identifiers.getMemoryUsage();
+    m.constantTableBytes    = pimpl->constantTable.getMemoryUsage();
+    m.stringDictionaryBytes = pimpl->stringDictionary.getMemoryUsage();
+    return m;
+}
+
 std::string Program::getHash() const
 {
-    choc::text::CodePrinter dump;
-    heart::Printer::print (*this, dump);
     HashBuilder hash;
-    hash << dump.toString();
+    heart::Printer::write (*this, [&] (std::string_view chunk) { hash << ArrayView<char> (chunk.data(), chunk.size()); });
     return hash.toString();
 }
 
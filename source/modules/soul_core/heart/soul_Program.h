@@ -44,16 +44,76 @@ public:
     /** Returns a deep copy of this program. */
     Program clone() const;
 
+    /** Adds deep copies of all the modules in another program to this one, moving them into
+        a namespace so that their names can't clash with the modules that are already here.
+        Any constants and strings that they use are added to this program's tables. None of the
+        copies will be marked as the main processor, so the module which was the main processor
+        of the source program is returned, to let the caller create an instance of it.
+    */
+    Module& addCopyOfProgram (const Program& source, const std::string& namespaceName);
+
+    /** Combines a list of programs into one whose main processor is a graph that feeds the
+        stream outputs of each program into the stream inputs of the next. This lets a chain
+        of patches be linked as a single performer. The stage names are used for the graph's
+        nodes, and as a prefix for the endpoints of each stage which are exposed by the graph.
+        If the programs can't be combined, this returns an empty program and adds an error to
+        the list.
+        @see ProgramChain
+    */
+    static Program createChain (CompileMessageList&, const std::vector<Program>& programs,
+                                const std::vector<std::string>& stageNames);
+
     //==============================================================================
     /** Creates a dump of this program as HEART code.
+        If numThreads is more than 1, its modules are printed in parallel on that many threads,
+        which gives the same result.
         @see createFromHEART()
     */
-    std::string toHEART() const;
+    std::string toHEART (uint32_t numThreads = 1) const;
+
+    /** Writes this program as HEART code, passing it to a function in chunks rather than
+        building it all as a single string. This is handy for sending a big program
+        straight to a file.
+        @see toHEART()
+    */
+    void writeHEART (const std::function<void(std::string_view)>&, uint32_t numThreads = 1) const;
+
+    /** Generates the source code for a self-contained C++ class with the given name, which renders
+        this program at the sample rate in the build settings. This lets a program be compiled
+        ahead of time for a target that can't run a JIT. If any part of the program can't be
+        translated, this returns an empty string and adds an error to the list.
+        @see CppGenerator
+    */
+    std::string toCpp (CompileMessageList&, const BuildSettings&, const std::string& className) const;
 
     /** Converts a chunk of HEART code that was emitted by toHEART() back to a Program.
-        @see toString()
+        The program is sanity-checked after it has been parsed, and if numThreads is more than 1,
+        the parsing of its function bodies and the checks on its functions are shared out between
+        that many threads.
+        @see toString(), createFromTrustedHEART()
+    */
+    static Program createFromHEART (CompileMessageList&, CodeLocation heartCode, uint32_t numThreads = 1);
+
+    /** Converts some HEART code back to a Program without sanity-checking it.
+        This is for loading HEART which this library produced itself (e.g. from a cache), and
+        which has already passed the checks. Only syntax errors are reported, so using this on
+        HEART from any other source could produce a program that fails in unexpected ways.
+        If numThreads is more than 1, the function bodies are parsed on that many threads.
+        @see createFromHEART
+    */
+    static Program createFromTrustedHEART (CompileMessageList&, CodeLocation heartCode, uint32_t numThreads = 1);
+
+    /** Serialises this program into a compact binary form which can be restored
+        much more quickly than HEART code, but which isn't portable between versions.
+        @see createFromBinary()
     */
-    static Program createFromHEART (CompileMessageList&, CodeLocation heartCode);
+    std::vector<uint8_t> toBinary() const;
+
+    /** Restores a program from some data that was created by toBinary().
+        If the data isn't valid, this returns an empty program and adds an error to the list.
+        @see toBinary()
+    */
+    static Program createFromBinary (CompileMessageList&, const void* data, size_t size);
 
     //==============================================================================
     /** Return true if the program contains no modules. */
@@ -115,6 +175,59 @@ public:
     */
     uint32_t getModuleID (Module&, uint32_t arraySize);
 
+    //==============================================================================
+    /** A static estimate of how much memory and processing a processor or graph needs.
+        @see getCostEstimate()
+    */
+    struct CostEstimate
+    {
+        /** Used for the operation counts when they can't be bounded, e.g. because the code
+            contains a loop whose number of iterations depends on run-time values.
+        */
+        static constexpr uint64_t unbounded = std::numeric_limits<uint64_t>::max();
+
+        /** The number of bytes of state that an instance needs, including any delay lines in a graph. */
+        uint64_t stateSize = 0;
+
+        /** An upper bound on the number of operations needed to render a single frame. */
+        uint64_t maxOperationsPerFrame = 0;
+
+        /** An upper bound on the number of operations needed to handle a single incoming event. */
+        uint64_t maxOperationsPerEvent = 0;
+    };
+
+    /** Works out the cost of one of the processors or graphs in this program, without running it.
+        The operation counts are a worst case which assumes that every branch of the code is taken,
+        so they're only useful as a rough guide to how the cost of different programs compares.
+        @see CostEstimator
+    */
+    CostEstimate getCostEstimate (const Module&) const;
+
+    //==============================================================================
+    /** The number of bytes used by a program's data structures.
+        @see getMemoryUsage()
+    */
+    struct MemoryUsage
+    {
+        /** The total size of the blocks allocated by the pool which holds the program's modules,
+            functions, variables, etc, and the number of those bytes that are in use.
+        */
+        uint64_t poolBytesAllocated = 0, poolBytesUsed = 0;
+
+        /** The number of objects in the pool. */
+        uint64_t numPoolObjects = 0;
+
+        /** Estimates of the space taken by the program's identifiers, its constant table
+            (including the data of its constant arrays and external data), and its string dictionary.
+        */
+        uint64_t identifierBytes = 0, constantTableBytes = 0, stringDictionaryBytes = 0;
+
+        uint64_t getTotal() const   { return poolBytesAllocated + identifierBytes + constantTableBytes + stringDictionaryBytes; }
+    };
+
+    /** Measures the memory used by this program. */
+    MemoryUsage getMemoryUsage() const;
+
     //==============================================================================
     /** Returns the allocator used to hold all items in the program and its modules. */
     heart::Allocator& getAllocator();
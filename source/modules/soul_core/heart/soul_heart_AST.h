@@ -72,8 +72,11 @@ struct heart
 
     struct Parser;
     struct Printer;
+    struct BinaryFormat;
     struct Checker;
     struct Utilities;
+    struct FlatFunction;
+    struct UseDefChains;
 
     static constexpr const char* getRunFunctionName()               { return "run"; }
     static constexpr const char* getUserInitFunctionName()          { return "init"; }
@@ -92,6 +95,14 @@ struct heart
         Allocator (const Allocator&) = delete;
         Allocator (Allocator&&) = default;
 
+        /** Creates an allocator for use on a worker thread. Objects are allocated from its own
+            pool, which can be absorbed into the parent's pool when the worker has finished, but
+            its identifiers come from the parent's pool (under the given lock, which all the
+            parent's workers must share) so that they can be compared with the parent's.
+        */
+        Allocator (Allocator& parentAllocator, std::mutex& parentLock)
+            : identifierSource (std::addressof (parentAllocator)), identifierLock (std::addressof (parentLock)) {}
+
         template <typename Type, typename... Args>
         Type& allocate (Args&&... args)                       { return pool.allocate<Type> (std::forward<Args> (args)...); }
 
@@ -101,10 +112,23 @@ struct heart
         Constant& allocateZeroInitialiser (const Type& type)  { return allocateConstant (Value::zeroInitialiser (type)); }
 
         template <typename Type>
-        Identifier get (const Type& newString)  { return identifiers.get (newString); }
+        Identifier get (const Type& newString)
+        {
+            if (identifierSource != nullptr)
+            {
+                std::lock_guard<std::mutex> lock (*identifierLock);
+                return identifierSource->identifiers.get (newString);
+            }
+
+            return identifiers.get (newString);
+        }
 
         PoolAllocator pool;
         Identifier::Pool identifiers;
+
+    private:
+        Allocator* identifierSource = nullptr;
+        std::mutex* identifierLock = nullptr;
     };
 
     //==============================================================================
@@ -292,7 +316,7 @@ struct heart
 
         InterpolationType interpolationType = InterpolationType::none;
         pool_ptr<ProcessorInstance> sourceProcessor, destProcessor;
-        std::string sourceEndpoint, destEndpoint;
+        Identifier sourceEndpoint, destEndpoint;
         std::optional<size_t> sourceEndpointIndex, destEndpointIndex;
         int64_t delayLength = 0;
     };
@@ -741,6 +765,11 @@ struct heart
         bool functionUseTestFlag = false;
         uint64_t localVariableStackSize = 0;
 
+        /** An optional flattened copy of the blocks, which is only valid until they're next modified.
+            @see FlatFunction
+        */
+        std::shared_ptr<const FlatFunction> flatBody;
+
         pool_ptr<Block> findBlockByName (const std::string& blockName) const
         {
             for (auto b : blocks)
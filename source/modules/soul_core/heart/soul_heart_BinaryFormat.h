@@ -0,0 +1,1394 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul
+{
+
+//==============================================================================
+/**
+    Converts a Program to and from a compact binary form.
+
+    Unlike HEART text, this format isn't meant to be readable or stable across
+    versions: it's for caching a built program so that it can be restored without
+    any tokenising or name resolution. All the strings are pooled into a table at the
+    start of the data, and objects refer to each other by index. Code locations are
+    not stored, so a restored program doesn't refer back to any source code.
+*/
+struct heart::BinaryFormat
+{
+    static std::vector<uint8_t> write (const Program& program)
+    {
+        return Writer (program).write();
+    }
+
+    /** Throws a compile error if the data isn't valid. */
+    static Program read (const void* data, size_t size)
+    {
+        return Reader (static_cast<const uint8_t*> (data), size).read();
+    }
+
+private:
+    static constexpr uint32_t magicNumber = 0x42534c53; // "SLSB"
+    static constexpr uint32_t formatVersion = 1;
+
+    enum class ModuleType : uint8_t  { processor, graph, namespace_ };
+
+    enum class TypeCode : uint8_t
+    {
+        invalid,
+        primitive,
+        vector,
+        fixedSizeArray,
+        unsizedArray,
+        wrap,
+        clamp,
+        structure,
+        stringLiteral
+    };
+
+    enum class ValueEncoding : uint8_t  { invalid, zero, packedData };
+
+    enum class ExpressionType : uint8_t
+    {
+        variable,
+        arrayElement,
+        structElement,
+        constant,
+        typeCast,
+        unaryOperator,
+        binaryOperator,
+        pureFunctionCall,
+        processorProperty
+    };
+
+    #define SOUL_BINARY_ENUM_ITEM(Type)     Type,
+    enum class StatementType : uint8_t   { SOUL_HEART_STATEMENTS (SOUL_BINARY_ENUM_ITEM) };
+    enum class TerminatorType : uint8_t  { SOUL_HEART_TERMINATORS (SOUL_BINARY_ENUM_ITEM) };
+    #undef SOUL_BINARY_ENUM_ITEM
+
+    static ModuleType getModuleType (const Module& m)
+    {
+        if (m.isGraph())      return ModuleType::graph;
+        if (m.isNamespace())  return ModuleType::namespace_;
+        return ModuleType::processor;
+    }
+
+    //==============================================================================
+    struct Writer
+    {
+        Writer (const Program& p) : program (p) {}
+
+        std::vector<uint8_t> write()
+        {
+            writeProgram();
+
+            auto body = std::move (data);
+            data.clear();
+            data.reserve (body.size() + 64 * strings.size());
+
+            writeRaw (magicNumber);
+            writeInt (formatVersion);
+            writeInt (strings.size());
+
+            for (auto* s : strings)
+            {
+                writeInt (s->length());
+                data.insert (data.end(), s->begin(), s->end());
+            }
+
+            data.insert (data.end(), body.begin(), body.end());
+            return std::move (data);
+        }
+
+    private:
+        const Program& program;
+        std::vector<uint8_t> data;
+        std::vector<const std::string*> strings;
+        std::unordered_map<std::string, size_t> stringIndexes;
+        std::unordered_map<const Structure*, size_t> structIndexes;
+        std::unordered_map<const heart::Function*, size_t> functionIndexes;
+        std::unordered_map<const heart::Variable*, size_t> variableIndexes;
+        std::unordered_map<const heart::InputDeclaration*, size_t> inputIndexes;
+        std::unordered_map<const heart::OutputDeclaration*, size_t> outputIndexes;
+        std::unordered_map<const heart::ProcessorInstance*, size_t> processorInstanceIndexes;
+        std::unordered_map<const heart::Block*, size_t> blockIndexes;
+
+        void writeProgram()
+        {
+            auto& dictionary = program.getStringDictionary();
+            writeInt (dictionary.strings.size());
+
+            for (auto& s : dictionary.strings)
+            {
+                writeInt (s.handle.handle);
+                writeString (s.text);
+            }
+
+            auto& modules = program.getModules();
+            writeInt (modules.size());
+
+            for (auto& m : modules)
+                writeModuleDeclaration (m);
+
+            // all the struct members must be available before any values are read
+            for (auto& m : modules)
+                writeStructMembers (m);
+
+            for (auto& m : modules)
+                writeModuleContent (m);
+
+            auto& constants = program.getConstantTable();
+            writeInt (constants.size());
+
+            for (auto& c : constants)
+            {
+                writeSignedInt (c.handle);
+                writeValue (*c.value);
+            }
+        }
+
+        void writeModuleDeclaration (const Module& m)
+        {
+            writeEnum (getModuleType (m));
+            writeString (m.shortName);
+            writeString (m.fullName);
+            writeString (m.originalFullName);
+            writeRaw (m.sampleRate);
+
+            writeInt (m.structs.size());
+
+            for (auto& s : m.structs)
+            {
+                auto index = structIndexes.size();
+                structIndexes[s.get()] = index;
+                writeString (s->getName());
+            }
+
+            writeInt (m.functions.size());
+
+            for (auto& f : m.functions)
+            {
+                auto index = functionIndexes.size();
+                functionIndexes[f.getPointer()] = index;
+            }
+        }
+
+        void writeStructMembers (const Module& m)
+        {
+            for (auto& s : m.structs)
+            {
+                writeInt (s->getNumMembers());
+
+                for (auto& member : s->getMembers())
+                {
+                    writeType (member.type);
+                    writeString (member.name);
+                }
+            }
+        }
+
+        void writeModuleContent (const Module& m)
+        {
+            writeAnnotation (m.annotation);
+
+            writeInt (m.inputs.size());
+
+            for (auto& i : m.inputs)
+            {
+                auto index = inputIndexes.size();
+                inputIndexes[i.getPointer()] = index;
+                writeIODeclaration (i);
+            }
+
+            writeInt (m.outputs.size());
+
+            for (auto& o : m.outputs)
+            {
+                auto index = outputIndexes.size();
+                outputIndexes[o.getPointer()] = index;
+                writeIODeclaration (o);
+            }
+
+            writeInt (m.processorInstances.size());
+
+            for (auto& p : m.processorInstances)
+            {
+                auto index = processorInstanceIndexes.size();
+                processorInstanceIndexes[p.getPointer()] = index;
+                writeString (p->instanceName);
+                writeString (p->sourceName);
+                writeSignedInt (p->clockMultiplier);
+                writeSignedInt (p->clockDivider);
+                writeInt (p->arraySize);
+            }
+
+            writeInt (m.connections.size());
+
+            for (auto& c : m.connections)
+            {
+                writeEnum (c->interpolationType);
+                writeProcessorInstanceRef (c->sourceProcessor);
+                writeString (c->sourceEndpoint);
+                writeOptionalInt (c->sourceEndpointIndex);
+                writeProcessorInstanceRef (c->destProcessor);
+                writeString (c->destEndpoint);
+                writeOptionalInt (c->destEndpointIndex);
+                writeSignedInt (c->delayLength);
+            }
+
+            writeInt (m.stateVariables.size());
+
+            for (auto& v : m.stateVariables)
+                writeVariableRef (v);
+
+            for (auto& f : m.functions)
+                writeFunction (f);
+        }
+
+        void writeIODeclaration (const heart::IODeclaration& io)
+        {
+            writeString (io.name);
+            writeInt (io.index);
+            writeEnum (io.endpointType);
+            writeInt (io.dataTypes.size());
+
+            for (auto& t : io.dataTypes)
+                writeType (t);
+
+            writeOptionalInt (io.arraySize);
+            writeAnnotation (io.annotation);
+        }
+
+        void writeProcessorInstanceRef (pool_ptr<heart::ProcessorInstance> p)
+        {
+            writeInt (p == nullptr ? 0 : processorInstanceIndexes.at (p.get()) + 1);
+        }
+
+        void writeFunction (const heart::Function& f)
+        {
+            blockIndexes.clear();
+
+            writeType (f.returnType);
+            writeString (f.name);
+            writeEnum (f.functionType.type);
+            writeEnum (f.intrinsicType);
+            writeBool (f.isExported);
+            writeBool (f.hasNoBody);
+            writeInt (f.localVariableStackSize);
+            writeAnnotation (f.annotation);
+
+            writeInt (f.parameters.size());
+
+            for (auto& p : f.parameters)
+                writeVariableRef (p);
+
+            writeInt (getParameterIndex (f, f.stateParameter));
+            writeInt (getParameterIndex (f, f.ioParameter));
+
+            writeInt (f.blocks.size());
+
+            for (auto& b : f.blocks)
+            {
+                auto index = blockIndexes.size();
+                blockIndexes[b.getPointer()] = index;
+                writeString (b->name);
+            }
+
+            for (auto& b : f.blocks)
+                writeBlock (b);
+        }
+
+        static size_t getParameterIndex (const heart::Function& f, pool_ptr<heart::Variable> v)
+        {
+            if (v != nullptr)
+                for (size_t i = 0; i < f.parameters.size(); ++i)
+                    if (f.parameters[i] == v)
+                        return i + 1;
+
+            return 0;
+        }
+
+        void writeBlock (const heart::Block& b)
+        {
+            writeBool (b.doNotOptimiseAway);
+            writeInt (b.parameters.size());
+
+            for (auto& p : b.parameters)
+                writeVariableRef (p);
+
+            size_t numStatements = 0;
+
+            for (auto s : b.statements)
+            {
+                (void) s;
+                ++numStatements;
+            }
+
+            writeInt (numStatements);
+
+            for (auto s : b.statements)
+                writeStatement (*s);
+
+            SOUL_ASSERT (b.isTerminated());
+            writeTerminator (*b.terminator);
+        }
+
+        void writeBlockRef (const heart::Block& b)
+        {
+            writeInt (blockIndexes.at (std::addressof (b)));
+        }
+
+        void writeStatement (const heart::Statement& s)
+        {
+            if (auto a = cast<const heart::AssignFromValue> (s))
+            {
+                writeEnum (StatementType::AssignFromValue);
+                writeExpression (*a->target);
+                writeExpression (a->source);
+                return;
+            }
+
+            if (auto fc = cast<const heart::FunctionCall> (s))
+            {
+                writeEnum (StatementType::FunctionCall);
+                writeOptionalExpression (fc->target);
+                writeFunctionRef (fc->getFunction());
+                writeExpressionList (fc->arguments);
+                return;
+            }
+
+            if (auto r = cast<const heart::ReadStream> (s))
+            {
+                writeEnum (StatementType::ReadStream);
+                writeExpression (*r->target);
+                writeInt (inputIndexes.at (r->source.getPointer()));
+                return;
+            }
+
+            if (auto w = cast<const heart::WriteStream> (s))
+            {
+                writeEnum (StatementType::WriteStream);
+                writeInt (outputIndexes.at (w->target.getPointer()));
+                writeOptionalExpression (w->element);
+                writeExpression (w->value);
+                return;
+            }
+
+            SOUL_ASSERT (is_type<const heart::AdvanceClock> (s));
+            writeEnum (StatementType::AdvanceClock);
+        }
+
+        void writeTerminator (const heart::Terminator& t)
+        {
+            if (auto b = cast<const heart::Branch> (t))
+            {
+                writeEnum (TerminatorType::Branch);
+                writeBlockRef (b->target);
+                writeExpressionList (b->targetArgs);
+                return;
+            }
+
+            if (auto b = cast<const heart::BranchIf> (t))
+            {
+                writeEnum (TerminatorType::BranchIf);
+                writeExpression (b->condition);
+                writeBlockRef (b->targets[0]);
+                writeBlockRef (b->targets[1]);
+                writeExpressionList (b->targetArgs[0]);
+                writeExpressionList (b->targetArgs[1]);
+                return;
+            }
+
+            if (auto r = cast<const heart::ReturnValue> (t))
+            {
+                writeEnum (TerminatorType::ReturnValue);
+                writeExpression (r->returnValue);
+                return;
+            }
+
+            SOUL_ASSERT (is_type<const heart::ReturnVoid> (t));
+            writeEnum (TerminatorType::ReturnVoid);
+        }
+
+        template <typename ListType>
+        void writeExpressionList (const ListType& list)
+        {
+            writeInt (list.size());
+
+            for (auto& e : list)
+                writeExpression (e);
+        }
+
+        void writeOptionalExpression (pool_ptr<heart::Expression> e)
+        {
+            writeBool (e != nullptr);
+
+            if (e != nullptr)
+                writeExpression (*e);
+        }
+
+        void writeExpression (const heart::Expression& e)
+        {
+            if (auto v = cast<const heart::Variable> (e))
+            {
+                writeEnum (ExpressionType::variable);
+                return writeVariableRef (*v);
+            }
+
+            if (auto c = cast<const heart::Constant> (e))
+            {
+                writeEnum (ExpressionType::constant);
+                return writeValue (c->value);
+            }
+
+            if (auto a = cast<const heart::ArrayElement> (e))
+            {
+                writeEnum (ExpressionType::arrayElement);
+                writeExpression (a->parent);
+                writeOptionalExpression (a->dynamicIndex);
+                writeInt (a->fixedStartIndex);
+                writeInt (a->fixedEndIndex);
+                writeBool (a->isRangeTrusted);
+                writeBool (a->suppressWrapWarning);
+                return;
+            }
+
+            if (auto s = cast<const heart::StructElement> (e))
+            {
+                writeEnum (ExpressionType::structElement);
+                writeExpression (s->parent);
+                writeString (s->memberName);
+                return;
+            }
+
+            if (auto t = cast<const heart::TypeCast> (e))
+            {
+                writeEnum (ExpressionType::typeCast);
+                writeExpression (t->source);
+                writeType (t->destType);
+                return;
+            }
+
+            if (auto u = cast<const heart::UnaryOperator> (e))
+            {
+                writeEnum (ExpressionType::unaryOperator);
+                writeExpression (u->source);
+                writeEnum (u->operation);
+                return;
+            }
+
+            if (auto b = cast<const heart::BinaryOperator> (e))
+            {
+                writeEnum (ExpressionType::binaryOperator);
+                writeExpression (b->lhs);
+                writeExpression (b->rhs);
+                writeEnum (b->operation);
+                return;
+            }
+
+            if (auto fc = cast<const heart::PureFunctionCall> (e))
+            {
+                writeEnum (ExpressionType::pureFunctionCall);
+                writeFunctionRef (fc->function);
+                writeExpressionList (fc->arguments);
+                return;
+            }
+
+            auto pp = cast<const heart::ProcessorProperty> (e);
+            SOUL_ASSERT (pp != nullptr);
+            writeEnum (ExpressionType::processorProperty);
+            writeEnum (pp->property);
+        }
+
+        void writeFunctionRef (const heart::Function& f)
+        {
+            writeInt (functionIndexes.at (std::addressof (f)));
+        }
+
+        // Variables are written in full the first time they're referenced, and by index after that
+        void writeVariableRef (const heart::Variable& v)
+        {
+            auto existing = variableIndexes.find (std::addressof (v));
+
+            if (existing != variableIndexes.end())
+                return writeInt (existing->second);
+
+            auto index = variableIndexes.size();
+            variableIndexes[std::addressof (v)] = index;
+            writeInt (index);
+
+            writeType (v.type);
+            writeBool (v.name.isValid());
+
+            if (v.name.isValid())
+                writeString (v.name);
+
+            writeEnum (v.role);
+            writeSignedInt (v.externalHandle);
+            writeAnnotation (v.annotation);
+        }
+
+        void writeType (const Type& t)
+        {
+            writeRaw (static_cast<uint8_t> ((t.isConst() ? 1 : 0) | (t.isReference() ? 2 : 0)));
+
+            if (t.isStringLiteral())
+                return writeEnum (TypeCode::stringLiteral);
+
+            if (t.isStruct())
+            {
+                writeEnum (TypeCode::structure);
+                return writeInt (structIndexes.at (t.getStruct().get()));
+            }
+
+            if (t.isBoundedInt())
+            {
+                writeEnum (t.isWrapped() ? TypeCode::wrap : TypeCode::clamp);
+                return writeSignedInt (t.getBoundedIntLimit());
+            }
+
+            if (t.isVector())
+            {
+                writeEnum (TypeCode::vector);
+                writeEnum (t.getVectorElementType().type);
+                return writeInt (t.getVectorSize());
+            }
+
+            if (t.isUnsizedArray())
+            {
+                writeEnum (TypeCode::unsizedArray);
+                return writeType (t.getArrayElementType());
+            }
+
+            if (t.isFixedSizeArray())
+            {
+                writeEnum (TypeCode::fixedSizeArray);
+                writeType (t.getArrayElementType());
+                return writeInt (t.getArraySize());
+            }
+
+            if (t.isPrimitive())
+            {
+                writeEnum (TypeCode::primitive);
+                return writeEnum (t.getPrimitiveType().type);
+            }
+
+            SOUL_ASSERT (! t.isValid());
+            writeEnum (TypeCode::invalid);
+        }
+
+        void writeValue (const Value& v)
+        {
+            if (! v.isValid())
+                return writeEnum (ValueEncoding::invalid);
+
+            // large zero-initialised arrays are common, so avoid storing their content
+            if (v.getPackedDataSize() != 0 && v.isZero())
+            {
+                writeEnum (ValueEncoding::zero);
+                return writeType (v.getType());
+            }
+
+            writeEnum (ValueEncoding::packedData);
+            writeType (v.getType());
+            writeInt (v.getPackedDataSize());
+            writeBytes (v.getPackedData(), v.getPackedDataSize());
+        }
+
+        void writeAnnotation (const Annotation& a)
+        {
+            writeInt (a.size());
+
+            if (a.isEmpty())
+                return;
+
+            auto& dictionary = a.getDictionary();
+            writeInt (dictionary.strings.size());
+
+            for (auto& s : dictionary.strings)
+            {
+                writeInt (s.handle.handle);
+                writeString (s.text);
+            }
+
+            for (auto& name : a.getNames())
+            {
+                writeString (name);
+                writeValue (a.getValue (name));
+            }
+        }
+
+        void writeString (const std::string& s)
+        {
+            auto found = stringIndexes.find (s);
+
+            if (found != stringIndexes.end())
+                return writeInt (found->second);
+
+            auto index = strings.size();
+            auto& entry = *stringIndexes.emplace (s, index).first;
+            strings.push_back (std::addressof (entry.first));
+            writeInt (index);
+        }
+
+        template <typename OptionalType>
+        void writeOptionalInt (const OptionalType& o)
+        {
+            writeInt (o.has_value() ? static_cast<uint64_t> (*o) + 1 : 0);
+        }
+
+        void writeBool (bool b)      { data.push_back (b ? 1 : 0); }
+
+        void writeInt (uint64_t n)
+        {
+            while (n >= 0x80)
+            {
+                data.push_back (static_cast<uint8_t> (n | 0x80));
+                n >>= 7;
+            }
+
+            data.push_back (static_cast<uint8_t> (n));
+        }
+
+        void writeSignedInt (int64_t n)
+        {
+            writeInt ((static_cast<uint64_t> (n) << 1) ^ static_cast<uint64_t> (n >> 63));
+        }
+
+        template <typename EnumType>
+        void writeEnum (EnumType value)
+        {
+            writeInt (static_cast<uint64_t> (value));
+        }
+
+        template <typename Type>
+        void writeRaw (Type value)
+        {
+            writeBytes (std::addressof (value), sizeof (value));
+        }
+
+        void writeBytes (const void* source, size_t size)
+        {
+            auto bytes = static_cast<const uint8_t*> (source);
+            data.insert (data.end(), bytes, bytes + size);
+        }
+    };
+
+    //==============================================================================
+    struct Reader
+    {
+        Reader (const uint8_t* d, size_t size) : data (d), end (d + size) {}
+
+        Program read()
+        {
+            if (readRaw<uint32_t>() != magicNumber || readInt() != formatVersion)
+                fail();
+
+            auto numStrings = readSize();
+            strings.reserve (numStrings);
+
+            for (size_t i = 0; i < numStrings; ++i)
+            {
+                auto length = readSize();
+                auto start = reinterpret_cast<const char*> (data);
+                skip (length);
+                strings.emplace_back (start, length);
+            }
+
+            identifiers.resize (numStrings);
+            readProgram();
+
+            if (data != end)
+                fail();
+
+            for (auto& m : program.getModules())
+            {
+                m->rebuildBlockPredecessors();
+                m->rebuildVariableUseCounts();
+            }
+
+            return program;
+        }
+
+    private:
+        const uint8_t* data;
+        const uint8_t* const end;
+        Program program;
+        std::vector<std::string> strings;
+        std::vector<Identifier> identifiers;
+        std::vector<StructurePtr> structs;
+        std::vector<pool_ref<heart::Function>> functions;
+        std::vector<pool_ref<heart::Variable>> variables;
+        std::vector<pool_ref<heart::InputDeclaration>> inputs;
+        std::vector<pool_ref<heart::OutputDeclaration>> outputs;
+        std::vector<pool_ref<heart::ProcessorInstance>> processorInstances;
+        std::vector<pool_ref<heart::Block>> blocks;
+
+        [[noreturn]] static void fail()
+        {
+            CodeLocation().throwError (Errors::invalidBinaryProgram());
+        }
+
+        void readProgram()
+        {
+            readStringDictionary (program.getStringDictionary());
+
+            auto numModules = readSize();
+            std::vector<pool_ref<Module>> modules;
+
+            for (size_t i = 0; i < numModules; ++i)
+                modules.push_back (readModuleDeclaration());
+
+            for (auto& m : modules)
+                readStructMembers (m);
+
+            for (auto& m : modules)
+                readModuleContent (m);
+
+            auto& constants = program.getConstantTable();
+            auto numConstants = readSize();
+
+            for (size_t i = 0; i < numConstants; ++i)
+            {
+                auto handle = static_cast<ConstantTable::Handle> (readSignedInt());
+                constants.addItem ({ handle, std::make_unique<Value> (readValue()) });
+            }
+        }
+
+        void readStringDictionary (StringDictionary& dictionary)
+        {
+            auto numItems = readSize();
+
+            for (size_t i = 0; i < numItems; ++i)
+            {
+                auto handle = static_cast<uint32_t> (readInt());
+                dictionary.addItem ({ { handle }, readString() });
+            }
+        }
+
+        Module& readModuleDeclaration()
+        {
+            auto type = readEnum<ModuleType> (ModuleType::namespace_);
+
+            auto& m = type == ModuleType::graph      ? program.addGraph()
+                    : type == ModuleType::namespace_ ? program.addNamespace()
+                                                     : program.addProcessor();
+
+            m.shortName = readString();
+            m.fullName = readString();
+            m.originalFullName = readString();
+            m.sampleRate = readRaw<double>();
+
+            auto numStructs = readSize();
+
+            for (size_t i = 0; i < numStructs; ++i)
+                structs.push_back (m.addStruct (readString()));
+
+            auto numFunctions = readSize();
+
+            for (size_t i = 0; i < numFunctions; ++i)
+            {
+                auto& f = m.allocate<heart::Function>();
+                m.functions.push_back (f);
+                functions.push_back (f);
+            }
+
+            return m;
+        }
+
+        void readStructMembers (Module& m)
+        {
+            for (auto& s : m.structs)
+            {
+                auto numMembers = readSize();
+
+                for (size_t i = 0; i < numMembers; ++i)
+                {
+                    auto type = readType();
+                    s->addMember (std::move (type), readString());
+                }
+            }
+        }
+
+        void readModuleContent (Module& m)
+        {
+            m.annotation = readAnnotation();
+
+            auto numInputs = readSize();
+
+            for (size_t i = 0; i < numInputs; ++i)
+            {
+                auto& io = m.allocate<heart::InputDeclaration> (CodeLocation());
+                readIODeclaration (io);
+                m.inputs.push_back (io);
+                inputs.push_back (io);
+            }
+
+            auto numOutputs = readSize();
+
+            for (size_t i = 0; i < numOutputs; ++i)
+            {
+                auto& io = m.allocate<heart::OutputDeclaration> (CodeLocation());
+                readIODeclaration (io);
+                m.outputs.push_back (io);
+                outputs.push_back (io);
+            }
+
+            auto numProcessorInstances = readSize();
+
+            for (size_t i = 0; i < numProcessorInstances; ++i)
+            {
+                auto& p = m.allocate<heart::ProcessorInstance>();
+                p.instanceName = readString();
+                p.sourceName = readString();
+                p.clockMultiplier = readSignedInt();
+                p.clockDivider = readSignedInt();
+                p.arraySize = static_cast<uint32_t> (readInt());
+                m.processorInstances.push_back (p);
+                processorInstances.push_back (p);
+            }
+
+            auto numConnections = readSize();
+
+            for (size_t i = 0; i < numConnections; ++i)
+            {
+                auto& c = m.allocate<heart::Connection> (CodeLocation());
+                c.interpolationType = readEnum<InterpolationType> (InterpolationType::best);
+                c.sourceProcessor = readProcessorInstanceRef();
+                c.sourceEndpoint = program.getAllocator().get (readString());
+                c.sourceEndpointIndex = readOptionalInt<size_t>();
+                c.destProcessor = readProcessorInstanceRef();
+                c.destEndpoint = program.getAllocator().get (readString());
+                c.destEndpointIndex = readOptionalInt<size_t>();
+                c.delayLength = readSignedInt();
+                m.connections.push_back (c);
+            }
+
+            auto numStateVariables = readSize();
+
+            for (size_t i = 0; i < numStateVariables; ++i)
+                m.stateVariables.push_back (readVariableRef (m));
+
+            for (auto& f : m.functions)
+                readFunction (m, f);
+        }
+
+        void readIODeclaration (heart::IODeclaration& io)
+        {
+            io.name = getIdentifier (readStringIndex());
+            io.index = static_cast<uint32_t> (readInt());
+            io.endpointType = readEnum<EndpointType> (EndpointType::event);
+
+            auto numTypes = readSize();
+
+            for (size_t i = 0; i < numTypes; ++i)
+                io.dataTypes.push_back (readType());
+
+            io.arraySize = readOptionalInt<uint32_t>();
+            io.annotation = readAnnotation();
+        }
+
+        pool_ptr<heart::ProcessorInstance> readProcessorInstanceRef()
+        {
+            auto index = readIndex (processorInstances.size() + 1);
+
+            if (index == 0)
+                return {};
+
+            return processorInstances[index - 1];
+        }
+
+        void readFunction (Module& m, heart::Function& f)
+        {
+            blocks.clear();
+
+            f.returnType = readType();
+            f.name = getIdentifier (readStringIndex());
+            f.functionType = { readEnum<heart::FunctionType::Type> (heart::FunctionType::Type::intrinsic) };
+            f.intrinsicType = readEnum<IntrinsicType> (IntrinsicType::shuffle);
+            f.isExported = readBool();
+            f.hasNoBody = readBool();
+            f.localVariableStackSize = readInt();
+            f.annotation = readAnnotation();
+
+            auto numParams = readSize();
+
+            for (size_t i = 0; i < numParams; ++i)
+                f.parameters.push_back (readVariableRef (m));
+
+            if (auto stateParam = readIndex (numParams + 1))
+                f.stateParameter = f.parameters[stateParam - 1];
+
+            if (auto ioParam = readIndex (numParams + 1))
+                f.ioParameter = f.parameters[ioParam - 1];
+
+            auto numBlocks = readSize();
+
+            for (size_t i = 0; i < numBlocks; ++i)
+            {
+                auto name = getIdentifier (readStringIndex());
+
+                if (name.toString()[0] != '@')
+                    fail();
+
+                auto& b = m.allocate<heart::Block> (name);
+                f.blocks.push_back (b);
+                blocks.push_back (b);
+            }
+
+            for (auto& b : f.blocks)
+                readBlock (m, b);
+        }
+
+        void readBlock (Module& m, heart::Block& b)
+        {
+            b.doNotOptimiseAway = readBool();
+
+            auto numParams = readSize();
+
+            for (size_t i = 0; i < numParams; ++i)
+                b.parameters.push_back (readVariableRef (m));
+
+            auto numStatements = readSize();
+            LinkedList<heart::Statement>::Iterator last;
+
+            for (size_t i = 0; i < numStatements; ++i)
+                last = b.statements.insertAfter (last, readStatement (m));
+
+            b.terminator = readTerminator (m);
+        }
+
+        heart::Block& readBlockRef()
+        {
+            return blocks[readIndex (blocks.size())];
+        }
+
+        heart::Statement& readStatement (Module& m)
+        {
+            switch (readEnum<StatementType> (StatementType::AdvanceClock))
+            {
+                case StatementType::AssignFromValue:
+                {
+                    auto& target = readExpression (m);
+                    return m.allocate<heart::AssignFromValue> (CodeLocation(), target, readExpression (m));
+                }
+
+                case StatementType::FunctionCall:
+                {
+                    auto target = readOptionalExpression (m);
+                    auto& fc = m.allocate<heart::FunctionCall> (CodeLocation(), target, readFunctionRef());
+                    readExpressionList (m, fc.arguments);
+                    return fc;
+                }
+
+                case StatementType::ReadStream:
+                {
+                    auto& target = readExpression (m);
+                    return m.allocate<heart::ReadStream> (CodeLocation(), target, inputs[readIndex (inputs.size())]);
+                }
+
+                case StatementType::WriteStream:
+                {
+                    heart::OutputDeclaration& output = outputs[readIndex (outputs.size())];
+                    auto element = readOptionalExpression (m);
+                    return m.allocate<heart::WriteStream> (CodeLocation(), output, element, readExpression (m));
+                }
+
+                case StatementType::AdvanceClock:
+                default:
+                    return m.allocate<heart::AdvanceClock> (CodeLocation());
+            }
+        }
+
+        heart::Terminator& readTerminator (Module& m)
+        {
+            switch (readEnum<TerminatorType> (TerminatorType::ReturnValue))
+            {
+                case TerminatorType::Branch:
+                {
+                    auto& b = m.allocate<heart::Branch> (readBlockRef());
+                    readExpressionList (m, b.targetArgs);
+                    return b;
+                }
+
+                case TerminatorType::BranchIf:
+                {
+                    auto& condition = readExpression (m);
+                    auto& trueBlock = readBlockRef();
+                    auto& falseBlock = readBlockRef();
+
+                    if (std::addressof (trueBlock) == std::addressof (falseBlock))
+                        fail();
+
+                    auto& b = m.allocate<heart::BranchIf> (condition, trueBlock, falseBlock);
+                    readExpressionList (m, b.targetArgs[0]);
+                    readExpressionList (m, b.targetArgs[1]);
+                    return b;
+                }
+
+                case TerminatorType::ReturnValue:
+                    return m.allocate<heart::ReturnValue> (readExpression (m));
+
+                case TerminatorType::ReturnVoid:
+                default:
+                    return m.allocate<heart::ReturnVoid>();
+            }
+        }
+
+        template <typename ListType>
+        void readExpressionList (Module& m, ListType& list)
+        {
+            auto num = readSize();
+
+            for (size_t i = 0; i < num; ++i)
+                list.push_back (readExpression (m));
+        }
+
+        pool_ptr<heart::Expression> readOptionalExpression (Module& m)
+        {
+            if (readBool())
+                return readExpression (m);
+
+            return {};
+        }
+
+        heart::Expression& readExpression (Module& m)
+        {
+            switch (readEnum<ExpressionType> (ExpressionType::processorProperty))
+            {
+                case ExpressionType::variable:
+                    return readVariableRef (m);
+
+                case ExpressionType::constant:
+                    return m.allocate<heart::Constant> (CodeLocation(), readValue());
+
+                case ExpressionType::arrayElement:
+                {
+                    auto& parent = readExpression (m);
+
+                    if (! parent.getType().isArrayOrVector())
+                        fail();
+
+                    auto dynamicIndex = readOptionalExpression (m);
+                    auto start = readSize();
+                    auto& a = m.allocate<heart::ArrayElement> (CodeLocation(), parent, start, static_cast<size_t> (readInt()));
+                    a.dynamicIndex = dynamicIndex;
+                    a.isRangeTrusted = readBool();
+                    a.suppressWrapWarning = readBool();
+                    return a;
+                }
+
+                case ExpressionType::structElement:
+                {
+                    auto& parent = readExpression (m);
+                    auto member = readString();
+
+                    if (! (parent.getType().isStruct() && parent.getType().getStructRef().hasMemberWithName (member)))
+                        fail();
+
+                    return m.allocate<heart::StructElement> (CodeLocation(), parent, std::move (member));
+                }
+
+                case ExpressionType::typeCast:
+                {
+                    auto& source = readExpression (m);
+                    return m.allocate<heart::TypeCast> (CodeLocation(), source, readType());
+                }
+
+                case ExpressionType::unaryOperator:
+                {
+                    auto& source = readExpression (m);
+                    return m.allocate<heart::UnaryOperator> (CodeLocation(), source, readEnum<UnaryOp::Op> (UnaryOp::Op::unknown));
+                }
+
+                case ExpressionType::binaryOperator:
+                {
+                    auto& lhs = readExpression (m);
+                    auto& rhs = readExpression (m);
+                    return m.allocate<heart::BinaryOperator> (CodeLocation(), lhs, rhs, readEnum<BinaryOp::Op> (BinaryOp::Op::unknown));
+                }
+
+                case ExpressionType::pureFunctionCall:
+                {
+                    auto& fc = m.allocate<heart::PureFunctionCall> (CodeLocation(), readFunctionRef());
+                    readExpressionList (m, fc.arguments);
+                    return fc;
+                }
+
+                case ExpressionType::processorProperty:
+                default:
+                {
+                    auto property = readEnum (heart::ProcessorProperty::Property::session);
+                    return m.allocate<heart::ProcessorProperty> (CodeLocation(), property);
+                }
+            }
+        }
+
+        heart::Function& readFunctionRef()
+        {
+            return functions[readIndex (functions.size())];
+        }
+
+        heart::Variable& readVariableRef (Module& m)
+        {
+            auto index = readIndex (variables.size() + 1);
+
+            if (index < variables.size())
+                return variables[index];
+
+            auto type = readType();
+            auto name = readBool() ? getIdentifier (readStringIndex()) : Identifier();
+            auto role = readEnum<heart::Variable::Role> (heart::Variable::Role::external);
+
+            auto& v = m.allocate<heart::Variable> (CodeLocation(), std::move (type), name, role);
+            v.externalHandle = static_cast<ConstantTable::Handle> (readSignedInt());
+            v.annotation = readAnnotation();
+            variables.push_back (v);
+            return v;
+        }
+
+        Type readType()
+        {
+            auto flags = readRaw<uint8_t>();
+            auto isConst = (flags & 1) != 0;
+            auto isRef   = (flags & 2) != 0;
+
+            switch (readEnum<TypeCode> (TypeCode::stringLiteral))
+            {
+                case TypeCode::primitive:       return Type (readPrimitiveType()).withConstAndRefFlags (isConst, isRef);
+                case TypeCode::wrap:            return Type::createWrappedInt (readBoundedIntLimit()).withConstAndRefFlags (isConst, isRef);
+                case TypeCode::clamp:           return Type::createClampedInt (readBoundedIntLimit()).withConstAndRefFlags (isConst, isRef);
+                case TypeCode::structure:       return Type::createStruct (*structs[readIndex (structs.size())]).withConstAndRefFlags (isConst, isRef);
+                case TypeCode::stringLiteral:   return Type::createStringLiteral().withConstAndRefFlags (isConst, isRef);
+                case TypeCode::unsizedArray:    return readArrayElementType().createUnsizedArray().withConstAndRefFlags (isConst, isRef);
+
+                case TypeCode::vector:
+                {
+                    auto elementType = readPrimitiveType();
+                    auto size = readInt();
+
+                    if (! Type::isLegalVectorSize (static_cast<int64_t> (size)))
+                        fail();
+
+                    return Type::createVector (elementType, static_cast<Type::ArraySize> (size)).withConstAndRefFlags (isConst, isRef);
+                }
+
+                case TypeCode::fixedSizeArray:
+                {
+                    auto elementType = readArrayElementType();
+                    auto size = readInt();
+
+                    if (size > Type::maxArraySize)
+                        fail();
+
+                    return elementType.createArray (static_cast<Type::ArraySize> (size)).withConstAndRefFlags (isConst, isRef);
+                }
+
+                case TypeCode::invalid:
+                default:
+                    return {};
+            }
+        }
+
+        Type readArrayElementType()
+        {
+            auto t = readType();
+
+            if (! t.canBeArrayElementType())
+                fail();
+
+            return t;
+        }
+
+        PrimitiveType readPrimitiveType()
+        {
+            return readEnum<PrimitiveType::Primitive> (PrimitiveType::Primitive::bool_);
+        }
+
+        Type::BoundedIntSize readBoundedIntLimit()
+        {
+            auto limit = readSignedInt();
+
+            if (limit <= 0 || limit > std::numeric_limits<Type::BoundedIntSize>::max())
+                fail();
+
+            return static_cast<Type::BoundedIntSize> (limit);
+        }
+
+        Value readValue()
+        {
+            auto encoding = readEnum (ValueEncoding::packedData);
+
+            if (encoding == ValueEncoding::invalid)
+                return {};
+
+            auto type = readType();
+
+            if (! type.isValid())
+                fail();
+
+            if (encoding == ValueEncoding::zero)
+            {
+                if (type.isVoid())
+                    fail();
+
+                return Value::zeroInitialiser (std::move (type));
+            }
+
+            auto size = readSize();
+            auto source = data;
+            skip (size);
+
+            if (size != type.getPackedSizeInBytes())
+                fail();
+
+            return Value::createFromRawData (std::move (type), source, size);
+        }
+
+        Annotation readAnnotation()
+        {
+            Annotation a;
+            auto numProperties = readSize();
+
+            if (numProperties != 0)
+            {
+                StringDictionary dictionary;
+                readStringDictionary (dictionary);
+
+                for (size_t i = 0; i < numProperties; ++i)
+                {
+                    auto name = readString();
+                    a.set (name, readValue(), dictionary);
+                }
+            }
+
+            return a;
+        }
+
+        size_t readStringIndex()
+        {
+            return readIndex (strings.size());
+        }
+
+        const std::string& readString()
+        {
+            return strings[readStringIndex()];
+        }
+
+        Identifier getIdentifier (size_t stringIndex)
+        {
+            auto& i = identifiers[stringIndex];
+
+            if (! i.isValid())
+            {
+                if (strings[stringIndex].empty())
+                    fail();
+
+                i = program.getAllocator().get (strings[stringIndex]);
+            }
+
+            return i;
+        }
+
+        template <typename IntType>
+        std::optional<IntType> readOptionalInt()
+        {
+            if (auto n = readInt())
+                return static_cast<IntType> (n - 1);
+
+            return {};
+        }
+
+        template <typename EnumType>
+        EnumType readEnum (EnumType lastValidValue)
+        {
+            auto value = readInt();
+
+            if (value > static_cast<uint64_t> (lastValidValue))
+                fail();
+
+            return static_cast<EnumType> (value);
+        }
+
+        size_t readIndex (size_t limit)
+        {
+            auto n = readInt();
+
+            if (n >= limit)
+                fail();
+
+            return static_cast<size_t> (n);
+        }
+
+        // Any count must be smaller than the remaining data, which stops a corrupt
+        // file from making us try to allocate something huge
+        size_t readSize()
+        {
+            return readIndex (static_cast<size_t> (end - data) + 1);
+        }
+
+        bool readBool()
+        {
+            return readRaw<uint8_t>() != 0;
+        }
+
+        uint64_t readInt()
+        {
+            uint64_t n = 0;
+
+            for (int shift = 0; shift < 64; shift += 7)
+            {
+                auto byte = readRaw<uint8_t>();
+                n |= static_cast<uint64_t> (byte & 0x7f) << shift;
+
+                if ((byte & 0x80) == 0)
+                    return n;
+            }
+
+            fail();
+        }
+
+        int64_t readSignedInt()
+        {
+            auto n = readInt();
+            return static_cast<int64_t> (n >> 1) ^ -static_cast<int64_t> (n & 1);
+        }
+
+        template <typename Type>
+        Type readRaw()
+        {
+            Type value;
+            auto source = data;
+            skip (sizeof (Type));
+            memcpy (std::addressof (value), source, sizeof (Type));
+            return value;
+        }
+
+        void skip (size_t numBytes)
+        {
+            if (numBytes > static_cast<size_t> (end - data))
+                fail();
+
+            data += numBytes;
+        }
+    };
+};
+
+} // namespace soul
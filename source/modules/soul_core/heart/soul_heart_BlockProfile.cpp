@@ -0,0 +1,148 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul
+{
+
+static constexpr const char* blockCounterPrefix = "_blockCount_";
+static constexpr const char* blockKeyAnnotation = "blockProfileKey";
+
+BlockProfile BlockProfile::fromSettings (const BuildSettings& settings)
+{
+    BlockProfile profile;
+    auto& custom = settings.customSettings;
+
+    if (custom.isObject() && custom.hasObjectMember (profileSetting))
+    {
+        auto source = custom[profileSetting];
+
+        if (source.isObject())
+        {
+            for (uint32_t i = 0; i < source.size(); ++i)
+            {
+                auto member = source.getObjectMemberAt (i);
+                auto count = static_cast<uint64_t> (std::max (static_cast<int64_t> (0), member.value.getWithDefault<int64_t> (0)));
+                profile.counts[member.name] = count;
+                profile.maxCount = std::max (profile.maxCount, count);
+            }
+        }
+    }
+
+    return profile;
+}
+
+void BlockProfile::instrument (Program& program)
+{
+    uint32_t numCounters = 0;
+
+    for (auto& m : program.getModules())
+    {
+        if (! m->isProcessor())
+            continue;
+
+        for (auto& f : m->functions)
+        {
+            if (f->hasNoBody || f->intrinsicType != IntrinsicType::none)
+                continue;
+
+            for (auto& b : f->blocks)
+            {
+                auto& counter = m->allocate<heart::Variable> (CodeLocation(), PrimitiveType::int64,
+                                                              m->allocator.get (blockCounterPrefix + std::to_string (numCounters++)),
+                                                              heart::Variable::Role::state);
+                counter.annotation.set (blockKeyAnnotation, getKey (m, f, b));
+                m->stateVariables.push_back (counter);
+
+                auto& one = m->allocator.allocateConstant (Value::createInt64 (1));
+                auto& increment = m->allocate<heart::BinaryOperator> (CodeLocation(), counter, one, BinaryOp::Op::add);
+                b->statements.insertFront (m->allocate<heart::AssignFromValue> (CodeLocation(), counter, increment));
+            }
+        }
+    }
+}
+
+choc::value::Value BlockProfile::read (const Program& instrumentedProgram, Performer& performer)
+{
+    std::unordered_map<std::string, std::string> keysForCounters;
+    std::vector<std::string> keys;
+
+    for (auto& m : instrumentedProgram.getModules())
+    {
+        for (auto& v : m->stateVariables)
+        {
+            if (v->annotation.hasValue (blockKeyAnnotation))
+            {
+                keys.push_back (v->annotation.getString (blockKeyAnnotation));
+                keysForCounters[v->name.toString()] = keys.back();
+            }
+        }
+    }
+
+    std::vector<uint8_t> state (static_cast<size_t> (performer.getStateSize()));
+
+    if (state.empty() || ! performer.saveState (state.data(), state.size()))
+        return {};
+
+    std::unordered_map<std::string, int64_t> counts;
+
+    for (auto& v : performer.getStateVariables())
+    {
+        // The performer's names are the instance path, then a dot, then the variable's name
+        auto name = v.name.substr (v.name.rfind ('.') + 1);
+        auto key = keysForCounters.find (name);
+
+        if (key != keysForCounters.end() && v.size == sizeof (int64_t) && v.offset + v.size <= state.size())
+            counts[key->second] += readUnaligned<int64_t> (state.data() + v.offset);
+    }
+
+    auto result = choc::value::createObject ("BlockProfile");
+
+    for (auto& key : keys)
+    {
+        auto count = counts.find (key);
+
+        if (count != counts.end())
+            result.addMember (key, count->second);
+    }
+
+    return result;
+}
+
+std::optional<uint64_t> BlockProfile::getCount (const Module& m, const heart::Function& f, const heart::Block& b) const
+{
+    auto found = counts.find (getKey (m, f, b));
+
+    if (found == counts.end())
+        return {};
+
+    return found->second;
+}
+
+double BlockProfile::getRelativeFrequency (uint64_t count) const
+{
+    return maxCount == 0 ? 0.0 : static_cast<double> (count) / static_cast<double> (maxCount);
+}
+
+std::string BlockProfile::getKey (const Module& m, const heart::Function& f, const heart::Block& b)
+{
+    return m.fullName + "/" + f.name.toString() + "/" + b.name.toString();
+}
+
+} // namespace soul
@@ -0,0 +1,73 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul
+{
+
+class Performer;
+
+//==============================================================================
+/**
+    Counts of how many times each block in a program's processors was run, which the
+    optimiser uses to decide which calls to inline and how to lay out each function's blocks.
+
+    To gather a profile, build the program with an "instrumentBlocks" property set to true in
+    BuildSettings::customSettings, which adds a counter to the start of every block. Once the
+    program has been running for a while, read() collects the counts from the performer, and
+    passing the result as a "blockProfile" property in the customSettings of a later build of
+    the same code lets the optimiser favour the blocks that were hot. The counts are matched up
+    by the names of the blocks before optimisation, so both builds must use the same source and
+    optimisation level.
+*/
+struct BlockProfile
+{
+    static constexpr const char* instrumentSetting  = "instrumentBlocks";
+    static constexpr const char* profileSetting     = "blockProfile";
+
+    /** Returns the profile given in some build settings, which is empty if there isn't one. */
+    static BlockProfile fromSettings (const BuildSettings&);
+
+    /** Adds a counter to the start of every block in the program's processors. */
+    static void instrument (Program&);
+
+    /** Collects the counters from a performer which has linked an instrumented program,
+        adding together the counts from all the instances of each processor. The performer
+        mustn't be rendering while this is called.
+        @returns an object which can be used as the "blockProfile" custom setting, or a void
+                 value if the performer can't provide its state.
+    */
+    static choc::value::Value read (const Program& instrumentedProgram, Performer&);
+
+    bool isEmpty() const        { return counts.empty(); }
+
+    /** Returns the number of times a block was run, if it's in the profile. */
+    std::optional<uint64_t> getCount (const Module&, const heart::Function&, const heart::Block&) const;
+
+    /** Returns a count as a proportion of the count of the hottest block in the profile. */
+    double getRelativeFrequency (uint64_t count) const;
+
+private:
+    std::unordered_map<std::string, uint64_t> counts;
+    uint64_t maxCount = 0;
+
+    static std::string getKey (const Module&, const heart::Function&, const heart::Block&);
+};
+
+} // namespace soul
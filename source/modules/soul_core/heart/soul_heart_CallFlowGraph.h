@@ -88,6 +88,83 @@ struct CallFlowGraph
         return results;
     }
 
+    //==============================================================================
+    /** Describes a natural loop in a function's block graph. */
+    struct Loop
+    {
+        pool_ref<heart::Block> header;
+        std::vector<pool_ref<heart::Block>> blocks;  // includes the header, in the function's block order
+        std::unordered_set<const heart::Block*> blockSet;
+
+        /** If the header has just one predecessor from outside the loop, and that block
+            unconditionally branches into the header, this is it.
+        */
+        pool_ptr<heart::Block> preheader;
+
+        bool contains (const heart::Block& b) const     { return blockSet.find (std::addressof (b)) != blockSet.end(); }
+    };
+
+    /** Finds all the natural loops in a function, i.e. the sets of blocks which can reach the
+        source of a back-edge that jumps to a block that dominates it.
+        The function's block predecessor lists must be up to date before calling this, and the
+        results are sorted so that inner loops come before the loops that enclose them.
+    */
+    static std::vector<Loop> findLoops (const heart::Function& f)
+    {
+        std::vector<Loop> loops;
+
+        if (f.blocks.empty())
+            return loops;
+
+        Dominators dominators (f);
+
+        for (auto b : dominators.reversePostOrder)
+        {
+            for (auto dest : b->terminator->getDestinationBlocks())
+            {
+                if (dominators.dominates (dest, b))
+                {
+                    auto loop = std::find_if (loops.begin(), loops.end(), [&] (const Loop& l) { return l.header == dest; });
+
+                    if (loop == loops.end())
+                    {
+                        loops.push_back ({ dest, {}, { dest.getPointer() }, {} });
+                        loop = loops.end() - 1;
+                    }
+
+                    addBlocksReachingBackEdge (*loop, b, dominators);
+                }
+            }
+        }
+
+        for (auto& loop : loops)
+        {
+            for (auto& b : f.blocks)
+                if (loop.contains (b))
+                    loop.blocks.push_back (b);
+
+            for (auto pred : loop.header->predecessors)
+            {
+                if (! (loop.contains (pred) || ! dominators.isReachable (pred)))
+                {
+                    if (loop.preheader != nullptr)
+                    {
+                        loop.preheader = {};
+                        break;
+                    }
+
+                    loop.preheader = pred;
+                }
+            }
+
+            if (loop.preheader != nullptr && ! is_type<heart::Branch> (loop.preheader->terminator))
+                loop.preheader = {};
+        }
+
+        std::stable_sort (loops.begin(), loops.end(), [] (const Loop& a, const Loop& b) { return a.blocks.size() < b.blocks.size(); });
+        return loops;
+    }
+
 private:
     //==============================================================================
     static void resetVisitedFlags (const heart::Function& f)
@@ -264,6 +341,139 @@ private:
         return results;
     }
 
+    //==============================================================================
+    /** Calculates the immediate dominator of each block that's reachable from the function's
+        entry block, using the iterative algorithm from Cooper, Harvey & Kennedy.
+    */
+    struct Dominators
+    {
+        Dominators (const heart::Function& f)
+        {
+            std::vector<std::pair<pool_ref<heart::Block>, size_t>> stack;
+            std::unordered_set<const heart::Block*> visited;
+            std::vector<pool_ref<heart::Block>> postOrder;
+
+            auto& entry = f.blocks.front().get();
+            stack.push_back ({ entry, 0 });
+            visited.insert (std::addressof (entry));
+
+            while (! stack.empty())
+            {
+                auto& top = stack.back();
+                auto destinations = top.first->terminator->getDestinationBlocks();
+
+                if (top.second < destinations.size())
+                {
+                    auto next = destinations[top.second++];
+
+                    if (visited.insert (next.getPointer()).second)
+                        stack.push_back ({ next, 0 });
+                }
+                else
+                {
+                    postOrder.push_back (top.first);
+                    stack.pop_back();
+                }
+            }
+
+            reversePostOrder.assign (postOrder.rbegin(), postOrder.rend());
+
+            for (size_t i = 0; i < reversePostOrder.size(); ++i)
+                orderIndex[reversePostOrder[i].getPointer()] = i;
+
+            immediateDominators.resize (reversePostOrder.size(), undefined);
+            immediateDominators[0] = 0;
+
+            for (bool changed = true; changed;)
+            {
+                changed = false;
+
+                for (size_t i = 1; i < reversePostOrder.size(); ++i)
+                {
+                    auto newDominator = undefined;
+
+                    for (auto pred : reversePostOrder[i]->predecessors)
+                    {
+                        auto predIndex = getIndex (pred);
+
+                        if (predIndex != undefined && immediateDominators[predIndex] != undefined)
+                            newDominator = (newDominator == undefined) ? predIndex : intersect (predIndex, newDominator);
+                    }
+
+                    if (immediateDominators[i] != newDominator)
+                    {
+                        immediateDominators[i] = newDominator;
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        bool isReachable (const heart::Block& b) const      { return getIndex (b) != undefined; }
+
+        /** Returns true if every path from the entry block to b passes through a. */
+        bool dominates (const heart::Block& a, const heart::Block& b) const
+        {
+            auto target = getIndex (a);
+
+            if (target == undefined)
+                return false;
+
+            for (auto i = getIndex (b); i != undefined; i = immediateDominators[i])
+            {
+                if (i == target)
+                    return true;
+
+                if (i == 0)
+                    break;
+            }
+
+            return false;
+        }
+
+        std::vector<pool_ref<heart::Block>> reversePostOrder;
+
+    private:
+        static constexpr size_t undefined = std::numeric_limits<size_t>::max();
+        std::unordered_map<const heart::Block*, size_t> orderIndex;
+        std::vector<size_t> immediateDominators;
+
+        size_t getIndex (const heart::Block& b) const
+        {
+            auto i = orderIndex.find (std::addressof (b));
+            return i != orderIndex.end() ? i->second : undefined;
+        }
+
+        size_t intersect (size_t a, size_t b) const
+        {
+            while (a != b)
+            {
+                while (a > b)  a = immediateDominators[a];
+                while (b > a)  b = immediateDominators[b];
+            }
+
+            return a;
+        }
+    };
+
+    static void addBlocksReachingBackEdge (Loop& loop, heart::Block& backEdgeSource, const Dominators& dominators)
+    {
+        std::vector<pool_ref<heart::Block>> toVisit;
+
+        if (loop.blockSet.insert (std::addressof (backEdgeSource)).second)
+            toVisit.push_back (backEdgeSource);
+
+        while (! toVisit.empty())
+        {
+            auto b = toVisit.back();
+            toVisit.pop_back();
+
+            for (auto pred : b->predecessors)
+                if (dominators.isReachable (pred) && loop.blockSet.insert (pred.getPointer()).second)
+                    toVisit.push_back (pred);
+        }
+    }
+
     //==============================================================================
     static constexpr uint64_t perCallStackOverhead = 16;
     static constexpr uint64_t stackItemAlignment = 8;
@@ -23,15 +23,19 @@ namespace soul
 
 struct heart::Checker
 {
-    static void sanityCheck (Program& program)
+    /** Runs all the checks on a program, throwing an error if there's a problem.
+        The checks which look at each function on its own can be shared out between some
+        worker threads. The errors reported are the same as when it's done on one thread.
+    */
+    static void sanityCheck (Program& program, uint32_t numThreads = 1)
     {
         program.getMainProcessorOrThrowError();
         sanityCheckInputsAndOutputs (program);
-        sanityCheckAdvanceAndStreamCalls (program);
+        sanityCheckAdvanceAndStreamCalls (program, numThreads);
         checkConnections (program);
         checkForRecursiveFunctions (program);
-        checkForInfiniteLoops (program);
-        checkBlockParameters (program);
+        checkForInfiniteLoops (program, numThreads);
+        checkBlockParameters (program, numThreads);
     }
 
     static void sanityCheckInputsAndOutputs (Program& program)
@@ -64,8 +68,8 @@ struct heart::Checker
                 {
                     pool_ptr<heart::IODeclaration> sourceOutput, destInput;
                     size_t sourceInstanceArraySize = 1, destInstanceArraySize = 1;
-                    auto sourceDescription = conn->sourceEndpoint;
-                    auto destDescription   = conn->destEndpoint;
+                    auto sourceDescription = conn->sourceEndpoint.toString();
+                    auto destDescription   = conn->destEndpoint.toString();
 
                     if (conn->sourceProcessor != nullptr)
                     {
@@ -163,48 +167,50 @@ struct heart::Checker
     }
 
 
-    static void sanityCheckAdvanceAndStreamCalls (Program& program)
+    static void sanityCheckAdvanceAndStreamCalls (Program& program, uint32_t numThreads = 1)
     {
-        for (auto& m : program.getModules())
+        checkEachFunction (program, numThreads, [] (Module& m, heart::Function& f)
         {
-            for (auto& f : m->functions)
-            {
-                auto firstAdvanceCall = heart::Utilities::findFirstAdvanceCall (f);
+            auto flat = f.flatBody.get();
+            auto firstAdvanceCall = flat != nullptr ? flat->findFirstAdvanceCall()
+                                                    : heart::Utilities::findFirstAdvanceCall (f);
 
-                if (f->functionType.isRun() && firstAdvanceCall == nullptr)
-                    f->location.throwError (Errors::runFunctionMustCallAdvance());
+            if (f.functionType.isRun() && firstAdvanceCall == nullptr)
+                f.location.throwError (Errors::runFunctionMustCallAdvance());
 
-                if (firstAdvanceCall != nullptr && ! m->isProcessor())
-                    firstAdvanceCall->location.throwError (Errors::advanceCannotBeCalledHere());
+            if (firstAdvanceCall != nullptr && ! m.isProcessor())
+                firstAdvanceCall->location.throwError (Errors::advanceCannotBeCalledHere());
 
-                if (! f->functionType.isSystemInit())
+            if (! f.functionType.isSystemInit())
+            {
+                auto checkCall = [] (heart::FunctionCall& call)
                 {
-                    f->visitStatements<heart::FunctionCall> ([] (heart::FunctionCall& call)
-                    {
-                        auto& target = *call.function;
+                    auto& target = *call.function;
 
-                        if (target.functionType.isRun() || target.functionType.isUserInit() || target.functionType.isEvent())
-                            target.location.throwError (Errors::cannotCallFunction (target.getReadableName()));
-                    });
-                }
+                    if (target.functionType.isRun() || target.functionType.isUserInit() || target.functionType.isEvent())
+                        target.location.throwError (Errors::cannotCallFunction (target.getReadableName()));
+                };
 
-                if (f->functionType.isUserInit())
-                    if (auto w = heart::Utilities::findFirstWrite (f))
-                        w->location.throwError (Errors::streamsCannotBeUsedDuringInit());
+                if (flat != nullptr)
+                    flat->visitCalls (checkCall);
+                else
+                    f.visitStatements<heart::FunctionCall> (checkCall);
             }
-        }
-    }
-
-
 
+            if (f.functionType.isUserInit())
+                if (auto w = flat != nullptr ? flat->findFirstWrite() : heart::Utilities::findFirstWrite (f))
+                    w->location.throwError (Errors::streamsCannotBeUsedDuringInit());
+        });
+    }
 
     //==============================================================================
-    static void checkForInfiniteLoops (Program& program)
+    static void checkForInfiniteLoops (Program& program, uint32_t numThreads = 1)
     {
-        for (auto& m : program.getModules())
-            for (auto& f : m->functions)
-                if (CallFlowGraph::doesFunctionContainInfiniteLoops (f))
-                    f->location.throwError (Errors::functionContainsAnInfiniteLoop (f->getReadableName()));
+        checkEachFunction (program, numThreads, [] (Module&, heart::Function& f)
+        {
+            if (CallFlowGraph::doesFunctionContainInfiniteLoops (f))
+                f.location.throwError (Errors::functionContainsAnInfiniteLoop (f.getReadableName()));
+        });
     }
 
     static void checkForRecursiveFunctions (Program& program)
@@ -227,53 +233,84 @@ struct heart::Checker
     }
 
     //==============================================================================
-    static void checkBlockParameters (Program& program)
+    static void checkBlockParameters (Program& program, uint32_t numThreads = 1)
     {
-        for (auto& m : program.getModules())
+        checkEachFunction (program, numThreads, [] (Module&, heart::Function& f)
         {
-            for (auto& f : m->functions)
+            if (! f.blocks.empty())
             {
-                if (! f->blocks.empty())
-                {
-                    if (! f->blocks[0]->parameters.empty())
-                        f->location.throwError (Errors::functionBlockCantBeParameterised (f->blocks[0]->name));
+                if (! f.blocks[0]->parameters.empty())
+                    f.location.throwError (Errors::functionBlockCantBeParameterised (f.blocks[0]->name));
 
-                    for (auto& b : f->blocks)
+                for (auto& b : f.blocks)
+                {
+                    for (auto& param : b->parameters)
                     {
-                        for (auto& param : b->parameters)
-                        {
-                            auto& type = param->getType();
+                        auto& type = param->getType();
 
-                            if (type.isReference() || type.isVoid())
-                                f->location.throwError (Errors::blockParametersInvalid (b->name));
-                        }
-
-                        if (auto branch = cast<heart::Branch> (b->terminator))
-                        {
-                            if (branch->target->parameters.size() != branch->targetArgs.size())
-                                f->location.throwError (Errors::branchInvalidParameters (b->name));
+                        if (type.isReference() || type.isVoid())
+                            f.location.throwError (Errors::blockParametersInvalid (b->name));
+                    }
 
-                            for (size_t n = 0; n < branch->targetArgs.size(); n++)
-                            {
-                                auto& argType = branch->targetArgs[n]->getType();
-                                auto& parameterType = branch->target->parameters[n]->getType();
+                    if (auto branch = cast<heart::Branch> (b->terminator))
+                    {
+                        if (branch->target->parameters.size() != branch->targetArgs.size())
+                            f.location.throwError (Errors::branchInvalidParameters (b->name));
 
-                                if (! TypeRules::canSilentlyCastTo (parameterType, argType))
-                                    f->location.throwError (Errors::branchInvalidParameters (b->name));
-                            }
-                        }
-                        else if (auto branchIf = cast<heart::BranchIf> (b->terminator))
+                        for (size_t n = 0; n < branch->targetArgs.size(); n++)
                         {
-                            if (! branchIf->targetArgs[0].empty() || ! branchIf->targetArgs[1].empty())
-                                f->location.throwError (Errors::notYetImplemented ("BranchIf parameterised blocks"));
+                            auto& argType = branch->targetArgs[n]->getType();
+                            auto& parameterType = branch->target->parameters[n]->getType();
+
+                            if (! TypeRules::canSilentlyCastTo (parameterType, argType))
+                                f.location.throwError (Errors::branchInvalidParameters (b->name));
                         }
                     }
+                    else if (auto branchIf = cast<heart::BranchIf> (b->terminator))
+                    {
+                        if (! branchIf->targetArgs[0].empty() || ! branchIf->targetArgs[1].empty())
+                            f.location.throwError (Errors::notYetImplemented ("BranchIf parameterised blocks"));
+                    }
                 }
             }
-        }
+        });
     }
 
+    /** Calls a check for each function in the program. If there's more than one thread, the functions
+        are split into batches which are checked in parallel, but the errors are reported in the same
+        order, so the outcome is the same as checking them one at a time.
+    */
+    template <typename CheckFn>
+    static void checkEachFunction (Program& program, uint32_t numThreads, CheckFn&& check)
+    {
+        std::vector<std::pair<Module*, heart::Function*>> functions;
+
+        for (auto& m : program.getModules())
+            for (auto& f : m->functions)
+                functions.push_back ({ std::addressof (m.get()), std::addressof (f.get()) });
+
+        auto numBatches = std::min ((size_t) numThreads, functions.size());
+
+        if (numBatches <= 1)
+        {
+            for (auto& f : functions)
+                check (*f.first, *f.second);
+
+            return;
+        }
+
+        auto batchSize = (functions.size() + numBatches - 1) / numBatches;
 
+        runCompileTasksInParallel (numBatches, numThreads, [&] (size_t batch)
+        {
+            auto end = std::min (functions.size(), (batch + 1) * batchSize);
+
+            for (auto i = batch * batchSize; i < end; ++i)
+                check (*functions[i].first, *functions[i].second);
+        });
+    }
+
+    //==============================================================================
     static void testHEARTRoundTrip (const Program& program)
     {
         ignoreUnused (program);
@@ -0,0 +1,560 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul
+{
+
+/** Works out a static estimate of how much state a processor or graph needs, and an upper
+    bound on the number of operations it can perform while rendering a frame or handling an event.
+
+    An "operation" is roughly one arithmetic instruction on a scalar: vector and array operations
+    count once per element, and intrinsics are weighted by a rough guess at what they cost. Every
+    block in a function is assumed to run on each pass, so conditional code is counted as if all of
+    its branches were taken.
+
+    Loops are bounded if they have the form that for-loops and loop (n) statements produce, where a
+    local counter starts at a constant, is stepped by a constant on every iteration, and is compared
+    with a constant. A loop in run() which calls advance() counts as running once per frame. If any
+    other loop is reachable, the number of operations is unbounded.
+*/
+struct CostEstimator
+{
+    static Program::CostEstimate estimate (const Program& program, const Module& module)
+    {
+        CostEstimator estimator (program);
+        return estimator.getEstimate (module);
+    }
+
+private:
+    using Cost = uint64_t;
+    using Loop = CallFlowGraph::Loop;
+
+    static constexpr Cost unbounded = Program::CostEstimate::unbounded;
+    static constexpr Cost perCallOverhead = 2;
+
+    CostEstimator (const Program& p) : program (p) {}
+
+    const Program& program;
+    std::unordered_map<const Module*, Program::CostEstimate> moduleEstimates;
+    std::unordered_map<const heart::Function*, Cost> functionCosts;
+
+    static Cost add (Cost a, Cost b)          { return a > unbounded - b ? unbounded : a + b; }
+    static Cost multiply (Cost a, Cost b)     { return (a == 0 || b == 0) ? 0 : (a > unbounded / b ? unbounded : a * b); }
+
+    //==============================================================================
+    Program::CostEstimate getEstimate (const Module& module)
+    {
+        auto found = moduleEstimates.find (std::addressof (module));
+
+        if (found != moduleEstimates.end())
+            return found->second;
+
+        Program::CostEstimate result;
+
+        if (module.isProcessor())   result = getProcessorEstimate (module);
+        if (module.isGraph())       result = getGraphEstimate (module);
+
+        moduleEstimates[std::addressof (module)] = result;
+        return result;
+    }
+
+    Program::CostEstimate getProcessorEstimate (const Module& processor)
+    {
+        Program::CostEstimate result;
+
+        for (auto& v : processor.stateVariables)
+            result.stateSize = add (result.stateSize, (Cost) v->type.getPackedSizeInBytes());
+
+        if (auto run = processor.findRunFunction())
+            result.maxOperationsPerFrame = getFunctionCost (*run);
+
+        for (auto& f : processor.functions)
+            if (f->functionType.isEvent())
+                result.maxOperationsPerEvent = std::max (result.maxOperationsPerEvent, getFunctionCost (f));
+
+        return result;
+    }
+
+    Program::CostEstimate getGraphEstimate (const Module& graph)
+    {
+        Program::CostEstimate result;
+
+        for (auto& instance : graph.processorInstances)
+        {
+            if (auto module = program.getModuleWithName (instance->sourceName))
+            {
+                auto instanceEstimate = getEstimate (*module);
+
+                // A processor with a clock divider still does all its work on the frames where it runs
+                auto runsPerFrame = (Cost) std::max ((int64_t) 1, (instance->clockMultiplier + instance->clockDivider - 1)
+                                                                     / instance->clockDivider);
+
+                result.stateSize             = add (result.stateSize,             multiply (instanceEstimate.stateSize, instance->arraySize));
+                result.maxOperationsPerFrame = add (result.maxOperationsPerFrame, multiply (instanceEstimate.maxOperationsPerFrame,
+                                                                                            multiply (instance->arraySize, runsPerFrame)));
+                result.maxOperationsPerEvent = add (result.maxOperationsPerEvent, multiply (instanceEstimate.maxOperationsPerEvent, instance->arraySize));
+            }
+        }
+
+        for (auto& c : graph.connections)
+        {
+            if (auto source = findSourceEndpoint (graph, c))
+            {
+                if (source->isStreamEndpoint())
+                {
+                    auto& type = source->dataTypes.front();
+                    auto numChannels = (Cost) source->arraySize.value_or (1);
+
+                    result.maxOperationsPerFrame = add (result.maxOperationsPerFrame, multiply (getNumElements (type), numChannels));
+
+                    if (c->delayLength > 0)
+                        result.stateSize = add (result.stateSize, multiply ((Cost) c->delayLength,
+                                                                            multiply ((Cost) type.getPackedSizeInBytes(), numChannels)));
+                }
+            }
+        }
+
+        return result;
+    }
+
+    pool_ptr<heart::IODeclaration> findSourceEndpoint (const Module& graph, const heart::Connection& c) const
+    {
+        if (c.sourceProcessor == nullptr)
+            return graph.findInput (c.sourceEndpoint);
+
+        if (auto module = program.getModuleWithName (c.sourceProcessor->sourceName))
+            return module->findOutput (c.sourceEndpoint);
+
+        return {};
+    }
+
+    //==============================================================================
+    Cost getFunctionCost (heart::Function& f)
+    {
+        auto found = functionCosts.find (std::addressof (f));
+
+        if (found != functionCosts.end())
+            return found->second;
+
+        // A placeholder stops a recursive call from looping forever
+        functionCosts[std::addressof (f)] = unbounded;
+
+        auto cost = calculateFunctionCost (f);
+        functionCosts[std::addressof (f)] = cost;
+        return cost;
+    }
+
+    Cost calculateFunctionCost (heart::Function& f)
+    {
+        f.rebuildBlockPredecessors();
+
+        std::unordered_map<const heart::Block*, Cost> numRuns;
+        std::unordered_set<const heart::Block*> advancingBlocks;
+
+        for (auto& b : f.blocks)
+        {
+            numRuns[b.getPointer()] = 1;
+
+            if (heart::Utilities::doesBlockCallAdvance (b))
+                advancingBlocks.insert (b.getPointer());
+        }
+
+        for (auto& loop : CallFlowGraph::findLoops (f))
+        {
+            Cost headerRuns = unbounded, bodyRuns = unbounded;
+
+            // A loop which calls advance() is taken to go round once per frame. That isn't true of code
+            // like "loop { if (x) advance(); }", but it's impossible to be any more precise without
+            // knowing which branches will be taken, and real processors rarely spin without advancing
+            if (std::any_of (loop.blocks.begin(), loop.blocks.end(), [&] (const pool_ref<heart::Block>& b) { return advancingBlocks.count (b.getPointer()) != 0; }))
+            {
+                headerRuns = bodyRuns = 1;
+            }
+            else if (auto numIterations = getNumIterations (loop))
+            {
+                headerRuns = add (*numIterations, 1);
+                bodyRuns = *numIterations;
+            }
+
+            for (auto& b : loop.blocks)
+                numRuns[b.getPointer()] = multiply (numRuns[b.getPointer()], b == loop.header ? headerRuns : bodyRuns);
+        }
+
+        Cost total = 0;
+
+        for (auto& b : f.blocks)
+            total = add (total, multiply (getBlockCost (b), numRuns[b.getPointer()]));
+
+        return total;
+    }
+
+    //==============================================================================
+    Cost getBlockCost (heart::Block& b)
+    {
+        Cost cost = 0;
+
+        for (auto s : b.statements)
+            cost = add (cost, getStatementCost (*s));
+
+        if (b.terminator != nullptr)
+        {
+            cost = add (cost, 1);
+            b.terminator->visitExpressions ([&] (pool_ref<heart::Expression>& e, AccessType) { cost = add (cost, getExpressionCost (e)); });
+        }
+
+        return cost;
+    }
+
+    Cost getStatementCost (heart::Statement& s)
+    {
+        Cost cost = 0;
+        s.visitExpressions ([&] (pool_ref<heart::Expression>& e, AccessType) { cost = add (cost, getExpressionCost (e)); });
+
+        if (auto a = cast<heart::Assignment> (s))
+            if (a->target != nullptr)
+                cost = add (cost, getNumElements (a->target->getType()));
+
+        if (auto call = cast<heart::FunctionCall> (s))
+            cost = add (cost, getCallCost (call->getFunction(), call->arguments));
+
+        if (auto w = cast<heart::WriteStream> (s))
+            cost = add (cost, getNumElements (w->value->getType()));
+
+        return std::max (cost, (Cost) 1);
+    }
+
+    /** Returns the cost of a single node in an expression, not including its sub-expressions. */
+    Cost getExpressionCost (heart::Expression& e)
+    {
+        if (is_type<heart::BinaryOperator> (e) || is_type<heart::UnaryOperator> (e) || is_type<heart::TypeCast> (e))
+            return getNumElements (e.getType());
+
+        if (auto a = cast<heart::ArrayElement> (e))
+            return a->dynamicIndex != nullptr ? 1 : 0;
+
+        if (auto call = cast<heart::PureFunctionCall> (e))
+            return getCallCost (call->function, call->arguments);
+
+        return 0;
+    }
+
+    template <typename ArgList>
+    Cost getCallCost (heart::Function& f, const ArgList& args)
+    {
+        auto bodyCost = f.hasNoBody ? 0 : getFunctionCost (f);
+
+        if (f.intrinsicType == IntrinsicType::none)
+            return add (bodyCost, perCallOverhead);
+
+        // The body of an intrinsic is only a fallback for back-ends which have no native version
+        // of it, so the more expensive of the two is used
+        auto firstArgSize = args.empty() ? (Cost) 1 : getNumElements (args.front()->getType());
+        return std::max (bodyCost, getIntrinsicCost (f.intrinsicType, getNumElements (f.returnType), firstArgSize));
+    }
+
+    static Cost getIntrinsicCost (IntrinsicType type, Cost resultSize, Cost firstArgSize)
+    {
+        switch (type)
+        {
+            case IntrinsicType::none:
+            case IntrinsicType::get_array_size:         return 1;
+            case IntrinsicType::read:                   return 2;
+            case IntrinsicType::readLinearInterpolated: return 8;
+
+            case IntrinsicType::sum:
+            case IntrinsicType::product:
+            case IntrinsicType::minElement:
+            case IntrinsicType::maxElement:
+            case IntrinsicType::maxAbsElement:          return multiply (firstArgSize, 2);
+
+            case IntrinsicType::dot:
+            case IntrinsicType::sumOfSquares:
+            case IntrinsicType::multiplyAccumulate:
+            case IntrinsicType::addScaled:              return multiply (firstArgSize, 3);
+
+            case IntrinsicType::fft:
+            {
+                Cost log2Size = 1;
+
+                while (((Cost) 1 << log2Size) < firstArgSize && log2Size < 63)
+                    ++log2Size;
+
+                return multiply (multiply (firstArgSize, log2Size), 5);
+            }
+
+            case IntrinsicType::abs:
+            case IntrinsicType::min:
+            case IntrinsicType::max:
+            case IntrinsicType::isnan:
+            case IntrinsicType::isinf:
+            case IntrinsicType::fma:
+            case IntrinsicType::select:                 return resultSize;
+
+            case IntrinsicType::clamp:
+            case IntrinsicType::floor:
+            case IntrinsicType::ceil:
+            case IntrinsicType::roundToInt:
+            case IntrinsicType::shuffle:                return multiply (resultSize, 2);
+
+            case IntrinsicType::wrap:
+            case IntrinsicType::addModulo2Pi:           return multiply (resultSize, 4);
+
+            case IntrinsicType::fastSin:
+            case IntrinsicType::fastCos:
+            case IntrinsicType::fastExp:
+            case IntrinsicType::fastTanh:               return multiply (resultSize, 8);
+
+            case IntrinsicType::fmod:
+            case IntrinsicType::remainder:
+            case IntrinsicType::sqrt:                   return multiply (resultSize, 10);
+
+            case IntrinsicType::exp:
+            case IntrinsicType::log:
+            case IntrinsicType::log10:
+            case IntrinsicType::sin:
+            case IntrinsicType::cos:                    return multiply (resultSize, 20);
+
+            case IntrinsicType::tan:
+            case IntrinsicType::sinh:
+            case IntrinsicType::cosh:
+            case IntrinsicType::tanh:
+            case IntrinsicType::asin:
+            case IntrinsicType::acos:
+            case IntrinsicType::atan:                   return multiply (resultSize, 30);
+
+            case IntrinsicType::pow:
+            case IntrinsicType::asinh:
+            case IntrinsicType::acosh:
+            case IntrinsicType::atanh:
+            case IntrinsicType::atan2:                  return multiply (resultSize, 40);
+        }
+
+        return resultSize;
+    }
+
+    static Cost getNumElements (const Type& type)
+    {
+        if (type.isFixedSizeArray())
+            return multiply ((Cost) type.getArraySize(), getNumElements (type.getElementType()));
+
+        if (type.isVector())
+            return (Cost) type.getVectorSize();
+
+        if (type.isStruct())
+        {
+            Cost total = 0;
+
+            for (auto& m : type.getStructRef().getMembers())
+                total = add (total, getNumElements (m.type));
+
+            return std::max (total, (Cost) 1);
+        }
+
+        return 1;
+    }
+
+    //==============================================================================
+    template <typename Predicate>
+    static bool doesEveryIterationReach (const Loop& loop, Predicate&& isTarget)
+    {
+        if (isTarget (loop.header.get()))
+            return true;
+
+        std::unordered_set<const heart::Block*> visited;
+        std::vector<pool_ref<heart::Block>> toVisit { loop.header };
+
+        while (! toVisit.empty())
+        {
+            auto b = toVisit.back();
+            toVisit.pop_back();
+
+            for (auto dest : b->terminator->getDestinationBlocks())
+            {
+                if (dest == loop.header)
+                    return false;
+
+                if (loop.contains (dest) && ! isTarget (dest.get()) && visited.insert (dest.getPointer()).second)
+                    toVisit.push_back (dest);
+            }
+        }
+
+        return true;
+    }
+
+    static std::optional<Cost> getNumIterations (const Loop& loop)
+    {
+        auto branchIf = cast<heart::BranchIf> (loop.header->terminator);
+
+        if (loop.preheader == nullptr || branchIf == nullptr || branchIf->isParameterised()
+             || ! loop.contains (branchIf->targets[0]) || loop.contains (branchIf->targets[1]))
+            return {};
+
+        auto condition = cast<heart::BinaryOperator> (branchIf->condition);
+
+        if (condition == nullptr)
+            return {};
+
+        auto op = condition->operation;
+        auto counter = cast<heart::Variable> (condition->lhs);
+        auto limit = cast<heart::Constant> (condition->rhs);
+
+        if (counter == nullptr)
+        {
+            counter = cast<heart::Variable> (condition->rhs);
+            limit = cast<heart::Constant> (condition->lhs);
+
+            if      (op == BinaryOp::Op::lessThan)              op = BinaryOp::Op::greaterThan;
+            else if (op == BinaryOp::Op::lessThanOrEqual)       op = BinaryOp::Op::greaterThanOrEqual;
+            else if (op == BinaryOp::Op::greaterThan)           op = BinaryOp::Op::lessThan;
+            else if (op == BinaryOp::Op::greaterThanOrEqual)    op = BinaryOp::Op::lessThanOrEqual;
+            else return {};
+        }
+
+        if (counter == nullptr || limit == nullptr || ! counter->isMutableLocal()
+             || ! counter->type.isPrimitiveInteger() || ! limit->getType().isPrimitiveInteger())
+            return {};
+
+        auto start = getInitialValue (*loop.preheader, *counter);
+        auto step = getStep (loop, *counter);
+
+        if (! (start.has_value() && step.has_value()))
+            return {};
+
+        auto end = limit->value.getAsInt64();
+
+        // Works out the number of steps needed to cover the distance, rounding up
+        auto getNumSteps = [] (int64_t from, int64_t to, int64_t stepSize, bool inclusive) -> Cost
+        {
+            if (to < from || (to == from && ! inclusive))
+                return 0;
+
+            auto distance = (Cost) to - (Cost) from;
+            return inclusive ? distance / (Cost) stepSize + 1
+                             : (distance + (Cost) stepSize - 1) / (Cost) stepSize;
+        };
+
+        if (*step > 0 && op == BinaryOp::Op::lessThan)              return getNumSteps (*start, end, *step, false);
+        if (*step > 0 && op == BinaryOp::Op::lessThanOrEqual)       return getNumSteps (*start, end, *step, true);
+        if (*step < 0 && op == BinaryOp::Op::greaterThan)           return getNumSteps (end, *start, -*step, false);
+        if (*step < 0 && op == BinaryOp::Op::greaterThanOrEqual)    return getNumSteps (end, *start, -*step, true);
+
+        return {};
+    }
+
+    static std::optional<int64_t> getInitialValue (heart::Block& preheader, heart::Variable& counter)
+    {
+        pool_ptr<heart::Statement> lastWrite;
+
+        for (auto s : preheader.statements)
+            if (s->writesVariable (counter) || s->readsVariable (counter))
+                lastWrite = *s;
+
+        if (auto a = cast<heart::AssignFromValue> (lastWrite))
+            if (a->target == counter)
+                if (auto c = cast<heart::Constant> (a->source))
+                    if (c->getType().isPrimitiveInteger())
+                        return c->value.getAsInt64();
+
+        return {};
+    }
+
+    /** Looks for a single statement in the loop which adds a constant to the counter, and
+        which is run on every iteration.
+    */
+    static std::optional<int64_t> getStep (const Loop& loop, heart::Variable& counter)
+    {
+        pool_ptr<heart::AssignFromValue> update;
+        pool_ptr<heart::Block> updateBlock;
+
+        for (auto& b : loop.blocks)
+        {
+            for (auto s : b->statements)
+            {
+                if (s->writesVariable (counter))
+                {
+                    if (update != nullptr || b == loop.header)
+                        return {};
+
+                    update = cast<heart::AssignFromValue> (*s);
+                    updateBlock = b;
+
+                    if (update == nullptr)
+                        return {};
+                }
+                else if (auto call = cast<heart::FunctionCall> (*s))
+                {
+                    auto& params = call->getFunction().parameters;
+
+                    for (size_t i = 0; i < call->arguments.size() && i < params.size(); ++i)
+                        if (params[i]->type.isNonConstReference() && call->arguments[i]->getRootVariable().get() == std::addressof (counter))
+                            return {};
+                }
+            }
+        }
+
+        if (update == nullptr || ! doesEveryIterationReach (loop, [&] (const heart::Block& b) { return std::addressof (b) == updateBlock.get(); }))
+            return {};
+
+        auto op = cast<heart::BinaryOperator> (update->source);
+
+        if (op == nullptr || ! (op->operation == BinaryOp::Op::add || op->operation == BinaryOp::Op::subtract))
+            return {};
+
+        auto stepSize = cast<heart::Constant> (op->rhs);
+        auto source = op->lhs;
+
+        if (stepSize == nullptr && op->operation == BinaryOp::Op::add)
+        {
+            stepSize = cast<heart::Constant> (op->lhs);
+            source = op->rhs;
+        }
+
+        if (stepSize == nullptr || ! stepSize->getType().isPrimitiveInteger() || ! isCopyOfCounter (loop, source, counter))
+            return {};
+
+        auto step = stepSize->value.getAsInt64();
+        return op->operation == BinaryOp::Op::subtract ? -step : step;
+    }
+
+    /** Checks whether an expression is either the counter, or a constant which was set to its value. */
+    static bool isCopyOfCounter (const Loop& loop, heart::Expression& e, heart::Variable& counter)
+    {
+        auto v = cast<heart::Variable> (e);
+
+        if (v == nullptr)
+            return false;
+
+        if (v.get() == std::addressof (counter))
+            return true;
+
+        if (! v->isConstant())
+            return false;
+
+        for (auto& b : loop.blocks)
+            for (auto s : b->statements)
+                if (auto a = cast<heart::AssignFromValue> (*s))
+                    if (a->target == v)
+                        return a->source.getPointer() == std::addressof (counter);
+
+        return false;
+    }
+};
+
+} // namespace soul
@@ -0,0 +1,2562 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul
+{
+
+//==============================================================================
+/**
+    Translates a program into the source code for a self-contained C++ class, so that it can
+    be compiled ahead of time for targets which can't run a JIT.
+
+    The generated class has no dependencies beyond the standard library. Each processor
+    becomes a struct holding its state, and each HEART function becomes a member function
+    which takes a restrict-qualified pointer to the state of the processor that it belongs to.
+    The function bodies keep the structure of their HEART blocks, using labels and gotos, and
+    the run() functions store the place that they should resume from when they advance.
+
+    Frames are rendered by a render() function that loops over a block, calling the run()
+    functions in the order given by the FlattenedGraph (skipping any instances which are purely
+    event-driven), and the program's events and values are sent and received through named
+    member functions. Constant tables become static constexpr arrays, and aggregates are plain
+    structs with small fixed-size loops, so the host compiler is free to inline and vectorise
+    it all.
+*/
+struct CppGenerator
+{
+    /** Returns the source for a class with the given name which runs the program at the
+        sample rate in the build settings. Anything that the generator can't translate is
+        reported as a compile error.
+    */
+    static std::string generate (Program& program, const BuildSettings& settings, const std::string& className)
+    {
+        CppGenerator generator (program, settings, className);
+        return generator.build();
+    }
+
+private:
+    CppGenerator (Program& p, const BuildSettings& s, const std::string& name)
+        : program (p), settings (s), className (makeSafeIdentifierName (name))
+    {
+        if (className.empty())
+            className = "Program";
+
+        classNames.names.insert (className);
+        classNames.reserve ({ "RenderContext", "Vector", "FixedArray", "Slice", "sampleRate", "init", "reset",
+                              "render", "state", "initialState", "currentFrame", "outputEventContext", "ProgramState",
+                              "Globals", "globals", "frameCounter", "Unsigned", "wrappingAdd", "wrappingSubtract",
+                              "wrappingMultiply", "wrappingNegate", "divideInt", "moduloInt", "shiftLeft", "shiftRight",
+                              "shiftRightUnsigned", "convertElement", "convertElements", "map", "wrapIndex", "wrapInt",
+                              "clampInt", "addTo", "minOf", "maxOf", "clampOf", "absOf", "addModulo2Pi", "roundToInt",
+                              "Externals", "externals", "std" });
+
+        programStateNames.reserve ({ "globals", "frameCounter" });
+    }
+
+    //==============================================================================
+    /** Turns names into unique, legal C++ identifiers. A set can have a parent whose names
+        it also avoids, so that locals don't hide the class's members.
+    */
+    struct NameSet
+    {
+        NameSet (const NameSet* parentSet = nullptr) : parent (parentSet) {}
+
+        std::string add (const std::string& name)
+        {
+            auto safe = makeSafeIdentifierName (name);
+
+            // Leading and double underscores are reserved for the implementation in C++
+            while (! safe.empty() && safe[0] == '_')
+                safe = safe.substr (1);
+
+            while (soul::contains (safe, "__"))
+                safe = replaceSubString (safe, "__", "_");
+
+            if (safe.empty() || isDigit (safe[0]) || isCppKeyword (safe))
+                safe = "v_" + safe;
+
+            auto result = addSuffixToMakeUnique (safe, [this] (const std::string& s) { return contains (s); });
+            names.insert (result);
+            return result;
+        }
+
+        void reserve (std::initializer_list<const char*> namesToReserve)
+        {
+            for (auto n : namesToReserve)
+                names.insert (n);
+        }
+
+        bool contains (const std::string& name) const
+        {
+            return names.find (name) != names.end() || (parent != nullptr && parent->contains (name));
+        }
+
+        static bool isCppKeyword (const std::string& s)
+        {
+            static constexpr const char* keywords[] =
+            {
+                "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor", "bool", "break", "case", "catch",
+                "char", "char16_t", "char32_t", "class", "compl", "const", "constexpr", "const_cast", "continue", "decltype",
+                "default", "delete", "do", "double", "dynamic_cast", "else", "enum", "explicit", "export", "extern", "false",
+                "float", "for", "friend", "goto", "if", "inline", "int", "long", "mutable", "namespace", "new", "noexcept",
+                "not", "not_eq", "nullptr", "operator", "or", "or_eq", "private", "protected", "public", "register",
+                "reinterpret_cast", "return", "short", "signed", "sizeof", "static", "static_assert", "static_cast",
+                "struct", "switch", "template", "this", "thread_local", "throw", "true", "try", "typedef", "typeid",
+                "typename", "union", "unsigned", "using", "virtual", "void", "volatile", "wchar_t", "while", "xor", "xor_eq",
+                "int8_t", "int16_t", "int32_t", "int64_t", "uint8_t", "uint16_t", "uint32_t", "uint64_t", "size_t", "NULL"
+            };
+
+            for (auto k : keywords)
+                if (s == k)
+                    return true;
+
+            return false;
+        }
+
+        const NameSet* parent;
+        std::unordered_set<std::string> names;
+    };
+
+    //==============================================================================
+    struct ProcessorInfo
+    {
+        std::string stateType;
+        NameSet members;
+        std::vector<std::string> inputs, outputs;
+        std::vector<std::pair<std::string, Type>> runLocals;
+        std::vector<uint32_t> instances;
+    };
+
+    struct FunctionInfo
+    {
+        Module& module;
+        std::string name;
+    };
+
+    struct StructInfo
+    {
+        std::string name;
+        std::vector<std::string> members;
+    };
+
+    /** The names used for a function's variables and blocks while it's being generated. */
+    struct FunctionContext
+    {
+        FunctionContext (const NameSet& classLevelNames) : names (&classLevelNames) {}
+
+        heart::Function* function = nullptr;
+        ProcessorInfo* processor = nullptr;
+        bool isRun = false;
+        NameSet names, labels;
+        std::unordered_map<const heart::Variable*, std::string> variables;
+        std::unordered_map<const heart::Block*, std::string> blocks;
+        std::unordered_set<const heart::Block*> jumpTargets;
+        std::vector<std::string> resumeLabels;
+        size_t numResumePointsGenerated = 0;
+    };
+
+    Program& program;
+    const BuildSettings& settings;
+    std::string className;
+    FlattenedGraph graph;
+
+    NameSet classNames;
+    std::unordered_map<const Module*, ProcessorInfo> processors;
+    std::unordered_map<const heart::Variable*, std::string> globalVariables, stateVariables;
+    std::unordered_map<const heart::Function*, FunctionInfo> functions;
+    std::vector<heart::Function*> functionOrder;
+    std::unordered_map<const Structure*, StructInfo> structs;
+    std::vector<const Structure*> structOrder;
+    std::vector<std::string> instanceMembers;
+
+    std::unordered_map<ConstantTable::Handle, std::string> tables;
+    std::unordered_map<uint32_t, std::string> strings;
+    std::unordered_map<std::string, std::string> constants;
+
+    choc::text::CodePrinter structsOut, constantsOut, statesOut, apiOut, routingOut, functionsOut;
+
+    static constexpr choc::text::CodePrinter::NewLine newLine = {};
+    static constexpr choc::text::CodePrinter::BlankLine blankLine = {};
+    static constexpr choc::text::CodePrinter::SectionBreak sectionBreak = {};
+
+    //==============================================================================
+    std::string build()
+    {
+        if (settings.sampleRate <= 0)
+            throwError (Errors::unsupportedSampleRate());
+
+        graph = FlattenedGraph::create (program);
+
+        for (auto& v : program.getExternalVariables())
+            externalVariables[v.getPointer()] = externalNames.add (makeIdentifierRemovingColons (program.getExternalVariableName (v)));
+
+        for (auto& m : program.getModules())
+            if (m->isNamespace())
+                for (auto& v : m->stateVariables)
+                    if (! v->isExternal())
+                        globalVariables[v.getPointer()] = globalNames.add (v->name.toString());
+
+        createProcessorInfo();
+        findUsedFunctions();
+        createEndpointNames();
+
+        for (auto f : functionOrder)
+            generateFunction (*f);
+
+        createRoutes();
+        generateStates();
+        generateEventRouting();
+        generateAPI();
+
+        return assemble();
+    }
+
+    NameSet globalNames, externalNames;
+    std::unordered_map<const heart::Variable*, std::string> externalVariables;
+
+    //==============================================================================
+    void createProcessorInfo()
+    {
+        for (uint32_t i = 0; i < graph.instances.size(); ++i)
+        {
+            auto& module = graph.instances[i].module.get();
+            auto& info = processors[std::addressof (module)];
+
+            if (info.stateType.empty())
+            {
+                info.stateType = classNames.add ("State_" + getModuleName (module));
+                info.members.reserve ({ "frequency", "period", "id", "session", "instanceIndex", "resumePoint" });
+
+                for (auto& v : module.stateVariables)
+                    if (! v->isExternal())
+                        stateVariables[v.getPointer()] = info.members.add (v->name.toString());
+
+                for (auto& input : module.inputs)
+                    info.inputs.push_back (input->isEventEndpoint() ? std::string() : info.members.add ("in_" + input->name.toString()));
+
+                for (auto& output : module.outputs)
+                    info.outputs.push_back (output->isEventEndpoint() ? std::string() : info.members.add ("out_" + output->name.toString()));
+            }
+
+            info.instances.push_back (i);
+            instanceMembers.push_back (programStateNames.add (graph.instances[i].name));
+        }
+    }
+
+    static std::string getModuleName (const Module& module)
+    {
+        return makeIdentifierRemovingColons (Program::stripRootNamespaceFromQualifiedPath (module.fullName));
+    }
+
+    Module& findModuleOwningFunction (const heart::Function& f) const
+    {
+        if (auto m = program.getModuleContainingFunction (f))
+            return *m;
+
+        throwError (Errors::cannotFind (f.name.toString()));
+    }
+
+    /** Finds the functions that can be reached from the processors' run, init and event
+        functions, so that the rest of the library isn't translated.
+    */
+    void findUsedFunctions()
+    {
+        std::vector<heart::Function*> toVisit;
+
+        auto addFunction = [&] (heart::Function& f)
+        {
+            if (functions.find (std::addressof (f)) != functions.end() || hasNativeIntrinsic (f))
+                return;
+
+            auto& module = findModuleOwningFunction (f);
+            functions.insert ({ std::addressof (f), FunctionInfo { module, classNames.add (getModuleName (module) + "_" + f.name.toString()) } });
+            functionOrder.push_back (std::addressof (f));
+            toVisit.push_back (std::addressof (f));
+        };
+
+        for (auto& instance : graph.instances)
+            for (auto& f : instance.module->functions)
+                if (f->functionType.isRun() || f->functionType.isEvent() || isInitFunctionNeeded (f))
+                    addFunction (f);
+
+        while (! toVisit.empty())
+        {
+            auto& f = *toVisit.back();
+            toVisit.pop_back();
+
+            if (hasNativeImplementationOnly (f))
+                continue;
+
+            for (auto& b : f.blocks)
+            {
+                for (auto s : b->statements)
+                    if (auto call = cast<heart::FunctionCall> (*s))
+                        addFunction (call->getFunction());
+
+                b->visitExpressions ([&] (pool_ref<heart::Expression>& e, AccessType)
+                {
+                    if (auto call = cast<heart::PureFunctionCall> (e))
+                        addFunction (call->function);
+                });
+            }
+        }
+    }
+
+    static bool isInitFunctionNeeded (const heart::Function& f)
+    {
+        if (f.name != heart::getSystemInitFunctionName() || f.hasNoBody || f.blocks.empty())
+            return false;
+
+        return f.blocks.size() > 1 || ! f.blocks.front()->statements.empty();
+    }
+
+    /** The intrinsics whose library functions only have placeholder bodies. */
+    static bool hasNativeImplementationOnly (const heart::Function& f)
+    {
+        auto intrinsic = f.intrinsicType;
+
+        return intrinsic == IntrinsicType::sqrt  || intrinsic == IntrinsicType::pow
+            || intrinsic == IntrinsicType::exp   || intrinsic == IntrinsicType::log
+            || intrinsic == IntrinsicType::log10 || intrinsic == IntrinsicType::sin
+            || intrinsic == IntrinsicType::cos   || intrinsic == IntrinsicType::isnan
+            || intrinsic == IntrinsicType::isinf || f.hasNoBody || f.blocks.empty();
+    }
+
+    //==============================================================================
+    /** Vectors of size 1 are treated as scalars, as they are elsewhere. */
+    static Type normalise (const Type& t)
+    {
+        auto type = t.removeConstIfPresent().removeReferenceIfPresent();
+
+        if (type.isVector() && type.getVectorSize() == 1)
+            return type.getElementType();
+
+        return type;
+    }
+
+    std::string getType (const Type& t)
+    {
+        auto type = normalise (t);
+
+        if (type.isVoid())              return "void";
+        if (type.isBoundedInt())        return "int32_t";
+        if (type.isStringLiteral())     return "const char*";
+        if (type.isVector())            return "Vector<" + getType (type.getElementType()) + ", " + std::to_string (type.getVectorSize()) + ">";
+        if (type.isUnsizedArray())      return "Slice<" + getType (type.getArrayElementType()) + ">";
+        if (type.isFixedSizeArray())    return "FixedArray<" + getType (type.getArrayElementType()) + ", " + std::to_string (type.getArraySize()) + ">";
+        if (type.isStruct())            return getStruct (type.getStructRef()).name;
+        if (type.isBool())              return "bool";
+        if (type.isInteger32())         return "int32_t";
+        if (type.isInteger64())         return "int64_t";
+        if (type.isFloat32())           return "float";
+        if (type.isFloat64())           return "double";
+
+        throwError (Errors::notYetImplemented ("C++ generation for type " + type.getDescription()));
+    }
+
+    std::string getParameterType (const Type& type)
+    {
+        auto valueType = getType (type);
+
+        if (! type.isReference())
+            return valueType;
+
+        return type.isConst() ? "const " + valueType + "&" : valueType + "&";
+    }
+
+    const StructInfo& getStruct (const Structure& s)
+    {
+        auto found = structs.find (std::addressof (s));
+
+        if (found != structs.end())
+            return found->second;
+
+        StructInfo info;
+        info.name = classNames.add (s.getName());
+        NameSet memberNames;
+
+        // Make sure that the types of the members are declared first
+        for (auto& m : s.getMembers())
+        {
+            getType (m.type);
+            info.members.push_back (memberNames.add (m.name));
+        }
+
+        structOrder.push_back (std::addressof (s));
+        return structs[std::addressof (s)] = std::move (info);
+    }
+
+    /** A primitive, a vector, or an array of primitives, which can be treated element-wise. */
+    struct ElementLayout
+    {
+        Type elementType;
+        size_t numElements = 0;
+
+        bool isValid() const    { return numElements != 0; }
+    };
+
+    static ElementLayout getElementLayout (const Type& t)
+    {
+        auto type = normalise (t);
+
+        if (type.isBoundedInt())                                return { PrimitiveType::int32, 1 };
+        if (type.isPrimitive())                                 return { type, 1 };
+        if (type.isVector())                                    return { type.getElementType(), type.getVectorSize() };
+
+        if (type.isFixedSizeArray() && type.getArrayElementType().isPrimitive()
+             && ! type.getArrayElementType().isBoundedInt())    return { type.getArrayElementType(), type.getArraySize() };
+
+        return {};
+    }
+
+    //==============================================================================
+    struct ValuePrinter  : public soul::ValuePrinter
+    {
+        ValuePrinter (CppGenerator& g) : generator (g) {}
+
+        void print (std::string_view s) override    { text += s; }
+
+        void printInt32 (int32_t v) override
+        {
+            print (v == std::numeric_limits<int32_t>::min() ? "(-2147483647 - 1)" : std::to_string (v));
+        }
+
+        void printInt64 (int64_t v) override
+        {
+            print (v == std::numeric_limits<int64_t>::min() ? "(-9223372036854775807LL - 1)" : std::to_string (v) + "LL");
+        }
+
+        void printFloat32 (float v) override                    { appendFloat<float> (text, v); }
+        void printFloat64 (double v) override                   { appendFloat<double> (text, v); }
+
+        void printFloat32Elements (const void* elements, size_t numElements) override   { appendFloats<float> (elements, numElements); }
+        void printFloat64Elements (const void* elements, size_t numElements) override   { appendFloats<double> (elements, numElements); }
+
+        void beginArrayMembers (const Type&) override           { print ("{ { "); }
+        void endArrayMembers() override                         { print (" } }"); }
+        void beginVectorMembers (const Type&) override          { print ("{ { "); }
+        void endVectorMembers() override                        { print (" } }"); }
+
+        void printStringLiteral (StringDictionary::Handle h) override
+        {
+            print (generator.getStringLiteral (h));
+        }
+
+        void printUnsizedArrayContent (const Type& arrayType, const void* pointer) override
+        {
+            ConstantTable::Handle handle = {};
+
+            if (pointer != nullptr)
+                writeUnaligned (std::addressof (handle), pointer);
+
+            print (generator.getConstantTable (arrayType, handle));
+        }
+
+        template <typename FloatType>
+        static void appendFloat (std::string& s, FloatType v)
+        {
+            auto typeName = std::string (std::is_same<FloatType, float>::value ? "float" : "double");
+
+            if (v == 0)                 { s += std::is_same<FloatType, float>::value ? "0.0f" : "0.0"; return; }
+            if (std::isnan (v))         { s += "std::numeric_limits<" + typeName + ">::quiet_NaN()"; return; }
+            if (std::isinf (v))         { s += (v > 0 ? "" : "-") + ("std::numeric_limits<" + typeName + ">::infinity()"); return; }
+
+            if constexpr (std::is_same<FloatType, float>::value)
+                soul::ValuePrinter::appendFloat32 (s, v);
+            else
+                soul::ValuePrinter::appendFloat64 (s, v);
+        }
+
+        template <typename FloatType>
+        void appendFloats (const void* elements, size_t numElements)
+        {
+            std::string s;
+            s.reserve (numElements * 16);
+
+            for (size_t i = 0; i < numElements; ++i)
+            {
+                if (i != 0)
+                    s += ", ";
+
+                appendFloat<FloatType> (s, readUnaligned<FloatType> (elements, i * sizeof (FloatType)));
+            }
+
+            print (s);
+        }
+
+        CppGenerator& generator;
+        std::string text;
+    };
+
+    std::string printValue (const Value& v)
+    {
+        ValuePrinter p (*this);
+        v.print (p);
+        return p.text;
+    }
+
+    /** Returns an expression for a constant. Aggregates become static constexpr members,
+        so that they're only built once rather than every time they're used.
+    */
+    std::string getConstant (const Value& value)
+    {
+        auto& type = value.getType();
+
+        if (type.isVector() && type.getVectorSize() == 1)
+            return getConstant (value.getSubElement (0));
+
+        if (type.isPrimitive() || type.isBoundedInt() || type.isStringLiteral() || type.isUnsizedArray())
+            return printValue (value);
+
+        auto cppType = getType (type);
+
+        if (value.isZero())
+            return cppType + " {}";
+
+        auto initialiser = printValue (value);
+        auto& name = constants[cppType + " " + initialiser];
+
+        if (name.empty())
+        {
+            name = classNames.add ("constant_" + std::to_string (constants.size()));
+            constantsOut << "static constexpr " << cppType << " " << name << " = " << initialiser << ";" << newLine;
+        }
+
+        return name;
+    }
+
+    std::string getStringLiteral (StringDictionary::Handle h)
+    {
+        auto& name = strings[h.handle];
+
+        if (name.empty())
+        {
+            name = classNames.add ("string_" + std::to_string (h.handle));
+            constantsOut << "static constexpr const char* " << name << " = "
+                         << choc::json::getEscapedQuotedString (program.getStringDictionary().getStringForHandle (h)) << ";" << newLine;
+        }
+
+        return name;
+    }
+
+    std::string getConstantTable (const Type& arrayType, ConstantTable::Handle handle)
+    {
+        auto sliceType = getType (arrayType);
+        auto value = handle != 0 ? program.getConstantTable().getValueForHandle (handle) : nullptr;
+
+        if (value == nullptr || value->getType().getArraySize() == 0)
+            return sliceType + " { nullptr, 0 }";
+
+        auto& name = tables[handle];
+
+        if (name.empty())
+        {
+            auto& tableType = value->getType();
+            name = classNames.add ("table_" + std::to_string (handle));
+            auto contents = printValue (*value);
+
+            // The array's own braces are used, rather than the ones around a FixedArray
+            contents = contents.substr (2, contents.length() - 4);
+
+            constantsOut << "static constexpr " << getType (tableType.getArrayElementType()) << " " << name
+                         << "[" << tableType.getArraySize() << "] = " << contents << ";" << newLine;
+        }
+
+        return sliceType + " { " + name + ", " + std::to_string (value->getType().getArraySize()) + " }";
+    }
+
+    //==============================================================================
+    void generateFunction (heart::Function& f)
+    {
+        auto& info = functions.find (std::addressof (f))->second;
+
+        if (hasNativeImplementationOnly (f))
+            return;
+
+        FunctionContext context (classNames);
+        context.function = std::addressof (f);
+        context.isRun = f.functionType.isRun();
+
+        if (info.module.isProcessor())
+        {
+            context.processor = std::addressof (processors[std::addressof (info.module)]);
+            context.names.reserve ({ "_state" });
+        }
+
+        std::vector<std::pair<std::string, std::string>> params;
+
+        if (context.processor != nullptr)
+            params.push_back ({ context.processor->stateType + "* SOUL_CPP_RESTRICT", "_state" });
+
+        for (auto& p : f.parameters)
+        {
+            auto name = context.names.add (p->name.toString());
+            context.variables[p.getPointer()] = name;
+            params.push_back ({ getParameterType (p->type), name });
+        }
+
+        std::vector<std::string> localDeclarations;
+        auto persistentLocals = context.isRun ? findLocalsWhichOutliveAdvance (f) : std::unordered_set<const heart::Variable*>();
+
+        auto addLocal = [&] (heart::Variable& v)
+        {
+            if (context.variables.find (std::addressof (v)) != context.variables.end())
+                return;
+
+            auto name = v.name.isValid() ? v.name.toString() : std::string ("temp");
+
+            if (persistentLocals.find (std::addressof (v)) != persistentLocals.end())
+            {
+                auto member = context.processor->members.add ("local_" + name);
+                context.processor->runLocals.push_back ({ member, v.type });
+                context.variables[std::addressof (v)] = "_state->" + member;
+                return;
+            }
+
+            auto localName = context.names.add (name);
+            context.variables[std::addressof (v)] = localName;
+            localDeclarations.push_back (getType (v.type.removeConstIfPresent().removeReferenceIfPresent()) + " " + localName + ";");
+        };
+
+        for (auto& b : f.blocks)
+        {
+            context.blocks[b.getPointer()] = context.labels.add (b->name.toString().substr (1));
+
+            for (auto& p : b->parameters)
+                addLocal (p);
+        }
+
+        for (size_t i = 0; i < f.blocks.size(); ++i)
+            addJumpTargets (f.blocks[i], i + 1 < f.blocks.size() ? f.blocks[i + 1].getPointer() : nullptr, context.jumpTargets);
+
+        for (auto& v : f.getAllLocalVariables())
+            addLocal (v);
+
+        if (context.isRun)
+            for (auto& b : f.blocks)
+                for (auto s : b->statements)
+                    if (is_type<heart::AdvanceClock> (*s))
+                        context.resumeLabels.push_back (context.labels.add ("resume_" + std::to_string (context.resumeLabels.size() + 1)));
+
+        choc::text::CodePrinter body;
+
+        {
+            auto indent = body.createIndentWithBraces();
+
+            for (auto& d : localDeclarations)
+                body << d << newLine;
+
+            if (! localDeclarations.empty())
+                body << blankLine;
+
+            if (context.isRun)
+            {
+                auto& module = info.module;
+
+                for (size_t i = 0; i < module.outputs.size(); ++i)
+                    if (module.outputs[i]->isStreamEndpoint())
+                        body << "_state->" << context.processor->outputs[i] << " = {};" << newLine;
+
+                body << blankLine << "switch (_state->resumePoint)" << newLine;
+
+                {
+                    auto switchIndent = body.createIndentWithBraces();
+                    body << "case 0:   break;" << newLine;
+
+                    for (size_t i = 0; i < context.resumeLabels.size(); ++i)
+                        body << "case " << (i + 1) << ":   goto " << context.resumeLabels[i] << ";" << newLine;
+
+                    body << "default:  return;" << newLine;
+                }
+
+                body << newLine << blankLine;
+            }
+
+            for (size_t i = 0; i < f.blocks.size(); ++i)
+                generateBlock (context, f.blocks[i], i + 1 < f.blocks.size() ? f.blocks[i + 1].getPointer() : nullptr, body);
+        }
+
+        // Parameters that the body doesn't use are left unnamed, to avoid unused-parameter warnings
+        auto bodyCode = body.toString();
+        std::vector<std::string> paramDeclarations;
+
+        for (auto& p : params)
+            paramDeclarations.push_back (containsIdentifier (bodyCode, p.second) ? p.first + " " + p.second : p.first);
+
+        functionsOut << getType (f.returnType) << " " << info.name << " (" << joinStrings (paramDeclarations, ", ") << ") noexcept" << newLine
+                     << bodyCode;
+
+        functionsOut << blankLine;
+    }
+
+    static bool containsIdentifier (const std::string& code, const std::string& name)
+    {
+        auto isIdentifierChar = [] (char c) { return std::isalnum (static_cast<unsigned char> (c)) || c == '_'; };
+
+        for (auto pos = code.find (name); pos != std::string::npos; pos = code.find (name, pos + 1))
+            if ((pos == 0 || ! isIdentifierChar (code[pos - 1]))
+                 && (pos + name.length() == code.length() || ! isIdentifierChar (code[pos + name.length()])))
+                return true;
+
+        return false;
+    }
+
+    void generateBlock (FunctionContext& context, heart::Block& block, const heart::Block* nextBlock, choc::text::CodePrinter& out)
+    {
+        bool hasLabel = context.jumpTargets.find (std::addressof (block)) != context.jumpTargets.end();
+
+        if (hasLabel)
+        {
+            out.addIndent (-2);
+            out << context.blocks[std::addressof (block)] << ":" << newLine;
+            out.addIndent (2);
+        }
+
+        for (auto s : block.statements)
+            generateStatement (context, *s, out);
+
+        if (auto b = cast<heart::Branch> (block.terminator))
+        {
+            generateJump (context, b->target, b->targetArgs, nextBlock, out);
+        }
+        else if (auto bi = cast<heart::BranchIf> (block.terminator))
+        {
+            if (! bi->isConditional())
+            {
+                generateJump (context, bi->targets[0], bi->targetArgs[0], nextBlock, out);
+            }
+            else if (hasArguments (*bi))
+            {
+                out << "if (" << getExpression (context, bi->condition, PrimitiveType::bool_) << ")" << newLine;
+
+                {
+                    auto indent = out.createIndentWithBraces();
+                    generateJump (context, bi->targets[0], bi->targetArgs[0], nullptr, out);
+                }
+
+                out << newLine;
+                generateJump (context, bi->targets[1], bi->targetArgs[1], nextBlock, out);
+            }
+            else
+            {
+                auto condition = getExpression (context, bi->condition, PrimitiveType::bool_);
+
+                if (bi->targets[0].getPointer() == nextBlock)
+                {
+                    out << "if (! " << condition << ")  goto " << context.blocks[bi->targets[1].getPointer()] << ";" << newLine;
+                }
+                else
+                {
+                    out << "if (" << condition << ")  goto " << context.blocks[bi->targets[0].getPointer()] << ";" << newLine;
+
+                    if (bi->targets[1].getPointer() != nextBlock)
+                        out << "goto " << context.blocks[bi->targets[1].getPointer()] << ";" << newLine;
+                }
+            }
+        }
+        else if (auto r = cast<heart::ReturnValue> (block.terminator))
+        {
+            out << "return " << getExpression (context, r->returnValue, context.function->returnType) << ";" << newLine;
+        }
+        else if (context.isRun)
+        {
+            out << "_state->resumePoint = -1;" << newLine
+                << "return;" << newLine;
+        }
+        else if (nextBlock != nullptr || (hasLabel && block.statements.empty()))
+        {
+            // A label can't be the last thing before a closing brace, so an empty final block still needs its return
+            out << "return;" << newLine;
+        }
+
+        if (nextBlock != nullptr)
+            out << blankLine;
+    }
+
+    static bool hasArguments (const heart::BranchIf& b)
+    {
+        return ! (b.targetArgs[0].empty() && b.targetArgs[1].empty());
+    }
+
+    /** Finds the blocks that need a label, because a goto is generated for a jump to them. */
+    static void addJumpTargets (const heart::Block& block, const heart::Block* nextBlock, std::unordered_set<const heart::Block*>& targets)
+    {
+        auto add = [&] (const heart::Block& target)
+        {
+            if (std::addressof (target) != nextBlock)
+                targets.insert (std::addressof (target));
+        };
+
+        if (auto b = cast<heart::Branch> (block.terminator))
+        {
+            add (b->target);
+        }
+        else if (auto bi = cast<heart::BranchIf> (block.terminator))
+        {
+            if (! bi->isConditional())
+            {
+                add (bi->targets[0]);
+            }
+            else if (hasArguments (*bi) || bi->targets[0].getPointer() != nextBlock)
+            {
+                targets.insert (bi->targets[0].getPointer());
+                add (bi->targets[1]);
+            }
+            else
+            {
+                targets.insert (bi->targets[1].getPointer());
+            }
+        }
+    }
+
+    template <typename ArgList>
+    void generateJump (FunctionContext& context, heart::Block& target, const ArgList& args,
+                       const heart::Block* nextBlock, choc::text::CodePrinter& out)
+    {
+        if (args.size() == 1)
+        {
+            out << context.variables[target.parameters.front().getPointer()] << " = "
+                << getExpression (context, args.front(), target.parameters.front()->type) << ";" << newLine;
+        }
+        else if (! args.empty())
+        {
+            // The arguments may refer to the parameters, so they're all evaluated before any are set
+            auto indent = out.createIndentWithBraces();
+
+            for (size_t i = 0; i < args.size(); ++i)
+                out << "auto _arg" << i << " = " << getExpression (context, args[i], target.parameters[i]->type) << ";" << newLine;
+
+            for (size_t i = 0; i < args.size(); ++i)
+                out << context.variables[target.parameters[i].getPointer()] << " = _arg" << i << ";" << newLine;
+        }
+
+        if (args.size() > 1)
+            out << newLine;
+
+        if (std::addressof (target) != nextBlock)
+            out << "goto " << context.blocks[std::addressof (target)] << ";" << newLine;
+    }
+
+    void generateStatement (FunctionContext& context, heart::Statement& s, choc::text::CodePrinter& out)
+    {
+        if (auto a = cast<heart::AssignFromValue> (s))
+        {
+            out << getTarget (context, *a->target) << " = " << getExpression (context, a->source, a->target->getType()) << ";" << newLine;
+            return;
+        }
+
+        if (auto call = cast<heart::FunctionCall> (s))
+        {
+            auto& fn = call->getFunction();
+            auto callCode = getCall (context, fn, call->arguments);
+
+            if (call->target != nullptr)
+                out << getTarget (context, *call->target) << " = " << convert (callCode, fn.returnType, call->target->getType()) << ";" << newLine;
+            else
+                out << callCode << ";" << newLine;
+
+            return;
+        }
+
+        if (auto r = cast<heart::ReadStream> (s))
+        {
+            auto& input = r->source.get();
+            auto& member = getProcessor (context).inputs[input.index];
+            out << getTarget (context, *r->target) << " = " << convert ("_state->" + member, input.dataTypes.front(), r->target->getType()) << ";" << newLine;
+            return;
+        }
+
+        if (auto w = cast<heart::WriteStream> (s))
+            return generateWrite (context, *w, out);
+
+        if (is_type<heart::AdvanceClock> (s))
+        {
+            if (! context.isRun)
+                throwError (Errors::notYetImplemented ("calls to advance() outside the run function in generated C++"));
+
+            auto index = context.numResumePointsGenerated++;
+            out << "_state->resumePoint = " << (index + 1) << ";" << newLine
+                << "return;" << newLine;
+            out.addIndent (-2);
+            out << context.resumeLabels[index] << ":" << newLine;
+            out.addIndent (2);
+            return;
+        }
+
+        throwError (Errors::notYetImplemented ("C++ generation for this statement"));
+    }
+
+    ProcessorInfo& getProcessor (const FunctionContext& context)
+    {
+        if (context.processor == nullptr)
+            throwError (Errors::notYetImplemented ("endpoint access outside a processor"));
+
+        return *context.processor;
+    }
+
+    void generateWrite (FunctionContext& context, heart::WriteStream& w, choc::text::CodePrinter& out)
+    {
+        auto& output = w.target.get();
+        auto& processor = getProcessor (context);
+        auto& valueType = w.value->getType();
+
+        if (output.isEventEndpoint())
+        {
+            auto typeIndex = findType (output, valueType);
+
+            if (typeIndex < 0)
+                throwError (Errors::notYetImplemented ("writing a " + valueType.getDescription() + " to " + output.name.toString()));
+
+            auto& type = output.dataTypes[static_cast<size_t> (typeIndex)];
+            auto element = w.element != nullptr ? getIndex (context, *w.element, output.arraySize.value_or (1)) : std::string ("0");
+
+            out << getEventSenderName (functions.find (context.function)->second.module, output, type)
+                << " (_state->instanceIndex, " << element << ", " << getExpression (context, w.value, type) << ");" << newLine;
+            return;
+        }
+
+        auto target = "_state->" + processor.outputs[output.index];
+        auto& type = output.dataTypes.front();
+
+        if (w.element != nullptr)
+            target += "[" + getIndex (context, *w.element, output.arraySize.value_or (1)) + "]";
+        else if (output.arraySize.has_value())
+            throwError (Errors::notYetImplemented ("writing to a whole endpoint array"));
+
+        if (output.isStreamEndpoint())
+            out << "addTo (" << target << ", " << getExpression (context, w.value, type) << ");" << newLine;
+        else
+            out << target << " = " << getExpression (context, w.value, type) << ";" << newLine;
+    }
+
+    static int findType (const heart::IODeclaration& d, const Type& type)
+    {
+        for (size_t i = 0; i < d.dataTypes.size(); ++i)
+            if (d.dataTypes[i].isEqual (type, Type::ignoreVectorSize1 | Type::ignoreConst | Type::ignoreReferences))
+                return static_cast<int> (i);
+
+        return -1;
+    }
+
+    std::string getEventSenderName (const Module& module, const heart::IODeclaration& output, const Type& type)
+    {
+        auto key = std::addressof (output);
+        auto typeIndex = static_cast<size_t> (findType (output, type));
+        auto& names = eventSenders[key];
+
+        if (names.empty())
+            for (auto& t : output.dataTypes)
+                names.push_back (classNames.add ("send_" + getModuleName (module) + "_" + output.name.toString()
+                                                  + (output.dataTypes.size() > 1 ? "_" + t.getShortIdentifierDescription() : std::string())));
+
+        return names[typeIndex];
+    }
+
+    std::unordered_map<const heart::IODeclaration*, std::vector<std::string>> eventSenders;
+
+    //==============================================================================
+    template <typename ArgList>
+    std::string getCall (FunctionContext& context, heart::Function& fn, const ArgList& arguments)
+    {
+        if (fn.intrinsicType == IntrinsicType::get_array_size && arguments.size() == 1)
+        {
+            auto arrayType = normalise (arguments.front()->getType());
+
+            if (arrayType.isFixedSizeArray() || arrayType.isVector())
+                return std::to_string (arrayType.isVector() ? arrayType.getVectorSize() : arrayType.getArraySize());
+
+            if (arrayType.isUnsizedArray())
+                return getExpression (context, arguments.front()) + ".numElements";
+        }
+
+        std::vector<std::string> args;
+
+        for (size_t i = 0; i < arguments.size(); ++i)
+        {
+            auto& paramType = fn.parameters[i]->type;
+
+            if (paramType.isReference() && ! paramType.isConst())
+                args.push_back (getTarget (context, arguments[i]));
+            else
+                args.push_back (getExpression (context, arguments[i], paramType.removeConstIfPresent().removeReferenceIfPresent()));
+        }
+
+        if (fn.intrinsicType != IntrinsicType::none)
+        {
+            auto native = getNativeIntrinsic (fn, args);
+
+            if (! native.empty())
+                return native;
+        }
+
+        if (hasNativeImplementationOnly (fn))
+            throwError (Errors::notYetImplemented ("calls to " + fn.getReadableName() + " in generated C++"));
+
+        auto& info = functions.find (std::addressof (fn))->second;
+
+        if (info.module.isProcessor())
+        {
+            if (context.processor == nullptr)
+                throwError (Errors::notYetImplemented ("calls to processor functions from outside a processor"));
+
+            args.insert (args.begin(), "_state");
+        }
+
+        return info.name + " (" + joinStrings (args, ", ") + ")";
+    }
+
+    bool hasNativeIntrinsic (const heart::Function& fn)
+    {
+        return fn.intrinsicType != IntrinsicType::none
+                && ! getNativeIntrinsic (fn, std::vector<std::string> (fn.parameters.size(), "x")).empty();
+    }
+
+    /** Returns a call to the standard library for an intrinsic, or an empty string if the
+        HEART version of the function should be used instead.
+    */
+    std::string getNativeIntrinsic (const heart::Function& fn, const std::vector<std::string>& args)
+    {
+        if (args.empty() || args.size() > 3 || args.size() != fn.parameters.size())
+            return {};
+
+        auto argType = normalise (fn.parameters.front()->type);
+
+        for (auto& p : fn.parameters)
+            if (p->type.isBoundedInt() || ! normalise (p->type).isIdentical (argType))
+                return {};
+
+        if (! (argType.isPrimitive() || argType.isVector()))
+            return {};
+
+        auto elementType = argType.isVector() ? argType.getElementType() : argType;
+        auto isFloat = elementType.isFloatingPoint();
+        auto isInt = elementType.isInteger();
+        auto returnType = normalise (fn.returnType);
+        std::string function;
+
+        switch (fn.intrinsicType)
+        {
+            case IntrinsicType::sqrt:    case IntrinsicType::exp:     case IntrinsicType::log:
+            case IntrinsicType::log10:   case IntrinsicType::sin:     case IntrinsicType::cos:
+            case IntrinsicType::tan:     case IntrinsicType::sinh:    case IntrinsicType::cosh:
+            case IntrinsicType::tanh:    case IntrinsicType::asinh:   case IntrinsicType::acosh:
+            case IntrinsicType::atanh:   case IntrinsicType::asin:    case IntrinsicType::acos:
+            case IntrinsicType::atan:
+                if (isFloat && args.size() == 1)
+                    function = "std::" + std::string (getIntrinsicName (fn.intrinsicType));
+
+                break;
+
+            case IntrinsicType::floor:   case IntrinsicType::ceil:
+                if (isFloat && args.size() == 1 && argType.isPrimitive())
+                    function = "std::" + std::string (getIntrinsicName (fn.intrinsicType));
+
+                break;
+
+            case IntrinsicType::isnan:   case IntrinsicType::isinf:
+                if (isFloat && args.size() == 1 && argType.isPrimitive() && returnType.isBool())
+                    return "std::" + std::string (getIntrinsicName (fn.intrinsicType)) + " (" + args[0] + ")";
+
+                return {};
+
+            case IntrinsicType::roundToInt:
+                if (isFloat && args.size() == 1 && argType.isPrimitive()
+                     && returnType.isIdentical (elementType.isFloat32() ? PrimitiveType::int32 : PrimitiveType::int64))
+                    return "roundToInt (" + args[0] + ")";
+
+                return {};
+
+            case IntrinsicType::abs:
+                if ((isFloat || isInt) && args.size() == 1 && argType.isPrimitive())
+                    function = "absOf";
+
+                break;
+
+            case IntrinsicType::pow:     case IntrinsicType::fmod:    case IntrinsicType::atan2:
+                if (isFloat && args.size() == 2 && argType.isPrimitive())
+                    function = "std::" + std::string (getIntrinsicName (fn.intrinsicType));
+
+                break;
+
+            case IntrinsicType::addModulo2Pi:
+                if (isFloat && args.size() == 2 && argType.isPrimitive())
+                    function = "addModulo2Pi";
+
+                break;
+
+            case IntrinsicType::min:     case IntrinsicType::max:
+                if ((isFloat || isInt) && args.size() == 2 && argType.isPrimitive())
+                    function = fn.intrinsicType == IntrinsicType::min ? "minOf" : "maxOf";
+
+                break;
+
+            case IntrinsicType::clamp:
+                if ((isFloat || isInt) && args.size() == 3 && argType.isPrimitive())
+                    function = "clampOf";
+
+                break;
+
+            case IntrinsicType::fma:
+                if (isFloat && args.size() == 3 && argType.isPrimitive())
+                    function = "std::fma";
+
+                break;
+
+            default:
+                break;
+        }
+
+        if (function.empty() || ! returnType.isIdentical (argType))
+            return {};
+
+        if (argType.isPrimitive())
+            return function + " (" + joinStrings (args, ", ") + ")";
+
+        auto element = getType (elementType);
+        return "map<" + element + "> (" + args[0] + ", [] (" + element + " _x) { return " + function + " (_x); })";
+    }
+
+    //==============================================================================
+    std::string getVariable (FunctionContext& context, const heart::Variable& v)
+    {
+        auto local = context.variables.find (std::addressof (v));
+
+        if (local != context.variables.end())
+            return local->second;
+
+        auto external = externalVariables.find (std::addressof (v));
+
+        if (external != externalVariables.end())
+            return "externals." + external->second;
+
+        auto global = globalVariables.find (std::addressof (v));
+
+        if (global != globalVariables.end())
+            return "state.globals." + global->second;
+
+        auto member = stateVariables.find (std::addressof (v));
+
+        if (member != stateVariables.end() && context.processor != nullptr)
+            return "_state->" + member->second;
+
+        throwError (Errors::notYetImplemented ("C++ generation for a reference to " + v.name.toString()));
+    }
+
+    /** Returns an expression which can be assigned to. */
+    std::string getTarget (FunctionContext& context, heart::Expression& e)
+    {
+        for (pool_ptr<heart::Expression> parent = e;;)
+        {
+            if (auto element = cast<heart::ArrayElement> (parent))
+            {
+                if (element->parent->getType().isUnsizedArray())
+                    throwError (Errors::notYetImplemented ("writing to elements of an unsized array in generated C++"));
+
+                parent = element->parent;
+            }
+            else if (auto member = cast<heart::StructElement> (parent))
+            {
+                parent = member->parent;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        return getExpression (context, e);
+    }
+
+    std::string getExpression (FunctionContext& context, heart::Expression& e, const Type& targetType)
+    {
+        if (auto c = cast<heart::Constant> (e))
+        {
+            auto value = c->value.tryCastToType (targetType.removeConstIfPresent().removeReferenceIfPresent());
+
+            if (value.isValid())
+                return getConstant (value);
+        }
+
+        return convert (getExpression (context, e), e.getType(), targetType);
+    }
+
+    std::string getExpression (FunctionContext& context, heart::Expression& e)
+    {
+        if (auto v = cast<heart::Variable> (e))
+            return getVariable (context, *v);
+
+        if (auto c = cast<heart::Constant> (e))
+            return getConstant (c->value);
+
+        if (auto element = cast<heart::ArrayElement> (e))
+            return getArrayElement (context, *element);
+
+        if (auto member = cast<heart::StructElement> (e))
+            return getExpression (context, member->parent) + "." + getStruct (member->parent->getType().getStructRef()).members[member->getMemberIndex()];
+
+        if (auto c = cast<heart::TypeCast> (e))
+            return getExpression (context, c->source, c->destType);
+
+        if (auto u = cast<heart::UnaryOperator> (e))
+            return getUnaryOp (context, *u);
+
+        if (auto b = cast<heart::BinaryOperator> (e))
+            return getBinaryOp (context, *b);
+
+        if (auto call = cast<heart::PureFunctionCall> (e))
+            return getCall (context, call->function, call->arguments);
+
+        if (auto p = cast<heart::ProcessorProperty> (e))
+        {
+            if (context.processor == nullptr)
+                throwError (Errors::notYetImplemented ("processor properties outside a processor"));
+
+            switch (p->property)
+            {
+                case heart::ProcessorProperty::Property::period:      return "_state->period";
+                case heart::ProcessorProperty::Property::frequency:   return "_state->frequency";
+                case heart::ProcessorProperty::Property::id:          return "_state->id";
+                case heart::ProcessorProperty::Property::session:     return "_state->session";
+                case heart::ProcessorProperty::Property::none:
+                default:                                              break;
+            }
+        }
+
+        throwError (Errors::notYetImplemented ("C++ generation for this expression"));
+    }
+
+    std::string getIndex (FunctionContext& context, heart::Expression& index, size_t arraySize)
+    {
+        auto& indexType = index.getType();
+
+        if (indexType.isBoundedInt() && static_cast<size_t> (indexType.getBoundedIntLimit()) <= arraySize)
+            return getExpression (context, index);
+
+        if (auto c = cast<heart::Constant> (index))
+        {
+            auto n = c->value.getAsInt64();
+
+            if (n >= 0 && static_cast<uint64_t> (n) < arraySize)
+                return std::to_string (n);
+        }
+
+        return "wrapIndex (" + getExpression (context, index) + ", " + std::to_string (arraySize) + ")";
+    }
+
+    std::string getArrayElement (FunctionContext& context, heart::ArrayElement& e)
+    {
+        auto& parentType = e.parent->getType();
+        auto parent = getExpression (context, e.parent);
+
+        if (parentType.isPrimitive())
+            return parent;
+
+        if (e.isDynamic())
+        {
+            if (parentType.isUnsizedArray())
+                return parent + "[" + getExpression (context, *e.dynamicIndex) + "]";
+
+            return parent + "[" + getIndex (context, *e.dynamicIndex, parentType.getArrayOrVectorSize()) + "]";
+        }
+
+        if (e.isSlice())
+        {
+            if (parentType.isUnsizedArray())
+                throwError (Errors::notYetImplemented ("slices of unsized arrays in generated C++"));
+
+            return parent + ".slice<" + std::to_string (e.fixedStartIndex) + ", " + std::to_string (e.getSliceSize()) + ">()";
+        }
+
+        return parent + "[" + std::to_string (e.fixedStartIndex) + "]";
+    }
+
+    //==============================================================================
+    /** Returns an expression that converts a value from one type to another. */
+    std::string convert (const std::string& expression, const Type& sourceType, const Type& destType)
+    {
+        auto source = normalise (sourceType);
+        auto dest = normalise (destType);
+
+        if (dest.isBoundedInt())
+        {
+            if (source.isBoundedInt() && source.getBoundedIntLimit() <= dest.getBoundedIntLimit())
+                return expression;
+
+            if (source.isPrimitive() || source.isBoundedInt())
+            {
+                auto value = source.isFloatingPoint() ? "convertElement<int64_t> (" + expression + ")" : expression;
+                return std::string (dest.isWrapped() ? "wrapInt (" : "clampInt (") + value + ", " + std::to_string (dest.getBoundedIntLimit()) + ")";
+            }
+        }
+
+        if (source.isIdentical (dest) || (source.isBoundedInt() && dest.isInteger32()))
+            return expression;
+
+        if (dest.isUnsizedArray())
+        {
+            if (source.isFixedSizeArray() && source.getArrayElementType().isIdentical (dest.getArrayElementType()))
+                return getType (dest) + " { " + expression + ".elements, " + std::to_string (source.getArraySize()) + " }";
+        }
+        else
+        {
+            auto sourceLayout = getElementLayout (source);
+            auto destLayout = getElementLayout (dest);
+
+            if (sourceLayout.isValid() && destLayout.isValid())
+            {
+                if (sourceLayout.numElements == 1)
+                {
+                    auto scalar = convertScalar (expression, sourceLayout.elementType, destLayout.elementType);
+
+                    if (dest.isPrimitive())
+                        return scalar;
+
+                    return getType (dest) + "::broadcast (" + scalar + ")";
+                }
+
+                if (sourceLayout.numElements == destLayout.numElements)
+                {
+                    if (sourceLayout.elementType.isIdentical (destLayout.elementType) && (source.isVector() == dest.isVector()))
+                        return expression;
+
+                    return "convertElements<" + getType (dest) + "> (" + expression + ")";
+                }
+            }
+        }
+
+        throwError (Errors::notYetImplemented ("casts from " + source.getDescription() + " to " + dest.getDescription() + " in generated C++"));
+    }
+
+    std::string convertScalar (const std::string& expression, const Type& source, const Type& dest)
+    {
+        if (source.isIdentical (dest))
+            return expression;
+
+        if (dest.isBool() || (source.isFloatingPoint() && dest.isInteger()))
+            return "convertElement<" + getType (dest) + "> (" + expression + ")";
+
+        return "static_cast<" + getType (dest) + "> (" + expression + ")";
+    }
+
+    std::string getUnaryOp (FunctionContext& context, heart::UnaryOperator& u)
+    {
+        auto type = normalise (u.source->getType());
+        auto layout = getElementLayout (type);
+
+        if (! layout.isValid() || (layout.numElements > 1 && ! type.isVector()))
+            throwError (Errors::notYetImplemented ("unary operators on " + type.getDescription() + " in generated C++"));
+
+        auto source = getExpression (context, u.source);
+
+        if (type.isPrimitive() || type.isBoundedInt())
+            return getScalarUnaryOp (u.operation, layout.elementType, source);
+
+        auto element = getType (layout.elementType);
+        auto result = u.operation == UnaryOp::Op::logicalNot ? std::string ("bool") : element;
+
+        return "map<" + result + "> (" + source + ", [] (" + element + " _x) { return "
+                 + getScalarUnaryOp (u.operation, layout.elementType, "_x") + "; })";
+    }
+
+    std::string getScalarUnaryOp (UnaryOp::Op op, const Type& type, const std::string& a)
+    {
+        switch (op)
+        {
+            case UnaryOp::Op::negate:       return type.isInteger() ? "wrappingNegate (" + a + ")" : "(-" + a + ")";
+            case UnaryOp::Op::logicalNot:   return "(! " + a + ")";
+            case UnaryOp::Op::bitwiseNot:   return type.isBool() ? "(! " + a + ")" : "static_cast<" + getType (type) + "> (~" + a + ")";
+            case UnaryOp::Op::unknown:
+            default:                        break;
+        }
+
+        throwError (Errors::notYetImplemented ("this unary operator in generated C++"));
+    }
+
+    std::string getBinaryOp (FunctionContext& context, heart::BinaryOperator& b)
+    {
+        auto types = BinaryOp::getTypes (b.operation, b.lhs->getType(), b.rhs->getType());
+        auto operandType = normalise (types.operandType);
+        auto operands = getElementLayout (operandType);
+        auto results = getElementLayout (types.resultType);
+
+        if (! operands.isValid() || operands.numElements != results.numElements
+             || (operands.numElements > 1 && ! operandType.isVector()))
+            throwError (Errors::notYetImplemented ("binary operators on " + operandType.getDescription() + " in generated C++"));
+
+        auto lhs = getExpression (context, b.lhs, operandType);
+        auto rhs = getExpression (context, b.rhs, operandType);
+
+        if (! operandType.isVector())
+        {
+            auto result = getScalarBinaryOp (b.operation, operands.elementType, lhs, rhs);
+
+            // Arithmetic on a wrap<N> or clamp<N> has to bring the result back into range, as the interpreter does
+            if (types.resultType.isBoundedInt())
+                return std::string (types.resultType.isWrapped() ? "wrapInt (" : "clampInt (") + result + ", "
+                         + std::to_string (types.resultType.getBoundedIntLimit()) + ")";
+
+            return result;
+        }
+
+        auto element = getType (operands.elementType);
+
+        return "map<" + getType (results.elementType) + "> (" + lhs + ", " + rhs + ", [] (" + element + " _x, " + element + " _y) { return "
+                 + getScalarBinaryOp (b.operation, operands.elementType, "_x", "_y") + "; })";
+    }
+
+    std::string getScalarBinaryOp (BinaryOp::Op op, const Type& type, const std::string& a, const std::string& b)
+    {
+        auto isInt = type.isInteger();
+        auto call = [&] (const char* function) { return std::string (function) + " (" + a + ", " + b + ")"; };
+        auto infix = [&] (const char* symbol) { return "(" + a + " " + symbol + " " + b + ")"; };
+
+        switch (op)
+        {
+            case BinaryOp::Op::add:                  return isInt ? call ("wrappingAdd")      : infix ("+");
+            case BinaryOp::Op::subtract:             return isInt ? call ("wrappingSubtract") : infix ("-");
+            case BinaryOp::Op::multiply:             return isInt ? call ("wrappingMultiply") : infix ("*");
+            case BinaryOp::Op::divide:               return isInt ? call ("divideInt")        : infix ("/");
+            case BinaryOp::Op::modulo:               return isInt ? call ("moduloInt")        : call ("std::fmod");
+            case BinaryOp::Op::bitwiseOr:            return "static_cast<" + getType (type) + "> " + infix ("|");
+            case BinaryOp::Op::bitwiseAnd:           return "static_cast<" + getType (type) + "> " + infix ("&");
+            case BinaryOp::Op::bitwiseXor:           return "static_cast<" + getType (type) + "> " + infix ("^");
+            case BinaryOp::Op::logicalOr:            return infix ("||");
+            case BinaryOp::Op::logicalAnd:           return infix ("&&");
+            case BinaryOp::Op::equals:               return infix ("==");
+            case BinaryOp::Op::notEquals:            return infix ("!=");
+            case BinaryOp::Op::lessThan:             return infix ("<");
+            case BinaryOp::Op::lessThanOrEqual:      return infix ("<=");
+            case BinaryOp::Op::greaterThan:          return infix (">");
+            case BinaryOp::Op::greaterThanOrEqual:   return infix (">=");
+            case BinaryOp::Op::leftShift:            return call ("shiftLeft");
+            case BinaryOp::Op::rightShift:           return call ("shiftRight");
+            case BinaryOp::Op::rightShiftUnsigned:   return call ("shiftRightUnsigned");
+            case BinaryOp::Op::unknown:
+            default:                                 break;
+        }
+
+        throwError (Errors::notYetImplemented ("this binary operator in generated C++"));
+    }
+
+    //==============================================================================
+    /** Finds the locals of a run() function whose values may be needed after an advance(), which
+        have to be kept in the processor's state. Everything else can be an ordinary local.
+        A variable can stay local if it's only used in one block, where it's assigned before
+        it's read, without an advance() in between.
+    */
+    static std::unordered_set<const heart::Variable*> findLocalsWhichOutliveAdvance (heart::Function& f)
+    {
+        struct Usage
+        {
+            const heart::Block* block = nullptr;
+            bool isAssigned = false, isStale = false;
+        };
+
+        std::unordered_map<const heart::Variable*, Usage> usage;
+        std::unordered_set<const heart::Variable*> result;
+
+        auto access = [&] (const heart::Variable& v, const heart::Block& b, bool isAssignment)
+        {
+            if (! (v.isMutableLocal() || v.isConstant()))
+                return;
+
+            auto& u = usage[std::addressof (v)];
+
+            if (u.block == nullptr)
+                u.block = std::addressof (b);
+
+            if (u.block != std::addressof (b))
+            {
+                result.insert (std::addressof (v));
+            }
+            else if (isAssignment)
+            {
+                u.isAssigned = true;
+                u.isStale = false;
+            }
+            else if (! u.isAssigned || u.isStale)
+            {
+                result.insert (std::addressof (v));
+            }
+        };
+
+        for (auto& b : f.blocks)
+        {
+            for (auto& p : b->parameters)
+                result.insert (p.getPointer());
+
+            for (auto s : b->statements)
+            {
+                if (is_type<heart::AdvanceClock> (*s))
+                {
+                    for (auto& u : usage)
+                        u.second.isStale = true;
+
+                    continue;
+                }
+
+                pool_ptr<heart::Variable> assigned;
+
+                if (auto a = cast<heart::Assignment> (*s))
+                    if (a->target != nullptr)
+                        assigned = cast<heart::Variable> (*a->target);
+
+                s->visitExpressions ([&] (pool_ref<heart::Expression>& e, AccessType mode)
+                {
+                    if (auto v = cast<heart::Variable> (e))
+                        if (v != assigned || mode != AccessType::write)
+                            access (*v, b, false);
+                });
+
+                if (assigned != nullptr)
+                    access (*assigned, b, true);
+            }
+
+            if (b->terminator != nullptr)
+            {
+                b->terminator->visitExpressions ([&] (pool_ref<heart::Expression>& e, AccessType)
+                {
+                    if (auto v = cast<heart::Variable> (e))
+                        access (*v, b, false);
+                });
+            }
+        }
+
+        return result;
+    }
+
+    //==============================================================================
+    static Type getEndpointType (const heart::IODeclaration& d, int32_t element)
+    {
+        return element >= 0 && d.arraySize.has_value() ? d.dataTypes.front() : d.getFrameOrValueType();
+    }
+
+    std::string getInstanceState (uint32_t instance) const
+    {
+        return "state." + instanceMembers[instance];
+    }
+
+    ProcessorInfo& getProcessor (uint32_t instance)
+    {
+        return processors[graph.instances[instance].module.getPointer()];
+    }
+
+    void generateStates()
+    {
+        std::unordered_set<const Module*> done;
+
+        for (auto& instance : graph.instances)
+        {
+            auto& module = instance.module.get();
+
+            if (! done.insert (std::addressof (module)).second)
+                continue;
+
+            auto& info = processors[std::addressof (module)];
+
+            statesOut << "struct " << info.stateType << newLine;
+
+            {
+                auto indent = statesOut.createIndentWithBraces();
+
+                for (auto& v : module.stateVariables)
+                    if (! v->isExternal())
+                        statesOut << getType (v->type) << " " << stateVariables[v.getPointer()] << ";" << newLine;
+
+                for (size_t i = 0; i < module.inputs.size(); ++i)
+                    if (! info.inputs[i].empty())
+                        statesOut << getType (getEndpointType (module.inputs[i], -1)) << " " << info.inputs[i] << ";" << newLine;
+
+                for (size_t i = 0; i < module.outputs.size(); ++i)
+                    if (! info.outputs[i].empty())
+                        statesOut << getType (getEndpointType (module.outputs[i], -1)) << " " << info.outputs[i] << ";" << newLine;
+
+                for (auto& local : info.runLocals)
+                    statesOut << getType (local.second) << " " << local.first << ";" << newLine;
+
+                statesOut << "double frequency, period;" << newLine
+                          << "int32_t id, session, instanceIndex, resumePoint;" << newLine;
+            }
+
+            statesOut << ";" << blankLine;
+        }
+
+        statesOut << "struct Globals" << newLine;
+
+        {
+            auto indent = statesOut.createIndentWithBraces();
+
+            for (auto& m : program.getModules())
+                if (m->isNamespace())
+                    for (auto& v : m->stateVariables)
+                        if (! v->isExternal())
+                            statesOut << getType (v->type) << " " << globalVariables[v.getPointer()] << ";" << newLine;
+        }
+
+        statesOut << ";" << blankLine
+                  << "struct Externals" << newLine;
+
+        {
+            auto indent = statesOut.createIndentWithBraces();
+
+            for (auto& v : program.getExternalVariables())
+                statesOut << getType (v->type) << " " << externalVariables[v.getPointer()] << ";" << newLine;
+        }
+
+        statesOut << ";" << blankLine;
+    }
+
+    //==============================================================================
+    /** The names of the program's endpoints in the generated class. */
+    struct EndpointNames
+    {
+        std::vector<std::string> renderInputs, renderOutputs, inputValues, outputValues;
+        std::vector<std::vector<std::string>> inputEvents, outputEvents;
+    };
+
+    EndpointNames endpointNames;
+    NameSet renderContextNames, programStateNames;
+
+    struct Route
+    {
+        std::string dest;
+        Type destType;
+        bool isStream = false;
+        std::vector<std::string> sources;
+    };
+
+    std::vector<std::vector<Route>> instanceRoutes;
+    std::vector<Route> outputRoutes;
+    std::vector<std::string> delayLineDeclarations, delayLineUpdates;
+
+    /** Gives each of the overloads for an event endpoint's types its own name, unless they
+        can all share the same one.
+    */
+    std::vector<std::string> getEventNames (const heart::IODeclaration& d, const std::string& prefix, bool canOverload)
+    {
+        std::unordered_set<std::string> cppTypes;
+
+        for (auto& t : d.dataTypes)
+            cppTypes.insert (getType (t));
+
+        std::vector<std::string> names;
+        auto name = prefix + d.name.toString();
+
+        if (d.dataTypes.size() == 1 || (canOverload && cppTypes.size() == d.dataTypes.size()))
+        {
+            auto shared = classNames.add (name);
+
+            for (size_t i = 0; i < d.dataTypes.size(); ++i)
+                names.push_back (shared);
+        }
+        else
+        {
+            for (auto& t : d.dataTypes)
+                names.push_back (classNames.add (name + "_" + t.getShortIdentifierDescription()));
+        }
+
+        return names;
+    }
+
+    void createEndpointNames()
+    {
+        auto& main = program.getMainProcessorOrThrowError();
+        renderContextNames.reserve ({ "numFrames" });
+
+        for (auto& input : main.inputs)
+        {
+            auto isStream = input->isStreamEndpoint();
+            auto isValue = input->isValueEndpoint();
+            endpointNames.renderInputs.push_back (isStream ? renderContextNames.add (input->name.toString()) : std::string());
+            endpointNames.inputValues.push_back (isValue ? classNames.add ("inputValue_" + input->name.toString()) : std::string());
+            endpointNames.inputEvents.push_back (input->isEventEndpoint() ? getEventNames (input, "addInputEvent_", true) : std::vector<std::string>());
+        }
+
+        for (auto& output : main.outputs)
+        {
+            auto isStream = output->isStreamEndpoint();
+            auto isValue = output->isValueEndpoint();
+            endpointNames.renderOutputs.push_back (isStream ? renderContextNames.add (output->name.toString()) : std::string());
+            endpointNames.outputValues.push_back (isValue ? programStateNames.add ("outputValue_" + output->name.toString()) : std::string());
+            endpointNames.outputEvents.push_back (output->isEventEndpoint() ? getEventNames (output, "outputEvent_", false) : std::vector<std::string>());
+        }
+    }
+
+    /** Works out where each of the stream and value inputs of the processors, and the program's
+        outputs, get their values from on each frame.
+    */
+    void createRoutes()
+    {
+        instanceRoutes.resize (graph.instances.size());
+
+        for (auto& c : graph.connections)
+        {
+            auto& source = graph.getSource (program, c);
+            auto& dest = graph.getDest (program, c);
+
+            if (source.isEventEndpoint())
+                continue;
+
+            auto sourceElement = source.arraySize.has_value() ? c.source.element : -1;
+            auto destElement = dest.arraySize.has_value() ? c.dest.element : -1;
+            auto sourceType = getEndpointType (source, sourceElement);
+            auto destType = getEndpointType (dest, destElement);
+            std::string sourceCode, destCode;
+
+            if (c.source.isProgramEndpoint())
+                sourceCode = source.isStreamEndpoint() ? "context." + endpointNames.renderInputs[c.source.endpoint] + "[frame]"
+                                                       : endpointNames.inputValues[c.source.endpoint];
+            else
+                sourceCode = getInstanceState (c.source.instance) + "." + getProcessor (c.source.instance).outputs[c.source.endpoint];
+
+            if (sourceElement >= 0)
+                sourceCode += "[" + std::to_string (sourceElement) + "]";
+
+            if (c.delayLength != 0 && source.isStreamEndpoint())
+            {
+                auto index = std::to_string (delayLineDeclarations.size());
+                auto buffer = programStateNames.add ("delay_" + index);
+                auto position = programStateNames.add ("delayPosition_" + index);
+                auto capacity = getNextPowerOf2 (static_cast<uint32_t> (c.delayLength));
+                auto mask = std::to_string (capacity - 1) + "u";
+
+                // The position just counts up and gets masked, and the delayed frame is the one that
+                // was written delayLength frames ago, which for a full buffer is the next to be overwritten
+                auto readIndex = capacity == static_cast<uint32_t> (c.delayLength)
+                                   ? "state." + position + " & " + mask
+                                   : "(state." + position + " - " + std::to_string (c.delayLength) + "u) & " + mask;
+
+                delayLineDeclarations.push_back ("FixedArray<" + getType (sourceType) + ", " + std::to_string (capacity) + "> " + buffer + ";");
+                delayLineDeclarations.push_back ("uint32_t " + position + ";");
+                delayLineUpdates.push_back ("state." + buffer + "[state." + position + " & " + mask + "] = " + sourceCode + ";");
+                delayLineUpdates.push_back ("++state." + position + ";");
+                sourceCode = "state." + buffer + "[" + readIndex + "]";
+            }
+
+            if (c.dest.isProgramEndpoint())
+                destCode = dest.isStreamEndpoint() ? "context." + endpointNames.renderOutputs[c.dest.endpoint] + "[frame]"
+                                                   : "state." + endpointNames.outputValues[c.dest.endpoint];
+            else
+                destCode = getInstanceState (c.dest.instance) + "." + getProcessor (c.dest.instance).inputs[c.dest.endpoint];
+
+            if (destElement >= 0)
+                destCode += "[" + std::to_string (destElement) + "]";
+
+            auto& routes = c.dest.isProgramEndpoint() ? outputRoutes : instanceRoutes[c.dest.instance];
+            auto route = std::find_if (routes.begin(), routes.end(), [&] (const Route& r) { return r.dest == destCode; });
+
+            if (route == routes.end())
+            {
+                routes.push_back ({ destCode, destType, dest.isStreamEndpoint(), {} });
+                route = routes.end() - 1;
+            }
+
+            route->sources.push_back (convert (sourceCode, sourceType, destType));
+        }
+
+        auto& main = program.getMainProcessorOrThrowError();
+
+        // Stream outputs that nothing is connected to still need to be cleared
+        for (uint32_t i = 0; i < main.outputs.size(); ++i)
+        {
+            if (main.outputs[i]->isStreamEndpoint())
+            {
+                auto dest = "context." + endpointNames.renderOutputs[i] + "[frame]";
+
+                if (std::none_of (outputRoutes.begin(), outputRoutes.end(), [&] (const Route& r) { return startsWith (r.dest, dest); }))
+                    outputRoutes.push_back ({ dest, main.outputs[i]->getFrameOrValueType(), true, { getType (main.outputs[i]->getFrameOrValueType()) + " {}" } });
+            }
+        }
+    }
+
+    static void printRoute (choc::text::CodePrinter& out, const Route& r)
+    {
+        if (! r.isStream)
+        {
+            out << r.dest << " = " << r.sources.back() << ";" << newLine;
+            return;
+        }
+
+        out << r.dest << " = " << r.sources.front() << ";" << newLine;
+
+        for (size_t i = 1; i < r.sources.size(); ++i)
+            out << "addTo (" << r.dest << ", " << r.sources[i] << ");" << newLine;
+    }
+
+    //==============================================================================
+    const heart::Function* findEventHandler (const Module& module, const heart::InputDeclaration& input, const Type& type) const
+    {
+        for (auto& f : module.functions)
+        {
+            if (! f->functionType.isEvent() || f->parameters.empty())
+                continue;
+
+            if (f->name.toString() != heart::getEventFunctionName (input.name.toString(), f->parameters.front()->type))
+                continue;
+
+            auto valueType = f->parameters.back()->type.removeConstIfPresent().removeReferenceIfPresent();
+
+            if (valueType.isEqual (type, Type::ignoreVectorSize1))
+                return f.getPointer();
+        }
+
+        return nullptr;
+    }
+
+    /** Prints the calls that deliver an event of the given type from a source to all the
+        handlers and program outputs that it's connected to.
+    */
+    void printEventDelivery (choc::text::CodePrinter& out, const FlattenedGraph::Endpoint& source,
+                             const Type& type, const std::string& value)
+    {
+        for (auto& c : graph.connections)
+        {
+            if (c.source.instance != source.instance || c.source.endpoint != source.endpoint
+                 || (source.element >= 0 && c.source.element >= 0 && c.source.element != source.element))
+                continue;
+
+            if (! graph.getSource (program, c).isEventEndpoint())
+                continue;
+
+            if (c.delayLength != 0)
+                throwError (Errors::notYetImplemented ("delayed event connections in generated C++"));
+
+            auto& dest = graph.getDest (program, c);
+            auto typeIndex = findType (dest, type);
+
+            if (typeIndex < 0)
+                continue;
+
+            if (c.dest.isProgramEndpoint())
+            {
+                auto& callback = endpointNames.outputEvents[c.dest.endpoint][static_cast<size_t> (typeIndex)];
+                out << "if (" << callback << " != nullptr)  " << callback << " (outputEventContext, currentFrame, " << value << ");" << newLine;
+                continue;
+            }
+
+            auto& module = graph.instances[c.dest.instance].module.get();
+            auto handler = findEventHandler (module, static_cast<const heart::InputDeclaration&> (dest),
+                                             dest.dataTypes[static_cast<size_t> (typeIndex)]);
+
+            if (handler == nullptr)
+                continue;
+
+            auto call = functions.find (handler)->second.name + " (&" + getInstanceState (c.dest.instance);
+
+            if (handler->parameters.size() < 2)
+            {
+                out << call << ", " << value << ");" << newLine;
+            }
+            else if (c.dest.element < 0 && dest.arraySize.has_value())
+            {
+                for (uint32_t i = 0; i < *dest.arraySize; ++i)
+                    out << call << ", " << i << ", " << value << ");" << newLine;
+            }
+            else
+            {
+                out << call << ", " << std::max (0, c.dest.element) << ", " << value << ");" << newLine;
+            }
+        }
+    }
+
+    void generateEventRouting()
+    {
+        std::unordered_set<const Module*> done;
+
+        for (auto& instance : graph.instances)
+        {
+            auto& module = instance.module.get();
+
+            if (! done.insert (std::addressof (module)).second)
+                continue;
+
+            auto& info = processors[std::addressof (module)];
+
+            for (auto& output : module.outputs)
+            {
+                auto senders = eventSenders.find (output.getPointer());
+
+                if (senders == eventSenders.end())
+                    continue;
+
+                auto numElements = output->arraySize.value_or (1);
+
+                for (size_t typeIndex = 0; typeIndex < output->dataTypes.size(); ++typeIndex)
+                {
+                    auto& type = output->dataTypes[typeIndex];
+                    std::vector<std::pair<uint32_t, std::string>> cases;
+
+                    for (auto i : info.instances)
+                    {
+                        for (uint32_t element = 0; element < numElements; ++element)
+                        {
+                            choc::text::CodePrinter delivery;
+                            printEventDelivery (delivery, { i, output->index, output->arraySize.has_value() ? static_cast<int32_t> (element) : -1 },
+                                                type, "value");
+                            auto code = delivery.toString();
+
+                            if (! code.empty())
+                                cases.push_back ({ i * numElements + element, code });
+                        }
+                    }
+
+                    auto needsSwitch = info.instances.size() * numElements > 1 && ! cases.empty();
+
+                    routingOut << "void " << senders->second[typeIndex]
+                               << " (int32_t" << (needsSwitch ? " instanceIndex" : "")
+                               << ", int32_t" << (needsSwitch ? " element" : "")
+                               << ", const " << getType (type) << "&" << (cases.empty() ? "" : " value") << ") noexcept" << newLine;
+
+                    {
+                        auto indent = routingOut.createIndentWithBraces();
+
+                        if (! needsSwitch)
+                        {
+                            for (auto& c : cases)
+                                routingOut << c.second;
+                        }
+                        else
+                        {
+                            routingOut << "switch (instanceIndex * " << numElements << " + element)" << newLine;
+
+                            {
+                                auto switchIndent = routingOut.createIndentWithBraces();
+
+                                for (auto& c : cases)
+                                {
+                                    routingOut << "case " << c.first << ":" << newLine;
+                                    routingOut.addIndent (4);
+                                    routingOut << c.second << "break;" << newLine;
+                                    routingOut.addIndent (-4);
+                                    routingOut << newLine;
+                                }
+
+                                routingOut << "default:  break;" << newLine;
+                            }
+
+                            routingOut << newLine;
+                        }
+                    }
+
+                    routingOut << blankLine;
+                }
+            }
+        }
+    }
+
+    //==============================================================================
+    std::string getRunFunction (uint32_t instance)
+    {
+        for (auto& f : graph.instances[instance].module->functions)
+            if (f->functionType.isRun())
+                return functions.find (f.getPointer())->second.name;
+
+        return {};
+    }
+
+    /** Returns an expression that's true when all the idle flags in an instance's voice are set,
+        or an empty string if there aren't any.
+    */
+    std::string getVoiceIdleTest (uint32_t instance)
+    {
+        std::vector<std::string> flags;
+
+        for (auto i : graph.getVoiceInstances (instance))
+            for (auto& flag : FlattenedGraph::getVoiceIdleFlags (graph.instances[i].module))
+                flags.push_back (getInstanceState (i) + "." + stateVariables[flag.getPointer()]);
+
+        return joinStrings (flags, " && ");
+    }
+
+    /** Wraps an instance's per-frame code so that it's skipped while its voice is idle. */
+    std::string getGatedVoiceCode (uint32_t instance, const std::string& idleTest, const std::string& body)
+    {
+        auto& module = graph.instances[instance].module.get();
+        std::vector<std::string> clears;
+
+        for (size_t i = 0; i < module.outputs.size(); ++i)
+            if (module.outputs[i]->isStreamEndpoint())
+                clears.push_back (getInstanceState (instance) + "." + getProcessor (instance).outputs[i] + " = {};");
+
+        choc::text::CodePrinter code;
+
+        if (clears.empty())
+        {
+            code << "if (! (" << idleTest << "))" << newLine;
+        }
+        else
+        {
+            code << "if (" << idleTest << ")" << newLine;
+
+            {
+                auto indent = code.createIndentWithBraces();
+
+                for (auto& c : clears)
+                    code << c << newLine;
+            }
+
+            code << newLine << "else" << newLine;
+        }
+
+        {
+            auto indent = code.createIndentWithBraces();
+            code << body;
+        }
+
+        return code.toString();
+    }
+
+    void generateAPI()
+    {
+        auto& main = program.getMainProcessorOrThrowError();
+        double sampleRate = settings.sampleRate;
+
+        std::string sampleRateText;
+        ValuePrinter::appendFloat<double> (sampleRateText, sampleRate);
+
+        apiOut << "static constexpr double sampleRate = " << sampleRateText << ";" << blankLine;
+
+        // init() and reset()
+        apiOut << "/** Prepares the program to be rendered. This must be called before render(), and after" << newLine
+               << "    any external variables have been set." << newLine
+               << "*/" << newLine
+               << "void init (int32_t sessionID = " << settings.sessionID << ") noexcept" << newLine;
+
+        {
+            auto indent = apiOut.createIndentWithBraces();
+            apiOut << "state = {};" << blankLine;
+
+            for (uint32_t i = 0; i < graph.instances.size(); ++i)
+            {
+                auto& instance = graph.instances[i];
+                auto frequency = sampleRate * std::pow (2.0, instance.rateShift);
+                auto arraySize = instance.path.empty() ? 1u : instance.path.back()->arraySize;
+                auto id = static_cast<int32_t> (program.getModuleID (instance.module, arraySize) + instance.arrayIndex);
+                std::string frequencyText, periodText;
+                ValuePrinter::appendFloat<double> (frequencyText, frequency);
+                ValuePrinter::appendFloat<double> (periodText, 1.0 / frequency);
+
+                auto s = getInstanceState (i);
+                apiOut << s << ".frequency = " << frequencyText << ";" << newLine
+                       << s << ".period = " << periodText << ";" << newLine
+                       << s << ".id = " << id << ";" << newLine
+                       << s << ".session = sessionID;" << newLine
+                       << s << ".instanceIndex = " << i << ";" << blankLine;
+            }
+
+            for (uint32_t i = 0; i < graph.instances.size(); ++i)
+                if (auto f = graph.instances[i].module->findFunction (heart::getSystemInitFunctionName()))
+                    if (isInitFunctionNeeded (*f))
+                        apiOut << functions.find (f.get())->second.name << " (&" << getInstanceState (i) << ");" << newLine;
+
+            apiOut << blankLine << "initialState = state;" << newLine;
+        }
+
+        apiOut << blankLine
+               << "/** Returns the program to the state it was in after init(). */" << newLine
+               << "void reset() noexcept     { state = initialState; }" << blankLine;
+
+        // Rendering
+        apiOut << "/** The buffers for the program's streams, each of which must have numFrames frames. */" << newLine
+               << "struct RenderContext" << newLine;
+
+        {
+            auto indent = apiOut.createIndentWithBraces();
+
+            for (size_t i = 0; i < main.inputs.size(); ++i)
+                if (! endpointNames.renderInputs[i].empty())
+                    apiOut << "const " << getType (main.inputs[i]->getFrameOrValueType()) << "* " << endpointNames.renderInputs[i] << ";" << newLine;
+
+            for (size_t i = 0; i < main.outputs.size(); ++i)
+                if (! endpointNames.renderOutputs[i].empty())
+                    apiOut << getType (main.outputs[i]->getFrameOrValueType()) << "* " << endpointNames.renderOutputs[i] << ";" << newLine;
+
+            apiOut << "uint32_t numFrames;" << newLine;
+        }
+
+        apiOut << ";" << blankLine
+               << "void render (const RenderContext& context) noexcept" << newLine;
+
+        {
+            auto indent = apiOut.createIndentWithBraces();
+            apiOut << "for (uint32_t frame = 0; frame < context.numFrames; ++frame)" << newLine;
+
+            {
+                auto loopIndent = apiOut.createIndentWithBraces();
+                apiOut << "currentFrame = frame;" << blankLine;
+
+                for (uint32_t i = 0; i < graph.instances.size(); ++i)
+                {
+                    auto& instance = graph.instances[i];
+
+                    if (instance.isEventDriven())
+                        continue;
+
+                    auto run = getRunFunction (i);
+                    choc::text::CodePrinter code;
+
+                    for (auto& r : instanceRoutes[i])
+                        printRoute (code, r);
+
+                    if (! run.empty())
+                    {
+                        auto call = run + " (&" + getInstanceState (i) + ");";
+
+                        if (instance.rateShift > 0)
+                            code << "for (int i = 0; i < " << (1 << instance.rateShift) << "; ++i)" << newLine
+                                 << "    " << call << newLine;
+                        else
+                            code << call << newLine;
+                    }
+
+                    auto body = code.toString();
+                    auto idleTest = getVoiceIdleTest (i);
+
+                    if (! idleTest.empty())
+                        body = getGatedVoiceCode (i, idleTest, body);
+
+                    if (instance.rateShift < 0)
+                    {
+                        auto mask = (static_cast<uint64_t> (1) << static_cast<uint32_t> (-instance.rateShift)) - 1;
+                        apiOut << "if ((state.frameCounter & " << mask << "u) == 0)" << newLine;
+                        auto ifIndent = apiOut.createIndentWithBraces();
+                        apiOut << body;
+                    }
+                    else
+                    {
+                        apiOut << body;
+                    }
+
+                    apiOut << blankLine;
+                }
+
+                for (auto& r : outputRoutes)
+                    printRoute (apiOut, r);
+
+                if (! outputRoutes.empty())
+                    apiOut << blankLine;
+
+                for (auto& update : delayLineUpdates)
+                    apiOut << update << newLine;
+
+                if (! delayLineUpdates.empty())
+                    apiOut << blankLine;
+
+                apiOut << "++state.frameCounter;" << newLine;
+            }
+
+            apiOut << newLine;
+        }
+
+        apiOut << blankLine;
+
+        // Events and values
+        for (uint32_t i = 0; i < main.inputs.size(); ++i)
+        {
+            auto& input = main.inputs[i].get();
+
+            if (input.isEventEndpoint())
+            {
+                for (size_t typeIndex = 0; typeIndex < input.dataTypes.size(); ++typeIndex)
+                {
+                    auto& type = input.dataTypes[typeIndex];
+                    apiOut << "void " << endpointNames.inputEvents[i][typeIndex] << " (const " << getType (type) << "& value) noexcept" << newLine;
+                    auto indent = apiOut.createIndentWithBraces();
+                    apiOut << "currentFrame = 0;" << newLine;
+                    printEventDelivery (apiOut, { FlattenedGraph::programEndpoint, i, -1 }, type, "value");
+                }
+
+                apiOut << blankLine;
+            }
+            else if (input.isValueEndpoint())
+            {
+                auto& name = endpointNames.inputValues[i];
+                apiOut << "void set" << capitaliseFirst (name) << " (const " << getType (input.getFrameOrValueType()) << "& value) noexcept    { "
+                       << name << " = value; }" << blankLine;
+            }
+        }
+
+        for (uint32_t i = 0; i < main.outputs.size(); ++i)
+        {
+            auto& output = main.outputs[i].get();
+
+            if (output.isValueEndpoint())
+            {
+                auto& name = endpointNames.outputValues[i];
+                apiOut << getType (output.getFrameOrValueType()) << " get" << capitaliseFirst (name) << "() const noexcept    { return state." << name << "; }" << blankLine;
+            }
+            else if (output.isEventEndpoint())
+            {
+                for (size_t typeIndex = 0; typeIndex < output.dataTypes.size(); ++typeIndex)
+                    apiOut << "void (*" << endpointNames.outputEvents[i][typeIndex] << ") (void* context, uint32_t frameOffset, const "
+                           << getType (output.dataTypes[typeIndex]) << "& value) = nullptr;" << newLine;
+            }
+        }
+
+        apiOut << "void* outputEventContext = nullptr;" << blankLine;
+
+        for (auto& v : program.getExternalVariables())
+        {
+            auto& name = externalVariables[v.getPointer()];
+            auto setter = classNames.add ("setExternalVariable_" + name);
+
+            if (v->type.isUnsizedArray())
+                apiOut << "void " << setter << " (const " << getType (v->type.getArrayElementType()) << "* data, int32_t numElements) noexcept    { externals."
+                       << name << " = { data, numElements }; }" << newLine;
+            else
+                apiOut << "void " << setter << " (const " << getType (v->type) << "& value) noexcept    { externals." << name << " = value; }" << newLine;
+        }
+    }
+
+    static std::string capitaliseFirst (std::string s)
+    {
+        if (! s.empty())
+            s[0] = static_cast<char> (std::toupper (static_cast<unsigned char> (s[0])));
+
+        return s;
+    }
+
+    //==============================================================================
+    std::string assemble()
+    {
+        choc::text::CodePrinter out;
+
+        out << "//==============================================================================" << newLine
+            << "// " << className << ": generated from the SOUL program \""
+            << Program::stripRootNamespaceFromQualifiedPath (program.getMainProcessorOrThrowError().fullName) << "\"" << newLine
+            << "// This file was created automatically - any changes will be lost if it is regenerated." << newLine
+            << "//==============================================================================" << blankLine
+            << "#pragma once" << blankLine
+            << "#include <cstdint>" << newLine
+            << "#include <cmath>" << newLine
+            << "#include <limits>" << newLine
+            << "#include <type_traits>" << blankLine
+            << "#ifndef SOUL_CPP_RESTRICT" << newLine
+            << " #ifdef _MSC_VER" << newLine
+            << "  #define SOUL_CPP_RESTRICT __restrict" << newLine
+            << " #else" << newLine
+            << "  #define SOUL_CPP_RESTRICT __restrict__" << newLine
+            << " #endif" << newLine
+            << "#endif" << blankLine
+            << "class " << className << newLine;
+
+        {
+            auto indent = out.createIndentWithBraces();
+
+            out.addIndent (-4);
+            out << "public:" << newLine;
+            out.addIndent (4);
+            out << className << "() = default;" << blankLine
+                << getAggregateTemplates() << blankLine;
+
+            for (auto s : structOrder)
+            {
+                auto& info = structs[s];
+                out << "struct " << info.name << newLine;
+
+                {
+                    auto structIndent = out.createIndentWithBraces();
+                    auto& members = s->getMembers();
+
+                    for (size_t i = 0; i < members.size(); ++i)
+                        out << getType (members[i].type) << " " << info.members[i] << ";" << newLine;
+                }
+
+                out << ";" << blankLine;
+            }
+
+            out << sectionBreak << apiOut.toString() << blankLine;
+
+            out.addIndent (-4);
+            out << "private:" << newLine;
+            out.addIndent (4);
+            out << sectionBreak << getHelperFunctions() << blankLine << sectionBreak;
+
+            auto constantDeclarations = constantsOut.toString();
+
+            if (! constantDeclarations.empty())
+                out << constantDeclarations << blankLine << sectionBreak;
+
+            out << statesOut.toString()
+                << "struct ProgramState" << newLine;
+
+            {
+                auto stateIndent = out.createIndentWithBraces();
+                out << "Globals globals;" << newLine;
+
+                for (uint32_t i = 0; i < graph.instances.size(); ++i)
+                    out << getProcessor (i).stateType << " " << instanceMembers[i] << ";" << newLine;
+
+                auto& main = program.getMainProcessorOrThrowError();
+
+                for (size_t i = 0; i < main.outputs.size(); ++i)
+                    if (! endpointNames.outputValues[i].empty())
+                        out << getType (main.outputs[i]->getFrameOrValueType()) << " " << endpointNames.outputValues[i] << ";" << newLine;
+
+                for (auto& d : delayLineDeclarations)
+                    out << d << newLine;
+
+                out << "uint64_t frameCounter;" << newLine;
+            }
+
+            out << ";" << blankLine
+                << "ProgramState state {}, initialState {};" << newLine
+                << "Externals externals {};" << newLine;
+
+            auto& main = program.getMainProcessorOrThrowError();
+
+            for (size_t i = 0; i < main.inputs.size(); ++i)
+                if (! endpointNames.inputValues[i].empty())
+                    out << getType (main.inputs[i]->getFrameOrValueType()) << " " << endpointNames.inputValues[i] << " {};" << newLine;
+
+            out << "uint32_t currentFrame = 0;" << blankLine
+                << sectionBreak << trimEnd (routingOut.toString()) << blankLine
+                << sectionBreak << trimEnd (functionsOut.toString()) << newLine;
+        }
+
+        out << ";" << newLine;
+        return out.toString();
+    }
+
+    static const char* getAggregateTemplates()
+    {
+        return R"(template <typename Type, int32_t numElements>
+struct Vector
+{
+    using ElementType = Type;
+    static constexpr int32_t size = numElements;
+
+    Type elements[static_cast<size_t> (numElements)];
+
+    Type& operator[] (int64_t index) noexcept               { return elements[index]; }
+    const Type& operator[] (int64_t index) const noexcept   { return elements[index]; }
+
+    template <int32_t start, int32_t length>
+    Vector<Type, length>& slice() noexcept                  { return *reinterpret_cast<Vector<Type, length>*> (elements + start); }
+
+    template <int32_t start, int32_t length>
+    const Vector<Type, length>& slice() const noexcept      { return *reinterpret_cast<const Vector<Type, length>*> (elements + start); }
+
+    static Vector broadcast (Type value) noexcept
+    {
+        Vector result;
+
+        for (auto& e : result.elements)
+            e = value;
+
+        return result;
+    }
+};
+
+template <typename Type, int32_t numElements>
+struct FixedArray
+{
+    using ElementType = Type;
+    static constexpr int32_t size = numElements;
+
+    Type elements[static_cast<size_t> (numElements)];
+
+    Type& operator[] (int64_t index) noexcept               { return elements[index]; }
+    const Type& operator[] (int64_t index) const noexcept   { return elements[index]; }
+
+    template <int32_t start, int32_t length>
+    FixedArray<Type, length>& slice() noexcept              { return *reinterpret_cast<FixedArray<Type, length>*> (elements + start); }
+
+    template <int32_t start, int32_t length>
+    const FixedArray<Type, length>& slice() const noexcept  { return *reinterpret_cast<const FixedArray<Type, length>*> (elements + start); }
+
+    static FixedArray broadcast (Type value) noexcept
+    {
+        FixedArray result;
+
+        for (auto& e : result.elements)
+            e = value;
+
+        return result;
+    }
+};
+
+/** A read-only view of some data, which wraps its indexes in the same way as a fixed-size array. */
+template <typename Type>
+struct Slice
+{
+    const Type* elements;
+    int32_t numElements;
+
+    const Type& operator[] (int64_t index) const noexcept
+    {
+        static const Type empty {};
+        return numElements != 0 ? elements[wrapIndex (index, numElements)] : empty;
+    }
+};)";
+    }
+
+    static const char* getHelperFunctions()
+    {
+        return R"(template <typename Type>
+using Unsigned = typename std::make_unsigned<Type>::type;
+
+template <typename Type> static Type wrappingAdd (Type a, Type b) noexcept        { return static_cast<Type> (static_cast<Unsigned<Type>> (a) + static_cast<Unsigned<Type>> (b)); }
+template <typename Type> static Type wrappingSubtract (Type a, Type b) noexcept   { return static_cast<Type> (static_cast<Unsigned<Type>> (a) - static_cast<Unsigned<Type>> (b)); }
+template <typename Type> static Type wrappingMultiply (Type a, Type b) noexcept   { return static_cast<Type> (static_cast<Unsigned<Type>> (a) * static_cast<Unsigned<Type>> (b)); }
+template <typename Type> static Type wrappingNegate (Type a) noexcept             { return static_cast<Type> (Unsigned<Type>() - static_cast<Unsigned<Type>> (a)); }
+
+template <typename Type> static Type divideInt (Type a, Type b) noexcept          { return b == 0 ? 0 : (b == -1 ? wrappingNegate (a) : a / b); }
+template <typename Type> static Type moduloInt (Type a, Type b) noexcept          { return (b == 0 || b == -1) ? 0 : a % b; }
+
+template <typename Type>
+static Type shiftLeft (Type a, Type b) noexcept
+{
+    return (b >= 0 && b < static_cast<Type> (sizeof (Type) * 8)) ? static_cast<Type> (static_cast<Unsigned<Type>> (a) << b) : 0;
+}
+
+template <typename Type>
+static Type shiftRight (Type a, Type b) noexcept
+{
+    constexpr auto numBits = static_cast<Type> (sizeof (Type) * 8);
+    return b < 0 ? (a >= 0 ? 0 : -1) : (a >> (b < numBits ? b : numBits - 1));
+}
+
+template <typename Type>
+static Type shiftRightUnsigned (Type a, Type b) noexcept
+{
+    return (b >= 0 && b < static_cast<Type> (sizeof (Type) * 8)) ? static_cast<Type> (static_cast<Unsigned<Type>> (a) >> b) : 0;
+}
+
+template <typename Dest, typename Source>
+static Dest convertElement (Source s) noexcept
+{
+    if constexpr (std::is_same<Dest, bool>::value)
+    {
+        return s != 0;
+    }
+    else if constexpr (std::is_floating_point<Source>::value && std::is_integral<Dest>::value)
+    {
+        if (std::isnan (s))                                                 return 0;
+        if (s <= static_cast<Source> (std::numeric_limits<Dest>::min()))    return std::numeric_limits<Dest>::min();
+        if (s >= static_cast<Source> (std::numeric_limits<Dest>::max()))    return std::numeric_limits<Dest>::max();
+
+        return static_cast<Dest> (s);
+    }
+    else
+    {
+        return static_cast<Dest> (s);
+    }
+}
+
+template <typename Dest, typename Source>
+static Dest convertElements (const Source& source) noexcept
+{
+    Dest result;
+
+    for (int32_t i = 0; i < Dest::size; ++i)
+        result.elements[i] = convertElement<typename Dest::ElementType> (source.elements[i]);
+
+    return result;
+}
+
+template <typename Result, typename Type, int32_t size, typename Fn>
+static Vector<Result, size> map (const Vector<Type, size>& a, Fn&& fn) noexcept
+{
+    Vector<Result, size> result;
+
+    for (int32_t i = 0; i < size; ++i)
+        result.elements[i] = fn (a.elements[i]);
+
+    return result;
+}
+
+template <typename Result, typename Type, int32_t size, typename Fn>
+static Vector<Result, size> map (const Vector<Type, size>& a, const Vector<Type, size>& b, Fn&& fn) noexcept
+{
+    Vector<Result, size> result;
+
+    for (int32_t i = 0; i < size; ++i)
+        result.elements[i] = fn (a.elements[i], b.elements[i]);
+
+    return result;
+}
+
+static int64_t wrapIndex (int64_t index, int32_t size) noexcept
+{
+    auto i = index % size;
+    return i < 0 ? i + size : i;
+}
+
+static int32_t wrapInt (int64_t n, int32_t limit) noexcept     { return static_cast<int32_t> (wrapIndex (n, limit)); }
+static int32_t clampInt (int64_t n, int32_t limit) noexcept    { return static_cast<int32_t> (n < 0 ? 0 : (n >= limit ? limit - 1 : n)); }
+
+template <typename Type>
+static void addTo (Type& dest, const Type& source) noexcept     { dest += source; }
+
+template <typename Type, int32_t size>
+static void addTo (Vector<Type, size>& dest, const Vector<Type, size>& source) noexcept
+{
+    for (int32_t i = 0; i < size; ++i)
+        addTo (dest.elements[i], source.elements[i]);
+}
+
+template <typename Type, int32_t size>
+static void addTo (FixedArray<Type, size>& dest, const FixedArray<Type, size>& source) noexcept
+{
+    for (int32_t i = 0; i < size; ++i)
+        addTo (dest.elements[i], source.elements[i]);
+}
+
+template <typename Type> static Type minOf (Type a, Type b) noexcept                 { return a < b ? a : b; }
+template <typename Type> static Type maxOf (Type a, Type b) noexcept                 { return a > b ? a : b; }
+template <typename Type> static Type clampOf (Type n, Type low, Type high) noexcept  { return n < low ? low : (n > high ? high : n); }
+
+template <typename Type>
+static Type absOf (Type n) noexcept
+{
+    if constexpr (std::is_integral<Type>::value)
+        return n < 0 ? wrappingNegate (n) : n;
+    else
+        return n < 0 ? -n : n;
+}
+
+template <typename Type>
+static auto roundToInt (Type n) noexcept
+{
+    using IntType = typename std::conditional<std::is_same<Type, float>::value, int32_t, int64_t>::type;
+    return convertElement<IntType> (n + (n < 0 ? static_cast<Type> (-0.5) : static_cast<Type> (0.5)));
+}
+
+template <typename Type>
+static Type addModulo2Pi (Type value, Type increment) noexcept
+{
+    constexpr auto twoPi = static_cast<Type> (2.0 * 3.141592653589793238);
+    value += increment;
+
+    if (value >= twoPi)
+    {
+        if (value >= twoPi * 2)
+            return std::fmod (value, twoPi);
+
+        return value - twoPi;
+    }
+
+    return value < 0 ? std::fmod (value, twoPi) + twoPi : value;
+})";
+    }
+};
+
+} // namespace soul
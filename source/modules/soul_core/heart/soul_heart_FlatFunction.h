@@ -0,0 +1,383 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul
+{
+
+//==============================================================================
+/**
+    A compact, index-based copy of a function's body.
+
+    The statements and terminators of all the blocks are laid out in one contiguous array
+    of instructions, and their operands are indexes into a table of expression nodes, so
+    code which just needs to scan a function can walk a few small arrays rather than
+    chasing pointers around the pools. Every entry keeps a pointer to the AST object it
+    was made from, for when the details are needed.
+
+    A flat body is a read-only snapshot. It's made by create() (or for a whole program by
+    flattenProgram(), which the compiler calls after optimisation when the "flatFunctionBodies"
+    property is set in BuildSettings::customSettings), and it becomes stale as soon as the
+    function's blocks are modified, so anything which changes a function must reset its
+    flatBody.
+*/
+struct heart::FlatFunction
+{
+    using Index = uint32_t;
+    static constexpr Index none = 0xffffffffu;
+
+    enum class Opcode  : uint8_t
+    {
+        assign,         ///< operands: source
+        call,           ///< operands: the arguments
+        readStream,     ///< no operands
+        writeStream,    ///< operands: value, then the element index if there is one
+        advanceClock,   ///< no operands
+        branch,         ///< operands: the target's arguments
+        branchIf,       ///< operands: condition, then the arguments for each target
+        returnVoid,     ///< no operands
+        returnValue     ///< operands: the return value
+    };
+
+    enum class NodeType  : uint8_t
+    {
+        variable,
+        constant,
+        arrayElement,       ///< operands: parent, then the index if it's dynamic
+        structElement,      ///< operands: parent
+        typeCast,           ///< operands: source
+        unaryOperator,      ///< operands: source
+        binaryOperator,     ///< operands: lhs, rhs
+        pureFunctionCall,   ///< operands: the arguments
+        processorProperty
+    };
+
+    /** An expression. Each expression object only gets one node, so all the places that
+        refer to a particular variable will share the same index.
+    */
+    struct Node
+    {
+        NodeType type;
+        Index firstOperand = 0, numOperands = 0;
+        Expression* expression = nullptr;
+    };
+
+    struct Instruction
+    {
+        Opcode opcode;
+        Index target = none;                        ///< The node that's written, if any
+        Index firstOperand = 0, numOperands = 0;
+        Index destBlocks[2] = { none, none };
+        Index numTrueTargetArgs = 0;                ///< For a branchIf, the number of its arguments that go to the first target
+        Object* source = nullptr;                   ///< The Statement or Terminator
+    };
+
+    struct FlatBlock
+    {
+        Index firstInstruction = 0, numInstructions = 0;
+        Index firstParameter = 0, numParameters = 0;
+        Block* block = nullptr;
+    };
+
+    std::vector<FlatBlock> blocks;
+    std::vector<Instruction> instructions;
+    std::vector<Node> nodes;
+    std::vector<Index> operands;
+
+    //==============================================================================
+    static FlatFunction create (Function& f)
+    {
+        FlatFunction flat;
+        Builder builder (flat);
+        builder.build (f);
+        return flat;
+    }
+
+    static void flattenProgram (Program& program)
+    {
+        for (auto& m : program.getModules())
+            for (auto& f : m->functions)
+                f->flatBody = f->hasNoBody ? nullptr : std::make_shared<const FlatFunction> (create (f));
+    }
+
+    //==============================================================================
+    ArrayView<const Index> getOperands (const Instruction& i) const    { return getOperandRange (i.firstOperand, i.numOperands); }
+    ArrayView<const Index> getOperands (const Node& n) const           { return getOperandRange (n.firstOperand, n.numOperands); }
+    ArrayView<const Index> getParameters (const FlatBlock& b) const    { return getOperandRange (b.firstParameter, b.numParameters); }
+
+    ArrayView<const Instruction> getInstructions (const FlatBlock& b) const
+    {
+        return { instructions.data() + b.firstInstruction, instructions.data() + b.firstInstruction + b.numInstructions };
+    }
+
+    /** Returns the index of the first instruction with the given opcode, or none. */
+    Index findFirst (Opcode opcode) const
+    {
+        for (Index i = 0; i < static_cast<Index> (instructions.size()); ++i)
+            if (instructions[i].opcode == opcode)
+                return i;
+
+        return none;
+    }
+
+    pool_ptr<AdvanceClock> findFirstAdvanceCall() const    { return findFirstStatement<AdvanceClock> (Opcode::advanceClock); }
+    pool_ptr<WriteStream> findFirstWrite() const           { return findFirstStatement<WriteStream> (Opcode::writeStream); }
+
+    template <typename Visitor>
+    void visitCalls (Visitor&& visit) const
+    {
+        for (auto& i : instructions)
+            if (i.opcode == Opcode::call)
+                visit (*static_cast<FunctionCall*> (i.source));
+    }
+
+    /** Calls the visitor with each variable that the given node reads (which for a
+        dynamic array index means both the array and the index).
+    */
+    template <typename Visitor>
+    void visitVariablesRead (Index node, Visitor&& visit) const
+    {
+        auto& n = nodes[node];
+
+        if (n.type == NodeType::variable)
+        {
+            visit (*static_cast<Variable*> (n.expression));
+            return;
+        }
+
+        for (auto operand : getOperands (n))
+            visitVariablesRead (operand, visit);
+    }
+
+private:
+    //==============================================================================
+    ArrayView<const Index> getOperandRange (Index start, Index num) const
+    {
+        return { operands.data() + start, operands.data() + start + num };
+    }
+
+    template <typename StatementType>
+    pool_ptr<StatementType> findFirstStatement (Opcode opcode) const
+    {
+        auto index = findFirst (opcode);
+
+        if (index == none)
+            return {};
+
+        return *static_cast<StatementType*> (instructions[index].source);
+    }
+
+    //==============================================================================
+    struct Builder
+    {
+        Builder (FlatFunction& f) : flat (f) {}
+
+        FlatFunction& flat;
+        std::unordered_map<const Expression*, Index> nodeIndexes;
+        std::unordered_map<const Block*, Index> blockIndexes;
+
+        void build (Function& f)
+        {
+            flat.blocks.reserve (f.blocks.size());
+
+            for (auto& b : f.blocks)
+            {
+                blockIndexes[std::addressof (b.get())] = static_cast<Index> (flat.blocks.size());
+                flat.blocks.push_back ({ 0, 0, 0, 0, std::addressof (b.get()) });
+            }
+
+            for (size_t i = 0; i < f.blocks.size(); ++i)
+            {
+                auto& b = f.blocks[i].get();
+
+                std::vector<Index> params;
+
+                for (auto& p : b.parameters)
+                    params.push_back (getNode (p));
+
+                flat.blocks[i].firstParameter = addOperands (params);
+                flat.blocks[i].numParameters = static_cast<Index> (params.size());
+                flat.blocks[i].firstInstruction = static_cast<Index> (flat.instructions.size());
+
+                for (auto s : b.statements)
+                    addStatement (*s);
+
+                if (b.terminator != nullptr)
+                    addTerminator (*b.terminator);
+
+                flat.blocks[i].numInstructions = static_cast<Index> (flat.instructions.size()) - flat.blocks[i].firstInstruction;
+            }
+        }
+
+        Index addOperands (const std::vector<Index>& indexes)
+        {
+            auto start = static_cast<Index> (flat.operands.size());
+            flat.operands.insert (flat.operands.end(), indexes.begin(), indexes.end());
+            return start;
+        }
+
+        template <typename ListType>
+        void addExpressions (std::vector<Index>& indexes, const ListType& list)
+        {
+            for (auto& e : list)
+                indexes.push_back (getNode (e));
+        }
+
+        Index getNode (Expression& e)
+        {
+            auto found = nodeIndexes.find (std::addressof (e));
+
+            if (found != nodeIndexes.end())
+                return found->second;
+
+            Node node;
+            std::vector<Index> ops;
+
+            if (is_type<Variable> (e))                              node.type = NodeType::variable;
+            else if (is_type<Constant> (e))                         node.type = NodeType::constant;
+            else if (is_type<ProcessorProperty> (e))                node.type = NodeType::processorProperty;
+            else if (auto a = cast<ArrayElement> (e))
+            {
+                node.type = NodeType::arrayElement;
+                ops.push_back (getNode (a->parent));
+
+                if (a->isDynamic())
+                    ops.push_back (getNode (*a->dynamicIndex));
+            }
+            else if (auto s = cast<StructElement> (e))              { node.type = NodeType::structElement;    ops.push_back (getNode (s->parent)); }
+            else if (auto c = cast<TypeCast> (e))                   { node.type = NodeType::typeCast;         ops.push_back (getNode (c->source)); }
+            else if (auto u = cast<UnaryOperator> (e))              { node.type = NodeType::unaryOperator;    ops.push_back (getNode (u->source)); }
+            else if (auto b = cast<BinaryOperator> (e))             { node.type = NodeType::binaryOperator;   ops.push_back (getNode (b->lhs)); ops.push_back (getNode (b->rhs)); }
+            else if (auto p = cast<PureFunctionCall> (e))           { node.type = NodeType::pureFunctionCall; addExpressions (ops, p->arguments); }
+            else                                                    SOUL_ASSERT_FALSE;
+
+            node.firstOperand = addOperands (ops);
+            node.numOperands = static_cast<Index> (ops.size());
+            node.expression = std::addressof (e);
+
+            auto index = static_cast<Index> (flat.nodes.size());
+            flat.nodes.push_back (node);
+            nodeIndexes[std::addressof (e)] = index;
+            return index;
+        }
+
+        void addInstruction (Instruction i, const std::vector<Index>& ops)
+        {
+            i.firstOperand = addOperands (ops);
+            i.numOperands = static_cast<Index> (ops.size());
+            flat.instructions.push_back (i);
+        }
+
+        Index getTargetNode (Assignment& a)
+        {
+            return a.target != nullptr ? getNode (*a.target) : none;
+        }
+
+        void addStatement (Statement& s)
+        {
+            Instruction i;
+            i.source = std::addressof (s);
+            std::vector<Index> ops;
+
+            if (auto a = cast<AssignFromValue> (s))
+            {
+                i.opcode = Opcode::assign;
+                i.target = getTargetNode (*a);
+                ops.push_back (getNode (a->source));
+            }
+            else if (auto c = cast<FunctionCall> (s))
+            {
+                i.opcode = Opcode::call;
+                i.target = getTargetNode (*c);
+                addExpressions (ops, c->arguments);
+            }
+            else if (auto r = cast<ReadStream> (s))
+            {
+                i.opcode = Opcode::readStream;
+                i.target = getTargetNode (*r);
+            }
+            else if (auto w = cast<WriteStream> (s))
+            {
+                i.opcode = Opcode::writeStream;
+                ops.push_back (getNode (w->value));
+
+                if (w->element != nullptr)
+                    ops.push_back (getNode (*w->element));
+            }
+            else if (is_type<AdvanceClock> (s))
+            {
+                i.opcode = Opcode::advanceClock;
+            }
+            else
+            {
+                SOUL_ASSERT_FALSE;
+            }
+
+            addInstruction (i, ops);
+        }
+
+        void addTerminator (Terminator& t)
+        {
+            Instruction i;
+            i.source = std::addressof (t);
+            std::vector<Index> ops;
+
+            if (auto b = cast<Branch> (t))
+            {
+                i.opcode = Opcode::branch;
+                i.destBlocks[0] = getBlockIndex (b->target);
+                addExpressions (ops, b->targetArgs);
+            }
+            else if (auto bi = cast<BranchIf> (t))
+            {
+                i.opcode = Opcode::branchIf;
+                i.destBlocks[0] = getBlockIndex (bi->targets[0]);
+                i.destBlocks[1] = getBlockIndex (bi->targets[1]);
+                i.numTrueTargetArgs = static_cast<Index> (bi->targetArgs[0].size());
+                ops.push_back (getNode (bi->condition));
+                addExpressions (ops, bi->targetArgs[0]);
+                addExpressions (ops, bi->targetArgs[1]);
+            }
+            else if (is_type<ReturnVoid> (t))
+            {
+                i.opcode = Opcode::returnVoid;
+            }
+            else if (auto r = cast<ReturnValue> (t))
+            {
+                i.opcode = Opcode::returnValue;
+                ops.push_back (getNode (r->returnValue));
+            }
+            else
+            {
+                SOUL_ASSERT_FALSE;
+            }
+
+            addInstruction (i, ops);
+        }
+
+        Index getBlockIndex (Block& b) const
+        {
+            auto found = blockIndexes.find (std::addressof (b));
+            SOUL_ASSERT (found != blockIndexes.end());
+            return found->second;
+        }
+    };
+};
+
+} // namespace soul
@@ -0,0 +1,558 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul
+{
+
+//==============================================================================
+/**
+    Expands a program's graph hierarchy into a flat list of the processor instances that it
+    contains, and the connections between their endpoints.
+
+    Graphs within graphs, arrays of processors and endpoint arrays are all resolved, so each
+    connection goes directly from a processor output (or one of the program's inputs) to a
+    processor input (or one of the program's outputs), with the total delay of all the graph
+    connections that it passed through. The instances are sorted into the order in which the
+    MultiRateSchedule says they should be rendered.
+
+    If the main processor isn't a graph, the result is a single instance whose endpoints are
+    connected directly to the program's endpoints.
+*/
+struct FlattenedGraph
+{
+    struct Instance
+    {
+        pool_ref<Module> module;
+
+        /** The chain of graph nodes leading from the main graph down to this processor. */
+        std::vector<pool_ref<heart::ProcessorInstance>> path;
+
+        /** The index of this instance if its node is an array of processors. */
+        uint32_t arrayIndex = 0;
+
+        /** log2 of this instance's clock rate relative to the main graph. */
+        int rateShift = 0;
+
+        /** A readable name, e.g. "voices[2].osc". */
+        std::string name;
+
+        /** The element index of each node in the path, which is 0 for nodes that aren't arrays. */
+        std::vector<uint32_t> pathIndexes;
+
+        /** True if the processor only ever does anything inside its event handlers, i.e. all its
+            endpoints are events and it either has no run() function or one that does nothing
+            but advance. Instances like this (e.g. voice allocators and MIDI parsers) can be left
+            out of the per-frame schedule, and just have their handlers called as events arrive.
+        */
+        bool isEventDriven() const
+        {
+            for (auto& i : module->inputs)
+                if (! i->isEventEndpoint())
+                    return false;
+
+            for (auto& o : module->outputs)
+                if (! o->isEventEndpoint())
+                    return false;
+
+            if (auto run = module->findFunction (heart::getRunFunctionName()))
+            {
+                for (auto& b : run->blocks)
+                {
+                    for (auto s : b->statements)
+                        if (! is_type<heart::AdvanceClock> (*s))
+                            return false;
+
+                    if (b->terminator == nullptr || b->terminator->isConditional())
+                        return false;
+                }
+            }
+
+            return true;
+        }
+    };
+
+    /** One of an instance's endpoints, or if the instance index is programEndpoint, one of the
+        program's inputs or outputs. An element of -1 refers to the whole endpoint rather than
+        an element of an endpoint array.
+    */
+    struct Endpoint
+    {
+        uint32_t instance = programEndpoint, endpoint = 0;
+        int32_t element = -1;
+
+        bool isProgramEndpoint() const      { return instance == programEndpoint; }
+    };
+
+    struct Connection
+    {
+        Endpoint source, dest;
+        uint32_t delayLength = 0;
+    };
+
+    static constexpr uint32_t programEndpoint = 0xffffffffu;
+
+    std::vector<Instance> instances;
+    std::vector<Connection> connections;
+
+    /** Returns the declaration of the output (or program input) that a connection comes from. */
+    const heart::IODeclaration& getSource (const Program& program, const Connection& c) const
+    {
+        if (c.source.isProgramEndpoint())
+            return program.getMainProcessorOrThrowError().inputs[c.source.endpoint];
+
+        return instances[c.source.instance].module->outputs[c.source.endpoint];
+    }
+
+    /** Returns the declaration of the input (or program output) that a connection goes to. */
+    const heart::IODeclaration& getDest (const Program& program, const Connection& c) const
+    {
+        if (c.dest.isProgramEndpoint())
+            return program.getMainProcessorOrThrowError().outputs[c.dest.endpoint];
+
+        return instances[c.dest.instance].module->inputs[c.dest.endpoint];
+    }
+
+    /** A processor can tell the renderer that its voice has nothing to do by declaring a bool
+        state variable with this annotation, e.g. bool idle [[ voiceIdle ]]; and setting it while
+        it's silent. Once every such flag in a voice is set, none of the voice's instances are run
+        (and their stream outputs stay at zero) until an event handler clears one of them again.
+        A voice is the element of the innermost array of nodes that an instance is inside, so a
+        processor in a voice graph can gate all the other processors in that graph.
+    */
+    static constexpr const char* voiceIdleAnnotation = "voiceIdle";
+
+    /** Returns a processor's state variables which are flagged with voiceIdleAnnotation. */
+    static std::vector<pool_ref<heart::Variable>> getVoiceIdleFlags (const Module& module)
+    {
+        std::vector<pool_ref<heart::Variable>> flags;
+
+        for (auto& v : module.stateVariables)
+            if (v->annotation.getBool (voiceIdleAnnotation) && v->type.isBool())
+                flags.push_back (v);
+
+        return flags;
+    }
+
+    /** Returns the indexes of all the instances that are in the same voice as the given one,
+        including itself. If the instance isn't inside an array of nodes, it's on its own.
+    */
+    std::vector<uint32_t> getVoiceInstances (uint32_t index) const
+    {
+        auto& instance = instances[index];
+        auto depth = instance.path.size();
+
+        while (depth > 0 && instance.path[depth - 1]->arraySize <= 1)
+            --depth;
+
+        if (depth == 0)
+            return { index };
+
+        std::vector<uint32_t> result;
+
+        for (uint32_t i = 0; i < instances.size(); ++i)
+        {
+            auto& other = instances[i];
+
+            if (other.path.size() >= depth
+                 && std::equal (instance.path.begin(), instance.path.begin() + static_cast<std::ptrdiff_t> (depth), other.path.begin(),
+                                [] (const pool_ref<heart::ProcessorInstance>& a, const pool_ref<heart::ProcessorInstance>& b) { return a == b; })
+                 && std::equal (instance.pathIndexes.begin(), instance.pathIndexes.begin() + static_cast<std::ptrdiff_t> (depth), other.pathIndexes.begin()))
+                result.push_back (i);
+        }
+
+        return result;
+    }
+
+    static FlattenedGraph create (const Program& program)
+    {
+        FlattenedGraph result;
+        Builder (program, result).build();
+        return result;
+    }
+
+    /** Removes every instance that can't affect any of the program outputs which the provider
+        says are connected, along with all the connections to and from those instances.
+        This walks backwards along the connections from the connected outputs, so a whole chain
+        of processors that only feeds unconnected outputs (e.g. meters or sends that the host
+        isn't listening to) gets dropped, not just the last one in the chain.
+        The remaining instances keep their relative order.
+    */
+    template <typename EndpointConnectionStatusProvider>
+    void removeUnconnectedInstances (const Program& program, EndpointConnectionStatusProvider& ecsp)
+    {
+        auto& mainOutputs = program.getMainProcessorOrThrowError().outputs;
+        std::vector<bool> isLive (instances.size());
+        std::vector<uint32_t> toVisit;
+
+        auto markLive = [&] (const Endpoint& source)
+        {
+            if (! source.isProgramEndpoint() && ! isLive[source.instance])
+            {
+                isLive[source.instance] = true;
+                toVisit.push_back (source.instance);
+            }
+        };
+
+        for (auto& c : connections)
+            if (c.dest.isProgramEndpoint() && ecsp.isOutputConnected (mainOutputs[c.dest.endpoint]))
+                markLive (c.source);
+
+        while (! toVisit.empty())
+        {
+            auto instance = toVisit.back();
+            toVisit.pop_back();
+
+            for (auto& c : connections)
+                if (c.dest.instance == instance)
+                    markLive (c.source);
+        }
+
+        std::vector<uint32_t> newIndexes (instances.size(), programEndpoint);
+        std::vector<Instance> liveInstances;
+
+        for (size_t i = 0; i < instances.size(); ++i)
+        {
+            if (isLive[i])
+            {
+                newIndexes[i] = static_cast<uint32_t> (liveInstances.size());
+                liveInstances.push_back (std::move (instances[i]));
+            }
+        }
+
+        auto isDead = [&] (const Endpoint& e)  { return ! e.isProgramEndpoint() && ! isLive[e.instance]; };
+
+        removeIf (connections, [&] (const Connection& c) { return isDead (c.source) || isDead (c.dest); });
+
+        for (auto& c : connections)
+        {
+            if (! c.source.isProgramEndpoint())  c.source.instance = newIndexes[c.source.instance];
+            if (! c.dest.isProgramEndpoint())    c.dest.instance = newIndexes[c.dest.instance];
+        }
+
+        instances = std::move (liveInstances);
+    }
+
+private:
+    //==============================================================================
+    struct Builder
+    {
+        Builder (const Program& p, FlattenedGraph& g) : program (p), graph (g) {}
+
+        struct Scope;
+
+        struct Node
+        {
+            uint32_t leaf = programEndpoint;
+            std::unique_ptr<Scope> child;
+        };
+
+        struct Scope
+        {
+            const Module& module;
+            const Scope* parent;
+            pool_ptr<heart::ProcessorInstance> instanceInParent;
+            uint32_t indexInParent;
+            std::unordered_map<const heart::ProcessorInstance*, std::vector<Node>> nodes;
+        };
+
+        const Program& program;
+        FlattenedGraph& graph;
+        std::unique_ptr<Scope> topScope;
+        std::vector<const Scope*> instanceScopes;
+
+        void build()
+        {
+            auto& main = program.getMainProcessorOrThrowError();
+
+            if (! main.isGraph())
+            {
+                graph.instances.push_back ({ main, {}, 0, 0, main.originalFullName, {} });
+
+                for (uint32_t i = 0; i < main.inputs.size(); ++i)
+                    graph.connections.push_back ({ { programEndpoint, i, -1 }, { 0, i, -1 }, 0 });
+
+                for (uint32_t i = 0; i < main.outputs.size(); ++i)
+                    for (auto& element : getOutputElements (main.outputs[i]))
+                        graph.connections.push_back ({ { 0, i, element }, { programEndpoint, i, element }, 0 });
+
+                return;
+            }
+
+            topScope = createScope (main, nullptr, {}, 0, {});
+
+            for (uint32_t i = 0; i < main.inputs.size(); ++i)
+                connect (*topScope, {}, 0, main.inputs[i]->name.toString(), -1, 0, { programEndpoint, i, -1 });
+
+            for (uint32_t instance = 0; instance < graph.instances.size(); ++instance)
+            {
+                auto& info = graph.instances[instance];
+                auto& outputs = info.module->outputs;
+
+                for (uint32_t i = 0; i < outputs.size(); ++i)
+                    for (auto& element : getOutputElements (outputs[i]))
+                        connect (*instanceScopes[instance], info.path.back(), info.arrayIndex,
+                                 outputs[i]->name.toString(), element, 0, { instance, i, element });
+            }
+
+            sortIntoScheduleOrder (main);
+        }
+
+        /** Event arrays are connected one element at a time, because each element can be
+            routed to a different place, but streams and values are connected as a whole.
+        */
+        static std::vector<int32_t> getOutputElements (const heart::OutputDeclaration& output)
+        {
+            if (output.isEventEndpoint() && output.arraySize.has_value())
+            {
+                std::vector<int32_t> elements;
+
+                for (uint32_t i = 0; i < *output.arraySize; ++i)
+                    elements.push_back (static_cast<int32_t> (i));
+
+                return elements;
+            }
+
+            return { -1 };
+        }
+
+        std::unique_ptr<Scope> createScope (const Module& module, const Scope* parent, pool_ptr<heart::ProcessorInstance> instance,
+                                            uint32_t index, const std::vector<pool_ref<heart::ProcessorInstance>>& path)
+        {
+            auto scope = std::make_unique<Scope> (Scope { module, parent, instance, index, {} });
+
+            for (auto& pathIndex : module.processorInstances)
+            {
+                auto child = program.getModuleWithName (pathIndex->sourceName);
+
+                if (child == nullptr)
+                    throwError (Errors::cannotFindProcessor (pathIndex->sourceName));
+
+                auto childPath = path;
+                childPath.push_back (pathIndex);
+                auto& nodes = scope->nodes[pathIndex.getPointer()];
+
+                // Each element of a processor array becomes a separate instance with its own state. Arrays
+                // whose code never branches can be run as the lanes of a single instance instead, but those
+                // have already been packed into one by ProcessorArrayPacking, if it was enabled.
+                for (uint32_t i = 0; i < pathIndex->arraySize; ++i)
+                {
+                    Node node;
+
+                    if (child->isGraph())
+                    {
+                        node.child = createScope (*child, scope.get(), pathIndex, i, childPath);
+                    }
+                    else
+                    {
+                        node.leaf = static_cast<uint32_t> (graph.instances.size());
+                        graph.instances.push_back ({ *child, childPath, i, 0, getInstanceName (childPath, i), getPathIndexes (*scope, i) });
+                        instanceScopes.push_back (scope.get());
+                    }
+
+                    nodes.push_back (std::move (node));
+                }
+            }
+
+            return scope;
+        }
+
+        static std::vector<uint32_t> getPathIndexes (const Scope& scope, uint32_t index)
+        {
+            std::vector<uint32_t> indexes { index };
+
+            for (auto s = std::addressof (scope); s->instanceInParent != nullptr; s = s->parent)
+                indexes.insert (indexes.begin(), s->indexInParent);
+
+            return indexes;
+        }
+
+        static std::string getInstanceName (const std::vector<pool_ref<heart::ProcessorInstance>>& path, uint32_t index)
+        {
+            std::vector<std::string> names;
+
+            for (auto& pathIndex : path)
+                names.push_back (pathIndex->instanceName);
+
+            auto name = joinStrings (names, ".");
+
+            if (path.back()->arraySize > 1)
+                name += "[" + std::to_string (index) + "]";
+
+            return name;
+        }
+
+        void sortIntoScheduleOrder (const Module& main)
+        {
+            auto schedule = MultiRateSchedule::create (program, main);
+            std::vector<size_t> stages;
+
+            for (auto& instance : graph.instances)
+            {
+                size_t stageIndex = 0;
+
+                for (size_t i = 0; i < schedule.stages.size(); ++i)
+                {
+                    auto& stage = schedule.stages[i];
+
+                    if (stage.path.size() == instance.path.size()
+                         && std::equal (stage.path.begin(), stage.path.end(), instance.path.begin(),
+                                        [] (const pool_ref<heart::ProcessorInstance>& a, const pool_ref<heart::ProcessorInstance>& b) { return a == b; }))
+                    {
+                        stageIndex = i;
+                        instance.rateShift = stage.rateShift;
+                        break;
+                    }
+                }
+
+                stages.push_back (stageIndex);
+            }
+
+            std::vector<uint32_t> order (graph.instances.size());
+
+            for (uint32_t i = 0; i < order.size(); ++i)
+                order[i] = i;
+
+            std::stable_sort (order.begin(), order.end(), [&] (uint32_t a, uint32_t b) { return stages[a] < stages[b]; });
+
+            std::vector<uint32_t> newIndexes (order.size());
+            std::vector<Instance> sorted;
+
+            for (uint32_t i = 0; i < order.size(); ++i)
+            {
+                newIndexes[order[i]] = i;
+                sorted.push_back (std::move (graph.instances[order[i]]));
+            }
+
+            graph.instances = std::move (sorted);
+
+            for (auto& c : graph.connections)
+            {
+                if (! c.source.isProgramEndpoint())  c.source.instance = newIndexes[c.source.instance];
+                if (! c.dest.isProgramEndpoint())    c.dest.instance = newIndexes[c.dest.instance];
+            }
+        }
+
+        /** Follows the connections from an endpoint in a graph scope to all the processor inputs
+            and program outputs that it ends up at, adding a connection for each of them.
+        */
+        void connect (const Scope& scope, pool_ptr<heart::ProcessorInstance> sourceProcessor, uint32_t sourceIndex,
+                      const std::string& endpoint, int32_t element, uint32_t delay, const Endpoint& origin)
+        {
+            for (auto& c : scope.module.connections)
+            {
+                if (c->sourceProcessor != sourceProcessor || c->sourceEndpoint.toString() != endpoint)
+                    continue;
+
+                if (c->sourceEndpointIndex.has_value() && element >= 0 && *c->sourceEndpointIndex != static_cast<size_t> (element))
+                    continue;
+
+                pool_ptr<heart::IODeclaration> sourceEndpoint;
+
+                if (sourceProcessor != nullptr)
+                    sourceEndpoint = getModule (*sourceProcessor).findOutput (endpoint);
+                else
+                    sourceEndpoint = scope.module.findInput (endpoint);
+
+                auto sourceCount = sourceProcessor != nullptr ? sourceProcessor->arraySize : 1u;
+                auto sourcePosition = sourceIndex;
+                auto numElements = sourceEndpoint != nullptr ? sourceEndpoint->arraySize.value_or (1) : 1u;
+
+                // An endpoint array which isn't indexed is spread over the processors that it feeds
+                if (element >= 0 && ! c->sourceEndpointIndex.has_value() && numElements > 1)
+                {
+                    sourcePosition = sourceIndex * numElements + static_cast<uint32_t> (element);
+                    sourceCount *= numElements;
+                }
+
+                auto passedElement = c->sourceEndpointIndex.has_value() ? -1 : element;
+                auto totalDelay = delay + static_cast<uint32_t> (c->delayLength);
+                pool_ptr<heart::IODeclaration> destEndpoint;
+
+                if (c->destProcessor != nullptr)
+                    destEndpoint = getModule (*c->destProcessor).findInput (c->destEndpoint.toString());
+                else
+                    destEndpoint = scope.module.findOutput (c->destEndpoint.toString());
+
+                auto destCount = c->destProcessor != nullptr ? c->destProcessor->arraySize : 1u;
+                auto destElements = destEndpoint != nullptr ? destEndpoint->arraySize.value_or (1) : 1u;
+                auto destElement = c->destEndpointIndex.has_value() ? static_cast<int32_t> (*c->destEndpointIndex) : -1;
+                uint32_t firstDest = 0, numDests = destCount;
+
+                if (sourceCount == destCount && destCount > 1)
+                {
+                    firstDest = sourcePosition;
+                    numDests = 1;
+                }
+                else if (! c->destEndpointIndex.has_value())
+                {
+                    if (destCount == 1 && sourceCount > 1 && sourceCount == destElements)
+                        destElement = static_cast<int32_t> (sourcePosition);
+                    else if (sourceCount == 1 || destCount == 1)
+                        destElement = passedElement;
+                }
+
+                if (c->destProcessor == nullptr)
+                {
+                    if (scope.parent == nullptr)
+                    {
+                        auto& main = program.getMainProcessorOrThrowError();
+
+                        for (uint32_t i = 0; i < main.outputs.size(); ++i)
+                            if (main.outputs[i]->name == c->destEndpoint)
+                                graph.connections.push_back ({ origin, { programEndpoint, i, destElement }, totalDelay });
+                    }
+                    else
+                    {
+                        connect (*scope.parent, scope.instanceInParent, scope.indexInParent,
+                                 c->destEndpoint.toString(), destElement, totalDelay, origin);
+                    }
+
+                    continue;
+                }
+
+                auto& nodes = scope.nodes.find (c->destProcessor.get())->second;
+
+                for (auto i = firstDest; i < firstDest + numDests; ++i)
+                {
+                    auto& node = nodes[i];
+
+                    if (node.child != nullptr)
+                    {
+                        connect (*node.child, {}, 0, c->destEndpoint.toString(), destElement, totalDelay, origin);
+                        continue;
+                    }
+
+                    auto& inputs = graph.instances[node.leaf].module->inputs;
+
+                    for (uint32_t j = 0; j < inputs.size(); ++j)
+                        if (inputs[j]->name == c->destEndpoint)
+                            graph.connections.push_back ({ origin, { node.leaf, j, destElement }, totalDelay });
+                }
+            }
+        }
+
+        const Module& getModule (const heart::ProcessorInstance& pathIndex) const
+        {
+            return *program.getModuleWithName (pathIndex.sourceName);
+        }
+    };
+};
+
+} // namespace soul
@@ -27,9 +27,15 @@ namespace soul
 */
 struct BlockBuilder
 {
-    BlockBuilder (Module& m) : module (m) {}
+    BlockBuilder (Module& m) : module (m), allocator (m.allocator) {}
 
-    BlockBuilder (Module& m, heart::Block& block) : module (m), currentBlock (block)
+    /** Creates a builder which allocates its objects from the given allocator rather than
+        the module's. This lets functions be built on worker threads, using a separate
+        allocator for each thread.
+    */
+    BlockBuilder (Module& m, heart::Allocator& a) : module (m), allocator (a) {}
+
+    BlockBuilder (Module& m, heart::Block& block) : module (m), allocator (m.allocator), currentBlock (block)
     {
         lastStatementInCurrentBlock = block.statements.getLast();
     }
@@ -37,10 +43,10 @@ struct BlockBuilder
     virtual ~BlockBuilder() {}
 
     template <typename StringType>
-    Identifier createIdentifier (StringType&& name)                     { return module.allocator.get (name); }
+    Identifier createIdentifier (StringType&& name)                     { return allocator.get (name); }
     Identifier createIdentifier (const char* prefix, uint32_t index)    { return createIdentifier (prefix + std::to_string (index)); }
 
-    heart::Constant& createConstant (Value v)                   { return module.allocator.allocateConstant (std::move (v)); }
+    heart::Constant& createConstant (Value v)                   { return allocator.allocateConstant (std::move (v)); }
 
     template <typename IntType>
     heart::Constant& createConstantInt32 (IntType intValue)     { return createConstant (Value::createInt32 (intValue)); }
@@ -48,12 +54,12 @@ struct BlockBuilder
     template <typename IntType>
     heart::Constant& createConstantInt64 (IntType intValue)     { return createConstant (Value::createInt64 (intValue)); }
 
-    heart::Constant& createZeroInitialiser (const Type& type)   { return module.allocator.allocateZeroInitialiser (type); }
+    heart::Constant& createZeroInitialiser (const Type& type)   { return allocator.allocateZeroInitialiser (type); }
 
     template <typename StringType>
     heart::Variable& createVariable (Type type, StringType&& name, heart::Variable::Role role)
     {
-        return module.allocate<heart::Variable> (CodeLocation(), std::move (type), createIdentifier (name), role);
+        return allocator.allocate<heart::Variable> (CodeLocation(), std::move (type), createIdentifier (name), role);
     }
 
     heart::Variable& createRegisterVariable (Type type)
@@ -92,12 +98,12 @@ struct BlockBuilder
 
     heart::StructElement& createStructElement (heart::Expression& parent, std::string memberName)
     {
-        return module.allocate<heart::StructElement> (parent.location, parent, std::move (memberName));
+        return allocator.allocate<heart::StructElement> (parent.location, parent, std::move (memberName));
     }
 
     heart::ArrayElement& createFixedArrayElement (heart::Expression& parent, size_t index)
     {
-        return module.allocate<heart::ArrayElement> (parent.location, parent, index);
+        return allocator.allocate<heart::ArrayElement> (parent.location, parent, index);
     }
 
     heart::Expression& createFixedArrayElementIfNotPrimitive (heart::Expression& parent, size_t index)
@@ -111,7 +117,7 @@ struct BlockBuilder
 
     heart::ArrayElement& createFixedArraySlice (CodeLocation l, heart::Expression& parent, size_t start, size_t end)
     {
-        return module.allocate<heart::ArrayElement> (std::move (l), parent, start, end);
+        return allocator.allocate<heart::ArrayElement> (std::move (l), parent, start, end);
     }
 
     heart::ArrayElement& createTrustedDynamicSubElement (heart::Expression& parent, heart::Expression& index)
@@ -122,7 +128,7 @@ struct BlockBuilder
     heart::ArrayElement& createDynamicSubElement (CodeLocation l, heart::Expression& parent, heart::Expression& index,
                                                   bool isTrusted, bool suppressWrapWarning)
     {
-        auto& s = module.allocate<heart::ArrayElement> (std::move (l), parent, index);
+        auto& s = allocator.allocate<heart::ArrayElement> (std::move (l), parent, index);
         s.isRangeTrusted = isTrusted;
         s.suppressWrapWarning = suppressWrapWarning;
         return s;
@@ -130,12 +136,15 @@ struct BlockBuilder
 
     heart::Expression& createCast (CodeLocation l, heart::Expression& source, const Type& destType)
     {
-        return module.allocate<heart::TypeCast> (std::move (l), source, destType);
+        return allocator.allocate<heart::TypeCast> (std::move (l), source, destType);
     }
 
     heart::Expression& createCastIfNeeded (heart::Expression& source, const Type& destType)
     {
-        return createCastIfNeeded (module, source, destType);
+        if (destType.isIdentical (source.getType()))
+            return source;
+
+        return allocator.allocate<heart::TypeCast> (source.location, source, destType);
     }
 
     static heart::Expression& createCastIfNeeded (Module& m, heart::Expression& source, const Type& destType)
@@ -148,12 +157,12 @@ struct BlockBuilder
 
     heart::Expression& createUnaryOp (CodeLocation l, heart::Expression& source, UnaryOp::Op op)
     {
-        return module.allocate<heart::UnaryOperator> (std::move (l), source, op);
+        return allocator.allocate<heart::UnaryOperator> (std::move (l), source, op);
     }
 
     heart::Expression& createBinaryOp (CodeLocation l, heart::Expression& lhs, heart::Expression& rhs, BinaryOp::Op op)
     {
-        return module.allocate<heart::BinaryOperator> (std::move (l), lhs, rhs, op);
+        return allocator.allocate<heart::BinaryOperator> (std::move (l), lhs, rhs, op);
     }
 
     heart::Expression& createAdd (heart::Expression& lhs, heart::Expression& rhs)
@@ -183,7 +192,7 @@ struct BlockBuilder
     }
 
     template <typename Type, typename... Args>
-    void createStatement (Args&&... args)   { addStatement (module.allocate<Type> (std::forward<Args> (args)...)); }
+    void createStatement (Args&&... args)   { addStatement (allocator.allocate<Type> (std::forward<Args> (args)...)); }
 
     void addAssignment (heart::Expression& dest, heart::Expression& source)
     {
@@ -254,7 +263,7 @@ struct BlockBuilder
 
     void addFunctionCall (pool_ptr<heart::Expression> dest, heart::Function& function, std::initializer_list<pool_ref<heart::Expression>> args)
     {
-        auto& call = module.allocate<heart::FunctionCall> (CodeLocation(), dest, function);
+        auto& call = allocator.allocate<heart::FunctionCall> (CodeLocation(), dest, function);
         call.arguments.reserve (args.size());
 
         for (auto& a : args)
@@ -266,7 +275,7 @@ struct BlockBuilder
 
     void addFunctionCall (pool_ptr<heart::Expression> dest, heart::Function& function, heart::FunctionCall::ArgListType&& args)
     {
-        auto& call = module.allocate<heart::FunctionCall> (CodeLocation(), dest, function);
+        auto& call = allocator.allocate<heart::FunctionCall> (CodeLocation(), dest, function);
         call.arguments = std::move (args);
         SOUL_ASSERT (call.arguments.size() == function.parameters.size());
         addStatement (call);
@@ -301,26 +310,27 @@ struct BlockBuilder
 
     void setReturnTerminator()
     {
-        setTerminator (module.allocate<heart::ReturnVoid>());
+        setTerminator (allocator.allocate<heart::ReturnVoid>());
     }
 
     void setReturnTerminator (heart::Expression& value)
     {
-        setTerminator (module.allocate<heart::ReturnValue> (value));
+        setTerminator (allocator.allocate<heart::ReturnValue> (value));
     }
 
     void setBranchTerminator (heart::Block& target)
     {
-        setTerminator (module.allocate<heart::Branch> (target));
+        setTerminator (allocator.allocate<heart::Branch> (target));
     }
 
     void setBranchIfTerminator (heart::Expression& condition, heart::Block& trueBranch, heart::Block& falseBranch)
     {
         SOUL_ASSERT (std::addressof (trueBranch) != std::addressof (falseBranch));
-        setTerminator (module.allocate<heart::BranchIf> (condition, trueBranch, falseBranch));
+        setTerminator (allocator.allocate<heart::BranchIf> (condition, trueBranch, falseBranch));
     }
 
     Module& module;
+    heart::Allocator& allocator;
     pool_ptr<heart::Block> currentBlock;
     LinkedList<heart::Statement>::Iterator lastStatementInCurrentBlock;
 };
@@ -333,6 +343,7 @@ struct BlockBuilder
 struct FunctionBuilder  : public BlockBuilder
 {
     FunctionBuilder (Module& m) : BlockBuilder (m) {}
+    FunctionBuilder (Module& m, heart::Allocator& a) : BlockBuilder (m, a) {}
 
     ~FunctionBuilder() override
     {
@@ -424,11 +435,11 @@ struct FunctionBuilder  : public BlockBuilder
                     if (! currentFunction->returnType.isVoid())
                         return false;
 
-                    b->terminator = module.allocate<heart::ReturnVoid>();
+                    b->terminator = allocator.allocate<heart::ReturnVoid>();
                 }
                 else
                 {
-                    b->terminator = module.allocate<heart::Branch> (blocks[i + 1]);
+                    b->terminator = allocator.allocate<heart::Branch> (blocks[i + 1]);
                 }
             }
         }
@@ -443,7 +454,7 @@ struct FunctionBuilder  : public BlockBuilder
 
     heart::Variable& addParameter (const std::string& name, const Type& type)
     {
-        auto& v = module.allocate<heart::Variable> (CodeLocation(), type, module.allocator.get (name),
+        auto& v = allocator.allocate<heart::Variable> (CodeLocation(), type, allocator.get (name),
                                                     heart::Variable::Role::parameter);
         addParameter (v);
         return v;
@@ -458,7 +469,7 @@ struct FunctionBuilder  : public BlockBuilder
 
     [[nodiscard]] heart::Block& createBlock (Identifier name)
     {
-        return module.allocate<heart::Block> (name);
+        return allocator.allocate<heart::Block> (name);
     }
 
     [[nodiscard]] heart::Block& createBlock (const char* prefix, uint32_t index)
@@ -468,7 +479,7 @@ struct FunctionBuilder  : public BlockBuilder
 
     [[nodiscard]] heart::Block& createBlock (const char* name)
     {
-        return createBlock (module.allocator.get (name));
+        return createBlock (allocator.get (name));
     }
 
     [[nodiscard]] heart::Block& createNewBlock()
@@ -515,22 +526,22 @@ struct FunctionBuilder  : public BlockBuilder
 
     void addReturn()
     {
-        addTerminatorStatement (module.allocate<heart::ReturnVoid>(), nullptr);
+        addTerminatorStatement (allocator.allocate<heart::ReturnVoid>(), nullptr);
     }
 
     void addReturn (heart::Expression& value)
     {
-        addTerminatorStatement (module.allocate<heart::ReturnValue> (value), nullptr);
+        addTerminatorStatement (allocator.allocate<heart::ReturnValue> (value), nullptr);
     }
 
     void addBranch (heart::Block& target, pool_ptr<heart::Block> subsequentBlock)
     {
-        addTerminatorStatement (module.allocate<heart::Branch> (target), subsequentBlock);
+        addTerminatorStatement (allocator.allocate<heart::Branch> (target), subsequentBlock);
     }
 
     void addBranch (heart::Block& target, heart::Branch::ArgListType&& targetArgs, pool_ptr<heart::Block> subsequentBlock)
     {
-        auto& branch = module.allocate<heart::Branch> (target);
+        auto& branch = allocator.allocate<heart::Branch> (target);
 
         branch.targetArgs = std::move (targetArgs);
 
@@ -539,7 +550,7 @@ struct FunctionBuilder  : public BlockBuilder
 
     void addBranch (heart::Block& target, std::initializer_list<pool_ref<heart::Expression>> targetArgs, pool_ptr<heart::Block> subsequentBlock)
     {
-        auto& branch = module.allocate<heart::Branch> (target);
+        auto& branch = allocator.allocate<heart::Branch> (target);
 
         for (auto& a : targetArgs)
             branch.targetArgs.push_back (a);
@@ -552,7 +563,7 @@ struct FunctionBuilder  : public BlockBuilder
                       heart::Block& falseBranch,
                       pool_ptr<heart::Block> subsequentBlock)
     {
-        addTerminatorStatement (module.allocate<heart::BranchIf> (condition, trueBranch, falseBranch),
+        addTerminatorStatement (allocator.allocate<heart::BranchIf> (condition, trueBranch, falseBranch),
                                 subsequentBlock);
     }
 
@@ -563,7 +574,7 @@ struct FunctionBuilder  : public BlockBuilder
                       std::initializer_list<pool_ref<heart::Expression>> falseBranchArgs,
                       pool_ptr<heart::Block> subsequentBlock)
     {
-        auto& branchIf = module.allocate<heart::BranchIf> (condition, trueBranch, falseBranch);
+        auto& branchIf = allocator.allocate<heart::BranchIf> (condition, trueBranch, falseBranch);
 
         for (auto& a : trueBranchArgs)
             branchIf.targetArgs[0].push_back (a);
@@ -581,7 +592,7 @@ struct FunctionBuilder  : public BlockBuilder
                       heart::BranchIf::ArgListType&& falseBranchArgs,
                       pool_ptr<heart::Block> subsequentBlock)
     {
-        auto& branchIf = module.allocate<heart::BranchIf> (condition, trueBranch, falseBranch);
+        auto& branchIf = allocator.allocate<heart::BranchIf> (condition, trueBranch, falseBranch);
 
         branchIf.targetArgs[0] = std::move (trueBranchArgs);
         branchIf.targetArgs[1] = std::move (falseBranchArgs);
@@ -600,9 +611,9 @@ struct FunctionBuilder  : public BlockBuilder
                        const std::function<void(FunctionBuilder&)>& createTrueBranch,
                        const std::function<void(FunctionBuilder&)>& createFalseBranch)
     {
-        auto& conditionTrueBlock   = createBlock (module.allocator.get (blockNamePrefix + "_true"));
-        auto& conditionFalseBlock  = createBlock (module.allocator.get (blockNamePrefix + "_false"));
-        auto& continueBlock        = createBlock (module.allocator.get (blockNamePrefix + "_continue"));
+        auto& conditionTrueBlock   = createBlock (allocator.get (blockNamePrefix + "_true"));
+        auto& conditionFalseBlock  = createBlock (allocator.get (blockNamePrefix + "_false"));
+        auto& continueBlock        = createBlock (allocator.get (blockNamePrefix + "_continue"));
 
         addBranchIf (condition, conditionTrueBlock, conditionFalseBlock, conditionTrueBlock);
         createTrueBranch (*this);
@@ -0,0 +1,357 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul
+{
+
+/** Splits a program whose main processor is a graph into a set of smaller programs which
+    can be rendered independently of each other, e.g. on different threads.
+
+    The processor instances in the main graph are grouped so that every connection between
+    two instances stays inside a group, except for stream connections which have a delay
+    of at least one block. Those connections are cut: the source partition gets a new
+    output, the destination partition gets a new input, and the delay on the new connection
+    is shortened by a block, so a caller which feeds each link's output into its input one
+    block later gets exactly the same result as the original graph.
+
+    Every partition keeps all of the original top-level inputs and outputs, but each output
+    is only connected in one of them.
+*/
+struct GraphPartitioner
+{
+    struct Link
+    {
+        size_t sourcePartition, destPartition;
+        std::string endpointName;   // the name of the output in the source, and the input in the dest
+    };
+
+    struct Result
+    {
+        std::vector<Program> partitions;
+        std::vector<Link> links;
+
+        /** For each top-level input, the partitions which contain a connection to it. */
+        std::unordered_map<std::string, std::vector<size_t>> inputPartitions;
+
+        /** For each top-level output, the partition which contains a connection to it. */
+        std::unordered_map<std::string, size_t> outputPartitions;
+    };
+
+    /** Divides up the program into at most maxPartitions pieces. If the blockSize is zero,
+        no connections are cut, so the only partitions will be parts of the graph which
+        aren't connected to each other at all.
+    */
+    static Result partition (const Program& program, uint32_t maxPartitions, uint32_t blockSize)
+    {
+        GraphPartitioner p (program, blockSize);
+        return p.createPartitions (maxPartitions);
+    }
+
+    static constexpr const char* linkEndpointPrefix = "_partition_link_";
+
+private:
+    GraphPartitioner (const Program& p, uint32_t size) : program (p), blockSize (size)
+    {
+        mainGraph = program.getMainProcessor();
+
+        if (mainGraph != nullptr && mainGraph->isGraph())
+            for (size_t i = 0; i < mainGraph->processorInstances.size(); ++i)
+                groups.push_back (i);
+    }
+
+    const Program& program;
+    const uint32_t blockSize;
+    pool_ptr<Module> mainGraph;
+    std::vector<size_t> groups;
+
+    size_t getInstanceIndex (const heart::ProcessorInstance& instance) const
+    {
+        auto& instances = mainGraph->processorInstances;
+
+        for (size_t i = 0; i < instances.size(); ++i)
+            if (instances[i] == instance)
+                return i;
+
+        SOUL_ASSERT_FALSE;
+        return 0;
+    }
+
+    size_t findGroup (size_t instanceIndex)
+    {
+        while (groups[instanceIndex] != instanceIndex)
+            instanceIndex = groups[instanceIndex] = groups[groups[instanceIndex]];
+
+        return instanceIndex;
+    }
+
+    void mergeGroups (size_t instance1, size_t instance2)
+    {
+        groups[findGroup (instance1)] = findGroup (instance2);
+    }
+
+    pool_ptr<heart::OutputDeclaration> findSourceOutput (const heart::Connection& c) const
+    {
+        if (auto module = program.getModuleWithName (c.sourceProcessor->sourceName))
+            return module->findOutput (c.sourceEndpoint);
+
+        return {};
+    }
+
+    bool canCut (const heart::Connection& c) const
+    {
+        if (blockSize == 0 || c.sourceProcessor == nullptr || c.destProcessor == nullptr
+             || c.delayLength < (int64_t) blockSize || c.interpolationType != InterpolationType::none
+             || c.sourceEndpointIndex.has_value() || c.destEndpointIndex.has_value())
+            return false;
+
+        for (auto& instance : { c.sourceProcessor, c.destProcessor })
+            if (instance->arraySize != 1 || instance->hasClockMultiplier() || instance->hasClockDivider())
+                return false;
+
+        auto output = findSourceOutput (c);
+        return output != nullptr && output->isStreamEndpoint() && ! output->arraySize.has_value();
+    }
+
+    Result createPartitions (uint32_t maxPartitions)
+    {
+        Result result;
+
+        if (mainGraph == nullptr || groups.size() < 2 || maxPartitions < 2)
+            return createSinglePartition();
+
+        std::unordered_map<std::string, size_t> outputWriters;
+
+        for (auto& c : mainGraph->connections)
+        {
+            if (c->sourceProcessor != nullptr && c->destProcessor != nullptr)
+            {
+                if (! canCut (c))
+                    mergeGroups (getInstanceIndex (*c->sourceProcessor), getInstanceIndex (*c->destProcessor));
+            }
+            else if (c->sourceProcessor != nullptr)
+            {
+                // all the instances which write to the same top-level output must be rendered together
+                auto source = getInstanceIndex (*c->sourceProcessor);
+                auto writer = outputWriters.find (c->destEndpoint.toString());
+
+                if (writer != outputWriters.end())
+                    mergeGroups (source, writer->second);
+                else
+                    outputWriters[c->destEndpoint.toString()] = source;
+            }
+        }
+
+        auto instancePartitions = assignGroupsToPartitions (maxPartitions);
+        auto numPartitions = 1 + *std::max_element (instancePartitions.begin(), instancePartitions.end());
+
+        if (numPartitions < 2)
+            return createSinglePartition();
+
+        for (size_t i = 0; i < numPartitions; ++i)
+            result.partitions.push_back (program.clone());
+
+        std::vector<std::vector<pool_ref<heart::Connection>>> newConnections (numPartitions);
+
+        for (auto& c : mainGraph->connections)
+        {
+            if (c->sourceProcessor == nullptr && c->destProcessor == nullptr)
+            {
+                auto writer = outputWriters.find (c->destEndpoint.toString());
+                auto partition = writer != outputWriters.end() ? instancePartitions[writer->second] : 0;
+
+                addInputUser (result, c->sourceEndpoint.toString(), partition);
+                result.outputPartitions[c->destEndpoint.toString()] = partition;
+                newConnections[partition].push_back (cloneConnection (result.partitions[partition], c));
+                continue;
+            }
+
+            if (c->sourceProcessor == nullptr)
+            {
+                auto dest = instancePartitions[getInstanceIndex (*c->destProcessor)];
+                addInputUser (result, c->sourceEndpoint.toString(), dest);
+                newConnections[dest].push_back (cloneConnection (result.partitions[dest], c));
+                continue;
+            }
+
+            auto source = instancePartitions[getInstanceIndex (*c->sourceProcessor)];
+
+            if (c->destProcessor == nullptr)
+            {
+                result.outputPartitions[c->destEndpoint.toString()] = source;
+                newConnections[source].push_back (cloneConnection (result.partitions[source], c));
+                continue;
+            }
+
+            auto dest = instancePartitions[getInstanceIndex (*c->destProcessor)];
+
+            if (source == dest)
+            {
+                newConnections[source].push_back (cloneConnection (result.partitions[source], c));
+                continue;
+            }
+
+            auto name = linkEndpointPrefix + std::to_string (result.links.size());
+            result.links.push_back ({ source, dest, name });
+            addLink (result.partitions[source], result.partitions[dest], c, name, newConnections[source], newConnections[dest]);
+        }
+
+        for (size_t i = 0; i < numPartitions; ++i)
+        {
+            auto& graph = result.partitions[i].getMainProcessorOrThrowError();
+            graph.connections = newConnections[i];
+
+            std::vector<pool_ref<heart::ProcessorInstance>> instances;
+
+            for (size_t j = 0; j < instancePartitions.size(); ++j)
+                if (instancePartitions[j] == i)
+                    instances.push_back (graph.processorInstances[j]);
+
+            graph.processorInstances = instances;
+        }
+
+        return result;
+    }
+
+    static void addInputUser (Result& result, const std::string& inputName, size_t partition)
+    {
+        auto& users = result.inputPartitions[inputName];
+
+        if (std::find (users.begin(), users.end(), partition) == users.end())
+            users.push_back (partition);
+    }
+
+    Result createSinglePartition() const
+    {
+        Result result;
+        result.partitions.push_back (program);
+
+        if (mainGraph != nullptr)
+        {
+            for (auto& i : mainGraph->inputs)
+                result.inputPartitions[i->name.toString()] = { 0 };
+
+            for (auto& o : mainGraph->outputs)
+                result.outputPartitions[o->name.toString()] = 0;
+        }
+
+        return result;
+    }
+
+    /** Shares out the groups between the partitions, biggest first, always giving the next
+        group to the partition which has the fewest instances so far.
+    */
+    std::vector<size_t> assignGroupsToPartitions (uint32_t maxPartitions)
+    {
+        std::unordered_map<size_t, uint64_t> groupSizes;
+
+        for (size_t i = 0; i < groups.size(); ++i)
+            groupSizes[findGroup (i)] += mainGraph->processorInstances[i]->arraySize;
+
+        std::vector<std::pair<size_t, uint64_t>> sortedGroups (groupSizes.begin(), groupSizes.end());
+
+        std::sort (sortedGroups.begin(), sortedGroups.end(), [] (auto& a, auto& b)
+        {
+            return a.second != b.second ? a.second > b.second : a.first < b.first;
+        });
+
+        std::vector<uint64_t> partitionSizes (std::min ((size_t) maxPartitions, sortedGroups.size()), 0);
+        std::unordered_map<size_t, size_t> groupPartitions;
+
+        for (auto& g : sortedGroups)
+        {
+            auto smallest = (size_t) std::distance (partitionSizes.begin(),
+                                                    std::min_element (partitionSizes.begin(), partitionSizes.end()));
+            groupPartitions[g.first] = smallest;
+            partitionSizes[smallest] += g.second;
+        }
+
+        std::vector<size_t> instancePartitions;
+
+        for (size_t i = 0; i < groups.size(); ++i)
+            instancePartitions.push_back (groupPartitions[findGroup (i)]);
+
+        return instancePartitions;
+    }
+
+    pool_ptr<heart::ProcessorInstance> findClonedInstance (Module& graph, pool_ptr<heart::ProcessorInstance> original) const
+    {
+        if (original == nullptr)
+            return {};
+
+        return graph.processorInstances[getInstanceIndex (*original)];
+    }
+
+    heart::Connection& cloneConnection (Program& partition, const heart::Connection& old) const
+    {
+        auto& graph = partition.getMainProcessorOrThrowError();
+        auto& c = graph.allocate<heart::Connection> (old.location);
+        c.interpolationType   = old.interpolationType;
+        c.sourceProcessor     = findClonedInstance (graph, old.sourceProcessor);
+        c.destProcessor       = findClonedInstance (graph, old.destProcessor);
+        c.sourceEndpoint      = partition.getAllocator().get (old.sourceEndpoint.toString());
+        c.destEndpoint        = partition.getAllocator().get (old.destEndpoint.toString());
+        c.sourceEndpointIndex = old.sourceEndpointIndex;
+        c.destEndpointIndex   = old.destEndpointIndex;
+        c.delayLength         = old.delayLength;
+        return c;
+    }
+
+    void addLink (Program& sourcePartition, Program& destPartition, const heart::Connection& old, const std::string& name,
+                  std::vector<pool_ref<heart::Connection>>& sourceConnections,
+                  std::vector<pool_ref<heart::Connection>>& destConnections) const
+    {
+        auto sourceOutput = findSourceOutput (old);
+        SOUL_ASSERT (sourceOutput != nullptr);
+
+        {
+            auto& graph = sourcePartition.getMainProcessorOrThrowError();
+            auto& output = graph.allocate<heart::OutputDeclaration> (old.location);
+            output.name = sourcePartition.getAllocator().get (name);
+            output.index = (uint32_t) graph.outputs.size();
+            output.endpointType = sourceOutput->endpointType;
+            output.dataTypes = sourceOutput->dataTypes;
+            graph.outputs.push_back (output);
+
+            auto& c = cloneConnection (sourcePartition, old);
+            c.destProcessor = {};
+            c.destEndpoint = output.name;
+            c.delayLength = 0;
+            sourceConnections.push_back (c);
+        }
+
+        {
+            auto& graph = destPartition.getMainProcessorOrThrowError();
+            auto& input = graph.allocate<heart::InputDeclaration> (old.location);
+            input.name = destPartition.getAllocator().get (name);
+            input.index = (uint32_t) graph.inputs.size();
+            input.endpointType = sourceOutput->endpointType;
+            input.dataTypes = sourceOutput->dataTypes;
+            graph.inputs.push_back (input);
+
+            auto& c = cloneConnection (destPartition, old);
+            c.sourceProcessor = {};
+            c.sourceEndpoint = input.name;
+            c.delayLength = old.delayLength - (int64_t) blockSize;
+            destConnections.push_back (c);
+        }
+    }
+};
+
+} // namespace soul
@@ -0,0 +1,732 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul
+{
+
+//==============================================================================
+/**
+    Runs each processor's state initialisation function at link time, and if it can be
+    fully evaluated, replaces its body with a plain list of constant assignments.
+
+    Once the sample rate and any specialisation arguments are known, tables which a
+    processor builds in its init() function (or in the initialisers of its state variables)
+    are usually fixed, but without this they'd be recalculated every time a performer is
+    reset. After this pass, a reset just copies the pre-computed values into place.
+
+    The evaluation is abandoned for a processor, leaving its code untouched, if it
+    does anything whose result can't be known at this point: reading an external variable,
+    a stream or a processor's id, calling a function with no body, writing to an output
+    (e.g. the console), running for more than maxStatements, or anything that would be
+    undefined behaviour at runtime, like an integer division by zero. processor.frequency
+    and processor.period can only be used if every instance of the processor runs at the
+    same rate.
+
+    If a map of previous results is supplied, a processor whose key (as returned by getKey)
+    was in it has that result applied instead of being evaluated again. Only the processors
+    with a non-empty key are looked up, and the map is left holding the results for those.
+*/
+struct InitialStateEvaluator
+{
+    using Result = Compiler::IncrementalBuildCache::InitialState;
+    using GetKeyFn = std::function<std::string (const Module&)>;
+
+    static void apply (Program& program, double sampleRate,
+                       const GetKeyFn& getKey = {},
+                       std::unordered_map<std::string, Result>* previousResults = nullptr)
+    {
+        auto rates = getProcessorRates (program, sampleRate);
+        std::unordered_map<std::string, Result> results;
+
+        for (auto& m : program.getModules())
+        {
+            if (m->isProcessor())
+            {
+                auto rate = rates.find (m.getPointer());
+                InitialStateEvaluator evaluator (m, rate != rates.end() ? rate->second : 0);
+                auto key = previousResults != nullptr ? getKey (m.get()) : std::string();
+
+                if (key.empty())
+                {
+                    evaluator.evaluate();
+                    continue;
+                }
+
+                // The rate is given to the processor from outside, so it's part of the key
+                key += "@" + choc::text::floatToString (evaluator.frequency);
+
+                if (! (evaluator.applyPreviousResult (results, key) || evaluator.applyPreviousResult (*previousResults, key)))
+                    evaluator.evaluate();
+
+                if (evaluator.result.has_value())
+                    results[key] = std::move (*evaluator.result);
+            }
+        }
+
+        if (previousResults != nullptr)
+            *previousResults = std::move (results);
+    }
+
+    static constexpr uint64_t maxStatements = 1u << 22;
+
+private:
+    InitialStateEvaluator (Module& m, double rate) : module (m), frequency (rate) {}
+
+    struct Abandon {};
+
+    /** A reference to a value, or a part of one. */
+    struct LValue
+    {
+        Value* root = nullptr;
+        SubElementPath path;
+        size_t sliceStart = 0, sliceEnd = 0;
+        bool isSlice = false;
+
+        bool isWholeValue() const    { return ! isSlice && path.getPath().empty(); }
+    };
+
+    struct Frame
+    {
+        std::unordered_map<const heart::Variable*, Value> values;
+        std::unordered_map<const heart::Variable*, LValue> references;
+    };
+
+    Module& module;
+    double frequency;
+    std::unordered_map<const heart::Variable*, Value> stateValues;
+    std::vector<pool_ref<heart::Variable>> writtenStateVariables;
+    uint64_t numStatements = 0;
+    uint32_t callDepth = 0;
+    std::optional<Result> result;
+
+    static constexpr uint32_t maxCallDepth = 256;
+
+    //==============================================================================
+    void evaluate()
+    {
+        result = Result { getStateDescription(), false, {} };
+        auto initFunction = module.findFunction (heart::getSystemInitFunctionName());
+
+        if (initFunction == nullptr || initFunction->hasNoBody || initFunction->blocks.empty())
+            return;
+
+        try
+        {
+            Frame frame;
+            call (*initFunction, frame);
+        }
+        catch (Abandon) { return; }
+
+        // If the function was already nothing more than one assignment per variable, there's no point rebuilding it
+        if (initFunction->blocks.size() == 1 && numStatements <= writtenStateVariables.size() + 1)
+            return;
+
+        result->wasReplaced = true;
+
+        for (auto& v : module.stateVariables)
+        {
+            if (contains (writtenStateVariables, v))
+            {
+                // Strings and unsized arrays are handles into this program's tables, so they can't be re-used
+                if (! canBeStoredAsRawData (v->type))
+                {
+                    result.reset();
+                    break;
+                }
+
+                auto& value = stateValues[v.getPointer()];
+                auto data = static_cast<const uint8_t*> (value.getPackedData());
+                result->values.push_back ({ v->name.toString(), std::vector<uint8_t> (data, data + value.getPackedDataSize()) });
+            }
+        }
+
+        replaceInitFunction (*initFunction);
+    }
+
+    bool applyPreviousResult (const std::unordered_map<std::string, Result>& previousResults, const std::string& key)
+    {
+        auto found = previousResults.find (key);
+
+        if (found == previousResults.end())
+            return false;
+
+        auto& previous = found->second;
+
+        if (previous.stateVariables != getStateDescription())
+            return false;
+
+        if (previous.wasReplaced)
+        {
+            auto initFunction = module.findFunction (heart::getSystemInitFunctionName());
+
+            if (initFunction == nullptr)
+                return false;
+
+            std::unordered_map<const heart::Variable*, Value> values;
+
+            for (auto& v : module.stateVariables)
+            {
+                for (auto& value : previous.values)
+                {
+                    if (v->name.toString() == value.first)
+                    {
+                        if (value.second.size() != v->type.getPackedSizeInBytes())
+                            return false;
+
+                        values[v.getPointer()] = Value::createFromRawData (v->type, value.second.data(), value.second.size());
+                        break;
+                    }
+                }
+            }
+
+            if (values.size() != previous.values.size())
+                return false;
+
+            for (auto& v : module.stateVariables)
+                if (values.find (v.getPointer()) != values.end())
+                    writtenStateVariables.push_back (v);
+
+            stateValues = std::move (values);
+            replaceInitFunction (*initFunction);
+        }
+
+        result = previous;
+        return true;
+    }
+
+    std::string getStateDescription() const
+    {
+        std::string description;
+
+        for (auto& v : module.stateVariables)
+            description += v->name.toString() + " " + v->type.getDescription() + "; ";
+
+        return description;
+    }
+
+    static bool canBeStoredAsRawData (const Type& type)
+    {
+        if (type.isStringLiteral() || type.isUnsizedArray())
+            return false;
+
+        if (type.isFixedSizeArray())
+            return canBeStoredAsRawData (type.getElementType());
+
+        if (type.isStruct())
+        {
+            auto& s = type.getStructRef();
+
+            for (size_t i = 0; i < s.getNumMembers(); ++i)
+                if (! canBeStoredAsRawData (s.getMemberType (i)))
+                    return false;
+        }
+
+        return true;
+    }
+
+    void replaceInitFunction (heart::Function& initFunction)
+    {
+        initFunction.blocks.clear();
+        initFunction.flatBody.reset();
+
+        FunctionBuilder builder (module);
+        builder.beginFunction (initFunction);
+        builder.ensureBlockIsReady();
+
+        for (auto& v : module.stateVariables)
+            if (contains (writtenStateVariables, v))
+                builder.addAssignment (v, stateValues[v.getPointer()]);
+
+        builder.endFunction();
+        builder.checkFunctionBlocksForTermination();
+    }
+
+    //==============================================================================
+    Value call (heart::Function& f, Frame& frame)
+    {
+        if (++callDepth > maxCallDepth || f.hasNoBody || f.blocks.empty())
+            throw Abandon();
+
+        auto block = f.blocks.front();
+
+        for (;;)
+        {
+            for (auto s : block->statements)
+            {
+                countStatement();
+                perform (*s, frame);
+            }
+
+            countStatement();
+            auto terminator = block->terminator;
+
+            if (auto branch = cast<heart::Branch> (terminator))
+            {
+                setBlockParameters (branch->target, branch->targetArgs, frame);
+                block = branch->target;
+            }
+            else if (auto branchIf = cast<heart::BranchIf> (terminator))
+            {
+                auto index = evaluate (branchIf->condition, frame).getAsBool() ? 0 : 1;
+                setBlockParameters (branchIf->targets[index], branchIf->targetArgs[index], frame);
+                block = branchIf->targets[index];
+            }
+            else if (auto returnValue = cast<heart::ReturnValue> (terminator))
+            {
+                auto result = evaluate (returnValue->returnValue, frame).tryCastToType (f.returnType.removeReferenceIfPresent());
+                --callDepth;
+                return checkValid (result);
+            }
+            else if (is_type<heart::ReturnVoid> (terminator))
+            {
+                --callDepth;
+                return {};
+            }
+            else
+            {
+                throw Abandon();
+            }
+        }
+    }
+
+    void countStatement()
+    {
+        if (++numStatements > maxStatements)
+            throw Abandon();
+    }
+
+    template <typename ArgList>
+    void setBlockParameters (heart::Block& target, const ArgList& args, Frame& frame)
+    {
+        if (args.size() != target.parameters.size())
+            throw Abandon();
+
+        // All the arguments need to be evaluated before any of the parameters are changed
+        std::vector<Value> values;
+
+        for (auto& a : args)
+            values.push_back (evaluate (a, frame));
+
+        for (size_t i = 0; i < values.size(); ++i)
+            frame.values[target.parameters[i].getPointer()] = castTo (values[i], target.parameters[i]->type);
+    }
+
+    void perform (heart::Statement& s, Frame& frame)
+    {
+        if (auto a = cast<heart::AssignFromValue> (s))
+        {
+            auto value = evaluate (a->source, frame);
+            write (*a->target, std::move (value), frame);
+            return;
+        }
+
+        if (auto fc = cast<heart::FunctionCall> (s))
+        {
+            auto result = callFunction (fc->getFunction(), fc->arguments, frame);
+
+            if (fc->target != nullptr)
+                write (*fc->target, std::move (result), frame);
+
+            return;
+        }
+
+        // Streams, advance() and anything else can't happen at link time
+        throw Abandon();
+    }
+
+    template <typename ArgList>
+    Value callFunction (heart::Function& f, const ArgList& args, Frame& callerFrame)
+    {
+        if (args.size() != f.parameters.size())
+            throw Abandon();
+
+        if (f.intrinsicType != IntrinsicType::none)
+        {
+            auto result = performIntrinsic (f, args, callerFrame);
+
+            if (result.isValid())
+                return result;
+
+            if (hasPlaceholderBody (f.intrinsicType))
+                throw Abandon();
+        }
+
+        Frame frame;
+
+        for (size_t i = 0; i < f.parameters.size(); ++i)
+        {
+            auto& param = f.parameters[i];
+
+            if (param->type.isReference() && isLValue (args[i]))
+                frame.references.emplace (param.getPointer(), getLValue (args[i], callerFrame));
+            else
+                frame.values[param.getPointer()] = castTo (evaluate (args[i], callerFrame), param->type);
+        }
+
+        return call (f, frame);
+    }
+
+    template <typename ArgList>
+    Value performIntrinsic (heart::Function& f, const ArgList& args, Frame& frame)
+    {
+        ArrayWithPreallocation<Value, 4> argValues;
+
+        for (auto& a : args)
+            argValues.push_back (evaluate (a, frame));
+
+        auto result = soul::performIntrinsic (f.intrinsicType, argValues);
+
+        if (! result.isValid())
+            return {};
+
+        return result.tryCastToType (f.returnType.removeReferenceIfPresent().removeConstIfPresent());
+    }
+
+    /** The library declares these intrinsics with bodies that just return a dummy value. */
+    static bool hasPlaceholderBody (IntrinsicType i)
+    {
+        return i == IntrinsicType::sqrt  || i == IntrinsicType::pow   || i == IntrinsicType::exp
+            || i == IntrinsicType::log   || i == IntrinsicType::log10 || i == IntrinsicType::sin
+            || i == IntrinsicType::cos   || i == IntrinsicType::isnan || i == IntrinsicType::isinf;
+    }
+
+    //==============================================================================
+    Value evaluate (heart::Expression& e, Frame& frame)
+    {
+        if (auto c = cast<heart::Constant> (e))
+        {
+            if (c->value.getType().isUnsizedArray())
+                throw Abandon();
+
+            return c->value;
+        }
+
+        if (isLValue (e))
+            return read (getLValue (e, frame));
+
+        if (auto tc = cast<heart::TypeCast> (e))
+            return castTo (evaluate (tc->source, frame), tc->destType);
+
+        if (auto u = cast<heart::UnaryOperator> (e))
+            return applyUnaryOp (evaluate (u->source, frame), u->operation);
+
+        if (auto b = cast<heart::BinaryOperator> (e))
+            return applyBinaryOp (evaluate (b->lhs, frame), evaluate (b->rhs, frame), b->operation, b->getType());
+
+        if (auto fc = cast<heart::PureFunctionCall> (e))
+            return callFunction (fc->function, fc->arguments, frame);
+
+        if (auto pp = cast<heart::ProcessorProperty> (e))
+        {
+            if (frequency > 0)
+            {
+                if (pp->property == heart::ProcessorProperty::Property::frequency)  return castTo (Value (frequency), pp->getType());
+                if (pp->property == heart::ProcessorProperty::Property::period)     return castTo (Value (1.0 / frequency), pp->getType());
+            }
+        }
+
+        throw Abandon();
+    }
+
+    static Value applyUnaryOp (Value value, UnaryOp::Op op)
+    {
+        if (value.getType().isVector())
+        {
+            ArrayWithPreallocation<Value, 8> elements;
+
+            for (size_t i = 0; i < value.getType().getVectorSize(); ++i)
+                elements.push_back (applyUnaryOp (value.getSubElement (i), op));
+
+            return Value::createArrayOrVector (value.getType(), elements);
+        }
+
+        if (! isPrimitiveOrBoundedInt (value))
+            throw Abandon();
+
+        auto resultType = value.getType();
+        value = toPrimitive (value);
+
+        if (! UnaryOp::apply (value, op))
+            throw Abandon();
+
+        return castTo (value, resultType);
+    }
+
+    static Value applyBinaryOp (Value a, Value b, BinaryOp::Op op, const Type& resultType)
+    {
+        if (resultType.isVector())
+        {
+            ArrayWithPreallocation<Value, 8> elements;
+            auto elementType = resultType.getElementType();
+
+            for (size_t i = 0; i < resultType.getVectorSize(); ++i)
+                elements.push_back (applyBinaryOp (a.getType().isVector() ? a.getSubElement (i) : a,
+                                                   b.getType().isVector() ? b.getSubElement (i) : b,
+                                                   op, elementType));
+
+            return Value::createArrayOrVector (resultType, elements);
+        }
+
+        // Errors such as a division by zero aren't reported, as they'd only happen at runtime
+        if (! (isPrimitiveOrBoundedInt (a) && isPrimitiveOrBoundedInt (b)))
+            throw Abandon();
+
+        a = toPrimitive (a);
+        b = toPrimitive (b);
+
+        // Dividing the lowest integer by -1 would overflow here in the compiler
+        if ((op == BinaryOp::Op::divide || op == BinaryOp::Op::modulo)
+              && a.getType().isInteger() && b.getType().isInteger() && b.getAsInt64() == -1)
+            throw Abandon();
+
+        if (! BinaryOp::apply (a, b, op, [] (CompileMessage) {}))
+            throw Abandon();
+
+        // Casting back to the result type takes care of wrapping or clamping a bounded int
+        return castTo (a, resultType);
+    }
+
+    static bool isPrimitiveOrBoundedInt (const Value& v)
+    {
+        return v.getType().isPrimitive() || v.getType().isBoundedInt();
+    }
+
+    /** The compile-time operators only deal with plain primitives, so a bounded int is treated
+        as an int32, and the result is cast back to the bounded type afterwards.
+    */
+    static Value toPrimitive (const Value& v)
+    {
+        if (v.getType().isBoundedInt())
+            return checkValid (v.tryCastToType (PrimitiveType::int32));
+
+        return castTo (v, v.getType().removeConstIfPresent());
+    }
+
+    static Value castTo (const Value& v, const Type& type)
+    {
+        auto destType = type.removeReferenceIfPresent();
+
+        // A Value can only turn a bounded int into an integer, so anything else goes via an int32
+        if (v.getType().isBoundedInt() && ! (destType.isInteger() || destType.isBoundedInt()))
+            return castTo (checkValid (v.tryCastToType (PrimitiveType::int32)), destType);
+
+        return checkValid (v.tryCastToType (destType));
+    }
+
+    static Value checkValid (Value v)
+    {
+        if (! v.isValid())
+            throw Abandon();
+
+        return v;
+    }
+
+    //==============================================================================
+    static bool isLValue (heart::Expression& e)
+    {
+        return is_type<heart::Variable> (e) || is_type<heart::ArrayElement> (e) || is_type<heart::StructElement> (e);
+    }
+
+    LValue getLValue (heart::Expression& e, Frame& frame)
+    {
+        if (auto v = cast<heart::Variable> (e))
+        {
+            if (v->isExternal())
+                throw Abandon();
+
+            auto reference = frame.references.find (v.get());
+
+            if (reference != frame.references.end())
+                return reference->second;
+
+            LValue result;
+
+            if (v->isState())
+            {
+                // A state variable has to be given a value here before it's read, otherwise it'd
+                // depend on whatever was left in it before the performer was reset
+                auto found = stateValues.find (v.get());
+
+                if (found == stateValues.end())
+                    throw Abandon();
+
+                result.root = std::addressof (found->second);
+            }
+            else
+            {
+                auto found = frame.values.find (v.get());
+
+                if (found == frame.values.end())
+                    throw Abandon();
+
+                result.root = std::addressof (found->second);
+            }
+
+            return result;
+        }
+
+        if (auto a = cast<heart::ArrayElement> (e))
+        {
+            auto result = getLValue (a->parent, frame);
+            auto parentType = getType (result);
+
+            if (result.isSlice || ! parentType.isArrayOrVector() || parentType.isUnsizedArray())
+                throw Abandon();
+
+            if (a->isDynamic())
+            {
+                auto index = toPrimitive (evaluate (*a->dynamicIndex, frame)).getAsInt64();
+
+                if (index < 0 || (uint64_t) index >= (uint64_t) parentType.getArrayOrVectorSize())
+                    throw Abandon();
+
+                result.path += (size_t) index;
+            }
+            else if (a->isSlice())
+            {
+                result.isSlice = true;
+                result.sliceStart = a->fixedStartIndex;
+                result.sliceEnd = a->fixedEndIndex;
+            }
+            else
+            {
+                result.path += a->fixedStartIndex;
+            }
+
+            return result;
+        }
+
+        if (auto s = cast<heart::StructElement> (e))
+        {
+            auto result = getLValue (s->parent, frame);
+
+            if (result.isSlice || ! getType (result).isStruct())
+                throw Abandon();
+
+            result.path += s->getMemberIndex();
+            return result;
+        }
+
+        throw Abandon();
+    }
+
+    static Type getType (const LValue& l)
+    {
+        if (l.path.getPath().empty())
+            return l.root->getType().removeReferenceIfPresent();
+
+        return l.path.getElement (l.root->getType()).type;
+    }
+
+    static Value read (const LValue& l)
+    {
+        auto value = l.path.getPath().empty() ? *l.root : l.root->getSubElement (l.path);
+
+        if (l.isSlice)
+            return value.getSlice (l.sliceStart, l.sliceEnd);
+
+        return value;
+    }
+
+    void write (heart::Expression& target, Value value, Frame& frame)
+    {
+        if (auto v = cast<heart::Variable> (target))
+        {
+            if (v->isExternal())
+                throw Abandon();
+
+            if (frame.references.find (v.get()) == frame.references.end())
+            {
+                auto newValue = castTo (value, v->type);
+
+                if (v->isState())
+                {
+                    if (! contains (writtenStateVariables, *v))
+                        writtenStateVariables.push_back (*v);
+
+                    stateValues[v.get()] = std::move (newValue);
+                }
+                else
+                {
+                    frame.values[v.get()] = std::move (newValue);
+                }
+
+                return;
+            }
+        }
+
+        auto l = getLValue (target, frame);
+
+        if (l.isSlice)
+        {
+            auto elementType = getType (l).getElementType();
+
+            if (value.getType().getArrayOrVectorSize() != l.sliceEnd - l.sliceStart)
+                throw Abandon();
+
+            for (size_t i = l.sliceStart; i < l.sliceEnd; ++i)
+                l.root->modifySubElementInPlace (l.path + i, castTo (value.getSubElement (i - l.sliceStart), elementType));
+        }
+        else if (l.isWholeValue())
+        {
+            *l.root = castTo (value, l.root->getType());
+        }
+        else
+        {
+            l.root->modifySubElementInPlace (l.path, castTo (value, getType (l)));
+        }
+    }
+
+    //==============================================================================
+    /** Works out the rate at which each processor runs, for the ones where it's the same
+        wherever the processor is used.
+    */
+    static std::unordered_map<const Module*, double> getProcessorRates (const Program& program, double sampleRate)
+    {
+        std::unordered_map<const Module*, double> rates;
+
+        if (auto main = program.getMainProcessor())
+            addRates (program, *main, sampleRate, rates);
+
+        return rates;
+    }
+
+    static void addRates (const Program& program, const Module& module, double rate,
+                          std::unordered_map<const Module*, double>& rates)
+    {
+        if (module.isGraph())
+        {
+            for (auto& i : module.processorInstances)
+                if (auto child = program.getModuleWithName (i->sourceName))
+                    addRates (program, *child, rate * (double) i->clockMultiplier / (double) i->clockDivider, rates);
+
+            return;
+        }
+
+        auto existing = rates.find (std::addressof (module));
+
+        if (existing == rates.end())
+            rates[std::addressof (module)] = rate;
+        else if (existing->second != rate)
+            existing->second = 0;
+    }
+};
+
+} // namespace soul
@@ -0,0 +1,236 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul
+{
+
+//==============================================================================
+/**
+    A static schedule for rendering a graph whose processor instances run at different
+    clock rates.
+
+    The graph, including any nested graphs, is flattened into a list of stages, one for each
+    processor that needs to be run. Each stage has its overall clock rate relative to the
+    main graph. Clock multipliers and dividers are always powers of two, so this is held as
+    a shift. The stages are in an order where every instance comes after the ones it reads
+    from without a delay. Where the ordering allows it, stages with the same rate are placed
+    next to each other, and each run of same-rate stages is a Batch.
+
+    A back end can then render each block one stage at a time. Each processor runs for
+    getNumFrames() frames in its own tight loop at its native rate. This avoids stepping the
+    whole graph one frame at a time and testing each instance's clock counter on every frame.
+*/
+struct MultiRateSchedule
+{
+    struct Stage
+    {
+        /** The chain of instances leading from the main graph down to this processor. */
+        std::vector<pool_ref<heart::ProcessorInstance>> path;
+        pool_ref<Module> processor;
+
+        /** log2 of this stage's clock rate relative to the main graph, so e.g. a processor
+            with a clock divider of 4 has a shift of -2.
+        */
+        int rateShift = 0;
+
+        /** Returns the number of frames this stage must render to cover the main graph's
+            frames from startFrame to startFrame + numFrames. For a divided clock, this depends
+            on where the block starts, because its frames don't line up with every block.
+        */
+        uint32_t getNumFrames (uint64_t startFrame, uint32_t numFrames) const
+        {
+            if (rateShift >= 0)
+                return numFrames << rateShift;
+
+            auto shift = static_cast<uint32_t> (-rateShift);
+            return static_cast<uint32_t> (((startFrame + numFrames) >> shift) - (startFrame >> shift));
+        }
+
+        /** Returns the largest number of frames this stage can be asked to render in one block. */
+        uint32_t getMaxFramesPerBlock (uint32_t maxBlockSize) const
+        {
+            if (rateShift >= 0)
+                return maxBlockSize << rateShift;
+
+            return (maxBlockSize >> static_cast<uint32_t> (-rateShift)) + 1;
+        }
+    };
+
+    /** A run of consecutive stages which all have the same clock rate. */
+    struct Batch
+    {
+        int rateShift;
+        size_t startStage, endStage;
+    };
+
+    std::vector<Stage> stages;
+    std::vector<Batch> batches;
+
+    /** Returns the smallest block size for which every stage renders the same number of frames
+        in each block. A caller can use block sizes that are a multiple of this to keep the
+        amount of work per block constant.
+    */
+    uint32_t getBlockAlignment() const
+    {
+        int lowestShift = 0;
+
+        for (auto& s : stages)
+            lowestShift = std::min (lowestShift, s.rateShift);
+
+        return 1u << static_cast<uint32_t> (-lowestShift);
+    }
+
+    static MultiRateSchedule create (const Program& program, const Module& graph)
+    {
+        SOUL_ASSERT (graph.isGraph());
+        MultiRateSchedule schedule;
+        std::vector<pool_ref<heart::ProcessorInstance>> path;
+        schedule.addGraph (program, graph, path, 0);
+        schedule.createBatches();
+        return schedule;
+    }
+
+private:
+    //==============================================================================
+    static int getRateShift (const heart::ProcessorInstance& i)
+    {
+        auto log2 = [] (int64_t n)
+        {
+            int shift = 0;
+
+            while ((n >>= 1) != 0)
+                ++shift;
+
+            return shift;
+        };
+
+        return log2 (i.clockMultiplier) - log2 (i.clockDivider);
+    }
+
+    void addGraph (const Program& program, const Module& graph,
+                   std::vector<pool_ref<heart::ProcessorInstance>>& path, int parentRateShift)
+    {
+        auto& instances = graph.processorInstances;
+        auto numInstances = instances.size();
+
+        auto indexOf = [&] (pool_ptr<heart::ProcessorInstance> i) -> size_t
+        {
+            for (size_t j = 0; j < numInstances; ++j)
+                if (instances[j] == i)
+                    return j;
+
+            return numInstances;
+        };
+
+        // A connection with a delay doesn't need its source to be rendered first, which is
+        // what allows a graph with feedback to be ordered at all
+        std::vector<std::vector<size_t>> dependents (numInstances);
+        std::vector<uint32_t> numDependencies (numInstances, 0);
+
+        for (auto& c : graph.connections)
+        {
+            auto source = indexOf (c->sourceProcessor);
+            auto dest = indexOf (c->destProcessor);
+
+            if (source < numInstances && dest < numInstances && source != dest && c->delayLength == 0)
+            {
+                dependents[source].push_back (dest);
+                ++numDependencies[dest];
+            }
+        }
+
+        std::vector<int> rateShifts;
+
+        for (auto& i : instances)
+            rateShifts.push_back (parentRateShift + getRateShift (i));
+
+        std::vector<bool> done (numInstances, false);
+        int lastRateShift = stages.empty() ? parentRateShift : stages.back().rateShift;
+
+        for (size_t numDone = 0; numDone < numInstances; ++numDone)
+        {
+            // Take the first instance which is ready to go, but prefer one with the same rate as
+            // the last stage, so that same-rate stages end up in the same batch
+            size_t next = numInstances;
+
+            for (size_t i = 0; i < numInstances; ++i)
+            {
+                if (! done[i] && numDependencies[i] == 0)
+                {
+                    if (next == numInstances)
+                        next = i;
+
+                    if (rateShifts[i] == lastRateShift)
+                    {
+                        next = i;
+                        break;
+                    }
+                }
+            }
+
+            // This can only happen if there's a cycle without a delay, which the compiler
+            // should have already rejected, so just carry on in the order they were declared
+            if (next == numInstances)
+                for (size_t i = 0; i < numInstances && next == numInstances; ++i)
+                    if (! done[i])
+                        next = i;
+
+            done[next] = true;
+
+            for (auto d : dependents[next])
+                if (numDependencies[d] > 0)
+                    --numDependencies[d];
+
+            addInstance (program, instances[next], path, rateShifts[next]);
+
+            if (! stages.empty())
+                lastRateShift = stages.back().rateShift;
+        }
+    }
+
+    void addInstance (const Program& program, pool_ref<heart::ProcessorInstance> instance,
+                      std::vector<pool_ref<heart::ProcessorInstance>>& path, int rateShift)
+    {
+        auto module = program.getModuleWithName (instance->sourceName);
+        SOUL_ASSERT (module != nullptr);
+
+        path.push_back (instance);
+
+        if (module->isGraph())
+            addGraph (program, *module, path, rateShift);
+        else
+            stages.push_back ({ path, *module, rateShift });
+
+        path.pop_back();
+    }
+
+    void createBatches()
+    {
+        for (size_t i = 0; i < stages.size(); ++i)
+        {
+            if (batches.empty() || batches.back().rateShift != stages[i].rateShift)
+                batches.push_back ({ stages[i].rateShift, i, i + 1 });
+            else
+                batches.back().endStage = i + 1;
+        }
+    }
+};
+
+} // namespace soul
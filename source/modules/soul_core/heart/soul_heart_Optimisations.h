@@ -31,20 +31,16 @@ struct Optimisations
     {
         for (auto& m : program.getModules())
         {
-            m->rebuildVariableUseCounts();
-
             for (auto f : m->functions)
+            {
                 removeDuplicateConstants (f);
 
-            m->rebuildVariableUseCounts();
-
-            for (auto f : m->functions)
-                convertWriteOnceVariablesToConstants (f);
-
-            m->rebuildVariableUseCounts();
-
-            for (auto f : m->functions)
-                removeUnusedVariables (f);
+                // NB: converting variables to constants doesn't change how often they're read,
+                // so the same chains can be used for both of these passes
+                heart::UseDefChains chains (f);
+                convertWriteOnceVariablesToConstants (chains);
+                removeDeadStores (f, chains);
+            }
         }
     }
 
@@ -130,210 +126,1634 @@ struct Optimisations
 
         for (auto& module : program.getModules())
         {
-            for (auto& s : module->structs)
-            {
-                ArrayWithPreallocation<size_t, 4> unusedMembers;
+            for (auto& s : module->structs)
+            {
+                ArrayWithPreallocation<size_t, 4> unusedMembers;
+
+                for (size_t i = 0; i < s->getNumMembers(); ++i)
+                    if (s->getMemberReadWriteCount (i).numReads == 0)
+                        unusedMembers.push_back (i);
+
+                if (! unusedMembers.empty())
+                {
+                    std::reverse (unusedMembers.begin(), unusedMembers.end());
+                    results.push_back ({ module, *s, unusedMembers });
+                }
+            }
+        }
+
+        return results;
+    }
+
+    static void optimiseFunctionBlocks (Program& program)
+    {
+        for (auto& m : program.getModules())
+            for (auto f : m->functions)
+                optimiseFunctionBlocks (f, program.getAllocator());
+    }
+
+    /** Does the same job as optimiseFunctionBlocks(), but shares the functions out
+        between a number of worker threads. Each worker gets its own allocator, which
+        is merged back into the program's allocator when they've all finished.
+    */
+    static void optimiseFunctionBlocks (Program& program, uint32_t numThreads)
+    {
+        std::vector<pool_ref<heart::Function>> functions;
+
+        for (auto& m : program.getModules())
+            for (auto f : m->functions)
+                functions.push_back (f);
+
+        auto numBatches = std::min ((size_t) numThreads, functions.size());
+
+        if (numBatches <= 1)
+            return optimiseFunctionBlocks (program);
+
+        std::vector<heart::Allocator> allocators (numBatches);
+        auto batchSize = (functions.size() + numBatches - 1) / numBatches;
+
+        runCompileTasksInParallel (numBatches, numThreads, [&] (size_t batch)
+        {
+            auto end = std::min (functions.size(), (batch + 1) * batchSize);
+
+            for (auto i = batch * batchSize; i < end; ++i)
+                optimiseFunctionBlocks (functions[i], allocators[batch]);
+        });
+
+        for (auto& a : allocators)
+            program.getAllocator().pool.absorb (a.pool);
+    }
+
+    static void optimiseFunctionBlocks (heart::Function& f, heart::Allocator& allocator)
+    {
+        f.rebuildBlockPredecessors();
+        eliminateEmptyAndUnreachableBlocks (f, allocator);
+        eliminateUnreachableBlockCycles (f);
+        mergeAdjacentBlocks (f);
+    }
+
+    /** Propagates compile-time constant values through the program's functions, folding any
+        operators, casts and conditional branches that end up with constant operands.
+    */
+    static void propagateConstants (Program& program)
+    {
+        for (auto& m : program.getModules())
+            for (auto f : m->functions)
+                propagateConstants (f, program.getAllocator());
+    }
+
+    /** Repeatedly substitutes the values of constant variables and constant block parameters
+        into the expressions which read them, until nothing else can be folded.
+    */
+    static bool propagateConstants (heart::Function& f, heart::Allocator& allocator)
+    {
+        bool anyChanged = false;
+
+        for (;;)
+        {
+            bool changed = foldConstantExpressions (f, allocator);
+
+            if (foldConstantBranches (f, allocator))
+                changed = true;
+
+            if (propagateConstantBlockParameters (f, allocator))
+                changed = true;
+
+            if (! changed)
+                return anyChanged;
+
+            anyChanged = true;
+        }
+    }
+
+    /** Looks for simple counted loops which apply the same element-wise operations to every
+        element of some vectors, and replaces them with whole-vector operations.
+    */
+    static void vectoriseLoops (Program& program)
+    {
+        for (auto& m : program.getModules())
+            for (auto f : m->functions)
+                vectoriseLoops (f, program.getAllocator());
+    }
+
+    static bool vectoriseLoops (heart::Function& f, heart::Allocator& allocator)
+    {
+        f.rebuildBlockPredecessors();
+        bool anyChanged = false;
+
+        for (auto& loop : CallFlowGraph::findLoops (f))
+            if (LoopVectoriser (f, loop, allocator).perform())
+                anyChanged = true;
+
+        // the vectorised loops leave behind some chains of blocks which can now be merged
+        if (anyChanged)
+            optimiseFunctionBlocks (f, allocator);
+
+        return anyChanged;
+    }
+
+    /** Hoists loop-invariant code out of loops, and replaces multiplications of induction
+        variables by constants with running totals.
+    */
+    static void optimiseLoops (Program& program)
+    {
+        for (auto& m : program.getModules())
+            for (auto f : m->functions)
+                optimiseLoops (f, program.getAllocator());
+    }
+
+    static bool optimiseLoops (heart::Function& f, heart::Allocator& allocator)
+    {
+        f.rebuildBlockPredecessors();
+        bool anyChanged = false;
+
+        for (auto& loop : CallFlowGraph::findLoops (f))
+        {
+            if (loop.preheader != nullptr)
+            {
+                if (hoistLoopInvariants (f, loop, allocator))
+                    anyChanged = true;
+
+                if (reduceInductionVariableMultiplies (loop, allocator))
+                    anyChanged = true;
+            }
+        }
+
+        // Replacing expressions with hoisted constants can leave casts whose source already has the
+        // cast's type, and the code generator produces some too, e.g. when casting a constant's value
+        if (removeRedundantCasts (f))
+            anyChanged = true;
+
+        return anyChanged;
+    }
+
+    /** Replaces any cast to the type that its source already has (ignoring const) with the source. */
+    static bool removeRedundantCasts (heart::Function& f)
+    {
+        bool anyChanged = false;
+
+        auto removeCasts = [&] (pool_ref<heart::Expression>& value, AccessType mode)
+        {
+            if (mode == AccessType::read)
+            {
+                while (auto c = cast<heart::TypeCast> (value))
+                {
+                    if (! isRedundantCast (*c))
+                        break;
+
+                    value = c->source;
+                    anyChanged = true;
+                }
+            }
+        };
+
+        for (auto b : f.blocks)
+        {
+            for (auto s : b->statements)
+                s->visitExpressions (removeCasts);
+
+            b->terminator->visitExpressions (removeCasts);
+        }
+
+        return anyChanged;
+    }
+
+    static bool isRedundantCast (const heart::TypeCast& c)
+    {
+        return c.destType.removeConstIfPresent().isIdentical (c.source->getType().removeConstIfPresent());
+    }
+
+    template <typename EndpointConnectionStatusProvider>
+    static void removeUnconnectedEndpoints (Module& module, EndpointConnectionStatusProvider& ecsp)
+    {
+        removeUnconnectedInputs (module, ecsp);
+        removeUnconnectedOutputs (module, ecsp);
+    }
+
+    static void makeFunctionCallInline (Program& program, heart::Function& parentFunction,
+                                        size_t blockIndex, heart::FunctionCall& call)
+    {
+        SOUL_ASSERT (heart::Utilities::canFunctionBeInlined (program, parentFunction, call));
+        SOUL_ASSERT (contains (parentFunction.blocks[blockIndex]->statements, std::addressof (call)));
+
+        Inliner (*program.getModuleContainingFunction (call.getFunction()),
+                 parentFunction, blockIndex, call, call.getFunction()).perform();
+    }
+
+    static bool inlineAllCallsToFunction (Program& program, heart::Function& functionToInline)
+    {
+        bool anyChanged = false;
+
+        for (auto& m : program.getModules())
+        {
+            for (auto& f : m->functions)
+            {
+                auto result = inlineAllCallsToFunction (program, f, functionToInline);
+
+                if (result == InlineResult::failed)
+                    return false;
+
+                if (result == InlineResult::ok)
+                    anyChanged = true;
+            }
+        }
+
+        if (! anyChanged)
+            return false;
+
+        removeItem (program.getModuleContainingFunction (functionToInline)->functions, functionToInline);
+        return true;
+    }
+
+    /** Inlines calls to small functions, starting with the call sites that look most worthwhile,
+        until the program has grown by as much as the optimisation level allows.
+        The call sites are scored by the size of the function being called, how often they run,
+        and how many of their arguments are constants. How often a call runs is taken from the
+        profile if it has a count for the call's block, or otherwise guessed from how deeply
+        nested in loops it is. Calls in blocks that the profile shows never ran aren't inlined.
+    */
+    static void inlineFunctionsWithinBudget (Program& program, int optimisationLevel, const BlockProfile& profile = {})
+    {
+        auto policy = InliningPolicy::forOptimisationLevel (optimisationLevel);
+
+        if (policy.maxGrowthProportion <= 0)
+            return;
+
+        // The costs are worked out once, and then only updated for the functions that get calls inlined into them
+        FunctionCostCache costs;
+        uint64_t totalCost = 0;
+
+        for (auto& m : program.getModules())
+            for (auto& f : m->functions)
+                totalCost += costs.get (f);
+
+        auto budget = std::max ((uint64_t) (totalCost * policy.maxGrowthProportion), policy.minimumBudget);
+        auto candidates = findInlineCandidates (program, policy, profile);
+
+        std::stable_sort (candidates.begin(), candidates.end(),
+                          [] (const InlineCandidate& a, const InlineCandidate& b) { return a.score < b.score; });
+
+        for (auto& c : candidates)
+        {
+            // NB: the function may have grown since the candidates were chosen, if other calls were inlined into it
+            auto growth = costs.get (c.call->getFunction()) + getInliningOverhead (c.call);
+
+            if (growth > budget || growth > policy.maxCalleeCost)
+                continue;
+
+            auto blockIndex = findBlockIndexContaining (c.parentFunction, c.call);
+
+            if (blockIndex < c.parentFunction->blocks.size())
+            {
+                auto oldCost = costs.get (c.parentFunction);
+                makeFunctionCallInline (program, c.parentFunction, blockIndex, c.call);
+                auto actualGrowth = costs.update (c.parentFunction) - oldCost;
+
+                if (actualGrowth >= budget)
+                    break;
+
+                budget -= actualGrowth;
+            }
+        }
+    }
+
+    /** Moves the blocks that a profile shows were never run to the end of their functions,
+        so that the code which does run is packed together. The entry block always stays first.
+    */
+    static void moveColdBlocksToEnd (Program& program, const BlockProfile& profile)
+    {
+        for (auto& m : program.getModules())
+        {
+            for (auto& f : m->functions)
+            {
+                if (f->blocks.size() > 2)
+                {
+                    std::stable_partition (f->blocks.begin() + 1, f->blocks.end(), [&] (pool_ref<heart::Block> b)
+                    {
+                        auto count = profile.getCount (m, f, b);
+                        return ! (count.has_value() && *count == 0);
+                    });
+                }
+            }
+        }
+    }
+
+    static void garbageCollectStringDictionary (Program& program)
+    {
+        std::unordered_set<uint32_t> handlesUsed;
+
+        for (auto& m : program.getModules())
+            for (auto f : m->functions)
+                f->visitExpressions ([&] (pool_ref<heart::Expression>& e, AccessType)
+                                     {
+                                         if (auto c = cast<heart::Constant> (e))
+                                             if (c->value.getType().isStringLiteral())
+                                                 handlesUsed.insert (c->value.getStringLiteral().handle);
+                                     });
+
+        program.getStringDictionary().removeItemsIf ([&] (const StringDictionary::Item& item)
+                                                     {
+                                                         return handlesUsed.find (item.handle.handle) == handlesUsed.end();
+                                                     });
+    }
+
+
+private:
+    static bool eliminateEmptyAndUnreachableBlocks (heart::Function& f, heart::Allocator& allocator)
+    {
+        return heart::Utilities::removeBlocks (f, [&] (heart::Block& b) -> bool
+        {
+            if (b.doNotOptimiseAway || f.blocks.front() == b)
+                return false;
+
+            if (b.predecessors.empty())
+                return true;
+
+            if (b.terminator != nullptr && b.terminator->isParameterised())
+                return false;
+
+            if (! b.statements.empty())
+                return false;
+
+            if (b.terminator == nullptr)
+                return false;
+
+            auto destinations = b.terminator->getDestinationBlocks();
+            auto numDestinations = destinations.size();
+
+            if (numDestinations > 1)
+                return false;
+
+            if (numDestinations == 1)
+            {
+                if (b == destinations.front())
+                    return false;
+
+                for (auto pred : b.predecessors)
+                {
+                    SOUL_ASSERT (pred->terminator != nullptr);
+                    heart::Utilities::replaceBlockDestination (pred, b, destinations.front());
+                }
+
+                return true;
+            }
+
+            if (is_type<heart::ReturnVoid> (b.terminator))
+            {
+                if (heart::Utilities::areAllTerminatorsUnconditional (b.predecessors))
+                {
+                    for (auto pred : b.predecessors)
+                        pred->terminator = allocator.allocate<heart::ReturnVoid>();
+
+                    return true;
+                }
+            }
+
+            return false;
+        });
+    }
+
+    //==============================================================================
+    static bool eliminateUnreachableBlockCycles (heart::Function& f)
+    {
+        auto reachable = findBlocksReachableFromEntry (f);
+
+        return heart::Utilities::removeBlocks (f, [&] (heart::Block& b) -> bool
+        {
+            return reachable.find (std::addressof (b)) == reachable.end();
+        });
+    }
+
+    /** Does a single walk forwards from the entry block, rather than searching upstream from every block. */
+    static std::unordered_set<const heart::Block*> findBlocksReachableFromEntry (heart::Function& f)
+    {
+        std::unordered_set<const heart::Block*> reachable;
+        std::vector<heart::Block*> blocksToVisit;
+
+        if (! f.blocks.empty())
+        {
+            reachable.insert (std::addressof (f.blocks.front().get()));
+            blocksToVisit.push_back (std::addressof (f.blocks.front().get()));
+        }
+
+        while (! blocksToVisit.empty())
+        {
+            auto b = blocksToVisit.back();
+            blocksToVisit.pop_back();
+
+            if (b->terminator != nullptr)
+                for (auto dest : b->terminator->getDestinationBlocks())
+                    if (reachable.insert (std::addressof (dest.get())).second)
+                        blocksToVisit.push_back (std::addressof (dest.get()));
+        }
+
+        return reachable;
+    }
+
+    //==============================================================================
+    static bool mergeAdjacentBlocks (heart::Function& f)
+    {
+        return heart::Utilities::removeBlocks (f, [&] (heart::Block& b) -> bool
+        {
+            if (b.predecessors.size() != 1 || b.doNotOptimiseAway || (! b.parameters.empty()))
+                return false;
+
+            auto pred = b.predecessors.front();
+
+            if (pred == b || pred->terminator->isConditional())
+                return false;
+
+            SOUL_ASSERT (*pred->terminator->getDestinationBlocks().begin() == b);
+
+            if (auto first = b.statements.begin())
+                if (*first != nullptr)
+                    pred->statements.append (**first);
+
+            pred->terminator = b.terminator;
+            return true;
+        });
+    }
+
+    //==============================================================================
+    struct InliningPolicy
+    {
+        double maxGrowthProportion;  // the proportion by which the program's total size may grow
+        uint64_t minimumBudget;      // lets small programs inline a few things even if the proportion is tiny
+        uint64_t maxCalleeCost;      // functions bigger than this are never inlined
+        double maxScore;             // call sites with a higher score than this aren't considered
+
+        static InliningPolicy forOptimisationLevel (int level)
+        {
+            if (level == 0)   return { 0,    0,   0,   0 };
+            if (level == 1)   return { 0.05, 40,  30,  10.0 };
+            if (level == 3)   return { 0.25, 200, 200, 60.0 };
+
+            return { 0.1, 100, 80, 25.0 };  // level 2, and the default
+        }
+    };
+
+    struct InlineCandidate
+    {
+        pool_ref<heart::Function> parentFunction;
+        pool_ref<heart::FunctionCall> call;
+        double score;
+    };
+
+    /** Gives a rough idea of the size of a function, based on how many statements and
+        expression nodes it contains.
+    */
+    static uint64_t getFunctionCost (heart::Function& f)
+    {
+        uint64_t cost = f.blocks.size();
+        f.visitStatements<heart::Statement> ([&] (heart::Statement&) { ++cost; });
+        f.visitExpressions ([&] (pool_ref<heart::Expression>&, AccessType) { ++cost; });
+        return cost;
+    }
+
+    /** Estimates how much bigger the caller would get if this call was inlined: the callee's body
+        is copied, along with an assignment to a local variable for each argument and the
+        extra blocks and branches that the inliner adds around it.
+    */
+    static uint64_t getInliningGrowth (heart::FunctionCall& call)
+    {
+        return getFunctionCost (call.getFunction()) + getInliningOverhead (call);
+    }
+
+    static uint64_t getInliningOverhead (heart::FunctionCall& call)
+    {
+        return 2 * (uint64_t) call.arguments.size() + 3;
+    }
+
+    struct FunctionCostCache
+    {
+        uint64_t get (heart::Function& f)
+        {
+            auto found = costs.find (std::addressof (f));
+
+            if (found != costs.end())
+                return found->second;
+
+            return update (f);
+        }
+
+        uint64_t update (heart::Function& f)
+        {
+            auto cost = getFunctionCost (f);
+            costs[std::addressof (f)] = cost;
+            return cost;
+        }
+
+        std::unordered_map<const heart::Function*, uint64_t> costs;
+    };
+
+    static size_t findBlockIndexContaining (heart::Function& f, heart::Statement& s)
+    {
+        for (size_t i = 0; i < f.blocks.size(); ++i)
+            if (f.blocks[i]->statements.contains (s))
+                return i;
+
+        return f.blocks.size();
+    }
+
+    static std::vector<InlineCandidate> findInlineCandidates (Program& program, const InliningPolicy& policy, const BlockProfile& profile)
+    {
+        std::vector<InlineCandidate> candidates;
+
+        for (auto& m : program.getModules())
+        {
+            for (auto& f : m->functions)
+            {
+                f->rebuildBlockPredecessors();
+                auto loops = CallFlowGraph::findLoops (f);
+
+                for (auto b : f->blocks)
+                {
+                    size_t loopDepth = 0;
+
+                    for (auto& loop : loops)
+                        if (loop.contains (b))
+                            ++loopDepth;
+
+                    // A profiled block's frequency is scaled so that the hottest block counts
+                    // the same as one nested three loops deep
+                    auto frequency = 1.0 + (double) loopDepth;
+
+                    if (auto count = profile.getCount (m, f, b))
+                    {
+                        if (*count == 0)
+                            continue;
+
+                        frequency = 1.0 + 3.0 * profile.getRelativeFrequency (*count);
+                    }
+
+                    for (auto s : b->statements)
+                    {
+                        if (auto call = cast<heart::FunctionCall> (*s))
+                        {
+                            auto& callee = call->getFunction();
+
+                            // NB: an intrinsic's body is only a placeholder for the real implementation
+                            if (callee == f || callee.annotation.getBool ("do_not_optimise")
+                                 || callee.intrinsicType != IntrinsicType::none
+                                 || ! heart::Utilities::canFunctionBeInlined (program, f, *call))
+                                continue;
+
+                            auto growth = getInliningGrowth (*call);
+
+                            if (growth > policy.maxCalleeCost)
+                                continue;
+
+                            size_t numConstantArgs = 0;
+
+                            for (auto& arg : call->arguments)
+                                if (is_type<heart::Constant> (arg))
+                                    ++numConstantArgs;
+
+                            // Calls that run more often are more worthwhile, and constant arguments give later passes a chance to fold things
+                            auto score = (double) growth / frequency
+                                           * (1.0 - std::min (0.5, 0.2 * (double) numConstantArgs));
+
+                            if (score <= policy.maxScore)
+                                candidates.push_back ({ f, *call, score });
+                        }
+                    }
+                }
+            }
+        }
+
+        return candidates;
+    }
+
+    //==============================================================================
+    using KnownConstantMap = std::unordered_map<const heart::Variable*, pool_ref<heart::Constant>>;
+
+    static std::unordered_map<const heart::Variable*, uint32_t> countVariableWrites (heart::Function& f)
+    {
+        std::unordered_map<const heart::Variable*, uint32_t> numWrites;
+
+        f.visitExpressions ([&] (pool_ref<heart::Expression>& value, AccessType mode)
+        {
+            if (mode != AccessType::read)
+                if (auto v = cast<heart::Variable> (value))
+                    ++numWrites[v.get()];
+        });
+
+        return numWrites;
+    }
+
+    static pool_ptr<heart::Variable> getConstantVariableAssigned (heart::Statement& s, const std::unordered_map<const heart::Variable*, uint32_t>& numWrites)
+    {
+        if (auto a = cast<heart::AssignFromValue> (s))
+        {
+            if (auto target = cast<heart::Variable> (a->target))
+            {
+                if (target->isConstant() && target->type.isPrimitive() && is_type<heart::Constant> (a->source))
+                {
+                    auto writes = numWrites.find (target.get());
+
+                    if (writes != numWrites.end() && writes->second == 1)
+                        return target;
+                }
+            }
+        }
+
+        return {};
+    }
+
+    /** If all the operands of an operator or cast are constants, this returns the value it produces. */
+    static Value getFoldedValue (heart::Expression& e)
+    {
+        if (! e.getType().isPrimitive())
+            return {};
+
+        if (auto b = cast<heart::BinaryOperator> (e))
+        {
+            auto lhs = cast<heart::Constant> (b->lhs);
+            auto rhs = cast<heart::Constant> (b->rhs);
+
+            if (lhs != nullptr && rhs != nullptr && lhs->getType().isPrimitive() && rhs->getType().isPrimitive())
+            {
+                auto result = lhs->value;
+
+                // NB: anything that would be a run-time error (e.g. an integer divide-by-zero) is just left alone
+                if (BinaryOp::apply (result, rhs->value, b->operation, [] (CompileMessage) {}))
+                    return result.tryCastToType (b->getType());
+            }
+
+            return {};
+        }
+
+        if (auto u = cast<heart::UnaryOperator> (e))
+        {
+            if (auto source = cast<heart::Constant> (u->source))
+            {
+                auto result = source->value;
+
+                if (source->getType().isPrimitive() && UnaryOp::apply (result, u->operation))
+                    return result;
+            }
+
+            return {};
+        }
+
+        if (auto c = cast<heart::TypeCast> (e))
+            if (auto source = cast<heart::Constant> (c->source))
+                if (source->getType().isPrimitive())
+                    return source->value.tryCastToType (c->destType);
+
+        return {};
+    }
+
+    static bool foldConstantExpressions (heart::Function& f, heart::Allocator& allocator)
+    {
+        auto numWrites = countVariableWrites (f);
+        KnownConstantMap knownConstants;
+        bool anyChanged = false;
+
+        for (auto b : f.blocks)
+            for (auto s : b->statements)
+                if (auto target = getConstantVariableAssigned (*s, numWrites))
+                    knownConstants.insert ({ target.get(), *cast<heart::Constant> (cast<heart::AssignFromValue> (*s)->source) });
+
+        auto foldExpression = [&] (pool_ref<heart::Expression>& value, AccessType mode)
+        {
+            if (mode != AccessType::read)
+                return;
+
+            if (auto v = cast<heart::Variable> (value))
+            {
+                auto known = knownConstants.find (v.get());
+
+                if (known != knownConstants.end())
+                {
+                    value = known->second;
+                    anyChanged = true;
+                }
+
+                return;
+            }
+
+            if (is_type<heart::Constant> (value))
+                return;
+
+            auto folded = getFoldedValue (value);
+
+            if (folded.isValid())
+            {
+                value = allocator.allocateConstant (std::move (folded));
+                anyChanged = true;
+            }
+        };
+
+        for (auto b : f.blocks)
+        {
+            for (auto s : b->statements)
+            {
+                s->visitExpressions (foldExpression);
+
+                // Any constants that this statement has just resolved can be used by the ones that follow it
+                if (auto target = getConstantVariableAssigned (*s, numWrites))
+                    knownConstants.insert ({ target.get(), *cast<heart::Constant> (cast<heart::AssignFromValue> (*s)->source) });
+            }
+
+            if (b->terminator != nullptr)
+                b->terminator->visitExpressions (foldExpression);
+        }
+
+        return anyChanged;
+    }
+
+    static bool foldConstantBranches (heart::Function& f, heart::Allocator& allocator)
+    {
+        bool anyChanged = false;
+
+        for (auto b : f.blocks)
+        {
+            if (auto branchIf = cast<heart::BranchIf> (b->terminator))
+            {
+                if (auto condition = cast<heart::Constant> (branchIf->condition))
+                {
+                    if (condition->getType().isPrimitive())
+                    {
+                        auto targetIndex = condition->value.getAsBool() ? 0 : 1;
+                        auto& branch = allocator.allocate<heart::Branch> (branchIf->targets[targetIndex]);
+                        branch.targetArgs = branchIf->targetArgs[targetIndex];
+                        b->terminator = branch;
+                        anyChanged = true;
+                    }
+                }
+            }
+        }
+
+        return anyChanged;
+    }
+
+    template <typename ArgListVisitor>
+    static void visitIncomingBranchArguments (heart::Block& b, ArgListVisitor&& visit)
+    {
+        for (auto pred : b.predecessors)
+        {
+            if (auto branch = cast<heart::Branch> (pred->terminator))
+            {
+                if (branch->target == b)
+                    visit (branch->targetArgs);
+            }
+            else if (auto branchIf = cast<heart::BranchIf> (pred->terminator))
+            {
+                for (size_t i = 0; i < 2; ++i)
+                    if (branchIf->targets[i] == b)
+                        visit (branchIf->targetArgs[i]);
+            }
+        }
+    }
+
+    /** Finds block parameters for which every incoming branch passes the same constant, and
+        replaces them with that constant.
+    */
+    static bool propagateConstantBlockParameters (heart::Function& f, heart::Allocator& allocator)
+    {
+        f.rebuildBlockPredecessors();
+        auto numWrites = countVariableWrites (f);
+        KnownConstantMap knownConstants;
+
+        for (auto b : f.blocks)
+        {
+            if (b->parameters.empty() || b->predecessors.empty() || f.blocks.front() == b)
+                continue;
+
+            for (auto i = b->parameters.size(); i > 0;)
+            {
+                auto& param = b->parameters[--i].get();
+
+                if (! param.type.isPrimitive() || numWrites.find (std::addressof (param)) != numWrites.end())
+                    continue;
+
+                Value incomingValue;
+                bool allTheSame = true;
+
+                visitIncomingBranchArguments (b, [&] (heart::Branch::ArgListType& args)
+                {
+                    auto c = args.size() == b->parameters.size() ? cast<heart::Constant> (args[i]) : pool_ptr<heart::Constant>();
+
+                    if (c == nullptr || (incomingValue.isValid() && incomingValue != c->value))
+                        allTheSame = false;
+                    else
+                        incomingValue = c->value;
+                });
+
+                if (! allTheSame)
+                    continue;
+
+                auto castValue = incomingValue.tryCastToType (param.type);
+
+                if (! castValue.isValid())
+                    continue;
+
+                knownConstants.insert ({ std::addressof (param), allocator.allocateConstant (std::move (castValue)) });
+
+                visitIncomingBranchArguments (b, [&] (heart::Branch::ArgListType& args)
+                {
+                    args.erase (args.begin() + i);
+                });
+
+                b->parameters.erase (b->parameters.begin() + i);
+            }
+        }
+
+        if (knownConstants.empty())
+            return false;
+
+        f.visitExpressions ([&] (pool_ref<heart::Expression>& value, AccessType)
+        {
+            if (auto v = cast<heart::Variable> (value))
+            {
+                auto known = knownConstants.find (v.get());
+
+                if (known != knownConstants.end())
+                    value = known->second;
+            }
+        });
+
+        return true;
+    }
+
+    //==============================================================================
+    /** Rewrites a loop of the form:
+
+            $i = 0;
+            branch @loop;
+        @loop:
+            branch_if lessThan ($i, N) ? @body : @break;
+        @body:
+            $a[$i] = add ($b[$i], $x);
+            let $0 = $i;
+            $i = add ($0, 1);
+            branch @loop;
+
+        ..where $a and $b are vectors with at least N elements, as a single vector operation on
+        the first N elements. Because every element access in the body uses the counter as its
+        index, and no scalar that the body writes is read by a later iteration, the iterations
+        are independent, and can all be done at once.
+    */
+    struct LoopVectoriser
+    {
+        LoopVectoriser (heart::Function& f, const CallFlowGraph::Loop& l, heart::Allocator& a)
+            : function (f), loop (l), allocator (a)
+        {}
+
+        bool perform()
+        {
+            if (! (findCountedLoop() && findIncrement()))
+                return false;
+
+            numWrites = countVariableWrites (function);
+            LinkedList<heart::Statement> newStatements;
+            LinkedList<heart::Statement>::Iterator last;
+
+            for (auto s : body->statements)
+            {
+                if (s == increment || s == counterCopy)
+                    continue;
+
+                auto newStatement = vectoriseStatement (*s);
+
+                if (newStatement == nullptr)
+                    return false;
+
+                last = newStatements.insertAfter (last, *newStatement);
+            }
+
+            if (newStatements.empty() || ! areLoopTemporariesOnlyUsedInLoop())
+                return false;
+
+            auto& finalCount = allocator.allocateConstant (Value::createInt64 (count).castToTypeExpectingSuccess (counter->type.removeConstIfPresent()));
+            newStatements.insertAfter (last, allocator.allocate<heart::AssignFromValue> (increment->location, *counter, finalCount));
+
+            body->statements = newStatements;
+            body->terminator = allocator.allocate<heart::Branch> (*exitBlock);
+            loop.header->terminator = allocator.allocate<heart::Branch> (*body);
+            return true;
+        }
+
+    private:
+        static constexpr int64_t maxCount = (int64_t) Type::maxVectorSize;
+
+        heart::Function& function;
+        const CallFlowGraph::Loop& loop;
+        heart::Allocator& allocator;
+
+        pool_ptr<heart::Variable> counter, counterCopyVariable;
+        pool_ptr<heart::Block> body, exitBlock;
+        pool_ptr<heart::Statement> increment, counterCopy;
+        int64_t count = 0;
+
+        std::unordered_map<const heart::Variable*, uint32_t> numWrites;
+        std::unordered_map<const heart::Variable*, pool_ptr<heart::Variable>> vectorisedTemporaries;
+
+        bool findCountedLoop()
+        {
+            if (loop.blocks.size() != 2 || loop.preheader == nullptr || ! loop.header->statements.empty()
+                 || ! loop.header->parameters.empty())
+                return false;
+
+            auto branchIf = cast<heart::BranchIf> (loop.header->terminator);
+
+            if (branchIf == nullptr || branchIf->isParameterised() || ! loop.contains (branchIf->targets[0])
+                 || loop.contains (branchIf->targets[1]))
+                return false;
+
+            body = branchIf->targets[0];
+            exitBlock = branchIf->targets[1];
+
+            if (! body->parameters.empty() || body->doNotOptimiseAway)
+                return false;
+
+            if (auto branch = cast<heart::Branch> (body->terminator))
+            {
+                if (branch->target != loop.header || branch->isParameterised())
+                    return false;
+            }
+            else
+            {
+                return false;
+            }
+
+            auto condition = cast<heart::BinaryOperator> (branchIf->condition);
+
+            if (condition == nullptr || condition->operation != BinaryOp::Op::lessThan)
+                return false;
+
+            counter = cast<heart::Variable> (condition->lhs);
+            auto limit = cast<heart::Constant> (condition->rhs);
+
+            if (counter == nullptr || limit == nullptr || ! counter->isMutableLocal()
+                 || ! counter->type.isPrimitiveInteger() || ! limit->getType().isPrimitiveInteger())
+                return false;
+
+            count = limit->value.getAsInt64();
+
+            return count > 0 && count <= maxCount && isCounterZeroOnEntry();
+        }
+
+        bool isCounterZeroOnEntry() const
+        {
+            pool_ptr<heart::Statement> lastWrite;
+
+            for (auto s : loop.preheader->statements)
+                if (s->writesVariable (*counter) || s->readsVariable (*counter))
+                    lastWrite = *s;
+
+            if (auto a = cast<heart::AssignFromValue> (lastWrite))
+                if (a->target == counter)
+                    if (auto c = cast<heart::Constant> (a->source))
+                        return c->getType().isPrimitiveInteger() && c->value.getAsInt64() == 0;
+
+            return false;
+        }
+
+        /** Finds the "i = i + 1" at the end of the body, which may read i via a copy. */
+        bool findIncrement()
+        {
+            auto lastStatement = body->statements.getLast();
+
+            if (lastStatement == nullptr)
+                return false;
+
+            auto a = cast<heart::AssignFromValue> (**lastStatement);
+
+            if (a == nullptr || a->target != counter)
+                return false;
+
+            auto add = cast<heart::BinaryOperator> (a->source);
+
+            if (add == nullptr || add->operation != BinaryOp::Op::add)
+                return false;
+
+            auto step = cast<heart::Constant> (add->rhs);
+            auto source = cast<heart::Variable> (add->lhs);
+
+            if (step == nullptr || source == nullptr || ! step->getType().isPrimitiveInteger() || step->value.getAsInt64() != 1)
+                return false;
+
+            increment = *a;
+
+            for (auto s : body->statements)
+            {
+                if (s != increment && s->writesVariable (*counter))
+                    return false;
+
+                if (source != counter)
+                {
+                    if (auto copy = cast<heart::AssignFromValue> (*s))
+                    {
+                        if (copy->target == source && copy->source == counter)
+                        {
+                            counterCopy = *s;
+                            counterCopyVariable = source;
+                        }
+                    }
+                }
+            }
+
+            if (source == counter)
+                return true;
+
+            if (counterCopy == nullptr || ! counterCopyVariable->isConstant())
+                return false;
+
+            // the copy of the counter mustn't be used for anything other than the increment
+            bool isCopyUsedElsewhere = false;
+
+            function.visitExpressions ([&] (pool_ref<heart::Expression>& value, AccessType mode)
+            {
+                if (mode == AccessType::read && value == counterCopyVariable && std::addressof (value) != std::addressof (add->lhs))
+                    isCopyUsedElsewhere = true;
+            });
+
+            return ! isCopyUsedElsewhere;
+        }
+
+        Type getVectorType (const Type& elementType) const
+        {
+            auto type = elementType.removeConstIfPresent();
+
+            if (! type.isPrimitive() || type.isBool() || type.isVoid())
+                return {};
+
+            return Type::createVector (type.getPrimitiveType(), (Type::ArraySize) count);
+        }
+
+        bool isWrittenInLoop (heart::Variable& v) const
+        {
+            for (auto s : body->statements)
+                if (s->writesVariable (v))
+                    return true;
+
+            return false;
+        }
+
+        /** Returns a reference to the first N elements of a vector that's being indexed by the counter. */
+        pool_ptr<heart::Expression> getVectorSlice (heart::Expression& e)
+        {
+            auto element = cast<heart::ArrayElement> (e);
+
+            if (element == nullptr || element->dynamicIndex != counter)
+                return {};
+
+            auto parent = cast<heart::Variable> (element->parent);
+
+            if (parent == nullptr)
+                return {};
+
+            const auto& parentType = parent->type;
+
+            if (! (parentType.isVector() && parentType.getVectorSize() >= (Type::ArraySize) count
+                    && getVectorType (parentType.getElementType()).isValid()))
+                return {};
+
+            if (parentType.getVectorSize() == (Type::ArraySize) count)
+                return parent;
+
+            return allocator.allocate<heart::ArrayElement> (element->location, *parent, 0, (size_t) count);
+        }
+
+        pool_ptr<heart::Expression> vectoriseExpression (heart::Expression& e)
+        {
+            if (auto c = cast<heart::Constant> (e))
+                return broadcast (*c);
+
+            if (auto v = cast<heart::Variable> (e))
+            {
+                auto temp = vectorisedTemporaries.find (v.get());
+
+                if (temp != vectorisedTemporaries.end())
+                    return temp->second;
+
+                if (v == counter || v == counterCopyVariable || isWrittenInLoop (*v))
+                    return {};
+
+                return broadcast (*v);
+            }
+
+            if (is_type<heart::ArrayElement> (e))
+                return getVectorSlice (e);
+
+            if (auto b = cast<heart::BinaryOperator> (e))
+            {
+                auto op = b->operation;
+
+                if (! (op == BinaryOp::Op::add || op == BinaryOp::Op::subtract || op == BinaryOp::Op::multiply
+                        || (op == BinaryOp::Op::divide && b->getType().isFloatingPoint())))
+                    return {};
+
+                auto lhs = vectoriseExpression (b->lhs);
+                auto rhs = vectoriseExpression (b->rhs);
+
+                if (lhs == nullptr || rhs == nullptr
+                     || ! lhs->getType().removeConstIfPresent().isIdentical (rhs->getType().removeConstIfPresent()))
+                    return {};
+
+                return allocator.allocate<heart::BinaryOperator> (b->location, *lhs, *rhs, op);
+            }
+
+            if (auto u = cast<heart::UnaryOperator> (e))
+            {
+                if (u->operation != UnaryOp::Op::negate)
+                    return {};
+
+                if (auto source = vectoriseExpression (u->source))
+                    return allocator.allocate<heart::UnaryOperator> (u->location, *source, u->operation);
+
+                return {};
+            }
+
+            if (auto c = cast<heart::TypeCast> (e))
+            {
+                auto destType = getVectorType (c->destType);
+                auto source = vectoriseExpression (c->source);
+
+                if (source == nullptr || ! destType.isValid() || ! TypeRules::canCastTo (destType, source->getType()))
+                    return {};
+
+                if (source->getType().removeConstIfPresent().isIdentical (destType))
+                    return source;
+
+                return allocator.allocate<heart::TypeCast> (c->location, *source, destType);
+            }
+
+            return {};
+        }
+
+        pool_ptr<heart::Expression> broadcast (heart::Expression& e)
+        {
+            auto vectorType = getVectorType (e.getType());
+
+            if (! vectorType.isValid())
+                return {};
+
+            return allocator.allocate<heart::TypeCast> (e.location, e, vectorType);
+        }
+
+        pool_ptr<heart::Statement> vectoriseStatement (heart::Statement& s)
+        {
+            auto a = cast<heart::AssignFromValue> (s);
+
+            if (a == nullptr)
+                return {};
+
+            auto source = vectoriseExpression (a->source);
+
+            if (source == nullptr)
+                return {};
+
+            if (auto target = cast<heart::Variable> (a->target))
+            {
+                auto writes = numWrites.find (target.get());
+
+                if (! target->isFunctionLocal() || writes == numWrites.end() || writes->second != 1)
+                    return {};
+
+                auto& vectorTemp = allocator.allocate<heart::Variable> (target->location, source->getType().removeConstIfPresent(),
+                                                                        heart::Variable::Role::constant);
+                vectorisedTemporaries[target.get()] = vectorTemp;
+                return allocator.allocate<heart::AssignFromValue> (a->location, vectorTemp, *source);
+            }
+
+            auto target = getVectorSlice (*a->target);
+
+            if (target == nullptr || ! target->isAssignable()
+                 || ! target->getType().removeConstIfPresent().isIdentical (source->getType().removeConstIfPresent()))
+                return {};
+
+            return allocator.allocate<heart::AssignFromValue> (a->location, *target, *source);
+        }
+
+        bool areLoopTemporariesOnlyUsedInLoop() const
+        {
+            for (auto b : function.blocks)
+            {
+                if (b == body)
+                    continue;
+
+                bool isUsed = false;
+
+                b->visitExpressions ([&] (pool_ref<heart::Expression>& value, AccessType)
+                {
+                    if (auto v = cast<heart::Variable> (value))
+                        if (vectorisedTemporaries.find (v.get()) != vectorisedTemporaries.end())
+                            isUsed = true;
+                });
+
+                if (isUsed)
+                    return false;
+            }
+
+            return true;
+        }
+    };
+
+    //==============================================================================
+    struct LoopInvariance
+    {
+        LoopInvariance (heart::Function& f, const CallFlowGraph::Loop& l)  : loop (l), numWrites (countVariableWrites (f))
+        {
+            for (auto& b : f.blocks)
+            {
+                for (auto p : b->parameters)
+                    blockParameters.insert (p.getPointer());
+
+                for (auto s : b->statements)
+                    if (auto a = cast<heart::AssignFromValue> (*s))
+                        if (auto target = cast<heart::Variable> (a->target))
+                            if (target->isConstant())
+                                definingBlocks[target.get()] = b.getPointer();
+            }
+
+            for (auto& b : loop.blocks)
+            {
+                for (auto s : b->statements)
+                {
+                    if (is_type<heart::FunctionCall> (*s) || is_type<heart::AdvanceClock> (*s))
+                        canStateChange = true;
+
+                    s->visitExpressions ([this] (pool_ref<heart::Expression>& value, AccessType mode)
+                    {
+                        if (mode != AccessType::read)
+                            if (auto v = cast<heart::Variable> (value))
+                                variablesWrittenInLoop.insert (v.get());
+                    });
+                }
+            }
+        }
+
+        bool isInvariant (heart::Variable& v) const
+        {
+            if (v.isExternal())
+                return true;
+
+            if (blockParameters.find (std::addressof (v)) != blockParameters.end()
+                 || variablesWrittenInLoop.find (std::addressof (v)) != variablesWrittenInLoop.end())
+                return false;
+
+            if (v.isConstant())
+            {
+                auto writes = numWrites.find (std::addressof (v));
+                auto definingBlock = definingBlocks.find (std::addressof (v));
+
+                return writes != numWrites.end() && writes->second == 1
+                        && definingBlock != definingBlocks.end() && ! loop.contains (*definingBlock->second);
+            }
+
+            if (v.isState())
+                return ! canStateChange;
+
+            return v.isMutableLocal() || (v.isParameter() && ! v.type.isReference());
+        }
+
+        bool isInvariant (heart::Expression& e) const
+        {
+            if (is_type<heart::Constant> (e) || is_type<heart::ProcessorProperty> (e))
+                return true;
+
+            if (auto v = cast<heart::Variable> (e))
+                return isInvariant (*v);
+
+            if (auto c = cast<heart::TypeCast> (e))
+                return isInvariant (c->source);
+
+            if (auto u = cast<heart::UnaryOperator> (e))
+                return isInvariant (u->source);
+
+            if (auto b = cast<heart::BinaryOperator> (e))
+            {
+                // An integer division can't be moved to somewhere it might run when it wouldn't have done before,
+                // unless we know that the divisor isn't zero
+                if ((b->operation == BinaryOp::Op::divide || b->operation == BinaryOp::Op::modulo) && b->getType().isInteger())
+                {
+                    auto divisor = cast<heart::Constant> (b->rhs);
+
+                    if (divisor == nullptr || divisor->value.isZero())
+                        return false;
+                }
+
+                return isInvariant (b->lhs) && isInvariant (b->rhs);
+            }
+
+            return false;
+        }
+
+        /** Returns the variable that a statement writes if it can be moved out of the loop. */
+        pool_ptr<heart::Variable> getHoistableTarget (heart::Statement& s) const
+        {
+            if (auto a = cast<heart::AssignFromValue> (s))
+            {
+                if (auto target = cast<heart::Variable> (a->target))
+                {
+                    if (target->isConstant() && ! is_type<heart::Constant> (a->source))
+                    {
+                        auto writes = numWrites.find (target.get());
+
+                        if (writes != numWrites.end() && writes->second == 1 && isInvariant (a->source))
+                            return target;
+                    }
+                }
+            }
+
+            return {};
+        }
+
+        void markAsHoisted (heart::Variable& v, heart::Block& preheader)
+        {
+            definingBlocks[std::addressof (v)] = std::addressof (preheader);
+            variablesWrittenInLoop.erase (std::addressof (v));
+        }
+
+        const CallFlowGraph::Loop& loop;
+        std::unordered_map<const heart::Variable*, uint32_t> numWrites;
+        std::unordered_map<const heart::Variable*, const heart::Block*> definingBlocks;
+        std::unordered_set<const heart::Variable*> blockParameters, variablesWrittenInLoop;
+        bool canStateChange = false;
+    };
+
+    static bool hoistLoopInvariants (heart::Function& f, const CallFlowGraph::Loop& loop, heart::Allocator& allocator)
+    {
+        LoopInvariance invariance (f, loop);
+        auto anyHoisted = hoistInvariantStatements (loop, invariance);
+
+        if (hoistInvariantSubExpressions (loop, invariance, allocator))
+            anyHoisted = true;
+
+        return anyHoisted;
+    }
+
+    static bool hoistInvariantStatements (const CallFlowGraph::Loop& loop, LoopInvariance& invariance)
+    {
+        auto& preheader = *loop.preheader;
+        bool anyHoisted = false;
+
+        for (;;)
+        {
+            bool hoistedAny = false;
 
-                for (size_t i = 0; i < s->getNumMembers(); ++i)
-                    if (s->getMemberReadWriteCount (i).numReads == 0)
-                        unusedMembers.push_back (i);
+            for (auto b : loop.blocks)
+            {
+                LinkedList<heart::Statement>::Iterator last;
 
-                if (! unusedMembers.empty())
+                for (auto s = b->statements.begin(); s != nullptr;)
                 {
-                    std::reverse (unusedMembers.begin(), unusedMembers.end());
-                    results.push_back ({ module, *s, unusedMembers });
+                    auto next = s.next();
+
+                    if (auto target = invariance.getHoistableTarget (**s))
+                    {
+                        b->statements.removeNext (last);
+                        s->nextObject = nullptr;
+                        preheader.statements.append (**s);
+                        invariance.markAsHoisted (*target, preheader);
+                        hoistedAny = true;
+                    }
+                    else
+                    {
+                        last = s;
+                    }
+
+                    s = next;
                 }
             }
-        }
 
-        return results;
-    }
+            if (! hoistedAny)
+                return anyHoisted;
 
-    static void optimiseFunctionBlocks (Program& program)
-    {
-        for (auto& m : program.getModules())
-            for (auto f : m->functions)
-                optimiseFunctionBlocks (f, program.getAllocator());
+            anyHoisted = true;
+        }
     }
 
-    static void optimiseFunctionBlocks (heart::Function& f, heart::Allocator& allocator)
+    static bool isOperatorExpression (heart::Expression& e)
     {
-        f.rebuildBlockPredecessors();
-        eliminateEmptyAndUnreachableBlocks (f, allocator);
-        eliminateUnreachableBlockCycles (f);
-        mergeAdjacentBlocks (f);
-    }
+        if (auto c = cast<heart::TypeCast> (e))
+            return ! isRedundantCast (*c);
 
-    template <typename EndpointConnectionStatusProvider>
-    static void removeUnconnectedEndpoints (Module& module, EndpointConnectionStatusProvider& ecsp)
-    {
-        removeUnconnectedInputs (module, ecsp);
-        removeUnconnectedOutputs (module, ecsp);
+        return is_type<heart::BinaryOperator> (e) || is_type<heart::UnaryOperator> (e);
     }
 
-    static void makeFunctionCallInline (Program& program, heart::Function& parentFunction,
-                                        size_t blockIndex, heart::FunctionCall& call)
+    /** Finds the largest invariant operator expressions inside the statements of a loop, and
+        moves each of them into a new constant which is calculated before the loop starts.
+    */
+    static bool hoistInvariantSubExpressions (const CallFlowGraph::Loop& loop, LoopInvariance& invariance, heart::Allocator& allocator)
     {
-        SOUL_ASSERT (heart::Utilities::canFunctionBeInlined (program, parentFunction, call));
-        SOUL_ASSERT (contains (parentFunction.blocks[blockIndex]->statements, std::addressof (call)));
+        auto visitLoopExpressions = [&] (heart::ExpressionVisitorFn fn)
+        {
+            for (auto& b : loop.blocks)
+            {
+                for (auto s : b->statements)
+                    s->visitExpressions (fn);
 
-        Inliner (*program.getModuleContainingFunction (call.getFunction()),
-                 parentFunction, blockIndex, call, call.getFunction()).perform();
-    }
+                b->terminator->visitExpressions (fn);
+            }
+        };
 
-    static bool inlineAllCallsToFunction (Program& program, heart::Function& functionToInline)
-    {
-        bool anyChanged = false;
+        // The visitor goes depth-first, so the operands of an invariant expression must be found
+        // before we can know which of them are sub-parts of an expression that is being moved
+        std::unordered_set<const heart::Expression*> invariantOperands;
 
-        for (auto& m : program.getModules())
+        visitLoopExpressions ([&] (pool_ref<heart::Expression>& value, AccessType mode)
         {
-            for (auto& f : m->functions)
+            if (mode == AccessType::read && isOperatorExpression (value) && invariance.isInvariant (value))
             {
-                auto result = inlineAllCallsToFunction (program, f, functionToInline);
+                if (auto b = cast<heart::BinaryOperator> (value))
+                {
+                    invariantOperands.insert (b->lhs.getPointer());
+                    invariantOperands.insert (b->rhs.getPointer());
+                }
+                else if (auto u = cast<heart::UnaryOperator> (value))
+                {
+                    invariantOperands.insert (u->source.getPointer());
+                }
+                else if (auto c = cast<heart::TypeCast> (value))
+                {
+                    invariantOperands.insert (c->source.getPointer());
+                }
+            }
+        });
 
-                if (result == InlineResult::failed)
-                    return false;
+        bool anyHoisted = false;
 
-                if (result == InlineResult::ok)
-                    anyChanged = true;
+        visitLoopExpressions ([&] (pool_ref<heart::Expression>& value, AccessType mode)
+        {
+            if (mode == AccessType::read && isOperatorExpression (value)
+                 && invariantOperands.find (value.getPointer()) == invariantOperands.end()
+                 && invariance.isInvariant (value))
+            {
+                auto& v = allocator.allocate<heart::Variable> (CodeLocation(), value->getType(), heart::Variable::Role::constant);
+                loop.preheader->statements.append (allocator.allocate<heart::AssignFromValue> (CodeLocation(), v, value));
+                invariance.numWrites[std::addressof (v)] = 1;
+                invariance.markAsHoisted (v, *loop.preheader);
+                value = v;
+                anyHoisted = true;
             }
-        }
-
-        if (! anyChanged)
-            return false;
+        });
 
-        removeItem (program.getModuleContainingFunction (functionToInline)->functions, functionToInline);
-        return true;
+        return anyHoisted;
     }
 
-    static void garbageCollectStringDictionary (Program& program)
+    //==============================================================================
+    /** Describes a statement in a loop of the form "i = i + step" or "i = i - step". */
+    struct InductionVariable
     {
-        std::vector<StringDictionary::Handle> handlesUsed;
-
-        for (auto& m : program.getModules())
-            for (auto f : m->functions)
-                f->visitExpressions ([&] (pool_ref<heart::Expression>& e, AccessType)
-                                     {
-                                         if (auto c = cast<heart::Constant> (e))
-                                         {
-                                             const auto& type = c->value.getType();
-
-                                             if (type.isStringLiteral())
-                                             {
-                                                 auto handle = c->value.getStringLiteral();
+        pool_ref<heart::Variable> variable;
+        pool_ref<heart::Block> block;
+        pool_ref<heart::AssignFromValue> update;
+        BinaryOp::Op operation;
+        Value step;
+    };
 
-                                                 if (! contains (handlesUsed, handle))
-                                                     handlesUsed.push_back (handle);
-                                             }
-                                         }
-                                     });
+    static std::vector<InductionVariable> findInductionVariables (const CallFlowGraph::Loop& loop)
+    {
+        std::unordered_map<const heart::Variable*, uint32_t> writesInLoop;
 
-        removeIf (program.getStringDictionary().strings,
-                  [&] (const StringDictionary::Item& item) { return ! contains (handlesUsed, item.handle); });
-    }
+        for (auto& b : loop.blocks)
+            for (auto s : b->statements)
+                s->visitExpressions ([&] (pool_ref<heart::Expression>& value, AccessType mode)
+                {
+                    if (mode != AccessType::read)
+                        if (auto v = cast<heart::Variable> (value))
+                            ++writesInLoop[v.get()];
+                });
 
+        std::vector<InductionVariable> results;
 
-private:
-    static bool eliminateEmptyAndUnreachableBlocks (heart::Function& f, heart::Allocator& allocator)
-    {
-        return heart::Utilities::removeBlocks (f, [&] (heart::Block& b) -> bool
+        for (auto& b : loop.blocks)
         {
-            if (b.doNotOptimiseAway || f.blocks.front() == b)
-                return false;
+            // Maps any constants that are copies of a variable (e.g. "let $0 = $i") back to that variable
+            std::unordered_map<const heart::Variable*, heart::Variable*> copiesOfVariables;
 
-            if (b.predecessors.empty())
-                return true;
+            for (auto s : b->statements)
+            {
+                auto a = cast<heart::AssignFromValue> (*s);
 
-            if (b.terminator != nullptr && b.terminator->isParameterised())
-                return false;
+                if (a == nullptr)
+                    continue;
 
-            if (! b.statements.empty())
-                return false;
+                auto target = cast<heart::Variable> (a->target);
 
-            if (b.terminator == nullptr)
-                return false;
+                if (target == nullptr)
+                    continue;
 
-            auto destinations = b.terminator->getDestinationBlocks();
-            auto numDestinations = destinations.size();
+                if (auto source = cast<heart::Variable> (a->source))
+                    if (target->isConstant())
+                        copiesOfVariables[target.get()] = source.get();
 
-            if (numDestinations > 1)
-                return false;
+                auto op = cast<heart::BinaryOperator> (a->source);
 
-            if (numDestinations == 1)
-            {
-                if (b == destinations.front())
-                    return false;
+                if (op == nullptr || ! (target->isMutableLocal() && target->type.isPrimitiveInteger() && writesInLoop[target.get()] == 1))
+                    continue;
 
-                for (auto pred : b.predecessors)
+                if (op->operation != BinaryOp::Op::add && op->operation != BinaryOp::Op::subtract)
+                    continue;
+
+                auto isReadOfTarget = [&] (heart::Expression& e)
                 {
-                    SOUL_ASSERT (pred->terminator != nullptr);
-                    heart::Utilities::replaceBlockDestination (pred, b, destinations.front());
-                }
+                    if (auto v = cast<heart::Variable> (e))
+                    {
+                        if (v == target)
+                            return true;
 
-                return true;
-            }
+                        auto copy = copiesOfVariables.find (v.get());
+                        return copy != copiesOfVariables.end() && copy->second == target.get();
+                    }
 
-            if (is_type<heart::ReturnVoid> (b.terminator))
-            {
-                if (heart::Utilities::areAllTerminatorsUnconditional (b.predecessors))
-                {
-                    for (auto pred : b.predecessors)
-                        pred->terminator = allocator.allocate<heart::ReturnVoid>();
+                    return false;
+                };
 
-                    return true;
-                }
+                auto isStep = [&] (heart::Expression& e)
+                {
+                    auto c = cast<heart::Constant> (e);
+                    return c != nullptr && c->getType().isIdentical (target->type.removeConstIfPresent());
+                };
+
+                if (isReadOfTarget (op->lhs) && isStep (op->rhs))
+                    results.push_back ({ *target, b, *a, op->operation, cast<heart::Constant> (op->rhs)->value });
+                else if (op->operation == BinaryOp::Op::add && isReadOfTarget (op->rhs) && isStep (op->lhs))
+                    results.push_back ({ *target, b, *a, op->operation, cast<heart::Constant> (op->lhs)->value });
             }
+        }
 
-            return false;
-        });
+        return results;
     }
 
-    //==============================================================================
-    static bool eliminateUnreachableBlockCycles (heart::Function& f)
+    /** For an induction variable i, this replaces each read of "i * k" inside the loop with a new
+        variable that's initialised before the loop, and is incremented along with i.
+    */
+    static bool reduceInductionVariableMultiplies (const CallFlowGraph::Loop& loop, heart::Allocator& allocator)
     {
-        return heart::Utilities::removeBlocks (f, [&] (heart::Block& b) -> bool
+        bool anyChanged = false;
+
+        for (auto& induction : findInductionVariables (loop))
         {
-            return f.blocks.front() != b
-                    && ! isReachableFrom (f, b, f.blocks.front());
-        });
-    }
+            auto& i = induction.variable.get();
+            std::vector<std::pair<Value, pool_ptr<heart::Variable>>> scaledVariables;
 
-    static bool isReachableFrom (heart::Function& f, heart::Block& dest, heart::Block& source)
-    {
-        bool result = false;
+            auto getScaleFactor = [&] (heart::Expression& e) -> pool_ptr<heart::Constant>
+            {
+                if (auto op = cast<heart::BinaryOperator> (e))
+                {
+                    if (op->operation == BinaryOp::Op::multiply)
+                    {
+                        if (op->lhs == i)  if (auto c = cast<heart::Constant> (op->rhs))  if (c->getType().isIdentical (i.type.removeConstIfPresent()))  return c;
+                        if (op->rhs == i)  if (auto c = cast<heart::Constant> (op->lhs))  if (c->getType().isIdentical (i.type.removeConstIfPresent()))  return c;
+                    }
+                }
+
+                return {};
+            };
 
-        CallFlowGraph::visitUpstreamBlocks (f, dest,
-            [&] (heart::Block& b) -> bool
+            auto replaceMultiplies = [&] (pool_ref<heart::Expression>& value, AccessType mode)
             {
-                if (std::addressof (b) == std::addressof (source)) { result = true; return false; }
-                return true;
-            });
+                if (mode != AccessType::read)
+                    return;
 
-        return result;
-    }
+                if (auto scale = getScaleFactor (value))
+                {
+                    auto existing = std::find_if (scaledVariables.begin(), scaledVariables.end(),
+                                                  [&] (const std::pair<Value, pool_ptr<heart::Variable>>& v) { return v.first == scale->value; });
 
-    //==============================================================================
-    static bool mergeAdjacentBlocks (heart::Function& f)
-    {
-        return heart::Utilities::removeBlocks (f, [&] (heart::Block& b) -> bool
-        {
-            if (b.predecessors.size() != 1 || b.doNotOptimiseAway || (! b.parameters.empty()))
-                return false;
+                    if (existing == scaledVariables.end())
+                    {
+                        scaledVariables.push_back ({ scale->value, allocator.allocate<heart::Variable> (CodeLocation(), i.type.removeConstIfPresent(),
+                                                                                                       heart::Variable::Role::mutableLocal) });
+                        existing = scaledVariables.end() - 1;
+                    }
 
-            auto pred = b.predecessors.front();
+                    value = *existing->second;
+                }
+            };
 
-            if (pred == b || pred->terminator->isConditional())
-                return false;
+            for (auto& b : loop.blocks)
+            {
+                for (auto s : b->statements)
+                    s->visitExpressions (replaceMultiplies);
 
-            SOUL_ASSERT (*pred->terminator->getDestinationBlocks().begin() == b);
+                b->terminator->visitExpressions (replaceMultiplies);
+            }
 
-            if (auto first = b.statements.begin())
-                if (*first != nullptr)
-                    pred->statements.append (**first);
+            for (auto& scaled : scaledVariables)
+            {
+                auto& scaleConstant = allocator.allocateConstant (scaled.first);
+                auto& initialValue = allocator.allocate<heart::BinaryOperator> (CodeLocation(), i, scaleConstant, BinaryOp::Op::multiply);
+                loop.preheader->statements.append (allocator.allocate<heart::AssignFromValue> (CodeLocation(), *scaled.second, initialValue));
+
+                auto scaledStep = induction.step;
+                BinaryOp::apply (scaledStep, scaled.first, BinaryOp::Op::multiply, [] (CompileMessage) {});
+                auto& increment = allocator.allocate<heart::BinaryOperator> (CodeLocation(), *scaled.second,
+                                                                             allocator.allocateConstant (scaledStep), induction.operation);
+                induction.block->statements.insertAfter (induction.update.get(),
+                                                         allocator.allocate<heart::AssignFromValue> (CodeLocation(), *scaled.second, increment));
+            }
 
-            pred->terminator = b.terminator;
-            return true;
-        });
+            if (! scaledVariables.empty())
+                anyChanged = true;
+        }
+
+        return anyChanged;
     }
 
     //==============================================================================
@@ -389,74 +1809,135 @@ private:
     }
 
     //==============================================================================
-    static bool findAndReplaceFirstDuplicateConstant (heart::Function& f)
+    /** Removes assignments which copy one constant into another, and makes everything that read
+        the copy read the original instead. The copies are all collected in one sweep, and then the
+        reads are redirected in a single pass over the function's expressions.
+    */
+    static void removeDuplicateConstants (heart::Function& f)
     {
-        for (auto b : f.blocks)
+        std::unordered_map<const heart::Variable*, heart::Variable*> originals;
+
+        auto getOriginal = [&] (heart::Variable* v)
         {
-            LinkedList<heart::Statement>::Iterator last;
+            for (;;)
+            {
+                auto found = originals.find (v);
 
-            for (auto s : b->statements)
+                if (found == originals.end())
+                    return v;
+
+                v = found->second;
+            }
+        };
+
+        for (auto b : f.blocks)
+        {
+            b->statements.removeMatches ([&] (heart::Statement& s)
             {
-                if (auto a = cast<heart::AssignFromValue> (*s))
+                if (auto a = cast<heart::AssignFromValue> (s))
                 {
                     if (auto target = cast<heart::Variable> (a->target))
                     {
-                        if (target->isConstant())
+                        if (auto source = cast<heart::Variable> (a->source))
                         {
-                            if (auto source = cast<heart::Variable> (a->source))
+                            if (target->isConstant() && source->isConstant()
+                                 && originals.find (target.get()) == originals.end())
                             {
-                                if (source->isConstant())
-                                {
-                                    b->statements.removeNext (last);
-
-                                    f.visitExpressions ([target, source] (pool_ref<heart::Expression>& value, AccessType mode)
-                                    {
-                                        if (value == target && mode == AccessType::read)
-                                            value = *source;
-                                    });
-
-                                    return true;
-                                }
+                                auto original = getOriginal (source.get());
+
+                                if (original != target.get())
+                                    originals[target.get()] = original;
+
+                                return true;
                             }
                         }
                     }
                 }
 
-                last = *s;
-            }
+                return false;
+            });
         }
 
-        return false;
+        if (! originals.empty())
+        {
+            f.visitExpressions ([&] (pool_ref<heart::Expression>& value, AccessType mode)
+            {
+                if (mode == AccessType::read)
+                    if (auto v = cast<heart::Variable> (value))
+                        value = *getOriginal (v.get());
+            });
+        }
     }
 
-    static void removeDuplicateConstants (heart::Function& f)
+    static bool isAssignmentTo (heart::Statement& s, heart::Variable& v)
     {
-        while (findAndReplaceFirstDuplicateConstant (f))
-        {}
+        if (auto a = cast<heart::Assignment> (s))
+            return a->target == v;
+
+        return false;
     }
 
-    static void removeUnusedVariables (heart::Function& f)
+    /** Removes the assignments to local variables which are never read. Removing one of these
+        can leave other variables that were only read by it unread, so these are followed up
+        using the chains until there's nothing more to remove, although only statements with no
+        side-effects are removed in these follow-ups.
+    */
+    static void removeDeadStores (heart::Function& f, heart::UseDefChains& chains)
     {
-        for (auto b : f.blocks)
+        std::vector<heart::Variable*> unreadVariables;
+        std::unordered_set<heart::Statement*> deadStatements;
+        bool isFollowUp = false;
+
+        chains.visitVariables ([&] (heart::Variable& v, const heart::UseDefChains::Chain& chain)
         {
-            b->statements.removeMatches ([] (heart::Statement& s)
+            if (chain.uses.empty() && v.isFunctionLocal())
+                unreadVariables.push_back (std::addressof (v));
+        });
+
+        auto nextUnreadVariables = [&] (std::vector<heart::Variable*>& variables)
+        {
+            std::vector<heart::Variable*> newlyUnread;
+
+            for (auto v : variables)
             {
-                if (auto a = cast<heart::Assignment> (s))
-                    if (auto target = cast<heart::Variable> (a->target))
-                        return target->readWriteCount.numReads == 0 && target->isFunctionLocal();
+                auto chain = chains.find (*v);
+                SOUL_ASSERT (chain != nullptr);
+                auto definitions = chain->definitions;
 
-                return false;
-            });
+                for (auto s : definitions)
+                {
+                    if (isAssignmentTo (*s, *v) && ! (isFollowUp && s->mayHaveSideEffects())
+                         && deadStatements.insert (s).second)
+                    {
+                        chains.removeStatement (*s, [&] (heart::Variable& read)
+                        {
+                            if (chains.getNumReads (read) == 0 && read.isFunctionLocal())
+                                newlyUnread.push_back (std::addressof (read));
+                        });
+                    }
+                }
+            }
+
+            return newlyUnread;
+        };
+
+        while (! unreadVariables.empty())
+        {
+            unreadVariables = nextUnreadVariables (unreadVariables);
+            isFollowUp = true;
         }
+
+        if (! deadStatements.empty())
+            for (auto b : f.blocks)
+                b->statements.removeMatches ([&] (heart::Statement& s) { return deadStatements.find (std::addressof (s)) != deadStatements.end(); });
     }
 
-    static void convertWriteOnceVariablesToConstants (heart::Function& f)
+    static void convertWriteOnceVariablesToConstants (heart::UseDefChains& chains)
     {
-        f.visitStatements<heart::Assignment> ([] (heart::Assignment& a)
+        chains.visitVariables ([] (heart::Variable& v, const heart::UseDefChains::Chain& chain)
         {
-            if (auto target = cast<heart::Variable> (a.target))
-                if (target->readWriteCount.numWrites == 1 && target->isMutableLocal())
-                    target->role = heart::Variable::Role::constant;
+            if (chain.definitions.size() == 1 && v.isMutableLocal() && isAssignmentTo (*chain.definitions.front(), v))
+                v.role = heart::Variable::Role::constant;
         });
     }
 
@@ -477,7 +1958,7 @@ private:
                   {
                       if (connection.sourceProcessor == nullptr)
                           for (auto& i : toRemove)
-                              if (connection.sourceEndpoint == i->name.toString())
+                              if (connection.sourceEndpoint == i->name)
                                   return true;
 
                       return false;
@@ -511,7 +1992,7 @@ private:
                   {
                       if (connection.destProcessor == nullptr)
                           for (auto& i : toRemove)
-                              if (connection.destEndpoint == i->name.toString())
+                              if (connection.destEndpoint == i->name)
                                   return true;
 
                       return false;
@@ -569,6 +2050,15 @@ private:
                 for (size_t i = 0; i < targetFunction.parameters.size(); ++i)
                 {
                     auto& param = targetFunction.parameters[i].get();
+
+                    // A reference parameter is replaced by the argument itself, so that writes go
+                    // to the caller's variable. A copy of it would just be discarded as unused.
+                    if (param.type.isReference())
+                    {
+                        referenceArguments[param] = bindReferenceArgument (builder, call.arguments[i]);
+                        continue;
+                    }
+
                     auto newParamName = inlinedFnName + "_param_" + makeSafeIdentifierName (param.name.toString());
                     auto& localParamVar = builder.createMutableLocalVariable (param.type, newParamName);
                     builder.addAssignment (localParamVar, call.arguments[i]);
@@ -599,6 +2089,9 @@ private:
 
         void cloneBlock (heart::Block& target, const heart::Block& source)
         {
+            for (auto p : source.parameters)
+                target.addParameter (getRemappedVariable (p));
+
             LinkedList<heart::Statement>::Iterator last;
 
             for (auto s : source.statements)
@@ -631,14 +2124,27 @@ private:
 
         heart::Branch& clone (const heart::Branch& old)
         {
-            return module.allocate<heart::Branch> (*remappedBlocks[old.target]);
+            auto& b = module.allocate<heart::Branch> (*remappedBlocks[old.target]);
+
+            for (auto& arg : old.targetArgs)
+                b.targetArgs.push_back (cloneExpression (arg));
+
+            return b;
         }
 
         heart::BranchIf& clone (const heart::BranchIf& old)
         {
-            return module.allocate<heart::BranchIf> (cloneExpression (old.condition),
-                                                     *remappedBlocks[old.targets[0]],
-                                                     *remappedBlocks[old.targets[1]]);
+            auto& b = module.allocate<heart::BranchIf> (cloneExpression (old.condition),
+                                                        *remappedBlocks[old.targets[0]],
+                                                        *remappedBlocks[old.targets[1]]);
+
+            for (auto& arg : old.targetArgs[0])
+                b.targetArgs[0].push_back (cloneExpression (arg));
+
+            for (auto& arg : old.targetArgs[1])
+                b.targetArgs[1].push_back (cloneExpression (arg));
+
+            return b;
         }
 
         heart::Terminator& clone (const heart::ReturnVoid&)    { return module.allocate<heart::Branch> (*postCallResumeBlock); }
@@ -709,7 +2215,14 @@ private:
                 return clone (*f);
 
             if (auto v = cast<heart::Variable> (old))
+            {
+                auto boundArgument = referenceArguments.find (*v);
+
+                if (boundArgument != referenceArguments.end())
+                    return copyBoundArgument (*boundArgument->second);
+
                 return getRemappedVariable (*v);
+            }
 
             if (auto s = cast<heart::ArrayElement> (old))
                 return cloneArrayElement (*s);
@@ -751,6 +2264,52 @@ private:
             return old;
         }
 
+        // Any dynamic indexes in the argument are evaluated once, before the inlined code runs,
+        // so that the reference keeps pointing at the same element if they're modified later
+        heart::Expression& bindReferenceArgument (BlockBuilder& builder, heart::Expression& arg)
+        {
+            if (auto a = cast<heart::ArrayElement> (arg))
+            {
+                auto& element = module.allocate<heart::ArrayElement> (a->location,
+                                                                      bindReferenceArgument (builder, a->parent),
+                                                                      a->fixedStartIndex,
+                                                                      a->fixedEndIndex);
+
+                if (a->dynamicIndex != nullptr)
+                    element.dynamicIndex = builder.createRegisterVariable (*a->dynamicIndex);
+
+                element.suppressWrapWarning = a->suppressWrapWarning;
+                element.isRangeTrusted = a->isRangeTrusted;
+                return element;
+            }
+
+            if (auto s = cast<heart::StructElement> (arg))
+                return module.allocate<heart::StructElement> (s->location, bindReferenceArgument (builder, s->parent), s->memberName);
+
+            if (is_type<heart::Variable> (arg))
+                return arg;
+
+            return builder.createRegisterVariable (arg);
+        }
+
+        heart::Expression& copyBoundArgument (heart::Expression& arg)
+        {
+            if (auto a = cast<heart::ArrayElement> (arg))
+            {
+                auto& element = module.allocate<heart::ArrayElement> (a->location, copyBoundArgument (a->parent),
+                                                                      a->fixedStartIndex, a->fixedEndIndex);
+                element.dynamicIndex = a->dynamicIndex;
+                element.suppressWrapWarning = a->suppressWrapWarning;
+                element.isRangeTrusted = a->isRangeTrusted;
+                return element;
+            }
+
+            if (auto s = cast<heart::StructElement> (arg))
+                return module.allocate<heart::StructElement> (s->location, copyBoundArgument (s->parent), s->memberName);
+
+            return arg;
+        }
+
         heart::ArrayElement& cloneArrayElement (const heart::ArrayElement& old)
         {
             auto& s = module.allocate<heart::ArrayElement> (old.location,
@@ -780,15 +2339,20 @@ private:
         std::vector<pool_ref<heart::Block>> newBlocks;
         std::unordered_map<pool_ref<heart::Block>, pool_ptr<heart::Block>> remappedBlocks;
         std::unordered_map<pool_ref<heart::Variable>, pool_ptr<heart::Variable>> remappedVariables;
+        std::unordered_map<pool_ref<heart::Variable>, pool_ptr<heart::Expression>> referenceArguments;
         pool_ptr<heart::Block> postCallResumeBlock;
         pool_ptr<heart::Variable> returnValueVar;
     };
 
     enum class InlineResult { ok, failed, noneFound };
 
-    static InlineResult inlineNextCall (Program& program, heart::Function& parentFunction, heart::Function& functionToInline)
+    /** Looks for the next call, starting at the given block. The inliner only adds blocks after the one
+        that contained the call, so a search can carry on from where the last one stopped.
+    */
+    static InlineResult inlineNextCall (Program& program, heart::Function& parentFunction,
+                                        heart::Function& functionToInline, size_t& blockIndex)
     {
-        for (size_t blockIndex = 0; blockIndex < parentFunction.blocks.size(); ++blockIndex)
+        for (; blockIndex < parentFunction.blocks.size(); ++blockIndex)
         {
             for (auto s : parentFunction.blocks[blockIndex]->statements)
             {
@@ -812,10 +2376,11 @@ private:
     static InlineResult inlineAllCallsToFunction (Program& program, heart::Function& parentFunction, heart::Function& functionToInline)
     {
         bool anyChanged = false;
+        size_t blockIndex = 0;
 
         for (;;)
         {
-            auto result = inlineNextCall (program, parentFunction, functionToInline);
+            auto result = inlineNextCall (program, parentFunction, functionToInline, blockIndex);
 
             if (result == InlineResult::failed)
                 return result;
@@ -85,9 +85,15 @@ struct heart::Parser   : public Tokeniser<DummyKeywordMatcher,
                                           HEARTOperator::Matcher,
                                           IdentifierMatcher>
 {
-    static Program parse (const CodeLocation& code)
+    /** Parses some HEART code. If numThreads is more than 1, the function bodies are shared out
+        between that many threads once everything else has been parsed. If the code contains more
+        than one error, this may change which of them gets reported.
+    */
+    static Program parse (const CodeLocation& code, uint32_t numThreads = 1)
     {
-        return heart::Parser (code).parse();
+        heart::Parser p (code);
+        p.numThreads = numThreads;
+        return p.parse();
     }
 
     static Type parseType (const CodeLocation& code)
@@ -113,9 +119,18 @@ private:
 
     Program program;
     pool_ptr<Module> module;
+    uint32_t numThreads = 1;
+    heart::Allocator* workerAllocator = nullptr;
+    std::mutex* workerLock = nullptr;
 
     //==============================================================================
     Parser (const CodeLocation& text)  : Tokeniser (text) {}
+
+    /** Creates a parser for a worker thread, which adds to an existing program, but
+        allocates its objects from its own allocator.
+    */
+    Parser (const CodeLocation& text, Program& p, heart::Allocator& a, std::mutex& lock)
+        : Tokeniser (text), program (p), workerAllocator (std::addressof (a)), workerLock (std::addressof (lock)) {}
     ~Parser() override = default;
 
     //==============================================================================
@@ -139,9 +154,28 @@ private:
         for (auto& item : scannedTopLevelItems)  parseStateVariables (item);
         for (auto& item : scannedTopLevelItems)  parseModule (item);
 
+        if (numThreads > 1)
+            parseFunctionBodiesInParallel (scannedTopLevelItems);
+
         return program;
     }
 
+    heart::Allocator& getAllocator()
+    {
+        return workerAllocator != nullptr ? *workerAllocator : program.getAllocator();
+    }
+
+    StringDictionary::Handle getStringHandle (const std::string& text)
+    {
+        if (workerLock != nullptr)
+        {
+            std::lock_guard<std::mutex> lock (*workerLock);
+            return program.getStringDictionary().getHandleForString (text);
+        }
+
+        return program.getStringDictionary().getHandleForString (text);
+    }
+
     void scanTopLevelItem (std::vector<ScannedTopLevelItem>& scannedTopLevelItems, Module& newModule)
     {
         ScannedTopLevelItem newItem (newModule);
@@ -268,12 +302,15 @@ private:
             parseOutput (module->outputs[i]);
         }
 
-        for (size_t i = 0; i < item.functionBodyCode.size(); ++i)
+        if (numThreads <= 1)
         {
-            if (item.functionBodyCode[i] != UTF8Reader())
+            for (size_t i = 0; i < item.functionBodyCode.size(); ++i)
             {
-                resetPosition (item.functionBodyCode[i]);
-                parseFunctionBody (module->functions[i]);
+                if (item.functionBodyCode[i] != UTF8Reader())
+                {
+                    resetPosition (item.functionBodyCode[i]);
+                    parseFunctionBody (module->functions[i]);
+                }
             }
         }
 
@@ -284,10 +321,51 @@ private:
         resetPosition (nextItemPos);
     }
 
+    void parseFunctionBodiesInParallel (std::vector<ScannedTopLevelItem>& items)
+    {
+        struct FunctionBody
+        {
+            ScannedTopLevelItem& item;
+            size_t functionIndex;
+        };
+
+        std::vector<FunctionBody> bodies;
+
+        for (auto& item : items)
+            for (size_t i = 0; i < item.functionBodyCode.size(); ++i)
+                if (item.functionBodyCode[i] != UTF8Reader())
+                    bodies.push_back ({ item, i });
+
+        auto numBatches = std::min ((size_t) numThreads, bodies.size());
+        auto batchSize = numBatches == 0 ? 0 : (bodies.size() + numBatches - 1) / numBatches;
+        std::vector<heart::Allocator> allocators;
+        std::mutex lock;
+
+        for (size_t i = 0; i < numBatches; ++i)
+            allocators.emplace_back (program.getAllocator(), lock);
+
+        runCompileTasksInParallel (numBatches, numThreads, [&] (size_t batch)
+        {
+            Parser worker (startLocation, program, allocators[batch], lock);
+            auto end = std::min (bodies.size(), (batch + 1) * batchSize);
+
+            for (auto i = batch * batchSize; i < end; ++i)
+            {
+                auto& body = bodies[i];
+                worker.module = body.item.module;
+                worker.resetPosition (body.item.functionBodyCode[body.functionIndex]);
+                worker.parseFunctionBody (body.item.module.functions[body.functionIndex]);
+            }
+        });
+
+        for (auto& a : allocators)
+            program.getAllocator().pool.absorb (a.pool);
+    }
+
     void scanInput (ScannedTopLevelItem& item)
     {
         item.inputDecls.push_back (getCurrentTokeniserPosition());
-        auto& inputDeclaration = module->allocate<heart::InputDeclaration> (location);
+        auto& inputDeclaration = getAllocator().allocate<heart::InputDeclaration> (location);
         inputDeclaration.name = parseIdentifier();
         inputDeclaration.index = (uint32_t) module->inputs.size();
 
@@ -301,7 +379,7 @@ private:
     void scanOutput (ScannedTopLevelItem& item)
     {
         item.outputDecls.push_back (getCurrentTokeniserPosition());
-        auto& output = module->allocate<heart::OutputDeclaration> (location);
+        auto& output = getAllocator().allocate<heart::OutputDeclaration> (location);
         output.name = parseIdentifier();
 
         if (module->findInput (output.name) != nullptr || module->findOutput (output.name) != nullptr)
@@ -384,7 +462,7 @@ private:
         if (matches (Token::literalInt64))     { auto v = literalIntValue;    skip(); return Value::createInt64 (v); }
         if (matches (Token::literalFloat32))   { auto v = literalDoubleValue; skip(); return Value ((float) v); }
         if (matches (Token::literalFloat64))   { auto v = literalDoubleValue; skip(); return Value (v); }
-        if (matches (Token::literalString))    { auto v = program.getStringDictionary().getHandleForString (currentStringValue); skip(); return Value::createStringLiteral(v); }
+        if (matches (Token::literalString))    { auto v = getStringHandle (currentStringValue); skip(); return Value::createStringLiteral(v); }
         if (matchIf ("true"))                  return Value (true);
         if (matchIf ("false"))                 return Value (false);
         if (matchIf (HEARTOperator::minus))    return negate (parseAnnotationValue());
@@ -405,7 +483,7 @@ private:
             if (m->instanceName == name)
                 location.throwError (Errors::duplicateProcessor (name));
 
-        auto& mi = module->allocate<heart::ProcessorInstance>();
+        auto& mi = getAllocator().allocate<heart::ProcessorInstance>();
         module->processorInstances.push_back (mi);
         mi.instanceName = name;
         expect (HEARTOperator::assign);
@@ -433,7 +511,7 @@ private:
 
     void parseConnection()
     {
-        auto& c = module->allocate<heart::Connection> (location);
+        auto& c = getAllocator().allocate<heart::Connection> (location);
         module->connections.push_back (c);
 
         c.interpolationType = parseInterpolationType (*this);
@@ -468,7 +546,7 @@ private:
     struct ProcessorAndChannel
     {
         pool_ptr<heart::ProcessorInstance> processor;
-        std::string endpoint;
+        Identifier endpoint;
         std::optional<size_t> endpointIndex;
     };
 
@@ -481,11 +559,11 @@ private:
         if (matchIf (HEARTOperator::dot))
         {
             processorAndChannel.processor = findProcessorInstance (name);
-            processorAndChannel.endpoint   = readIdentifier();
+            processorAndChannel.endpoint   = getAllocator().get (readIdentifier());
         }
         else
         {
-            processorAndChannel.endpoint = name;
+            processorAndChannel.endpoint = getAllocator().get (name);
         }
 
         if (matchIf (HEARTOperator::openBracket))
@@ -527,13 +605,13 @@ private:
     {
         bool isExternal = matchIf ("external");
         auto type = readValueType();
-        auto name = program.getAllocator().get (readIdentifier());
+        auto name = getAllocator().get (readIdentifier());
 
         for (auto& v : module->stateVariables)
             if (v->name == name)
                 throwError (Errors::nameInUse (v->name));
 
-        auto& v = module->allocate<heart::Variable> (location, type, name,
+        auto& v = getAllocator().allocate<heart::Variable> (location, type, name,
                                                      isExternal ? heart::Variable::Role::external
                                                                 : heart::Variable::Role::state);
         parseAnnotation (v.annotation);
@@ -571,7 +649,7 @@ private:
 
     void scanFunction (ScannedTopLevelItem& item, bool isEventFunction)
     {
-        auto& fn = module->allocate<heart::Function>();
+        auto& fn = getAllocator().allocate<heart::Function>();
 
         fn.name = parseIdentifier();
 
@@ -642,7 +720,7 @@ private:
 
     void parseFunctionParams (heart::Function& f)
     {
-        FunctionBuilder builder (*module);
+        FunctionBuilder builder (*module, getAllocator());
         FunctionParseState state (f);
 
         if (! matchIf (HEARTOperator::closeParen))
@@ -652,7 +730,7 @@ private:
                 auto type = readValueOrRefType();
                 auto paramLocation = location;
                 auto name = parseIdentifier();
-                f.parameters.push_back (module->allocate<heart::Variable> (std::move (paramLocation), type, name,
+                f.parameters.push_back (getAllocator().allocate<heart::Variable> (std::move (paramLocation), type, name,
                                                                            heart::Variable::Role::parameter));
 
                 if (matchIf (HEARTOperator::comma))
@@ -685,7 +763,7 @@ private:
 
     void parseFunctionBody (heart::Function& f)
     {
-        FunctionBuilder builder (*module);
+        FunctionBuilder builder (*module, getAllocator());
         FunctionParseState state (f);
 
         if (! matchIf (HEARTOperator::closeBrace))
@@ -727,7 +805,7 @@ private:
                         auto paramType = readValueOrRefType();
                         auto paramLocation = location;
                         auto paramName = parseIdentifier();
-                        block.parameters.push_back (module->allocate<heart::Variable> (std::move (paramLocation), paramType, paramName, heart::Variable::Role::parameter));
+                        block.parameters.push_back (getAllocator().allocate<heart::Variable> (std::move (paramLocation), paramType, paramName, heart::Variable::Role::parameter));
 
                         if (matchIf (HEARTOperator::comma))
                             continue;
@@ -1118,7 +1196,7 @@ private:
         if (! lhs.getType().isValidArrayOrVectorRange (start, end))
             throwError (Errors::illegalSliceSize());
 
-        auto& s = module->allocate<heart::ArrayElement> (location, lhs, (size_t) start, (size_t) end);
+        auto& s = getAllocator().allocate<heart::ArrayElement> (location, lhs, (size_t) start, (size_t) end);
         return parseVariableSuffixes (state, s);
     }
 
@@ -1134,7 +1212,7 @@ private:
             auto& structure = lhs.getType().getStructRef();
 
             if (structure.hasMemberWithName (member))
-                return parseVariableSuffixes (state, module->allocate<heart::StructElement> (location, lhs, member));
+                return parseVariableSuffixes (state, getAllocator().allocate<heart::StructElement> (location, lhs, member));
 
             throwError (Errors::unknownMemberInStruct (member, structure.getName()));
         }
@@ -1178,14 +1256,14 @@ private:
                 throwError (Errors::nonIntegerArrayIndex());
 
             if (matchAndReplaceIf (Operator::closeDoubleBracket, Operator::closeBracket))
-                return parseVariableSuffixes (state, module->allocate<heart::ArrayElement> (location, lhs, startIndex));
+                return parseVariableSuffixes (state, getAllocator().allocate<heart::ArrayElement> (location, lhs, startIndex));
 
             expect (HEARTOperator::closeBracket);
 
             if (! lhs.getType().isArrayOrVector())
                 location.throwError (Errors::expectedArrayOrVector());
 
-            return parseVariableSuffixes (state, module->allocate<heart::ArrayElement> (location, lhs, startIndex));
+            return parseVariableSuffixes (state, getAllocator().allocate<heart::ArrayElement> (location, lhs, startIndex));
         }
 
         return lhs;
@@ -1201,7 +1279,7 @@ private:
         if (! UnaryOp::isTypeSuitable (opType, source.getType()))
             throwError (Errors::wrongTypeForUnary());
 
-        return module->allocate<heart::UnaryOperator> (location, source, opType);
+        return getAllocator().allocate<heart::UnaryOperator> (location, source, opType);
     }
 
     heart::BinaryOperator& parseBinaryOp (const FunctionParseState& state, BinaryOp::Op opType)
@@ -1227,7 +1305,7 @@ private:
                                                                    lhs.getType().getDescription(),
                                                                    rhs.getType().getDescription()));
 
-        return module->allocate<heart::BinaryOperator> (pos, lhs, rhs, opType);
+        return getAllocator().allocate<heart::BinaryOperator> (pos, lhs, rhs, opType);
     }
 
     heart::TypeCast& parseCast (const FunctionParseState& state)
@@ -1238,7 +1316,7 @@ private:
         auto& source = parseExpression (state);
         expect (HEARTOperator::closeParen);
 
-        return module->allocate<heart::TypeCast> (pos, source, destType);
+        return getAllocator().allocate<heart::TypeCast> (pos, source, destType);
     }
 
     heart::Expression& parseExpression (const FunctionParseState& state)
@@ -1272,7 +1350,7 @@ private:
             auto infOrNaN = parseNaNandInfinityTokens();
 
             if (infOrNaN.isValid())
-                return program.getAllocator().allocateConstant (infOrNaN);
+                return getAllocator().allocateConstant (infOrNaN);
 
             if (matchIf ("processor"))
                 return parseProcessorProperty();
@@ -1345,7 +1423,7 @@ private:
         if (module->isNamespace())
             pos.throwError (Errors::processorPropertyUsedOutsideDecl());
 
-        return module->allocate<heart::ProcessorProperty> (pos, property);
+        return getAllocator().allocate<heart::ProcessorProperty> (pos, property);
     }
 
     Value negate (const Value& v)
@@ -1359,7 +1437,7 @@ private:
     heart::Expression& parseConstantAsExpression (const FunctionParseState& state, const Type& requiredType)
     {
         auto c = parseConstant (requiredType, true);
-        return parseVariableSuffixes (state, program.getAllocator().allocateConstant (c));
+        return parseVariableSuffixes (state, getAllocator().allocateConstant (c));
     }
 
     Value castValue (const Value& v, const Type& destType)
@@ -1472,7 +1550,7 @@ private:
         {
             auto n = currentStringValue;
             expect (Token::literalString);
-            return Value::createStringLiteral (program.getStringDictionary().getHandleForString (n));
+            return Value::createStringLiteral (getStringHandle (n));
         }
 
         if (throwOnError)
@@ -1539,7 +1617,7 @@ private:
 
     Identifier parseIdentifier()
     {
-        return program.getAllocator().get (readIdentifier());
+        return getAllocator().get (readIdentifier());
     }
 
     int64_t parseLiteralInt()
@@ -1576,7 +1654,7 @@ private:
     Identifier readBlockName()
     {
         expect (HEARTOperator::at);
-        return program.getAllocator().get ("@" + readIdentifier());
+        return getAllocator().get ("@" + readIdentifier());
     }
 
     StructurePtr findStruct (const std::string& name)
@@ -0,0 +1,413 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul
+{
+
+//==============================================================================
+/**
+    Lowers float64 values to float32 in processors which have been marked as safe to run at
+    a reduced precision with a [[ reducedPrecision ]] annotation. The compiler only does this
+    when BuildSettings::allowReducedPrecision is set, which is intended for targets where
+    double precision is slow or emulated.
+
+    Inside a marked processor, the float64 state variables, function parameters, locals and
+    return types (including vectors and arrays of float64) all become float32. Its endpoints,
+    the parameters of its exported functions and anything belonging to other modules keep their
+    types, so casts are added wherever a value crosses between the two. For example, a call to
+    a float64 library function still runs at double precision, but its arguments and result
+    are converted.
+
+    If a processor uses float64 in a way that can't be converted with casts, such as copying a
+    whole float64 array out of a struct, it's left unchanged.
+*/
+struct PrecisionReduction
+{
+    static void apply (Program& program)
+    {
+        for (auto& m : program.getModules())
+            if (m->isProcessor() && m->annotation.getBool ("reducedPrecision"))
+                PrecisionReduction (m).convertModule();
+    }
+
+private:
+    PrecisionReduction (Module& m) : module (m) {}
+
+    Module& module;
+    std::unordered_set<const heart::Variable*> variablesToKeep, convertedVariables;
+    std::unordered_map<const heart::Statement*, Type> originalTypes;
+    std::vector<std::function<void()>> undoActions;
+    bool failed = false;
+
+    //==============================================================================
+    void convertModule()
+    {
+        findVariablesToKeep();
+
+        for (auto& v : module.stateVariables)
+            convertVariable (v);
+
+        for (auto& f : module.functions)
+        {
+            if (! hasFixedSignature (f))
+            {
+                convertType (f->returnType);
+
+                for (auto& p : f->parameters)
+                    convertVariable (p);
+            }
+
+            for (auto& b : f->blocks)
+            {
+                for (auto& p : b->parameters)
+                    convertVariable (p);
+
+                b->visitExpressions ([this] (pool_ref<heart::Expression>& value, AccessType)
+                {
+                    if (auto v = cast<heart::Variable> (value))
+                        if (v->isFunctionLocal())
+                            convertVariable (*v);
+                });
+            }
+        }
+
+        for (auto& f : module.functions)
+            for (auto& b : f->blocks)
+                fixBlock (f, b);
+
+        if (failed)
+            for (auto i = undoActions.rbegin(); i != undoActions.rend(); ++i)
+                (*i)();
+    }
+
+    /** Finds the variables whose types are tied to something outside this processor's code, which
+        have to stay as they are: the parameters of exported functions, variables which are read
+        from a stream, and variables that get the result of a call to another module's function
+        or are passed to it by reference. This also records the types of the values which are
+        written to outputs, as those must also stay the same.
+    */
+    void findVariablesToKeep()
+    {
+        for (auto& f : module.functions)
+        {
+            if (hasFixedSignature (f))
+                for (auto& p : f->parameters)
+                    variablesToKeep.insert (p.getPointer());
+
+            for (auto& b : f->blocks)
+            {
+                for (auto s : b->statements)
+                {
+                    if (auto r = cast<heart::ReadStream> (*s))
+                    {
+                        keepIfVariable (r->target);
+                        originalTypes[s] = r->target->getType();
+                    }
+                    else if (auto w = cast<heart::WriteStream> (*s))
+                    {
+                        originalTypes[s] = w->value->getType();
+                    }
+                    else if (auto call = cast<heart::FunctionCall> (*s))
+                    {
+                        auto& fn = call->getFunction();
+
+                        if (! isModuleFunction (fn))
+                        {
+                            keepIfVariable (call->target);
+
+                            for (size_t i = 0; i < call->arguments.size(); ++i)
+                                if (fn.parameters[i]->type.isReference())
+                                    keepIfVariable (call->arguments[i]);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    static bool hasFixedSignature (const heart::Function& f)
+    {
+        return f.isExported || ! f.functionType.isNormal();
+    }
+
+    void keepIfVariable (pool_ptr<heart::Expression> e)
+    {
+        if (auto v = cast<heart::Variable> (e))
+            variablesToKeep.insert (v.get());
+    }
+
+    bool isModuleFunction (const heart::Function& f) const
+    {
+        for (auto& mf : module.functions)
+            if (mf.getPointer() == std::addressof (f))
+                return true;
+
+        return false;
+    }
+
+    //==============================================================================
+    static bool isFloat64Based (const Type& t)
+    {
+        if (t.isPrimitive() || t.isVector())
+            return t.isFloat64();
+
+        if (t.isArray())
+            return isFloat64Based (t.getArrayElementType());
+
+        return false;
+    }
+
+    static Type getReducedType (const Type& t)
+    {
+        if (! isFloat64Based (t))
+            return t;
+
+        Type result;
+
+        if (t.isArray())
+            result = t.createCopyWithNewArrayElementType (getReducedType (t.getArrayElementType()));
+        else if (t.isVector())
+            result = Type::createVector (PrimitiveType::float32, t.getVectorSize());
+        else
+            result = PrimitiveType::float32;
+
+        if (t.isConst())      result = result.createConstIfNotPresent();
+        if (t.isReference())  result = result.createReference();
+
+        return result;
+    }
+
+    /** True if the two types are the same apart from one being a reduced-precision version of the other. */
+    static bool differOnlyInPrecision (const Type& a, const Type& b)
+    {
+        constexpr int flags = Type::ignoreConst | Type::ignoreReferences;
+        return ! a.isEqual (b, flags) && getReducedType (a).isEqual (getReducedType (b), flags);
+    }
+
+    void convertType (Type& type)
+    {
+        if (isFloat64Based (type))
+        {
+            auto oldType = type;
+            type = getReducedType (type);
+            undoActions.push_back ([&type, oldType] { type = oldType; });
+        }
+    }
+
+    void convertVariable (heart::Variable& v)
+    {
+        if (v.isExternal() || variablesToKeep.count (std::addressof (v)) != 0)
+            return;
+
+        if (convertedVariables.insert (std::addressof (v)).second)
+            convertType (v.type);
+    }
+
+    //==============================================================================
+    void fixBlock (heart::Function& f, heart::Block& b)
+    {
+        for (auto s : b.statements)
+            fixStatement (*s);
+
+        if (auto branch = cast<heart::Branch> (b.terminator))
+        {
+            fixBranchArgs (branch->targetArgs, branch->target);
+        }
+        else if (auto branchIf = cast<heart::BranchIf> (b.terminator))
+        {
+            fixValue (branchIf->condition, branchIf->condition->getType());
+            fixBranchArgs (branchIf->targetArgs[0], branchIf->targets[0]);
+            fixBranchArgs (branchIf->targetArgs[1], branchIf->targets[1]);
+        }
+        else if (auto ret = cast<heart::ReturnValue> (b.terminator))
+        {
+            fixValue (ret->returnValue, f.returnType);
+        }
+    }
+
+    template <typename ArgList>
+    void fixBranchArgs (ArgList& args, heart::Block& target)
+    {
+        for (size_t i = 0; i < args.size(); ++i)
+            fixValue (args[i], target.parameters[i]->type);
+    }
+
+    void fixStatement (heart::Statement& s)
+    {
+        if (auto a = cast<heart::AssignFromValue> (s))
+        {
+            fixLocation (*a->target);
+            fixValue (a->source, a->target->getType());
+        }
+        else if (auto call = cast<heart::FunctionCall> (s))
+        {
+            auto& fn = call->getFunction();
+
+            if (call->target != nullptr)
+            {
+                fixLocation (*call->target);
+                checkTypesMatch (call->target->getType(), fn.returnType);
+            }
+
+            for (size_t i = 0; i < call->arguments.size(); ++i)
+            {
+                auto& paramType = fn.parameters[i]->type;
+
+                if (paramType.isReference())
+                {
+                    fixLocation (call->arguments[i]);
+                    checkTypesMatch (call->arguments[i]->getType(), paramType);
+                }
+                else
+                {
+                    fixValue (call->arguments[i], paramType);
+                }
+            }
+        }
+        else if (auto r = cast<heart::ReadStream> (s))
+        {
+            fixLocation (*r->target);
+            checkTypesMatch (r->target->getType(), originalTypes[std::addressof (s)]);
+        }
+        else if (auto w = cast<heart::WriteStream> (s))
+        {
+            if (w->element != nullptr)
+            {
+                auto element = w->element.getAsPoolRef();
+                fixValue (element, element->getType());
+                w->element = element;
+            }
+
+            fixValue (w->value, originalTypes[std::addressof (s)]);
+        }
+    }
+
+    void checkTypesMatch (const Type& a, const Type& b)
+    {
+        if (differOnlyInPrecision (a, b))
+            failed = true;
+    }
+
+    /** Fixes up the sub-expressions of an expression which is being written to. */
+    void fixLocation (heart::Expression& e)
+    {
+        if (auto a = cast<heart::ArrayElement> (e))
+        {
+            fixLocation (a->parent);
+
+            if (a->dynamicIndex != nullptr)
+            {
+                auto index = a->dynamicIndex.getAsPoolRef();
+                fixValue (index, index->getType());
+                a->dynamicIndex = index;
+            }
+        }
+        else if (auto s = cast<heart::StructElement> (e))
+        {
+            fixLocation (s->parent);
+        }
+    }
+
+    /** Fixes up an expression which is being read, and casts it if it's a different precision
+        from the type it needs to be.
+    */
+    void fixValue (pool_ref<heart::Expression>& e, const Type& requiredType)
+    {
+        fixOperands (e);
+
+        if (differOnlyInPrecision (e->getType(), requiredType))
+            castTo (e, requiredType);
+    }
+
+    void fixOperands (heart::Expression& e)
+    {
+        if (auto b = cast<heart::BinaryOperator> (e))
+        {
+            fixOperands (b->lhs);
+            fixOperands (b->rhs);
+
+            // If just one side has been reduced, the other side needs to match it
+            auto lhsType = b->lhs->getType();
+            auto rhsType = b->rhs->getType();
+
+            if (isFloat64Based (lhsType) && ! isFloat64Based (rhsType))
+                castTo (b->lhs, getReducedType (lhsType));
+            else if (isFloat64Based (rhsType) && ! isFloat64Based (lhsType))
+                castTo (b->rhs, getReducedType (rhsType));
+        }
+        else if (auto u = cast<heart::UnaryOperator> (e))
+        {
+            fixOperands (u->source);
+        }
+        else if (auto c = cast<heart::TypeCast> (e))
+        {
+            fixOperands (c->source);
+        }
+        else if (auto call = cast<heart::PureFunctionCall> (e))
+        {
+            for (size_t i = 0; i < call->arguments.size(); ++i)
+                fixValue (call->arguments[i], call->function.parameters[i]->type);
+        }
+        else
+        {
+            fixLocation (e);
+        }
+    }
+
+    void castTo (pool_ref<heart::Expression>& e, const Type& type)
+    {
+        auto destType = type.removeReferenceIfPresent().removeConstIfPresent();
+        auto& oldValue = e.get();
+        auto constant = oldValue.getAsConstant();
+
+        if (constant.isValid())
+        {
+            replace (e, module.allocate<heart::Constant> (oldValue.location, constant.castToTypeExpectingSuccess (destType)));
+            return;
+        }
+
+        if (! destType.isPrimitiveOrVector())
+        {
+            failed = true;
+            return;
+        }
+
+        pool_ref<heart::Expression> source = oldValue;
+
+        // Rather than adding a cast to a cast, this replaces the existing one
+        if (auto existingCast = cast<heart::TypeCast> (oldValue))
+            if (existingCast->source->getType().isPrimitiveOrVector())
+                source = existingCast->source;
+
+        if (source->getType().isEqual (destType, Type::ignoreConst | Type::ignoreReferences))
+            replace (e, source);
+        else
+            replace (e, module.allocate<heart::TypeCast> (oldValue.location, source, destType));
+    }
+
+    void replace (pool_ref<heart::Expression>& e, heart::Expression& newValue)
+    {
+        auto& oldValue = e.get();
+        e = newValue;
+        undoActions.push_back ([&e, &oldValue] { e = oldValue; });
+    }
+};
+
+} // namespace soul
@@ -24,32 +24,154 @@ namespace soul
 //==============================================================================
 struct heart::Printer
 {
-    static void print (const Program& p, choc::text::CodePrinter& out)
+    /** Prints the program as HEART code. If numThreads is more than 1, the modules are printed
+        into separate buffers on that many threads, and then added to the output in order, so
+        the result is the same as printing them one at a time.
+    */
+    static void print (const Program& p, choc::text::CodePrinter& out, uint32_t numThreads = 1)
     {
         out << '#' << getHEARTFormatVersionPrefix() << ' ' << getHEARTFormatVersion() << blankLine;
 
-        for (auto& module : p.getModules())
-            PrinterStream (module, out).printAll();
+        auto& modules = p.getModules();
+        QualifiedNames names (p);
+
+        if (numThreads <= 1 || modules.size() <= 1)
+        {
+            for (auto& module : modules)
+                PrinterStream (module, names, out).printAll();
+
+            return;
+        }
+
+        std::vector<std::string> moduleDumps (modules.size());
+
+        runCompileTasksInParallel (modules.size(), numThreads, [&] (size_t i)
+        {
+            choc::text::CodePrinter moduleOut;
+            PrinterStream (modules[i], names, moduleOut).printAll();
+            moduleDumps[i] = moduleOut.toString();
+        });
+
+        for (auto& dump : moduleDumps)
+            out << dump;
     }
 
-    static std::string getDump (const Program& p)
+    static std::string getDump (const Program& p, uint32_t numThreads = 1)
     {
-        choc::text::CodePrinter out;
-        print (p, out);
+        choc::text::CodePrinter out (getExpectedSize (p));
+        print (p, out, numThreads);
         return out.toString();
     }
 
+    static void write (const Program& p, choc::text::CodePrinter::OutputFunction output, uint32_t numThreads = 1)
+    {
+        choc::text::CodePrinter out (std::move (output));
+        print (p, out, numThreads);
+        out.flush();
+    }
+
 private:
+    /** A rough guess at the size of a program's dump, which is dominated by any big constant
+        tables, so that the printer's buffer chunks can be sized to suit it.
+    */
+    static size_t getExpectedSize (const Program& p)
+    {
+        size_t total = 16384;
+
+        for (auto& c : p.getConstantTable())
+            total += c.value->getPackedDataSize() * 3;
+
+        return std::min (total, static_cast<size_t> (16 * 1024 * 1024));
+    }
+
+    /** Finds the module that owns each struct, function and state variable up-front, so that
+        the printer doesn't need to search the whole program every time it has to decide
+        whether a name needs qualifying. Once built, it's only read, so the modules can share
+        it when they're printed on different threads.
+    */
+    struct QualifiedNames
+    {
+        QualifiedNames (const Program& p)
+        {
+            for (auto& m : p.getModules())
+            {
+                for (auto& s : m->structs)
+                    structs.emplace (s.get(), Name { std::addressof (m.get()), Program::stripRootNamespaceFromQualifiedPath (TokenisedPathString::join (m->fullName, s->getName())) });
+
+                for (auto& f : m->functions)
+                    functions.emplace (std::addressof (f.get()), Name { std::addressof (m.get()), TokenisedPathString::join (m->fullName, f->name) });
+
+                for (auto& v : m->stateVariables)
+                    stateVariables.emplace (std::addressof (v.get()), Name { std::addressof (m.get()), Program::stripRootNamespaceFromQualifiedPath (TokenisedPathString::join (m->fullName, v->name)) });
+            }
+        }
+
+        std::string getStructName (const Module& context, const Structure& s) const
+        {
+            auto i = structs.find (std::addressof (s));
+            SOUL_ASSERT (i != structs.end());
+
+            if (i == structs.end() || i->second.owner == std::addressof (context))
+                return s.getName();
+
+            return i->second.qualifiedName;
+        }
+
+        std::string getFunctionName (const Module& context, const heart::Function& f) const
+        {
+            auto i = functions.find (std::addressof (f));
+            SOUL_ASSERT (i != functions.end());
+
+            if (i == functions.end())
+                return f.name;
+
+            if (i->second.owner == std::addressof (context))
+                return f.name.toString();
+
+            return i->second.qualifiedName;
+        }
+
+        std::string getVariableName (const Module& context, const heart::Variable& v) const
+        {
+            if (v.isState())
+            {
+                auto i = stateVariables.find (std::addressof (v));
+
+                if (i != stateVariables.end())
+                {
+                    if (i->second.owner == std::addressof (context))
+                        return v.name.toString();
+
+                    return i->second.qualifiedName;
+                }
+            }
+
+            return v.name;
+        }
+
+    private:
+        struct Name
+        {
+            const Module* owner;
+            std::string qualifiedName;
+        };
+
+        std::unordered_map<const Structure*, Name> structs;
+        std::unordered_map<const heart::Function*, Name> functions;
+        std::unordered_map<const heart::Variable*, Name> stateVariables;
+    };
+
     static constexpr choc::text::CodePrinter::NewLine newLine = {};
     static constexpr choc::text::CodePrinter::BlankLine blankLine = {};
     static constexpr choc::text::CodePrinter::SectionBreak sectionBreak = {};
 
     struct PrinterStream
     {
-        PrinterStream (const Module& m, choc::text::CodePrinter& o)
-           : module (m), out (o) {}
+        PrinterStream (const Module& m, const QualifiedNames& n, choc::text::CodePrinter& o)
+           : module (m), names (n), out (o) {}
 
         const Module& module;
+        const QualifiedNames& names;
         choc::text::CodePrinter& out;
 
         std::unordered_map<pool_ref<heart::Variable>, std::string> localVariableNames;
@@ -371,6 +493,50 @@ private:
                 void printFloat32 (float value) override    { if (value == 0) print ("0.0f"); else ValuePrinter::printFloat32 (value); }
                 void printFloat64 (double value) override   { if (value == 0) print ("0.0");  else ValuePrinter::printFloat64 (value); }
 
+                // Constant tables can be huge, so they're formatted into one string rather
+                // than being passed to the CodePrinter an element at a time
+                void printFloat32Elements (const void* elements, size_t numElements) override
+                {
+                    std::string s;
+                    s.reserve (numElements * 14);
+
+                    for (size_t i = 0; i < numElements; ++i)
+                    {
+                        if (i != 0)
+                            s += ", ";
+
+                        auto value = readUnaligned<float> (elements, i * sizeof (float));
+
+                        if (value == 0)
+                            s += "0.0f";
+                        else
+                            appendFloat32 (s, value);
+                    }
+
+                    print (s);
+                }
+
+                void printFloat64Elements (const void* elements, size_t numElements) override
+                {
+                    std::string s;
+                    s.reserve (numElements * 22);
+
+                    for (size_t i = 0; i < numElements; ++i)
+                    {
+                        if (i != 0)
+                            s += ", ";
+
+                        auto value = readUnaligned<double> (elements, i * sizeof (double));
+
+                        if (value == 0)
+                            s += "0.0";
+                        else
+                            appendFloat64 (s, value);
+                    }
+
+                    print (s);
+                }
+
                 choc::text::CodePrinter& outStream;
             };
 
@@ -404,7 +570,7 @@ private:
                     SOUL_ASSERT_FALSE;
                 }
 
-                return printVarWithPrefix (module.program.getVariableNameWithQualificationIfNeeded (module, *v));
+                return printVarWithPrefix (names.getVariableName (module, *v));
             }
 
             if (auto arrayElement = cast<heart::ArrayElement> (e))
@@ -490,7 +656,7 @@ private:
 
         std::string getTypeDescription (const Type& type) const
         {
-            return module.program.getTypeDescriptionWithQualificationIfNeeded (module, type.removeConstIfPresent());
+            return type.removeConstIfPresent().getDescription ([this] (const Structure& s) { return names.getStructName (module, s); });
         }
 
         static const char* getUnaryOpName (UnaryOp::Op o)
@@ -527,7 +693,7 @@ private:
             out << " = ";
         }
 
-        std::string getFunctionName (const heart::Function& f)   { return module.program.getFunctionNameWithQualificationIfNeeded (module, f); }
+        std::string getFunctionName (const heart::Function& f)   { return names.getFunctionName (module, f); }
         static std::string getBlockName (heart::Block& b)        { return b.name; }
 
         void printStatementDescription (const heart::Object& s)
@@ -0,0 +1,622 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul
+{
+
+//==============================================================================
+/**
+    Packs an array of identical processors, such as a bank of voices, into a single processor
+    whose state is laid out structure-of-arrays: each state variable becomes a vector with a
+    lane for each element of the array, e.g. float -> float<8>, so that one call to run()
+    advances every element with vector operations.
+
+    The lanes have to stay in step, so run() and _soul_init mustn't branch, and can only do
+    the arithmetic that the loop vectoriser also handles, on non-boolean primitive state and
+    locals. Calls to functions outside the processor are made once for each lane. Event
+    handlers can do anything that only touches their own lane: each one is given the lane
+    index as an extra parameter, and updates that element of the state.
+
+    The processor's event inputs become endpoint arrays with an element per lane, which the
+    graph already knows how to route into: an event sent to voices[i] arrives at lane i, and
+    one sent to the whole array reaches every lane. Stream inputs are read once and given to
+    every lane, and each stream output writes the sum of its lanes, which is what the array's
+    outputs would have been mixed into. A processor isn't packed if any of its connections
+    would be routed differently once the array has gone, e.g. a stream fed element-by-element
+    from another array.
+
+    This pass is only run when the "packProcessorArrays" custom build setting is enabled.
+*/
+struct ProcessorArrayPacking
+{
+    static constexpr const char* setting = "packProcessorArrays";
+
+    /** Packs every processor array that can be packed. */
+    static void apply (Program& program)
+    {
+        for (auto& m : program.getModules())
+            if (m->isGraph())
+                for (auto& i : m->processorInstances)
+                    if (auto processor = getPackableProcessor (program, m, i))
+                        ProcessorArrayPacking (*processor, i).pack();
+    }
+
+private:
+    //==============================================================================
+    static pool_ptr<Module> getPackableProcessor (Program& program, Module& graph, heart::ProcessorInstance& instance)
+    {
+        if (instance.arraySize < 2 || instance.arraySize > Type::maxVectorSize
+             || instance.hasClockMultiplier() || instance.hasClockDivider())
+            return {};
+
+        auto processor = program.getModuleWithName (instance.sourceName);
+
+        if (processor == nullptr || ! processor->isProcessor() || countInstancesOf (program, *processor) != 1)
+            return {};
+
+        if (areEndpointsSuitable (*processor) && areStateVariablesSuitable (*processor)
+             && areFunctionsSuitable (*processor) && areConnectionsSuitable (program, graph, instance, *processor))
+            return processor;
+
+        return {};
+    }
+
+    static size_t countInstancesOf (Program& program, const Module& processor)
+    {
+        size_t count = 0;
+
+        for (auto& m : program.getModules())
+            for (auto& i : m->processorInstances)
+                if (i->sourceName == processor.fullName)
+                    ++count;
+
+        return count;
+    }
+
+    static bool isLaneType (const Type& type)
+    {
+        return type.isPrimitive() && ! (type.isReference() || type.isBool() || type.isVoid());
+    }
+
+    static bool areEndpointsSuitable (const Module& processor)
+    {
+        for (auto& i : processor.inputs)
+            if (i->arraySize.has_value() || i->dataTypes.size() != 1 || i->isValueEndpoint()
+                 || (i->isStreamEndpoint() && ! isLaneType (i->getFrameType())))
+                return false;
+
+        for (auto& o : processor.outputs)
+            if (! o->isStreamEndpoint() || o->arraySize.has_value() || ! isLaneType (o->getFrameType()))
+                return false;
+
+        return true;
+    }
+
+    static bool areStateVariablesSuitable (const Module& processor)
+    {
+        // Annotated state, e.g. a voice idle flag or a block profile counter, is looked up
+        // by name for each instance, so has to stay as it is
+        for (auto& v : processor.stateVariables)
+            if (v->isExternal() || ! v->annotation.isEmpty() || ! isLaneType (v->type))
+                return false;
+
+        return true;
+    }
+
+    //==============================================================================
+    static bool areFunctionsSuitable (const Module& processor)
+    {
+        auto run = processor.findRunFunction();
+
+        if (run == nullptr)
+            return false;
+
+        for (auto& f : processor.functions)
+        {
+            if (f == run || f->functionType.isSystemInit())
+            {
+                if (! canBeWidened (processor, f))
+                    return false;
+            }
+            else if (! (f->functionType.isEvent() && canBeSplitIntoLanes (processor, f)))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    static bool canBeWidened (const Module& processor, heart::Function& f)
+    {
+        if (! (f.parameters.empty() && f.returnType.isVoid()))
+            return false;
+
+        for (auto& b : f.blocks)
+        {
+            if (! b->parameters.empty())
+                return false;
+
+            if (auto branch = cast<heart::Branch> (b->terminator))
+            {
+                if (branch->isParameterised())
+                    return false;
+            }
+            else if (! is_type<heart::ReturnVoid> (b->terminator))
+            {
+                return false;
+            }
+
+            for (auto s : b->statements)
+                if (! canBeWidened (processor, *s))
+                    return false;
+        }
+
+        return true;
+    }
+
+    static bool canBeWidened (const Module& processor, heart::Statement& s)
+    {
+        if (auto a = cast<heart::AssignFromValue> (s))
+            return isLaneVariable (*a->target) && canBeWidened (a->source);
+
+        if (auto r = cast<heart::ReadStream> (s))
+            return isLaneVariable (*r->target);
+
+        if (auto w = cast<heart::WriteStream> (s))
+            return w->element == nullptr && canBeWidened (w->value);
+
+        if (auto call = cast<heart::FunctionCall> (s))
+        {
+            if (! isLaneSafeCall (processor, call->getFunction())
+                 || (call->target != nullptr && ! isLaneVariable (*call->target)))
+                return false;
+
+            for (auto& arg : call->arguments)
+                if (! canBeWidened (arg))
+                    return false;
+
+            return true;
+        }
+
+        return is_type<heart::AdvanceClock> (s);
+    }
+
+    static bool isLaneVariable (heart::Expression& e)
+    {
+        if (auto v = cast<heart::Variable> (e))
+            return isLaneType (v->type) && (v->isFunctionLocal() || (v->isState() && ! v->isExternal()));
+
+        return false;
+    }
+
+    static bool canBeWidened (heart::Expression& e)
+    {
+        if (is_type<heart::Variable> (e))
+            return isLaneVariable (e);
+
+        if (auto c = cast<heart::Constant> (e))
+            return isLaneType (c->getType().removeConstIfPresent());
+
+        if (auto p = cast<heart::ProcessorProperty> (e))
+            return p->property != heart::ProcessorProperty::Property::id && isLaneType (p->getType());
+
+        if (auto b = cast<heart::BinaryOperator> (e))
+        {
+            auto op = b->operation;
+            auto type = b->lhs->getType().removeConstIfPresent();
+
+            return (op == BinaryOp::Op::add || op == BinaryOp::Op::subtract || op == BinaryOp::Op::multiply
+                     || (op == BinaryOp::Op::divide && type.isFloatingPoint()))
+                    && type.isIdentical (b->rhs->getType().removeConstIfPresent())
+                    && canBeWidened (b->lhs) && canBeWidened (b->rhs);
+        }
+
+        if (auto u = cast<heart::UnaryOperator> (e))
+            return u->operation == UnaryOp::Op::negate && canBeWidened (u->source);
+
+        if (auto t = cast<heart::TypeCast> (e))
+            return isLaneType (t->destType.removeConstIfPresent()) && canBeWidened (t->source);
+
+        return false;
+    }
+
+    /** An event handler runs for one lane at a time, so it mustn't do anything that would
+        involve the others, or that a packed processor couldn't do for a single lane.
+    */
+    static bool canBeSplitIntoLanes (const Module& processor, heart::Function& handler)
+    {
+        if (handler.parameters.size() != 1)
+            return false;
+
+        auto input = findInputForHandler (processor, handler);
+
+        if (input == nullptr
+             || processor.findFunction (heart::getEventFunctionName (input->name.toString(), PrimitiveType::int32)) != nullptr)
+            return false;
+
+        bool suitable = true;
+
+        handler.visitAllStatements ([&] (heart::Statement& s)
+        {
+            if (is_type<heart::ReadStream> (s) || is_type<heart::WriteStream> (s) || is_type<heart::AdvanceClock> (s))
+                suitable = false;
+
+            if (auto call = cast<heart::FunctionCall> (s))
+                if (! isLaneSafeCall (processor, call->getFunction()))
+                    suitable = false;
+        });
+
+        handler.visitExpressions ([&] (pool_ref<heart::Expression>& e, AccessType)
+        {
+            if (auto p = cast<heart::ProcessorProperty> (e))
+                if (p->property == heart::ProcessorProperty::Property::id)
+                    suitable = false;
+
+            if (auto call = cast<heart::PureFunctionCall> (e))
+                if (! isLaneSafeCall (processor, call->function))
+                    suitable = false;
+        });
+
+        return suitable;
+    }
+
+    /** Functions from outside the processor can't see its state, unless it's passed to them
+        by reference, which a single lane can't be.
+    */
+    static bool isLaneSafeCall (const Module& processor, const heart::Function& function)
+    {
+        for (auto& f : processor.functions)
+            if (f == function)
+                return false;
+
+        for (auto& p : function.parameters)
+            if (p->type.isReference())
+                return false;
+
+        return true;
+    }
+
+    static pool_ptr<heart::InputDeclaration> findInputForHandler (const Module& processor, const heart::Function& handler)
+    {
+        for (auto& i : processor.inputs)
+            if (i->isEventEndpoint() && handler.name.toString() == heart::getEventFunctionName (i->name.toString(), i->dataTypes.front()))
+                return i;
+
+        return {};
+    }
+
+    //==============================================================================
+    /** Returns how many separate sources the graph will treat a connection as coming from,
+        or 0 if the elements it passes on can't be worked out from this graph alone.
+    */
+    static uint32_t getNumSources (Program& program, const Module& graph, const heart::Connection& c)
+    {
+        if (c.sourceProcessor == nullptr)
+        {
+            // An enclosing graph could pass along one element of an array at a time
+            if (program.getMainProcessor() != std::addressof (graph))
+                return 0;
+
+            auto input = graph.findInput (c.sourceEndpoint);
+            return input != nullptr && ! input->arraySize.has_value() ? 1 : 0;
+        }
+
+        auto source = program.getModuleWithName (c.sourceProcessor->sourceName);
+
+        if (source == nullptr || ! source->isProcessor())
+            return 0;
+
+        auto output = source->findOutput (c.sourceEndpoint);
+
+        if (output == nullptr)
+            return 0;
+
+        if (output->arraySize.has_value() && ! c.sourceEndpointIndex.has_value())
+            return c.sourceProcessor->arraySize * *output->arraySize;
+
+        return c.sourceProcessor->arraySize;
+    }
+
+    static uint32_t getNumDestinations (Program& program, const Module& graph, const heart::Connection& c)
+    {
+        pool_ptr<heart::IODeclaration> endpoint;
+        uint32_t count = 1;
+
+        if (c.destProcessor == nullptr)
+        {
+            endpoint = graph.findOutput (c.destEndpoint);
+        }
+        else if (auto dest = program.getModuleWithName (c.destProcessor->sourceName))
+        {
+            endpoint = dest->findInput (c.destEndpoint);
+            count = c.destProcessor->arraySize;
+        }
+
+        if (endpoint == nullptr)
+            return 0;
+
+        if (endpoint->arraySize.has_value() && ! c.destEndpointIndex.has_value())
+            return count * *endpoint->arraySize;
+
+        return count;
+    }
+
+    static bool areConnectionsSuitable (Program& program, const Module& graph,
+                                        heart::ProcessorInstance& instance, const Module& processor)
+    {
+        for (auto& c : graph.connections)
+        {
+            if (c->destProcessor == instance)
+            {
+                auto input = processor.findInput (c->destEndpoint);
+
+                if (input == nullptr || c->destEndpointIndex.has_value())
+                    return false;
+
+                // Streams are only shared between the lanes, but events can also be sent
+                // to each lane from a matching array of sources
+                auto numSources = getNumSources (program, graph, c);
+
+                if (! (numSources == 1 || (input->isEventEndpoint() && numSources == instance.arraySize)))
+                    return false;
+            }
+
+            if (c->sourceProcessor == instance)
+                if (c->sourceEndpointIndex.has_value() || getNumDestinations (program, graph, c) != 1)
+                    return false;
+        }
+
+        return true;
+    }
+
+    //==============================================================================
+    ProcessorArrayPacking (Module& p, heart::ProcessorInstance& i)
+        : processor (p), instance (i), numLanes (i.arraySize)
+    {
+    }
+
+    Module& processor;
+    heart::ProcessorInstance& instance;
+    const uint32_t numLanes;
+
+    void pack()
+    {
+        for (auto& v : processor.stateVariables)
+            v->type = getLaneVectorType (v->type);
+
+        widenFunction (processor.getRunFunction());
+
+        if (auto init = processor.findFunction (heart::getSystemInitFunctionName()))
+            widenFunction (*init);
+
+        for (auto& i : processor.inputs)
+            if (i->isEventEndpoint())
+                splitHandlerIntoLanes (i);
+
+        instance.arraySize = 1;
+    }
+
+    Type getLaneVectorType (const Type& type) const
+    {
+        auto vectorType = Type::createVector (type.getPrimitiveType(), numLanes);
+        return type.isConst() ? vectorType.createConst() : vectorType;
+    }
+
+    heart::Variable& createTemporary (const Type& type)
+    {
+        return processor.allocate<heart::Variable> (CodeLocation(), type.removeConstIfPresent(), heart::Variable::Role::constant);
+    }
+
+    heart::Expression& getLane (heart::Expression& vector, uint32_t lane)
+    {
+        return processor.allocate<heart::ArrayElement> (vector.location, vector, lane);
+    }
+
+    //==============================================================================
+    void widenFunction (heart::Function& f)
+    {
+        std::vector<pool_ref<heart::Variable>> locals;
+
+        f.visitExpressions ([&] (pool_ref<heart::Expression>& e, AccessType)
+        {
+            if (auto v = cast<heart::Variable> (e))
+                if (v->isFunctionLocal() && ! contains (locals, v))
+                    locals.push_back (*v);
+        });
+
+        for (auto& v : locals)
+            v->type = getLaneVectorType (v->type);
+
+        for (auto& b : f.blocks)
+        {
+            std::vector<pool_ref<heart::Statement>> oldStatements;
+
+            for (auto s : b->statements)
+                oldStatements.push_back (*s);
+
+            b->statements.clear();
+            LinkedList<heart::Statement>::Iterator last;
+
+            for (auto& s : oldStatements)
+                widenStatement (s, [&] (heart::Statement& newStatement) { last = b->statements.insertAfter (last, newStatement); });
+        }
+
+        f.flatBody.reset();
+    }
+
+    template <typename AddStatementFn>
+    void widenStatement (heart::Statement& s, AddStatementFn&& addStatement)
+    {
+        if (auto a = cast<heart::AssignFromValue> (s))
+        {
+            a->source = widen (a->source);
+            return addStatement (s);
+        }
+
+        if (auto r = cast<heart::ReadStream> (s))
+        {
+            // The stream is read once, and its frame is given to every lane
+            auto& target = *r->target;
+            auto& frame = createTemporary (r->source->getFrameType());
+            r->target = frame;
+            addStatement (s);
+            return addStatement (processor.allocate<heart::AssignFromValue> (r->location, target, broadcast (frame)));
+        }
+
+        if (auto w = cast<heart::WriteStream> (s))
+        {
+            auto& values = widen (w->value);
+            auto& lanes = createTemporary (values.getType());
+            addStatement (processor.allocate<heart::AssignFromValue> (w->location, lanes, values));
+
+            auto sum = std::addressof (getLane (lanes, 0));
+
+            for (uint32_t i = 1; i < numLanes; ++i)
+                sum = std::addressof (processor.allocate<heart::BinaryOperator> (w->location, *sum, getLane (lanes, i), BinaryOp::Op::add));
+
+            w->value = *sum;
+            return addStatement (s);
+        }
+
+        if (auto call = cast<heart::FunctionCall> (s))
+        {
+            // A function from outside the processor is called once for each lane
+            std::vector<pool_ptr<heart::Expression>> laneArguments;
+
+            for (auto& arg : call->arguments)
+            {
+                if (is_type<heart::Constant> (arg))
+                {
+                    laneArguments.push_back ({});
+                    continue;
+                }
+
+                auto& values = widen (arg);
+
+                if (is_type<heart::Variable> (values))
+                {
+                    laneArguments.push_back (values);
+                    continue;
+                }
+
+                auto& lanes = createTemporary (values.getType());
+                addStatement (processor.allocate<heart::AssignFromValue> (call->location, lanes, values));
+                laneArguments.push_back (lanes);
+            }
+
+            // A local has to be given a value before its lanes can be set one at a time
+            if (auto target = cast<heart::Variable> (call->target))
+            {
+                if (target->isFunctionLocal())
+                {
+                    target->role = heart::Variable::Role::mutableLocal;
+                    addStatement (processor.allocate<heart::AssignFromValue> (call->location, *target,
+                                                                             processor.allocator.allocateZeroInitialiser (target->type)));
+                }
+            }
+
+            for (uint32_t lane = 0; lane < numLanes; ++lane)
+            {
+                pool_ptr<heart::Expression> target;
+
+                if (call->target != nullptr)
+                    target = getLane (*call->target, lane);
+
+                auto& laneCall = processor.allocate<heart::FunctionCall> (call->location, target, call->function);
+
+                for (size_t i = 0; i < call->arguments.size(); ++i)
+                {
+                    if (auto c = cast<heart::Constant> (call->arguments[i]))
+                        laneCall.arguments.push_back (processor.allocator.allocateConstant (c->value));
+                    else
+                        laneCall.arguments.push_back (getLane (*laneArguments[i], lane));
+                }
+
+                addStatement (laneCall);
+            }
+
+            return;
+        }
+
+        addStatement (s);
+    }
+
+    heart::Expression& widen (heart::Expression& e)
+    {
+        if (is_type<heart::Variable> (e))
+            return e;
+
+        if (auto c = cast<heart::Constant> (e))
+            return processor.allocator.allocateConstant (c->value.castToTypeExpectingSuccess (getLaneVectorType (c->getType().removeConstIfPresent())));
+
+        if (is_type<heart::ProcessorProperty> (e))
+            return broadcast (e);
+
+        if (auto b = cast<heart::BinaryOperator> (e))
+            return processor.allocate<heart::BinaryOperator> (b->location, widen (b->lhs), widen (b->rhs), b->operation);
+
+        // Unary operators only take primitives, but multiplying by -1 negates every lane exactly
+        if (auto u = cast<heart::UnaryOperator> (e))
+        {
+            auto& source = widen (u->source);
+            auto minusOne = Value::createInt32 (-1).castToTypeExpectingSuccess (source.getType().removeConstIfPresent());
+            return processor.allocate<heart::BinaryOperator> (u->location, source, processor.allocator.allocateConstant (minusOne),
+                                                              BinaryOp::Op::multiply);
+        }
+
+        if (auto t = cast<heart::TypeCast> (e))
+            return processor.allocate<heart::TypeCast> (t->location, widen (t->source), getLaneVectorType (t->destType.removeConstIfPresent()));
+
+        SOUL_ASSERT_FALSE;
+        return e;
+    }
+
+    heart::Expression& broadcast (heart::Expression& e)
+    {
+        return processor.allocate<heart::TypeCast> (e.location, e, getLaneVectorType (e.getType().removeConstIfPresent()));
+    }
+
+    //==============================================================================
+    void splitHandlerIntoLanes (heart::InputDeclaration& input)
+    {
+        auto handler = processor.findFunction (heart::getEventFunctionName (input.name.toString(), input.dataTypes.front()));
+        input.arraySize = numLanes;
+
+        if (handler == nullptr)
+            return;
+
+        auto& lane = processor.allocate<heart::Variable> (handler->location, PrimitiveType::int32,
+                                                          processor.allocator.get ("_lane"), heart::Variable::Role::parameter);
+        handler->parameters.insert (handler->parameters.begin(), lane);
+        handler->name = processor.allocator.get (heart::getEventFunctionName (input.name.toString(), lane.type));
+
+        handler->visitExpressions ([&] (pool_ref<heart::Expression>& e, AccessType)
+        {
+            if (auto v = cast<heart::Variable> (e))
+                if (v->isState())
+                    e = processor.allocate<heart::ArrayElement> (v->location, *v, lane);
+        });
+
+        handler->flatBody.reset();
+    }
+};
+
+} // namespace soul
@@ -0,0 +1,649 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul
+{
+
+//==============================================================================
+/**
+    Merges pairs of processors that are joined by a plain stream connection into a single
+    processor, so that a chain like oscillator -> filter -> gain runs as one run() loop
+    with the value that used to travel along each connection held in a local variable,
+    rather than being written to one processor's output and copied into the next one's
+    input on every frame.
+
+    A connection is only fused if it's a zero-delay, non-interpolated connection between
+    two single processor instances running at the graph's own rate, it's the only thing
+    attached to both of its endpoints, and it's the only route from the source to the
+    destination. Each processor's run() must contain exactly one advance() and never return,
+    and neither may use processor.id, external variables or the annotations that change
+    how a processor gets built or run, and neither module may be used anywhere else.
+
+    The fused run() function runs the source processor's code up to its advance(), then the
+    destination's code up to its advance(), then advances once for both of them. The
+    destination's state variables, functions and endpoints are moved into the source's
+    module, and are renamed where their names would clash.
+*/
+struct ProcessorFusion
+{
+    /** The annotations given to the state variables that were moved out of a fused
+        processor, recording the instance and name they originally had.
+    */
+    static constexpr const char* instanceAnnotation = "fusedInstance";
+    static constexpr const char* nameAnnotation = "fusedName";
+
+    /** Fuses every connection that can be fused, and returns the names of the modules that
+        had other processors merged into them.
+    */
+    static std::vector<std::string> apply (Program& program)
+    {
+        // Unreachable blocks would get in the way of the checks on the run functions'
+        // advance() calls and return statements, so those are tidied up first
+        for (auto& m : program.getModules())
+            if (m->isProcessor())
+                if (auto run = m->findRunFunction())
+                    Optimisations::optimiseFunctionBlocks (*run, program.getAllocator());
+
+        std::vector<std::string> fusedModules;
+
+        for (;;)
+        {
+            bool anyFused = false;
+
+            for (auto& m : program.getModules())
+            {
+                if (m->isGraph())
+                {
+                    if (auto source = fuseNextConnection (program, m))
+                    {
+                        if (! contains (fusedModules, source->fullName))
+                            fusedModules.push_back (source->fullName);
+
+                        anyFused = true;
+                        break;
+                    }
+                }
+            }
+
+            if (! anyFused)
+                return fusedModules;
+        }
+    }
+
+private:
+    //==============================================================================
+    static pool_ptr<Module> fuseNextConnection (Program& program, Module& graph)
+    {
+        for (auto& c : graph.connections)
+        {
+            if (canFuse (program, graph, c))
+            {
+                auto& source = *program.getModuleWithName (c->sourceProcessor->sourceName);
+                auto& dest = *program.getModuleWithName (c->destProcessor->sourceName);
+                ProcessorFusion (program, graph, c, source, dest).fuse();
+                return source;
+            }
+        }
+
+        return {};
+    }
+
+    static bool canFuse (Program& program, Module& graph, heart::Connection& c)
+    {
+        auto sourceInstance = c.sourceProcessor;
+        auto destInstance = c.destProcessor;
+
+        if (sourceInstance == nullptr || destInstance == nullptr || sourceInstance == destInstance)
+            return false;
+
+        if (c.delayLength != 0 || c.interpolationType != InterpolationType::none
+             || c.sourceEndpointIndex.has_value() || c.destEndpointIndex.has_value())
+            return false;
+
+        for (auto i : { sourceInstance, destInstance })
+            if (i->arraySize != 1 || i->hasClockMultiplier() || i->hasClockDivider())
+                return false;
+
+        auto source = program.getModuleWithName (sourceInstance->sourceName);
+        auto dest = program.getModuleWithName (destInstance->sourceName);
+
+        if (source == nullptr || dest == nullptr || source == dest
+             || ! source->isProcessor() || ! dest->isProcessor()
+             || countInstancesOf (program, *source) != 1 || countInstancesOf (program, *dest) != 1)
+            return false;
+
+        auto output = source->findOutput (c.sourceEndpoint);
+        auto input = dest->findInput (c.destEndpoint);
+
+        if (output == nullptr || input == nullptr
+             || ! output->isStreamEndpoint() || ! input->isStreamEndpoint()
+             || output->arraySize.has_value() || input->arraySize.has_value()
+             || ! output->getFrameType().isIdentical (input->getFrameType()))
+            return false;
+
+        for (auto& other : graph.connections)
+        {
+            if (other == c)
+                continue;
+
+            if ((other->sourceProcessor == sourceInstance && other->sourceEndpoint == c.sourceEndpoint)
+                 || (other->destProcessor == destInstance && other->destEndpoint == c.destEndpoint)
+                 || (other->sourceProcessor == sourceInstance && other->destProcessor == destInstance)
+                 || (other->sourceProcessor == destInstance && other->destProcessor == sourceInstance))
+                return false;
+        }
+
+        return ! isReachableWithout (graph, *sourceInstance, *destInstance, c)
+                && isSuitableForFusion (*source, *output, true)
+                && isSuitableForFusion (*dest, *output, false)
+                && ! haveClashingStructs (*source, *dest);
+    }
+
+    static size_t countInstancesOf (Program& program, const Module& processor)
+    {
+        size_t count = 0;
+
+        for (auto& m : program.getModules())
+            for (auto& i : m->processorInstances)
+                if (i->sourceName == processor.fullName)
+                    ++count;
+
+        return count;
+    }
+
+    /** Checks whether there's any path from the source to the destination other than the
+        connection being fused, because if there is, the processors in between would have
+        to run in the middle of the fused one.
+    */
+    static bool isReachableWithout (Module& graph, heart::ProcessorInstance& source,
+                                    heart::ProcessorInstance& dest, heart::Connection& excluded)
+    {
+        std::vector<const heart::ProcessorInstance*> visited, toVisit { std::addressof (source) };
+
+        while (! toVisit.empty())
+        {
+            auto instance = toVisit.back();
+            toVisit.pop_back();
+
+            if (contains (visited, instance))
+                continue;
+
+            visited.push_back (instance);
+
+            for (auto& c : graph.connections)
+            {
+                if (c == excluded || c->sourceProcessor != instance || c->destProcessor == nullptr)
+                    continue;
+
+                if (c->destProcessor == dest)
+                    return true;
+
+                toVisit.push_back (c->destProcessor.get());
+            }
+        }
+
+        return false;
+    }
+
+    static bool isSuitableForFusion (Module& m, heart::OutputDeclaration& link, bool isSource)
+    {
+        if (m.annotation.hasValue ("reducedPrecision") || m.annotation.hasValue ("silenceTail"))
+            return false;
+
+        // A voice idle flag would end up gating the other processor as well
+        for (auto& v : m.stateVariables)
+            if (v->isExternal() || v->annotation.hasValue ("voiceIdle"))
+                return false;
+
+        auto run = m.findRunFunction();
+
+        if (run == nullptr)
+            return false;
+
+        bool suitable = true;
+        int numAdvanceCalls = 0;
+
+        for (auto& f : m.functions)
+        {
+            for (auto& b : f->blocks)
+            {
+                if (f == run && b->terminator != nullptr && b->terminator->isReturn())
+                    suitable = false;
+
+                for (auto s : b->statements)
+                {
+                    if (is_type<heart::AdvanceClock> (*s))
+                    {
+                        if (f != run)
+                            suitable = false;
+
+                        ++numAdvanceCalls;
+                    }
+
+                    // The link's writes get turned into additions, which can only be done
+                    // if they already have the right type
+                    if (isSource)
+                        if (auto w = cast<heart::WriteStream> (*s))
+                            if (w->target == link && ! w->value->getType().isIdentical (link.getFrameType()))
+                                suitable = false;
+                }
+
+                b->visitExpressions ([&] (pool_ref<heart::Expression>& e, AccessType)
+                {
+                    if (auto p = cast<heart::ProcessorProperty> (e))
+                        if (p->property == heart::ProcessorProperty::Property::id)
+                            suitable = false;
+                });
+            }
+        }
+
+        return suitable && numAdvanceCalls == 1;
+    }
+
+    static bool haveClashingStructs (const Module& source, const Module& dest)
+    {
+        for (auto& s : dest.structs)
+            if (source.findStruct (s->getName()) != nullptr)
+                return true;
+
+        return false;
+    }
+
+    //==============================================================================
+    ProcessorFusion (Program& p, Module& g, heart::Connection& c, Module& s, Module& d)
+        : program (p), graph (g), link (c), source (s), dest (d),
+          sourceInstance (*c.sourceProcessor), destInstance (*c.destProcessor),
+          linkOutput (*s.findOutput (c.sourceEndpoint)), linkInput (*d.findInput (c.destEndpoint)),
+          prefix (c.destProcessor->instanceName + "_")
+    {
+    }
+
+    Program& program;
+    Module& graph;
+    heart::Connection& link;
+    Module& source;
+    Module& dest;
+    heart::ProcessorInstance& sourceInstance;
+    heart::ProcessorInstance& destInstance;
+    heart::OutputDeclaration& linkOutput;
+    heart::InputDeclaration& linkInput;
+    const std::string prefix;
+    std::unordered_map<std::string, std::string> renamedEndpoints;
+
+    void fuse()
+    {
+        auto& sourceRun = source.getRunFunction();
+        auto& destRun = dest.getRunFunction();
+
+        moveEndpoints();
+        moveStateVariables();
+        moveStructs();
+        moveFunctions (destRun);
+        mergeRunFunctions (sourceRun, destRun);
+        rewireGraph();
+
+        program.removeModule (dest);
+        source.rebuildBlockPredecessors();
+    }
+
+    //==============================================================================
+    template <typename IsUsedFn>
+    std::string makeUniqueName (const std::string& name, IsUsedFn&& isUsed)
+    {
+        if (! isUsed (name))
+            return name;
+
+        return addSuffixToMakeUnique (prefix + name, isUsed);
+    }
+
+    bool isEndpointNameUsed (const std::string& name) const
+    {
+        return source.findInput (name) != nullptr || source.findOutput (name) != nullptr;
+    }
+
+    void moveEndpoints()
+    {
+        removeFirst (source.outputs, [&] (heart::OutputDeclaration& o) { return std::addressof (o) == std::addressof (linkOutput); });
+
+        for (auto& i : dest.inputs)
+        {
+            if (i == linkInput)
+                continue;
+
+            auto oldName = i->name.toString();
+            auto newName = makeUniqueName (oldName, [this] (const std::string& nm) { return isEndpointNameUsed (nm); });
+
+            if (newName != oldName)
+            {
+                if (i->isEventEndpoint())
+                    renameEventHandlers (i, oldName, newName);
+
+                renamedEndpoints[oldName] = newName;
+                i->name = source.allocator.get (newName);
+            }
+
+            source.inputs.push_back (i);
+        }
+
+        for (auto& o : dest.outputs)
+        {
+            auto oldName = o->name.toString();
+            auto newName = makeUniqueName (oldName, [this] (const std::string& nm) { return isEndpointNameUsed (nm); });
+
+            if (newName != oldName)
+            {
+                renamedEndpoints[oldName] = newName;
+                o->name = source.allocator.get (newName);
+            }
+
+            source.outputs.push_back (o);
+        }
+
+        for (size_t i = 0; i < source.inputs.size(); ++i)
+            source.inputs[i]->index = static_cast<uint32_t> (i);
+
+        for (size_t i = 0; i < source.outputs.size(); ++i)
+            source.outputs[i]->index = static_cast<uint32_t> (i);
+    }
+
+    void renameEventHandlers (heart::InputDeclaration& input, const std::string& oldName, const std::string& newName)
+    {
+        for (auto& type : input.dataTypes)
+            if (auto f = dest.findFunction (heart::getEventFunctionName (oldName, type)))
+                f->name = dest.allocator.get (heart::getEventFunctionName (newName, type));
+    }
+
+    void moveStateVariables()
+    {
+        for (auto& v : dest.stateVariables)
+        {
+            if (! v->annotation.hasValue (instanceAnnotation))
+            {
+                v->annotation.set (instanceAnnotation, destInstance.instanceName);
+                v->annotation.set (nameAnnotation, v->name.toString());
+            }
+
+            auto newName = makeUniqueName (v->name.toString(), [this] (const std::string& nm) { return source.findStateVariable (nm) != nullptr; });
+            v->name = source.allocator.get (newName);
+            source.stateVariables.push_back (v);
+        }
+    }
+
+    void moveStructs()
+    {
+        for (auto& s : dest.structs)
+            source.structs.push_back (s);
+    }
+
+    void moveFunctions (heart::Function& destRun)
+    {
+        auto isFunctionNameUsed = [this] (const std::string& nm)
+        {
+            return source.findFunction (nm) != nullptr || dest.findFunction (nm) != nullptr;
+        };
+
+        auto sourceInit = source.findFunction (heart::getSystemInitFunctionName());
+        auto destInit = dest.findFunction (heart::getSystemInitFunctionName());
+
+        for (auto& f : dest.functions)
+        {
+            if (f == destRun)
+                continue;
+
+            // The destination's init functions become ordinary functions that the source's
+            // _soul_init calls, unless the source doesn't have one, in which case they can stay
+            if (sourceInit != nullptr && (f->functionType.isSystemInit() || f->functionType.isUserInit()))
+            {
+                f->functionType = heart::FunctionType::normal();
+                f->name = source.allocator.get (addSuffixToMakeUnique (prefix + "init", isFunctionNameUsed));
+            }
+            else if (source.findFunction (f->name) != nullptr)
+            {
+                f->name = source.allocator.get (makeUniqueName (f->name.toString(), isFunctionNameUsed));
+            }
+
+            source.functions.push_back (f);
+        }
+
+        if (sourceInit != nullptr && destInit != nullptr)
+            callBeforeReturning (*sourceInit, *destInit);
+    }
+
+    void callBeforeReturning (heart::Function& caller, heart::Function& callee)
+    {
+        for (auto& b : caller.blocks)
+        {
+            if (b->terminator != nullptr && b->terminator->isReturn())
+            {
+                BlockBuilder builder (source, b);
+                builder.addFunctionCall (callee, {});
+            }
+        }
+    }
+
+    //==============================================================================
+    void mergeRunFunctions (heart::Function& sourceRun, heart::Function& destRun)
+    {
+        renameLocals (sourceRun, destRun);
+
+        // The value that would have gone along the connection, which accumulates whatever the
+        // source writes during a frame, just like its output would have done
+        auto& linkValue = source.allocate<heart::Variable> (CodeLocation(), linkOutput.getFrameType(),
+                                                            source.allocator.get ("_fused_" + prefix + linkInput.name.toString()),
+                                                            heart::Variable::Role::mutableLocal);
+        auto& destStarted = source.allocate<heart::Variable> (CodeLocation(), Type (PrimitiveType::bool_),
+                                                              source.allocator.get ("_fused_" + prefix + "started"),
+                                                              heart::Variable::Role::mutableLocal);
+
+        replaceLinkReadsAndWrites (sourceRun, destRun, linkValue);
+
+        auto& sourceAdvance = splitAtAdvance (sourceRun, "@" + prefix + "source_resume");
+        auto& destAdvance = splitAtAdvance (destRun, "@" + prefix + "resume");
+        auto& sourceResume = sourceRun.blocks[indexOf (sourceRun, sourceAdvance) + 1].get();
+        auto& destResume = destRun.blocks[indexOf (destRun, destAdvance) + 1].get();
+        auto& destEntry = destRun.blocks.front().get();
+
+        auto& entry = heart::Utilities::insertBlock (source, sourceRun, 0, "@" + prefix + "fused_entry");
+        auto& dispatch = createBlock ("@" + prefix + "dispatch");
+        auto& start = createBlock ("@" + prefix + "start");
+        auto& advance = createBlock ("@" + prefix + "advance");
+
+        {
+            BlockBuilder builder (source, entry);
+            builder.addZeroAssignment (linkValue);
+            builder.addAssignment (destStarted, Value (false));
+            builder.setBranchTerminator (sourceRun.blocks[1]);
+        }
+
+        {
+            BlockBuilder builder (source, sourceAdvance);
+            builder.setBranchTerminator (dispatch);
+        }
+
+        {
+            BlockBuilder builder (source, dispatch);
+            builder.setBranchIfTerminator (destStarted, destResume, start);
+        }
+
+        {
+            BlockBuilder builder (source, start);
+            builder.addAssignment (destStarted, Value (true));
+            builder.setBranchTerminator (destEntry);
+        }
+
+        {
+            BlockBuilder builder (source, destAdvance);
+            builder.setBranchTerminator (advance);
+        }
+
+        {
+            BlockBuilder builder (source, advance);
+            builder.createStatement<heart::AdvanceClock> (CodeLocation());
+            builder.addZeroAssignment (linkValue);
+            builder.setBranchTerminator (sourceResume);
+        }
+
+        for (auto b : { std::addressof (dispatch), std::addressof (start) })
+            sourceRun.blocks.push_back (*b);
+
+        for (auto& b : destRun.blocks)
+            sourceRun.blocks.push_back (b);
+
+        sourceRun.blocks.push_back (advance);
+        sourceRun.rebuildBlockPredecessors();
+    }
+
+    heart::Block& createBlock (const std::string& name)
+    {
+        return source.allocate<heart::Block> (source.allocator.get (name));
+    }
+
+    static size_t indexOf (heart::Function& f, heart::Block& b)
+    {
+        for (size_t i = 0; i < f.blocks.size(); ++i)
+            if (f.blocks[i] == b)
+                return i;
+
+        SOUL_ASSERT_FALSE;
+        return 0;
+    }
+
+    /** Gives the destination's blocks and local variables names that can't clash with
+        the ones in the source's run function.
+    */
+    void renameLocals (heart::Function& sourceRun, heart::Function& destRun)
+    {
+        for (auto& b : destRun.blocks)
+        {
+            b->name = source.allocator.get (addSuffixToMakeUnique ("@" + prefix + b->name.toString().substr (1),
+                                                                   [&] (const std::string& nm) { return sourceRun.findBlockByName (nm) != nullptr; }));
+
+            for (auto& p : b->parameters)
+                renameLocal (p);
+
+            b->visitExpressions ([&] (pool_ref<heart::Expression>& e, AccessType)
+            {
+                if (auto v = cast<heart::Variable> (e))
+                    if (! (v->isState() || v->isParameter()))
+                        renameLocal (*v);
+            });
+        }
+    }
+
+    void renameLocal (heart::Variable& v)
+    {
+        if (v.name.isValid() && v.name.toString().find (prefix) != 0)
+            v.name = source.allocator.get (prefix + v.name.toString());
+    }
+
+    void replaceLinkReadsAndWrites (heart::Function& sourceRun, heart::Function& destRun, heart::Variable& linkValue)
+    {
+        for (auto& b : sourceRun.blocks)
+        {
+            b->statements.replaceMatches ([&] (heart::Statement& s) -> heart::Statement*
+            {
+                if (auto w = cast<heart::WriteStream> (s))
+                {
+                    if (w->target == linkOutput)
+                    {
+                        auto& sum = source.allocate<heart::BinaryOperator> (w->location, linkValue, w->value, BinaryOp::Op::add);
+                        return std::addressof (source.allocate<heart::AssignFromValue> (w->location, linkValue, sum));
+                    }
+                }
+
+                return nullptr;
+            });
+        }
+
+        for (auto& b : destRun.blocks)
+        {
+            b->statements.replaceMatches ([&] (heart::Statement& s) -> heart::Statement*
+            {
+                if (auto r = cast<heart::ReadStream> (s))
+                    if (r->source == linkInput)
+                        return std::addressof (source.allocate<heart::AssignFromValue> (r->location, *r->target, linkValue));
+
+                return nullptr;
+            });
+        }
+    }
+
+    /** Splits the block holding the function's only advance() into the part before it,
+        which is left without a terminator, and a new block holding the part after it.
+        Returns the first part.
+    */
+    heart::Block& splitAtAdvance (heart::Function& f, const std::string& resumeBlockName)
+    {
+        for (size_t i = 0; i < f.blocks.size(); ++i)
+        {
+            auto& b = f.blocks[i].get();
+
+            for (auto s : b.statements)
+            {
+                if (is_type<heart::AdvanceClock> (*s))
+                {
+                    auto name = addSuffixToMakeUnique (resumeBlockName, [&] (const std::string& nm) { return f.findBlockByName (nm) != nullptr; });
+                    auto& resume = heart::Utilities::splitBlock (source, f, i, b.statements.getPredecessor (*s), name);
+                    resume.statements.removeFront();
+                    b.terminator = nullptr;
+                    return b;
+                }
+            }
+        }
+
+        SOUL_ASSERT_FALSE;
+        return f.blocks.front();
+    }
+
+    //==============================================================================
+    void rewireGraph()
+    {
+        removeFirst (graph.connections, [&] (heart::Connection& c) { return std::addressof (c) == std::addressof (link); });
+
+        for (auto& c : graph.connections)
+        {
+            if (c->sourceProcessor == destInstance)
+            {
+                c->sourceProcessor = sourceInstance;
+                c->sourceEndpoint = getRenamedEndpoint (c->sourceEndpoint);
+            }
+
+            if (c->destProcessor == destInstance)
+            {
+                c->destProcessor = sourceInstance;
+                c->destEndpoint = getRenamedEndpoint (c->destEndpoint);
+            }
+        }
+
+        removeFirst (graph.processorInstances, [&] (heart::ProcessorInstance& i) { return std::addressof (i) == std::addressof (destInstance); });
+    }
+
+    Identifier getRenamedEndpoint (Identifier name)
+    {
+        auto found = renamedEndpoints.find (name.toString());
+
+        if (found != renamedEndpoints.end())
+            return graph.allocator.get (found->second);
+
+        return name;
+    }
+};
+
+} // namespace soul
@@ -0,0 +1,251 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul
+{
+
+/** Combines several programs into a single one whose main processor is a graph that runs
+    each of them in turn. This lets a host which chains together a set of patches link them
+    all into one performer, rather than needing a performer for each of them and copying
+    the audio between them on every block.
+
+    Each program is copied into a namespace named after its stage, and its main processor
+    becomes a node in the new graph. The stream outputs of each stage are connected to the
+    stream inputs of the next one in the order that they're declared, for as many as both
+    of them have.
+
+    The first stage's stream inputs and the last stage's stream outputs become the graph's
+    stream inputs and outputs, keeping their names. Every other endpoint which isn't connected,
+    including the event and value inputs that are used for parameters, is also exposed by the
+    graph, with the stage name as a prefix, e.g. "reverb_roomSize". External variables are
+    moved into the stage's namespace, e.g. "reverb::Reverb::impulse", and the console outputs
+    of all the stages are merged into a single one.
+*/
+struct ProgramChain
+{
+    /** Builds the chain. Each stage is given the name at the same index in stageNames, but if
+        a name is missing, isn't a valid identifier, or has already been used, a new one is made.
+        If the programs can't be combined, this returns an empty program and adds an error to
+        the list.
+    */
+    static Program create (CompileMessageList& messageList, const std::vector<Program>& programs,
+                           const std::vector<std::string>& stageNames)
+    {
+        try
+        {
+            CompileMessageHandler handler (messageList);
+            ProgramChain chain (programs, stageNames);
+            return chain.build();
+        }
+        catch (AbortCompilationException) {}
+
+        return {};
+    }
+
+    static constexpr const char* graphName = "_chain";
+
+private:
+    ProgramChain (const std::vector<Program>& p, const std::vector<std::string>& names) : programs (p)
+    {
+        for (size_t i = 0; i < programs.size(); ++i)
+        {
+            auto name = i < names.size() ? makeSafeIdentifierName (names[i]) : std::string();
+
+            if (name.empty() || name == graphName || contains (stageNames, name))
+                name = "stage" + std::to_string (i);
+
+            while (contains (stageNames, name))
+                name += "_";
+
+            stageNames.push_back (name);
+        }
+    }
+
+    const std::vector<Program>& programs;
+    std::vector<std::string> stageNames;
+    Program result;
+    pool_ptr<Module> graph;
+
+    Program build()
+    {
+        if (programs.empty())
+            throwError (Errors::emptyProgram());
+
+        graph = result.addGraph();
+        graph->shortName = graphName;
+        graph->fullName = TokenisedPathString::join (Program::getRootNamespaceName(), graphName);
+        graph->originalFullName = graphName;
+        graph->annotation.set ("main", true);
+
+        std::vector<pool_ref<Module>> stages;
+
+        for (size_t i = 0; i < programs.size(); ++i)
+        {
+            auto& stage = result.addCopyOfProgram (programs[i], stageNames[i]);
+
+            if (! (stage.isProcessor() || stage.isGraph()))
+                throwError (Errors::cannotFindMainProcessor());
+
+            auto& node = graph->allocate<heart::ProcessorInstance>();
+            node.instanceName = stageNames[i];
+            node.sourceName = stage.fullName;
+            graph->processorInstances.push_back (node);
+            stages.push_back (stage);
+        }
+
+        for (size_t i = 0; i < stages.size(); ++i)
+        {
+            auto node = graph->processorInstances[i];
+            auto isFirstStage = i == 0;
+            auto isLastStage = i == stages.size() - 1;
+            auto streamInputs = getStreams (stages[i]->inputs);
+            auto streamOutputs = getStreams (stages[i]->outputs);
+            size_t numInputsConnected = 0, numOutputsConnected = 0;
+
+            if (! isFirstStage)
+            {
+                auto previousOutputs = getStreams (stages[i - 1]->outputs);
+                numInputsConnected = std::min (streamInputs.size(), previousOutputs.size());
+
+                for (size_t j = 0; j < numInputsConnected; ++j)
+                    addConnection (graph->processorInstances[i - 1], previousOutputs[j]->name, node, streamInputs[j]->name);
+            }
+
+            if (! isLastStage)
+                numOutputsConnected = std::min (streamOutputs.size(), getStreams (stages[i + 1]->inputs).size());
+
+            for (auto& input : stages[i]->inputs)
+            {
+                if (isConnected (streamInputs, input, numInputsConnected))
+                    continue;
+
+                auto keepName = isFirstStage && input->isStreamEndpoint();
+                auto& graphInput = addInput (input, keepName ? input->name.toString() : stageNames[i] + "_" + input->name.toString());
+                addConnection ({}, graphInput.name, node, input->name);
+            }
+
+            for (auto& output : stages[i]->outputs)
+            {
+                if (isConnected (streamOutputs, output, numOutputsConnected))
+                    continue;
+
+                if (output->isConsoleEndpoint())
+                {
+                    addConnection (node, output->name, {}, getConsoleOutput (output).name);
+                    continue;
+                }
+
+                auto keepName = isLastStage && output->isStreamEndpoint();
+                auto& graphOutput = addOutput (output, keepName ? output->name.toString() : stageNames[i] + "_" + output->name.toString());
+                addConnection (node, output->name, {}, graphOutput.name);
+            }
+        }
+
+        heart::Checker::sanityCheckInputsAndOutputs (result);
+        heart::Checker::checkConnections (result);
+        return result;
+    }
+
+    template <typename IOList>
+    static IOList getStreams (const IOList& endpoints)
+    {
+        IOList result;
+
+        for (auto& e : endpoints)
+            if (e->isStreamEndpoint())
+                result.push_back (e);
+
+        return result;
+    }
+
+    /** Returns true if the endpoint is one of the first numConnected items in the list of streams. */
+    template <typename IOList, typename IODeclaration>
+    static bool isConnected (const IOList& streams, const IODeclaration& endpoint, size_t numConnected)
+    {
+        for (size_t i = 0; i < numConnected; ++i)
+            if (streams[i] == endpoint)
+                return true;
+
+        return false;
+    }
+
+    void checkNameIsFree (const std::string& name) const
+    {
+        if (graph->findInput (name) != nullptr || graph->findOutput (name) != nullptr)
+            throwError (Errors::nameInUse (name));
+    }
+
+    template <typename IODeclaration>
+    void copyDeclaration (IODeclaration& io, const heart::IODeclaration& source, const std::string& name, uint32_t index)
+    {
+        io.name = result.getAllocator().get (name);
+        io.index = index;
+        io.endpointType = source.endpointType;
+        io.dataTypes = source.dataTypes;
+        io.annotation = source.annotation;
+        io.arraySize = source.arraySize;
+    }
+
+    heart::InputDeclaration& addInput (const heart::InputDeclaration& source, const std::string& name)
+    {
+        checkNameIsFree (name);
+        auto& input = graph->allocate<heart::InputDeclaration> (source.location);
+        copyDeclaration (input, source, name, (uint32_t) graph->inputs.size());
+        graph->inputs.push_back (input);
+        return input;
+    }
+
+    heart::OutputDeclaration& addOutput (const heart::OutputDeclaration& source, const std::string& name)
+    {
+        checkNameIsFree (name);
+        auto& output = graph->allocate<heart::OutputDeclaration> (source.location);
+        copyDeclaration (output, source, name, (uint32_t) graph->outputs.size());
+        graph->outputs.push_back (output);
+        return output;
+    }
+
+    heart::OutputDeclaration& getConsoleOutput (const heart::OutputDeclaration& source)
+    {
+        if (auto existing = graph->findOutput (source.name.toString()))
+        {
+            for (auto& type : source.dataTypes)
+                if (! std::any_of (existing->dataTypes.begin(), existing->dataTypes.end(),
+                                   [&] (const Type& t) { return t.isIdentical (type); }))
+                    existing->dataTypes.push_back (type);
+
+            return *existing;
+        }
+
+        return addOutput (source, source.name.toString());
+    }
+
+    void addConnection (pool_ptr<heart::ProcessorInstance> source, Identifier sourceEndpoint,
+                        pool_ptr<heart::ProcessorInstance> dest, Identifier destEndpoint)
+    {
+        auto& c = graph->allocate<heart::Connection> (CodeLocation());
+        c.sourceProcessor = source;
+        c.sourceEndpoint = result.getAllocator().get (sourceEndpoint.toString());
+        c.destProcessor = dest;
+        c.destEndpoint = result.getAllocator().get (destEndpoint.toString());
+        graph->connections.push_back (c);
+    }
+};
+
+} // namespace soul
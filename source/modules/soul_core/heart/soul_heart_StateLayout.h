@@ -0,0 +1,215 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul
+{
+
+//==============================================================================
+/**
+    Re-orders the state variables of each processor so that the ones which are used on every
+    frame are packed together, rather than being scattered between big arrays in the order in
+    which they were declared. Back-ends lay out a processor's state in the order of its
+    stateVariables list, so this keeps the per-frame working set small enough to stay in the cache.
+
+    The variables are split into three regions:
+     - The "hot" ones which are used by run() or the functions that it calls. These are sorted
+       so that the ones with the largest alignment come first, which lets vectors be loaded with
+       aligned SIMD instructions without any padding, and then by how often they're used.
+     - Any other small variables, which are only used by event handlers or init().
+     - Arrays and other variables which are bigger than largeVariableSize. Even if a delay line
+       or a table is read on every frame, only a few of its elements will be touched at a time,
+       so it's kept out of the way of everything else.
+*/
+struct StateLayout
+{
+    static void apply (Program& program)
+    {
+        for (auto& m : program.getModules())
+            if (m->isProcessor() && m->stateVariables.size() > 1)
+                StateLayout (m).reorderStateVariables();
+    }
+
+    static constexpr size_t largeVariableSize = 4096;
+
+private:
+    StateLayout (Module& m) : module (m) {}
+
+    using UseCounts = std::unordered_map<const heart::Variable*, uint64_t>;
+
+    Module& module;
+    std::unordered_map<const heart::Function*, UseCounts> functionUseCounts;
+
+    static constexpr uint64_t loopWeight = 8;
+    static constexpr uint32_t maxLoopDepth = 4;
+    static constexpr uint64_t maxUseCount = std::numeric_limits<uint64_t>::max();
+
+    //==============================================================================
+    void reorderStateVariables()
+    {
+        UseCounts useCounts;
+
+        if (auto run = module.findRunFunction())
+            useCounts = getUseCounts (*run);
+
+        struct Item
+        {
+            pool_ref<heart::Variable> variable;
+            int region;
+            size_t alignment;
+            uint64_t useCount;
+            size_t originalIndex;
+        };
+
+        std::vector<Item> items;
+        items.reserve (module.stateVariables.size());
+
+        for (auto& v : module.stateVariables)
+        {
+            auto found = useCounts.find (v.getPointer());
+            auto useCount = found != useCounts.end() ? found->second : 0;
+            auto region = v->type.getPackedSizeInBytes() > largeVariableSize ? 2 : (useCount != 0 ? 0 : 1);
+
+            items.push_back ({ v, region, getAlignment (v->type), useCount, items.size() });
+        }
+
+        std::sort (items.begin(), items.end(), [] (const Item& a, const Item& b)
+        {
+            if (a.region != b.region)          return a.region < b.region;
+            if (a.region == 2)                 return a.originalIndex < b.originalIndex;
+            if (a.alignment != b.alignment)    return a.alignment > b.alignment;
+            if (a.useCount != b.useCount)      return a.useCount > b.useCount;
+
+            return a.originalIndex < b.originalIndex;
+        });
+
+        for (size_t i = 0; i < items.size(); ++i)
+            module.stateVariables[i] = items[i].variable;
+    }
+
+    /** Returns the natural alignment of a type, as a back-end would lay it out. */
+    static size_t getAlignment (const Type& type)
+    {
+        if (type.isFixedSizeArray())
+            return getAlignment (type.getElementType());
+
+        if (type.isStruct())
+        {
+            size_t alignment = 1;
+
+            for (auto& m : type.getStructRef().getMembers())
+                alignment = std::max (alignment, getAlignment (m.type));
+
+            return alignment;
+        }
+
+        size_t alignment = 1;
+
+        while (alignment < type.getPackedSizeInBytes() && alignment < 64)
+            alignment *= 2;
+
+        return alignment;
+    }
+
+    //==============================================================================
+    /** Counts the number of times that each state variable is used by a function and the functions
+        that it calls, with uses inside loops counted several times over.
+    */
+    const UseCounts& getUseCounts (heart::Function& f)
+    {
+        auto found = functionUseCounts.find (std::addressof (f));
+
+        if (found != functionUseCounts.end())
+            return found->second;
+
+        // A placeholder stops a recursive call from looping forever
+        functionUseCounts[std::addressof (f)] = {};
+
+        UseCounts counts;
+        auto blockWeights = getBlockWeights (f);
+
+        for (auto& b : f.blocks)
+        {
+            auto weight = blockWeights[b.getPointer()];
+
+            b->visitExpressions ([&] (pool_ref<heart::Expression>& value, AccessType)
+            {
+                if (auto v = cast<heart::Variable> (value))
+                    if (v->isState())
+                        counts[v.get()] += weight;
+
+                if (auto call = cast<heart::PureFunctionCall> (value))
+                    addCallee (counts, call->function, weight);
+            });
+
+            for (auto s : b->statements)
+                if (auto call = cast<heart::FunctionCall> (*s))
+                    addCallee (counts, call->getFunction(), weight);
+        }
+
+        return functionUseCounts[std::addressof (f)] = std::move (counts);
+    }
+
+    void addCallee (UseCounts& counts, heart::Function& callee, uint64_t weight)
+    {
+        if (callee.hasNoBody || ! contains (module.functions, callee))
+            return;
+
+        for (auto& c : getUseCounts (callee))
+        {
+            auto& total = counts[c.first];
+            auto uses = c.second > maxUseCount / weight ? maxUseCount : c.second * weight;
+            total = uses > maxUseCount - total ? maxUseCount : total + uses;
+        }
+    }
+
+    /** Gives each block a weight which grows with the number of loops that it's inside. Loops which
+        call advance() are the ones that run once per frame, so they don't count.
+    */
+    static std::unordered_map<const heart::Block*, uint64_t> getBlockWeights (heart::Function& f)
+    {
+        std::unordered_map<const heart::Block*, uint64_t> weights;
+        std::unordered_map<const heart::Block*, uint32_t> depths;
+
+        f.rebuildBlockPredecessors();
+
+        for (auto& loop : CallFlowGraph::findLoops (f))
+        {
+            if (std::any_of (loop.blocks.begin(), loop.blocks.end(), [] (const pool_ref<heart::Block>& b) { return heart::Utilities::doesBlockCallAdvance (b); }))
+                continue;
+
+            for (auto& b : loop.blocks)
+                ++depths[b.getPointer()];
+        }
+
+        for (auto& b : f.blocks)
+        {
+            uint64_t weight = 1;
+
+            for (uint32_t i = 0; i < std::min (depths[b.getPointer()], maxLoopDepth); ++i)
+                weight *= loopWeight;
+
+            weights[b.getPointer()] = weight;
+        }
+
+        return weights;
+    }
+};
+
+} // namespace soul
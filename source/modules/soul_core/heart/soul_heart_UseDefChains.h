@@ -0,0 +1,145 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul
+{
+
+//==============================================================================
+/**
+    For each variable used in a function, this holds the list of statements which write
+    to it (its definitions) and the statements or terminators which read it (its uses).
+
+    The chains are built with one scan of the function, and after that a pass can keep
+    them up to date as it removes statements, rather than rescanning to recount things.
+    A statement or terminator appears in a list once for each time it accesses the variable.
+*/
+struct heart::UseDefChains
+{
+    UseDefChains (Function& f)
+    {
+        for (auto b : f.blocks)
+        {
+            for (auto s : b->statements)
+            {
+                auto& statement = *s;
+
+                statement.visitExpressions ([&] (pool_ref<Expression>& value, AccessType mode)
+                {
+                    if (auto v = cast<Variable> (value))
+                        addAccess (*v, statement, mode);
+                });
+            }
+
+            if (auto t = b->terminator)
+            {
+                t->visitExpressions ([&] (pool_ref<Expression>& value, AccessType)
+                {
+                    if (auto v = cast<Variable> (value))
+                        chains[v.get()].uses.push_back (t.get());
+                });
+            }
+        }
+    }
+
+    struct Chain
+    {
+        std::vector<Statement*> definitions;
+        std::vector<Object*> uses;
+    };
+
+    const Chain* find (Variable& v) const
+    {
+        auto found = chains.find (std::addressof (v));
+        return found != chains.end() ? std::addressof (found->second) : nullptr;
+    }
+
+    uint32_t getNumReads (Variable& v) const
+    {
+        auto c = find (v);
+        return c != nullptr ? static_cast<uint32_t> (c->uses.size()) : 0;
+    }
+
+    uint32_t getNumWrites (Variable& v) const
+    {
+        auto c = find (v);
+        return c != nullptr ? static_cast<uint32_t> (c->definitions.size()) : 0;
+    }
+
+    /** Calls the visitor for each variable that's accessed in the function. */
+    template <typename Visitor>
+    void visitVariables (Visitor&& visit) const
+    {
+        for (auto& c : chains)
+            visit (*c.first, c.second);
+    }
+
+    /** Removes a statement's accesses from the chains. This doesn't take it out of its block,
+        which is left for the caller to do. The callback is given each variable which the
+        statement read, after its uses have been updated, so that a caller can spot any that
+        are no longer read.
+    */
+    template <typename VariableCallback>
+    void removeStatement (Statement& s, VariableCallback&& variableNoLongerReadBy)
+    {
+        std::vector<Variable*> variablesRead;
+
+        s.visitExpressions ([&] (pool_ref<Expression>& value, AccessType mode)
+        {
+            if (auto v = cast<Variable> (value))
+            {
+                auto& c = chains[v.get()];
+
+                if (mode != AccessType::write)
+                {
+                    removeFirst (c.uses, static_cast<Object*> (std::addressof (s)));
+                    variablesRead.push_back (v.get());
+                }
+
+                if (mode != AccessType::read)
+                    removeFirst (c.definitions, std::addressof (s));
+            }
+        });
+
+        for (auto v : variablesRead)
+            variableNoLongerReadBy (*v);
+    }
+
+private:
+    std::unordered_map<Variable*, Chain> chains;
+
+    void addAccess (Variable& v, Statement& s, AccessType mode)
+    {
+        auto& c = chains[std::addressof (v)];
+
+        if (mode != AccessType::write)  c.uses.push_back (std::addressof (s));
+        if (mode != AccessType::read)   c.definitions.push_back (std::addressof (s));
+    }
+
+    template <typename Item>
+    static void removeFirst (std::vector<Item*>& list, Item* item)
+    {
+        auto i = std::find (list.begin(), list.end(), item);
+
+        if (i != list.end())
+            list.erase (i);
+    }
+};
+
+} // namespace soul
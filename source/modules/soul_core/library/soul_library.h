@@ -52,14 +52,30 @@ static inline const char* getSystemModuleCode (const std::string& moduleName)
         #include "soul_library_frequency.h"
         ;
 
+    if (moduleName == "soul.convolution") return
+        #include "soul_library_convolution.h"
+        ;
+
+    if (moduleName == "soul.wavetable") return
+        #include "soul_library_wavetable.h"
+        ;
+
     if (moduleName == "soul.mixing") return
         #include "soul_library_mixing.h"
         ;
 
+    if (moduleName == "soul.oversampling") return
+        #include "soul_library_oversampling.h"
+        ;
+
     if (moduleName == "soul.noise") return
         #include "soul_library_noise.h"
         ;
 
+    if (moduleName == "soul.delay") return
+        #include "soul_library_delay.h"
+        ;
+
     return nullptr;
 }
 
@@ -0,0 +1,159 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+R"library(
+
+/** This namespace contains processors which convolve a signal with an impulse response. */
+namespace soul::convolution
+{
+    /** Convolves a stream with an impulse response which is loaded from an external
+        variable, using a uniformly-partitioned FFT convolution.
+
+        The impulse response is split into partitions of blockSize frames, and each
+        block of input is transformed once and kept in a frequency-domain delay line,
+        so the work per block is one FFT and one inverse FFT of size (2 * blockSize),
+        plus one complex multiply-add per bin for each partition. This keeps the CPU
+        cost evenly spread across blocks, and the latency is blockSize frames.
+
+        The impulse response is read from the external "impulseResponse". As with any
+        external, its name in a patch's manifest is qualified by the processor's name,
+        i.e. "soul::convolution::UniformlyPartitioned::impulseResponse". Any part of it
+        beyond (blockSize * maxPartitions) frames is ignored. Its sample rate isn't
+        taken into account, so it should be recorded at the rate the processor will
+        run at.
+
+        blockSize must be a power of two. Each of the arrays which holds a set of
+        partitions is limited to the maximum size for a type (1MB), so
+        (blockSize + 1) * maxPartitions can't be more than about 260,000. For a long
+        impulse response, a larger blockSize allows more of it to be used, at the
+        expense of more latency.
+    */
+    processor UniformlyPartitioned (int blockSize, int maxPartitions)  [[ main: false ]]
+    {
+        input stream float in;
+        output stream float out;
+
+        external soul::audio_samples::Mono impulseResponse;
+
+        let numBins = blockSize + 1;
+
+        float[blockSize * 2] inputBlocks, transformBuffer;
+        float[blockSize] outputBlock;
+        float[numBins] binsReal, binsImag, sumReal, sumImag;
+
+        // The transformed partitions of the impulse response, and the transforms of
+        // the most recent input blocks, each stored as maxPartitions sets of bins
+        float[numBins * maxPartitions] responseReal, responseImag, historyReal, historyImag;
+
+        int numPartitions, newestBlock;
+
+        void run()
+        {
+            static_assert (blockSize > 1 && (blockSize & (blockSize - 1)) == 0, "The blockSize for soul::convolution::UniformlyPartitioned must be a power of 2");
+            static_assert (maxPartitions > 0, "The maxPartitions for soul::convolution::UniformlyPartitioned must be greater than zero");
+
+            prepareImpulseResponse();
+
+            loop
+            {
+                // While a block of input is collected, the output from the previous one is played
+                for (int i = 0; i < blockSize; ++i)
+                {
+                    inputBlocks.at (blockSize + i) = in;
+                    out << outputBlock.at (i);
+                    advance();
+                }
+
+                processBlock();
+            }
+        }
+
+        void prepareImpulseResponse()
+        {
+            let length = impulseResponse.frames.size;
+            numPartitions = clamp ((length + blockSize - 1) / blockSize, 1, maxPartitions);
+
+            for (int partition = 0; partition < numPartitions; ++partition)
+            {
+                let start = partition * blockSize;
+
+                for (int i = 0; i < blockSize; ++i)
+                {
+                    transformBuffer.at (i) = start + i < length ? impulseResponse.frames.at (start + i) : 0.0f;
+                    transformBuffer.at (blockSize + i) = 0.0f;
+                }
+
+                soul::DFT::forwardBins (transformBuffer, binsReal, binsImag);
+                let offset = partition * numBins;
+
+                for (int bin = 0; bin < numBins; ++bin)
+                {
+                    responseReal.at (offset + bin) = binsReal.at (bin);
+                    responseImag.at (offset + bin) = binsImag.at (bin);
+                }
+            }
+        }
+
+        void processBlock()
+        {
+            // The transform covers the previous block and the new one, and the second half of
+            // its circular convolution with each zero-padded partition is the linear result
+            soul::DFT::forwardBins (inputBlocks, binsReal, binsImag);
+
+            newestBlock = (newestBlock + 1) % numPartitions;
+            let newestOffset = newestBlock * numBins;
+
+            for (int bin = 0; bin < numBins; ++bin)
+            {
+                historyReal.at (newestOffset + bin) = binsReal.at (bin);
+                historyImag.at (newestOffset + bin) = binsImag.at (bin);
+                sumReal.at (bin) = 0.0f;
+                sumImag.at (bin) = 0.0f;
+            }
+
+            for (int partition = 0; partition < numPartitions; ++partition)
+            {
+                let historyOffset = ((newestBlock - partition + numPartitions) % numPartitions) * numBins;
+                let responseOffset = partition * numBins;
+
+                for (int bin = 0; bin < numBins; ++bin)
+                {
+                    let xr = historyReal.at (historyOffset + bin);
+                    let xi = historyImag.at (historyOffset + bin);
+                    let hr = responseReal.at (responseOffset + bin);
+                    let hi = responseImag.at (responseOffset + bin);
+
+                    sumReal.at (bin) += xr * hr - xi * hi;
+                    sumImag.at (bin) += xr * hi + xi * hr;
+                }
+            }
+
+            soul::DFT::inverseBins (sumReal, sumImag, transformBuffer);
+
+            for (int i = 0; i < blockSize; ++i)
+            {
+                outputBlock.at (i) = transformBuffer.at (blockSize + i);
+                inputBlocks.at (i) = inputBlocks.at (blockSize + i);
+            }
+        }
+    }
+}
+
+)library"
@@ -0,0 +1,178 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*  The following string literal forms part of a set of SOUL code chunks that form
+    the built-in library. (See the soul::getBuiltInLibraryCode() function)
+*/
+R"library(
+
+/**
+    This namespace contains functions for using an array as a ring buffer of delayed samples,
+    and a processor which uses them to make a variable-length delay.
+
+    The buffers must have a size which is a power of 2, so that a position can be wrapped
+    with a single bitwise-and, rather than the modulo that a wrap<> index needs for other
+    sizes. The write position is a plain int which you keep alongside the buffer, e.g.
+
+        float[4096] buffer;
+        int writePos;
+
+        ...
+        soul::delay::write (buffer, writePos, in);
+        out << soul::delay::readLinear (buffer, writePos, delayInFrames);
+
+    A delay of 0 reads the most recently written frame, so the longest possible delay is one
+    less than the size of the buffer. Each tap of a multi-tap delay is just another read,
+    and costs a couple of loads and a multiply-add at most.
+*/
+namespace soul::delay
+{
+    /** Writes a frame to a delay buffer and moves the write position on by one. */
+    void write<Buffer, SampleType> (Buffer& buffer, int& writePos, SampleType value)
+    {
+        static_assert (Buffer.isFixedSizeArray && (Buffer.size & (Buffer.size - 1)) == 0, "soul::delay::write() requires a fixed-size array whose size is a power of 2");
+
+        let mask = int (Buffer.size) - 1;
+        buffer.at (writePos & mask) = value;
+        writePos = (writePos + 1) & mask;
+    }
+
+    /** Returns the frame that was written a whole number of frames before the most recent one. */
+    Buffer.elementType read<Buffer> (const Buffer& buffer, int writePos, int delay)
+    {
+        static_assert (Buffer.isFixedSizeArray && (Buffer.size & (Buffer.size - 1)) == 0, "soul::delay::read() requires a fixed-size array whose size is a power of 2");
+
+        return buffer.at ((writePos - 1 - delay) & (int (Buffer.size) - 1));
+    }
+
+    /** Returns a linearly-interpolated frame from a fractional number of frames before the most
+        recent one. The delay must be at least 0, and less than the size of the buffer minus 1.
+    */
+    Buffer.elementType readLinear<Buffer> (const Buffer& buffer, int writePos, float delay)
+    {
+        static_assert (Buffer.isFixedSizeArray && (Buffer.size & (Buffer.size - 1)) == 0, "soul::delay::readLinear() requires a fixed-size array whose size is a power of 2");
+
+        let mask = int (Buffer.size) - 1;
+        let wholeFrames = int (delay);
+        let fraction = Buffer.elementType (delay - float (wholeFrames));
+        let newer = buffer.at ((writePos - 1 - wholeFrames) & mask);
+        let older = buffer.at ((writePos - 2 - wholeFrames) & mask);
+
+        return newer + (older - newer) * fraction;
+    }
+
+    /** Returns a frame from a fractional number of frames before the most recent one, using 4-point
+        Hermite interpolation. This is smoother than linear interpolation for a delay which is being
+        modulated, as in a chorus or flanger. The delay must be at least 1, and less than the size
+        of the buffer minus 2.
+    */
+    Buffer.elementType readCubic<Buffer> (const Buffer& buffer, int writePos, float delay)
+    {
+        static_assert (Buffer.isFixedSizeArray && (Buffer.size & (Buffer.size - 1)) == 0, "soul::delay::readCubic() requires a fixed-size array whose size is a power of 2");
+
+        let mask = int (Buffer.size) - 1;
+        let wholeFrames = int (delay);
+        let fraction = Buffer.elementType (delay - float (wholeFrames));
+        let start = writePos - wholeFrames;
+
+        let x0 = buffer.at (start & mask);
+        let x1 = buffer.at ((start - 1) & mask);
+        let x2 = buffer.at ((start - 2) & mask);
+        let x3 = buffer.at ((start - 3) & mask);
+
+        let half = Buffer.elementType (0.5f);
+        let c1 = half * (x2 - x0);
+        let c2 = x0 - Buffer.elementType (2.5f) * x1 + Buffer.elementType (2.0f) * x2 - half * x3;
+        let c3 = half * (x3 - x0) + Buffer.elementType (1.5f) * (x1 - x2);
+
+        return ((c3 * fraction + c2) * fraction + c1) * fraction + x1;
+    }
+
+    /** Writes an array of frames to a delay buffer and moves the write position on by its size. */
+    void writeBlock<Buffer, Block> (Buffer& buffer, int& writePos, const Block& block)
+    {
+        static_assert (Buffer.isFixedSizeArray && (Buffer.size & (Buffer.size - 1)) == 0, "soul::delay::writeBlock() requires a fixed-size array whose size is a power of 2");
+        static_assert (Block.isFixedSizeArray && Block.size <= Buffer.size, "soul::delay::writeBlock() requires a fixed-size block which is no bigger than the buffer");
+
+        let mask = int (Buffer.size) - 1;
+
+        for (int i = 0; i < int (Block.size); ++i)
+            buffer.at ((writePos + i) & mask) = block.at (i);
+
+        writePos = (writePos + int (Block.size)) & mask;
+    }
+
+    /** Fills an array with the frames that were written a whole number of frames before the last
+        array's worth, so that after calling writeBlock(), a delay of 0 reads back the same block.
+    */
+    void readBlock<Buffer, Block> (const Buffer& buffer, int writePos, int delay, Block& block)
+    {
+        static_assert (Buffer.isFixedSizeArray && (Buffer.size & (Buffer.size - 1)) == 0, "soul::delay::readBlock() requires a fixed-size array whose size is a power of 2");
+        static_assert (Block.isFixedSizeArray && Block.size <= Buffer.size, "soul::delay::readBlock() requires a fixed-size block which is no bigger than the buffer");
+
+        let mask = int (Buffer.size) - 1;
+        let start = writePos - delay - int (Block.size);
+
+        for (int i = 0; i < int (Block.size); ++i)
+            block.at (i) = buffer.at ((start + i) & mask);
+    }
+
+    /** A delay line whose length in frames is set by the last event sent to delayFramesIn, and can
+        be any fractional value from 0 to maxDelayFrames. The buffer is rounded up to the next power
+        of 2 frames.
+    */
+    processor Delay (using SampleType, int maxDelayFrames)  [[ main: false ]]
+    {
+        input  stream SampleType in;
+        output stream SampleType out;
+        input  event float delayFramesIn;
+
+        // The smallest power of 2 that holds maxDelayFrames plus the extra frame needed for interpolation
+        let sizeBits0 = maxDelayFrames + 1;
+        let sizeBits1 = sizeBits0 | (sizeBits0 >> 1);
+        let sizeBits2 = sizeBits1 | (sizeBits1 >> 2);
+        let sizeBits3 = sizeBits2 | (sizeBits2 >> 4);
+        let sizeBits4 = sizeBits3 | (sizeBits3 >> 8);
+        let bufferSize = (sizeBits4 | (sizeBits4 >> 16)) + 1;
+
+        SampleType[bufferSize] buffer;
+        int writePos;
+        float delayFrames;
+
+        event delayFramesIn (float newDelay)
+        {
+            delayFrames = clamp (newDelay, 0.0f, float (maxDelayFrames));
+        }
+
+        void run()
+        {
+            static_assert (maxDelayFrames > 0 && maxDelayFrames < (1 << 30), "The maxDelayFrames for soul::delay::Delay must be between 1 and 2^30");
+
+            loop
+            {
+                write (buffer, writePos, in);
+                out << readLinear (buffer, writePos, delayFrames);
+                advance();
+            }
+        }
+    }
+}
+
+)library"
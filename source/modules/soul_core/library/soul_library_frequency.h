@@ -20,7 +20,13 @@
 
 R"library(
 
-/** Discrete Fourier Transform functions. */
+/** Discrete Fourier Transform functions.
+
+    For buffers whose size is a power of two, forward() and inverse() use an O(N log N)
+    real FFT, which is done with a complex FFT of half the size. Other sizes fall back to
+    an O(N^2) DFT. forwardBins() and inverseBins() use the same method, but work with the
+    spectrum as a conventional list of complex bins.
+*/
 namespace soul::DFT
 {
     /** Performs a real forward DFT from an input buffer to an output buffer. */
@@ -30,12 +36,55 @@ namespace soul::DFT
         static_assert (SampleBuffer.elementType.isFloat && SampleBuffer.elementType.isPrimitive, "The element type for DFT::forward() must be floating point");
         let harmonics = inputData.size / 2;
 
-        SampleBuffer inputImag, outputReal, outputImag;
+        if const (SampleBuffer.size >= 4 && (SampleBuffer.size & (SampleBuffer.size - 1)) == 0)
+        {
+            // Packs the even and odd samples into the real and imaginary parts of a half-size
+            // complex FFT, then separates their spectra and combines them into the result
+            let halfSize = int (harmonics);
+            SampleBuffer.elementType[SampleBuffer.size / 2] real, imag;
+
+            for (int i = 0; i < halfSize; ++i)
+            {
+                real.at (i) = inputData.at (i * 2);
+                imag.at (i) = inputData.at (i * 2 + 1);
+            }
+
+            performFFT (real, imag, false);
+
+            let angle = -pi / halfSize;
+            let stepReal = cos (angle);
+            let stepImag = sin (angle);
+            let scale = 1.0 / halfSize;
+            float64 twiddleReal = 1.0, twiddleImag = 0.0;
+
+            for (int k = 0; k < halfSize; ++k)
+            {
+                let j = (halfSize - k) & (halfSize - 1);
+                let evenReal = 0.5 * (real.at (k) + real.at (j));
+                let evenImag = 0.5 * (imag.at (k) - imag.at (j));
+                let oddReal  = 0.5 * (imag.at (k) + imag.at (j));
+                let oddImag  = 0.5 * (real.at (j) - real.at (k));
+
+                let binReal = evenReal + twiddleReal * oddReal - twiddleImag * oddImag;
+                let binImag = evenImag + twiddleReal * oddImag + twiddleImag * oddReal;
 
-        performComplex (inputData, inputImag, outputReal, outputImag, 1.0f / float (harmonics));
+                outputData.at (k)            = SampleBuffer.elementType (-binImag * scale);
+                outputData.at (halfSize + k) = SampleBuffer.elementType (-binReal * scale);
 
-        outputData[0:harmonics]             = outputReal[0:harmonics];
-        outputData[harmonics:harmonics * 2] = outputImag[0:harmonics];
+                let nextReal = twiddleReal * stepReal - twiddleImag * stepImag;
+                twiddleImag  = twiddleReal * stepImag + twiddleImag * stepReal;
+                twiddleReal  = nextReal;
+            }
+        }
+        else
+        {
+            SampleBuffer inputImag, outputReal, outputImag;
+
+            performComplex (inputData, inputImag, outputReal, outputImag, 1.0f / float (harmonics));
+
+            outputData[0:harmonics]             = outputReal[0:harmonics];
+            outputData[harmonics:harmonics * 2] = outputImag[0:harmonics];
+        }
     }
 
     /** Performs a real inverse DFT from an input buffer to an output buffer. */
@@ -45,12 +94,227 @@ namespace soul::DFT
         static_assert (SampleBuffer.elementType.isFloat && SampleBuffer.elementType.isPrimitive, "The element type for DFT::inverse() must be floating point");
         let harmonics = inputData.size / 2;
 
-        SampleBuffer inputReal, inputImag, outputReal;
+        if const (SampleBuffer.size >= 4 && (SampleBuffer.size & (SampleBuffer.size - 1)) == 0)
+        {
+            // The even and odd output samples are the real parts of two half-size transforms,
+            // so each spectrum is made conjugate-symmetric (which makes its transform real),
+            // and they're done together as the real and imaginary parts of one complex FFT
+            let halfSize = int (harmonics);
+            SampleBuffer.elementType[SampleBuffer.size / 2] real, imag;
+
+            let angle = pi / halfSize;
+            let stepReal = cos (angle);
+            let stepImag = sin (angle);
+            float64 twiddleReal = 1.0, twiddleImag = 0.0;
+
+            for (int k = 0; k < halfSize; ++k)
+            {
+                let j = (halfSize - k) & (halfSize - 1);
+
+                // the twiddle factor for bin j is the twiddle for bin k reflected about the imaginary axis
+                let jTwiddleReal = k == 0 ? 1.0 : -twiddleReal;
+                let jTwiddleImag = twiddleImag;
+
+                let evenReal = 0.5 * (inputData.at (halfSize + k) + inputData.at (halfSize + j));
+                let evenImag = 0.5 * (inputData.at (k) - inputData.at (j));
+
+                let kOddReal = twiddleReal * inputData.at (halfSize + k) - twiddleImag * inputData.at (k);
+                let kOddImag = twiddleReal * inputData.at (k) + twiddleImag * inputData.at (halfSize + k);
+                let jOddReal = jTwiddleReal * inputData.at (halfSize + j) - jTwiddleImag * inputData.at (j);
+                let jOddImag = jTwiddleReal * inputData.at (j) + jTwiddleImag * inputData.at (halfSize + j);
+
+                let oddReal = 0.5 * (kOddReal + jOddReal);
+                let oddImag = 0.5 * (kOddImag - jOddImag);
+
+                real.at (k) = SampleBuffer.elementType (evenReal - oddImag);
+                imag.at (k) = SampleBuffer.elementType (evenImag + oddReal);
+
+                let nextReal = twiddleReal * stepReal - twiddleImag * stepImag;
+                twiddleImag  = twiddleReal * stepImag + twiddleImag * stepReal;
+                twiddleReal  = nextReal;
+            }
+
+            performFFT (real, imag, true);
+
+            for (int i = 0; i < halfSize; ++i)
+            {
+                outputData.at (i * 2)     = -real.at (i);
+                outputData.at (i * 2 + 1) = -imag.at (i);
+            }
+        }
+        else
+        {
+            SampleBuffer inputReal, inputImag, outputReal;
+
+            inputReal[0:harmonics] = inputData[harmonics:harmonics * 2];
+            inputImag[0:harmonics] = inputData[0:harmonics];
+
+            performComplex (inputReal, inputImag, outputReal, outputData, 1.0f);
+        }
+    }
+
+    /** Performs an unscaled real forward FFT of a buffer whose size is a power of two,
+        writing the (size / 2 + 1) complex bins from DC to Nyquist into a pair of buffers.
+        Unlike forward(), the bins are in the conventional order and form, so they can be
+        multiplied together to perform convolution.
+    */
+    void forwardBins<SampleBuffer, BinBuffer> (const SampleBuffer& inputData, BinBuffer& outputReal, BinBuffer& outputImag)
+    {
+        static_assert (SampleBuffer.isFixedSizeArray && BinBuffer.isFixedSizeArray, "The buffers for DFT::forwardBins() must be fixed size arrays");
+        static_assert (SampleBuffer.size >= 4 && (SampleBuffer.size & (SampleBuffer.size - 1)) == 0, "The size of the input for DFT::forwardBins() must be a power of 2");
+        static_assert (BinBuffer.size == SampleBuffer.size / 2 + 1, "The bin buffers for DFT::forwardBins() must be half the input size plus one");
+        let halfSize = int (SampleBuffer.size / 2);
+
+        SampleBuffer.elementType[SampleBuffer.size / 2] real, imag;
+
+        for (int i = 0; i < halfSize; ++i)
+        {
+            real.at (i) = inputData.at (i * 2);
+            imag.at (i) = inputData.at (i * 2 + 1);
+        }
+
+        performFFT (real, imag, false);
+
+        let angle = -pi / halfSize;
+        let stepReal = cos (angle);
+        let stepImag = sin (angle);
+        float64 twiddleReal = 1.0, twiddleImag = 0.0;
+
+        for (int k = 0; k <= halfSize; ++k)
+        {
+            let i = k & (halfSize - 1);
+            let j = (halfSize - k) & (halfSize - 1);
+            let evenReal = 0.5 * (real.at (i) + real.at (j));
+            let evenImag = 0.5 * (imag.at (i) - imag.at (j));
+            let oddReal  = 0.5 * (imag.at (i) + imag.at (j));
+            let oddImag  = 0.5 * (real.at (j) - real.at (i));
+
+            outputReal.at (k) = BinBuffer.elementType (evenReal + twiddleReal * oddReal - twiddleImag * oddImag);
+            outputImag.at (k) = BinBuffer.elementType (evenImag + twiddleReal * oddImag + twiddleImag * oddReal);
+
+            let nextReal = twiddleReal * stepReal - twiddleImag * stepImag;
+            twiddleImag  = twiddleReal * stepImag + twiddleImag * stepReal;
+            twiddleReal  = nextReal;
+        }
+    }
+
+    /** Performs the inverse of forwardBins(), converting (size / 2 + 1) complex bins back to
+        a real buffer, and scaling the result by 1 / size.
+    */
+    void inverseBins<BinBuffer, SampleBuffer> (const BinBuffer& inputReal, const BinBuffer& inputImag, SampleBuffer& outputData)
+    {
+        static_assert (SampleBuffer.isFixedSizeArray && BinBuffer.isFixedSizeArray, "The buffers for DFT::inverseBins() must be fixed size arrays");
+        static_assert (SampleBuffer.size >= 4 && (SampleBuffer.size & (SampleBuffer.size - 1)) == 0, "The size of the output for DFT::inverseBins() must be a power of 2");
+        static_assert (BinBuffer.size == SampleBuffer.size / 2 + 1, "The bin buffers for DFT::inverseBins() must be half the output size plus one");
+        let halfSize = int (SampleBuffer.size / 2);
+
+        SampleBuffer.elementType[SampleBuffer.size / 2] real, imag;
+
+        let angle = pi / halfSize;
+        let stepReal = cos (angle);
+        let stepImag = sin (angle);
+        float64 twiddleReal = 1.0, twiddleImag = 0.0;
+
+        // Rebuilds the spectra of the even and odd samples, and puts them into the real and
+        // imaginary parts of a half-size complex inverse FFT
+        for (int k = 0; k < halfSize; ++k)
+        {
+            let j = halfSize - k;
+            let evenReal = 0.5 * (inputReal.at (k) + inputReal.at (j));
+            let evenImag = 0.5 * (inputImag.at (k) - inputImag.at (j));
+            let diffReal = 0.5 * (inputReal.at (k) - inputReal.at (j));
+            let diffImag = 0.5 * (inputImag.at (k) + inputImag.at (j));
+            let oddReal  = twiddleReal * diffReal - twiddleImag * diffImag;
+            let oddImag  = twiddleReal * diffImag + twiddleImag * diffReal;
+
+            real.at (k) = SampleBuffer.elementType (evenReal - oddImag);
+            imag.at (k) = SampleBuffer.elementType (evenImag + oddReal);
+
+            let nextReal = twiddleReal * stepReal - twiddleImag * stepImag;
+            twiddleImag  = twiddleReal * stepImag + twiddleImag * stepReal;
+            twiddleReal  = nextReal;
+        }
+
+        performFFT (real, imag, true);
+
+        let scale = SampleBuffer.elementType (1.0 / halfSize);
+
+        for (int i = 0; i < halfSize; ++i)
+        {
+            outputData.at (i * 2)     = real.at (i) * scale;
+            outputData.at (i * 2 + 1) = imag.at (i) * scale;
+        }
+    }
+
+    /** Performs an unscaled in-place complex FFT on a pair of buffers holding the real and
+        imaginary parts of the data, whose size must be a power of two.
+        A forward transform uses a negative exponent, and an inverse one a positive exponent.
+
+        The "fft" intrinsic annotation allows a performer to replace this with a native
+        implementation.
+    */
+    void performFFT<SampleBuffer> (SampleBuffer& real, SampleBuffer& imag, bool isInverse)  [[intrin: "fft"]]
+    {
+        static_assert (SampleBuffer.isFixedSizeArray, "The buffers for DFT::performFFT() must be fixed size arrays");
+        static_assert ((SampleBuffer.size & (SampleBuffer.size - 1)) == 0, "The size of the buffers for DFT::performFFT() must be a power of 2");
+        let size = int (SampleBuffer.size);
+
+        // bit-reversed reordering
+        int j = 0;
+
+        for (int i = 1; i < size; ++i)
+        {
+            var bit = size >> 1;
+
+            while ((j & bit) != 0)
+            {
+                j = j ^ bit;
+                bit = bit >> 1;
+            }
+
+            j = j ^ bit;
 
-        inputReal[0:harmonics] = inputData[harmonics:harmonics * 2];
-        inputImag[0:harmonics] = inputData[0:harmonics];
+            if (i < j)
+            {
+                let tempReal = real.at (i);
+                let tempImag = imag.at (i);
+                real.at (i) = real.at (j);
+                imag.at (i) = imag.at (j);
+                real.at (j) = tempReal;
+                imag.at (j) = tempImag;
+            }
+        }
 
-        performComplex (inputReal, inputImag, outputReal, outputData, 1.0f);
+        // Each pass only needs one sin and cos, as the twiddle factors are generated by
+        // rotating the previous one
+        for (int halfLength = 1; halfLength < size; halfLength = halfLength * 2)
+        {
+            let angle = isInverse ? pi / halfLength : -pi / halfLength;
+            let stepReal = cos (angle);
+            let stepImag = sin (angle);
+            float64 twiddleReal = 1.0, twiddleImag = 0.0;
+
+            for (int k = 0; k < halfLength; ++k)
+            {
+                for (int start = 0; start < size; start += halfLength * 2)
+                {
+                    let a = start + k;
+                    let b = a + halfLength;
+
+                    let productReal = twiddleReal * real.at (b) - twiddleImag * imag.at (b);
+                    let productImag = twiddleReal * imag.at (b) + twiddleImag * real.at (b);
+
+                    real.at (b) = SampleBuffer.elementType (real.at (a) - productReal);
+                    imag.at (b) = SampleBuffer.elementType (imag.at (a) - productImag);
+                    real.at (a) = SampleBuffer.elementType (real.at (a) + productReal);
+                    imag.at (a) = SampleBuffer.elementType (imag.at (a) + productImag);
+                }
+
+                let nextReal = twiddleReal * stepReal - twiddleImag * stepImag;
+                twiddleImag  = twiddleReal * stepImag + twiddleImag * stepReal;
+                twiddleReal  = nextReal;
+            }
+        }
     }
 
     /** For internal use by the other functions: performs a O(N^2) complex DFT. */
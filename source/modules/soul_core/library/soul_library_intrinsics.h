@@ -70,6 +70,11 @@ namespace soul::intrinsics
     /** Returns the log 10 of a scalar floating point value. */
     T.removeReference log10<T>     (T n)                   [[intrin: "log10"]]     { static_assert (T.isScalar && T.primitiveType.isFloat, "log10() only works with scalar floating point types");     return T(); }
 
+    /** Returns (a * b) + c for floating point scalars or vectors. A back-end may perform this as a
+        fused multiply-add, in which case the result is only rounded once.
+    */
+    T.removeReference fma<T>       (T a, T b, T c)         [[intrin: "fma"]]       { static_assert (T.isScalar && T.primitiveType.isFloat, "fma() only works with floating point scalar or vector types"); return a * b + c; }
+
     /** Rounds a floating point number up or down to the nearest integer. */
     int32 roundToInt (float32 n)    [[intrin: "roundToInt"]]                       { return int32 (n + (n < 0 ? -0.5f : 0.5f)); }
     /** Rounds a floating point number up or down to the nearest integer. */
@@ -100,7 +105,7 @@ namespace soul::intrinsics
     }
 
     /** Returns the sum of an array or vector of scalar values. */
-    T.elementType sum<T> (T t)
+    T.elementType sum<T> (T t)  [[intrin: "sum"]]
     {
         static_assert (T.isArray || T.isVector, "sum() only works with arrays or vectors");
         static_assert (T.elementType.isScalar, "sum() only works with arrays of scalar values");
@@ -162,7 +167,7 @@ namespace soul::intrinsics
     }
 
     /** Returns the product of an array or vector of scalar values. */
-    T.elementType product<T> (T t)
+    T.elementType product<T> (T t)  [[intrin: "product"]]
     {
         static_assert (T.isArray || T.isVector, "product() only works with arrays or vectors");
         static_assert (T.elementType.isScalar, "product() only works with arrays of scalar values");
@@ -223,6 +228,197 @@ namespace soul::intrinsics
         }
     }
 
+    /** Returns the dot product of two arrays or vectors of scalar values, which must be the same size. */
+    T.elementType dot<T> (T a, T b)  [[intrin: "dot"]]
+    {
+        static_assert (T.isArray || T.isVector, "dot() only works with arrays or vectors");
+        static_assert (T.elementType.isScalar, "dot() only works with arrays of scalar values");
+
+        if const (T.isVector)
+        {
+            return sum (a * b);
+        }
+        else if const (T.isFixedSizeArray)
+        {
+            var total = T.elementType();
+            wrap<a.size> i;
+
+            loop (a.size)
+            {
+                total += a[i] * b[i];
+                ++i;
+            }
+
+            return total;
+        }
+        else
+        {
+            var total = T.elementType();
+
+            for (int i = 0; i < a.size; ++i)
+                total += a[i] * b[i];
+
+            return total;
+        }
+    }
+
+    /** Returns the sum of the squares of the elements in an array or vector of scalar values. */
+    T.elementType sumOfSquares<T> (T t)  [[intrin: "sumOfSquares"]]
+    {
+        static_assert (T.isArray || T.isVector, "sumOfSquares() only works with arrays or vectors");
+        static_assert (T.elementType.isScalar, "sumOfSquares() only works with arrays of scalar values");
+
+        return dot (t, t);
+    }
+
+    /** Returns the smallest element in an array or vector of scalar values. */
+    T.elementType minElement<T> (T t)  [[intrin: "minElement"]]
+    {
+        static_assert (T.isArray || T.isVector, "minElement() only works with arrays or vectors");
+        static_assert (T.elementType.isScalar, "minElement() only works with arrays of scalar values");
+
+        if const (T.isFixedSizeArray || T.isVector)
+        {
+            var result = t[0];
+            wrap<t.size> i;
+
+            loop (t.size - 1)
+                result = min (result, t[++i]);
+
+            return result;
+        }
+        else
+        {
+            if (t.size == 0)
+                return T.elementType();
+
+            var result = t[0];
+
+            for (int i = 1; i < t.size; ++i)
+                result = min (result, t[i]);
+
+            return result;
+        }
+    }
+
+    /** Returns the largest element in an array or vector of scalar values. */
+    T.elementType maxElement<T> (T t)  [[intrin: "maxElement"]]
+    {
+        static_assert (T.isArray || T.isVector, "maxElement() only works with arrays or vectors");
+        static_assert (T.elementType.isScalar, "maxElement() only works with arrays of scalar values");
+
+        if const (T.isFixedSizeArray || T.isVector)
+        {
+            var result = t[0];
+            wrap<t.size> i;
+
+            loop (t.size - 1)
+                result = max (result, t[++i]);
+
+            return result;
+        }
+        else
+        {
+            if (t.size == 0)
+                return T.elementType();
+
+            var result = t[0];
+
+            for (int i = 1; i < t.size; ++i)
+                result = max (result, t[i]);
+
+            return result;
+        }
+    }
+
+    /** Returns the largest absolute value of the elements in an array or vector of scalar
+        values, e.g. the peak level of a block of samples.
+    */
+    T.elementType maxAbsElement<T> (T t)  [[intrin: "maxAbsElement"]]
+    {
+        static_assert (T.isArray || T.isVector, "maxAbsElement() only works with arrays or vectors");
+        static_assert (T.elementType.isScalar, "maxAbsElement() only works with arrays of scalar values");
+
+        if const (T.isFixedSizeArray || T.isVector)
+        {
+            var result = abs (t[0]);
+            wrap<t.size> i;
+
+            loop (t.size - 1)
+                result = max (result, abs (t[++i]));
+
+            return result;
+        }
+        else
+        {
+            var result = T.elementType();
+
+            for (int i = 0; i < t.size; ++i)
+                result = max (result, abs (t[i]));
+
+            return result;
+        }
+    }
+
+    /** Adds the element-wise product of two arrays or vectors to a third, i.e. dest[i] += a[i] * b[i].
+        All three must be the same size.
+    */
+    void multiplyAccumulate<T> (T& dest, T a, T b)  [[intrin: "multiplyAccumulate"]]
+    {
+        static_assert (T.isArray || T.isVector, "multiplyAccumulate() only works with arrays or vectors");
+        static_assert (T.elementType.isScalar, "multiplyAccumulate() only works with arrays of scalar values");
+
+        if const (T.isVector)
+        {
+            dest += a * b;
+        }
+        else if const (T.isFixedSizeArray)
+        {
+            wrap<dest.size> i;
+
+            loop (dest.size)
+            {
+                dest[i] += a[i] * b[i];
+                ++i;
+            }
+        }
+        else
+        {
+            for (int i = 0; i < dest.size; ++i)
+                dest[i] += a[i] * b[i];
+        }
+    }
+
+    /** Adds an array or vector multiplied by a scalar gain to another one of the same size,
+        i.e. dest[i] += source[i] * gain. This is the inner loop of a typical mixer.
+    */
+    void addScaled<T, GainType> (T& dest, T source, GainType gain)  [[intrin: "addScaled"]]
+    {
+        static_assert (T.isArray || T.isVector, "addScaled() only works with arrays or vectors");
+        static_assert (T.elementType.isScalar, "addScaled() only works with arrays of scalar values");
+        static_assert (GainType.isScalar, "The gain for addScaled() must be a scalar value");
+
+        if const (T.isVector)
+        {
+            dest += source * T.elementType (gain);
+        }
+        else if const (T.isFixedSizeArray)
+        {
+            wrap<dest.size> i;
+
+            loop (dest.size)
+            {
+                dest[i] += source[i] * T.elementType (gain);
+                ++i;
+            }
+        }
+        else
+        {
+            for (int i = 0; i < dest.size; ++i)
+                dest[i] += source[i] * T.elementType (gain);
+        }
+    }
+
     /** Reads an element from an array, allowing the index to be any type of floating point type.
         If a floating point index is used, it will be rounded down to an integer index - for an
         interpolated read operation, see readLinearInterpolated(). Indexes beyond the range of the
@@ -259,6 +455,59 @@ namespace soul::intrinsics
         return sample1 + (sample2 - sample1) * Array.elementType (index - IndexType (intIndex));
     }
 
+    /** Chooses between two scalars or vectors, element by element. Where the mask is true, the
+        result takes the element from a, and elsewhere it takes the one from b. The mask can be a
+        single bool, or a bool vector with the same size as the values.
+    */
+    T.removeReference select<MaskType, T> (MaskType mask, T a, T b)  [[intrin: "select"]]
+    {
+        static_assert (T.isScalar, "select() only works with scalar or vector values");
+        static_assert (MaskType.primitiveType.isBool, "The mask for select() must be a bool or bool vector");
+
+        if const (MaskType.isVector)
+        {
+            static_assert (T.isVector && MaskType.size == T.size, "The mask for select() must be the same size as the values");
+
+            var result = b;
+            wrap<a.size> i;
+
+            loop (a.size)
+            {
+                if (mask[i])
+                    result[i] = a[i];
+
+                ++i;
+            }
+
+            return result;
+        }
+        else
+        {
+            return mask ? a : b;
+        }
+    }
+
+    /** Rearranges the elements of a vector, so that element i of the result is the element of
+        the source at position indexes[i]. Indexes beyond the size of the vector are wrapped.
+    */
+    T.removeReference shuffle<T, IndexType> (T source, IndexType indexes)  [[intrin: "shuffle"]]
+    {
+        static_assert (T.isVector, "shuffle() only works with vectors");
+        static_assert (IndexType.isVector && IndexType.primitiveType.isInt, "The indexes for shuffle() must be an integer vector");
+        static_assert (IndexType.size == T.size, "The indexes for shuffle() must be the same size as the source vector");
+
+        var result = source;
+        wrap<source.size> i;
+
+        loop (source.size)
+        {
+            result[i] = source.at (indexes[i]);
+            ++i;
+        }
+
+        return result;
+    }
+
     // NB: this is used internally, not something you'd want to call from user code
     int get_array_size<Array> (const Array& array) [[intrin: "get_array_size"]];
 }
@@ -170,6 +170,105 @@ namespace soul::gain
     }
 }
 
+//==============================================================================
+/** Processors which smooth out the changes in a set of parameter values. */
+namespace soul::smoothing
+{
+    /** A new target value for one of the parameters of a SmoothedParameters processor. */
+    struct ParameterChange
+    {
+        int index;
+        float value;
+    }
+
+    //==============================================================================
+    /** Smooths a set of numParameters parameters, producing their values as the elements
+        of a vector stream.
+
+        Each change sent to parameterIn starts a linear ramp from the parameter's current
+        value to its new one, lasting rampSeconds. All the ramps are advanced together with
+        a single vector add, and once every parameter has reached its target, the processor
+        does nothing more per frame than write out the values. This makes it a lot cheaper
+        than having a separate smoothing processor for each parameter, when most of them
+        aren't moving most of the time.
+
+        Changes with an index which is out of range are ignored.
+    */
+    processor SmoothedParameters (int numParameters, float rampSeconds)  [[ main: false ]]
+    {
+        input event ParameterChange parameterIn;
+        output stream float<numParameters> out;
+
+        float<numParameters> currentValues, targetValues, increments;
+        int64[numParameters] rampEnds;
+        bool[numParameters] isParameterRamping;
+        int64 rampTime, nextRampEnd;
+        bool isRamping;
+
+        event parameterIn (ParameterChange change)
+        {
+            if (change.index >= 0 && change.index < numParameters)
+            {
+                let index = wrap<numParameters> (change.index);
+                let numFrames = max (1, int (rampSeconds * float (processor.frequency)));
+                let end = rampTime + numFrames;
+
+                targetValues.at (index) = change.value;
+                increments.at (index) = (change.value - currentValues.at (index)) / float (numFrames);
+                rampEnds[index] = end;
+                isParameterRamping[index] = true;
+
+                if (! isRamping || end < nextRampEnd)
+                    nextRampEnd = end;
+
+                isRamping = true;
+            }
+        }
+
+        void run()
+        {
+            loop
+            {
+                if (isRamping)
+                {
+                    currentValues += increments;
+
+                    if (++rampTime >= nextRampEnd)
+                        finishRamps();
+                }
+
+                out << currentValues;
+                advance();
+            }
+        }
+
+        // Snaps any ramps which have reached their end onto their target, and finds the
+        // time at which the next of the remaining ones will finish
+        void finishRamps()
+        {
+            isRamping = false;
+
+            for (int i = 0; i < numParameters; ++i)
+            {
+                if (isParameterRamping.at (i))
+                {
+                    if (rampEnds.at (i) <= rampTime)
+                    {
+                        currentValues.at (i) = targetValues.at (i);
+                        increments.at (i) = 0.0f;
+                        isParameterRamping.at (i) = false;
+                    }
+                    else if (! isRamping || rampEnds.at (i) < nextRampEnd)
+                    {
+                        nextRampEnd = rampEnds.at (i);
+                        isRamping = true;
+                    }
+                }
+            }
+        }
+    }
+}
+
 //==============================================================================
 /** Generators for common envelope shapes. */
 namespace soul::envelope
@@ -181,6 +280,9 @@ namespace soul::envelope
         The envelope implements fixed-length attack and release ramps where the hold
         level is based on the velocity of the triggering NoteOn event, multiplied
         by the holdLevelMultiplier parameter.
+
+        While it's waiting for a note, the envelope marks its voice as idle, so when
+        it's used inside an array of voices, the silent voices aren't rendered.
     */
     processor FixedAttackReleaseEnvelope (float holdLevelMultiplier,
                                           float attackTimeSeconds,
@@ -191,10 +293,11 @@ namespace soul::envelope
 
         output stream float levelOut;
 
-        event noteIn (soul::note_events::NoteOn e)      { active = true; targetLevel = e.velocity; }
+        event noteIn (soul::note_events::NoteOn e)      { active = true; idle = false; targetLevel = e.velocity; }
         event noteIn (soul::note_events::NoteOff e)     { active = false; }
 
         bool active = false;
+        bool idle = false [[ voiceIdle ]];
         float targetLevel;
 
         void run()
@@ -205,7 +308,10 @@ namespace soul::envelope
             {
                 // Waiting for note-on
                 while (! active)
+                {
+                    idle = true;
                     advance();
+                }
 
                 float level;
 
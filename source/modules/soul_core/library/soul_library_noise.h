@@ -59,6 +59,69 @@ namespace soul::random
     {
         return (float (getNextInt32 (state)) * (2.0f / 2147483647.0f)) - 1.0f;
     }
+
+    /*  The ...Lanes() functions run a separate xorshift generator in each element of an int32
+        vector, so that a whole set of independent random sequences can be advanced with a few
+        vector operations rather than one generator call per value.
+    */
+
+    /** Gives each lane of a vector of xorshift generators a different non-zero seed. */
+    void seedLanes<IntVector> (IntVector& state, int64 seed)
+    {
+        static_assert (IntVector.isVector && IntVector.primitiveType.isInt32, "seedLanes() requires a vector of int32 values");
+
+        var rng = RandomNumberState (seed);
+
+        for (int i = 0; i < state.size; ++i)
+            state.at (i) = getNextInt32 (rng) | 1;
+    }
+
+    /** Advances each lane of a vector of xorshift generators, and returns their new values,
+        which cover the full 32-bit integer range (apart from zero).
+    */
+    IntVector.removeReference getNextInt32Lanes<IntVector> (IntVector& state)
+    {
+        static_assert (IntVector.isVector && IntVector.primitiveType.isInt32, "getNextInt32Lanes() requires a vector of int32 values");
+
+        IntVector.removeReference x = state;
+        x ^= x << IntVector.removeReference (13);
+        x ^= x >>> IntVector.removeReference (17);
+        x ^= x << IntVector.removeReference (5);
+        state = x;
+        return x;
+    }
+
+    /** Advances each lane of a vector of xorshift generators, and returns a value 0 to 1 for each. */
+    float<IntVector.size> getNextUnipolarLanes<IntVector> (IntVector& state)
+    {
+        return float<IntVector.size> (getNextInt32Lanes (state) >>> IntVector.removeReference (8)) * (1.0f / 16777216.0f);
+    }
+
+    /** Advances each lane of a vector of xorshift generators, and returns a value -1 to 1 for each. */
+    float<IntVector.size> getNextBipolarLanes<IntVector> (IntVector& state)
+    {
+        return float<IntVector.size> (getNextInt32Lanes (state)) * (1.0f / 2147483648.0f);
+    }
+
+    /** Fills an array of floats with values -1 to 1, taking a vector's worth of values at a time
+        from a vector of xorshift generators. The size of the array must be a multiple of the
+        size of the vector.
+    */
+    void fillBipolar<Array, IntVector> (Array& dest, IntVector& state)
+    {
+        static_assert (Array.isFixedSizeArray && Array.elementType.isFloat32, "fillBipolar() requires a fixed-size array of float32 values");
+        static_assert (Array.size % IntVector.size == 0, "fillBipolar() requires an array whose size is a multiple of the vector size");
+
+        let numLanes = int (IntVector.size);
+
+        for (int i = 0; i < dest.size; i += numLanes)
+        {
+            let values = getNextBipolarLanes (state);
+
+            for (int lane = 0; lane < numLanes; ++lane)
+                dest.at (i + lane) = values.at (lane);
+        }
+    }
 }
 
 /**
@@ -144,6 +207,95 @@ namespace soul::noise
             }
         }
     }
+
+    /*  The ...Lanes processors produce a set of independent noise sources as the channels of
+        a single vector stream, using a vector of random number generators. This is much cheaper
+        than running a separate processor for each source.
+    */
+
+    /** A set of numLanes independent white noise generators. */
+    processor WhiteLanes (int numLanes)
+    {
+        output stream float<numLanes> out;
+
+        void run()
+        {
+            int<numLanes> rng;
+            random::seedLanes (rng, processor.id + 40);
+
+            loop
+            {
+                out << random::getNextBipolarLanes (rng);
+                advance();
+            }
+        }
+    }
+
+    /** A set of numLanes independent brown noise generators. */
+    processor BrownLanes (int numLanes)
+    {
+        output stream float<numLanes> out;
+
+        void run()
+        {
+            let limit = 32.0f;
+            float<numLanes> runningTotal;
+            int<numLanes> rng;
+            random::seedLanes (rng, processor.id + 50);
+
+            loop
+            {
+                let next = runningTotal + random::getNextBipolarLanes (rng);
+
+                // vectors can't be compared, so the steps which would go past the limit are dropped lane by lane
+                for (int lane = 0; lane < numLanes; ++lane)
+                    if (next.at (lane) <= limit && next.at (lane) >= -limit)
+                        runningTotal.at (lane) = next.at (lane);
+
+                runningTotal *= 0.998f;
+                out << runningTotal * (1.0f / limit);
+                advance();
+            }
+        }
+    }
+
+    /** A set of numLanes independent pink noise generators. */
+    processor PinkLanes (int numLanes)
+    {
+        output stream float<numLanes> out;
+
+        void run()
+        {
+            let pinkBits = 12;
+            int counter;
+            float<numLanes>[pinkBits] values;
+            float<numLanes> total;
+            int<numLanes> rng;
+            random::seedLanes (rng, processor.id + 60);
+
+            loop
+            {
+                let white = random::getNextBipolarLanes (rng);
+                ++counter;
+
+                // All the lanes share the counter, so they all update the same row of values
+                for (int bit = 0; bit < pinkBits; ++bit)
+                {
+                    if (((counter >> bit) & 1) != 0)
+                    {
+                        let index = wrap<pinkBits> (bit);
+                        total -= values[index];
+                        values[index] = white;
+                        total += white;
+                        break;
+                    }
+                }
+
+                out << total * (1.0f / float (pinkBits - 1));
+                advance();
+            }
+        }
+    }
 }
 
 )library"
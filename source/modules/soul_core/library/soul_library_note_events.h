@@ -208,6 +208,339 @@ namespace soul::voice_allocators
 
         VoiceInfo[voiceCount] voiceInfo;
     }
+
+    /** An allocator for large numbers of voices, which does a fixed amount of work for each
+        event rather than searching all the voices.
+
+        Inactive voices are kept in a queue, so that the one which was released longest ago is
+        reused first. When they're all in use, the stealingPolicy chooses which active voice to
+        take over:
+            0 = the oldest voice
+            1 = the quietest voice, i.e. the one with the lowest note-on velocity (or the oldest
+                of those, if several have the same velocity)
+            2 = a voice which is already playing the same note on the same channel if there is
+                one, even if other voices are free, otherwise the same as policy 0
+
+        When a voice is stolen, it's sent a NoteOff for its old note before the new NoteOn.
+        Voices are grouped by channel and by note, so a NoteOff, or a pitch bend, pressure or
+        slide event, only touches the voices that it applies to.
+    */
+    processor Scalable (int voiceCount, int stealingPolicy)  [[ main: false ]]
+    {
+        input event (soul::note_events::NoteOn,
+                     soul::note_events::NoteOff,
+                     soul::note_events::PitchBend,
+                     soul::note_events::Pressure,
+                     soul::note_events::Slide) eventIn;
+
+        output event (soul::note_events::NoteOn,
+                      soul::note_events::NoteOff,
+                      soul::note_events::PitchBend,
+                      soul::note_events::Pressure,
+                      soul::note_events::Slide) voiceEventOut[voiceCount];
+
+        let numChannels = 16;
+        let numNotes = 128;
+
+        struct VoiceInfo
+        {
+            bool active;
+            int channel;
+            float note;
+            float velocity;
+            int64 startTime;
+        }
+
+        // A doubly-linked list of voices, where -1 marks the end
+        struct List   { int first, last; }
+        struct Links  { int previous, next; }
+
+        VoiceInfo[voiceCount] voiceInfo;
+
+        List freeVoices;                                // inactive voices, least recently released first
+        List activeVoices;                              // active voices, oldest first
+        List[numChannels * numNotes] noteVoices;        // active voices, grouped by channel and note
+        List[numChannels] channelVoices;                // voices which were last used on each channel
+        Links[voiceCount] freeOrAgeLinks, noteLinks, channelLinks;
+
+        // A min-heap of the active voices, ordered by velocity and then age
+        int[voiceCount] quietestVoices, heapPosition;
+        int heapSize;
+
+        int64 nextStartTime;
+
+        void run()
+        {
+            static_assert (voiceCount > 0, "The voiceCount for soul::voice_allocators::Scalable must be greater than zero");
+            static_assert (stealingPolicy >= 0 && stealingPolicy <= 2, "The stealingPolicy for soul::voice_allocators::Scalable must be 0, 1 or 2");
+
+            clear (freeVoices);
+            clear (activeVoices);
+
+            for (int i = 0; i < numChannels * numNotes; ++i)
+                clear (noteVoices.at (i));
+
+            for (int i = 0; i < numChannels; ++i)
+                clear (channelVoices.at (i));
+
+            for (int voice = 0; voice < voiceCount; ++voice)
+            {
+                voiceInfo.at (voice).channel = -1;
+                append (freeVoices, freeOrAgeLinks, voice);
+            }
+
+            loop
+                advance();
+        }
+
+        event eventIn (soul::note_events::NoteOn e)
+        {
+            let voice = chooseVoiceToAllocate (e);
+
+            if (voiceInfo.at (voice).active)
+            {
+                soul::note_events::NoteOff noteOff;
+
+                noteOff.channel = voiceInfo.at (voice).channel;
+                noteOff.note    = voiceInfo.at (voice).note;
+
+                voiceEventOut[wrap<voiceCount> (voice)] << noteOff;
+                removeActiveVoice (voice);
+            }
+            else
+            {
+                remove (freeVoices, freeOrAgeLinks, voice);
+            }
+
+            if (voiceInfo.at (voice).channel >= 0)
+                remove (channelVoices.at (getChannelIndex (voiceInfo.at (voice).channel)), channelLinks, voice);
+
+            voiceInfo.at (voice).active    = true;
+            voiceInfo.at (voice).channel   = e.channel;
+            voiceInfo.at (voice).note      = e.note;
+            voiceInfo.at (voice).velocity  = e.velocity;
+            voiceInfo.at (voice).startTime = nextStartTime++;
+
+            append (activeVoices, freeOrAgeLinks, voice);
+            append (noteVoices.at (getNoteIndex (e.channel, e.note)), noteLinks, voice);
+            append (channelVoices.at (getChannelIndex (e.channel)), channelLinks, voice);
+            addToHeap (voice);
+
+            voiceEventOut[wrap<voiceCount> (voice)] << e;
+        }
+
+        event eventIn (soul::note_events::NoteOff e)
+        {
+            // Release all voices associated with this note/channel
+            var voice = noteVoices.at (getNoteIndex (e.channel, e.note)).first;
+
+            while (voice >= 0)
+            {
+                let next = noteLinks.at (voice).next;
+
+                if (voiceInfo.at (voice).channel == e.channel && voiceInfo.at (voice).note == e.note)
+                {
+                    removeActiveVoice (voice);
+                    voiceInfo.at (voice).active = false;
+                    append (freeVoices, freeOrAgeLinks, voice);
+
+                    voiceEventOut[wrap<voiceCount> (voice)] << e;
+                }
+
+                voice = next;
+            }
+        }
+
+        event eventIn (soul::note_events::PitchBend e)
+        {
+            // Forward the pitch bend to all notes on this channel
+            var voice = channelVoices.at (getChannelIndex (e.channel)).first;
+
+            while (voice >= 0)
+            {
+                if (voiceInfo.at (voice).channel == e.channel)
+                    voiceEventOut[wrap<voiceCount> (voice)] << e;
+
+                voice = channelLinks.at (voice).next;
+            }
+        }
+
+        event eventIn (soul::note_events::Pressure p)
+        {
+            // Forward the event to all notes on this channel
+            var voice = channelVoices.at (getChannelIndex (p.channel)).first;
+
+            while (voice >= 0)
+            {
+                if (voiceInfo.at (voice).channel == p.channel)
+                    voiceEventOut[wrap<voiceCount> (voice)] << p;
+
+                voice = channelLinks.at (voice).next;
+            }
+        }
+
+        event eventIn (soul::note_events::Slide s)
+        {
+            // Forward the event to all notes on this channel
+            var voice = channelVoices.at (getChannelIndex (s.channel)).first;
+
+            while (voice >= 0)
+            {
+                if (voiceInfo.at (voice).channel == s.channel)
+                    voiceEventOut[wrap<voiceCount> (voice)] << s;
+
+                voice = channelLinks.at (voice).next;
+            }
+        }
+
+        int chooseVoiceToAllocate (soul::note_events::NoteOn e)
+        {
+            if (stealingPolicy == 2)
+            {
+                var voice = noteVoices.at (getNoteIndex (e.channel, e.note)).first;
+
+                while (voice >= 0)
+                {
+                    if (voiceInfo.at (voice).channel == e.channel && voiceInfo.at (voice).note == e.note)
+                        return voice;
+
+                    voice = noteLinks.at (voice).next;
+                }
+            }
+
+            if (freeVoices.first >= 0)
+                return freeVoices.first;
+
+            if (stealingPolicy == 1)
+                return quietestVoices.at (0);
+
+            return activeVoices.first;
+        }
+
+        void removeActiveVoice (int voice)
+        {
+            remove (activeVoices, freeOrAgeLinks, voice);
+            remove (noteVoices.at (getNoteIndex (voiceInfo.at (voice).channel, voiceInfo.at (voice).note)), noteLinks, voice);
+            removeFromHeap (voice);
+        }
+
+        int getChannelIndex (int channel)               { return wrap (channel, numChannels); }
+        int getNoteIndex (int channel, float note)      { return getChannelIndex (channel) * numNotes + wrap (roundToInt (note), numNotes); }
+
+        //==============================================================================
+        void clear (List& list)
+        {
+            list.first = -1;
+            list.last = -1;
+        }
+
+        void append (List& list, Links[voiceCount]& links, int voice)
+        {
+            links.at (voice).previous = list.last;
+            links.at (voice).next = -1;
+
+            if (list.last >= 0)
+                links.at (list.last).next = voice;
+            else
+                list.first = voice;
+
+            list.last = voice;
+        }
+
+        void remove (List& list, Links[voiceCount]& links, int voice)
+        {
+            let previous = links.at (voice).previous;
+            let next = links.at (voice).next;
+
+            if (previous >= 0)
+                links.at (previous).next = next;
+            else
+                list.first = next;
+
+            if (next >= 0)
+                links.at (next).previous = previous;
+            else
+                list.last = previous;
+        }
+
+        //==============================================================================
+        bool isQuieter (int voice1, int voice2)
+        {
+            let velocity1 = voiceInfo.at (voice1).velocity;
+            let velocity2 = voiceInfo.at (voice2).velocity;
+
+            return velocity1 < velocity2
+                    || (velocity1 == velocity2 && voiceInfo.at (voice1).startTime < voiceInfo.at (voice2).startTime);
+        }
+
+        void setHeapItem (int position, int voice)
+        {
+            quietestVoices.at (position) = voice;
+            heapPosition.at (voice) = position;
+        }
+
+        void addToHeap (int voice)
+        {
+            setHeapItem (heapSize, voice);
+            siftUp (heapSize++);
+        }
+
+        void removeFromHeap (int voice)
+        {
+            let position = heapPosition.at (voice);
+            --heapSize;
+
+            if (position != heapSize)
+            {
+                let movedVoice = quietestVoices.at (heapSize);
+                setHeapItem (position, movedVoice);
+                siftUp (position);
+                siftDown (heapPosition.at (movedVoice));
+            }
+        }
+
+        void siftUp (int position)
+        {
+            let voice = quietestVoices.at (position);
+
+            while (position > 0)
+            {
+                let parent = (position - 1) / 2;
+
+                if (! isQuieter (voice, quietestVoices.at (parent)))
+                    break;
+
+                setHeapItem (position, quietestVoices.at (parent));
+                position = parent;
+            }
+
+            setHeapItem (position, voice);
+        }
+
+        void siftDown (int position)
+        {
+            let voice = quietestVoices.at (position);
+
+            loop
+            {
+                var child = position * 2 + 1;
+
+                if (child >= heapSize)
+                    break;
+
+                if (child + 1 < heapSize && isQuieter (quietestVoices.at (child + 1), quietestVoices.at (child)))
+                    ++child;
+
+                if (! isQuieter (quietestVoices.at (child), voice))
+                    break;
+
+                setHeapItem (position, quietestVoices.at (child));
+                position = child;
+            }
+
+            setHeapItem (position, voice);
+        }
+    }
 }
 
 )library"
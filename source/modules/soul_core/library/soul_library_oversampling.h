@@ -0,0 +1,216 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*  The following string literal forms part of a set of SOUL code chunks that form
+    the built-in library. (See the soul::getBuiltInLibraryCode() function)
+*/
+R"library(
+
+/** This namespace contains halfband filters for changing the sample rate of a stream by
+    a factor of two, and graphs which use them to run a processor at a higher rate.
+
+    Running a nonlinear processor such as a clipper or saturator at a multiple of the
+    sample rate stops most of the harmonics it generates from aliasing back into the audio
+    band. Simply using a clock multiplier on the processor isn't enough for this, because
+    a connection into a faster node just repeats or interpolates the samples, and a
+    connection out of it just drops them, so they do very little filtering.
+
+    The filters here are polyphase, so each one only does the work of a 24-tap FIR per
+    input frame, and all the taps are handled as a single vector operation.
+*/
+namespace soul::oversampling
+{
+    /** The number of non-zero taps in each phase of the halfband filter. */
+    let halfbandTaps = 24;
+
+    /** The non-zero taps of a 47-tap Kaiser-windowed halfband lowpass filter, doubled to
+        make up for the zeros inserted when upsampling. The middle tap of the filter is
+        0.5, and all the others which aren't listed here are zero.
+
+        At double the original sample rate, the passband is flat to within 0.003dB up to
+        0.4 of the original Nyquist frequency, and the stopband is at least 70dB down
+        from 0.6 of it.
+    */
+    let halfbandCoefficients = float<halfbandTaps> (-0.000164176f, 0.000781022f, -0.002141704f, 0.004694811f,
+                                                    -0.009026450f, 0.015905528f, -0.026409611f, 0.042274536f,
+                                                    -0.066923632f, 0.109065532f, -0.200783792f, 0.632729565f,
+                                                     0.632729565f, -0.200783792f, 0.109065532f, -0.066923632f,
+                                                     0.042274536f, -0.026409611f, 0.015905528f, -0.009026450f,
+                                                     0.004694811f, -0.002141704f, 0.000781022f, -0.000164176f);
+
+    //==============================================================================
+    /** Doubles the sample rate of a stream.
+
+        This must be instantiated with a clock multiplier of 2 relative to its input, and
+        the input connection should use latch interpolation. It only reads its input on
+        every other frame. The even output frames come from the filter, and the odd ones are
+        the input samples themselves, delayed to line up with them. The latency is 23
+        frames at the higher rate.
+    */
+    processor Upsampler2x (int numChannels)  [[ main: false ]]
+    {
+        input  stream float<numChannels> in;
+        output stream float<numChannels> out;
+
+        float<halfbandTaps>[numChannels] history;
+
+        void run()
+        {
+            loop
+            {
+                let x = in;
+                float<numChannels> filtered, delayed;
+
+                for (int channel = 0; channel < numChannels; ++channel)
+                {
+                    history.at (channel)[0:halfbandTaps - 1] = history.at (channel)[1:halfbandTaps];
+                    history.at (channel)[halfbandTaps - 1] = x.at (channel);
+
+                    filtered.at (channel) = sum (history.at (channel) * halfbandCoefficients);
+                    delayed.at (channel)  = history.at (channel)[halfbandTaps / 2];
+                }
+
+                out << filtered;
+                advance();
+                out << delayed;
+                advance();
+            }
+        }
+    }
+
+    //==============================================================================
+    /** Halves the sample rate of a stream.
+
+        This should be instantiated at the same rate as its input, and its output connected
+        to a node which runs at half that rate. It filters each pair of input frames into a
+        single value, and writes it to both of its output frames, so it doesn't matter which
+        one the slower node ends up taking. The latency is 23 frames at the higher rate.
+    */
+    processor Downsampler2x (int numChannels)  [[ main: false ]]
+    {
+        input  stream float<numChannels> in;
+        output stream float<numChannels> out;
+
+        float<halfbandTaps>[numChannels] evenHistory;
+        float<halfbandTaps / 2>[numChannels] oddHistory;
+
+        void run()
+        {
+            loop
+            {
+                let even = in;
+                float<numChannels> result;
+
+                for (int channel = 0; channel < numChannels; ++channel)
+                {
+                    evenHistory.at (channel)[0:halfbandTaps - 1] = evenHistory.at (channel)[1:halfbandTaps];
+                    evenHistory.at (channel)[halfbandTaps - 1] = even.at (channel);
+
+                    result.at (channel) = 0.5f * (sum (evenHistory.at (channel) * halfbandCoefficients)
+                                               + oddHistory.at (channel)[0]);
+                }
+
+                out << result;
+                advance();
+
+                let odd = in;
+
+                for (int channel = 0; channel < numChannels; ++channel)
+                {
+                    oddHistory.at (channel)[0:halfbandTaps / 2 - 1] = oddHistory.at (channel)[1:halfbandTaps / 2];
+                    oddHistory.at (channel)[halfbandTaps / 2 - 1] = odd.at (channel);
+                }
+
+                out << result;
+                advance();
+            }
+        }
+    }
+
+    //==============================================================================
+    /** Runs a processor at twice the rate of this graph, with halfband filters on the way
+        in and out.
+
+        The processor can't take any parameters of its own, and must have a stream input
+        called "in" and a stream output called "out", both of type float<numChannels>.
+        For a processor with other inputs, such as parameter events, the up and downsamplers
+        can be connected around it in the same way as this graph does.
+
+        The overall latency is 23 frames.
+    */
+    graph Oversampled2x (processor Inner, int numChannels)  [[ main: false ]]
+    {
+        input  stream float<numChannels> in;
+        output stream float<numChannels> out;
+
+        let
+        {
+            up    = Upsampler2x (numChannels) * 2;
+            inner = Inner * 2;
+            down  = Downsampler2x (numChannels) * 2;
+        }
+
+        connection
+        {
+            [latch] in -> up.in;
+            up.out -> inner.in;
+            inner.out -> down.in;
+            down.out -> out;
+        }
+    }
+
+    //==============================================================================
+    /** Runs a processor at four times the rate of this graph, by using two halfband
+        stages in each direction.
+
+        The processor can't take any parameters of its own, and must have a stream input
+        called "in" and a stream output called "out", both of type float<numChannels>.
+        For a processor with other inputs, such as parameter events, the up and downsamplers
+        can be connected around it in the same way as this graph does.
+
+        The overall latency is 34.5 frames.
+    */
+    graph Oversampled4x (processor Inner, int numChannels)  [[ main: false ]]
+    {
+        input  stream float<numChannels> in;
+        output stream float<numChannels> out;
+
+        let
+        {
+            up1   = Upsampler2x (numChannels) * 2;
+            up2   = Upsampler2x (numChannels) * 4;
+            inner = Inner * 4;
+            down2 = Downsampler2x (numChannels) * 4;
+            down1 = Downsampler2x (numChannels) * 2;
+        }
+
+        connection
+        {
+            [latch] in -> up1.in;
+            [latch] up1.out -> up2.in;
+            up2.out -> inner.in;
+            inner.out -> down2.in;
+            down2.out -> down1.in;
+            down1.out -> out;
+        }
+    }
+}
+
+)library"
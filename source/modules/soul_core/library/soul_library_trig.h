@@ -60,6 +60,85 @@ namespace soul::intrinsics
                       : atanYoverX - T (pi);
     }
 
+    /*  The fast...() functions are cheaper approximations of sin, cos, exp and tanh, for use
+        in places such as oscillator banks and waveshapers, where they're called for every
+        sample of every voice, and full precision isn't needed. They're written without loops
+        or calls to other transcendental functions, so that a back-end can vectorise them, but
+        a performer may also replace them with native versions of at least the same accuracy.
+
+        The error bounds given below are for the approximations themselves. When T is float32,
+        the rounding of the arithmetic adds a few parts in 10^7 to these.
+    */
+
+    /** A fast approximation of sin(). The maximum absolute error is about 6e-7 for arguments
+        within +/- 2^16 radians, beyond which the range reduction starts to lose precision.
+    */
+    T fastSin<T> (T n)  [[intrin: "fastSin"]]
+    {
+        static_assert (T.isPrimitive && T.primitiveType.isFloat, "fastSin() only works with scalar floating point types");
+
+        // reduce to the range -pi to pi, then reflect into -pi/2 to pi/2
+        var x = n - T (twoPi) * floor (n * T (1.0 / twoPi) + T (0.5));
+        x = x > T (pi / 2) ? T (pi) - x : (x < T (-pi / 2) ? T (-pi) - x : x);
+
+        let x2 = x * x;
+        return x * (T (0.9999966159168018) + x2 * (T (-0.16664828384241215) + x2 * (T (0.008306325244314532) + x2 * T (-0.00018363654349409463))));
+    }
+
+    /** A fast approximation of cos(), with the same error bounds as fastSin(). */
+    T fastCos<T> (T n)  [[intrin: "fastCos"]]
+    {
+        static_assert (T.isPrimitive && T.primitiveType.isFloat, "fastCos() only works with scalar floating point types");
+        return fastSin (n + T (pi / 2));
+    }
+
+    /** A fast approximation of exp(). The maximum relative error is about 8e-8. The result
+        is clamped to the range 2^-126 to 2^127 (i.e. arguments from about -87.3 to 88.0),
+        so that it can't overflow a float32.
+    */
+    T fastExp<T> (T n)  [[intrin: "fastExp"]]
+    {
+        static_assert (T.isPrimitive && T.primitiveType.isFloat, "fastExp() only works with scalar floating point types");
+
+        // exp (n) = 2^i * 2^f, where i is an integer and f is between 0 and 1
+        let y = clamp (n * T (1.4426950408889634), T (-126), T (127));
+        let i = floor (y);
+        let f = y - i;
+        let fractionalPart = T (0.9999999250630113) + f * (T (0.693153073227578) + f * (T (0.24015361681495687)
+                                + f * (T (0.055826318717497006) + f * (T (0.008989339311678904) + f * T (0.0018775769931029863)))));
+
+        var bits = int (abs (i));
+        var power = T (2);
+        var integerPart = T (1);
+
+        loop (7)
+        {
+            if ((bits & 1) != 0)
+                integerPart *= power;
+
+            power *= power;
+            bits >>= 1;
+        }
+
+        return i < 0 ? fractionalPart / integerPart
+                     : fractionalPart * integerPart;
+    }
+
+    /** A fast approximation of tanh(), using a rational function which is clamped at +/- 1.
+        The maximum absolute error is about 1e-4, and the result is continuous and monotonic,
+        which makes it suitable for use as a saturating waveshaper.
+    */
+    T fastTanh<T> (T n)  [[intrin: "fastTanh"]]
+    {
+        static_assert (T.isPrimitive && T.primitiveType.isFloat, "fastTanh() only works with scalar floating point types");
+
+        let x = clamp (n, T (-4.971786858527607), T (4.971786858527607));
+        let x2 = x * x;
+
+        return x * (T (135135) + x2 * (T (17325) + x2 * (T (378) + x2)))
+                 / (T (135135) + x2 * (T (62370) + x2 * (T (3150) + x2 * T (28))));
+    }
+
     namespace helpers
     {
         T atanHelperPositive<T> (T n)
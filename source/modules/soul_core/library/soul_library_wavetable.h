@@ -0,0 +1,193 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+R"library(
+
+/**
+    This namespace contains oscillators which play band-limited waves from tables.
+
+    A wavetable is an external float array which the runtime fills with a set of mip levels,
+    each of which is one cycle of (tableSize) samples. You can declare one yourself with an
+    annotation such as:
+
+        external float[] sawTable [[ wavetable, sawtooth, tableSize: 2048 ]];
+
+    The wave types are the same as for the other generated externals: sinewave, triangle,
+    squarewave and sawtooth. Level 0 contains (tableSize / 4) harmonics, and each level after
+    that has half as many as the one before, down to a single sine wave. The optional
+    'numLevels' annotation limits the number of levels that are generated.
+
+    Because the table is an external, it's shared by every voice that uses it, and reading
+    from it costs a couple of lookups and a multiply-add per sample, rather than a call to
+    sin() or a set of polyBLEP corrections.
+*/
+namespace soul::wavetable
+{
+    /** Returns the number of harmonics in a level of a wavetable. */
+    int getNumHarmonics (int tableSize, int level)
+    {
+        return max (1, (tableSize / 4) >> level);
+    }
+
+    /** Returns the first mip level in a wavetable which can be played with the given phase
+        increment (in cycles per frame) without any of its harmonics going above Nyquist.
+    */
+    int getLevelForPhaseIncrement (const float[] table, int tableSize, float phaseIncrement)
+    {
+        let numLevels = int (table.size) / tableSize;
+        var level = 0;
+
+        while (level + 1 < numLevels)
+        {
+            if (float (getNumHarmonics (tableSize, level)) * phaseIncrement <= 0.5f)
+                break;
+
+            ++level;
+        }
+
+        return level;
+    }
+
+    /** Returns a linearly-interpolated sample from one level of a wavetable, where the phase
+        goes from 0 to 1 over a cycle of the wave.
+    */
+    float read (const float[] table, int tableSize, int level, float phase)
+    {
+        let position = phase * float (tableSize);
+        let index = wrap (int (position), tableSize);
+        let nextIndex = index + 1 == tableSize ? 0 : index + 1;
+        let start = level * tableSize;
+
+        let sample1 = table.at (start + index);
+        let sample2 = table.at (start + nextIndex);
+
+        return sample1 + (sample2 - sample1) * (position - floor (position));
+    }
+
+    /** An oscillator which plays a wave from a band-limited wavetable, at the frequency given
+        by the last event sent to frequencyIn. The waveShape is 0 for a sine, 1 for a triangle,
+        2 for a square or 3 for a sawtooth, and tableSize must be a power of two. The Sine,
+        Triangle, Square and Sawtooth graphs below are a more readable way to create one.
+
+        The wavetable is generated by the runtime and shared between all the instances of the
+        processor that have the same waveShape and tableSize.
+    */
+    processor Oscillator (int waveShape, int tableSize)  [[ main: false ]]
+    {
+        input event float frequencyIn;
+        output stream float out;
+
+        external float[] table [[ wavetable,
+                                  sinewave:   waveShape == 0,
+                                  triangle:   waveShape == 1,
+                                  squarewave: waveShape == 2,
+                                  sawtooth:   waveShape == 3,
+                                  tableSize:  tableSize ]];
+
+        float phase, phaseIncrement;
+        int level;
+
+        event frequencyIn (float newFrequency)
+        {
+            phaseIncrement = clamp (float (newFrequency * processor.period), 0.0f, 0.5f);
+            level = getLevelForPhaseIncrement (table, tableSize, phaseIncrement);
+        }
+
+        void run()
+        {
+            static_assert (waveShape >= 0 && waveShape <= 3, "The waveShape for soul::wavetable::Oscillator must be between 0 and 3");
+            static_assert (tableSize >= 8 && (tableSize & (tableSize - 1)) == 0, "The tableSize for soul::wavetable::Oscillator must be a power of 2");
+
+            loop
+            {
+                out << read (table, tableSize, level, phase);
+
+                phase += phaseIncrement;
+
+                if (phase >= 1.0f)
+                    phase -= 1.0f;
+
+                advance();
+            }
+        }
+    }
+
+    /** A band-limited sine wave oscillator. */
+    graph Sine (int tableSize)  [[ main: false ]]
+    {
+        input event float frequencyIn;
+        output stream float out;
+
+        let oscillator = Oscillator (0, tableSize);
+
+        connection
+        {
+            frequencyIn -> oscillator.frequencyIn;
+            oscillator.out -> out;
+        }
+    }
+
+    /** A band-limited triangle wave oscillator. */
+    graph Triangle (int tableSize)  [[ main: false ]]
+    {
+        input event float frequencyIn;
+        output stream float out;
+
+        let oscillator = Oscillator (1, tableSize);
+
+        connection
+        {
+            frequencyIn -> oscillator.frequencyIn;
+            oscillator.out -> out;
+        }
+    }
+
+    /** A band-limited square wave oscillator. */
+    graph Square (int tableSize)  [[ main: false ]]
+    {
+        input event float frequencyIn;
+        output stream float out;
+
+        let oscillator = Oscillator (2, tableSize);
+
+        connection
+        {
+            frequencyIn -> oscillator.frequencyIn;
+            oscillator.out -> out;
+        }
+    }
+
+    /** A band-limited sawtooth wave oscillator. */
+    graph Sawtooth (int tableSize)  [[ main: false ]]
+    {
+        input event float frequencyIn;
+        output stream float out;
+
+        let oscillator = Oscillator (3, tableSize);
+
+        connection
+        {
+            frequencyIn -> oscillator.frequencyIn;
+            oscillator.out -> out;
+        }
+    }
+}
+
+)library"
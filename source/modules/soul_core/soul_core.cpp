@@ -28,6 +28,7 @@
 #endif
 
 #include <thread>
+#include <deque>
 #include <iomanip>
 #include <fstream>
 
@@ -36,13 +37,27 @@
 #include "../../3rdParty/choc/text/choc_JSON.h"
 
 #if SOUL_INTEL
- #include <xmmintrin.h>
+ #include <emmintrin.h>
+#elif SOUL_ARM64
+ #include <arm_neon.h>
 #endif
 
 #ifdef __APPLE__
  #include <AvailabilityMacros.h>
 #endif
 
+#if defined (__linux__) || defined (__APPLE__)
+ #define SOUL_POSIX_THREADS 1
+ #include <pthread.h>
+ #include <sched.h>
+#endif
+
+#ifdef __linux__
+ #include <sys/mman.h>
+ #include <sys/syscall.h>
+ #include <unistd.h>
+#endif
+
 #define SOUL_INSIDE_CORE_CPP 1
 #define printf NO_PRINTFS_TODAY_THANKYOU
 
@@ -60,6 +75,7 @@
 #include "utilities/soul_UTF8Reader.cpp"
 #include "utilities/soul_MiscUtilities.cpp"
 #include "utilities/soul_AudioDataGeneration.cpp"
+#include "utilities/soul_SampleConversion.cpp"
 #include "types/soul_Struct.cpp"
 #include "types/soul_StringDictionary.cpp"
 #include "types/soul_ConstantTable.cpp"
@@ -69,7 +85,13 @@
 #include "types/soul_EndpointType.cpp"
 #include "heart/soul_heart_Printer.h"
 #include "heart/soul_heart_Parser.h"
+#include "heart/soul_heart_BinaryFormat.h"
 #include "heart/soul_heart_Checker.h"
+#include "heart/soul_heart_PrecisionReduction.h"
+#include "heart/soul_heart_ProcessorFusion.h"
+#include "heart/soul_heart_ProcessorArrayPacking.h"
+#include "heart/soul_heart_StateLayout.h"
+#include "heart/soul_heart_InitialStateEvaluator.h"
 #include "types/soul_Type.cpp"
 #include "library/soul_library.h"
 #include "compiler/soul_ASTVisitor.h"
@@ -77,13 +99,21 @@
 #include "compiler/soul_Parser.h"
 #include "compiler/soul_ResolutionPass.h"
 #include "compiler/soul_HeartGenerator.h"
+#include "compiler/soul_PerformanceLintPass.h"
 #include "compiler/soul_Compiler.cpp"
 #include "heart/soul_Intrinsics.cpp"
 #include "heart/soul_heart_FunctionBuilder.cpp"
+#include "heart/soul_heart_BlockProfile.cpp"
 #include "heart/soul_ModuleCloner.h"
+#include "heart/soul_heart_GraphPartitioner.h"
+#include "heart/soul_heart_CostEstimator.h"
+#include "heart/soul_heart_ProgramChain.h"
+#include "heart/soul_heart_FlattenedGraph.h"
+#include "heart/soul_heart_CppGenerator.h"
 #include "heart/soul_Module.cpp"
 #include "heart/soul_Program.cpp"
 #include "venue/soul_ThreadedVenue.cpp"
+#include "venue/soul_InterpreterPerformer.cpp"
 #include "diagnostics/soul_CodeLocation.cpp"
 #include "diagnostics/soul_Logging.cpp"
 #include "diagnostics/soul_CompileMessageList.cpp"
@@ -49,6 +49,7 @@
 #include <sstream>
 #include <array>
 #include <unordered_map>
+#include <unordered_set>
 #include <algorithm>
 #include <functional>
 #include <mutex>
@@ -59,6 +60,7 @@
 #include <atomic>
 #include <limits>
 #include <condition_variable>
+#include <thread>
 #include <cassert>
 #include <random>
 #include <optional>
@@ -130,8 +132,12 @@ namespace soul
 #include "heart/soul_Program.h"
 #include "heart/soul_Module.h"
 #include "heart/soul_heart_Utilities.h"
+#include "heart/soul_heart_FlatFunction.h"
+#include "heart/soul_heart_UseDefChains.h"
 #include "heart/soul_heart_FunctionBuilder.h"
 #include "heart/soul_heart_CallFlowGraph.h"
+#include "heart/soul_heart_MultiRateSchedule.h"
+#include "heart/soul_heart_BlockProfile.h"
 #include "heart/soul_heart_Optimisations.h"
 
 #include "compiler/soul_AST.h"
@@ -139,9 +145,11 @@ namespace soul
 
 #include "venue/soul_Endpoints.h"
 #include "venue/soul_Performer.h"
+#include "venue/soul_PerformerState.h"
 #include "venue/soul_Venue.h"
 
 #include "utilities/soul_EventQueue.h"
 #include "utilities/soul_AudioDataGeneration.h"
+#include "utilities/soul_SampleConversion.h"
 #include "utilities/soul_AudioMIDIWrapper.h"
 #include "utilities/soul_DumpConstant.h"
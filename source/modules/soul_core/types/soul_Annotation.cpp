@@ -78,59 +78,64 @@ static std::string annotationToString (const StringDictionary& stringDictionary,
 bool Annotation::isEmpty() const    { return size() == 0; }
 size_t Annotation::size() const     { return properties == nullptr ? 0 : properties->size(); }
 
-Value Annotation::getValue (const std::string& name) const
+const Value* Annotation::findValue (Key name) const
 {
-    SOUL_ASSERT (! name.empty());
-    return getValue (name, {});
+    SOUL_ASSERT (! name.name.empty());
+
+    if (properties != nullptr)
+        for (auto& p : *properties)
+            if (p.nameHash == name.hash && p.name == name.name)
+                return std::addressof (p.value);
+
+    return nullptr;
 }
 
-Value Annotation::getValue (const std::string& name, const Value& defaultReturnValue) const
+Value Annotation::getValue (Key name) const
 {
-    SOUL_ASSERT (! name.empty());
+    return getValue (name, {});
+}
 
-    if (properties != nullptr)
-        for (auto& p : *properties)
-            if (p.name == name)
-                return p.value;
+Value Annotation::getValue (Key name, const Value& defaultReturnValue) const
+{
+    if (auto v = findValue (name))
+        return *v;
 
     return defaultReturnValue;
 }
 
-bool Annotation::hasValue (const std::string& name) const
+bool Annotation::hasValue (Key name) const
 {
-    SOUL_ASSERT (! name.empty());
-
-    if (properties != nullptr)
-        for (auto& p : *properties)
-            if (p.name == name)
-                return true;
+    return findValue (name) != nullptr;
+}
 
-    return false;
+static bool isNumeric (const Value* v)
+{
+    return v != nullptr && (v->getType().isPrimitiveFloat() || v->getType().isPrimitiveInteger());
 }
 
-bool Annotation::getBool (const std::string& name, bool defaultValue) const
+bool Annotation::getBool (Key name, bool defaultValue) const
 {
-    auto v = getValue (name);
-    return v.isValid() ? v.getAsBool() : defaultValue;
+    auto v = findValue (name);
+    return v != nullptr && v->isValid() ? v->getAsBool() : defaultValue;
 }
 
-double Annotation::getDouble (const std::string& name, double defaultValue) const
+double Annotation::getDouble (Key name, double defaultValue) const
 {
-    auto v = getValue (name);
-    return v.getType().isPrimitiveFloat() || v.getType().isPrimitiveInteger() ? v.getAsDouble() : defaultValue;
+    auto v = findValue (name);
+    return isNumeric (v) ? v->getAsDouble() : defaultValue;
 }
 
-int64_t Annotation::getInt64 (const std::string& name, int64_t defaultValue) const
+int64_t Annotation::getInt64 (Key name, int64_t defaultValue) const
 {
-    auto v = getValue (name);
-    return v.getType().isPrimitiveFloat() || v.getType().isPrimitiveInteger() ? v.getAsInt64() : defaultValue;
+    auto v = findValue (name);
+    return isNumeric (v) ? v->getAsInt64() : defaultValue;
 }
 
-std::string Annotation::getString (const std::string& name, const std::string& defaultValue) const
+std::string Annotation::getString (Key name, const std::string& defaultValue) const
 {
-    auto v = getValue (name);
+    auto v = findValue (name);
 
-    if (v.isValid())
+    if (v != nullptr && v->isValid())
     {
         struct UnquotedPrinter  : public ValuePrinter
         {
@@ -142,7 +147,7 @@ std::string Annotation::getString (const std::string& name, const std::string& d
 
         UnquotedPrinter p;
         p.dictionary = std::addressof (dictionary);
-        v.print (p);
+        v->print (p);
         return p.out.str();
     }
 
@@ -180,9 +185,11 @@ void Annotation::setInternal (const std::string& name, Value newValue)
     }
     else
     {
+        auto hash = Key::getHash (name);
+
         for (auto& p : *properties)
         {
-            if (p.name == name)
+            if (p.nameHash == hash && p.name == name)
             {
                 p.value = std::move (newValue);
                 return;
@@ -207,12 +214,12 @@ void Annotation::set (const std::string& name, bool value)                { setI
 void Annotation::set (const std::string& name, const char* value)         { set (name, std::string (value)); }
 void Annotation::set (const std::string& name, const std::string& value)  { setInternal (name, Value::createStringLiteral (dictionary.getHandleForString (value))); }
 
-void Annotation::remove (const std::string& name)
+void Annotation::remove (Key name)
 {
-    SOUL_ASSERT (! name.empty());
+    SOUL_ASSERT (! name.name.empty());
 
     if (properties != nullptr)
-        removeIf (*properties, [&] (const Property& p) { return p.name == name; });
+        removeIf (*properties, [&] (const Property& p) { return p.nameHash == name.hash && p.name == name.name; });
 }
 
 std::vector<std::string> Annotation::getNames() const
@@ -32,23 +32,53 @@ struct Annotation
     Annotation& operator= (const Annotation&);
     Annotation& operator= (Annotation&&);
 
+    /** A property name and its hash, which the lookup methods compare before the name.
+        Because the hash can be computed at compile time, a name which is looked up often
+        can be declared once as a static constexpr Key, and then costs nothing to pass in.
+    */
+    struct Key
+    {
+        constexpr Key (std::string_view n) : name (n), hash (getHash (n)) {}
+        constexpr Key (const char* n) : Key (std::string_view (n)) {}
+        Key (const std::string& n) : Key (std::string_view (n)) {}
+
+        std::string_view name;
+        uint64_t hash;
+
+        static constexpr uint64_t getHash (std::string_view s)
+        {
+            uint64_t h = 14695981039346656037ull;
+
+            for (auto c : s)
+                h = (h ^ static_cast<uint8_t> (c)) * 1099511628211ull;
+
+            return h;
+        }
+    };
+
     struct Property
     {
         std::string name;
         Value value;
+        uint64_t nameHash = Key::getHash (name);
     };
 
     bool isEmpty() const;
     size_t size() const;
 
-    Value getValue (const std::string& name) const;
-    Value getValue (const std::string& name, const Value& defaultReturnValue) const;
-    bool hasValue (const std::string& name) const;
+    /** Returns a pointer to the value of a property, or nullptr if there isn't one.
+        The pointer is only valid until the annotation is next modified.
+    */
+    const Value* findValue (Key name) const;
+
+    Value getValue (Key name) const;
+    Value getValue (Key name, const Value& defaultReturnValue) const;
+    bool hasValue (Key name) const;
 
-    bool getBool (const std::string& name, bool defaultValue = false) const;
-    double getDouble (const std::string& name, double defaultValue = 0) const;
-    int64_t getInt64 (const std::string& name, int64_t defaultValue = 0) const;
-    std::string getString (const std::string& name, const std::string& defaultValue = {}) const;
+    bool getBool (Key name, bool defaultValue = false) const;
+    double getDouble (Key name, double defaultValue = 0) const;
+    int64_t getInt64 (Key name, int64_t defaultValue = 0) const;
+    std::string getString (Key name, const std::string& defaultValue = {}) const;
 
     void set (const std::string& name, int32_t value);
     void set (const std::string& name, int64_t value);
@@ -59,7 +89,7 @@ struct Annotation
     void set (const std::string& name, const std::string& value);
     void set (const std::string& name, Value newValue, const StringDictionary&);
 
-    void remove (const std::string& name);
+    void remove (Key name);
 
     std::vector<std::string> getNames() const;
     const StringDictionary& getDictionary() const;
@@ -24,6 +24,27 @@
 
 namespace soul
 {
+    static size_t getPackedDataHash (const void* sourceData, size_t size)
+    {
+        // An FNV-style hash which takes 8 bytes at a time, so that large tables are quick to hash
+        auto data = static_cast<const uint8_t*> (sourceData);
+        auto hash = static_cast<uint64_t> (14695981039346656037ull) ^ size;
+        size_t i = 0;
+
+        for (; i + sizeof (uint64_t) <= size; i += sizeof (uint64_t))
+        {
+            uint64_t word;
+            memcpy (&word, data + i, sizeof (word));
+            hash = (hash ^ word) * 1099511628211ull;
+            hash ^= hash >> 29;
+        }
+
+        for (; i < size; ++i)
+            hash = (hash ^ data[i]) * 1099511628211ull;
+
+        return static_cast<size_t> (hash);
+    }
+
     ConstantTable::ConstantTable() = default;
     ConstantTable::~ConstantTable() = default;
 
@@ -31,17 +52,39 @@ namespace soul
     const ConstantTable::Item* ConstantTable::end() const     { return items.end(); }
     size_t ConstantTable::size() const                        { return items.size(); }
 
+    size_t ConstantTable::getMemoryUsage() const
+    {
+        auto total = items.size() * sizeof (Item)
+                       + getHashContainerMemoryUsage (itemsByContent)
+                       + getHashContainerMemoryUsage (itemsByHandle);
+
+        for (auto& item : items)
+            if (item.value != nullptr)
+                total += sizeof (Value) + item.value->getPackedDataSize();
+
+        return total;
+    }
+
     ConstantTable::Handle ConstantTable::getHandleForValue (Value value)
     {
         if (! value.isValid())
             return 0;
 
-        for (auto& i : items)
-            if (value == *i.value)
-                return i.handle;
+        auto hash = getContentHash (value);
+        auto matches = itemsByContent.equal_range (hash);
+
+        for (auto i = matches.first; i != matches.second; ++i)
+        {
+            auto& item = items[i->second];
+
+            if (item.value->getPackedDataSize() == value.getPackedDataSize() && value == *item.value)
+                return item.handle;
+        }
 
         auto handle = nextIndex++;
         items.push_back ({ handle, std::make_unique<Value> (std::move (value)) });
+        itemsByContent.insert ({ hash, items.size() - 1 });
+        itemsByHandle[handle] = items.size() - 1;
         return handle;
     }
 
@@ -50,9 +93,10 @@ namespace soul
         if (handle == 0)
             return {};
 
-        for (auto& i : items)
-            if (handle == i.handle)
-                return i.value.get();
+        auto i = itemsByHandle.find (handle);
+
+        if (i != itemsByHandle.end())
+            return items[i->second].value.get();
 
         SOUL_ASSERT_FALSE;
         return {};
@@ -62,5 +106,84 @@ namespace soul
     {
         nextIndex = std::max (nextIndex, i.handle + 1);
         items.push_back (std::move (i));
+        addToIndexes (items.size() - 1);
+    }
+
+    void ConstantTable::addToIndexes (size_t itemIndex)
+    {
+        auto& item = items[itemIndex];
+
+        if (item.value != nullptr && item.value->isValid())
+            itemsByContent.insert ({ getContentHash (*item.value), itemIndex });
+
+        itemsByHandle[item.handle] = itemIndex;
+    }
+
+    size_t ConstantTable::getContentHash (const Value& value)
+    {
+        return getPackedDataHash (value.getPackedData(), value.getPackedDataSize());
+    }
+
+    //==============================================================================
+    struct SharedBlockStore
+    {
+        std::mutex lock;
+        std::unordered_multimap<size_t, std::weak_ptr<const SharedConstantData::Block>> blocks;
+
+        static SharedBlockStore& getInstance()
+        {
+            static SharedBlockStore store;
+            return store;
+        }
+
+        void removeExpiredBlocks()
+        {
+            for (auto i = blocks.begin(); i != blocks.end();)
+            {
+                if (i->second.expired())
+                    i = blocks.erase (i);
+                else
+                    ++i;
+            }
+        }
+    };
+
+    SharedConstantData::Block::Block (const void* sourceData, size_t sizeBytes)
+        : ownedData (new uint8_t[sizeBytes]), data (ownedData.get()), size (sizeBytes)
+    {
+        memcpy (ownedData.get(), sourceData, sizeBytes);
+    }
+
+    SharedConstantData::Block::Block (const void* sourceData, size_t sizeBytes, std::shared_ptr<const void> dataOwner)
+        : owner (std::move (dataOwner)), data (sourceData), size (sizeBytes)
+    {
+    }
+
+    SharedConstantData::BlockPtr SharedConstantData::get (const void* data, size_t size, std::shared_ptr<const void> dataOwner)
+    {
+        auto hash = getPackedDataHash (data, size);
+        auto& store = SharedBlockStore::getInstance();
+        std::lock_guard<std::mutex> l (store.lock);
+
+        auto matches = store.blocks.equal_range (hash);
+
+        for (auto i = matches.first; i != matches.second; ++i)
+            if (auto block = i->second.lock())
+                if (block->getSize() == size && memcmp (block->getData(), data, size) == 0)
+                    return block;
+
+        store.removeExpiredBlocks();
+        auto block = dataOwner != nullptr ? std::make_shared<const Block> (data, size, std::move (dataOwner))
+                                          : std::make_shared<const Block> (data, size);
+        store.blocks.insert ({ hash, block });
+        return block;
+    }
+
+    size_t SharedConstantData::getNumBlocks()
+    {
+        auto& store = SharedBlockStore::getInstance();
+        std::lock_guard<std::mutex> l (store.lock);
+        store.removeExpiredBlocks();
+        return store.blocks.size();
     }
 }
@@ -31,7 +31,9 @@ public:
 
     using Handle = std::intptr_t;
 
-    /** Adds a new Value to the set, and returns a handle for it. */
+    /** Adds a new Value to the set, and returns a handle for it.
+        If an identical value is already in the set, its handle is returned instead.
+    */
     Handle getHandleForValue (Value);
 
     /** Attempts to return the value that was provided for this handle, or a nullptr
@@ -49,12 +51,70 @@ public:
     const Item* end() const;
     size_t size() const;
 
+    /** Returns an estimate of the number of bytes used by the table, including its values' data. */
+    size_t getMemoryUsage() const;
+
     /** Manually adds an item - obviously to be used with care. */
     void addItem (Item);
 
 private:
     ArrayWithPreallocation<Item, 32> items;
     Handle nextIndex = 1;
+
+    // Indexes of the items, looked up by a hash of their packed data, and by their handles
+    std::unordered_multimap<size_t, size_t> itemsByContent;
+    std::unordered_map<Handle, size_t> itemsByHandle;
+
+    void addToIndexes (size_t itemIndex);
+    static size_t getContentHash (const Value&);
+};
+
+//==============================================================================
+/**
+    A process-wide store of read-only blocks of constant data, which lets all the performers
+    that have loaded the same program point at a single copy of its tables and external data,
+    rather than each one keeping a copy of its own.
+
+    Blocks are found by a hash of their content, so two programs which were compiled separately
+    can still share a table if its data is identical. A block is freed when the last reference
+    to it is released, so a performer should keep the references that it's given for as long as
+    it's using the data.
+*/
+class SharedConstantData
+{
+public:
+    /** An immutable block of data which may be shared by several performers. */
+    struct Block
+    {
+        Block (const void* sourceData, size_t size);
+        Block (const void* sourceData, size_t size, std::shared_ptr<const void> dataOwner);
+
+        const void* getData() const noexcept    { return data; }
+        size_t getSize() const noexcept         { return size; }
+
+    private:
+        std::unique_ptr<uint8_t[]> ownedData;
+        std::shared_ptr<const void> owner;
+        const void* data;
+        size_t size;
+    };
+
+    using BlockPtr = std::shared_ptr<const Block>;
+    using References = std::vector<BlockPtr>;
+
+    /** Returns a shared block with the same content as the data provided, creating one if there
+        isn't already a matching block in use.
+        If the data has an owner (e.g. from Value::getPackedDataOwner()), a new block refers to
+        the data and keeps its owner alive instead of copying it, in which case the data mustn't
+        be modified while the owner exists.
+    */
+    static BlockPtr get (const void* data, size_t size, std::shared_ptr<const void> dataOwner = {});
+
+    /** Blocks smaller than this are cheap enough to copy that they aren't worth sharing. */
+    static constexpr size_t minimumSharedSize = 1024;
+
+    /** Returns the number of distinct blocks which are currently in use. */
+    static size_t getNumBlocks();
 };
 
 
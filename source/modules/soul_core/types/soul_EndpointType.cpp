@@ -37,6 +37,8 @@ EndpointDetails::EndpointDetails (EndpointID id, std::string nm, EndpointType t,
 
     for (auto& type : types)
         dataTypes.push_back (type.getExternalType());
+
+    metadata = createEndpointMetadata (*this);
 }
 
 uint32_t EndpointDetails::getNumAudioChannels() const
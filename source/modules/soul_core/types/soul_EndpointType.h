@@ -92,6 +92,25 @@ private:
     template <typename Type> operator Type() const = delete;
 };
 
+//==============================================================================
+/** The details of an endpoint that hosts need when they set up a program, which are
+    parsed once from its types and annotation when an EndpointDetails is created, so that
+    they don't have to be looked up by name for each endpoint every time.
+*/
+struct EndpointMetadata
+{
+    bool isMIDIEvent = false;   ///< @see isMIDIEventEndpoint()
+    bool isParameter = false;   ///< @see isParameterInput()
+
+    /** The parameter properties. These are only filled in when isParameter is true, and they
+        follow the same rules and defaults as soul::patch::PatchParameterProperties.
+    */
+    std::string parameterName, unit, group, textValues;
+    float minValue = 0, maxValue = 1.0f, step = 0, initialValue = 0;
+    std::optional<int64_t> rampFrames;
+    bool isAutomatable = true, isBoolean = false, isHidden = false;
+};
+
 //==============================================================================
 /**
     Contains properties describing the unchanging characteristics of an input
@@ -125,6 +144,7 @@ struct EndpointDetails
     */
     ArrayWithPreallocation<choc::value::Type, 2> dataTypes;
     Annotation annotation;
+    EndpointMetadata metadata;
 };
 
 } // namespace soul
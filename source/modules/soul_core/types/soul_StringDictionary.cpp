@@ -32,12 +32,15 @@ namespace soul
         if (text.empty())
             return {};
 
-        for (auto& s : strings)
-            if (s.text == text)
-                return s.handle;
+        auto matches = itemsByText.equal_range (std::hash<std::string_view>() (text));
+
+        for (auto i = matches.first; i != matches.second; ++i)
+            if (strings[i->second].text == text)
+                return strings[i->second].handle;
 
         auto handle = StringDictionary::Handle { nextIndex++ };
         strings.push_back ({ handle, std::string (text) });
+        addToIndexes (strings.size() - 1);
         return handle;
     }
 
@@ -46,11 +49,54 @@ namespace soul
         if (handle == Handle())
             return {};
 
-        for (auto& s : strings)
-            if (s.handle == handle)
-                return s.text;
+        auto i = itemsByHandle.find (handle.handle);
+
+        if (i != itemsByHandle.end())
+            return strings[i->second].text;
 
         SOUL_ASSERT_FALSE;
         return {};
     }
+
+    void StringDictionary::addItem (Item i)
+    {
+        nextIndex = std::max (nextIndex, i.handle.handle + 1);
+        strings.push_back (std::move (i));
+        addToIndexes (strings.size() - 1);
+    }
+
+    void StringDictionary::reserve (size_t numStrings)
+    {
+        strings.reserve (numStrings);
+        itemsByText.reserve (numStrings);
+        itemsByHandle.reserve (numStrings);
+    }
+
+    size_t StringDictionary::getMemoryUsage() const
+    {
+        auto total = getVectorMemoryUsage (strings)
+                       + getHashContainerMemoryUsage (itemsByText)
+                       + getHashContainerMemoryUsage (itemsByHandle);
+
+        for (auto& s : strings)
+            total += s.text.capacity();
+
+        return total;
+    }
+
+    void StringDictionary::addToIndexes (size_t itemIndex)
+    {
+        auto& item = strings[itemIndex];
+        itemsByText.insert ({ std::hash<std::string_view>() (item.text), itemIndex });
+        itemsByHandle[item.handle.handle] = itemIndex;
+    }
+
+    void StringDictionary::rebuildIndexes()
+    {
+        itemsByText.clear();
+        itemsByHandle.clear();
+
+        for (size_t i = 0; i < strings.size(); ++i)
+            addToIndexes (i);
+    }
 }
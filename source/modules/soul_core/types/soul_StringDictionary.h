@@ -38,10 +38,37 @@ public:
         std::string text;
     };
 
+    /** The items in the dictionary. This is indexed internally, so don't modify it directly -
+        use addItem() and removeItemsIf() instead.
+    */
     std::vector<Item> strings;
 
+    /** Manually adds an item - obviously to be used with care. */
+    void addItem (Item);
+
+    /** Removes all the items for which the predicate returns true. */
+    template <typename Predicate>
+    void removeItemsIf (Predicate&& shouldRemove)
+    {
+        if (removeIf (strings, shouldRemove))
+            rebuildIndexes();
+    }
+
+    /** Pre-allocates space for the given number of strings. */
+    void reserve (size_t numStrings);
+
+    /** Returns an estimate of the number of bytes used by the dictionary and its strings. */
+    size_t getMemoryUsage() const;
+
 private:
     uint32_t nextIndex = 1;
+
+    // Indexes into the strings array, looked up by a hash of the text, and by handle
+    std::unordered_multimap<size_t, size_t> itemsByText;
+    std::unordered_map<uint32_t, size_t> itemsByHandle;
+
+    void addToIndexes (size_t itemIndex);
+    void rebuildIndexes();
 };
 
 
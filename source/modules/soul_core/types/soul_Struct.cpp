@@ -25,6 +25,16 @@ namespace soul
  #error "Don't add this cpp file to your build, it gets included indirectly by soul_core.cpp"
 #endif
 
+//==============================================================================
+static std::atomic<uint32_t> structureLayoutVersion { 1 };
+
+void Structure::invalidateLayouts()
+{
+    // 0 is reserved for an empty cache
+    if (++structureLayoutVersion == 0)
+        ++structureLayoutVersion;
+}
+
 //==============================================================================
 Structure::Structure (std::string nm, void* backlink)
   : backlinkToASTObject (backlink), name (std::move (nm))
@@ -34,17 +44,20 @@ Structure::Structure (std::string nm, void* backlink)
 
 Structure::Member& Structure::getMemberWithName (std::string_view memberName)
 {
+    invalidateLayouts();
     return members[getMemberIndex (memberName)];
 }
 
 void Structure::addMember (Type type, std::string memberName)
 {
+    invalidateLayouts();
     memberIndexMap[memberName] = members.size();
     members.push_back ({ std::move (type), std::move (memberName) });
 }
 
 void Structure::removeMember (std::string_view memberName)
 {
+    invalidateLayouts();
     auto i = getMemberIndex (memberName);
 
     for (auto& m : memberIndexMap)
@@ -87,12 +100,34 @@ bool Structure::isEmpty() const noexcept
 
 size_t Structure::getPackedSizeInBytes() const
 {
+    auto version = structureLayoutVersion.load();
+    auto cached = cachedLayout.sizeAndVersion.load (std::memory_order_relaxed);
+
+    if (static_cast<uint32_t> (cached >> 32) == version)
+        return static_cast<size_t> (cached & 0xffffffffu);
+
     size_t total = 0;
 
     for (auto& m : members)
         total += m.type.getPackedSizeInBytes();
 
-    return std::max ((size_t) 1, total);
+    total = std::max ((size_t) 1, total);
+
+    if (total <= 0xffffffffu)
+        cachedLayout.sizeAndVersion.store ((static_cast<uint64_t> (version) << 32) | total, std::memory_order_relaxed);
+
+    return total;
+}
+
+size_t Structure::getMemberOffset (size_t memberIndex) const
+{
+    SOUL_ASSERT (memberIndex < members.size());
+    size_t offset = 0;
+
+    for (size_t i = 0; i < memberIndex; ++i)
+        offset += members[i].type.getPackedSizeInBytes();
+
+    return offset;
 }
 
 static void checkStructRecursion (Structure* structToCheck, const CodeLocation& location,
@@ -46,7 +46,7 @@ public:
     const std::string& getName() const                              { return name; }
     size_t getNumMembers() const                                    { return members.size(); }
 
-    ArrayWithPreallocation<Member, 8>& getMembers()                 { return members; }
+    ArrayWithPreallocation<Member, 8>& getMembers()                 { invalidateLayouts(); return members; }
     const ArrayWithPreallocation<Member, 8>& getMembers() const     { return members; }
 
     const Type&           getMemberType (size_t i) const            { return members[i].type; }
@@ -70,8 +70,13 @@ public:
     std::string addMemberWithUniqueName (Type, const std::string& memberName);
 
     bool isEmpty() const noexcept;
+
+    /** Returns the packed size, which is cached until any structure is modified. */
     size_t getPackedSizeInBytes() const;
 
+    /** Returns the offset of a member within the packed data. */
+    size_t getMemberOffset (size_t memberIndex) const;
+
     void checkForRecursiveNestedStructs (const CodeLocation&);
 
 private:
@@ -79,6 +84,27 @@ private:
 
     std::string name;
     std::unordered_map<std::string, size_t> memberIndexMap;
+
+    /** Holds the packed size in the low 32 bits, and the layout version that it was
+        calculated for in the high bits. Copies of a structure start with an empty cache.
+    */
+    struct CachedLayout
+    {
+        CachedLayout() = default;
+        CachedLayout (const CachedLayout&) noexcept {}
+        CachedLayout (CachedLayout&&) noexcept {}
+
+        std::atomic<uint64_t> sizeAndVersion { 0 };
+    };
+
+    mutable CachedLayout cachedLayout;
+
+    /** Because a member's type can be a struct which is changed independently, any change to
+        any structure bumps a global version number, which makes all the cached sizes stale.
+        Structures are only modified while compiling, so once a program is built the caches stay
+        valid. Any non-const access to the members counts as a change.
+    */
+    static void invalidateLayouts();
 };
 
 
@@ -386,6 +386,7 @@ bool Type::isBoundedIntWithinLimit (BoundedIntSize maxSize) const
 Type Type::createStruct (Structure& s)           { return Type (s); }
 StructurePtr Type::getStruct() const             { SOUL_ASSERT (isStruct()); return structure; }
 Structure& Type::getStructRef() const            { SOUL_ASSERT (isStruct()); return *structure; }
+bool Type::refersToStruct() const                { return structure != nullptr; }
 
 bool Type::usesStruct (const Structure& s) const
 {
@@ -563,13 +564,9 @@ SubElementPath::TypeAndOffset SubElementPath::getElement (const Type& parentType
 
         if (e.type.isStruct())
         {
-            auto& members = e.type.getStructRef().getMembers();
-            SOUL_ASSERT (index < members.size());
-            e.type = members[index].type;
-
-            for (size_t i = 0; i < index; ++i)
-                e.offset += members[i].type.getPackedSizeInBytes();
-
+            const auto& s = e.type.getStructRef();
+            e.offset += s.getMemberOffset (index);
+            e.type = s.getMemberType (index);
             continue;
         }
 
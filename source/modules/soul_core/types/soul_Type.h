@@ -178,6 +178,8 @@ struct Type  final
     StructurePtr getStruct() const;
     Structure& getStructRef() const;
     bool usesStruct (const Structure&) const;
+    /** Returns true if this is a struct, or an array of structs. */
+    bool refersToStruct() const;
 
     //==============================================================================
     static Type createStringLiteral();
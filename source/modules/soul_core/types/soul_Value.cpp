@@ -55,6 +55,20 @@ struct Value::PackedData
             if (type.isArrayOrVector())
             {
                 p.beginArrayMembers (type);
+                auto elementType = type.getElementType();
+
+                if (elementType.isFloat32() && elementType.isPrimitive())
+                {
+                    p.printFloat32Elements (data, type.getArrayOrVectorSize());
+                    return p.endArrayMembers();
+                }
+
+                if (elementType.isFloat64() && elementType.isPrimitive())
+                {
+                    p.printFloat64Elements (data, type.getArrayOrVectorSize());
+                    return p.endArrayMembers();
+                }
+
                 bool isFirst = true;
 
                 for (ArrayIterator i (*this); i.next();)
@@ -313,26 +327,67 @@ struct Value::PackedData
     template <typename Primitive>
     void negateAs() const                   { setAs (-getAs<Primitive>()); }
 
-    void convertAllHandlesToPointers (ConstantTable& constantTable)
+    void convertAllHandlesToPointers (ConstantTable& constantTable, SharedConstantData::References* sharedReferences)
     {
         if (type.isUnsizedArray())
         {
             auto source = constantTable.getValueForHandle (getAs<ConstantTable::Handle>());
             SOUL_ASSERT (source != nullptr);
-            setAs<void*> (source->getPackedData());
+
+            if (sharedReferences != nullptr && source->getPackedDataSize() >= SharedConstantData::minimumSharedSize)
+            {
+                auto block = SharedConstantData::get (source->getPackedData(), source->getPackedDataSize(),
+                                                      source->getPackedDataOwner());
+                setAs<const void*> (block->getData());
+                sharedReferences->push_back (std::move (block));
+            }
+            else
+            {
+                setAs<void*> (source->getPackedData());
+            }
         }
         else if (type.isArrayOrVector())
         {
             for (ArrayIterator i (*this); i.next();)
-                i.get().convertAllHandlesToPointers (constantTable);
+                i.get().convertAllHandlesToPointers (constantTable, sharedReferences);
+        }
+        else if (type.isStruct())
+        {
+            for (StructIterator i (*this); i.next();)
+                i.get().convertAllHandlesToPointers (constantTable, sharedReferences);
+        }
+    }
+
+    void remapHandles (const Value::ConstantHandleMapper& mapConstant, const Value::StringHandleMapper& mapString)
+    {
+        if (type.isUnsizedArray())
+        {
+            setAs (mapConstant (getAs<ConstantTable::Handle>()));
+        }
+        else if (type.isStringLiteral())
+        {
+            setAs (mapString (getAs<StringDictionary::Handle>()));
+        }
+        else if (type.isArray() && mayContainHandles (type))
+        {
+            for (ArrayIterator i (*this); i.next();)
+                i.get().remapHandles (mapConstant, mapString);
         }
         else if (type.isStruct())
         {
             for (StructIterator i (*this); i.next();)
-                i.get().convertAllHandlesToPointers (constantTable);
+                i.get().remapHandles (mapConstant, mapString);
         }
     }
 
+    static bool mayContainHandles (const Type& t)
+    {
+        if (t.isUnsizedArray() || t.isStringLiteral() || t.isStruct())
+            return true;
+
+        return t.isArray() && mayContainHandles (t.getArrayElementType());
+    }
+
     struct ArrayIterator
     {
         ArrayIterator (const PackedData& p)
@@ -419,31 +474,36 @@ Value& Value::operator= (Value&& other) = default;
 
 Value::Value (Type t)  : type (std::move (t))
 {
-    allocatedData.resize (type.getPackedSizeInBytes());
+    auto size = type.getPackedSizeInBytes();
+
+    if (size > sharedDataThreshold)
+        sharedData = createSharedBlock (nullptr, size);
+    else
+        allocatedData.resize (size);
 }
 
 Value::Value (Type t, const void* sourceData)   : Value (std::move (t))
 {
-    memcpy (getPackedData(), sourceData, getPackedDataSize());
+    memcpy (getWritablePackedData(), sourceData, getPackedDataSize());
 }
 
-Value::Value (int32_t  v)  : Value (Type (PrimitiveType::int32))     { getData().setAs (v); }
-Value::Value (int64_t  v)  : Value (Type (PrimitiveType::int64))     { getData().setAs (v); }
-Value::Value (float    v)  : Value (Type (PrimitiveType::float32))   { getData().setAs (v); }
-Value::Value (double   v)  : Value (Type (PrimitiveType::float64))   { getData().setAs (v); }
-Value::Value (bool     v)  : Value (Type (PrimitiveType::bool_))     { getData().setAs (v ? (uint8_t) 1 : (uint8_t) 0); }
+Value::Value (int32_t  v)  : Value (Type (PrimitiveType::int32))     { getWritableData().setAs (v); }
+Value::Value (int64_t  v)  : Value (Type (PrimitiveType::int64))     { getWritableData().setAs (v); }
+Value::Value (float    v)  : Value (Type (PrimitiveType::float32))   { getWritableData().setAs (v); }
+Value::Value (double   v)  : Value (Type (PrimitiveType::float64))   { getWritableData().setAs (v); }
+Value::Value (bool     v)  : Value (Type (PrimitiveType::bool_))     { getWritableData().setAs (v ? (uint8_t) 1 : (uint8_t) 0); }
 
 Value Value::createArrayOrVector (Type t, ArrayView<Value> elements)
 {
     Value v (std::move (t));
-    v.getData().setFrom (elements);
+    v.getWritableData().setFrom (elements);
     return v;
 }
 
 Value Value::createStruct (Structure& s, ArrayView<Value> members)
 {
     Value v (Type::createStruct (s));
-    v.getData().setFrom (members);
+    v.getWritableData().setFrom (members);
     return v;
 }
 
@@ -451,21 +511,21 @@ Value Value::createUnsizedArray (const Type& elementType, ConstantTable::Handle
 {
     SOUL_ASSERT (! elementType.isUnsizedArray());  // this may need to be removed at some point, but is here as a useful sanity-check
     Value v (elementType.createUnsizedArray());
-    v.getData().setAs (h);
+    v.getWritableData().setAs (h);
     return v;
 }
 
 Value Value::createFloatVectorArray (choc::buffer::InterleavedView<float> data)
 {
     Value v (Type::createVector (PrimitiveType::float32, data.getNumChannels()).createArray (data.getNumFrames()));
-    copy (v.getAsChannelSet32(), data);
+    copy (v.getWritableData().getAsChannelSet32(), data);
     return v;
 }
 
 Value Value::createFloatVectorArray (choc::buffer::ChannelArrayView<float> data)
 {
     Value v (Type::createVector (PrimitiveType::float32, data.getNumChannels()).createArray (data.getNumFrames()));
-    copy (v.getAsChannelSet32(), data);
+    copy (v.getWritableData().getAsChannelSet32(), data);
     return v;
 }
 
@@ -481,7 +541,21 @@ Value Value::zeroInitialiser (Type t)
 Value Value::createStringLiteral (StringDictionary::Handle h)
 {
     Value v (Type::createStringLiteral());
-    v.getData().setAs (h);
+    v.getWritableData().setAs (h);
+    return v;
+}
+
+Value Value::createFromExternalData (Type type, const void* sourceData, size_t dataSize, std::shared_ptr<const void> owner)
+{
+    ignoreUnused (dataSize);
+    SOUL_ASSERT (owner != nullptr && dataSize == type.getPackedSizeInBytes());
+
+    Value v;
+    v.type = std::move (type);
+    v.sharedData = std::make_shared<SharedBlock>();
+    v.sharedData->data = static_cast<uint8_t*> (const_cast<void*> (sourceData));
+    v.sharedData->size = dataSize;
+    v.sharedData->externalOwner = std::move (owner);
     return v;
 }
 
@@ -491,7 +565,7 @@ Value Value::createFromRawData (Type type, const void* sourceData, size_t dataSi
 
     Value v (std::move (type));
     SOUL_ASSERT (dataSize == v.getPackedDataSize());
-    memcpy (v.getPackedData(), sourceData, v.getPackedDataSize());
+    memcpy (v.getWritablePackedData(), sourceData, v.getPackedDataSize());
     return v;
 }
 
@@ -518,7 +592,39 @@ Type& Value::getMutableType()                               { return type; }
 Value::PackedData Value::getData() const
 {
     SOUL_ASSERT (isValid());
-    return PackedData (type, allocatedData.data(), allocatedData.size());
+    return PackedData (type, static_cast<uint8_t*> (getPackedData()), getPackedDataSize());
+}
+
+Value::PackedData Value::getWritableData()
+{
+    SOUL_ASSERT (isValid());
+    return PackedData (type, getWritablePackedData(), getPackedDataSize());
+}
+
+uint8_t* Value::getWritablePackedData()
+{
+    if (sharedData == nullptr)
+        return allocatedData.data();
+
+    // If another Value is sharing this data, or it belongs to something else, this
+    // needs its own copy before it can be changed
+    if (sharedData.use_count() > 1 || sharedData->externalOwner != nullptr)
+        sharedData = createSharedBlock (sharedData->data, sharedData->size);
+
+    return sharedData->data;
+}
+
+std::shared_ptr<Value::SharedBlock> Value::createSharedBlock (const void* sourceData, size_t size)
+{
+    auto block = std::make_shared<SharedBlock>();
+    block->ownedData.reset (sourceData != nullptr ? new uint8_t[size] : new uint8_t[size]());
+    block->data = block->ownedData.get();
+    block->size = size;
+
+    if (sourceData != nullptr)
+        memcpy (block->data, sourceData, size);
+
+    return block;
 }
 
 void Value::print (ValuePrinter& p) const                   { getData().print (p); }
@@ -528,6 +634,39 @@ std::string Value::getDescription (const StringDictionary* dictionary) const
     struct DefaultPrinter  : public ValuePrinter
     {
         void print (std::string_view s) override  { out << s; }
+
+        void printFloat32Elements (const void* elements, size_t numElements) override
+        {
+            std::string s;
+            s.reserve (numElements * 14);
+
+            for (size_t i = 0; i < numElements; ++i)
+            {
+                if (i != 0)
+                    s += ", ";
+
+                appendFloat32 (s, readUnaligned<float> (elements, i * sizeof (float)));
+            }
+
+            print (s);
+        }
+
+        void printFloat64Elements (const void* elements, size_t numElements) override
+        {
+            std::string s;
+            s.reserve (numElements * 22);
+
+            for (size_t i = 0; i < numElements; ++i)
+            {
+                if (i != 0)
+                    s += ", ";
+
+                appendFloat64 (s, readUnaligned<double> (elements, i * sizeof (double)));
+            }
+
+            print (s);
+        }
+
         std::ostringstream out;
     };
 
@@ -540,27 +679,27 @@ std::string Value::getDescription (const StringDictionary* dictionary) const
 Value Value::getSubElement (const SubElementPath& path) const
 {
     auto typeAndOffset = path.getElement (type);
-    return Value (std::move (typeAndOffset.type), allocatedData.data() + typeAndOffset.offset);
+    return Value (std::move (typeAndOffset.type), static_cast<const uint8_t*> (getPackedData()) + typeAndOffset.offset);
 }
 
 void Value::modifySubElementInPlace (const SubElementPath& path, const void* newData)
 {
     auto typeAndOffset = path.getElement (type);
-    memcpy (allocatedData.data() + typeAndOffset.offset, newData, typeAndOffset.type.getPackedSizeInBytes());
+    memcpy (getWritablePackedData() + typeAndOffset.offset, newData, typeAndOffset.type.getPackedSizeInBytes());
 }
 
 void Value::modifySubElementInPlace (const SubElementPath& path, const Value& newValue)
 {
     auto typeAndOffset = path.getElement (type);
     SOUL_ASSERT (typeAndOffset.type.hasIdenticalLayout (newValue.getType()));
-    memcpy (allocatedData.data() + typeAndOffset.offset, newValue.getPackedData(), newValue.getPackedDataSize());
+    memcpy (getWritablePackedData() + typeAndOffset.offset, newValue.getPackedData(), newValue.getPackedDataSize());
 }
 
 void Value::setFromSubElementData (const Value& sourceValue, const SubElementPath& sourceValueSubElementPath)
 {
     auto typeAndOffset = sourceValueSubElementPath.getElement (sourceValue.type);
     SOUL_ASSERT (typeAndOffset.type.isEqual (type, Type::ignoreVectorSize1 | Type::duckTypeStructures | Type::treatStringAsInt32));
-    memcpy (getPackedData(), sourceValue.allocatedData.data() + typeAndOffset.offset, getPackedDataSize());
+    memcpy (getWritablePackedData(), static_cast<const uint8_t*> (sourceValue.getPackedData()) + typeAndOffset.offset, getPackedDataSize());
 }
 
 Value Value::getSlice (size_t start, size_t end) const
@@ -573,7 +712,7 @@ Value Value::getSlice (size_t start, size_t end) const
         auto elementType = type.getElementType();
         auto elementSize = elementType.getPackedSizeInBytes();
 
-        return Value (type.createCopyWithNewArraySize (end - start), allocatedData.data() + elementSize * start);
+        return Value (type.createCopyWithNewArraySize (end - start), static_cast<const uint8_t*> (getPackedData()) + elementSize * start);
     }
 
     SOUL_ASSERT_FALSE;
@@ -584,7 +723,11 @@ void Value::copyValue (const Value& source)
 {
     if (type.isIdentical (source.type))
     {
-        memcpy (allocatedData.data(), source.allocatedData.data(), allocatedData.size());
+        if (source.sharedData != nullptr && getPackedDataSize() == source.getPackedDataSize())
+            sharedData = source.sharedData;
+        else
+            memcpy (getWritablePackedData(), source.getPackedData(), getPackedDataSize());
+
         return;
     }
 
@@ -599,7 +742,7 @@ bool Value::canNegate() const
 Value Value::negated() const
 {
     Value v (*this);
-    v.getData().negate();
+    v.getWritableData().negate();
     return v;
 }
 
@@ -616,12 +759,14 @@ bool Value::operator!= (const Value& other) const       { return ! operator== (o
 Value Value::cloneWithEquivalentType (Type newType) const
 {
     SOUL_ASSERT (newType.hasIdenticalLayout (type));
-    return Value (std::move (newType), getPackedData());
+    Value v (*this);  // NB: copying means that any shared data block is shared with the new value too
+    v.type = std::move (newType);
+    return v;
 }
 
 void Value::clear()
 {
-    getData().clear();
+    getWritableData().clear();
 }
 
 Value Value::tryCastToType (const Type& destType) const
@@ -637,7 +782,7 @@ Value Value::tryCastToType (const Type& destType) const
         return {};
 
     Value v (destType);
-    v.getData().setFrom (getData());
+    v.getWritableData().setFrom (getData());
     return v;
 }
 
@@ -665,26 +810,39 @@ Value Value::castToTypeExpectingSuccess (const Type& destType) const
 
 void Value::convertAllHandlesToPointers (ConstantTable& constantTable)
 {
-    getData().convertAllHandlesToPointers (constantTable);
+    getWritableData().convertAllHandlesToPointers (constantTable, nullptr);
+}
+
+void Value::convertAllHandlesToSharedPointers (ConstantTable& constantTable, SharedConstantData::References& sharedReferences)
+{
+    getWritableData().convertAllHandlesToPointers (constantTable, std::addressof (sharedReferences));
+}
+
+void Value::remapHandles (const ConstantHandleMapper& mapConstant, const StringHandleMapper& mapString)
+{
+    if (PackedData::mayContainHandles (type))
+        getWritableData().remapHandles (mapConstant, mapString);
 }
 
 void Value::modifyArraySizeInPlace (size_t newSize)
 {
     SOUL_ASSERT (type.isArray());
     auto newType = type.createCopyWithNewArraySize ((Type::ArraySize) newSize);
-    SOUL_ASSERT (newType.getPackedSizeInBytes() <= allocatedData.size());
+    SOUL_ASSERT (newType.getPackedSizeInBytes() <= getPackedDataSize());
     type = std::move (newType);
 }
 
 //==============================================================================
 Value Value::fromExternalValue (const Type& targetType, const choc::value::ValueView& sourceValue,
-                                ConstantTable& constantTable, StringDictionary& stringDictionary)
+                                ConstantTable& constantTable, StringDictionary& stringDictionary,
+                                std::shared_ptr<const void> sourceDataOwner)
 {
     // put all conversion state into a single object to avoid lambdas needing to capture more than a single pointer to the state
     struct ConversionState
     {
         ConstantTable& constants;
         StringDictionary& dictionary;
+        std::shared_ptr<const void> sourceDataOwner;
 
         static Value castOrThrow (const Type& type, Value&& v)
         {
@@ -700,6 +858,36 @@ Value Value::fromExternalValue (const Type& targetType, const choc::value::Value
             return result;
         }
 
+        // True if the source element type is stored in exactly the same way as the target's
+        // packed element type, e.g. a float<1> frame of an audio file and a float
+        static bool hasSamePackedLayout (const Type& target, const choc::value::Type& source)
+        {
+            if (! target.isPrimitiveOrVector())
+                return false;
+
+            auto numElements = target.isVector() ? target.getVectorSize() : 1;
+            auto sourceElementType = source.isVector() ? source.getElementType() : source;
+
+            if (numElements != (source.isVector() ? source.getNumElements() : 1))
+                return false;
+
+            return (target.isFloat32() && sourceElementType.isFloat32())
+                || (target.isFloat64() && sourceElementType.isFloat64())
+                || (target.isInteger32() && sourceElementType.isInt32())
+                || (target.isInteger64() && sourceElementType.isInt64());
+        }
+
+        Value createFromPackedArray (const Type& arrayType, const choc::value::ValueView& source) const
+        {
+            auto size = arrayType.getPackedSizeInBytes();
+            SOUL_ASSERT (size == source.getType().getValueDataSize());
+
+            if (sourceDataOwner != nullptr && size > sharedDataThreshold)
+                return Value::createFromExternalData (arrayType, source.getRawData(), size, sourceDataOwner);
+
+            return Value::createFromRawData (arrayType, source.getRawData(), size);
+        }
+
         Value convert (const Type& targetType, const choc::value::ValueView& source)
         {
             if (source.isInt32())    return castOrThrow (targetType, Value::createInt32 (source.getInt32()));
@@ -743,6 +931,11 @@ Value Value::fromExternalValue (const Type& targetType, const choc::value::Value
                     throwError (Errors::cannotCastBetween ("array[" + std::to_string (size) + "]", targetType.getDescription()));
 
                 auto elementType = targetType.getArrayElementType();
+
+                if (size != 0 && source.getType().isUniformArray()
+                     && hasSamePackedLayout (elementType, source.getType().getElementType()))
+                    return castOrThrow (targetType, createFromPackedArray (elementType.createArray (size), source));
+
                 auto result = Value::zeroInitialiser (elementType.createArray (size));
 
                 for (uint32_t i = 0; i < size; ++i)
@@ -795,7 +988,7 @@ Value Value::fromExternalValue (const Type& targetType, const choc::value::Value
         }
     };
 
-    ConversionState c { constantTable, stringDictionary };
+    ConversionState c { constantTable, stringDictionary, std::move (sourceDataOwner) };
     return c.convert (targetType, sourceValue);
 }
 
@@ -876,22 +1069,50 @@ void ValuePrinter::printBool (bool b)                    { print (b ? "true" : "
 void ValuePrinter::printInt32 (int32_t v)                { print (std::to_string (v)); }
 void ValuePrinter::printInt64 (int64_t v)                { print (std::to_string (v) + "L"); }
 
-void ValuePrinter::printFloat32 (float value)
+void ValuePrinter::printFloat32 (float value)    { std::string s; appendFloat32 (s, value); print (s); }
+void ValuePrinter::printFloat64 (double value)   { std::string s; appendFloat64 (s, value); print (s); }
+
+void ValuePrinter::appendFloat32 (std::string& s, float value)
 {
-    if (value == 0)             return print ("0");
-    if (std::isnan (value))     return print ("_nan32");
-    if (std::isinf (value))     return print (value > 0 ? "_inf32" : "_ninf32");
+    if (value == 0)             { s += "0"; return; }
+    if (std::isnan (value))     { s += "_nan32"; return; }
+    if (std::isinf (value))     { s += (value > 0 ? "_inf32" : "_ninf32"); return; }
 
-    return print (choc::text::floatToString (value) + "f");
+    choc::text::FloatToStringBuffer<float> text (value);
+    s.append (text.begin(), text.end());
+    s += 'f';
 }
 
-void ValuePrinter::printFloat64 (double value)
+void ValuePrinter::appendFloat64 (std::string& s, double value)
 {
-    if (value == 0)             return print ("0");
-    if (std::isnan (value))     return print ("_nan64");
-    if (std::isinf (value))     return print (value > 0 ? "_inf64" : "_ninf64");
+    if (value == 0)             { s += "0"; return; }
+    if (std::isnan (value))     { s += "_nan64"; return; }
+    if (std::isinf (value))     { s += (value > 0 ? "_inf64" : "_ninf64"); return; }
+
+    choc::text::FloatToStringBuffer<double> text (value);
+    s.append (text.begin(), text.end());
+}
 
-    return print (choc::text::floatToString (value));
+void ValuePrinter::printFloat32Elements (const void* elements, size_t numElements)
+{
+    for (size_t i = 0; i < numElements; ++i)
+    {
+        if (i != 0)
+            printArrayMemberSeparator();
+
+        printFloat32 (readUnaligned<float> (elements, i * sizeof (float)));
+    }
+}
+
+void ValuePrinter::printFloat64Elements (const void* elements, size_t numElements)
+{
+    for (size_t i = 0; i < numElements; ++i)
+    {
+        if (i != 0)
+            printArrayMemberSeparator();
+
+        printFloat64 (readUnaligned<double> (elements, i * sizeof (double)));
+    }
 }
 
 void ValuePrinter::beginStructMembers (const Type&)       { print ("{ "); }
@@ -29,8 +29,11 @@ namespace soul
     etc, including nested types.
 
     Value can be passed by-value and for simple types will be pretty lightweight without
-    any heap storage, but obviously since it could contain megabytes of structured data
-    you should be a little wary of copying these too freely.
+    any heap storage. Values whose packed data is bigger than sharedDataThreshold keep it in
+    a reference-counted block which is shared between copies, and only duplicated when one
+    of the copies is modified, so copying a large table is cheap until it's changed.
+    A value can also be made to refer to data that belongs to something else, such as a
+    decoded audio file, with createFromExternalData().
 */
 struct Value  final
 {
@@ -59,6 +62,13 @@ struct Value  final
     static Value createUnsizedArray (const Type& elementType, ConstantTable::Handle);
     static Value createFromRawData (Type type, const void* data, size_t dataSize);
 
+    /** Creates a value which refers to a block of packed data that belongs to something else,
+        rather than copying it. The owner is kept alive for as long as any copy of the value
+        refers to the data, and the data mustn't change during that time. If the value is
+        modified, it first takes its own copy of the data.
+    */
+    static Value createFromExternalData (Type type, const void* data, size_t dataSize, std::shared_ptr<const void> owner);
+
     /** Creates an array of float vectors to match the size of the data provided. */
     static Value createFloatVectorArray (choc::buffer::InterleavedView<float> data);
     static Value createFloatVectorArray (choc::buffer::ChannelArrayView<float> data);
@@ -99,12 +109,28 @@ struct Value  final
     void print (ValuePrinter&) const;
 
     /** Internally the entire value (including all nested objects) is stored as a continguous packed chunk of
-        memory - this provides access to it with all the dangers that entails.
+        memory - this provides access to it with all the dangers that entails. Because the data may be
+        shared with other copies of the Value, it must only be read, and never modified through this pointer.
     */
-    void* getPackedData() const                    { return allocatedData.data(); }
+    void* getPackedData() const                    { return sharedData != nullptr ? sharedData->data : allocatedData.data(); }
 
     /** The total size of the packed data which fully represents this object. */
-    size_t getPackedDataSize() const               { return allocatedData.size(); }
+    size_t getPackedDataSize() const               { return sharedData != nullptr ? sharedData->size : allocatedData.size(); }
+
+    /** If the packed data is kept in a shared block, this returns a pointer which keeps that
+        block alive, so that the data can be used after this Value has gone. While any of these
+        pointers exist, modifying the Value makes it take a new copy of its data. For values
+        which are small enough to be stored internally, this returns nullptr.
+    */
+    std::shared_ptr<const void> getPackedDataOwner() const     { return sharedData; }
+
+    /** Values whose packed data is no larger than this number of bytes keep it inside the Value
+        object itself, so that primitives and small vectors (up to a float64<4>) never allocate.
+    */
+    static constexpr size_t inlineDataSize = 32;
+
+    /** Values whose packed data is larger than this number of bytes share it between copies. */
+    static constexpr size_t sharedDataThreshold = 512;
 
     /** Assuming the value is an array of float32 primitives or vectors, this returns a channel set
         which points directly into the packed data.
@@ -161,21 +187,55 @@ struct Value  final
 
     void convertAllHandlesToPointers (ConstantTable&);
 
+    /** Like convertAllHandlesToPointers(), but any arrays which are big enough to be worth sharing
+        are pointed at a copy of their data in the SharedConstantData store. The references to those
+        blocks are added to the list provided, which must be kept for as long as this value is used.
+    */
+    void convertAllHandlesToSharedPointers (ConstantTable&, SharedConstantData::References&);
+
+    using ConstantHandleMapper = std::function<ConstantTable::Handle(ConstantTable::Handle)>;
+    using StringHandleMapper   = std::function<StringDictionary::Handle(StringDictionary::Handle)>;
+
+    /** Replaces any constant and string handles that this value contains with new ones, e.g. when
+        moving it to a program which has a different ConstantTable and StringDictionary.
+    */
+    void remapHandles (const ConstantHandleMapper&, const StringHandleMapper&);
+
     bool operator== (const Value&) const;
     bool operator!= (const Value&) const;
 
     /** Copies the value from the source value - this is only valid if the type are identical. */
     void copyValue (const Value& source);
 
-    static Value fromExternalValue (const Type& targetType, const choc::value::ValueView&, ConstantTable&, StringDictionary&);
+    /** Converts a choc value to the given type. Arrays whose elements are already laid out in
+        the same way as the target type are copied in one go rather than element by element, and
+        if an owner is given for the source's data, large ones refer to it instead of copying it
+        (see createFromExternalData()).
+    */
+    static Value fromExternalValue (const Type& targetType, const choc::value::ValueView&, ConstantTable&, StringDictionary&,
+                                    std::shared_ptr<const void> sourceDataOwner = {});
     choc::value::Value toExternalValue (const ConstantTable&, const StringDictionary&) const;
 
 private:
     Type type;
-    ArrayWithPreallocation<uint8_t, 8> allocatedData;
+    ArrayWithPreallocation<uint8_t, inlineDataSize> allocatedData;
+
+    struct SharedBlock
+    {
+        uint8_t* data = nullptr;
+        size_t size = 0;
+        std::unique_ptr<uint8_t[]> ownedData;           ///< Null if the data belongs to externalOwner
+        std::shared_ptr<const void> externalOwner;
+    };
+
+    std::shared_ptr<SharedBlock> sharedData;
+
+    static std::shared_ptr<SharedBlock> createSharedBlock (const void* sourceData, size_t size);
 
     struct PackedData;
     PackedData getData() const;
+    PackedData getWritableData();
+    uint8_t* getWritablePackedData();
 
     Value (Type);
     Value (Type, const void*);
@@ -207,6 +267,18 @@ struct ValuePrinter
     virtual void printVectorMemberSeparator();
     virtual void endVectorMembers();
 
+    /** These are given the packed elements of an array or vector of float primitives. The default
+        versions call printArrayMemberSeparator() and printFloat32() or printFloat64() for each one,
+        but a printer that deals with large constant tables can override them to format the whole
+        list in one go with appendFloat32() or appendFloat64().
+    */
+    virtual void printFloat32Elements (const void* elements, size_t numElements);
+    virtual void printFloat64Elements (const void* elements, size_t numElements);
+
+    /** Appends a value in the format used by printFloat32() and printFloat64(). */
+    static void appendFloat32 (std::string&, float);
+    static void appendFloat64 (std::string&, double);
+
     virtual void printStringLiteral (StringDictionary::Handle);
     virtual void printUnsizedArrayContent (const Type& arrayType, const void*);
 
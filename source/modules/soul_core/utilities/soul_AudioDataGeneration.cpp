@@ -30,91 +30,193 @@ namespace soul
 namespace WaveGenerators
 {
     //==============================================================================
-    struct Generator
+    /*  Each wave is written as a function of its phase which works on either a plain double or
+        a DoublePair, so that the same code fills the bulk of a block two frames at a time with
+        SIMD, and then finishes off any remainder. The phases themselves are accumulated in the
+        same way as a per-sample oscillator would, so the results don't drift for long blocks.
+    */
+    inline double select (bool condition, double a, double b)   { return condition ? a : b; }
+
+   #if SOUL_INTEL || SOUL_ARM64
+    struct DoublePair
     {
-        Generator() = default;
-        virtual ~Generator() = default;
-
-        void init (double frequency, double sampleRate)
-        {
-            phaseIncrement = frequency / sampleRate;
-        }
+       #if SOUL_INTEL
+        using Vector = __m128d;
+        using Mask = __m128d;
+
+        DoublePair (double value)                           : v (_mm_set1_pd (value)) {}
+        DoublePair (double first, double second)            : v (_mm_set_pd (second, first)) {}
+        explicit DoublePair (Vector value)                  : v (value) {}
+
+        friend DoublePair operator+ (DoublePair a, DoublePair b)   { return DoublePair (_mm_add_pd (a.v, b.v)); }
+        friend DoublePair operator- (DoublePair a, DoublePair b)   { return DoublePair (_mm_sub_pd (a.v, b.v)); }
+        friend DoublePair operator* (DoublePair a, DoublePair b)   { return DoublePair (_mm_mul_pd (a.v, b.v)); }
+        friend DoublePair operator- (DoublePair a)                 { return DoublePair (_mm_xor_pd (a.v, _mm_set1_pd (-0.0))); }
+        friend Mask operator<  (DoublePair a, DoublePair b)        { return _mm_cmplt_pd (a.v, b.v); }
+        friend Mask operator>  (DoublePair a, DoublePair b)        { return _mm_cmpgt_pd (a.v, b.v); }
+        friend Mask operator>= (DoublePair a, DoublePair b)        { return _mm_cmpge_pd (a.v, b.v); }
+
+        void storeAsFloats (float* dest) const      { _mm_storel_pi (reinterpret_cast<__m64*> (dest), _mm_cvtpd_ps (v)); }
+       #else
+        using Vector = float64x2_t;
+        using Mask = uint64x2_t;
+
+        DoublePair (double value)                           : v (vdupq_n_f64 (value)) {}
+        DoublePair (double first, double second)            : v (vsetq_lane_f64 (second, vdupq_n_f64 (first), 1)) {}
+        explicit DoublePair (Vector value)                  : v (value) {}
+
+        friend DoublePair operator+ (DoublePair a, DoublePair b)   { return DoublePair (vaddq_f64 (a.v, b.v)); }
+        friend DoublePair operator- (DoublePair a, DoublePair b)   { return DoublePair (vsubq_f64 (a.v, b.v)); }
+        friend DoublePair operator* (DoublePair a, DoublePair b)   { return DoublePair (vmulq_f64 (a.v, b.v)); }
+        friend DoublePair operator- (DoublePair a)                 { return DoublePair (vnegq_f64 (a.v)); }
+        friend Mask operator<  (DoublePair a, DoublePair b)        { return vcltq_f64 (a.v, b.v); }
+        friend Mask operator>  (DoublePair a, DoublePair b)        { return vcgtq_f64 (a.v, b.v); }
+        friend Mask operator>= (DoublePair a, DoublePair b)        { return vcgeq_f64 (a.v, b.v); }
+
+        void storeAsFloats (float* dest) const      { vst1_f32 (dest, vcvt_f32_f64 (v)); }
+       #endif
+
+        Vector v;
+    };
 
-        virtual double getSample() = 0;
+    inline DoublePair select (DoublePair::Mask condition, DoublePair a, DoublePair b)
+    {
+       #if SOUL_INTEL
+        return DoublePair (_mm_or_pd (_mm_and_pd (condition, a.v), _mm_andnot_pd (condition, b.v)));
+       #else
+        return DoublePair (vbslq_f64 (condition, a.v, b.v));
+       #endif
+    }
+   #endif
 
-        void advance()
+    //==============================================================================
+    struct Phase
+    {
+        double next() noexcept
         {
-            currentPhase += phaseIncrement;
+            auto phase = current;
+            current += increment;
 
-            while (currentPhase >= 1.0)
-                currentPhase -= 1.0;
+            while (current >= 1.0)
+                current -= 1.0;
+
+            return phase;
         }
 
-        double phaseIncrement = 0;
-        double currentPhase   = 0;
+        double increment;
+        double current = 0;
     };
 
+    template <typename Value>
+    Value wrapPhase (Value phase)
+    {
+        return select (phase >= 1.0, phase - 1.0, phase);
+    }
 
-    //==============================================================================
-    struct Sine  : public Generator
+    /*  The phase is folded into the quarter-cycle either side of zero, where a Taylor series up to
+        the 21st power is accurate to well beyond the precision of the floats that are stored.
+    */
+    template <typename Value>
+    Value sine (Value phase)
     {
-        double getSample() override
+        static constexpr double coefficients[] =
         {
-            return std::sin (currentPhase * twoPi);
-        }
-    };
+            1.0, -1.0 / 6.0, 1.0 / 120.0, -1.0 / 5040.0, 1.0 / 362880.0, -1.0 / 39916800.0,
+            1.0 / 6227020800.0, -1.0 / 1307674368000.0, 1.0 / 355687428096000.0,
+            -1.0 / 121645100408832000.0, 1.0 / 51090942171709440000.0
+        };
 
-    //==============================================================================
-    struct Blep  : public Generator
+        auto x = phase - select (phase >= 0.5, 1.0, 0.0);
+        x = select (x > 0.25, 0.5 - x, x);
+        x = select (x < -0.25, -0.5 - x, x);
+
+        auto angle = x * twoPi;
+        auto angleSquared = angle * angle;
+        Value sum (coefficients[std::size (coefficients) - 1]);
+
+        for (auto i = std::size (coefficients) - 1; i > 0; --i)
+            sum = sum * angleSquared + coefficients[i - 1];
+
+        return sum * angle;
+    }
+
+    /*  The polyBLEP residual, which smooths the step at phase 0 from +1 to -1 over the samples
+        either side of it, and the polyBLAMP residual, which is its integral, and smooths a
+        change of slope in the same way.
+    */
+    template <typename Value>
+    Value blep (Value phase, double increment)
     {
-        double blep (double phase)
-        {
-            if (phase < phaseIncrement)
-            {
-                phase = phase / phaseIncrement;
-                return (phase + phase) - (phase * phase) - 1.0f;
-            }
+        auto before = phase * (1.0 / increment) - 1.0;
+        auto after = (phase - 1.0) * (1.0 / increment) + 1.0;
 
-            if (phase > (1.0f - phaseIncrement))
-            {
-                phase = (phase - 1.0f) / phaseIncrement;
-                return (phase * phase) + (phase + phase) + 1.0f;
-            }
+        return select (phase < increment, -(before * before),
+                       select (phase > 1.0 - increment, after * after, 0.0));
+    }
 
-            return 0;
-        }
-    };
+    template <typename Value>
+    Value blamp (Value phase, double increment)
+    {
+        auto before = 1.0 - phase * (1.0 / increment);
+        auto after = (phase - 1.0) * (1.0 / increment) + 1.0;
 
-    //==============================================================================
-    struct Saw  : public Blep
+        return select (phase < increment, before * before * before * (1.0 / 3.0),
+                       select (phase > 1.0 - increment, after * after * after * (1.0 / 3.0), 0.0));
+    }
+
+    template <typename Value>
+    Value sawtooth (Value phase, double increment, bool bandLimited)
     {
-        double getSample() override
-        {
-            return -1.0 + (2.0 * currentPhase) - blep (currentPhase);
-        }
-    };
+        auto naive = phase * 2.0 - 1.0;
+        return bandLimited ? naive - blep (phase, increment) : naive;
+    }
 
-    //==============================================================================
-    struct Square  : public Blep
+    template <typename Value>
+    Value square (Value phase, double increment, bool bandLimited)
     {
-        double getSample() override
+        auto naive = select (phase < 0.5, -1.0, 1.0);
+        return bandLimited ? naive - blep (phase, increment) + blep (wrapPhase (phase + 0.5), increment) : naive;
+    }
+
+    template <typename Value>
+    Value triangle (Value phase, double increment, bool bandLimited)
+    {
+        auto offset = phase - 0.5;
+        auto naive = select (offset < 0.0, -offset, offset) * 4.0 - 1.0;
+
+        return bandLimited ? naive + (blamp (wrapPhase (phase + 0.5), increment) - blamp (phase, increment)) * (4.0 * increment)
+                           : naive;
+    }
+
+    template <typename WaveFunction>
+    static void fill (float* dest, uint32_t numFrames, double phaseIncrement, WaveFunction&& wave)
+    {
+        Phase phase { phaseIncrement };
+        uint32_t i = 0;
+
+       #if SOUL_INTEL || SOUL_ARM64
+        for (; i + 2 <= numFrames; i += 2)
         {
-            return (currentPhase < 0.5 ? -1.0f : 1.0f) - blep (currentPhase)
-                    + blep (std::fmod (currentPhase + 0.5, 1.0));
+            auto first = phase.next();
+            wave (DoublePair (first, phase.next())).storeAsFloats (dest + i);
         }
-    };
+       #endif
 
-    //==============================================================================
-    struct Triangle  : public Square
+        for (; i < numFrames; ++i)
+            dest[i] = static_cast<float> (wave (phase.next()));
+    }
+
+    void fill (float* dest, uint32_t numFrames, double phaseIncrement, Shape shape, bool bandLimited)
     {
-        double getSample() override
+        switch (shape)
         {
-            sum += 4.0 * phaseIncrement * Square::getSample();
-            return sum;
+            case Shape::sine:       return fill (dest, numFrames, phaseIncrement, [] (auto phase) { return sine (phase); });
+            case Shape::sawtooth:   return fill (dest, numFrames, phaseIncrement, [=] (auto phase) { return sawtooth (phase, phaseIncrement, bandLimited); });
+            case Shape::square:     return fill (dest, numFrames, phaseIncrement, [=] (auto phase) { return square (phase, phaseIncrement, bandLimited); });
+            case Shape::triangle:   return fill (dest, numFrames, phaseIncrement, [=] (auto phase) { return triangle (phase, phaseIncrement, bandLimited); });
+            default:                SOUL_ASSERT_FALSE; return;
         }
-
-        double sum = 1;
-    };
+    }
 }
 
 //==============================================================================
@@ -249,63 +351,198 @@ choc::value::Value coerceAudioFileObjectToTargetType (const Type& targetType, co
 }
 
 //==============================================================================
+static bool isSuitableWaveformSize (double frequency, double sampleRate, int64_t numFrames)
+{
+    return numFrames > 0 && frequency > 0 && sampleRate > 0 && numFrames < 48000 * 60 * 60 * 2;
+}
+
+static choc::value::Value createMonoFrameArray (uint32_t numFrames)
+{
+    return choc::value::Value (choc::value::Type::createArray (choc::value::Type::createVector<float> (1), numFrames));
+}
+
 choc::value::Value generateWaveform (double frequency, double sampleRate, int64_t numFrames,
-                                     WaveGenerators::Generator& generator,
-                                     uint32_t oversamplingFactor)
+                                     const std::function<double(double phase)>& waveGenerator)
+{
+    if (! isSuitableWaveformSize (frequency, sampleRate, numFrames))
+        return {};
+
+    auto frames = createMonoFrameArray ((uint32_t) numFrames);
+    auto dest = static_cast<float*> (frames.getRawData());
+    WaveGenerators::Phase phase { frequency / sampleRate };
+
+    for (uint32_t i = 0; i < (uint32_t) numFrames; ++i)
+        dest[i] = (float) waveGenerator (phase.next());
+
+    return createAudioDataObject (frames, sampleRate);
+}
+
+choc::value::Value generateWaveform (WaveGenerators::Shape shape, double frequency, double sampleRate,
+                                     int64_t numFrames, bool bandLimited)
 {
-    if (numFrames > 0 && frequency > 0 && sampleRate > 0 && numFrames < 48000 * 60 * 60 * 2)
+    if (! isSuitableWaveformSize (frequency, sampleRate, numFrames))
+        return {};
+
+    auto frames = createMonoFrameArray ((uint32_t) numFrames);
+    auto dest = static_cast<float*> (frames.getRawData());
+
+    // The band-limited waves with edges are rendered at twice the rate and then resampled,
+    // which removes most of the aliasing that the polyBLEP corrections leave behind
+    if (! bandLimited || shape == WaveGenerators::Shape::sine)
     {
-        choc::buffer::ChannelArrayBuffer<float> data (1, (uint32_t) (numFrames * oversamplingFactor));
-        auto dst = data.getIterator (0);
+        WaveGenerators::fill (dest, (uint32_t) numFrames, frequency / sampleRate, shape, bandLimited);
+    }
+    else
+    {
+        constexpr uint32_t oversamplingFactor = 2;
+        choc::buffer::MonoBuffer<float> oversampled (1, (uint32_t) numFrames * oversamplingFactor);
+        WaveGenerators::fill (oversampled.getView().data.data, oversampled.getNumFrames(),
+                              frequency / (sampleRate * oversamplingFactor), shape, true);
+        resampleToFit (choc::buffer::createMonoView (dest, (uint32_t) numFrames), oversampled);
+    }
+
+    return createAudioDataObject (frames, sampleRate);
+}
+
+static choc::value::Value generateWaveform (const Annotation& annotation, WaveGenerators::Shape shape)
+{
+    return generateWaveform (shape,
+                             annotation.getDouble ("frequency"),
+                             annotation.getDouble ("rate"),
+                             annotation.getInt64 ("numFrames"),
+                             annotation.getBool ("bandLimited", true));
+}
+
+//==============================================================================
+/*  A wavetable holds a set of mip levels, each of which is a single cycle of the wave built
+    by adding up its harmonics, so it has no aliasing. Level 0 has (tableSize / 4) harmonics,
+    which leaves room for linear interpolation between the table's samples, and each level
+    after that has half as many as the one before, down to a plain sine wave.
+*/
+static choc::value::Value generateWavetable (const Annotation& annotation,
+                                             const std::function<void(uint32_t harmonic, double& sinAmp, double& cosAmp)>& getHarmonic)
+{
+    auto tableSize = annotation.getInt64 ("tableSize", 2048);
+
+    if (tableSize < 8 || tableSize > 65536 || (tableSize & (tableSize - 1)) != 0)
+        return {};
 
-        generator.init (frequency, sampleRate * oversamplingFactor);
+    auto size = (uint32_t) tableSize;
+    auto maxHarmonics = size / 4;
+    uint32_t maxLevels = 1;
+
+    while ((maxHarmonics >> maxLevels) != 0)
+        ++maxLevels;
+
+    auto numLevels = (uint32_t) std::clamp (annotation.getInt64 ("numLevels", maxLevels), (int64_t) 1, (int64_t) maxLevels);
+
+    std::vector<double> sineTable (size), level (size);
+
+    for (uint32_t i = 0; i < size; ++i)
+        sineTable[i] = std::sin (twoPi * i / size);
+
+    choc::buffer::ChannelArrayBuffer<float> data (1, numLevels * size);
+    auto dst = data.getIterator (0);
+
+    for (uint32_t levelIndex = 0; levelIndex < numLevels; ++levelIndex)
+    {
+        std::fill (level.begin(), level.end(), 0.0);
 
-        for (uint32_t i = 0; i < data.getNumFrames(); ++i)
+        for (uint32_t harmonic = 1; harmonic <= std::max (1u, maxHarmonics >> levelIndex); ++harmonic)
         {
-            *dst = (float) generator.getSample();
-            ++dst;
-            generator.advance();
-        }
+            double sinAmp = 0, cosAmp = 0;
+            getHarmonic (harmonic, sinAmp, cosAmp);
 
-        if (oversamplingFactor == 1)
-            return convertAudioDataToObject (data, sampleRate);
+            if (sinAmp == 0 && cosAmp == 0)
+                continue;
+
+            for (uint32_t i = 0; i < size; ++i)
+            {
+                auto index = (harmonic * i) % size;
+                level[i] += sinAmp * sineTable[index] + cosAmp * sineTable[(index + size / 4) % size];
+            }
+        }
 
-        // Resample to the right size
-        choc::buffer::ChannelArrayBuffer<float> resampledData (1, (uint32_t) numFrames);
-        resampleToFit (resampledData, data);
-        return convertAudioDataToObject (resampledData, sampleRate);
+        for (auto sample : level)
+        {
+            *dst = (float) sample;
+            ++dst;
+        }
     }
 
-    return {};
+    return convertAudioDataToObject (data, (double) size);
 }
 
-template <class Generator>
-static choc::value::Value generateWaveform (const Annotation& annotation, uint32_t oversamplingFactor)
+static choc::value::Value generateWavetable (const Annotation& annotation)
 {
-    Generator g;
+    if (annotation.getBool ("sinewave") || annotation.getBool ("sine"))
+        return generateWavetable (annotation, [] (uint32_t harmonic, double& sinAmp, double&)
+                                              {
+                                                  if (harmonic == 1)
+                                                      sinAmp = 1.0;
+                                              });
 
-    return generateWaveform (annotation.getDouble ("frequency"),
-                             annotation.getDouble ("rate"),
-                             annotation.getInt64 ("numFrames"),
-                             g,
-                             oversamplingFactor);
+    if (annotation.getBool ("sawtooth") || annotation.getBool ("saw"))
+        return generateWavetable (annotation, [] (uint32_t harmonic, double& sinAmp, double&)
+                                              {
+                                                  sinAmp = -2.0 / (pi * harmonic);
+                                              });
+
+    if (annotation.getBool ("triangle"))
+        return generateWavetable (annotation, [] (uint32_t harmonic, double&, double& cosAmp)
+                                              {
+                                                  if ((harmonic & 1) != 0)
+                                                      cosAmp = 8.0 / (pi * pi * harmonic * harmonic);
+                                              });
+
+    if (annotation.getBool ("squarewave") || annotation.getBool ("square"))
+        return generateWavetable (annotation, [] (uint32_t harmonic, double& sinAmp, double&)
+                                              {
+                                                  if ((harmonic & 1) != 0)
+                                                      sinAmp = -4.0 / (pi * harmonic);
+                                              });
+
+    return {};
 }
 
 choc::value::Value generateWaveform (const Annotation& annotation)
 {
+    if (annotation.getBool ("wavetable"))
+        return generateWavetable (annotation);
+
     if (annotation.getBool ("sinewave") || annotation.getBool ("sine"))
-        return generateWaveform<WaveGenerators::Sine> (annotation, 1);
+        return generateWaveform (annotation, WaveGenerators::Shape::sine);
 
     if (annotation.getBool ("sawtooth") || annotation.getBool ("saw"))
-        return generateWaveform<WaveGenerators::Saw> (annotation, 2);
+        return generateWaveform (annotation, WaveGenerators::Shape::sawtooth);
 
     if (annotation.getBool ("triangle"))
-        return generateWaveform<WaveGenerators::Triangle> (annotation, 2);
+        return generateWaveform (annotation, WaveGenerators::Shape::triangle);
 
     if (annotation.getBool ("squarewave") || annotation.getBool ("square"))
-        return generateWaveform<WaveGenerators::Square> (annotation, 2);
+        return generateWaveform (annotation, WaveGenerators::Shape::square);
 
     return {};
 }
 
+choc::value::Value generateWaveform (const choc::value::ValueView& annotation)
+{
+    if (! annotation.isObject())
+        return {};
+
+    Annotation a;
+
+    annotation.visitObjectMembers ([&] (std::string_view name, const choc::value::ValueView& value)
+    {
+        std::string propertyName (name);
+
+        if (value.isBool())         a.set (propertyName, value.getBool());
+        else if (value.isInt())     a.set (propertyName, value.get<int64_t>());
+        else if (value.isFloat())   a.set (propertyName, value.get<double>());
+        else if (value.isString())  a.set (propertyName, std::string (value.getString()));
+    });
+
+    return generateWaveform (a);
+}
+
 }
@@ -35,12 +35,39 @@ choc::value::Value convertAudioDataToObject (choc::buffer::InterleavedView<const
 choc::value::Value generateWaveform (double frequency, double sampleRate, int64_t numFrames,
                                      const std::function<double(double phase)>& waveGenerator);
 
+namespace WaveGenerators
+{
+    enum class Shape
+    {
+        sine,
+        sawtooth,
+        square,
+        triangle
+    };
+
+    /** Fills a block with a wave which starts at phase 0 and advances by phaseIncrement
+        cycles per frame, with an amplitude of -1 to 1. When bandLimited is true, the edges
+        and corners of the sawtooth, square and triangle waves are smoothed with polyBLEP and
+        polyBLAMP corrections, otherwise they're left as the plain geometric shapes.
+    */
+    void fill (float* dest, uint32_t numFrames, double phaseIncrement, Shape, bool bandLimited);
+}
+
+/** Builds a suitable type of value containing one of the built-in waves. */
+choc::value::Value generateWaveform (WaveGenerators::Shape, double frequency, double sampleRate,
+                                     int64_t numFrames, bool bandLimited = true);
+
 /** Looks at a set of annotations and tries to create the type of built-in wave
     that the user was asking for. If the annotation can't be interpreted, this
     will just return a void Value.
 */
 choc::value::Value generateWaveform (const Annotation&);
 
+/** Does the same job as generateWaveform (const Annotation&), for an annotation which
+    has been converted to an object, such as the one in an ExternalVariable.
+*/
+choc::value::Value generateWaveform (const choc::value::ValueView& annotation);
+
 choc::value::Value coerceAudioFileObjectToTargetType (const Type& targetType, const choc::value::ValueView& sourceValue);
 
 }
@@ -38,17 +38,68 @@ struct AudioMIDIWrapper
     void reset()
     {
         totalFramesRendered = 0;
-        preRenderOperations.clear();
-        postRenderOperations.clear();
+        operations.clear();
         numInputChannelsExpected = 0;
         numOutputChannelsExpected = 0;
         maxBlockSize = 0;
+        maxAdaptiveBlockSize = 0;
     }
 
-    /** A lambda to create a function which will provide a non-null Value if called when the given parameter
-        has been changed since the last call.
+    /** When adaptive block sizing is off, this is the largest chunk that the host's buffers are split into. */
+    static constexpr uint32_t defaultMaxChunkSize = 512;
+
+    /** Enables or disables adaptive block sizing.
+        By default, the host's buffers are rendered in chunks of at most defaultMaxChunkSize frames,
+        and are also split at each incoming MIDI event so that it's delivered at the right frame.
+        When adaptive sizing is enabled, that limit is lifted, and stretches without events are
+        rendered in blocks as large as the BuildSettings::maxBlockSize that the performer was linked
+        with, which is the best choice for offline bouncing. Event timing stays sample-accurate,
+        because chunks still end at the next event. The trade-off is that parameter changes are
+        only picked up at chunk boundaries.
     */
-    using GetNewParameterValueFn = std::function<std::function<const float*()>(const EndpointDetails& inputEndpoint)>;
+    void setAdaptiveBlockSizing (bool shouldUseAdaptiveSizes)
+    {
+        useAdaptiveBlockSizes = shouldUseAdaptiveSizes;
+    }
+
+    struct RenderOperationList;
+
+    /** Lets a parameter tell the wrapper that its value has changed.
+        Changed parameters are added to a lock-free queue, and before each chunk is rendered,
+        the wrapper only passes the values of the parameters in that queue to the performer,
+        so the cost doesn't depend on how many parameters there are. A parameter is only
+        queued once however many times it changes before the next chunk.
+    */
+    struct ParameterChangeNotifier
+    {
+        /** This is lock-free, and can be called from any thread. */
+        void markChanged() const
+        {
+            if (operations != nullptr)
+                operations->markParameterChanged (index);
+        }
+
+        RenderOperationList* operations = nullptr;
+        uint32_t index = 0;
+    };
+
+    /** A lambda which is called for each parameter input while the pipeline is being built, and
+        which can return a pointer to where the wrapper can find its current value, or nullptr to
+        leave the parameter unconnected. The notifier must be used to tell the wrapper whenever
+        that value changes, and the value must stay valid until the pipeline is rebuilt or the
+        wrapper is deleted.
+    */
+    using GetParameterSourceFn = std::function<const float*(const EndpointDetails& inputEndpoint, ParameterChangeNotifier)>;
+
+    /** A time-stamped value for a parameter, which can be passed to render().
+        The parameter index is the index of the ParameterChangeNotifier that the parameter was
+        given when the pipeline was built.
+    */
+    struct ParameterAutomationPoint
+    {
+        uint32_t frameIndex, parameterIndex;
+        float value;
+    };
 
     /**
     */
@@ -61,199 +112,111 @@ struct AudioMIDIWrapper
     /**
     */
     void buildRenderingPipeline (uint32_t processorMaxBlockSize,
-                                 GetNewParameterValueFn&& getNewParameterValueFn,
+                                 GetParameterSourceFn&& getParameterSourceFn,
                                  GetRampLengthForSparseStreamFn&& getRampLengthForSparseStreamFn,
                                  HandleUnusedEventFn&& handleUnusedEventFn)
     {
         SOUL_ASSERT (processorMaxBlockSize > 0);
         reset();
-        auto& perf = performer;
-        maxBlockSize = std::min (512u, processorMaxBlockSize);
+        maxBlockSize = std::min (defaultMaxChunkSize, processorMaxBlockSize);
+        maxAdaptiveBlockSize = processorMaxBlockSize;
+        operations.setHandleUnusedEventFn (std::move (handleUnusedEventFn));
 
-        for (auto& inputEndpoint : perf.getInputEndpoints())
+        uint32_t numParameterInputs = 0;
+
+        for (auto& inputEndpoint : performer.getInputEndpoints())
+            if (isParameterInput (inputEndpoint))
+                ++numParameterInputs;
+
+        operations.prepareParameterInputs (numParameterInputs);
+
+        for (auto& inputEndpoint : performer.getInputEndpoints())
         {
             if (isParameterInput (inputEndpoint))
             {
-                if (getNewParameterValueFn != nullptr)
+                if (getParameterSourceFn != nullptr)
                 {
-                    if (auto getNewValueForParamIfChanged = getNewParameterValueFn (inputEndpoint))
+                    auto value = getParameterSourceFn (inputEndpoint, operations.getNextParameterNotifier());
+
+                    if (value != nullptr)
                     {
-                        auto endpointHandle = perf.getEndpointHandle (inputEndpoint.endpointID);
-                        auto floatValue = choc::value::createFloat32 (0);
+                        uint32_t rampFrames = 0;
 
-                        if (isEvent (inputEndpoint))
-                        {
-                            preRenderOperations.push_back ([&perf, endpointHandle, floatValue, getNewValueForParamIfChanged] (RenderContext&) mutable
-                            {
-                                if (auto newValue = getNewValueForParamIfChanged())
-                                {
-                                    floatValue.getViewReference().set (*newValue);
-                                    perf.addInputEvent (endpointHandle, floatValue);
-                                }
-                            });
-                        }
-                        else if (isStream (inputEndpoint))
+                        if (isStream (inputEndpoint))
                         {
                             SOUL_ASSERT (getRampLengthForSparseStreamFn != nullptr);
-                            auto rampFrames = getRampLengthForSparseStreamFn (inputEndpoint);
-
-                            preRenderOperations.push_back ([&perf, endpointHandle, floatValue, getNewValueForParamIfChanged, rampFrames] (RenderContext&) mutable
-                            {
-                                if (auto newValue = getNewValueForParamIfChanged())
-                                {
-                                    floatValue.getViewReference().set (*newValue);
-                                    perf.setSparseInputStreamTarget (endpointHandle, floatValue, rampFrames, 0.0f);
-                                }
-                            });
-                        }
-                        else if (isValue (inputEndpoint))
-                        {
-                            preRenderOperations.push_back ([&perf, endpointHandle, floatValue, getNewValueForParamIfChanged] (RenderContext&) mutable
-                            {
-                                if (auto newValue = getNewValueForParamIfChanged())
-                                {
-                                    floatValue.getViewReference().set (*newValue);
-                                    perf.setInputValue (endpointHandle, floatValue);
-                                }
-                            });
+                            rampFrames = getRampLengthForSparseStreamFn (inputEndpoint);
                         }
+
+                        operations.addParameterInput (inputEndpoint, value, rampFrames);
                     }
                 }
             }
             else if (isMIDIEventEndpoint (inputEndpoint))
             {
-                auto endpointHandle = perf.getEndpointHandle (inputEndpoint.endpointID);
-                choc::value::Value midiEvent (inputEndpoint.getSingleEventType());
-
-                preRenderOperations.push_back ([&perf, endpointHandle, midiEvent] (RenderContext& rc) mutable
-                {
-                    for (uint32_t i = 0; i < rc.midiInCount; ++i)
-                    {
-                        midiEvent.getObjectMemberAt (0).value.set (rc.midiIn[i].getPackedMIDIData());
-                        perf.addInputEvent (endpointHandle, midiEvent);
-                    }
-                });
+                operations.addMIDIInput (inputEndpoint);
             }
             else if (auto numSourceChans = inputEndpoint.getNumAudioChannels())
             {
-                auto endpointHandle = perf.getEndpointHandle (inputEndpoint.endpointID);
-                auto& frameType = inputEndpoint.getFrameType();
-                auto startChannel = numInputChannelsExpected;
-                auto numChans = frameType.getNumElements();
-
-                if (frameType.isFloat() || (frameType.isVector() && frameType.getElementType().isFloat()))
-                {
-                    if (numChans == 1)
-                    {
-                        preRenderOperations.push_back ([&perf, endpointHandle, startChannel] (RenderContext& rc)
-                        {
-                            auto channel = rc.inputChannels.getChannel (startChannel);
-                            perf.setNextInputStreamFrames (endpointHandle, choc::value::createArrayView (const_cast<float*> (channel.data.data),
-                                                                                                         channel.getNumFrames()));
-                        });
-                    }
-                    else
-                    {
-                        choc::buffer::InterleavedBuffer<float> interleaved (numChans, maxBlockSize);
-
-                        preRenderOperations.push_back ([&perf, endpointHandle, startChannel, numChans, interleaved] (RenderContext& rc)
-                        {
-                            auto numFrames = rc.inputChannels.getNumFrames();
-
-                            copy (interleaved.getStart (numFrames),
-                                  rc.inputChannels.getChannelRange ({ startChannel, startChannel + numChans }));
-
-                            perf.setNextInputStreamFrames (endpointHandle, choc::value::create2DArrayView (interleaved.getView().data.data,
-                                                                                                           numFrames, interleaved.getNumChannels()));
-                        });
-                    }
-                }
-                else
-                {
-                    SOUL_ASSERT_FALSE;
-                }
-
+                operations.addAudioInput (inputEndpoint, numInputChannelsExpected, maxAdaptiveBlockSize);
                 numInputChannelsExpected += numSourceChans;
             }
         }
 
-        for (auto& outputEndpoint : perf.getOutputEndpoints())
+        for (auto& outputEndpoint : performer.getOutputEndpoints())
         {
             if (isMIDIEventEndpoint (outputEndpoint))
             {
-                auto endpointHandle = perf.getEndpointHandle (outputEndpoint.endpointID);
-
-                postRenderOperations.push_back ([&perf, endpointHandle] (RenderContext& rc)
-                {
-                    perf.iterateOutputEvents (endpointHandle, [&rc] (uint32_t frameOffset, const choc::value::ValueView& event) -> bool
-                    {
-                        if (rc.midiOutCount < rc.midiOutCapacity)
-                            rc.midiOut[rc.midiOutCount++] = MIDIEvent::fromPackedMIDIData (rc.frameOffset + frameOffset,
-                                                                                           event["midiBytes"].getInt32());
-
-                        return true;
-                    });
-                });
+                operations.addMIDIOutput (outputEndpoint);
             }
             else if (auto numChans = outputEndpoint.getNumAudioChannels())
             {
-                auto endpointHandle = perf.getEndpointHandle (outputEndpoint.endpointID);
-                auto& frameType = outputEndpoint.getFrameType();
-                auto startChannel = numOutputChannelsExpected;
+                operations.addAudioOutput (outputEndpoint, numOutputChannelsExpected);
                 numOutputChannelsExpected += numChans;
-
-                if (frameType.isFloat() || (frameType.isVector() && frameType.getElementType().isFloat()))
-                {
-                    postRenderOperations.push_back ([&perf, endpointHandle, startChannel, numChans] (RenderContext& rc)
-                    {
-                        copyIntersectionAndClearOutside (rc.outputChannels.getChannelRange ({ startChannel, startChannel + numChans }),
-                                                         getChannelSetFromArray (perf.getOutputStreamFrames (endpointHandle)));
-                    });
-                }
-                else
-                {
-                    SOUL_ASSERT_FALSE;
-                }
             }
-            else if (handleUnusedEventFn != nullptr && isEvent (outputEndpoint))
+            else if (isEvent (outputEndpoint))
             {
-                auto endpointHandle = perf.getEndpointHandle (outputEndpoint.endpointID);
-                auto endpointName = outputEndpoint.name;
-
-                postRenderOperations.push_back ([&perf, endpointHandle, handleUnusedEventFn, endpointName] (RenderContext& rc)
-                {
-                    perf.iterateOutputEvents (endpointHandle, [&] (uint32_t frameOffset, const choc::value::ValueView& eventData) -> bool
-                    {
-                        return handleUnusedEventFn (rc.totalFramesRendered + frameOffset, endpointName, eventData);
-                    });
-                });
+                operations.addUnusedEventOutput (outputEndpoint);
             }
         }
     }
 
+    /** Renders a block, splitting it into chunks as needed.
+
+        The automation points, if there are any, must be sorted by frame index. They don't cause
+        any extra splitting. Before each chunk, each parameter which has points inside the chunk
+        is given the value of the last one. A stream parameter ramps to it from the start of the
+        chunk, so that it arrives exactly on the point's frame. An event or value parameter gets
+        the value at the start of the chunk, because the performer has no way to time them more
+        accurately than that.
+    */
     void render (choc::buffer::ChannelArrayView<const float> input,
                  choc::buffer::ChannelArrayView<float> output,
                  const MIDIEvent* midiIn,
                  MIDIEvent* midiOut,
                  uint32_t midiInCount,
                  uint32_t midiOutCapacity,
-                 uint32_t& numMIDIOutMessages)
+                 uint32_t& numMIDIOutMessages,
+                 const ParameterAutomationPoint* automation = nullptr,
+                 uint32_t numAutomationPoints = 0)
     {
         SOUL_ASSERT (input.getNumFrames() == output.getNumFrames() && maxBlockSize != 0);
 
         RenderContext context { totalFramesRendered, input, output, midiIn, midiOut, 0, midiInCount, 0, midiOutCapacity };
+        auto automationEnd = automation + numAutomationPoints;
 
-        context.iterateInBlocks (maxBlockSize, [&] (RenderContext& rc)
+        context.iterateInBlocks (useAdaptiveBlockSizes ? maxAdaptiveBlockSize : maxBlockSize, [&] (RenderContext& rc)
         {
-            performer.prepare (rc.inputChannels.getNumFrames());
+            auto numFrames = rc.inputChannels.getNumFrames();
+            performer.prepare (numFrames);
 
-            for (auto& op : preRenderOperations)
-                op (rc);
+            operations.runPreRenderOperations (rc);
 
-            performer.advance();
+            if (automation != automationEnd)
+                automation = operations.applyParameterAutomation (automation, automationEnd, rc.frameOffset, rc.frameOffset + numFrames);
 
-            for (auto& op : postRenderOperations)
-                op (rc);
+            performer.advance();
+            operations.runPostRenderOperations (rc);
         });
 
         numMIDIOutMessages = context.midiOutCount;
@@ -314,15 +277,416 @@ struct AudioMIDIWrapper
         }
     };
 
+    //==============================================================================
+    /** A flat list of the operations which move the audio, MIDI and parameter data in a
+        RenderContext in and out of a performer's endpoints around each call to advance().
+
+        Each operation is a small tagged struct, and each list is run by a single loop over a
+        switch, so rendering a chunk involves no allocation and no type-erased calls. Anything
+        an operation needs besides its endpoint and channel range (e.g. an interleaving buffer
+        or a MIDI batch) is preallocated when it's added, and referred to by index.
+
+        Audio streams are bound to the context's channels with Performer::setNextInputStreamChannels()
+        and Performer::setNextOutputStreamChannels() where the performer supports it, and are only
+        interleaved into (or copied out of) frame arrays when it doesn't.
+    */
+    struct RenderOperationList
+    {
+        RenderOperationList (Performer& p)  : performer (p) {}
+
+        void clear()
+        {
+            preRenderOperations.clear();
+            postRenderOperations.clear();
+            parameterOperations.clear();
+            parameterValues.clear();
+            maxParameterInputs = 0;
+            interleavedBuffers.clear();
+            midiInputBatches.clear();
+            eventEndpointNames.clear();
+            handleUnusedEventFn = {};
+        }
+
+        /** Sets the function which addUnusedEventOutput() will pass events to. */
+        void setHandleUnusedEventFn (HandleUnusedEventFn&& fn)    { handleUnusedEventFn = std::move (fn); }
+
+        /** Allocates the queue of changed parameters. This must be called before adding the
+            given number of parameter inputs, and mustn't be called while anything might be
+            marking a parameter as changed.
+        */
+        void prepareParameterInputs (uint32_t maxNumParameters)
+        {
+            parameterOperations.clear();
+            parameterOperations.reserve (maxNumParameters);
+            parameterValues.clear();
+            parameterValues.reserve (maxNumParameters);
+            lastAutomationPoints.assign (maxNumParameters, nullptr);
+            automatedParameters.clear();
+            automatedParameters.reserve (maxNumParameters);
+            parameterChangedFlags.reset (new std::atomic<bool>[maxNumParameters]);
+            changedParameters.reset (maxNumParameters);
+            maxParameterInputs = maxNumParameters;
+        }
+
+        /** Returns the notifier that the next parameter to be added will use. */
+        ParameterChangeNotifier getNextParameterNotifier()
+        {
+            return { this, static_cast<uint32_t> (parameterOperations.size()) };
+        }
+
+        /** Adds a parameter input, which is marked as changed, so that its initial value is
+            passed to the performer before the first chunk.
+        */
+        void addParameterInput (const EndpointDetails& endpoint, const float* value, uint32_t rampFrames)
+        {
+            SOUL_ASSERT (value != nullptr && parameterOperations.size() < maxParameterInputs);
+
+            if (isEvent (endpoint))
+                addParameterOperation (OperationType::sendParameterEvent, endpoint, value, 0);
+            else if (isStream (endpoint))
+                addParameterOperation (OperationType::setParameterStreamTarget, endpoint, value, rampFrames);
+            else if (isValue (endpoint))
+                addParameterOperation (OperationType::setParameterValue, endpoint, value, 0);
+        }
+
+        /** Queues a parameter so that its value gets passed to the performer before the next
+            chunk. This is lock-free, and can be called from any thread.
+        */
+        void markParameterChanged (uint32_t index)
+        {
+            // The flag stays set until the render thread takes the index off the queue, so the
+            // queue can never hold more than one entry per parameter, and can't overflow
+            if (index < parameterOperations.size() && ! parameterChangedFlags[index].exchange (true))
+                changedParameters.push (index);
+        }
+
+        void addMIDIInput (const EndpointDetails& endpoint)
+        {
+            auto& op = addOperation (preRenderOperations, OperationType::sendMIDIInput, endpoint);
+            op.index = static_cast<uint32_t> (midiInputBatches.size());
+            midiInputBatches.push_back (std::make_unique<MIDIInputBatch> (endpoint.getSingleEventType()));
+        }
+
+        void addAudioInput (const EndpointDetails& endpoint, uint32_t startChannel, uint32_t maxFramesPerBlock)
+        {
+            auto numChans = checkFloatFrameType (endpoint);
+
+            if (numChans == 1)
+            {
+                auto& op = addOperation (preRenderOperations, OperationType::setMonoInputStream, endpoint);
+                op.startChannel = startChannel;
+                op.numChannels = 1;
+            }
+            else
+            {
+                auto& op = addOperation (preRenderOperations, OperationType::setInterleavedInputStream, endpoint);
+                op.startChannel = startChannel;
+                op.numChannels = numChans;
+                op.index = static_cast<uint32_t> (interleavedBuffers.size());
+                interleavedBuffers.push_back (choc::buffer::InterleavedBuffer<float> (numChans, maxFramesPerBlock));
+            }
+        }
+
+        void addAudioOutput (const EndpointDetails& endpoint, uint32_t startChannel)
+        {
+            auto numChans = checkFloatFrameType (endpoint);
+
+            auto& bind = addOperation (preRenderOperations, OperationType::bindOutputStream, endpoint);
+            bind.startChannel = startChannel;
+            bind.numChannels = numChans;
+            bind.index = static_cast<uint32_t> (postRenderOperations.size());
+
+            auto& op = addOperation (postRenderOperations, OperationType::copyOutputStream, endpoint);
+            op.startChannel = startChannel;
+            op.numChannels = numChans;
+        }
+
+        void addMIDIOutput (const EndpointDetails& endpoint)
+        {
+            addOperation (postRenderOperations, OperationType::readMIDIOutput, endpoint);
+        }
+
+        /** Adds an output whose events are passed to the HandleUnusedEventFn. If there's no
+            such function, this does nothing.
+        */
+        void addUnusedEventOutput (const EndpointDetails& endpoint)
+        {
+            if (handleUnusedEventFn != nullptr)
+            {
+                auto& op = addOperation (postRenderOperations, OperationType::forwardUnusedEvents, endpoint);
+                op.index = static_cast<uint32_t> (eventEndpointNames.size());
+                eventEndpointNames.push_back (endpoint.name);
+            }
+        }
+
+        void runPreRenderOperations (RenderContext& rc)
+        {
+            uint32_t changedParameter;
+
+            while (changedParameters.pop (changedParameter))
+            {
+                // The flag is cleared before the value is read, so if the value changes again
+                // after this point, the parameter gets queued again for the next chunk
+                parameterChangedFlags[changedParameter].store (false);
+                auto& op = parameterOperations[changedParameter];
+                sendParameterValue (changedParameter, *op.parameterValue, op.rampFrames);
+            }
+
+            for (auto& op : preRenderOperations)
+            {
+                switch (op.type)
+                {
+                    case OperationType::sendMIDIInput:
+                    {
+                        auto& batch = *midiInputBatches[op.index];
+
+                        for (uint32_t start = 0; start < rc.midiInCount; start += MIDIInputBatch::maxEvents)
+                        {
+                            auto numEvents = std::min (rc.midiInCount - start, MIDIInputBatch::maxEvents);
+
+                            for (uint32_t i = 0; i < numEvents; ++i)
+                                batch.packedMIDIData[i] = rc.midiIn[start + i].getPackedMIDIData();
+
+                            performer.addInputEvents (op.endpoint, batch.messageType, batch.packedMIDIData, numEvents);
+                        }
+
+                        break;
+                    }
+
+                    case OperationType::setMonoInputStream:
+                    {
+                        auto channel = rc.inputChannels.getChannel (op.startChannel);
+                        performer.setNextInputStreamFrames (op.endpoint, choc::value::createArrayView (const_cast<float*> (channel.data.data),
+                                                                                                       channel.getNumFrames()));
+                        break;
+                    }
+
+                    case OperationType::setInterleavedInputStream:
+                    {
+                        auto channels = rc.inputChannels.getChannelRange ({ op.startChannel, op.startChannel + op.numChannels });
+
+                        if (performer.setNextInputStreamChannels (op.endpoint, channels))
+                            break;
+
+                        auto& interleaved = interleavedBuffers[op.index];
+                        auto numFrames = rc.inputChannels.getNumFrames();
+                        interleaveChannels (interleaved.getStart (numFrames), channels);
+
+                        performer.setNextInputStreamFrames (op.endpoint, choc::value::create2DArrayView (interleaved.getView().data.data,
+                                                                                                         numFrames, op.numChannels));
+                        break;
+                    }
+
+                    case OperationType::bindOutputStream:
+                        postRenderOperations[op.index].isBound
+                            = performer.setNextOutputStreamChannels (op.endpoint, rc.outputChannels.getChannelRange ({ op.startChannel, op.startChannel + op.numChannels }));
+                        break;
+
+                    default:
+                        SOUL_ASSERT_FALSE;
+                        break;
+                }
+            }
+        }
+
+        /** Applies the automation points which fall inside the chunk from startFrame to endFrame,
+            and returns the first one that doesn't.
+        */
+        const ParameterAutomationPoint* applyParameterAutomation (const ParameterAutomationPoint* point,
+                                                                  const ParameterAutomationPoint* end,
+                                                                  uint32_t startFrame, uint32_t endFrame)
+        {
+            for (; point != end && point->frameIndex < endFrame; ++point)
+            {
+                if (point->parameterIndex < parameterOperations.size())
+                {
+                    auto& last = lastAutomationPoints[point->parameterIndex];
+
+                    if (last == nullptr)
+                        automatedParameters.push_back (point->parameterIndex);
+
+                    last = point;
+                }
+            }
+
+            for (auto index : automatedParameters)
+            {
+                auto& last = lastAutomationPoints[index];
+                sendParameterValue (index, last->value, last->frameIndex > startFrame ? last->frameIndex - startFrame : 0);
+                last = nullptr;
+            }
+
+            automatedParameters.clear();
+            return point;
+        }
+
+        void runPostRenderOperations (RenderContext& rc)
+        {
+            for (auto& op : postRenderOperations)
+            {
+                switch (op.type)
+                {
+                    case OperationType::copyOutputStream:
+                    {
+                        if (op.isBound)
+                            break;
+
+                        auto dest = rc.outputChannels.getChannelRange ({ op.startChannel, op.startChannel + op.numChannels });
+                        auto source = getChannelSetFromArray (performer.getOutputStreamFrames (op.endpoint));
+
+                        if (source.getSize() == dest.getSize())
+                            deinterleaveChannels (dest, source);
+                        else
+                            copyIntersectionAndClearOutside (dest, source);
+
+                        break;
+                    }
+
+                    case OperationType::readMIDIOutput:
+                    {
+                        auto numEvents = performer.readOutputEvents (op.endpoint, midiOutputBatch.frameOffsets, midiOutputBatch.packedMIDIData,
+                                                                     (uint32_t) sizeof (int32_t),
+                                                                     std::min (rc.midiOutCapacity - rc.midiOutCount, MIDIOutputBatch::maxEvents));
+
+                        for (uint32_t i = 0; i < numEvents; ++i)
+                            rc.midiOut[rc.midiOutCount++] = MIDIEvent::fromPackedMIDIData (rc.frameOffset + midiOutputBatch.frameOffsets[i],
+                                                                                           midiOutputBatch.packedMIDIData[i]);
+                        break;
+                    }
+
+                    case OperationType::forwardUnusedEvents:
+                    {
+                        auto& endpointName = eventEndpointNames[op.index];
+
+                        performer.forEachOutputEvent (op.endpoint, [&] (uint32_t frameOffset, const choc::value::ValueView& eventData) -> bool
+                        {
+                            return handleUnusedEventFn (rc.totalFramesRendered + frameOffset, endpointName, eventData);
+                        });
+
+                        break;
+                    }
+
+                    default:
+                        SOUL_ASSERT_FALSE;
+                        break;
+                }
+            }
+        }
+
+    private:
+        enum class OperationType : uint8_t
+        {
+            sendParameterEvent,
+            setParameterStreamTarget,
+            setParameterValue,
+            sendMIDIInput,
+            setMonoInputStream,
+            setInterleavedInputStream,
+            bindOutputStream,
+            copyOutputStream,
+            readMIDIOutput,
+            forwardUnusedEvents
+        };
+
+        struct Operation
+        {
+            OperationType type;
+            EndpointHandle endpoint;
+            uint32_t startChannel = 0, numChannels = 0, rampFrames = 0, index = 0;
+            const float* parameterValue = nullptr;
+            bool isBound = false;
+        };
+
+        /** Preallocated storage used to pass incoming MIDI to the performer in batches. */
+        struct MIDIInputBatch
+        {
+            MIDIInputBatch (const choc::value::Type& type) : messageType (type)
+            {
+                SOUL_ASSERT (messageType.getValueDataSize() == sizeof (int32_t));
+            }
+
+            static constexpr uint32_t maxEvents = 256;
+            choc::value::Type messageType;
+            int32_t packedMIDIData[maxEvents];
+        };
+
+        /** Preallocated storage used to read the performer's MIDI output in a single batch. */
+        struct MIDIOutputBatch
+        {
+            static constexpr uint32_t maxEvents = 1024;
+            uint32_t frameOffsets[maxEvents];
+            int32_t packedMIDIData[maxEvents];
+        };
+
+        Performer& performer;
+        std::vector<Operation> preRenderOperations, postRenderOperations, parameterOperations;
+        std::vector<choc::value::Value> parameterValues;
+        std::unique_ptr<std::atomic<bool>[]> parameterChangedFlags;
+        MultipleWriterFIFO<uint32_t> changedParameters;
+        size_t maxParameterInputs = 0;
+        std::vector<const ParameterAutomationPoint*> lastAutomationPoints;
+        std::vector<uint32_t> automatedParameters;
+        std::vector<choc::buffer::InterleavedBuffer<float>> interleavedBuffers;
+        std::vector<std::unique_ptr<MIDIInputBatch>> midiInputBatches;
+        std::vector<std::string> eventEndpointNames;
+        MIDIOutputBatch midiOutputBatch;
+        HandleUnusedEventFn handleUnusedEventFn;
+
+        Operation& addOperation (std::vector<Operation>& list, OperationType type, const EndpointDetails& endpoint)
+        {
+            Operation op;
+            op.type = type;
+            op.endpoint = performer.getEndpointHandle (endpoint.endpointID);
+            list.push_back (op);
+            return list.back();
+        }
+
+        void addParameterOperation (OperationType type, const EndpointDetails& endpoint, const float* value, uint32_t rampFrames)
+        {
+            auto index = static_cast<uint32_t> (parameterOperations.size());
+            auto& op = addOperation (parameterOperations, type, endpoint);
+            op.parameterValue = value;
+            op.rampFrames = rampFrames;
+            parameterValues.push_back (choc::value::createFloat32 (0));
+            parameterChangedFlags[index].store (false);
+            markParameterChanged (index);
+        }
+
+        void sendParameterValue (uint32_t index, float newValue, uint32_t rampFrames)
+        {
+            auto& op = parameterOperations[index];
+            auto& value = parameterValues[index];
+            value.getViewReference().set (newValue);
+
+            switch (op.type)
+            {
+                case OperationType::sendParameterEvent:        performer.addInputEvent (op.endpoint, value); break;
+                case OperationType::setParameterStreamTarget:  performer.setSparseInputStreamTarget (op.endpoint, value, rampFrames, 0.0f); break;
+                case OperationType::setParameterValue:         performer.setInputValue (op.endpoint, value); break;
+
+                default:
+                    SOUL_ASSERT_FALSE;
+                    break;
+            }
+        }
+
+        static uint32_t checkFloatFrameType (const EndpointDetails& endpoint)
+        {
+            auto& frameType = endpoint.getFrameType();
+            SOUL_ASSERT (frameType.isFloat() || (frameType.isVector() && frameType.getElementType().isFloat()));
+            return frameType.getNumElements();
+        }
+    };
+
 private:
     //==============================================================================
     Performer& performer;
 
     uint64_t totalFramesRendered = 0;
-    std::vector<std::function<void(RenderContext&)>> preRenderOperations;
-    std::vector<std::function<void(RenderContext&)>> postRenderOperations;
+    RenderOperationList operations { performer };
     uint32_t numInputChannelsExpected = 0, numOutputChannelsExpected = 0;
-    uint32_t maxBlockSize = 0;
+    uint32_t maxBlockSize = 0, maxAdaptiveBlockSize = 0;
+    bool useAdaptiveBlockSizes = false;
 };
 
 }
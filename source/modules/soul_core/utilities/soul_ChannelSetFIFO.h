@@ -22,6 +22,11 @@ namespace soul
 {
 
 //==============================================================================
+/** A single-reader, single-writer FIFO of interleaved multi-channel float frames.
+
+    The read() and write() methods are wait-free and suitable for a realtime thread, and
+    readBlocking() and writeBlocking() will wait for data or space until a deadline.
+*/
 struct ChannelSetFIFO
 {
     ChannelSetFIFO (uint32_t numChannels, uint32_t fifoSize)
@@ -41,28 +46,87 @@ struct ChannelSetFIFO
     {
         cancel();
         fifo.reset();
+        highWaterMark = 0;
     }
 
+    /** Returns the largest number of frames that have been queued in the FIFO since it was reset.
+        This can be called from any thread.
+    */
+    uint32_t getHighWaterMark() const noexcept      { return (uint32_t) highWaterMark.load (std::memory_order_relaxed); }
+
     /** Disables the FIFO, blocking until everything currently waiting on it has
         been cancelled. All subsequent read/writes will fail immediately.
     */
     void cancel()
     {
         fifo.cancel();
-        std::lock_guard<std::mutex> lock1 (writeLock);
-        std::lock_guard<std::mutex> lock2 (readLock);
+
+        while (numActiveOperations.load() != 0)
+            std::this_thread::yield();
+
         buffer.clear();
     }
 
+    /** Attempts to write a number of samples to the FIFO, failing immediately if there's not
+        enough space or the FIFO has been cancelled.
+    */
+    template <typename SourceType>
+    bool write (SourceType sourceData)
+    {
+        return performWrite (sourceData, [&] { return FIFO::WriteOperation (fifo, (int) sourceData.getNumFrames()); });
+    }
+
     /** Attempts to write a number of samples to the FIFO.
         This fails if there's not enough space or the FIFO has been cancelled, or the timeout is passed
     */
     template <typename SourceType>
     bool writeBlocking (SourceType sourceData, std::chrono::high_resolution_clock::time_point deadline)
     {
-        std::lock_guard<std::mutex> lock (writeLock);
+        return performWrite (sourceData, [&] { return FIFO::WriteOperation (fifo, (int) sourceData.getNumFrames(), deadline); });
+    }
+
+    /** Attempts to read a number of samples from the FIFO, failing immediately if there's not
+        enough data ready or the FIFO has been cancelled.
+    */
+    template <typename DestType>
+    bool read (DestType dest)
+    {
+        return performRead (dest, [&] { return FIFO::ReadOperation (fifo, (int) dest.getNumFrames()); });
+    }
+
+    /** Attempts to read a number of samples to the FIFO.
+        This fails immediately if there's not enough data ready or the FIFO has been cancelled, or
+        the timeout is passed.
+    */
+    template <typename DestType>
+    bool readBlocking (DestType dest, std::chrono::high_resolution_clock::time_point deadline)
+    {
+        return performRead (dest, [&] { return FIFO::ReadOperation (fifo, (int) dest.getNumFrames(), deadline); });
+    }
+
+private:
+    //==============================================================================
+    choc::buffer::InterleavedBuffer<float> buffer;
+    FIFO fifo;
+    std::atomic<int> numActiveOperations { 0 }, highWaterMark { 0 };
+
+    struct ActiveOperation
+    {
+        ActiveOperation (std::atomic<int>& c) : count (c)   { ++count; }
+        ~ActiveOperation()                                  { --count; }
+
+        std::atomic<int>& count;
+    };
+
+    template <typename SourceType, typename CreateOperationFn>
+    bool performWrite (SourceType& sourceData, CreateOperationFn&& createOperation)
+    {
+        ActiveOperation active (numActiveOperations);
+
+        if (fifo.isCancelled())
+            return false;
 
-        FIFO::WriteOperation w (fifo, (int) sourceData.getNumFrames(), deadline);
+        auto w = createOperation();
 
         if (w.failed())
             return false;
@@ -74,19 +138,26 @@ struct ChannelSetFIFO
             copyRemappingChannels (buffer.getStart ((uint32_t) w.blockSize2),
                                    sourceData.getFrameRange ({ (uint32_t) w.blockSize1, (uint32_t) (w.blockSize1 + w.blockSize2) }));
 
+        auto numQueued = fifo.getNumReady() + w.blockSize1 + w.blockSize2;
+
+        if (numQueued > highWaterMark.load (std::memory_order_relaxed))
+            highWaterMark.store (numQueued, std::memory_order_relaxed);
+
         return true;
     }
 
-    /** Attempts to read a number of samples to the FIFO.
-        This fails immediately if there's not enough data ready or the FIFO has been cancelled, or
-        the timeout is passed.
-    */
-    template <typename DestType>
-    bool readBlocking (DestType dest, std::chrono::high_resolution_clock::time_point deadline)
+    template <typename DestType, typename CreateOperationFn>
+    bool performRead (DestType& dest, CreateOperationFn&& createOperation)
     {
-        std::lock_guard<std::mutex> lock (readLock);
+        ActiveOperation active (numActiveOperations);
+
+        if (fifo.isCancelled())
+        {
+            dest.clear();
+            return false;
+        }
 
-        FIFO::ReadOperation r (fifo, (int) dest.getNumFrames(), deadline);
+        auto r = createOperation();
 
         if (r.failed())
         {
@@ -103,12 +174,6 @@ struct ChannelSetFIFO
 
         return true;
     }
-
-private:
-    //==============================================================================
-    choc::buffer::InterleavedBuffer<float> buffer;
-    FIFO fifo;
-    std::mutex readLock, writeLock;
 };
 
 }
@@ -116,6 +116,24 @@ inline auto getIteratorForIndex (Vector& vector, Position index)
     return vector.begin() + static_cast<typename Vector::difference_type> (index);
 }
 
+/** Returns the number of bytes in a vector's buffer, including any unused capacity. */
+template <typename Vector>
+inline size_t getVectorMemoryUsage (const Vector& v)
+{
+    return v.capacity() * sizeof (typename Vector::value_type);
+}
+
+/** Returns an estimate of the heap space used by a std::unordered_map or similar container,
+    assuming the usual layout of an array of bucket pointers, plus a node for each item which
+    holds the item, a link to the next node and a cached hash.
+*/
+template <typename HashContainer>
+inline size_t getHashContainerMemoryUsage (const HashContainer& c)
+{
+    return c.bucket_count() * sizeof (void*)
+            + c.size() * (sizeof (typename HashContainer::value_type) + 2 * sizeof (void*));
+}
+
 //==============================================================================
 /** This is a bit like a lite version of std::span.
     However, it does have the huge advantage that it asserts when mistakes are made like
@@ -24,56 +24,92 @@ namespace soul
 //==============================================================================
 /** A FIFO for holding time-stamped event objects.
 
+    The events are all of the same type, and are stored as packed data in a flat block of
+    memory which is allocated up-front, so pushing events doesn't allocate or copy any
+    Value objects. If an event is pushed when the FIFO is full, it's dropped, and the
+    overflow counter is incremented.
+
     TimestampType could be a uint64_t or a std::atomic<uint64_t> depending
     on whether atomicity is needed.
 */
 template <typename TimestampType>
 struct EventFIFO
 {
-    EventFIFO (const Type& type) : eventType (type)
+    EventFIFO (const Type& type, uint32_t maxNumEvents = defaultCapacity)
+        : eventType (type), capacity (maxNumEvents), eventSize (type.getPackedSizeInBytes())
     {
-        auto emptyValue = Value::zeroInitialiser (eventType);
-
-        events.resize (capacity);
-
-        for (uint32_t i = 0; i < capacity; i++)
-        {
-            events[i].time  = 0;
-            events[i].value = emptyValue;
-        }
+        SOUL_ASSERT (capacity > 0);
+        eventTimes.resize (capacity, 0);
+        eventData.resize (capacity * eventSize, 0);
     }
 
     using TimeType = TimestampType;
 
-    struct Event
-    {
-        uint64_t time;
-        soul::Value value;
-    };
+    static constexpr uint32_t defaultCapacity = 1024;
+
+    uint32_t getCapacity() const noexcept           { return capacity; }
+    uint64_t getNumEventsReady() const noexcept     { return writePos - readPos; }
+    uint64_t getNumOverflows() const noexcept       { return numOverflows; }
+    uint64_t getHighWaterMark() const noexcept      { return highWaterMark; }
+
+    uint64_t getEventTime (uint64_t pos) const noexcept      { return eventTimes[pos % capacity]; }
+    const void* getEventData (uint64_t pos) const noexcept   { return eventData.data() + (pos % capacity) * eventSize; }
 
-    Event& getEvent (uint64_t pos) noexcept    { return events[pos % capacity]; }
+    /** Returns a copy of an event, for code that isn't time-critical. */
+    soul::Value getEventValue (uint64_t pos) const
+    {
+        return soul::Value::createFromRawData (eventType, getEventData (pos), eventSize);
+    }
 
-    void pushEvent (uint64_t eventTime, const soul::Value& value) noexcept
+    /** Adds an event whose packed data matches the FIFO's event type.
+        Returns false if the FIFO was full and the event had to be dropped.
+    */
+    bool pushEvent (uint64_t eventTime, const void* packedEventData) noexcept
     {
-        SOUL_ASSERT (value.getType().isIdentical(eventType));
+        uint64_t pos = writePos;
 
-        auto& e = getEvent (writePos);
-        e.time = eventTime;
-        e.value.copyValue (value);
+        if (pos - readPos >= capacity)
+        {
+            ++numOverflows;
+            return false;
+        }
+
+        eventTimes[pos % capacity] = eventTime;
+        std::memcpy (eventData.data() + (pos % capacity) * eventSize, packedEventData, eventSize);
+        writePos = pos + 1;
+
+        if (pos + 1 - readPos > highWaterMark)
+            highWaterMark = pos + 1 - readPos;
+
+        return true;
+    }
 
-        ++writePos;
+    bool pushEvent (uint64_t eventTime, const soul::Value& value) noexcept
+    {
+        SOUL_ASSERT (value.getType().isIdentical (eventType) && value.getPackedDataSize() == eventSize);
+        return pushEvent (eventTime, value.getPackedData());
     }
 
-    void pushEvents (uint64_t eventTime, const soul::Value* eventsToAdd, uint32_t count)
+    /** Adds a number of events with the same time, returning the number which fitted. */
+    uint32_t pushEvents (uint64_t eventTime, const soul::Value* eventsToAdd, uint32_t count) noexcept
     {
+        uint32_t numAdded = 0;
+
         for (uint32_t i = 0; i < count; ++i)
-            pushEvent (eventTime, eventsToAdd[i]);
+            if (pushEvent (eventTime, eventsToAdd[i]))
+                ++numAdded;
+
+        return numAdded;
     }
 
-    static constexpr uint32_t capacity = 1024;
-    std::vector<Event> events;
-    TimeType readPos { 0 }, writePos { 0 };
+    TimeType readPos { 0 }, writePos { 0 }, numOverflows { 0 }, highWaterMark { 0 };
     Type eventType;
+
+private:
+    const uint32_t capacity;
+    const size_t eventSize;
+    std::vector<uint64_t> eventTimes;
+    std::vector<uint8_t> eventData;
 };
 
 }
@@ -22,111 +22,288 @@ namespace soul
 {
 
 //==============================================================================
-/** A single-reader, single-writer threaded FIFO.
+/** A single-reader, single-writer FIFO, which just manages the read and write positions
+    for a circular buffer which the caller owns.
+
+    The reader and writer each only touch their own atomic position, so the versions of
+    ReadOperation and WriteOperation which don't take a deadline are wait-free, and can be
+    used on a realtime thread. The versions with a deadline will block until there's enough
+    data or space, or the FIFO is cancelled, so should only be used on other threads.
 */
 struct FIFO
 {
-    FIFO (int size) : totalSize (size), freeSize (size - 1) {}
-
-    std::mutex lock;
-    std::condition_variable changed;
-    int totalSize, validStart = 0, validSize = 0, freeSize = 0;
-    bool isCancelled = false;
+    FIFO (int size) : totalSize (size) {}
 
     int getTotalSize() const noexcept    { return totalSize; }
-    int getFreeSpace() const noexcept    { return freeSize; }
-    int getNumReady() const noexcept     { return validSize; }
+    int getFreeSpace() const noexcept    { return totalSize - 1 - getNumReady(); }
+
+    int getNumReady() const noexcept
+    {
+        auto numReady = writePosition.load (std::memory_order_acquire) - readPosition.load (std::memory_order_acquire);
+        return numReady < 0 ? numReady + totalSize : numReady;
+    }
+
+    bool isCancelled() const noexcept    { return cancelled.load(); }
 
+    /** Empties the FIFO and clears any cancellation.
+        This mustn't be called while a read or write is in progress.
+    */
     void reset()
     {
-        std::lock_guard<std::mutex> l (lock);
-        validStart = 0;
-        validSize = 0;
-        freeSize = totalSize - 1;
-        isCancelled = false;
-        changed.notify_all();
+        readPosition = 0;
+        writePosition = 0;
+        cancelled = false;
+        notifyWaitingThreads();
     }
 
+    /** Makes any blocking reads or writes which are waiting, or start waiting later, fail. */
     void cancel()
     {
-        std::lock_guard<std::mutex> l (lock);
-        isCancelled = true;
-        changed.notify_all();
+        cancelled = true;
+        notifyWaitingThreads();
     }
 
     //==============================================================================
     struct ReadOperation
     {
-        ReadOperation (FIFO& f, int numWanted, std::chrono::high_resolution_clock::time_point deadline) : fifo (f)
+        /** Reads the given number of items, failing immediately if they're not all ready. */
+        ReadOperation (FIFO& f, int numWanted) : fifo (f)
         {
             SOUL_ASSERT (numWanted > 0 && numWanted <= f.totalSize);
-            std::unique_lock<std::mutex> l (f.lock);
 
-            while (f.validSize < numWanted)
-                if (! f.waitForChange (l, deadline))
-                    return;
+            if (f.getNumReady() >= numWanted)
+                setBlocks (numWanted);
+        }
 
-            startIndex1 = f.validStart;
-            blockSize1 = std::min (f.totalSize - startIndex1, numWanted);
-            blockSize2 = std::max (0, numWanted - blockSize1);
+        /** Reads the given number of items, waiting until the deadline for them to be ready. */
+        ReadOperation (FIFO& f, int numWanted, std::chrono::high_resolution_clock::time_point deadline) : fifo (f)
+        {
+            SOUL_ASSERT (numWanted > 0 && numWanted <= f.totalSize);
+
+            if (f.waitUntil ([&] { return f.getNumReady() >= numWanted; }, deadline))
+                setBlocks (numWanted);
         }
 
         ~ReadOperation()
         {
-            std::lock_guard<std::mutex> l (fifo.lock);
-            auto numDone = blockSize1 + blockSize2;
-            auto newStart = fifo.validStart + numDone;
-            fifo.validStart = newStart >= fifo.totalSize ? (newStart - fifo.totalSize) : newStart;
-            fifo.validSize -= numDone;
-            fifo.freeSize += numDone;
-            fifo.changed.notify_all();
+            if (! failed())
+            {
+                fifo.readPosition.store (fifo.wrap (startIndex1 + blockSize1 + blockSize2), std::memory_order_release);
+                fifo.notifyWaitingThreads();
+            }
         }
 
         bool failed() const         { return blockSize1 == 0; }
 
+        /** Abandons the read, leaving the items in the FIFO for a later one. */
+        void cancel()               { blockSize1 = 0; blockSize2 = 0; }
+
         FIFO& fifo;
         int startIndex1 = 0, blockSize1 = 0, blockSize2 = 0;
+
+    private:
+        void setBlocks (int numWanted)
+        {
+            startIndex1 = fifo.readPosition.load (std::memory_order_relaxed);
+            blockSize1 = std::min (fifo.totalSize - startIndex1, numWanted);
+            blockSize2 = numWanted - blockSize1;
+        }
     };
 
     //==============================================================================
     struct WriteOperation
     {
-        WriteOperation (FIFO& f, int numToWrite, std::chrono::high_resolution_clock::time_point deadline) : fifo (f)
+        /** Writes the given number of items, failing immediately if there isn't space for them all. */
+        WriteOperation (FIFO& f, int numToWrite) : fifo (f)
         {
             SOUL_ASSERT (numToWrite > 0 && numToWrite <= f.totalSize);
-            std::unique_lock<std::mutex> l (f.lock);
 
-            while (f.freeSize < numToWrite)
-                if (! f.waitForChange (l, deadline))
-                    return;
+            if (f.getFreeSpace() >= numToWrite)
+                setBlocks (numToWrite);
+        }
+
+        /** Writes the given number of items, waiting until the deadline for there to be space. */
+        WriteOperation (FIFO& f, int numToWrite, std::chrono::high_resolution_clock::time_point deadline) : fifo (f)
+        {
+            SOUL_ASSERT (numToWrite > 0 && numToWrite <= f.totalSize);
 
-            auto freeStart = f.validStart + f.validSize;
-            startIndex1 = freeStart >= f.totalSize ? freeStart - f.totalSize : freeStart;
-            blockSize1 = std::min (f.totalSize - startIndex1, numToWrite);
-            blockSize2 = std::max (0, numToWrite - blockSize1);
+            if (f.waitUntil ([&] { return f.getFreeSpace() >= numToWrite; }, deadline))
+                setBlocks (numToWrite);
         }
 
         ~WriteOperation()
         {
-            std::lock_guard<std::mutex> l (fifo.lock);
-            auto numDone = blockSize1 + blockSize2;
-            fifo.validSize += numDone;
-            fifo.freeSize -= numDone;
-            fifo.changed.notify_all();
+            if (! failed())
+            {
+                fifo.writePosition.store (fifo.wrap (startIndex1 + blockSize1 + blockSize2), std::memory_order_release);
+                fifo.notifyWaitingThreads();
+            }
         }
 
         bool failed() const         { return blockSize1 == 0; }
 
         FIFO& fifo;
         int startIndex1 = 0, blockSize1 = 0, blockSize2 = 0;
+
+    private:
+        void setBlocks (int numToWrite)
+        {
+            startIndex1 = fifo.writePosition.load (std::memory_order_relaxed);
+            blockSize1 = std::min (fifo.totalSize - startIndex1, numToWrite);
+            blockSize2 = numToWrite - blockSize1;
+        }
     };
 
 private:
-    bool waitForChange (std::unique_lock<std::mutex>& l,
-                        std::chrono::high_resolution_clock::time_point deadline)
+    const int totalSize;
+    std::atomic<int> readPosition { 0 }, writePosition { 0 };
+    std::atomic<bool> cancelled { false };
+
+    // These are only used by threads which are blocked waiting for the other end
+    std::mutex waitLock;
+    std::condition_variable changed;
+    std::atomic<int> numWaitingThreads { 0 };
+
+    int wrap (int position) const noexcept
     {
-        return ! (isCancelled || changed.wait_until (l, deadline) == std::cv_status::timeout);
+        return position >= totalSize ? position - totalSize : position;
     }
+
+    void notifyWaitingThreads()
+    {
+        // A realtime thread only makes this call if someone is actually waiting
+        if (numWaitingThreads.load() != 0)
+            changed.notify_all();
+    }
+
+    template <typename IsReadyFn>
+    bool waitUntil (IsReadyFn&& isReady, std::chrono::high_resolution_clock::time_point deadline)
+    {
+        if (isReady())
+            return true;
+
+        // Because the other end doesn't take the lock before notifying, a wake-up can be missed,
+        // so the condition is re-checked at least once per interval
+        constexpr auto maxWaitInterval = std::chrono::milliseconds (1);
+
+        std::unique_lock<std::mutex> l (waitLock);
+        ++numWaitingThreads;
+
+        for (;;)
+        {
+            if (isReady())
+                break;
+
+            auto now = std::chrono::high_resolution_clock::now();
+
+            if (cancelled || now >= deadline)
+            {
+                --numWaitingThreads;
+                return false;
+            }
+
+            changed.wait_until (l, std::min (deadline, now + maxWaitInterval));
+        }
+
+        --numWaitingThreads;
+        return true;
+    }
+};
+
+//==============================================================================
+/** A bounded FIFO of items which any number of threads can push to, and a single thread
+    reads from.
+
+    Pushing and popping are both lock-free, so either end can be used on a realtime thread.
+    Each slot has a sequence number which tells a writer whether it's free and tells the
+    reader whether it's been filled, so writers only contend with each other when they
+    claim a position.
+*/
+template <typename Item>
+struct MultipleWriterFIFO
+{
+    MultipleWriterFIFO() = default;
+
+    /** Reallocates the FIFO with space for at least the given number of items.
+        This mustn't be called while any other thread might be using it.
+    */
+    void reset (uint32_t minimumCapacity)
+    {
+        uint32_t capacity = 2;
+
+        while (capacity < minimumCapacity)
+            capacity *= 2;
+
+        slots.reset (new Slot[capacity]);
+        mask = capacity - 1;
+
+        for (uint32_t i = 0; i < capacity; ++i)
+            slots[i].sequence.store (i, std::memory_order_relaxed);
+
+        writePosition.store (0);
+        readPosition = 0;
+    }
+
+    uint32_t getCapacity() const noexcept       { return static_cast<uint32_t> (mask + 1); }
+
+    /** Adds an item, returning false if the FIFO is full. This can be called from any thread. */
+    bool push (const Item& item) noexcept
+    {
+        auto position = writePosition.load (std::memory_order_relaxed);
+
+        for (;;)
+        {
+            auto& slot = slots[position & mask];
+            auto sequence = slot.sequence.load (std::memory_order_acquire);
+            auto difference = static_cast<int64_t> (sequence) - static_cast<int64_t> (position);
+
+            if (difference == 0)
+            {
+                if (writePosition.compare_exchange_weak (position, position + 1, std::memory_order_relaxed))
+                {
+                    slot.item = item;
+                    slot.sequence.store (position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = writePosition.load (std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /** Removes the oldest item, returning false if the FIFO is empty.
+        This must only be called by the reader thread.
+    */
+    bool pop (Item& result) noexcept
+    {
+        auto& slot = slots[readPosition & mask];
+
+        if (slot.sequence.load (std::memory_order_acquire) != readPosition + 1)
+            return false;
+
+        result = slot.item;
+        slot.sequence.store (readPosition + mask + 1, std::memory_order_release);
+        ++readPosition;
+        return true;
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<uint64_t> sequence { 0 };
+        Item item;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    uint64_t mask = 0;
+    std::atomic<uint64_t> writePosition { 0 };
+    uint64_t readPosition = 0;
 };
 
 } // namespace soul
@@ -39,7 +39,19 @@ struct Identifier  final
     bool operator== (const std::string& other) const                { SOUL_ASSERT (isValid()); return *name == other; }
     bool operator!= (const std::string& other) const                { SOUL_ASSERT (isValid()); return *name != other; }
 
+    /** A hash function for using Identifiers as keys in unordered containers. */
+    struct Hash
+    {
+        size_t operator() (const Identifier& i) const noexcept    { return std::hash<const std::string*>() (i.name); }
+    };
+
     //==============================================================================
+    /** Creates and owns the strings that Identifiers point to.
+
+        A pool can share its strings with other pools, so that (for example) the AST and
+        the HEART program generated from it can compare each other's identifiers directly.
+        The strings stay alive for as long as any of the pools that share them.
+    */
     struct Pool  final
     {
         Pool() {}
@@ -55,54 +67,74 @@ struct Identifier  final
         Identifier get (const std::string& newString)
         {
             SOUL_ASSERT (! newString.empty());
+            return Identifier (std::addressof (*getStrings().insert (newString).first));
+        }
 
-            size_t s = 0;
-            size_t e = strings.size();
+        Identifier get (const Identifier& i)
+        {
+            if (! i.isValid())
+                return {};
 
-            while (s < e)
-            {
-                auto* elem = strings[s].get();
+            return get (i.toString());
+        }
 
-                if (*elem == newString)
-                    return Identifier (elem);
+        /** Makes this pool use the same strings as another one. Any identifiers which have
+            already been created by this pool will remain valid for as long as it exists.
+        */
+        void shareWith (Pool& other)
+        {
+            if (strings != nullptr && ! strings->empty() && strings != other.strings)
+                previousStrings.push_back (std::move (strings));
 
-                auto halfway = (s + e) / 2;
-                bool isBeforeHalfway = (newString < *strings[halfway]);
+            other.getStrings();
+            strings = other.strings;
+        }
 
-                if (halfway == s)
+        /** Returns an estimate of the number of bytes used by the pool's strings. If the strings
+            are shared with other pools, they're counted by each of them.
+        */
+        size_t getMemoryUsage() const
+        {
+            size_t total = 0;
+
+            auto addSet = [&] (const std::shared_ptr<StringSet>& set)
+            {
+                if (set != nullptr)
                 {
-                    if (! isBeforeHalfway)
-                        ++s;
+                    total += getHashContainerMemoryUsage (*set);
 
-                    break;
+                    for (auto& s : *set)
+                        total += s.capacity();
                 }
+            };
 
-                if (isBeforeHalfway)
-                    e = halfway;
-                else
-                    s = halfway;
-            }
+            addSet (strings);
 
-            auto* sharedString = new std::string (newString);
-            strings.insert (strings.begin() + (int) s, std::unique_ptr<std::string> (sharedString));
-            return Identifier (sharedString);
-        }
-
-        Identifier get (const Identifier& i)
-        {
-            if (! i.isValid())
-                return {};
+            for (auto& s : previousStrings)
+                addSet (s);
 
-            return get (i.toString());
+            return total;
         }
 
+        /** Detaches this pool from its strings. Any other pools sharing them are unaffected. */
         void clear()
         {
-            strings.clear();
+            strings.reset();
+            previousStrings.clear();
         }
 
     private:
-        std::vector<std::unique_ptr<std::string>> strings;
+        using StringSet = std::unordered_set<std::string>;
+        std::shared_ptr<StringSet> strings;
+        std::vector<std::shared_ptr<StringSet>> previousStrings;
+
+        StringSet& getStrings()
+        {
+            if (strings == nullptr)
+                strings = std::make_shared<StringSet>();
+
+            return *strings;
+        }
     };
 
 private:
@@ -34,6 +34,167 @@ bool inExceptionHandler()
    #endif
 }
 
+void runTasksInParallel (size_t numTasks, uint32_t numThreads, const std::function<void(size_t)>& task)
+{
+    if (numThreads <= 1 || numTasks <= 1)
+    {
+        for (size_t i = 0; i < numTasks; ++i)
+            task (i);
+
+        return;
+    }
+
+    std::vector<std::exception_ptr> exceptions (numTasks);
+    std::atomic<size_t> nextTask { 0 };
+
+    auto runNextTasks = [&]
+    {
+        for (;;)
+        {
+            auto index = nextTask++;
+
+            if (index >= numTasks)
+                break;
+
+            try
+            {
+                task (index);
+            }
+            catch (...)
+            {
+                exceptions[index] = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    auto numWorkers = std::min ((size_t) numThreads, numTasks) - 1;
+    workers.reserve (numWorkers);
+
+    for (size_t i = 0; i < numWorkers; ++i)
+        workers.emplace_back (runNextTasks);
+
+    runNextTasks();
+
+    for (auto& w : workers)
+        w.join();
+
+    for (auto& e : exceptions)
+        if (e != nullptr)
+            std::rethrow_exception (e);
+}
+
+bool setCurrentThreadRealtimePriority (int priority)
+{
+   #if SOUL_POSIX_THREADS
+    sched_param param {};
+    param.sched_priority = std::clamp (priority, sched_get_priority_min (SCHED_FIFO), sched_get_priority_max (SCHED_FIFO));
+    return pthread_setschedparam (pthread_self(), SCHED_FIFO, std::addressof (param)) == 0;
+   #else
+    ignoreUnused (priority);
+    return false;
+   #endif
+}
+
+bool setCurrentThreadCPUAffinity (const std::vector<uint32_t>& cpuCores)
+{
+   #if SOUL_POSIX_THREADS && defined (__linux__)
+    cpu_set_t cpus;
+    CPU_ZERO (std::addressof (cpus));
+
+    for (auto core : cpuCores)
+        if (core < CPU_SETSIZE)
+            CPU_SET (core, std::addressof (cpus));
+
+    return CPU_COUNT (std::addressof (cpus)) != 0
+            && pthread_setaffinity_np (pthread_self(), sizeof (cpus), std::addressof (cpus)) == 0;
+   #else
+    ignoreUnused (cpuCores);
+    return false;
+   #endif
+}
+
+std::vector<uint32_t> getNUMANodeCPUCores (uint32_t node)
+{
+    std::vector<uint32_t> cores;
+
+   #ifdef __linux__
+    // The list is in the form "0-7,16-23"
+    std::ifstream file ("/sys/devices/system/node/node" + std::to_string (node) + "/cpulist");
+    std::string list;
+
+    if (std::getline (file, list))
+    {
+        for (auto& range : choc::text::splitString (trim (list), ',', false))
+        {
+            auto dash = range.find ('-');
+            auto first = std::strtoul (range.c_str(), nullptr, 10);
+            auto last = dash == std::string::npos ? first : std::strtoul (range.c_str() + dash + 1, nullptr, 10);
+
+            for (auto core = first; core <= last; ++core)
+                cores.push_back (static_cast<uint32_t> (core));
+        }
+    }
+   #else
+    ignoreUnused (node);
+   #endif
+
+    return cores;
+}
+
+#ifdef __linux__
+ // These are the values from linux/mempolicy.h, which are used directly so that libnuma isn't needed
+ static constexpr int numaPolicyDefault = 0, numaPolicyPreferred = 1;
+ static constexpr uint32_t maxNUMANodes = 1024;
+#endif
+
+bool setCurrentThreadNUMANode (int node)
+{
+   #ifdef __linux__
+    if (node < 0)
+        return syscall (SYS_set_mempolicy, numaPolicyDefault, nullptr, 0) == 0;
+
+    if (static_cast<uint32_t> (node) >= maxNUMANodes)
+        return false;
+
+    constexpr auto bitsPerWord = sizeof (unsigned long) * 8;
+    unsigned long nodeMask[maxNUMANodes / bitsPerWord] = {};
+    nodeMask[static_cast<uint32_t> (node) / bitsPerWord] = 1ul << (static_cast<uint32_t> (node) % bitsPerWord);
+
+    // The kernel ignores the last bit of the mask size, hence the + 1
+    return syscall (SYS_set_mempolicy, numaPolicyPreferred, nodeMask, maxNUMANodes + 1) == 0;
+   #else
+    ignoreUnused (node);
+    return false;
+   #endif
+}
+
+void* allocateLargeBlock (size_t size)
+{
+   #ifdef __linux__
+    auto block = mmap (nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (block == MAP_FAILED)
+        return nullptr;
+
+    madvise (block, size, MADV_HUGEPAGE);
+    return block;
+   #else
+    return std::calloc (size, 1);
+   #endif
+}
+
+void freeLargeBlock (void* block, size_t size)
+{
+   #ifdef __linux__
+    if (block != nullptr)
+        munmap (block, size);
+   #else
+    ignoreUnused (size);
+    std::free (block);
+   #endif
+}
+
 ScopedDisableDenormals::ScopedDisableDenormals() noexcept  : oldFlags (getFPMode())
 {
    #if SOUL_ARM64 || SOUL_ARM32
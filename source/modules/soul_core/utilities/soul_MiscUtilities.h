@@ -64,6 +64,105 @@ void ignoreUnused (Types&&...) noexcept {}
 /** Returns whether an exception is in the process of being unwound. */
 bool inExceptionHandler();
 
+//==============================================================================
+/** Runs a batch of independent tasks, spreading them across a number of worker threads.
+
+    The function is called once for each task index from 0 to numTasks - 1, and this blocks
+    until all of them have finished. The calling thread also takes part in the work, so a
+    numThreads value of 0 or 1 simply runs all the tasks synchronously, in order.
+
+    If any tasks throw an exception, it's caught and re-thrown on the calling thread once all
+    the workers have finished. If more than one task throws, it's the one with the lowest index
+    that gets re-thrown, so that the result doesn't depend on thread timing.
+*/
+void runTasksInParallel (size_t numTasks, uint32_t numThreads, const std::function<void(size_t taskIndex)>& task);
+
+//==============================================================================
+/** Attempts to switch the calling thread to a realtime scheduling policy with the given
+    priority (1 to 99). Returns false if this isn't supported on this platform, or the
+    process doesn't have permission to do it.
+*/
+bool setCurrentThreadRealtimePriority (int priority);
+
+/** Attempts to restrict the calling thread to run on the given set of CPU cores.
+    Returns false if this isn't supported on this platform, or the cores are invalid.
+*/
+bool setCurrentThreadCPUAffinity (const std::vector<uint32_t>& cpuCores);
+
+//==============================================================================
+/** Returns the CPU cores which belong to a NUMA node, or an empty list if the node doesn't
+    exist, or this isn't supported on this platform.
+*/
+std::vector<uint32_t> getNUMANodeCPUCores (uint32_t node);
+
+/** Asks for any memory pages that the calling thread touches for the first time to be placed
+    on the given NUMA node, where possible. A negative node goes back to the default policy,
+    which places pages on whichever node the thread happens to be running on. Returns false if
+    this isn't supported on this platform.
+*/
+bool setCurrentThreadNUMANode (int node);
+
+/** Uses setCurrentThreadNUMANode() to place the memory that the calling thread touches on a
+    NUMA node for the lifetime of this object, and then goes back to the default policy.
+    A negative node leaves the policy alone.
+*/
+struct ScopedNUMANode
+{
+    ScopedNUMANode (int n) : node (n)   { if (node >= 0) setCurrentThreadNUMANode (node); }
+    ~ScopedNUMANode()                   { if (node >= 0) setCurrentThreadNUMANode (-1); }
+
+    const int node;
+};
+
+/** Allocates a block of memory which has its own mapping, and asks for it to be backed by
+    huge pages where the platform supports them. The memory is zeroed, and its pages aren't
+    placed until they're first touched, so they end up on the NUMA node chosen by the thread
+    which first writes to them. Where it's not supported, this falls back to calloc().
+*/
+void* allocateLargeBlock (size_t size);
+void freeLargeBlock (void* block, size_t size);
+
+/** An allocator for containers which can get very large, like a performer's state. Blocks of
+    minLargeBlockSize bytes or more come from allocateLargeBlock(), and smaller ones from the
+    default allocator.
+*/
+template <typename Type>
+struct LargeBlockAllocator
+{
+    using value_type = Type;
+
+    static constexpr size_t minLargeBlockSize = 2 * 1024 * 1024;
+
+    LargeBlockAllocator() = default;
+    template <typename Other> LargeBlockAllocator (const LargeBlockAllocator<Other>&) noexcept {}
+
+    Type* allocate (size_t num)
+    {
+        auto size = num * sizeof (Type);
+
+        if (size < minLargeBlockSize)
+            return std::allocator<Type>().allocate (num);
+
+        if (auto block = allocateLargeBlock (size))
+            return static_cast<Type*> (block);
+
+        throw std::bad_alloc();
+    }
+
+    void deallocate (Type* block, size_t num) noexcept
+    {
+        auto size = num * sizeof (Type);
+
+        if (size < minLargeBlockSize)
+            std::allocator<Type>().deallocate (block, num);
+        else
+            freeLargeBlock (block, size);
+    }
+
+    template <typename Other> bool operator== (const LargeBlockAllocator<Other>&) const noexcept   { return true; }
+    template <typename Other> bool operator!= (const LargeBlockAllocator<Other>&) const noexcept   { return false; }
+};
+
 //==============================================================================
 /** Rounds-up a size to a value which is a multiple of the given granularity. */
 template <int granularity, typename SizeType>
@@ -90,6 +189,17 @@ constexpr PointerType getAlignedPointer (PointerType p)
                                             + (size_t)(granularity - 1)) & ~(size_t)(granularity - 1));
 }
 
+/** Returns the smallest power of 2 which is greater than or equal to the given value. */
+constexpr uint32_t getNextPowerOf2 (uint32_t n)
+{
+    uint32_t result = 1;
+
+    while (result < n)
+        result <<= 1;
+
+    return result;
+}
+
 template <typename Type>
 Type readUnaligned (const void* srcPtr) noexcept
 {
@@ -218,7 +218,17 @@ inline bool is_type (SrcType& object)
 class PoolAllocator  final
 {
 public:
-    PoolAllocator()    { clear(); }
+    /** The first pool block that gets allocated will have the initial size, and each new block
+        is twice as big as the one before, up to the maximum size.
+    */
+    PoolAllocator (size_t initialPoolSize = defaultInitialPoolSize,
+                   size_t maximumPoolSize = defaultMaximumPoolSize)
+        : initialPoolBlockSize (std::max (initialPoolSize, minimumPoolSize)),
+          maximumPoolBlockSize (std::max (maximumPoolSize, initialPoolBlockSize))
+    {
+        clear();
+    }
+
     ~PoolAllocator() = default;
 
     PoolAllocator (const PoolAllocator&) = delete;
@@ -226,100 +236,225 @@ public:
     PoolAllocator (PoolAllocator&&) = default;
     PoolAllocator& operator= (PoolAllocator&&) = default;
 
-    /** Clears the pool (deleting all the objects in it) */
+    static constexpr const size_t defaultInitialPoolSize = 1024 * 64 - 32;
+    static constexpr const size_t defaultMaximumPoolSize = 1024 * 1024 - 32;
+
+    /** Clears the pool (deleting all the objects in it) and releases all its memory. */
     void clear()
     {
         pools.clear();
+        sparePools.clear();
         pools.reserve (32);
-        addNewPool();
+        numAllocations = 0;
+        nextPoolBlockSize = initialPoolBlockSize;
+        startNewPool (0);
+    }
+
+    /** Deletes all the objects in the pool, but hangs onto the memory blocks so that they can
+        be re-used by any objects that are allocated after this, rather than having to allocate
+        them all over again.
+    */
+    void reset()
+    {
+        for (auto& p : pools)
+        {
+            p->destroyObjects();
+            sparePools.push_back (std::move (p));
+        }
+
+        pools.clear();
+        numAllocations = 0;
+        startNewPool (0);
+    }
+
+    /** Moves all the objects from another pool into this one.
+        This is handy when a worker thread has been building objects in its own private
+        pool, since the objects stay where they are but their lifetime becomes tied to this
+        pool instead. The other pool is left empty, but still usable.
+    */
+    void absorb (PoolAllocator& other)
+    {
+        if (std::addressof (other) != this)
+        {
+            // NB: the new pools go in before the current one, so that it's still last
+            pools.insert (pools.end() - 1,
+                          std::make_move_iterator (other.pools.begin()),
+                          std::make_move_iterator (other.pools.end()));
+            numAllocations += other.numAllocations;
+
+            other.pools.clear();
+            other.numAllocations = 0;
+            other.startNewPool (0);
+        }
     }
 
     /** Allocates a new object for the pool, returning a reference to it. */
     template <typename Type, typename... Args>
     Type& allocate (Args&&... args)
     {
-        static_assert (sizeof (Type) + itemHeaderSize <= sizeof (Pool::space), "Can't allocate a pool object bigger than the pool block size");
+        // Objects which don't need destroying can skip having a destructor registered for them
+        constexpr bool needsDestructor = ! std::is_trivially_destructible<Type>::value;
+
         // NB: the constructor may throw, so we have to be careful not to register its destructor until we know it was successful
-        auto address = prepareSpaceForObject (sizeof (Type));
+        auto address = prepareSpaceForObject (sizeof (Type), needsDestructor);
         auto newObject = new (address) Type (std::forward<Args> (args)...);
-        currentPool->registerNewObject (sizeof (Type), [] (void* t) { static_cast<Type*> (t)->~Type(); });
+        currentPool->registerNewObject (sizeof (Type), needsDestructor ? destroyObject<Type> : nullptr);
+        ++numAllocations;
         return *newObject;
     }
 
+    /** Returns the number of objects that have been allocated since the pool was last cleared. */
+    size_t getNumAllocations() const noexcept       { return numAllocations; }
+
+    /** Returns the number of bytes used by the objects in the pool, including their headers. */
+    size_t getNumBytesUsed() const noexcept
+    {
+        size_t total = 0;
+
+        for (auto& p : pools)
+            total += p->nextSlot;
+
+        return total;
+    }
+
+    /** Returns the total size of the blocks that the pool has allocated, including the space
+        in them that hasn't been used yet, and any spare blocks that reset() has kept.
+    */
+    size_t getNumBytesAllocated() const noexcept
+    {
+        size_t total = 0;
+
+        for (auto& p : pools)       total += p->capacity;
+        for (auto& p : sparePools)  total += p->capacity;
+
+        return total;
+    }
+
 private:
     using DestructorFn = void(void*);
 
-    struct PoolItem
+    struct DestructorRecord
     {
-        size_t size;
         DestructorFn* destructor;
-        void* item;
+        DestructorRecord* next;
     };
 
-    static constexpr const size_t poolSize = 1024 * 64 - 32;
     static constexpr const size_t poolItemAlignment = 8;
-    static constexpr const size_t itemHeaderSize = offsetof (PoolItem, item);
+    static constexpr const size_t minimumPoolSize = 1024;
+    static constexpr const size_t destructorRecordSize = getAlignedSize<poolItemAlignment> (sizeof (DestructorRecord));
+
+    template <typename Type>
+    static void destroyObject (void* t)     { static_cast<Type*> (t)->~Type(); }
 
     struct Pool
     {
-        Pool() { SOUL_ASSERT (isAlignedPointer<poolItemAlignment> (getNextAddress())); }
+        Pool (size_t size) : capacity (size), space (new char[size])
+        {
+            SOUL_ASSERT (isAlignedPointer<poolItemAlignment> (space.get()));
+        }
+
         Pool (const Pool&) = delete;
         Pool (Pool&&) = delete;
 
         ~Pool()
         {
-            for (size_t i = 0; i < nextSlot;)
+            destroyObjects();
+        }
+
+        void destroyObjects()
+        {
+            for (auto record = firstDestructor; record != nullptr;)
             {
-                auto item = getItem (i);
-                item->destructor (&item->item);
-                i += item->size;
+                auto next = record->next;
+                record->destructor (getObjectForRecord (record));
+                record = next;
             }
+
+            firstDestructor = nullptr;
+            lastDestructor = nullptr;
+            nextSlot = 0;
+        }
+
+        static size_t getSpaceNeeded (size_t objectSize, bool needsDestructor)
+        {
+            return getAlignedSize<poolItemAlignment> (objectSize + (needsDestructor ? destructorRecordSize : 0));
         }
 
-        bool hasSpaceFor (size_t size) const
+        bool hasSpaceFor (size_t spaceNeeded) const
         {
-            return nextSlot + getAlignedSize<poolItemAlignment> (size + itemHeaderSize) <= poolSize;
+            return nextSlot + spaceNeeded <= capacity;
         }
 
-        void* getNextAddress()
+        void* getNextAddress (bool needsDestructor)
         {
-            auto item = getItem (nextSlot);
-            return &item->item;
+            return space.get() + nextSlot + (needsDestructor ? destructorRecordSize : 0);
         }
 
-        void registerNewObject (size_t size, DestructorFn d)
+        void registerNewObject (size_t objectSize, DestructorFn* destructor)
         {
-            size = getAlignedSize<poolItemAlignment> (size + itemHeaderSize);
-            auto item = getItem (nextSlot);
-            item->size = size;
-            item->destructor = d;
-            nextSlot += size;
+            if (destructor != nullptr)
+            {
+                auto record = reinterpret_cast<DestructorRecord*> (space.get() + nextSlot);
+                record->destructor = destructor;
+                record->next = nullptr;
+
+                if (lastDestructor != nullptr)
+                    lastDestructor->next = record;
+                else
+                    firstDestructor = record;
+
+                lastDestructor = record;
+            }
+
+            nextSlot += getSpaceNeeded (objectSize, destructor != nullptr);
         }
 
-        PoolItem* getItem (size_t byteOffset) noexcept  { return reinterpret_cast<PoolItem*> (space.data() + byteOffset); }
+        static void* getObjectForRecord (DestructorRecord* record) noexcept
+        {
+            return reinterpret_cast<char*> (record) + destructorRecordSize;
+        }
 
+        const size_t capacity;
         size_t nextSlot = 0;
-        alignas(poolItemAlignment) std::array<char, poolSize> space;
+        std::unique_ptr<char[]> space;
+        DestructorRecord* firstDestructor = nullptr;
+        DestructorRecord* lastDestructor = nullptr;
     };
 
-    std::vector<std::unique_ptr<Pool>> pools;
+    std::vector<std::unique_ptr<Pool>> pools, sparePools;
     Pool* currentPool = nullptr;
+    size_t numAllocations = 0;
+    size_t initialPoolBlockSize, maximumPoolBlockSize, nextPoolBlockSize = 0;
 
-    void addNewPool()
+    void startNewPool (size_t minimumSize)
     {
-        currentPool = new Pool();
+        for (auto i = sparePools.begin(); i != sparePools.end(); ++i)
+        {
+            if ((*i)->capacity >= minimumSize)
+            {
+                currentPool = i->get();
+                pools.push_back (std::move (*i));
+                sparePools.erase (i);
+                return;
+            }
+        }
+
+        currentPool = new Pool (std::max (nextPoolBlockSize, minimumSize));
         pools.emplace_back (currentPool);
+        nextPoolBlockSize = std::min (nextPoolBlockSize * 2, maximumPoolBlockSize);
     }
 
-    void* prepareSpaceForObject (size_t size)
+    void* prepareSpaceForObject (size_t objectSize, bool needsDestructor)
     {
-        if (! currentPool->hasSpaceFor (size))
+        auto spaceNeeded = Pool::getSpaceNeeded (objectSize, needsDestructor);
+
+        if (! currentPool->hasSpaceFor (spaceNeeded))
         {
-            addNewPool();
-            SOUL_ASSERT (currentPool->hasSpaceFor (size));
+            startNewPool (spaceNeeded);
+            SOUL_ASSERT (currentPool->hasSpaceFor (spaceNeeded));
         }
 
-        return currentPool->getNextAddress();
+        return currentPool->getNextAddress (needsDestructor);
     }
 };
 
@@ -23,7 +23,8 @@ namespace soul
 
 //==============================================================================
 /** A base class for intrusively-reference-counted objects, suitable for use by RefCountedPtr.
-    Note that the counter is non-atomic!
+    The counter is atomic, because objects such as Structures are shared between modules
+    that may be handled on different threads, e.g. when optimising functions in parallel.
 */
 struct RefCountedObject
 {
@@ -32,12 +33,13 @@ struct RefCountedObject
     RefCountedObject (RefCountedObject&&) noexcept {}
     ~RefCountedObject() = default;
 
-    uint32_t refCount = 0;
+    std::atomic<uint32_t> refCount { 0 };
 };
 
 //==============================================================================
 /** A smart pointer for referring to classes that inherit from RefCountedObject.
-    Note that this is intended to be fast, not thread-safe!
+    Like std::shared_ptr, the count is safe to change from multiple threads, but a single
+    RefCountedPtr object isn't.
 */
 template <typename ObjectType>
 struct RefCountedPtr  final
@@ -47,7 +49,7 @@ struct RefCountedPtr  final
     ~RefCountedPtr()   { decIfNotNull (object); }
 
     explicit RefCountedPtr (ObjectType* o) noexcept         : object (o) { incIfNotNull (o); }
-    RefCountedPtr (ObjectType& o) noexcept                  : object (std::addressof (o)) { o.refCount++; }
+    RefCountedPtr (ObjectType& o) noexcept                  : object (std::addressof (o)) { o.refCount.fetch_add (1, std::memory_order_relaxed); }
     RefCountedPtr (const RefCountedPtr& other) noexcept     : object (other.object) { incIfNotNull (object); }
     RefCountedPtr (RefCountedPtr&& other) noexcept          : object (other.object) { other.object = nullptr; }
 
@@ -95,7 +97,7 @@ private:
     static void incIfNotNull (ObjectType* o) noexcept
     {
         if (o != nullptr)
-            o->refCount++;
+            o->refCount.fetch_add (1, std::memory_order_relaxed);
     }
 
     static void decIfNotNull (ObjectType* o)
@@ -104,7 +106,7 @@ private:
         {
             SOUL_ASSERT (o->refCount > 0);
 
-            if (--(o->refCount) == 0)
+            if (o->refCount.fetch_sub (1, std::memory_order_acq_rel) == 1)
                 delete o;
         }
     }
@@ -21,7 +21,12 @@
 namespace soul
 {
 
-/** A sinc interpolator that can resample a chunk of audio data to fit a new number of frames. */
+/** A sinc interpolator that can resample a chunk of audio data to fit a new number of frames.
+
+    The windowed-sinc kernel is precomputed into a polyphase table, with the fractional
+    positions between phases being linearly interpolated. A larger number of zero crossings
+    gives a higher quality result, at the expense of speed.
+*/
 template <typename DestType, typename SourceType>
 void resampleToFit (DestType&& dest, const SourceType& source, int zeroCrossings = 50)
 {
@@ -45,47 +50,106 @@ void resampleToFit (DestType&& dest, const SourceType& source, int zeroCrossings
             }
         }
 
-        static void resample (choc::buffer::MonoView<SampleType> dest, const choc::buffer::MonoView<SampleType>& source, float ratio, int zeroCrossings) noexcept
+        static void resample (choc::buffer::MonoView<SampleType> dest, const choc::buffer::MonoView<SampleType>& source, float ratio, int zeroCrossings)
         {
             SOUL_ASSERT (source.data.stride == 1);
             auto sampleIncrement = double (source.getNumFrames()) / double (dest.getNumFrames());
+
+            // When the positions are all whole numbers of samples, only one phase is needed
+            constexpr uint32_t numPhases = 1024;
+            KernelTable kernel (ratio, zeroCrossings, sampleIncrement == std::floor (sampleIncrement) ? 0u : numPhases);
             auto dst = dest.data;
 
             for (choc::buffer::FrameCount i = 0; i < dest.getNumFrames(); ++i)
             {
-                *dst.data = static_cast<SampleType> (ratio * getBandlimitedSample (source, sampleIncrement * i, ratio, zeroCrossings));
+                *dst.data = static_cast<SampleType> (ratio * kernel.getBandlimitedSample (source, sampleIncrement * i));
                 dst.data += dst.stride;
             }
         }
 
-        static SampleType getBandlimitedSample (const choc::buffer::MonoView<SampleType>& source, double pos, float ratio, int numZeroCrossings) noexcept
+        struct KernelTable
         {
-            auto intPos  = (int64_t) pos;
-            auto fracPos = (float) (pos - (double) intPos);
-            auto result = SampleType();
-            auto floatZeroCrossings = SampleType (numZeroCrossings);
-            auto data = source.data.data;
-            auto numFrames = source.getNumFrames();
-
-            if (fracPos > 0)
+            KernelTable (float ratio, int numZeroCrossings, uint32_t phases)
+                : numKernelPhases (phases),
+                  crossings (int (float (numZeroCrossings) / ratio)),
+                  numTaps (static_cast<uint32_t> (2 * crossings + 1)),
+                  coefficients ((numKernelPhases + 1) * numTaps)
+            {
+                auto floatZeroCrossings = SampleType (numZeroCrossings);
+                auto coeff = coefficients.data();
+
+                for (uint32_t phase = 0; phase <= numKernelPhases; ++phase)
+                {
+                    auto fracPos = numKernelPhases == 0 ? 0.0f : float (phase) / float (numKernelPhases);
+
+                    for (int i = -crossings; i <= crossings; ++i)
+                        *coeff++ = windowedSinc (SampleType (fracPos + (ratio * float (i))), floatZeroCrossings);
+                }
+            }
+
+            SampleType getBandlimitedSample (const choc::buffer::MonoView<SampleType>& source, double pos) const noexcept
             {
-                fracPos = 1.0f - fracPos;
-                ++intPos;
+                auto intPos  = (int64_t) pos;
+                auto fracPos = (float) (pos - (double) intPos);
+
+                if (fracPos > 0)
+                {
+                    fracPos = 1.0f - fracPos;
+                    ++intPos;
+                }
+
+                auto firstSample = intPos - crossings;
+
+                if (numKernelPhases == 0)
+                    return applyKernel (source, firstSample, 0);
+
+                auto phasePos = fracPos * float (numKernelPhases);
+                auto phase = std::min ((uint32_t) phasePos, numKernelPhases - 1);
+                auto proportion = SampleType (phasePos - float (phase));
+
+                auto s1 = applyKernel (source, firstSample, phase);
+                auto s2 = applyKernel (source, firstSample, phase + 1);
+                return s1 + proportion * (s2 - s1);
             }
 
-            int crossings = int (float (numZeroCrossings) / ratio);
+        private:
+            uint32_t numKernelPhases;
+            int crossings;
+            uint32_t numTaps;
+            std::vector<SampleType> coefficients;
 
-            for (int i = -crossings; i <= crossings; ++i)
+            SampleType applyKernel (const choc::buffer::MonoView<SampleType>& source, int64_t firstSample, uint32_t phase) const noexcept
             {
-                auto sincPosition = SampleType (fracPos + (ratio * float (i)));
-                auto samplePosition = (uint32_t) (intPos + i);
+                auto numFrames = (int64_t) source.getNumFrames();
+                auto start = std::max ((int64_t) 0, -firstSample);
+                auto end = std::min ((int64_t) numTaps, numFrames - firstSample);
 
-                if (samplePosition < numFrames)
-                    result += static_cast<SampleType> (data[samplePosition] * windowedSinc (sincPosition, floatZeroCrossings));
+                if (start >= end)
+                    return {};
+
+                return innerProduct (source.data.data + firstSample + start,
+                                     coefficients.data() + phase * numTaps + start,
+                                     (uint32_t) (end - start));
             }
 
-            return result;
-        }
+            // This is written with several independent accumulators so that the compiler can
+            // turn it into SIMD multiply-adds without needing to reorder the floating-point sums
+            static SampleType innerProduct (const SampleType* a, const SampleType* b, uint32_t num) noexcept
+            {
+                constexpr uint32_t numLanes = 8;
+                SampleType sums[numLanes] = {};
+                uint32_t i = 0;
+
+                for (; i + numLanes <= num; i += numLanes)
+                    for (uint32_t j = 0; j < numLanes; ++j)
+                        sums[j] += a[i + j] * b[i + j];
+
+                for (; i < num; ++i)
+                    sums[0] += a[i] * b[i];
+
+                return ((sums[0] + sums[1]) + (sums[2] + sums[3])) + ((sums[4] + sums[5]) + (sums[6] + sums[7]));
+            }
+        };
 
         static SampleType windowedSinc (SampleType f, SampleType numZeroCrossings) noexcept
         {
@@ -0,0 +1,330 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#if ! SOUL_INSIDE_CORE_CPP
+ #error "Don't add this cpp file to your build, it gets included indirectly by soul_core.cpp"
+#endif
+
+
+namespace soul
+{
+
+namespace SampleConversion
+{
+    // These generic versions are used for the tail of each buffer and on CPUs without a SIMD kernel.
+    // Because the channel count is a constant, the compiler can unroll the inner loops.
+    template <uint32_t numChannels>
+    static void interleave (float* dest, const float* const* source, uint32_t start, uint32_t numFrames)
+    {
+        for (uint32_t i = start; i < numFrames; ++i)
+            for (uint32_t chan = 0; chan < numChannels; ++chan)
+                dest[i * numChannels + chan] = source[chan][i];
+    }
+
+    template <uint32_t numChannels>
+    static void deinterleave (float* const* dest, const float* source, uint32_t start, uint32_t numFrames)
+    {
+        for (uint32_t i = start; i < numFrames; ++i)
+            for (uint32_t chan = 0; chan < numChannels; ++chan)
+                dest[chan][i] = source[i * numChannels + chan];
+    }
+
+   #if SOUL_INTEL
+    static uint32_t interleave2 (float* dest, const float* const* source, uint32_t numFrames)
+    {
+        uint32_t i = 0;
+
+        for (; i + 4 <= numFrames; i += 4)
+        {
+            auto left  = _mm_loadu_ps (source[0] + i);
+            auto right = _mm_loadu_ps (source[1] + i);
+            _mm_storeu_ps (dest + i * 2,     _mm_unpacklo_ps (left, right));
+            _mm_storeu_ps (dest + i * 2 + 4, _mm_unpackhi_ps (left, right));
+        }
+
+        return i;
+    }
+
+    static uint32_t deinterleave2 (float* const* dest, const float* source, uint32_t numFrames)
+    {
+        uint32_t i = 0;
+
+        for (; i + 4 <= numFrames; i += 4)
+        {
+            auto frames01 = _mm_loadu_ps (source + i * 2);
+            auto frames23 = _mm_loadu_ps (source + i * 2 + 4);
+            _mm_storeu_ps (dest[0] + i, _mm_shuffle_ps (frames01, frames23, _MM_SHUFFLE (2, 0, 2, 0)));
+            _mm_storeu_ps (dest[1] + i, _mm_shuffle_ps (frames01, frames23, _MM_SHUFFLE (3, 1, 3, 1)));
+        }
+
+        return i;
+    }
+
+    // Interleaving and deinterleaving groups of 4 channels are both a 4x4 transpose of 4 frames
+    static void transpose4x4 (float* dest, uint32_t destStride, const float* const* source, uint32_t sourceOffset)
+    {
+        auto r0 = _mm_loadu_ps (source[0] + sourceOffset);
+        auto r1 = _mm_loadu_ps (source[1] + sourceOffset);
+        auto r2 = _mm_loadu_ps (source[2] + sourceOffset);
+        auto r3 = _mm_loadu_ps (source[3] + sourceOffset);
+        _MM_TRANSPOSE4_PS (r0, r1, r2, r3);
+        _mm_storeu_ps (dest, r0);
+        _mm_storeu_ps (dest + destStride, r1);
+        _mm_storeu_ps (dest + destStride * 2, r2);
+        _mm_storeu_ps (dest + destStride * 3, r3);
+    }
+
+    template <uint32_t numChannels>
+    static uint32_t interleaveGroupsOf4 (float* dest, const float* const* source, uint32_t numFrames)
+    {
+        uint32_t i = 0;
+
+        for (; i + 4 <= numFrames; i += 4)
+            for (uint32_t chan = 0; chan < numChannels; chan += 4)
+                transpose4x4 (dest + i * numChannels + chan, numChannels, source + chan, i);
+
+        return i;
+    }
+
+    template <uint32_t numChannels>
+    static uint32_t deinterleaveGroupsOf4 (float* const* dest, const float* source, uint32_t numFrames)
+    {
+        uint32_t i = 0;
+
+        for (; i + 4 <= numFrames; i += 4)
+        {
+            for (uint32_t chan = 0; chan < numChannels; chan += 4)
+            {
+                const float* frames[] = { source + i * numChannels + chan,
+                                          source + (i + 1) * numChannels + chan,
+                                          source + (i + 2) * numChannels + chan,
+                                          source + (i + 3) * numChannels + chan };
+                float block[16];
+                transpose4x4 (block, 4, frames, 0);
+
+                for (uint32_t j = 0; j < 4; ++j)
+                    memcpy (dest[chan + j] + i, block + j * 4, 4 * sizeof (float));
+            }
+        }
+
+        return i;
+    }
+
+    static uint32_t interleave4 (float* d, const float* const* s, uint32_t n)      { return interleaveGroupsOf4<4> (d, s, n); }
+    static uint32_t interleave8 (float* d, const float* const* s, uint32_t n)      { return interleaveGroupsOf4<8> (d, s, n); }
+    static uint32_t deinterleave4 (float* const* d, const float* s, uint32_t n)    { return deinterleaveGroupsOf4<4> (d, s, n); }
+    static uint32_t deinterleave8 (float* const* d, const float* s, uint32_t n)    { return deinterleaveGroupsOf4<8> (d, s, n); }
+
+   #elif SOUL_ARM64
+    static uint32_t interleave2 (float* dest, const float* const* source, uint32_t numFrames)
+    {
+        uint32_t i = 0;
+
+        for (; i + 4 <= numFrames; i += 4)
+            vst2q_f32 (dest + i * 2, (float32x4x2_t { { vld1q_f32 (source[0] + i), vld1q_f32 (source[1] + i) } }));
+
+        return i;
+    }
+
+    static uint32_t deinterleave2 (float* const* dest, const float* source, uint32_t numFrames)
+    {
+        uint32_t i = 0;
+
+        for (; i + 4 <= numFrames; i += 4)
+        {
+            auto channels = vld2q_f32 (source + i * 2);
+            vst1q_f32 (dest[0] + i, channels.val[0]);
+            vst1q_f32 (dest[1] + i, channels.val[1]);
+        }
+
+        return i;
+    }
+
+    static uint32_t interleave4 (float* dest, const float* const* source, uint32_t numFrames)
+    {
+        uint32_t i = 0;
+
+        for (; i + 4 <= numFrames; i += 4)
+            vst4q_f32 (dest + i * 4, (float32x4x4_t { { vld1q_f32 (source[0] + i), vld1q_f32 (source[1] + i),
+                                                        vld1q_f32 (source[2] + i), vld1q_f32 (source[3] + i) } }));
+
+        return i;
+    }
+
+    static uint32_t deinterleave4 (float* const* dest, const float* source, uint32_t numFrames)
+    {
+        uint32_t i = 0;
+
+        for (; i + 4 <= numFrames; i += 4)
+        {
+            auto channels = vld4q_f32 (source + i * 4);
+
+            for (int chan = 0; chan < 4; ++chan)
+                vst1q_f32 (dest[chan] + i, channels.val[chan]);
+        }
+
+        return i;
+    }
+
+    // NEON has no 8-way structure loads, so 8 channels are left to the generic loops
+    static uint32_t interleave8 (float*, const float* const*, uint32_t)      { return 0; }
+    static uint32_t deinterleave8 (float* const*, const float*, uint32_t)    { return 0; }
+
+   #else
+    static uint32_t interleave2 (float*, const float* const*, uint32_t)      { return 0; }
+    static uint32_t interleave4 (float*, const float* const*, uint32_t)      { return 0; }
+    static uint32_t interleave8 (float*, const float* const*, uint32_t)      { return 0; }
+    static uint32_t deinterleave2 (float* const*, const float*, uint32_t)    { return 0; }
+    static uint32_t deinterleave4 (float* const*, const float*, uint32_t)    { return 0; }
+    static uint32_t deinterleave8 (float* const*, const float*, uint32_t)    { return 0; }
+   #endif
+}
+
+void interleaveChannels (choc::buffer::InterleavedView<float> dest, choc::buffer::ChannelArrayView<const float> source)
+{
+    SOUL_ASSERT (dest.getSize() == source.getSize());
+    auto numChannels = source.getNumChannels();
+    auto numFrames = source.getNumFrames();
+
+    if (dest.data.stride == numChannels && source.data.offset == 0)
+    {
+        auto d = dest.data.data;
+        auto s = source.data.channels;
+
+        switch (numChannels)
+        {
+            case 2:  return SampleConversion::interleave<2> (d, s, SampleConversion::interleave2 (d, s, numFrames), numFrames);
+            case 4:  return SampleConversion::interleave<4> (d, s, SampleConversion::interleave4 (d, s, numFrames), numFrames);
+            case 8:  return SampleConversion::interleave<8> (d, s, SampleConversion::interleave8 (d, s, numFrames), numFrames);
+            default: break;
+        }
+    }
+
+    copy (dest, source);
+}
+
+void deinterleaveChannels (choc::buffer::ChannelArrayView<float> dest, choc::buffer::InterleavedView<const float> source)
+{
+    SOUL_ASSERT (dest.getSize() == source.getSize());
+    auto numChannels = source.getNumChannels();
+    auto numFrames = source.getNumFrames();
+
+    if (source.data.stride == numChannels && dest.data.offset == 0)
+    {
+        auto d = dest.data.channels;
+        auto s = source.data.data;
+
+        switch (numChannels)
+        {
+            case 2:  return SampleConversion::deinterleave<2> (d, s, SampleConversion::deinterleave2 (d, s, numFrames), numFrames);
+            case 4:  return SampleConversion::deinterleave<4> (d, s, SampleConversion::deinterleave4 (d, s, numFrames), numFrames);
+            case 8:  return SampleConversion::deinterleave<8> (d, s, SampleConversion::deinterleave8 (d, s, numFrames), numFrames);
+            default: break;
+        }
+    }
+
+    copy (dest, source);
+}
+
+//==============================================================================
+static constexpr float int16Scale = 32768.0f;
+static constexpr float int24Scale = 8388608.0f;
+
+void convertInt16ToFloat (float* dest, const int16_t* source, size_t numSamples)
+{
+    size_t i = 0;
+
+   #if SOUL_INTEL
+    auto scale = _mm_set1_ps (1.0f / int16Scale);
+
+    for (; i + 8 <= numSamples; i += 8)
+    {
+        auto samples = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (source + i));
+        auto low  = _mm_srai_epi32 (_mm_unpacklo_epi16 (samples, samples), 16);
+        auto high = _mm_srai_epi32 (_mm_unpackhi_epi16 (samples, samples), 16);
+        _mm_storeu_ps (dest + i,     _mm_mul_ps (_mm_cvtepi32_ps (low), scale));
+        _mm_storeu_ps (dest + i + 4, _mm_mul_ps (_mm_cvtepi32_ps (high), scale));
+    }
+   #elif SOUL_ARM64
+    for (; i + 8 <= numSamples; i += 8)
+    {
+        auto samples = vld1q_s16 (source + i);
+        vst1q_f32 (dest + i,     vmulq_n_f32 (vcvtq_f32_s32 (vmovl_s16 (vget_low_s16 (samples))), 1.0f / int16Scale));
+        vst1q_f32 (dest + i + 4, vmulq_n_f32 (vcvtq_f32_s32 (vmovl_s16 (vget_high_s16 (samples))), 1.0f / int16Scale));
+    }
+   #endif
+
+    for (; i < numSamples; ++i)
+        dest[i] = static_cast<float> (source[i]) * (1.0f / int16Scale);
+}
+
+void convertFloatToInt16 (int16_t* dest, const float* source, size_t numSamples)
+{
+    size_t i = 0;
+
+   #if SOUL_INTEL
+    auto scale = _mm_set1_ps (int16Scale);
+
+    for (; i + 8 <= numSamples; i += 8)
+    {
+        // _mm_cvtps_epi32 rounds to nearest, and _mm_packs_epi32 saturates to the int16 range
+        auto low  = _mm_cvtps_epi32 (_mm_mul_ps (_mm_loadu_ps (source + i), scale));
+        auto high = _mm_cvtps_epi32 (_mm_mul_ps (_mm_loadu_ps (source + i + 4), scale));
+        _mm_storeu_si128 (reinterpret_cast<__m128i*> (dest + i), _mm_packs_epi32 (low, high));
+    }
+   #elif SOUL_ARM64
+    for (; i + 8 <= numSamples; i += 8)
+    {
+        auto low  = vqmovn_s32 (vcvtnq_s32_f32 (vmulq_n_f32 (vld1q_f32 (source + i), int16Scale)));
+        auto high = vqmovn_s32 (vcvtnq_s32_f32 (vmulq_n_f32 (vld1q_f32 (source + i + 4), int16Scale)));
+        vst1q_s16 (dest + i, vcombine_s16 (low, high));
+    }
+   #endif
+
+    for (; i < numSamples; ++i)
+        dest[i] = static_cast<int16_t> (std::lrint (std::clamp (source[i] * int16Scale, -int16Scale, int16Scale - 1.0f)));
+}
+
+void convertInt24ToFloat (float* dest, const uint8_t* source, size_t numSamples)
+{
+    // The packed 3-byte layout doesn't suit SIMD loads, but this simple loop vectorises well enough
+    for (size_t i = 0; i < numSamples; ++i)
+    {
+        auto s = source + i * 3;
+        auto value = static_cast<int32_t> (static_cast<uint32_t> (s[0]) << 8
+                                            | static_cast<uint32_t> (s[1]) << 16
+                                            | static_cast<uint32_t> (s[2]) << 24) >> 8;
+        dest[i] = static_cast<float> (value) * (1.0f / int24Scale);
+    }
+}
+
+void convertFloatToInt24 (uint8_t* dest, const float* source, size_t numSamples)
+{
+    for (size_t i = 0; i < numSamples; ++i)
+    {
+        auto value = static_cast<int32_t> (std::lrint (std::clamp (source[i] * int24Scale, -int24Scale, int24Scale - 1.0f)));
+        auto d = dest + i * 3;
+        d[0] = static_cast<uint8_t> (value);
+        d[1] = static_cast<uint8_t> (value >> 8);
+        d[2] = static_cast<uint8_t> (value >> 16);
+    }
+}
+
+} // namespace soul
@@ -0,0 +1,50 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul
+{
+
+/** Copies a set of separate channels into an interleaved buffer of the same size.
+    Buffers with 2, 4 or 8 packed channels are handled by SIMD kernels where the CPU has them,
+    and any other layout falls back to choc::buffer::copy().
+*/
+void interleaveChannels (choc::buffer::InterleavedView<float> dest, choc::buffer::ChannelArrayView<const float> source);
+
+/** Copies an interleaved buffer into a set of separate channels of the same size.
+    Buffers with 2, 4 or 8 packed channels are handled by SIMD kernels where the CPU has them,
+    and any other layout falls back to choc::buffer::copy().
+*/
+void deinterleaveChannels (choc::buffer::ChannelArrayView<float> dest, choc::buffer::InterleavedView<const float> source);
+
+/** Converts 16-bit integer samples to floats in the range -1 to 1. */
+void convertInt16ToFloat (float* dest, const int16_t* source, size_t numSamples);
+
+/** Converts float samples to 16-bit integers, clipping anything outside the range -1 to 1. */
+void convertFloatToInt16 (int16_t* dest, const float* source, size_t numSamples);
+
+/** Converts packed little-endian 24-bit integer samples (3 bytes each) to floats in the range -1 to 1. */
+void convertInt24ToFloat (float* dest, const uint8_t* source, size_t numSamples);
+
+/** Converts float samples to packed little-endian 24-bit integers (3 bytes each), clipping
+    anything outside the range -1 to 1.
+*/
+void convertFloatToInt24 (uint8_t* dest, const float* source, size_t numSamples);
+
+} // namespace soul
@@ -66,6 +66,92 @@ namespace Token
     SOUL_DECLARE_TOKEN (identifier,     "$identifier")
 }
 
+//==============================================================================
+/** A perfect hash table of keyword tokens, which is built at compile-time so that
+    checking whether an identifier is a keyword takes a single lookup and comparison,
+    rather than a comparison with every keyword in turn.
+
+    The constructor searches for a seed for which none of the keywords collide, so
+    numSlots needs to be comfortably larger than the number of keywords.
+*/
+template <size_t numSlots>
+struct KeywordHashTable
+{
+    template <size_t numKeywords>
+    constexpr KeywordHashTable (const TokenType (&keywords)[numKeywords])
+    {
+        static_assert (numSlots >= numKeywords * 2, "the table needs more slots");
+
+        while (! build (keywords, numKeywords))
+            ++seed;
+    }
+
+    TokenType match (int length, const char* text) const noexcept
+    {
+        auto& slot = slots[getSlot (seed, text, static_cast<size_t> (length))];
+
+        if (slot.length == length && std::memcmp (slot.token.text, text, static_cast<size_t> (length)) == 0)
+            return slot.token;
+
+        return {};
+    }
+
+private:
+    struct Slot
+    {
+        TokenType token;
+        int length = 0;
+    };
+
+    Slot slots[numSlots] = {};
+    uint32_t seed = 1;
+
+    static constexpr size_t getSlot (uint32_t seed, const char* text, size_t length) noexcept
+    {
+        auto h = static_cast<uint32_t> (length)
+                  | (static_cast<uint32_t> (static_cast<uint8_t> (text[0])) << 8)
+                  | (static_cast<uint32_t> (static_cast<uint8_t> (text[length > 1 ? 1 : 0])) << 16)
+                  | (static_cast<uint32_t> (static_cast<uint8_t> (text[length - 1])) << 24);
+
+        h ^= seed;
+        h *= 0x9e3779b1u;
+        h ^= h >> 15;
+        h *= (seed << 1) | 1u;
+        h ^= h >> 13;
+        return h % numSlots;
+    }
+
+    static constexpr size_t getLength (const char* text) noexcept
+    {
+        size_t length = 0;
+
+        while (text[length] != 0)
+            ++length;
+
+        return length;
+    }
+
+    constexpr bool build (const TokenType* keywords, size_t numKeywords)
+    {
+        for (auto& s : slots)
+            s = {};
+
+        for (size_t i = 0; i < numKeywords; ++i)
+        {
+            auto length = getLength (keywords[i].text);
+            auto& slot = slots[getSlot (seed, keywords[i].text, length)];
+
+            if (slot.length != 0)
+                return false;
+
+            slot.token = keywords[i];
+            slot.length = static_cast<int> (length);
+        }
+
+        return true;
+    }
+};
+
 //==============================================================================
 /** Low-level tokeniser which allows raw source code to be iterated as tokens.
     This handles recognising keywords, operators, and also literals.
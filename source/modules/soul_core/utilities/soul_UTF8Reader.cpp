@@ -190,9 +190,12 @@ bool UTF8Reader::advanceIfStartsWith (const char* text)
 
 UTF8Reader UTF8Reader::find (const char* searchString) const
 {
-    for (auto t = *this;; ++t)
-        if (t.startsWith (searchString) || t.isEmpty())
-            return t;
+    // UTF-8 is self-synchronising, so a byte-wise search can only match at the start of a
+    // character, and the C library's search is far quicker than decoding each character
+    if (auto found = std::strstr (data, searchString))
+        return UTF8Reader (found);
+
+    return UTF8Reader (data + std::strlen (data));
 }
 
 bool UTF8Reader::isWhitespace() const noexcept          { return soul::isWhitespace (*data); }
@@ -200,12 +203,12 @@ bool UTF8Reader::isDigit() const noexcept               { return soul::isDigit (
 
 UTF8Reader UTF8Reader::findEndOfWhitespace() const
 {
-    auto t = *this;
+    auto t = data;
 
-    while (t.isWhitespace())
+    while (soul::isWhitespace (*t))
         ++t;
 
-    return t;
+    return UTF8Reader (t);
 }
 
 const char* UTF8Reader::findInvalidData() const
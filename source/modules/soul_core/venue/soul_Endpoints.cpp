@@ -39,6 +39,11 @@ bool isMIDIMessageStruct (const choc::value::Type& type)
 }
 
 bool isMIDIEventEndpoint (const EndpointDetails& details)
+{
+    return details.metadata.isMIDIEvent;
+}
+
+static bool hasMIDIEventType (const EndpointDetails& details)
 {
     return isEvent (details)
             && details.dataTypes.size() == 1
@@ -55,16 +60,70 @@ Type createMIDIEventEndpointType()
 
 bool isParameterInput (const EndpointDetails& details)
 {
-    if (isEvent (details) && ! isMIDIEventEndpoint (details))
-        return true;
+    return details.metadata.isParameter;
+}
+
+EndpointMetadata createEndpointMetadata (const EndpointDetails& details)
+{
+    static constexpr Annotation::Key nameKey ("name"), textKey ("text"), unitKey ("unit"), groupKey ("group"),
+                                     minKey ("min"), maxKey ("max"), stepKey ("step"), initKey ("init"),
+                                     rampFramesKey ("rampFrames"), automatableKey ("automatable"),
+                                     booleanKey ("boolean"), hiddenKey ("hidden");
+
+    auto& annotation = details.annotation;
+
+    EndpointMetadata m;
+    m.isMIDIEvent = hasMIDIEventType (details);
+    m.isParameter = isEvent (details) ? ! m.isMIDIEvent : annotation.hasValue (nameKey);
+
+    if (! m.isParameter)
+        return m;
+
+    auto getString = [&] (Annotation::Key key) -> std::string
+    {
+        auto v = annotation.findValue (key);
+        return v != nullptr && v->getType().isStringLiteral() ? annotation.getString (key) : std::string();
+    };
+
+    auto getFloat = [&] (Annotation::Key key, float defaultValue)
+    {
+        return static_cast<float> (annotation.getDouble (key, defaultValue));
+    };
+
+    m.parameterName = getString (nameKey);
+
+    if (m.parameterName.empty())
+        m.parameterName = details.name;
+
+    float defaultNumIntervals = 1000.0f;
+    m.textValues = getString (textKey);
+
+    if (! m.textValues.empty())
+    {
+        auto items = choc::text::splitString (choc::text::removeDoubleQuotes (m.textValues), '|', false);
+
+        if (items.size() > 1)
+        {
+            defaultNumIntervals = static_cast<float> (items.size() - 1);
+            m.maxValue = defaultNumIntervals;
+        }
+    }
 
-    if (isStream (details) && details.annotation.hasValue ("name"))
-        return true;
+    m.unit          = getString (unitKey);
+    m.group         = getString (groupKey);
+    m.minValue      = getFloat (minKey, m.minValue);
+    m.maxValue      = getFloat (maxKey, m.maxValue);
+    m.step          = getFloat (stepKey, m.maxValue / defaultNumIntervals);
+    m.initialValue  = getFloat (initKey, m.minValue);
+    m.isAutomatable = annotation.getBool (automatableKey, true);
+    m.isBoolean     = annotation.getBool (booleanKey, false);
+    m.isHidden      = annotation.getBool (hiddenKey, false);
 
-    if (isValue (details) && details.annotation.hasValue ("name"))
-        return true;
+    if (auto ramp = annotation.findValue (rampFramesKey))
+        if (ramp->getType().isPrimitive() && (ramp->getType().isFloatingPoint() || ramp->getType().isInteger()))
+            m.rampFrames = ramp->getAsInt64();
 
-    return false;
+    return m;
 }
 
 } // namespace soul
@@ -63,10 +63,58 @@ EndpointID findFirstOutputOfType (VenueOrPerformer& p, EndpointType t)
     return {};
 }
 
+//==============================================================================
+/** A hashed index of a program's input and output endpoints, so that looking one up by its
+    ID doesn't need a search through the lists. It's built when a program is loaded, and
+    keeps the position of each endpoint in its input or output list.
+*/
+struct EndpointIndex
+{
+    void build (ArrayView<const EndpointDetails> inputs, ArrayView<const EndpointDetails> outputs)
+    {
+        clear();
+        inputPositions.reserve (inputs.size());
+        outputPositions.reserve (outputs.size());
+
+        for (uint32_t i = 0; i < inputs.size(); ++i)
+            inputPositions[inputs[i].endpointID.toString()] = i;
+
+        for (uint32_t i = 0; i < outputs.size(); ++i)
+            outputPositions[outputs[i].endpointID.toString()] = i;
+    }
+
+    void clear()
+    {
+        inputPositions.clear();
+        outputPositions.clear();
+    }
+
+    /** Returns the endpoint's position in the list of inputs, if it's an input. */
+    std::optional<uint32_t> findInput (const EndpointID& endpointID) const     { return find (inputPositions, endpointID); }
+
+    /** Returns the endpoint's position in the list of outputs, if it's an output. */
+    std::optional<uint32_t> findOutput (const EndpointID& endpointID) const    { return find (outputPositions, endpointID); }
+
+private:
+    std::unordered_map<std::string, uint32_t> inputPositions, outputPositions;
+
+    static std::optional<uint32_t> find (const std::unordered_map<std::string, uint32_t>& positions, const EndpointID& endpointID)
+    {
+        auto found = positions.find (endpointID.toString());
+
+        if (found == positions.end())
+            return {};
+
+        return found->second;
+    }
+};
+
+//==============================================================================
 bool isMIDIMessageStruct (const choc::value::Type&);
 bool isMIDIEventEndpoint (const EndpointDetails&);
 Type createMIDIEventEndpointType();
 bool isParameterInput (const EndpointDetails&);
+EndpointMetadata createEndpointMetadata (const EndpointDetails&);
 bool isConsoleEndpoint (const std::string& endpointName);
 
 } // namespace soul
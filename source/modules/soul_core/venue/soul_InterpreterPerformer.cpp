@@ -0,0 +1,3779 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#if ! SOUL_INSIDE_CORE_CPP
+ #error "Don't add this cpp file to your build, it gets included indirectly by soul_core.cpp"
+#endif
+
+namespace soul
+{
+
+/**
+    An interpreter for HEART programs, for platforms where code can't be generated at runtime.
+
+    When it links, every function that the program can reach is translated into a flat list
+    of instructions. Each instruction holds a pointer to the handler which executes it and the
+    memory locations of its operands, which are offsets into the current stack frame, the
+    processor instance's state, the program's global state or a pool of constants. So there's
+    no decoding to do at runtime: each handler does its work and returns the next instruction,
+    and the dispatch loop just calls it. Arithmetic handlers are instantiated for each element
+    type, and loop over the elements of vectors and arrays, and the maths intrinsics call the
+    standard library directly rather than interpreting their bodies.
+
+    The whole program is flattened into a list of processor instances, ordered using the
+    MultiRateSchedule, which are rendered one frame at a time. The connections between them
+    become a list of copies (or sums, for streams) between their endpoint slots, and events are
+    dispatched straight to the handler functions of the instances which receive them. Instances
+    which only have event endpoints and nothing to do in run() are left out of the per-frame
+    loop altogether.
+*/
+namespace interpreter
+{
+
+//==============================================================================
+/** The element types that arithmetic instructions are specialised for. */
+enum class ElementType : uint8_t
+{
+    bool_,
+    int32,
+    int64,
+    float32,
+    float64,
+    other
+};
+
+/** Describes a type whose packed data is a run of elements of a single primitive type, which
+    covers primitives, vectors, bounded ints and fixed-size arrays of them. Other types have an
+    element type of "other", and can only be copied or compared as raw bytes.
+*/
+struct ElementLayout
+{
+    ElementType type = ElementType::other;
+    uint32_t numElements = 0;
+
+    bool isHomogeneous() const      { return type != ElementType::other; }
+
+    bool operator== (const ElementLayout& other) const    { return type == other.type && numElements == other.numElements; }
+    bool operator!= (const ElementLayout& other) const    { return ! operator== (other); }
+
+    static ElementType getElementType (PrimitiveType p)
+    {
+        if (p.isBool())       return ElementType::bool_;
+        if (p.isInteger32())  return ElementType::int32;
+        if (p.isInteger64())  return ElementType::int64;
+        if (p.isFloat32())    return ElementType::float32;
+        if (p.isFloat64())    return ElementType::float64;
+
+        return ElementType::other;
+    }
+
+    static ElementLayout forType (const Type& t)
+    {
+        if (t.isBoundedInt())
+            return { ElementType::int32, 1 };
+
+        if (t.isPrimitive())
+            return { getElementType (t.getPrimitiveType()), 1 };
+
+        if (t.isVector())
+            return { getElementType (t.getVectorElementType()), static_cast<uint32_t> (t.getVectorSize()) };
+
+        if (t.isFixedSizeArray())
+        {
+            auto element = forType (t.getArrayElementType());
+
+            if (element.isHomogeneous())
+                return { element.type, element.numElements * static_cast<uint32_t> (t.getArraySize()) };
+        }
+
+        return {};
+    }
+};
+
+//==============================================================================
+struct Instruction;
+struct Context;
+struct Engine;
+struct Instance;
+
+/** Executes an instruction, and returns the next one to run, or nullptr to leave the function. */
+using Handler = const Instruction* (*) (const Instruction&, Context&);
+
+/** The location of an instruction's operand. Most operands are at an offset from the start of
+    one of the memory areas that a function can see, but an indirect one reads a pointer from a
+    slot in the stack frame and adds the offset to that, which is how references and elements
+    with a dynamic index are reached.
+*/
+struct Operand
+{
+    enum class Base  : uint8_t
+    {
+        frame,
+        state,
+        global,
+        constants,
+        indirect
+    };
+
+    Base base = Base::frame;
+    uint32_t offset = 0, pointerSlot = 0;
+
+    Operand withOffset (size_t extra) const    { auto o = *this; o.offset += static_cast<uint32_t> (extra); return o; }
+
+    bool operator== (const Operand& other) const
+    {
+        return base == other.base && offset == other.offset
+                && (base != Base::indirect || pointerSlot == other.pointerSlot);
+    }
+
+    static Operand frame (uint32_t offset)                  { return { Base::frame, offset, 0 }; }
+    static Operand indirect (uint32_t pointerSlot)          { return { Base::indirect, 0, pointerSlot }; }
+};
+
+struct Instruction
+{
+    Handler handler = nullptr;
+    Operand dest, a, b, c;
+    uint32_t count = 1, size = 0;
+    const void* data = nullptr;
+    const Instruction* targets[2] = {};
+};
+
+/** The state of a function while it's running. */
+struct Context
+{
+    uint8_t* bases[4];    // indexed by Operand::Base
+    Engine* engine;
+    Instance* instance;
+    uint8_t* stackTop;
+    uint8_t* returnValue;
+    const Instruction* resumePoint;
+
+    uint8_t* get (const Operand& o) const
+    {
+        if (o.base == Operand::Base::indirect)
+            return readUnaligned<uint8_t*> (bases[0] + o.pointerSlot) + o.offset;
+
+        return bases[static_cast<int> (o.base)] + o.offset;
+    }
+};
+
+static void execute (const Instruction* ip, Context& context)
+{
+    while (ip != nullptr)
+        ip = ip->handler (*ip, context);
+}
+
+/** An unsized array value is a pointer to one of these, or nullptr if it's empty. */
+struct UnsizedArray
+{
+    const uint8_t* data;
+    uint32_t numElements;
+};
+
+static constexpr uint32_t align8  (size_t n)     { return static_cast<uint32_t> ((n + 7) & ~static_cast<size_t> (7)); }
+static constexpr uint32_t align16 (size_t n)     { return static_cast<uint32_t> ((n + 15) & ~static_cast<size_t> (15)); }
+
+//==============================================================================
+struct CompiledFunction
+{
+    heart::Function* function = nullptr;
+    std::vector<Instruction> code;
+    std::vector<uint32_t> parameterOffsets, parameterSizes;
+    uint32_t frameSize = 0;
+
+    /** The space needed by the function's frame and the deepest chain of calls that it makes. */
+    uint32_t stackSize = 0;
+};
+
+struct CallInfo
+{
+    struct Argument
+    {
+        Operand source;
+        uint32_t destOffset, size;
+        bool isReference;
+    };
+
+    const CompiledFunction* function = nullptr;
+    std::vector<Argument> arguments;
+};
+
+/** Somewhere that the events from a processor output or top-level input are sent to. */
+struct EventSink
+{
+    Instance* instance = nullptr;   // nullptr if this is one of the program's outputs
+    uint32_t endpoint = 0, element = 0, delay = 0;
+
+    // These are indexed by the type of the event, as an index into the source's data types
+    std::vector<const CompiledFunction*> handlers;
+    std::vector<int32_t> outputTypes;
+    std::vector<uint32_t> dataSizes;
+};
+
+/** Copies the frames or values arriving at an endpoint slot from the slots that feed it. */
+struct Route
+{
+    struct Source
+    {
+        uint32_t offset;
+        int32_t delayLine = -1;
+    };
+
+    uint32_t destOffset = 0, size = 0, numElements = 0;
+    ElementType elementType = ElementType::other;
+    bool isStream = false;
+    std::vector<Source> sources;
+};
+
+/** A stream connection's delay buffer. Its capacity is rounded up to a power of 2 so that
+    the write position can just keep counting up and be masked, and the delayed frame is the
+    one that was written length frames before it.
+*/
+struct DelayLine
+{
+    uint32_t sourceOffset, bufferOffset, positionOffset, length, mask, frameSize;
+};
+
+/** The layout of a processor's state, which also holds its endpoint slots and the stack frame
+    of its run() function, so that it can be suspended when it calls advance().
+*/
+struct ModuleLayout
+{
+    const Module* module = nullptr;
+    uint32_t size = 0;
+    std::vector<uint32_t> inputOffsets, outputOffsets;
+    uint32_t propertyOffsets[5] = {};    // indexed by heart::ProcessorProperty::Property
+    uint32_t runFrameOffset = 0, resumeOffset = 0;
+    const CompiledFunction* runFunction = nullptr;
+    const CompiledFunction* initFunction = nullptr;
+    std::vector<std::pair<uint32_t, uint32_t>> streamOutputs;   // offset, size
+    std::vector<uint32_t> voiceIdleFlags;
+
+    static constexpr uint32_t finished = 0xffffffffu;
+};
+
+struct Instance
+{
+    const ModuleLayout* layout = nullptr;
+    std::string name;
+    uint32_t memoryOffset = 0;
+    int rateShift = 0;
+    uint32_t runsPerFrame = 1;
+    uint64_t frameMask = 0;
+    int32_t id = 0;
+    uint8_t* state = nullptr;
+    bool isIdle = false;
+
+    std::vector<Route> inputRoutes;
+    std::vector<uint32_t> voiceIdleFlags;   // the memory offsets of all the idle flags in this instance's voice
+    std::vector<std::vector<std::vector<EventSink>>> eventSinks;   // [output][element]
+};
+
+/** One of the program's top-level inputs. */
+struct TopInput
+{
+    const heart::InputDeclaration* declaration = nullptr;
+    uint32_t slotOffset = 0, frameSize = 0;
+    ElementLayout layout;
+    std::vector<EventSink> sinks;
+    std::vector<Type> types;
+    std::vector<bool> hasExternalLayout;
+
+    std::vector<uint8_t> frames, value, sparseTarget;
+    std::vector<double> rampIncrements;
+    uint32_t numRampFrames = 0;
+    bool hasFrames = false, isSparse = false, isActive = false;
+};
+
+/** One of the program's top-level outputs. */
+struct TopOutput
+{
+    struct Event
+    {
+        uint32_t frame, typeIndex, dataOffset;
+    };
+
+    const heart::OutputDeclaration* declaration = nullptr;
+    uint32_t slotOffset = 0, frameSize = 0;
+    std::vector<uint8_t> frames;
+    std::vector<Event> events;
+    std::vector<uint8_t> eventData, scratch;
+    std::vector<Type> types;
+    std::vector<uint32_t> typeSizes;
+    std::vector<bool> hasExternalLayout;
+    std::vector<choc::value::ValueView> eventViews;
+    choc::value::ValueView valueView;
+    bool isActive = false;
+};
+
+//==============================================================================
+static double readElement (ElementType type, const uint8_t* p)
+{
+    switch (type)
+    {
+        case ElementType::bool_:    return *p != 0 ? 1.0 : 0.0;
+        case ElementType::int32:    return static_cast<double> (readUnaligned<int32_t> (p));
+        case ElementType::int64:    return static_cast<double> (readUnaligned<int64_t> (p));
+        case ElementType::float32:  return static_cast<double> (readUnaligned<float> (p));
+        case ElementType::float64:  return readUnaligned<double> (p);
+        case ElementType::other:
+        default:                    return 0;
+    }
+}
+
+static void writeElement (ElementType type, uint8_t* p, double value)
+{
+    switch (type)
+    {
+        case ElementType::bool_:    *p = value != 0 ? 1 : 0; break;
+        case ElementType::int32:    writeUnaligned (p, static_cast<int32_t> (value)); break;
+        case ElementType::int64:    writeUnaligned (p, static_cast<int64_t> (value)); break;
+        case ElementType::float32:  writeUnaligned (p, static_cast<float> (value)); break;
+        case ElementType::float64:  writeUnaligned (p, value); break;
+        case ElementType::other:
+        default:                    break;
+    }
+}
+
+template <typename Type>
+static Type addValues (Type a, Type b)
+{
+    if constexpr (std::is_same<Type, bool>::value)
+        return a || b;
+    else if constexpr (std::is_integral<Type>::value)
+        return static_cast<Type> (static_cast<typename std::make_unsigned<Type>::type> (a)
+                                   + static_cast<typename std::make_unsigned<Type>::type> (b));
+    else
+        return a + b;
+}
+
+template <typename Type>
+static void addElements (uint8_t* dest, const uint8_t* source, uint32_t numElements)
+{
+    for (uint32_t i = 0; i < numElements; ++i)
+    {
+        auto offset = i * sizeof (Type);
+        writeUnaligned (dest + offset, addValues (readUnaligned<Type> (dest + offset), readUnaligned<Type> (source + offset)));
+    }
+}
+
+static void addElements (ElementType type, uint8_t* dest, const uint8_t* source, uint32_t numElements)
+{
+    switch (type)
+    {
+        case ElementType::bool_:    addElements<bool>    (dest, source, numElements); break;
+        case ElementType::int32:    addElements<int32_t> (dest, source, numElements); break;
+        case ElementType::int64:    addElements<int64_t> (dest, source, numElements); break;
+        case ElementType::float32:  addElements<float>   (dest, source, numElements); break;
+        case ElementType::float64:  addElements<double>  (dest, source, numElements); break;
+        case ElementType::other:
+        default:                    break;
+    }
+}
+
+/** Returns true if a type's packed data has the same layout as a choc value of that type,
+    i.e. it doesn't contain any strings or unsized arrays.
+*/
+static bool hasExternalLayout (const Type& t)
+{
+    if (t.isStringLiteral() || t.isUnsizedArray())
+        return false;
+
+    if (t.isFixedSizeArray())
+        return hasExternalLayout (t.getArrayElementType());
+
+    if (t.isStruct())
+    {
+        for (auto& m : t.getStructRef().getMembers())
+            if (! hasExternalLayout (m.type))
+                return false;
+    }
+
+    return true;
+}
+
+//==============================================================================
+// The state can run to many megabytes for programs with long delay lines, so it's given
+// its own mapping, which lets its pages land on the NUMA node of the thread that links it
+using StateBuffer = std::vector<uint8_t, LargeBlockAllocator<uint8_t>>;
+
+/** The parts of a linked program which don't change once it has been linked, so that
+    engines which run the same program can share them.
+*/
+struct LinkedCode
+{
+    Program program;
+    std::vector<uint8_t> constants;
+    std::vector<std::unique_ptr<ModuleLayout>> layouts;
+    std::unordered_map<const heart::Function*, std::unique_ptr<CompiledFunction>> functions;
+    std::deque<CallInfo> calls;
+    std::deque<UnsizedArray> unsizedArrays;
+    std::vector<std::unique_ptr<uint8_t[]>> arrayData;
+    SharedConstantData::References sharedData;
+    size_t constantArrayDataSize = 0, externalArrayDataSize = 0;   // the number of bytes in arrayData
+    StateBuffer initialMemory;
+    std::vector<StateVariableDetails> stateVariables;
+
+    /** Converting values which contain strings adds them to the program's dictionary, so the
+        engines which share the program have to take turns at it.
+    */
+    std::mutex programLock;
+};
+
+/** Holds everything that a linked program needs while it's running. */
+struct Engine
+{
+    std::shared_ptr<LinkedCode> code = std::make_shared<LinkedCode>();
+    StateBuffer memory;
+    std::vector<uint8_t> stack, emptyElement;
+    uint8_t* stackEnd = nullptr;
+    uint32_t globalOffset = 0;
+    static constexpr uint32_t frameCounterOffset = 0;
+
+    std::vector<std::unique_ptr<Instance>> instances;
+    std::vector<Instance*> scheduledInstances;  // the instances that need to run on every frame
+    std::vector<Route> outputRoutes;
+    std::vector<DelayLine> delayLines;
+    std::vector<TopInput> inputs;
+    std::vector<TopOutput> outputs;
+
+    struct PendingEvent
+    {
+        uint64_t dueFrame;
+        const EventSink* sink;
+        uint32_t typeIndex, dataOffset;
+    };
+
+    struct QueuedEvent
+    {
+        uint32_t input, typeIndex, dataOffset;
+    };
+
+    std::vector<PendingEvent> pendingEvents;
+    std::vector<QueuedEvent> inputEvents;
+    std::vector<uint8_t> pendingEventData, inputEventData;
+
+    uint32_t currentFrame = 0, numXRuns = 0;
+    bool stackOverflowed = false;
+
+    static constexpr size_t eventQueueSize = 1024;
+    static constexpr size_t eventDataSize = 65536;
+
+    uint8_t* getGlobals()      { return memory.data() + globalOffset; }
+
+    /** If the code is shared with other engines, its size is counted as shared data. */
+    Performer::MemoryUsage getMemoryUsage (bool isCodeShared) const
+    {
+        Performer::MemoryUsage m, c;
+
+        for (auto& f : code->functions)
+            c.codeSize += sizeof (CompiledFunction) + getVectorMemoryUsage (f.second->code)
+                            + getVectorMemoryUsage (f.second->parameterOffsets) + getVectorMemoryUsage (f.second->parameterSizes);
+
+        for (auto& call : code->calls)
+            c.codeSize += sizeof (CallInfo) + getVectorMemoryUsage (call.arguments);
+
+        c.codeSize += code->layouts.size() * sizeof (ModuleLayout);
+
+        // The initial copy of the state is kept for reset(), so it's counted as part of the state
+        c.stateSize = getVectorMemoryUsage (code->initialMemory);
+        c.constantDataSize = getVectorMemoryUsage (code->constants) + code->constantArrayDataSize;
+        c.externalDataSize = code->externalArrayDataSize;
+
+        for (auto& i : instances)
+            m.codeSize += sizeof (Instance) + getVectorMemoryUsage (i->inputRoutes) + getVectorMemoryUsage (i->eventSinks);
+
+        m.codeSize += getVectorMemoryUsage (outputRoutes) + getVectorMemoryUsage (delayLines);
+        m.stateSize = getVectorMemoryUsage (memory) + getVectorMemoryUsage (stack);
+
+        for (auto& i : inputs)
+            m.streamBufferSize += getVectorMemoryUsage (i.frames) + getVectorMemoryUsage (i.value)
+                                    + getVectorMemoryUsage (i.sparseTarget) + getVectorMemoryUsage (i.rampIncrements);
+
+        for (auto& o : outputs)
+            m.streamBufferSize += getVectorMemoryUsage (o.frames) + getVectorMemoryUsage (o.events)
+                                    + getVectorMemoryUsage (o.eventData) + getVectorMemoryUsage (o.scratch);
+
+        m.streamBufferSize += getVectorMemoryUsage (pendingEvents) + getVectorMemoryUsage (pendingEventData)
+                                + getVectorMemoryUsage (inputEvents) + getVectorMemoryUsage (inputEventData);
+
+        for (auto& block : code->sharedData)
+            m.sharedDataSize += block->getSize();
+
+        if (isCodeShared)
+            m.sharedDataSize += c.getTotal();
+        else
+            m += c;
+
+        return m;
+    }
+
+    /** Makes an engine which runs the same code with the same routing, but which has no state
+        or buffers yet. Nothing that changes while an engine is running is read, so this can be
+        called while this one is in use.
+    */
+    std::unique_ptr<Engine> createCopy() const
+    {
+        auto e = std::make_unique<Engine>();
+        e->code = code;
+        e->globalOffset = globalOffset;
+        e->emptyElement.resize (emptyElement.size());
+        e->outputRoutes = outputRoutes;
+        e->delayLines = delayLines;
+
+        std::unordered_map<const Instance*, Instance*> copies;
+
+        for (auto& i : instances)
+        {
+            e->instances.push_back (std::make_unique<Instance>());
+            auto& copy = *e->instances.back();
+            copy.layout = i->layout;
+            copy.name = i->name;
+            copy.memoryOffset = i->memoryOffset;
+            copy.rateShift = i->rateShift;
+            copy.runsPerFrame = i->runsPerFrame;
+            copy.frameMask = i->frameMask;
+            copy.id = i->id;
+            copy.inputRoutes = i->inputRoutes;
+            copy.voiceIdleFlags = i->voiceIdleFlags;
+            copy.eventSinks = i->eventSinks;
+            copies[i.get()] = std::addressof (copy);
+        }
+
+        auto remapSinks = [&] (std::vector<EventSink>& sinks)
+        {
+            for (auto& sink : sinks)
+                if (sink.instance != nullptr)
+                    sink.instance = copies[sink.instance];
+        };
+
+        for (auto& i : e->instances)
+            for (auto& output : i->eventSinks)
+                for (auto& sinks : output)
+                    remapSinks (sinks);
+
+        for (auto i : scheduledInstances)
+            e->scheduledInstances.push_back (copies[i]);
+
+        for (auto& input : inputs)
+        {
+            TopInput t;
+            t.declaration = input.declaration;
+            t.slotOffset = input.slotOffset;
+            t.frameSize = input.frameSize;
+            t.layout = input.layout;
+            t.sinks = input.sinks;
+            t.types = input.types;
+            t.hasExternalLayout = input.hasExternalLayout;
+            remapSinks (t.sinks);
+            e->inputs.push_back (std::move (t));
+        }
+
+        for (auto& output : outputs)
+        {
+            TopOutput t;
+            t.declaration = output.declaration;
+            t.slotOffset = output.slotOffset;
+            t.frameSize = output.frameSize;
+            t.types = output.types;
+            t.typeSizes = output.typeSizes;
+            t.hasExternalLayout = output.hasExternalLayout;
+            e->outputs.push_back (std::move (t));
+        }
+
+        return e;
+    }
+
+    /** Gives a copy made by createCopy() its own state, in the state that it was linked with. */
+    void createState()
+    {
+        memory = code->initialMemory;
+
+        for (auto& i : instances)
+            i->state = memory.data() + i->memoryOffset;
+    }
+
+    //==============================================================================
+    void render (uint32_t numFrames)
+    {
+        auto base = memory.data();
+
+        for (uint32_t frame = 0; frame < numFrames; ++frame)
+        {
+            currentFrame = frame;
+            auto frameIndex = readUnaligned<uint64_t> (base + frameCounterOffset);
+
+            if (frame == 0)
+                dispatchInputEvents();
+
+            if (! pendingEvents.empty())
+                dispatchPendingEvents (frameIndex);
+
+            for (auto& input : inputs)
+                readInputFrame (input, frame);
+
+            for (auto instance : scheduledInstances)
+            {
+                if ((frameIndex & instance->frameMask) != 0)
+                    continue;
+
+                if (isVoiceIdle (*instance))
+                    continue;
+
+                for (auto& r : instance->inputRoutes)
+                    gather (r);
+
+                for (uint32_t i = 0; i < instance->runsPerFrame; ++i)
+                    run (*instance);
+            }
+
+            for (auto& r : outputRoutes)
+                gather (r);
+
+            for (auto& output : outputs)
+                if (! output.frames.empty())
+                    memcpy (output.frames.data() + frame * output.frameSize, base + output.slotOffset, output.frameSize);
+
+            for (auto& d : delayLines)
+            {
+                auto position = readUnaligned<uint32_t> (base + d.positionOffset);
+                memcpy (base + d.bufferOffset + (position & d.mask) * d.frameSize, base + d.sourceOffset, d.frameSize);
+                writeUnaligned (base + d.positionOffset, position + 1);
+            }
+
+            writeUnaligned (base + frameCounterOffset, frameIndex + 1);
+        }
+    }
+
+    /** Checks the flags that a voice's processors use to say that it's silent. Its stream
+        outputs are cleared the first time round, and then left alone until it wakes up.
+    */
+    bool isVoiceIdle (Instance& instance)
+    {
+        if (instance.voiceIdleFlags.empty())
+            return false;
+
+        auto base = memory.data();
+
+        for (auto flag : instance.voiceIdleFlags)
+        {
+            if (base[flag] == 0)
+            {
+                instance.isIdle = false;
+                return false;
+            }
+        }
+
+        if (! instance.isIdle)
+        {
+            instance.isIdle = true;
+
+            for (auto& o : instance.layout->streamOutputs)
+                memset (instance.state + o.first, 0, o.second);
+        }
+
+        return true;
+    }
+
+    void run (Instance& instance)
+    {
+        auto& layout = *instance.layout;
+        auto state = instance.state;
+
+        for (auto& o : layout.streamOutputs)
+            memset (state + o.first, 0, o.second);
+
+        auto resumeIndex = readUnaligned<uint32_t> (state + layout.resumeOffset);
+
+        if (resumeIndex == ModuleLayout::finished || layout.runFunction == nullptr)
+            return;
+
+        auto start = layout.runFunction->code.data();
+        Context context { { state + layout.runFrameOffset, state, getGlobals(), code->constants.data() },
+                          this, std::addressof (instance), stack.data(), nullptr, nullptr };
+        execute (start + resumeIndex, context);
+
+        writeUnaligned (state + layout.resumeOffset, context.resumePoint != nullptr ? static_cast<uint32_t> (context.resumePoint - start)
+                                                                                    : ModuleLayout::finished);
+    }
+
+    void callFunction (const CompiledFunction& f, Instance* instance, uint8_t* stackTop)
+    {
+        Context context { { stackTop, instance != nullptr ? instance->state : nullptr, getGlobals(), code->constants.data() },
+                          this, instance, stackTop + f.frameSize, nullptr, nullptr };
+        execute (f.code.data(), context);
+    }
+
+    void callEventHandler (const CompiledFunction& f, Instance& instance, uint8_t* stackTop,
+                           const uint8_t* data, uint32_t element)
+    {
+        if (stackTop + f.stackSize > stackEnd)
+        {
+            stackOverflowed = true;
+            return;
+        }
+
+        auto& params = f.function->parameters;
+        auto valueIndex = params.size() - 1;
+
+        if (params.size() > 1)
+        {
+            if (params.front()->type.isInteger64())
+                writeUnaligned (stackTop + f.parameterOffsets.front(), static_cast<int64_t> (element));
+            else
+                writeUnaligned (stackTop + f.parameterOffsets.front(), static_cast<int32_t> (element));
+        }
+
+        if (params[valueIndex]->type.isReference())
+            writeUnaligned (stackTop + f.parameterOffsets[valueIndex], const_cast<uint8_t*> (data));
+        else
+            memcpy (stackTop + f.parameterOffsets[valueIndex], data, f.parameterSizes[valueIndex]);
+
+        callFunction (f, std::addressof (instance), stackTop);
+    }
+
+    //==============================================================================
+    void emitEvent (const Context& context, uint32_t output, uint32_t element, uint32_t typeIndex, const uint8_t* data)
+    {
+        auto& sinks = context.instance->eventSinks[output];
+
+        if (element < sinks.size())
+            for (auto& sink : sinks[element])
+                deliverEvent (sink, typeIndex, data, context.stackTop);
+    }
+
+    void deliverEvent (const EventSink& sink, uint32_t typeIndex, const uint8_t* data, uint8_t* stackTop)
+    {
+        if (sink.delay != 0)
+        {
+            auto size = sink.dataSizes[typeIndex];
+
+            if (pendingEvents.size() == pendingEvents.capacity()
+                 || pendingEventData.size() + size > pendingEventData.capacity())
+            {
+                ++numXRuns;
+                return;
+            }
+
+            auto frameIndex = readUnaligned<uint64_t> (memory.data() + frameCounterOffset);
+            pendingEvents.push_back ({ frameIndex + sink.delay, std::addressof (sink), typeIndex, static_cast<uint32_t> (pendingEventData.size()) });
+            pendingEventData.insert (pendingEventData.end(), data, data + size);
+            return;
+        }
+
+        if (sink.instance != nullptr)
+        {
+            if (auto handler = sink.handlers[typeIndex])
+                callEventHandler (*handler, *sink.instance, stackTop, data, sink.element);
+
+            return;
+        }
+
+        auto outputType = sink.outputTypes[typeIndex];
+
+        if (outputType < 0)
+            return;
+
+        auto& output = outputs[sink.endpoint];
+        auto size = output.typeSizes[static_cast<size_t> (outputType)];
+
+        if (output.events.size() == output.events.capacity() || output.eventData.size() + size > output.eventData.capacity())
+        {
+            ++numXRuns;
+            return;
+        }
+
+        output.events.push_back ({ currentFrame, static_cast<uint32_t> (outputType), static_cast<uint32_t> (output.eventData.size()) });
+        output.eventData.insert (output.eventData.end(), data, data + size);
+    }
+
+    void dispatchInputEvents()
+    {
+        for (auto& e : inputEvents)
+            for (auto& sink : inputs[e.input].sinks)
+                deliverEvent (sink, e.typeIndex, inputEventData.data() + e.dataOffset, stack.data());
+
+        inputEvents.clear();
+        inputEventData.clear();
+    }
+
+    void dispatchPendingEvents (uint64_t frameIndex)
+    {
+        // Any events which are queued by the handlers called here will be due later, so they're
+        // left at the end of the list
+        auto numEvents = pendingEvents.size();
+        size_t numKept = 0;
+
+        for (size_t i = 0; i < numEvents; ++i)
+        {
+            auto e = pendingEvents[i];
+
+            if (e.dueFrame <= frameIndex)
+            {
+                auto& sink = *e.sink;
+                auto data = pendingEventData.data() + e.dataOffset;
+
+                if (sink.instance != nullptr)
+                {
+                    if (auto handler = sink.handlers[e.typeIndex])
+                        callEventHandler (*handler, *sink.instance, stack.data(), data, sink.element);
+                }
+                else
+                {
+                    EventSink undelayed (sink);
+                    undelayed.delay = 0;
+                    deliverEvent (undelayed, e.typeIndex, data, stack.data());
+                }
+            }
+            else
+            {
+                pendingEvents[numKept++] = e;
+            }
+        }
+
+        pendingEvents.erase (pendingEvents.begin() + static_cast<std::ptrdiff_t> (numKept),
+                             pendingEvents.begin() + static_cast<std::ptrdiff_t> (numEvents));
+
+        if (pendingEvents.empty())
+            pendingEventData.clear();
+    }
+
+    //==============================================================================
+    void readInputFrame (TopInput& input, uint32_t frame)
+    {
+        auto slot = memory.data() + input.slotOffset;
+
+        if (input.isSparse)
+        {
+            if (input.numRampFrames == 0)
+                return;
+
+            if (--input.numRampFrames == 0)
+            {
+                memcpy (slot, input.sparseTarget.data(), input.frameSize);
+                return;
+            }
+
+            auto elementSize = input.frameSize / input.layout.numElements;
+
+            for (uint32_t i = 0; i < input.layout.numElements; ++i)
+            {
+                auto p = slot + i * elementSize;
+                writeElement (input.layout.type, p, readElement (input.layout.type, p) + input.rampIncrements[i]);
+            }
+        }
+        else if (input.hasFrames)
+        {
+            memcpy (slot, input.frames.data() + frame * input.frameSize, input.frameSize);
+        }
+    }
+
+    const uint8_t* getSource (const Route::Source& s)
+    {
+        auto base = memory.data();
+
+        if (s.delayLine < 0)
+            return base + s.offset;
+
+        auto& d = delayLines[static_cast<size_t> (s.delayLine)];
+        return base + d.bufferOffset + ((readUnaligned<uint32_t> (base + d.positionOffset) - d.length) & d.mask) * d.frameSize;
+    }
+
+    void gather (const Route& r)
+    {
+        auto dest = memory.data() + r.destOffset;
+        memcpy (dest, getSource (r.sources.front()), r.size);
+
+        if (r.isStream)
+            for (size_t i = 1; i < r.sources.size(); ++i)
+                addElements (r.elementType, dest, getSource (r.sources[i]), r.numElements);
+        else if (r.sources.size() > 1)
+            memcpy (dest, getSource (r.sources.back()), r.size);
+    }
+
+    //==============================================================================
+    void reset()
+    {
+        memcpy (memory.data(), code->initialMemory.data(), memory.size());
+        restoreInputValues();
+        pendingEvents.clear();
+        pendingEventData.clear();
+        inputEvents.clear();
+        inputEventData.clear();
+        stackOverflowed = false;
+
+        for (auto& input : inputs)
+        {
+            input.isSparse = false;
+            input.numRampFrames = 0;
+        }
+    }
+
+    /** Value inputs keep whatever the caller last set, even if the state is replaced. */
+    void restoreInputValues()
+    {
+        for (auto& input : inputs)
+            if (! input.value.empty())
+                memcpy (memory.data() + input.slotOffset, input.value.data(), input.value.size());
+    }
+};
+
+//==============================================================================
+// Instruction handlers
+//==============================================================================
+template <typename Type>
+using UnsignedOf = typename std::make_unsigned<Type>::type;
+
+template <typename Source, typename Dest>
+static Dest convertElement (Source s)
+{
+    if constexpr (std::is_same<Dest, bool>::value)
+    {
+        return s != 0;
+    }
+    else if constexpr (std::is_floating_point<Source>::value && std::is_integral<Dest>::value)
+    {
+        if (std::isnan (s))                                          return 0;
+        if (s <= static_cast<Source> (std::numeric_limits<Dest>::min()))  return std::numeric_limits<Dest>::min();
+        if (s >= static_cast<Source> (std::numeric_limits<Dest>::max()))  return std::numeric_limits<Dest>::max();
+
+        return static_cast<Dest> (s);
+    }
+    else
+    {
+        return static_cast<Dest> (s);
+    }
+}
+
+static const Instruction* copy (const Instruction& i, Context& c)
+{
+    memcpy (c.get (i.dest), c.get (i.a), i.size);
+    return &i + 1;
+}
+
+template <typename Type>
+static const Instruction* accumulate (const Instruction& i, Context& c)
+{
+    addElements<Type> (c.get (i.dest), c.get (i.a), i.count);
+    return &i + 1;
+}
+
+template <typename Source, typename Dest, bool broadcast>
+static const Instruction* convert (const Instruction& i, Context& c)
+{
+    auto d = c.get (i.dest);
+    auto a = c.get (i.a);
+
+    for (uint32_t n = 0; n < i.count; ++n)
+        writeUnaligned (d + n * sizeof (Dest), convertElement<Source, Dest> (readUnaligned<Source> (a + (broadcast ? 0 : n * sizeof (Source)))));
+
+    return &i + 1;
+}
+
+template <typename Source, bool isWrapped>
+static const Instruction* castToBoundedInt (const Instruction& i, Context& c)
+{
+    auto n = convertElement<Source, int64_t> (readUnaligned<Source> (c.get (i.a)));
+    auto limit = static_cast<int64_t> (i.count);
+
+    if constexpr (isWrapped)
+    {
+        n %= limit;
+
+        if (n < 0)
+            n += limit;
+    }
+    else
+    {
+        n = n < 0 ? 0 : (n >= limit ? limit - 1 : n);
+    }
+
+    writeUnaligned (c.get (i.dest), static_cast<int32_t> (n));
+    return &i + 1;
+}
+
+template <typename Op>
+static const Instruction* unaryOp (const Instruction& i, Context& c)
+{
+    using OperandType = typename Op::OperandType;
+    using Result  = typename Op::Result;
+    auto d = c.get (i.dest);
+    auto a = c.get (i.a);
+
+    for (uint32_t n = 0; n < i.count; ++n)
+        writeUnaligned (d + n * sizeof (Result), static_cast<Result> (Op::apply (readUnaligned<OperandType> (a + n * sizeof (OperandType)))));
+
+    return &i + 1;
+}
+
+template <typename Op>
+static const Instruction* binaryOp (const Instruction& i, Context& c)
+{
+    using OperandType = typename Op::OperandType;
+    using Result  = typename Op::Result;
+    auto d = c.get (i.dest);
+    auto a = c.get (i.a);
+    auto b = c.get (i.b);
+
+    for (uint32_t n = 0; n < i.count; ++n)
+        writeUnaligned (d + n * sizeof (Result),
+                        static_cast<Result> (Op::apply (readUnaligned<OperandType> (a + n * sizeof (OperandType)),
+                                                        readUnaligned<OperandType> (b + n * sizeof (OperandType)))));
+
+    return &i + 1;
+}
+
+template <bool equal>
+static const Instruction* compareBytes (const Instruction& i, Context& c)
+{
+    auto same = memcmp (c.get (i.a), c.get (i.b), i.size) == 0;
+    writeUnaligned (c.get (i.dest), same == equal);
+    return &i + 1;
+}
+
+//==============================================================================
+template <typename T> struct Negate     { using OperandType = T; using Result = T;    static T apply (T a)      { if constexpr (std::is_integral<T>::value) return static_cast<T> (UnsignedOf<T>() - static_cast<UnsignedOf<T>> (a)); else return -a; } };
+template <typename T> struct LogicalNot { using OperandType = T; using Result = bool; static bool apply (T a)   { return a == 0; } };
+template <typename T> struct BitwiseNot { using OperandType = T; using Result = T;    static T apply (T a)      { if constexpr (std::is_same<T, bool>::value) return ! a; else return static_cast<T> (~a); } };
+
+template <typename T> struct Add        { using OperandType = T; using Result = T;    static T apply (T a, T b)     { return addValues (a, b); } };
+template <typename T> struct Subtract   { using OperandType = T; using Result = T;    static T apply (T a, T b)     { if constexpr (std::is_integral<T>::value) return static_cast<T> (static_cast<UnsignedOf<T>> (a) - static_cast<UnsignedOf<T>> (b)); else return a - b; } };
+template <typename T> struct Multiply   { using OperandType = T; using Result = T;    static T apply (T a, T b)     { if constexpr (std::is_integral<T>::value) return static_cast<T> (static_cast<UnsignedOf<T>> (a) * static_cast<UnsignedOf<T>> (b)); else return a * b; } };
+template <typename T> struct BitwiseOr  { using OperandType = T; using Result = T;    static T apply (T a, T b)     { return static_cast<T> (a | b); } };
+template <typename T> struct BitwiseAnd { using OperandType = T; using Result = T;    static T apply (T a, T b)     { return static_cast<T> (a & b); } };
+template <typename T> struct BitwiseXor { using OperandType = T; using Result = T;    static T apply (T a, T b)     { return static_cast<T> (a ^ b); } };
+template <typename T> struct LogicalOr  { using OperandType = T; using Result = bool; static bool apply (T a, T b)  { return a != 0 || b != 0; } };
+template <typename T> struct LogicalAnd { using OperandType = T; using Result = bool; static bool apply (T a, T b)  { return a != 0 && b != 0; } };
+template <typename T> struct Equals             { using OperandType = T; using Result = bool; static bool apply (T a, T b)  { return a == b; } };
+template <typename T> struct NotEquals          { using OperandType = T; using Result = bool; static bool apply (T a, T b)  { return a != b; } };
+template <typename T> struct LessThan           { using OperandType = T; using Result = bool; static bool apply (T a, T b)  { return a < b; } };
+template <typename T> struct LessThanOrEqual    { using OperandType = T; using Result = bool; static bool apply (T a, T b)  { return a <= b; } };
+template <typename T> struct GreaterThan        { using OperandType = T; using Result = bool; static bool apply (T a, T b)  { return a > b; } };
+template <typename T> struct GreaterThanOrEqual { using OperandType = T; using Result = bool; static bool apply (T a, T b)  { return a >= b; } };
+
+template <typename T>
+struct Divide
+{
+    using OperandType = T;
+    using Result = T;
+
+    static T apply (T a, T b)
+    {
+        if constexpr (std::is_integral<T>::value)
+        {
+            if (b == 0)   return 0;
+            if (b == -1)  return Negate<T>::apply (a);
+        }
+
+        return a / b;
+    }
+};
+
+template <typename T>
+struct Modulo
+{
+    using OperandType = T;
+    using Result = T;
+
+    static T apply (T a, T b)
+    {
+        if constexpr (std::is_integral<T>::value)
+            return (b == 0 || b == -1) ? 0 : a % b;
+        else
+            return std::fmod (a, b);
+    }
+};
+
+template <typename T>
+struct LeftShift
+{
+    using OperandType = T;
+    using Result = T;
+    static constexpr T numBits = static_cast<T> (sizeof (T) * 8);
+
+    static T apply (T a, T b)   { return (b >= 0 && b < numBits) ? static_cast<T> (static_cast<UnsignedOf<T>> (a) << b) : 0; }
+};
+
+template <typename T>
+struct RightShift
+{
+    using OperandType = T;
+    using Result = T;
+    static constexpr T numBits = static_cast<T> (sizeof (T) * 8);
+
+    static T apply (T a, T b)   { return b < 0 ? (a >= 0 ? 0 : -1) : (a >> (b < numBits ? b : numBits - 1)); }
+};
+
+template <typename T>
+struct RightShiftUnsigned
+{
+    using OperandType = T;
+    using Result = T;
+    static constexpr T numBits = static_cast<T> (sizeof (T) * 8);
+
+    static T apply (T a, T b)   { return (b >= 0 && b < numBits) ? static_cast<T> (static_cast<UnsignedOf<T>> (a) >> b) : 0; }
+};
+
+template <template <typename> class Op, bool supportsBool, bool supportsFloat>
+static Handler selectBinaryOp (ElementType type)
+{
+    if constexpr (supportsBool)
+        if (type == ElementType::bool_)
+            return binaryOp<Op<bool>>;
+
+    if (type == ElementType::int32)  return binaryOp<Op<int32_t>>;
+    if (type == ElementType::int64)  return binaryOp<Op<int64_t>>;
+
+    if constexpr (supportsFloat)
+    {
+        if (type == ElementType::float32)  return binaryOp<Op<float>>;
+        if (type == ElementType::float64)  return binaryOp<Op<double>>;
+    }
+
+    return nullptr;
+}
+
+template <template <typename> class Op, bool supportsBool, bool supportsFloat>
+static Handler selectUnaryOp (ElementType type)
+{
+    if constexpr (supportsBool)
+        if (type == ElementType::bool_)
+            return unaryOp<Op<bool>>;
+
+    if (type == ElementType::int32)  return unaryOp<Op<int32_t>>;
+    if (type == ElementType::int64)  return unaryOp<Op<int64_t>>;
+
+    if constexpr (supportsFloat)
+    {
+        if (type == ElementType::float32)  return unaryOp<Op<float>>;
+        if (type == ElementType::float64)  return unaryOp<Op<double>>;
+    }
+
+    return nullptr;
+}
+
+static Handler getBinaryOpHandler (BinaryOp::Op op, ElementType type)
+{
+    switch (op)
+    {
+        case BinaryOp::Op::add:                  return selectBinaryOp<Add,                false, true>  (type);
+        case BinaryOp::Op::subtract:             return selectBinaryOp<Subtract,           false, true>  (type);
+        case BinaryOp::Op::multiply:             return selectBinaryOp<Multiply,           false, true>  (type);
+        case BinaryOp::Op::divide:               return selectBinaryOp<Divide,             false, true>  (type);
+        case BinaryOp::Op::modulo:               return selectBinaryOp<Modulo,             false, true>  (type);
+        case BinaryOp::Op::bitwiseOr:            return selectBinaryOp<BitwiseOr,          true,  false> (type);
+        case BinaryOp::Op::bitwiseAnd:           return selectBinaryOp<BitwiseAnd,         true,  false> (type);
+        case BinaryOp::Op::bitwiseXor:           return selectBinaryOp<BitwiseXor,         true,  false> (type);
+        case BinaryOp::Op::logicalOr:            return selectBinaryOp<LogicalOr,          true,  false> (type);
+        case BinaryOp::Op::logicalAnd:           return selectBinaryOp<LogicalAnd,         true,  false> (type);
+        case BinaryOp::Op::equals:               return selectBinaryOp<Equals,             true,  true>  (type);
+        case BinaryOp::Op::notEquals:            return selectBinaryOp<NotEquals,          true,  true>  (type);
+        case BinaryOp::Op::lessThan:             return selectBinaryOp<LessThan,           false, true>  (type);
+        case BinaryOp::Op::lessThanOrEqual:      return selectBinaryOp<LessThanOrEqual,    false, true>  (type);
+        case BinaryOp::Op::greaterThan:          return selectBinaryOp<GreaterThan,        false, true>  (type);
+        case BinaryOp::Op::greaterThanOrEqual:   return selectBinaryOp<GreaterThanOrEqual, false, true>  (type);
+        case BinaryOp::Op::leftShift:            return selectBinaryOp<LeftShift,          false, false> (type);
+        case BinaryOp::Op::rightShift:           return selectBinaryOp<RightShift,         false, false> (type);
+        case BinaryOp::Op::rightShiftUnsigned:   return selectBinaryOp<RightShiftUnsigned, false, false> (type);
+        default:                                 return nullptr;
+    }
+}
+
+static Handler getUnaryOpHandler (UnaryOp::Op op, ElementType type)
+{
+    switch (op)
+    {
+        case UnaryOp::Op::negate:       return selectUnaryOp<Negate,     false, true>  (type);
+        case UnaryOp::Op::logicalNot:   return selectUnaryOp<LogicalNot, true,  true>  (type);
+        case UnaryOp::Op::bitwiseNot:   return selectUnaryOp<BitwiseNot, true,  false> (type);
+        default:                        return nullptr;
+    }
+}
+
+template <typename Source, bool broadcast>
+static Handler selectConversion (ElementType dest)
+{
+    switch (dest)
+    {
+        case ElementType::bool_:    return convert<Source, bool,    broadcast>;
+        case ElementType::int32:    return convert<Source, int32_t, broadcast>;
+        case ElementType::int64:    return convert<Source, int64_t, broadcast>;
+        case ElementType::float32:  return convert<Source, float,   broadcast>;
+        case ElementType::float64:  return convert<Source, double,  broadcast>;
+        case ElementType::other:
+        default:                    return nullptr;
+    }
+}
+
+template <bool broadcast>
+static Handler selectConversion (ElementType source, ElementType dest)
+{
+    switch (source)
+    {
+        case ElementType::bool_:    return selectConversion<bool,    broadcast> (dest);
+        case ElementType::int32:    return selectConversion<int32_t, broadcast> (dest);
+        case ElementType::int64:    return selectConversion<int64_t, broadcast> (dest);
+        case ElementType::float32:  return selectConversion<float,   broadcast> (dest);
+        case ElementType::float64:  return selectConversion<double,  broadcast> (dest);
+        case ElementType::other:
+        default:                    return nullptr;
+    }
+}
+
+template <bool isWrapped>
+static Handler selectBoundedIntCast (ElementType source)
+{
+    switch (source)
+    {
+        case ElementType::bool_:    return castToBoundedInt<bool,    isWrapped>;
+        case ElementType::int32:    return castToBoundedInt<int32_t, isWrapped>;
+        case ElementType::int64:    return castToBoundedInt<int64_t, isWrapped>;
+        case ElementType::float32:  return castToBoundedInt<float,   isWrapped>;
+        case ElementType::float64:  return castToBoundedInt<double,  isWrapped>;
+        case ElementType::other:
+        default:                    return nullptr;
+    }
+}
+
+static Handler getAccumulateHandler (ElementType type)
+{
+    switch (type)
+    {
+        case ElementType::int32:    return accumulate<int32_t>;
+        case ElementType::int64:    return accumulate<int64_t>;
+        case ElementType::float32:  return accumulate<float>;
+        case ElementType::float64:  return accumulate<double>;
+        case ElementType::bool_:
+        case ElementType::other:
+        default:                    return nullptr;
+    }
+}
+
+//==============================================================================
+/** Finds an element of a fixed-size array or vector, wrapping an index that's out of range. */
+template <typename IndexType>
+static const Instruction* elementAddress (const Instruction& i, Context& c)
+{
+    auto index = static_cast<int64_t> (readUnaligned<IndexType> (c.get (i.b)));
+    auto size = static_cast<int64_t> (i.count);
+
+    if (static_cast<uint64_t> (index) >= static_cast<uint64_t> (size))
+    {
+        index %= size;
+
+        if (index < 0)
+            index += size;
+    }
+
+    writeUnaligned (c.bases[0] + i.dest.offset, c.get (i.a) + index * i.size);
+    return &i + 1;
+}
+
+/** Finds an element of an unsized array. An empty array reads as a zeroed element. */
+template <typename IndexType>
+static const Instruction* unsizedElementAddress (const Instruction& i, Context& c)
+{
+    auto array = readUnaligned<const UnsizedArray*> (c.get (i.a));
+
+    if (array == nullptr || array->numElements == 0)
+    {
+        auto empty = c.engine->emptyElement.data();
+        memset (empty, 0, i.size);
+        writeUnaligned (c.bases[0] + i.dest.offset, empty);
+        return &i + 1;
+    }
+
+    auto index = static_cast<int64_t> (readUnaligned<IndexType> (c.get (i.b)));
+    auto size = static_cast<int64_t> (array->numElements);
+
+    if (static_cast<uint64_t> (index) >= static_cast<uint64_t> (size))
+    {
+        index %= size;
+
+        if (index < 0)
+            index += size;
+    }
+
+    writeUnaligned (c.bases[0] + i.dest.offset, const_cast<uint8_t*> (array->data) + index * i.size);
+    return &i + 1;
+}
+
+static const Instruction* getUnsizedArraySize (const Instruction& i, Context& c)
+{
+    auto array = readUnaligned<const UnsizedArray*> (c.get (i.a));
+    writeUnaligned (c.get (i.dest), static_cast<int32_t> (array != nullptr ? array->numElements : 0));
+    return &i + 1;
+}
+
+/** Casts a fixed-size array to an unsized one, using a record in the frame to describe it. */
+static const Instruction* makeUnsizedArray (const Instruction& i, Context& c)
+{
+    auto record = c.get (i.b);
+    writeUnaligned (record, UnsizedArray { c.get (i.a), i.count });
+    writeUnaligned (c.get (i.dest), reinterpret_cast<const UnsizedArray*> (record));
+    return &i + 1;
+}
+
+//==============================================================================
+static const Instruction* jump (const Instruction& i, Context&)
+{
+    return i.targets[0];
+}
+
+static const Instruction* branchIf (const Instruction& i, Context& c)
+{
+    return *c.get (i.a) != 0 ? i.targets[0] : i.targets[1];
+}
+
+static const Instruction* returnVoid (const Instruction&, Context&)
+{
+    return nullptr;
+}
+
+static const Instruction* returnValue (const Instruction& i, Context& c)
+{
+    if (c.returnValue != nullptr)
+        memcpy (c.returnValue, c.get (i.a), i.size);
+
+    return nullptr;
+}
+
+static const Instruction* advance (const Instruction& i, Context& c)
+{
+    c.resumePoint = &i + 1;
+    return nullptr;
+}
+
+static const Instruction* call (const Instruction& i, Context& c)
+{
+    auto& info = *static_cast<const CallInfo*> (i.data);
+    auto& f = *info.function;
+    auto frame = c.stackTop;
+
+    for (auto& arg : info.arguments)
+    {
+        if (arg.isReference)
+            writeUnaligned (frame + arg.destOffset, c.get (arg.source));
+        else
+            memcpy (frame + arg.destOffset, c.get (arg.source), arg.size);
+    }
+
+    Context callee { { frame, c.bases[1], c.bases[2], c.bases[3] }, c.engine, c.instance,
+                     frame + f.frameSize, i.count != 0 ? c.get (i.dest) : nullptr, nullptr };
+    execute (f.code.data(), callee);
+    return &i + 1;
+}
+
+static const Instruction* writeEvent (const Instruction& i, Context& c)
+{
+    c.engine->emitEvent (c, i.size, 0, i.count, c.get (i.a));
+    return &i + 1;
+}
+
+template <typename IndexType>
+static const Instruction* writeEventElement (const Instruction& i, Context& c)
+{
+    auto element = readUnaligned<IndexType> (c.get (i.b));
+
+    if (element >= 0)
+        c.engine->emitEvent (c, i.size, static_cast<uint32_t> (element), i.count, c.get (i.a));
+
+    return &i + 1;
+}
+
+//==============================================================================
+template <typename Arg, typename Result, Result (*fn) (Arg)>
+static const Instruction* nativeUnary (const Instruction& i, Context& c)
+{
+    auto d = c.get (i.dest);
+    auto a = c.get (i.a);
+
+    for (uint32_t n = 0; n < i.count; ++n)
+        writeUnaligned (d + n * sizeof (Result), fn (readUnaligned<Arg> (a + n * sizeof (Arg))));
+
+    return &i + 1;
+}
+
+template <typename Type, Type (*fn) (Type, Type)>
+static const Instruction* nativeBinary (const Instruction& i, Context& c)
+{
+    auto d = c.get (i.dest);
+    auto a = c.get (i.a);
+    auto b = c.get (i.b);
+
+    for (uint32_t n = 0; n < i.count; ++n)
+        writeUnaligned (d + n * sizeof (Type), fn (readUnaligned<Type> (a + n * sizeof (Type)),
+                                                   readUnaligned<Type> (b + n * sizeof (Type))));
+
+    return &i + 1;
+}
+
+template <typename Type, Type (*fn) (Type, Type, Type)>
+static const Instruction* nativeTernary (const Instruction& i, Context& c)
+{
+    auto d = c.get (i.dest);
+    auto a = c.get (i.a);
+    auto b = c.get (i.b);
+    auto x = c.get (i.c);
+
+    for (uint32_t n = 0; n < i.count; ++n)
+        writeUnaligned (d + n * sizeof (Type), fn (readUnaligned<Type> (a + n * sizeof (Type)),
+                                                   readUnaligned<Type> (b + n * sizeof (Type)),
+                                                   readUnaligned<Type> (x + n * sizeof (Type))));
+
+    return &i + 1;
+}
+
+/** Implementations of the intrinsics which match the bodies in the soul::intrinsics library. */
+template <typename T>
+struct Maths
+{
+    using IntType = typename std::conditional<std::is_same<T, float>::value, int32_t, int64_t>::type;
+
+    static T abs (T n)                  { return n < 0 ? Negate<T>::apply (n) : n; }
+    static T min (T a, T b)             { return a < b ? a : b; }
+    static T max (T a, T b)             { return a > b ? a : b; }
+    static T clamp (T n, T low, T high) { return n < low ? low : (n > high ? high : n); }
+
+    static T floor (T n)                { return std::floor (n); }
+    static T ceil (T n)                 { return std::ceil (n); }
+    static T fmod (T x, T y)            { return std::fmod (x, y); }
+    static T sqrt (T n)                 { return std::sqrt (n); }
+    static T pow (T a, T b)             { return std::pow (a, b); }
+    static T exp (T n)                  { return std::exp (n); }
+    static T log (T n)                  { return std::log (n); }
+    static T log10 (T n)                { return std::log10 (n); }
+    static T sin (T n)                  { return std::sin (n); }
+    static T cos (T n)                  { return std::cos (n); }
+    static T tan (T n)                  { return std::tan (n); }
+    static T sinh (T n)                 { return std::sinh (n); }
+    static T cosh (T n)                 { return std::cosh (n); }
+    static T tanh (T n)                 { return std::tanh (n); }
+    static T asinh (T n)                { return std::asinh (n); }
+    static T acosh (T n)                { return std::acosh (n); }
+    static T atanh (T n)                { return std::atanh (n); }
+    static T asin (T n)                 { return std::asin (n); }
+    static T acos (T n)                 { return std::acos (n); }
+    static T atan (T n)                 { return std::atan (n); }
+    static T atan2 (T a, T b)           { return std::atan2 (a, b); }
+    static T fma (T a, T b, T c)        { return std::fma (a, b, c); }
+    static bool isnan (T n)             { return std::isnan (n); }
+    static bool isinf (T n)             { return std::isinf (n); }
+    static IntType roundToInt (T n)     { return convertElement<T, IntType> (n + (n < 0 ? static_cast<T> (-0.5) : static_cast<T> (0.5))); }
+
+    static T addModulo2Pi (T value, T increment)
+    {
+        constexpr auto twoPi = static_cast<T> (2.0 * 3.141592653589793238);
+        value += increment;
+
+        if (value >= twoPi)
+        {
+            if (value >= twoPi * 2)
+                return std::fmod (value, twoPi);
+
+            return value - twoPi;
+        }
+
+        return value < 0 ? std::fmod (value, twoPi) + twoPi : value;
+    }
+};
+
+template <typename T>
+static constexpr ElementType getElementType()
+{
+    return std::is_same<T, float>::value   ? ElementType::float32
+         : std::is_same<T, double>::value  ? ElementType::float64
+         : std::is_same<T, int32_t>::value ? ElementType::int32 : ElementType::int64;
+}
+
+/** Returns a native handler for an intrinsic whose arguments are all of the given type, along
+    with the type of result that the handler writes.
+*/
+template <typename T>
+static std::pair<Handler, ElementType> getNativeIntrinsic (IntrinsicType intrinsic, size_t numArgs, bool isScalar)
+{
+    using M = Maths<T>;
+    constexpr auto isFloat = std::is_floating_point<T>::value;
+    auto result = [] (Handler h, ElementType t = getElementType<T>()) { return std::make_pair (h, t); };
+
+    if (numArgs == 1)
+    {
+        switch (intrinsic)
+        {
+            case IntrinsicType::abs:    if (isScalar) return result (nativeUnary<T, T, M::abs>); break;
+            default: break;
+        }
+
+        if constexpr (isFloat)
+        {
+            switch (intrinsic)
+            {
+                case IntrinsicType::floor:      if (isScalar) return result (nativeUnary<T, T, M::floor>); break;
+                case IntrinsicType::ceil:       if (isScalar) return result (nativeUnary<T, T, M::ceil>);  break;
+                case IntrinsicType::sqrt:       return result (nativeUnary<T, T, M::sqrt>);
+                case IntrinsicType::exp:        return result (nativeUnary<T, T, M::exp>);
+                case IntrinsicType::log:        return result (nativeUnary<T, T, M::log>);
+                case IntrinsicType::log10:      return result (nativeUnary<T, T, M::log10>);
+                case IntrinsicType::sin:        return result (nativeUnary<T, T, M::sin>);
+                case IntrinsicType::cos:        return result (nativeUnary<T, T, M::cos>);
+                case IntrinsicType::tan:        return result (nativeUnary<T, T, M::tan>);
+                case IntrinsicType::sinh:       return result (nativeUnary<T, T, M::sinh>);
+                case IntrinsicType::cosh:       return result (nativeUnary<T, T, M::cosh>);
+                case IntrinsicType::tanh:       return result (nativeUnary<T, T, M::tanh>);
+                case IntrinsicType::asinh:      return result (nativeUnary<T, T, M::asinh>);
+                case IntrinsicType::acosh:      return result (nativeUnary<T, T, M::acosh>);
+                case IntrinsicType::atanh:      return result (nativeUnary<T, T, M::atanh>);
+                case IntrinsicType::asin:       return result (nativeUnary<T, T, M::asin>);
+                case IntrinsicType::acos:       return result (nativeUnary<T, T, M::acos>);
+                case IntrinsicType::atan:       return result (nativeUnary<T, T, M::atan>);
+                case IntrinsicType::isnan:      if (isScalar) return result (nativeUnary<T, bool, M::isnan>, ElementType::bool_); break;
+                case IntrinsicType::isinf:      if (isScalar) return result (nativeUnary<T, bool, M::isinf>, ElementType::bool_); break;
+                case IntrinsicType::roundToInt: if (isScalar) return result (nativeUnary<T, typename M::IntType, M::roundToInt>,
+                                                                             std::is_same<T, float>::value ? ElementType::int32 : ElementType::int64); break;
+                default: break;
+            }
+        }
+    }
+    else if (numArgs == 2 && isScalar)
+    {
+        switch (intrinsic)
+        {
+            case IntrinsicType::min:    return result (nativeBinary<T, M::min>);
+            case IntrinsicType::max:    return result (nativeBinary<T, M::max>);
+            default: break;
+        }
+
+        if constexpr (isFloat)
+        {
+            switch (intrinsic)
+            {
+                case IntrinsicType::fmod:           return result (nativeBinary<T, M::fmod>);
+                case IntrinsicType::pow:            return result (nativeBinary<T, M::pow>);
+                case IntrinsicType::atan2:          return result (nativeBinary<T, M::atan2>);
+                case IntrinsicType::addModulo2Pi:   return result (nativeBinary<T, M::addModulo2Pi>);
+                default: break;
+            }
+        }
+    }
+    else if (numArgs == 3)
+    {
+        if (isScalar && intrinsic == IntrinsicType::clamp)
+            return result (nativeTernary<T, M::clamp>);
+
+        if constexpr (isFloat)
+            if (intrinsic == IntrinsicType::fma)
+                return result (nativeTernary<T, M::fma>);
+    }
+
+    return {};
+}
+
+static std::pair<Handler, ElementType> getNativeIntrinsic (IntrinsicType intrinsic, ElementType type, size_t numArgs, bool isScalar)
+{
+    switch (type)
+    {
+        case ElementType::int32:    return getNativeIntrinsic<int32_t> (intrinsic, numArgs, isScalar);
+        case ElementType::int64:    return getNativeIntrinsic<int64_t> (intrinsic, numArgs, isScalar);
+        case ElementType::float32:  return getNativeIntrinsic<float>   (intrinsic, numArgs, isScalar);
+        case ElementType::float64:  return getNativeIntrinsic<double>  (intrinsic, numArgs, isScalar);
+        case ElementType::bool_:
+        case ElementType::other:
+        default:                    return {};
+    }
+}
+
+/** The intrinsics whose library functions only have placeholder bodies. */
+static bool needsNativeImplementation (IntrinsicType intrinsic)
+{
+    return intrinsic == IntrinsicType::sqrt  || intrinsic == IntrinsicType::pow
+        || intrinsic == IntrinsicType::exp   || intrinsic == IntrinsicType::log
+        || intrinsic == IntrinsicType::log10 || intrinsic == IntrinsicType::sin
+        || intrinsic == IntrinsicType::cos   || intrinsic == IntrinsicType::isnan
+        || intrinsic == IntrinsicType::isinf;
+}
+
+//==============================================================================
+struct Linker;
+
+/** Translates the HEART for one function into instructions. */
+struct CodeGenerator
+{
+    CodeGenerator (Linker& l, CompiledFunction& f, const ModuleLayout* m)  : linker (l), result (f), layout (m) {}
+
+    void generate();
+
+private:
+    struct Fixup
+    {
+        size_t instruction;
+        int target;
+        size_t block;
+    };
+
+    Linker& linker;
+    CompiledFunction& result;
+    const ModuleLayout* layout;
+    std::unordered_map<const heart::Variable*, Operand> variables;
+    std::unordered_map<const heart::Block*, size_t> blockIndexes;
+    std::vector<size_t> blockStarts;
+    std::vector<Fixup> fixups;
+    uint32_t localsSize = 0, tempTop = 0, frameSize = 0, calleeStackSize = 0;
+
+    //==============================================================================
+    uint32_t allocateLocal (size_t size)
+    {
+        auto offset = align8 (localsSize);
+        localsSize = offset + static_cast<uint32_t> (size);
+        return offset;
+    }
+
+    void addLocal (const heart::Variable& v)
+    {
+        if (variables.find (std::addressof (v)) == variables.end())
+            variables[std::addressof (v)] = Operand::frame (allocateLocal (v.type.getPackedSizeInBytes()));
+    }
+
+    void resetTemps()
+    {
+        tempTop = align8 (localsSize);
+    }
+
+    Operand allocateTemp (size_t size)
+    {
+        auto offset = align8 (tempTop);
+        tempTop = offset + static_cast<uint32_t> (std::max (size, static_cast<size_t> (1)));
+        frameSize = std::max (frameSize, tempTop);
+        return Operand::frame (offset);
+    }
+
+    Operand allocateTemp (const Type& type)
+    {
+        return allocateTemp (type.getPackedSizeInBytes());
+    }
+
+    Instruction& emit (Handler handler)
+    {
+        result.code.emplace_back();
+        auto& i = result.code.back();
+        i.handler = handler;
+        return i;
+    }
+
+    void emitCopy (Operand dest, Operand source, size_t size)
+    {
+        if (dest == source || size == 0)
+            return;
+
+        auto& i = emit (copy);
+        i.dest = dest;
+        i.a = source;
+        i.size = static_cast<uint32_t> (size);
+    }
+
+    void emitJump (const heart::Block& target, Instruction& i, int slot)
+    {
+        fixups.push_back ({ static_cast<size_t> (std::addressof (i) - result.code.data()), slot, blockIndexes[std::addressof (target)] });
+    }
+
+    //==============================================================================
+    void compileStatement (heart::Statement& s);
+    void compileTerminator (heart::Terminator& t, const heart::Block* nextBlock);
+    void compileBlockArguments (heart::Block& target, ArrayView<pool_ref<heart::Expression>> args);
+    void compileWriteStream (heart::WriteStream& w);
+
+    Operand getLocation (heart::Expression& e);
+    Operand getLocation (heart::Expression& e, const Type& requiredType);
+    Operand getVariableLocation (heart::Variable& v);
+    Operand getElementLocation (heart::ArrayElement& a);
+    Operand getDynamicElement (Operand array, heart::Expression& index, uint32_t arraySize, uint32_t elementSize);
+    Operand getPropertyLocation (heart::ProcessorProperty& p);
+
+    void compileInto (heart::Expression& e, Operand dest);
+    void compileCast (heart::TypeCast& cast, Operand dest);
+    void compileConversion (Operand dest, const Type& destType, Operand source, const Type& sourceType);
+    void compileBinaryOp (heart::BinaryOperator& b, Operand dest);
+    void compileUnaryOp (heart::UnaryOperator& u, Operand dest);
+
+    template <typename ArgList>
+    void compileCall (heart::Function& fn, const ArgList& args, std::optional<Operand> dest);
+
+    template <typename ArgList>
+    bool compileIntrinsic (heart::Function& fn, const ArgList& args, std::optional<Operand> dest);
+
+    static bool needsConversion (const Type& from, const Type& to)
+    {
+        if (from.isIdentical (to) || from.isEqual (to, Type::ignoreReferences | Type::ignoreConst | Type::ignoreVectorSize1))
+            return false;
+
+        auto a = ElementLayout::forType (from);
+        return ! (a.isHomogeneous() && a == ElementLayout::forType (to) && ! to.isBoundedInt());
+    }
+
+    static uint32_t getMemberOffset (const Type& type, const std::string& name)
+    {
+        size_t offset = 0;
+
+        for (auto& m : type.getStructRef().getMembers())
+        {
+            if (m.name == name)
+                return static_cast<uint32_t> (offset);
+
+            offset += m.type.getPackedSizeInBytes();
+        }
+
+        SOUL_ASSERT_FALSE;
+        return 0;
+    }
+
+    static uint32_t findIndex (ArrayView<pool_ref<heart::InputDeclaration>> list, const heart::InputDeclaration& item)
+    {
+        for (size_t i = 0; i < list.size(); ++i)
+            if (list[i] == item)
+                return static_cast<uint32_t> (i);
+
+        SOUL_ASSERT_FALSE;
+        return 0;
+    }
+
+    static uint32_t findIndex (ArrayView<pool_ref<heart::OutputDeclaration>> list, const heart::OutputDeclaration& item)
+    {
+        for (size_t i = 0; i < list.size(); ++i)
+            if (list[i] == item)
+                return static_cast<uint32_t> (i);
+
+        SOUL_ASSERT_FALSE;
+        return 0;
+    }
+};
+
+//==============================================================================
+/** Builds the instruction lists, state layouts and routing for a whole program. */
+struct Linker
+{
+    using ExternalValues = std::unordered_map<std::string, Value>;
+
+    Linker (Program& p, Engine& e, const BuildSettings& s, const ExternalValues& v,
+            const std::vector<bool>& outputs, const BuildMonitor* m)
+        : program (p), engine (e), settings (s), externalValues (v), connectedOutputs (outputs), monitor (m) {}
+
+    void link()
+    {
+        createGlobalLayout();
+        auto graph = FlattenedGraph::create (program);
+
+        if (! connectedOutputs.empty())
+            graph.removeUnconnectedInstances (program, *this);
+
+        auto numInstances = graph.instances.size();
+
+        // Compiling each instance's functions is where the time goes, so that's
+        // what the progress is measured in
+        for (size_t i = 0; i < numInstances; ++i)
+        {
+            checkForCancellation();
+            createInstance (graph.instances[i]);
+            reportProgress (static_cast<float> (i + 1) / static_cast<float> (numInstances + 1));
+        }
+
+        checkForCancellation();
+        allocateMemory();
+        findVoiceIdleFlags (graph);
+        createRoutes (graph);
+        writeInitialState();
+        describeStateVariables();
+        reportProgress (1.0f);
+    }
+
+    bool isOutputConnected (const heart::OutputDeclaration& output) const
+    {
+        auto& outputs = program.getMainProcessorOrThrowError().outputs;
+
+        for (size_t i = 0; i < outputs.size(); ++i)
+            if (outputs[i] == output)
+                return connectedOutputs[i];
+
+        return true;
+    }
+
+    //==============================================================================
+    CompiledFunction& getCompiledFunction (heart::Function& f)
+    {
+        auto& slot = engine.code->functions[std::addressof (f)];
+
+        if (slot != nullptr)
+        {
+            if (contains (functionsBeingCompiled, std::addressof (f)))
+                throwError (Errors::notYetImplemented ("recursive calls to " + f.name.toString()));
+
+            return *slot;
+        }
+
+        slot = std::make_unique<CompiledFunction>();
+        auto& compiled = *slot;
+        compiled.function = std::addressof (f);
+
+        const ModuleLayout* layout = nullptr;
+
+        if (auto m = program.getModuleContainingFunction (f))
+            if (m->isProcessor())
+                layout = std::addressof (getLayout (*m));
+
+        functionsBeingCompiled.push_back (std::addressof (f));
+        CodeGenerator (*this, compiled, layout).generate();
+        removeFirst (functionsBeingCompiled, [&] (const heart::Function* fn) { return fn == std::addressof (f); });
+        return compiled;
+    }
+
+    CallInfo& createCallInfo()
+    {
+        engine.code->calls.emplace_back();
+        return engine.code->calls.back();
+    }
+
+    Operand getStateVariable (const heart::Variable& v)
+    {
+        auto found = stateVariables.find (std::addressof (v));
+
+        if (found == stateVariables.end())
+            throwError (Errors::notYetImplemented ("access to state outside the current processor"));
+
+        return found->second;
+    }
+
+    Operand addConstant (const Value& value)
+    {
+        auto size = value.getPackedDataSize();
+        auto data = static_cast<const uint8_t*> (value.getPackedData());
+        std::string key;
+
+        if (size <= 16 && ! mayContainUnsizedArrays (value.getType()))
+        {
+            key.assign (reinterpret_cast<const char*> (data), size);
+            auto found = constantOffsets.find (key);
+
+            if (found != constantOffsets.end())
+                return { Operand::Base::constants, found->second, 0 };
+        }
+
+        auto offset = align8 (engine.code->constants.size());
+        engine.code->constants.resize (offset + std::max (size, static_cast<size_t> (1)));
+        memcpy (engine.code->constants.data() + offset, data, size);
+        resolveUnsizedArrays (value.getType(), engine.code->constants.data() + offset);
+
+        if (! key.empty())
+            constantOffsets[key] = offset;
+
+        return { Operand::Base::constants, offset, 0 };
+    }
+
+    void noteElementSize (size_t size)
+    {
+        if (engine.emptyElement.size() < size)
+            engine.emptyElement.resize (size);
+    }
+
+    Program& program;
+
+private:
+    //==============================================================================
+    /** An endpoint of a processor instance, or one of the program's inputs or outputs if the
+        instance is null. An element of -1 refers to the whole endpoint.
+    */
+    struct Port
+    {
+        Instance* instance = nullptr;
+        uint32_t endpoint = 0;
+        int32_t element = -1;
+    };
+
+    struct Edge
+    {
+        Port source, dest;
+        uint32_t delay;
+    };
+
+    Engine& engine;
+    const BuildSettings& settings;
+    const ExternalValues& externalValues;
+    const std::vector<bool>& connectedOutputs;
+    const BuildMonitor* monitor;
+    std::unordered_map<const Module*, ModuleLayout*> layouts;
+    std::unordered_map<const heart::Variable*, Operand> stateVariables;
+    std::vector<std::pair<const heart::Variable*, const ModuleLayout*>> externals;
+    std::unordered_map<std::string, uint32_t> constantOffsets;
+    std::unordered_map<ConstantTable::Handle, const UnsizedArray*> unsizedArrays;
+    bool resolvingExternalData = false;
+    std::vector<const heart::Function*> functionsBeingCompiled;
+    uint32_t globalSize = 0;
+
+    //==============================================================================
+    void checkForCancellation() const
+    {
+        if (monitor != nullptr && monitor->isCancelled())
+            throwError (Errors::buildCancelled());
+    }
+
+    void reportProgress (float progress) const
+    {
+        if (monitor != nullptr)
+            monitor->reportProgress (progress);
+    }
+
+    void describeStateVariables()
+    {
+        auto add = [this] (std::string name, const Type& type, uint32_t offset)
+        {
+            if (! mayContainUnsizedArrays (type))
+                engine.code->stateVariables.push_back ({ std::move (name), type.getDescription(), offset, type.getPackedSizeInBytes() });
+        };
+
+        add ("frameCounter", PrimitiveType::int64, Engine::frameCounterOffset);
+
+        for (auto& m : program.getModules())
+            if (m->isNamespace())
+                for (auto& v : m->stateVariables)
+                    if (! v->isExternal())
+                        add (m->fullName + "::" + v->name.toString(), v->type, engine.globalOffset + stateVariables[v.getPointer()].offset);
+
+        for (auto& instance : engine.instances)
+            for (auto& v : instance->layout->module->stateVariables)
+                if (! v->isExternal())
+                    add (getStateVariableName (*instance, v), v->type, instance->memoryOffset + stateVariables[v.getPointer()].offset);
+    }
+
+    /** A variable that was moved into this instance by ProcessorFusion keeps the name it would
+        have had in its original instance, so that state can still be matched up by name with
+        a build where the processors weren't fused.
+    */
+    static std::string getStateVariableName (const Instance& instance, const heart::Variable& v)
+    {
+        if (v.annotation.hasValue (ProcessorFusion::instanceAnnotation))
+        {
+            auto parentPath = instance.name.substr (0, instance.name.rfind ('.') + 1);
+            return parentPath + v.annotation.getString (ProcessorFusion::instanceAnnotation)
+                     + "." + v.annotation.getString (ProcessorFusion::nameAnnotation);
+        }
+
+        return instance.name + "." + v.name.toString();
+    }
+
+    void createGlobalLayout()
+    {
+        for (auto& m : program.getModules())
+        {
+            if (m->isNamespace())
+            {
+                for (auto& v : m->stateVariables)
+                {
+                    auto offset = align8 (globalSize);
+                    globalSize = offset + static_cast<uint32_t> (v->type.getPackedSizeInBytes());
+                    stateVariables[v.getPointer()] = { Operand::Base::global, offset, 0 };
+
+                    if (v->isExternal())
+                        externals.push_back ({ v.getPointer(), nullptr });
+                }
+            }
+        }
+    }
+
+    ModuleLayout& getLayout (const Module& module)
+    {
+        auto found = layouts.find (std::addressof (module));
+
+        if (found != layouts.end())
+            return *found->second;
+
+        engine.code->layouts.push_back (std::make_unique<ModuleLayout>());
+        auto& layout = *engine.code->layouts.back();
+        layouts[std::addressof (module)] = std::addressof (layout);
+        layout.module = std::addressof (module);
+
+        uint32_t size = 0;
+
+        auto allocate = [&] (size_t n)
+        {
+            auto offset = align8 (size);
+            size = offset + static_cast<uint32_t> (n);
+            return offset;
+        };
+
+        for (auto& v : module.stateVariables)
+        {
+            stateVariables[v.getPointer()] = { Operand::Base::state, allocate (v->type.getPackedSizeInBytes()), 0 };
+
+            if (v->isExternal())
+                externals.push_back ({ v.getPointer(), std::addressof (layout) });
+        }
+
+        for (auto& flag : FlattenedGraph::getVoiceIdleFlags (module))
+            layout.voiceIdleFlags.push_back (stateVariables[flag.getPointer()].offset);
+
+        for (auto& input : module.inputs)
+            layout.inputOffsets.push_back (input->isEventEndpoint() ? 0 : allocate (input->getFrameOrValueType().getPackedSizeInBytes()));
+
+        for (auto& output : module.outputs)
+        {
+            if (output->isEventEndpoint())
+            {
+                layout.outputOffsets.push_back (0);
+                continue;
+            }
+
+            auto outputSize = output->getFrameOrValueType().getPackedSizeInBytes();
+            auto offset = allocate (outputSize);
+            layout.outputOffsets.push_back (offset);
+
+            if (output->isStreamEndpoint())
+                layout.streamOutputs.push_back ({ offset, static_cast<uint32_t> (outputSize) });
+        }
+
+        for (auto property : { heart::ProcessorProperty::Property::period, heart::ProcessorProperty::Property::frequency,
+                               heart::ProcessorProperty::Property::id, heart::ProcessorProperty::Property::session })
+            layout.propertyOffsets[static_cast<size_t> (property)] = allocate (8);
+
+        if (auto run = module.findFunction (heart::getRunFunctionName()))
+        {
+            auto& runFunction = getCompiledFunction (*run);
+            layout.runFunction = std::addressof (runFunction);
+            size = align16 (size);
+            layout.runFrameOffset = allocate (runFunction.frameSize);
+        }
+
+        layout.resumeOffset = allocate (sizeof (uint32_t));
+        layout.size = align16 (size);
+
+        if (auto init = module.findFunction (heart::getSystemInitFunctionName()))
+            if (! (init->hasNoBody || init->blocks.empty()))
+                layout.initFunction = std::addressof (getCompiledFunction (*init));
+
+        return layout;
+    }
+
+    //==============================================================================
+    void createInstance (const FlattenedGraph::Instance& source)
+    {
+        engine.instances.push_back (std::make_unique<Instance>());
+        auto& instance = *engine.instances.back();
+        auto& module = source.module.get();
+        instance.layout = std::addressof (getLayout (module));
+        instance.name = source.name;
+        instance.rateShift = source.rateShift;
+
+        if (instance.rateShift > 0)
+            instance.runsPerFrame = 1u << static_cast<uint32_t> (instance.rateShift);
+        else if (instance.rateShift < 0)
+            instance.frameMask = (static_cast<uint64_t> (1) << static_cast<uint32_t> (-instance.rateShift)) - 1;
+
+        auto arraySize = source.path.empty() ? 1u : source.path.back()->arraySize;
+        instance.id = static_cast<int32_t> (program.getModuleID (module, arraySize) + source.arrayIndex);
+        instance.eventSinks.resize (module.outputs.size());
+
+        for (size_t i = 0; i < module.outputs.size(); ++i)
+            instance.eventSinks[i].resize (module.outputs[i]->arraySize.value_or (1));
+
+        if (! source.isEventDriven())
+            engine.scheduledInstances.push_back (std::addressof (instance));
+    }
+
+    void findVoiceIdleFlags (const FlattenedGraph& graph)
+    {
+        for (uint32_t i = 0; i < graph.instances.size(); ++i)
+            for (auto j : graph.getVoiceInstances (i))
+                for (auto offset : engine.instances[j]->layout->voiceIdleFlags)
+                    engine.instances[i]->voiceIdleFlags.push_back (engine.instances[j]->memoryOffset + offset);
+    }
+
+    //==============================================================================
+    void allocateMemory()
+    {
+        auto& main = program.getMainProcessorOrThrowError();
+        uint32_t size = sizeof (uint64_t);
+
+        engine.globalOffset = align16 (size);
+        size = engine.globalOffset + globalSize;
+
+        for (auto& input : main.inputs)
+        {
+            TopInput t;
+            t.declaration = input.getPointer();
+
+            if (! input->isEventEndpoint())
+            {
+                auto type = input->getFrameOrValueType();
+                t.frameSize = static_cast<uint32_t> (type.getPackedSizeInBytes());
+                t.layout = ElementLayout::forType (type);
+                t.slotOffset = align16 (size);
+                size = t.slotOffset + t.frameSize;
+            }
+
+            for (auto& type : input->dataTypes)
+            {
+                t.types.push_back (type);
+                t.hasExternalLayout.push_back (hasExternalLayout (type));
+            }
+
+            engine.inputs.push_back (std::move (t));
+        }
+
+        for (auto& output : main.outputs)
+        {
+            TopOutput t;
+            t.declaration = output.getPointer();
+
+            if (! output->isEventEndpoint())
+            {
+                t.frameSize = static_cast<uint32_t> (output->getFrameOrValueType().getPackedSizeInBytes());
+                t.slotOffset = align16 (size);
+                size = t.slotOffset + t.frameSize;
+            }
+
+            for (auto& type : output->dataTypes)
+            {
+                t.types.push_back (type);
+                t.typeSizes.push_back (static_cast<uint32_t> (type.getPackedSizeInBytes()));
+                t.hasExternalLayout.push_back (hasExternalLayout (type));
+            }
+
+            engine.outputs.push_back (std::move (t));
+        }
+
+        for (auto& instance : engine.instances)
+        {
+            instance->memoryOffset = align16 (size);
+            size = instance->memoryOffset + instance->layout->size;
+        }
+
+        engine.memory.resize (size);
+    }
+
+    uint32_t allocateDelayLine (uint32_t sourceOffset, uint32_t length, uint32_t frameSize)
+    {
+        DelayLine d;
+        d.sourceOffset = sourceOffset;
+        d.length = length;
+        d.mask = getNextPowerOf2 (length) - 1;
+        d.frameSize = frameSize;
+        d.positionOffset = align16 (engine.memory.size());
+        d.bufferOffset = align16 (d.positionOffset + sizeof (uint32_t));
+        engine.memory.resize (d.bufferOffset + static_cast<size_t> (d.mask + 1) * frameSize);
+        engine.delayLines.push_back (d);
+        return static_cast<uint32_t> (engine.delayLines.size() - 1);
+    }
+
+    //==============================================================================
+    const heart::IODeclaration& getSourceDeclaration (const Port& p) const
+    {
+        if (p.instance != nullptr)
+            return p.instance->layout->module->outputs[p.endpoint];
+
+        return *engine.inputs[p.endpoint].declaration;
+    }
+
+    const heart::IODeclaration& getDestDeclaration (const Port& p) const
+    {
+        if (p.instance != nullptr)
+            return p.instance->layout->module->inputs[p.endpoint];
+
+        return *engine.outputs[p.endpoint].declaration;
+    }
+
+    uint32_t getSlotOffset (const Port& p, bool isSource) const
+    {
+        if (p.instance != nullptr)
+            return p.instance->memoryOffset + (isSource ? p.instance->layout->outputOffsets[p.endpoint]
+                                                        : p.instance->layout->inputOffsets[p.endpoint]);
+
+        return isSource ? engine.inputs[p.endpoint].slotOffset
+                        : engine.outputs[p.endpoint].slotOffset;
+    }
+
+    Port getPort (const FlattenedGraph::Endpoint& e) const
+    {
+        return { e.isProgramEndpoint() ? nullptr : engine.instances[e.instance].get(), e.endpoint, e.element };
+    }
+
+    void createRoutes (const FlattenedGraph& graph)
+    {
+        for (auto& c : graph.connections)
+        {
+            Edge e { getPort (c.source), getPort (c.dest), c.delayLength };
+
+            if (getSourceDeclaration (e.source).isEventEndpoint())
+                addEventSinks (e);
+            else
+                addRoute (e);
+        }
+    }
+
+    void addRoute (const Edge& e)
+    {
+        auto& sourceDeclaration = getSourceDeclaration (e.source);
+        auto& destDeclaration = getDestDeclaration (e.dest);
+
+        auto getSampleType = [] (const heart::IODeclaration& d, int32_t element)
+        {
+            return element >= 0 && d.arraySize.has_value() ? d.dataTypes.front() : d.getFrameOrValueType();
+        };
+
+        auto sourceElement = sourceDeclaration.arraySize.has_value() ? e.source.element : -1;
+        auto destElement = destDeclaration.arraySize.has_value() ? e.dest.element : -1;
+        auto sourceType = getSampleType (sourceDeclaration, sourceElement);
+        auto destType = getSampleType (destDeclaration, destElement);
+        auto size = static_cast<uint32_t> (destType.getPackedSizeInBytes());
+
+        if (sourceType.getPackedSizeInBytes() != size)
+            throwError (Errors::notYetImplemented ("connections between endpoints of different types"));
+
+        auto sourceOffset = getSlotOffset (e.source, true) + (sourceElement >= 0 ? static_cast<uint32_t> (sourceElement) * size : 0);
+        auto destOffset = getSlotOffset (e.dest, false) + (destElement >= 0 ? static_cast<uint32_t> (destElement) * size : 0);
+
+        Route::Source source { sourceOffset, -1 };
+
+        if (e.delay != 0 && sourceDeclaration.isStreamEndpoint())
+            source.delayLine = static_cast<int32_t> (allocateDelayLine (sourceOffset, e.delay, size));
+
+        auto& routes = e.dest.instance != nullptr ? e.dest.instance->inputRoutes : engine.outputRoutes;
+
+        for (auto& r : routes)
+        {
+            if (r.destOffset == destOffset)
+            {
+                r.sources.push_back (source);
+                return;
+            }
+        }
+
+        auto layout = ElementLayout::forType (destType);
+
+        Route r;
+        r.destOffset = destOffset;
+        r.size = size;
+        r.isStream = destDeclaration.isStreamEndpoint() && layout.isHomogeneous();
+        r.elementType = layout.type;
+        r.numElements = layout.numElements;
+        r.sources.push_back (source);
+        routes.push_back (std::move (r));
+    }
+
+    void addEventSinks (const Edge& e)
+    {
+        auto& sourceDeclaration = getSourceDeclaration (e.source);
+        auto& destDeclaration = getDestDeclaration (e.dest);
+        auto& sinks = e.source.instance != nullptr ? e.source.instance->eventSinks[e.source.endpoint][static_cast<size_t> (std::max (0, e.source.element))]
+                                                   : engine.inputs[e.source.endpoint].sinks;
+
+        EventSink sink;
+        sink.instance = e.dest.instance;
+        sink.endpoint = e.dest.endpoint;
+        sink.delay = e.delay;
+
+        for (auto& type : sourceDeclaration.dataTypes)
+        {
+            sink.dataSizes.push_back (static_cast<uint32_t> (type.getPackedSizeInBytes()));
+            auto destTypeIndex = findType (destDeclaration, type);
+
+            if (e.dest.instance != nullptr)
+                sink.handlers.push_back (destTypeIndex >= 0 ? findEventHandler (*e.dest.instance->layout,
+                                                                                static_cast<const heart::InputDeclaration&> (destDeclaration),
+                                                                                destDeclaration.dataTypes[static_cast<size_t> (destTypeIndex)])
+                                                            : nullptr);
+            else
+                sink.outputTypes.push_back (destTypeIndex);
+        }
+
+        if (e.dest.instance != nullptr && e.dest.element < 0 && destDeclaration.arraySize.has_value())
+        {
+            for (uint32_t i = 0; i < *destDeclaration.arraySize; ++i)
+            {
+                sink.element = i;
+                sinks.push_back (sink);
+            }
+
+            return;
+        }
+
+        sink.element = static_cast<uint32_t> (std::max (0, e.dest.element));
+        sinks.push_back (std::move (sink));
+    }
+
+    static int32_t findType (const heart::IODeclaration& d, const Type& type)
+    {
+        for (size_t i = 0; i < d.dataTypes.size(); ++i)
+            if (d.dataTypes[i].isEqual (type, Type::ignoreVectorSize1 | Type::ignoreConst | Type::ignoreReferences))
+                return static_cast<int32_t> (i);
+
+        return -1;
+    }
+
+    const CompiledFunction* findEventHandler (const ModuleLayout& layout, const heart::InputDeclaration& input, const Type& type)
+    {
+        for (auto& f : layout.module->functions)
+        {
+            if (! f->functionType.isEvent() || f->parameters.empty())
+                continue;
+
+            if (f->name.toString() != heart::getEventFunctionName (input.name.toString(), f->parameters.front()->type))
+                continue;
+
+            auto valueType = f->parameters.back()->type.removeConstIfPresent().removeReferenceIfPresent();
+
+            if (valueType.isEqual (type, Type::ignoreVectorSize1))
+                return std::addressof (getCompiledFunction (f));
+        }
+
+        return nullptr;
+    }
+
+    //==============================================================================
+    static bool mayContainUnsizedArrays (const Type& t)
+    {
+        if (t.isUnsizedArray())     return true;
+        if (t.isFixedSizeArray())   return mayContainUnsizedArrays (t.getArrayElementType());
+
+        if (t.isStruct())
+            for (auto& m : t.getStructRef().getMembers())
+                if (mayContainUnsizedArrays (m.type))
+                    return true;
+
+        return false;
+    }
+
+    /** Replaces the constant table handles in some packed data with pointers to UnsizedArray records. */
+    void resolveUnsizedArrays (const Type& type, uint8_t* data)
+    {
+        if (type.isUnsizedArray())
+        {
+            writeUnaligned (data, getUnsizedArray (readUnaligned<ConstantTable::Handle> (data)));
+        }
+        else if (type.isFixedSizeArray())
+        {
+            auto elementType = type.getArrayElementType();
+
+            if (mayContainUnsizedArrays (elementType))
+            {
+                auto elementSize = elementType.getPackedSizeInBytes();
+
+                for (size_t i = 0; i < type.getArraySize(); ++i)
+                    resolveUnsizedArrays (elementType, data + i * elementSize);
+            }
+        }
+        else if (type.isStruct())
+        {
+            for (auto& m : type.getStructRef().getMembers())
+            {
+                resolveUnsizedArrays (m.type, data);
+                data += m.type.getPackedSizeInBytes();
+            }
+        }
+    }
+
+    const UnsizedArray* getUnsizedArray (ConstantTable::Handle handle)
+    {
+        if (handle == 0)
+            return nullptr;
+
+        auto found = unsizedArrays.find (handle);
+
+        if (found != unsizedArrays.end())
+            return found->second;
+
+        auto value = program.getConstantTable().getValueForHandle (handle);
+
+        if (value == nullptr || ! value->getType().isFixedSizeArray())
+            return nullptr;
+
+        auto elementType = value->getType().getArrayElementType();
+        auto size = value->getPackedDataSize();
+        const uint8_t* data;
+
+        noteElementSize (elementType.getPackedSizeInBytes());
+
+        if (! mayContainUnsizedArrays (elementType) && size >= SharedConstantData::minimumSharedSize)
+        {
+            auto block = SharedConstantData::get (value->getPackedData(), size, value->getPackedDataOwner());
+            data = static_cast<const uint8_t*> (block->getData());
+            engine.code->sharedData.push_back (std::move (block));
+        }
+        else
+        {
+            engine.code->arrayData.push_back (std::make_unique<uint8_t[]> (std::max (size, static_cast<size_t> (1))));
+            (resolvingExternalData ? engine.code->externalArrayDataSize : engine.code->constantArrayDataSize) += size;
+            auto copy = engine.code->arrayData.back().get();
+            memcpy (copy, value->getPackedData(), size);
+            resolveUnsizedArrays (value->getType(), copy);
+            data = copy;
+        }
+
+        engine.code->unsizedArrays.push_back ({ data, static_cast<uint32_t> (value->getType().getArraySize()) });
+        auto result = std::addressof (engine.code->unsizedArrays.back());
+        unsizedArrays[handle] = result;
+        return result;
+    }
+
+    //==============================================================================
+    void writeInitialState()
+    {
+        auto base = engine.memory.data();
+
+        for (auto& e : externals)
+        {
+            auto& variable = *e.first;
+            auto name = program.getExternalVariableName (variable);
+            auto found = externalValues.find (name);
+
+            if (found == externalValues.end())
+                throwError (Errors::unresolvedExternal (name));
+
+            auto value = found->second;
+
+            if (! value.getType().isIdentical (variable.type))
+            {
+                value = value.tryCastToType (variable.type);
+
+                if (! value.isValid())
+                    throwError (Errors::cannotConvertExternalType (name, found->second.getType().getDescription()));
+            }
+
+            std::vector<uint8_t> data (static_cast<const uint8_t*> (value.getPackedData()),
+                                       static_cast<const uint8_t*> (value.getPackedData()) + value.getPackedDataSize());
+            resolvingExternalData = true;
+            resolveUnsizedArrays (variable.type, data.data());
+            resolvingExternalData = false;
+            auto offset = stateVariables[std::addressof (variable)].offset;
+
+            if (e.second == nullptr)
+            {
+                memcpy (base + engine.globalOffset + offset, data.data(), data.size());
+                continue;
+            }
+
+            for (auto& instance : engine.instances)
+                if (instance->layout == e.second)
+                    memcpy (base + instance->memoryOffset + offset, data.data(), data.size());
+        }
+
+        for (auto& instance : engine.instances)
+        {
+            auto& layout = *instance->layout;
+            auto state = base + instance->memoryOffset;
+            instance->state = state;
+            auto frequency = settings.sampleRate * std::pow (2.0, instance->rateShift);
+
+            writeUnaligned (state + layout.propertyOffsets[static_cast<size_t> (heart::ProcessorProperty::Property::frequency)], frequency);
+            writeUnaligned (state + layout.propertyOffsets[static_cast<size_t> (heart::ProcessorProperty::Property::period)], frequency > 0 ? 1.0 / frequency : 0.0);
+            writeUnaligned (state + layout.propertyOffsets[static_cast<size_t> (heart::ProcessorProperty::Property::id)], instance->id);
+            writeUnaligned (state + layout.propertyOffsets[static_cast<size_t> (heart::ProcessorProperty::Property::session)], settings.sessionID);
+        }
+    }
+};
+
+//==============================================================================
+void CodeGenerator::generate()
+{
+    auto& f = *result.function;
+
+    for (auto& p : f.parameters)
+    {
+        auto isReference = p->type.isReference();
+        auto size = isReference ? sizeof (void*) : p->type.getPackedSizeInBytes();
+        auto offset = allocateLocal (size);
+        result.parameterOffsets.push_back (offset);
+        result.parameterSizes.push_back (static_cast<uint32_t> (size));
+        variables[p.getPointer()] = isReference ? Operand::indirect (offset) : Operand::frame (offset);
+    }
+
+    for (auto& b : f.blocks)
+        for (auto& p : b->parameters)
+            addLocal (p);
+
+    f.visitExpressions ([this] (pool_ref<heart::Expression>& e, AccessType)
+    {
+        if (auto v = cast<heart::Variable> (e))
+            if (! v->isState())
+                addLocal (*v);
+    });
+
+    frameSize = localsSize;
+
+    for (size_t i = 0; i < f.blocks.size(); ++i)
+        blockIndexes[f.blocks[i].getPointer()] = i;
+
+    for (size_t i = 0; i < f.blocks.size(); ++i)
+    {
+        auto& block = f.blocks[i].get();
+        blockStarts.push_back (result.code.size());
+
+        for (auto s : block.statements)
+        {
+            resetTemps();
+            compileStatement (*s);
+        }
+
+        resetTemps();
+        const heart::Block* nextBlock = i + 1 < f.blocks.size() ? f.blocks[i + 1].getPointer() : nullptr;
+
+        if (block.terminator != nullptr)
+            compileTerminator (*block.terminator, nextBlock);
+        else
+            emit (returnVoid);
+    }
+
+    if (result.code.empty() || blockStarts.back() == result.code.size())
+        emit (returnVoid);
+
+    for (auto& fixup : fixups)
+        result.code[fixup.instruction].targets[fixup.target] = result.code.data() + blockStarts[fixup.block];
+
+    result.frameSize = align16 (std::max (frameSize, localsSize));
+    result.stackSize = result.frameSize + calleeStackSize;
+}
+
+void CodeGenerator::compileStatement (heart::Statement& s)
+{
+    if (auto a = cast<heart::AssignFromValue> (s))
+    {
+        auto dest = getLocation (*a->target);
+        compileInto (a->source, dest);
+    }
+    else if (auto fc = cast<heart::FunctionCall> (s))
+    {
+        std::optional<Operand> dest;
+
+        if (fc->target != nullptr)
+            dest = getLocation (*fc->target);
+
+        compileCall (fc->getFunction(), fc->arguments, dest);
+    }
+    else if (auto r = cast<heart::ReadStream> (s))
+    {
+        if (layout == nullptr)
+            throwError (Errors::notYetImplemented ("stream reads outside a processor"));
+
+        auto& module = *layout->module;
+        auto index = findIndex (module.inputs, r->source);
+        auto source = Operand { Operand::Base::state, layout->inputOffsets[index], 0 };
+        auto sourceType = r->source->getFrameOrValueType();
+        auto& targetType = r->target->getType();
+
+        if (needsConversion (sourceType, targetType))
+            compileConversion (getLocation (*r->target), targetType, source, sourceType);
+        else
+            emitCopy (getLocation (*r->target), source, sourceType.getPackedSizeInBytes());
+    }
+    else if (auto w = cast<heart::WriteStream> (s))
+    {
+        compileWriteStream (*w);
+    }
+    else if (is_type<heart::AdvanceClock> (s))
+    {
+        emit (advance);
+    }
+}
+
+void CodeGenerator::compileWriteStream (heart::WriteStream& w)
+{
+    if (layout == nullptr)
+        throwError (Errors::notYetImplemented ("endpoint writes outside a processor"));
+
+    auto& output = w.target.get();
+    auto outputIndex = findIndex (layout->module->outputs, output);
+
+    if (output.isEventEndpoint())
+    {
+        auto& valueType = w.value->getType();
+        auto typeIndex = static_cast<size_t> (0);
+
+        for (size_t i = 0; i < output.dataTypes.size(); ++i)
+        {
+            if (output.dataTypes[i].isEqual (valueType, Type::ignoreVectorSize1 | Type::ignoreConst | Type::ignoreReferences))
+            {
+                typeIndex = i;
+                break;
+            }
+
+            if (TypeRules::canSilentlyCastTo (output.dataTypes[i], valueType))
+                typeIndex = i;
+        }
+
+        auto value = getLocation (w.value, output.dataTypes[typeIndex]);
+
+        if (w.element != nullptr)
+        {
+            auto index = getLocation (*w.element);
+            auto& i = emit (w.element->getType().isInteger64() ? writeEventElement<int64_t> : writeEventElement<int32_t>);
+            i.a = value;
+            i.b = index;
+            i.size = outputIndex;
+            i.count = static_cast<uint32_t> (typeIndex);
+            return;
+        }
+
+        auto& i = emit (writeEvent);
+        i.a = value;
+        i.size = outputIndex;
+        i.count = static_cast<uint32_t> (typeIndex);
+        return;
+    }
+
+    auto dest = Operand { Operand::Base::state, layout->outputOffsets[outputIndex], 0 };
+    auto type = output.getFrameOrValueType();
+
+    if (w.element != nullptr)
+    {
+        type = output.dataTypes.front();
+        dest = getDynamicElement (dest, *w.element, output.arraySize.value_or (1), static_cast<uint32_t> (type.getPackedSizeInBytes()));
+    }
+
+    auto value = getLocation (w.value, type);
+    auto elements = ElementLayout::forType (type);
+
+    if (output.isStreamEndpoint())
+    {
+        if (auto handler = getAccumulateHandler (elements.type))
+        {
+            auto& i = emit (handler);
+            i.dest = dest;
+            i.a = value;
+            i.count = elements.numElements;
+            return;
+        }
+    }
+
+    emitCopy (dest, value, type.getPackedSizeInBytes());
+}
+
+void CodeGenerator::compileTerminator (heart::Terminator& t, const heart::Block* nextBlock)
+{
+    if (auto b = cast<heart::Branch> (t))
+    {
+        compileBlockArguments (b->target, b->targetArgs);
+
+        if (b->target.getPointer() != nextBlock)
+            emitJump (b->target, emit (jump), 0);
+    }
+    else if (auto bi = cast<heart::BranchIf> (t))
+    {
+        auto condition = getLocation (bi->condition, PrimitiveType::bool_);
+        auto& i = emit (branchIf);
+        i.a = condition;
+        emitJump (bi->targets[0], i, 0);
+        emitJump (bi->targets[1], result.code.back(), 1);
+    }
+    else if (auto r = cast<heart::ReturnValue> (t))
+    {
+        auto& returnType = result.function->returnType;
+        auto value = getLocation (r->returnValue, returnType);
+        auto& i = emit (returnValue);
+        i.a = value;
+        i.size = static_cast<uint32_t> (returnType.getPackedSizeInBytes());
+    }
+    else
+    {
+        emit (returnVoid);
+    }
+}
+
+void CodeGenerator::compileBlockArguments (heart::Block& target, ArrayView<pool_ref<heart::Expression>> args)
+{
+    if (args.empty())
+        return;
+
+    auto& params = target.parameters;
+
+    if (args.size() == 1)
+    {
+        auto& param = params.front().get();
+        auto value = getLocation (args.front(), param.type);
+        emitCopy (getVariableLocation (param), value, param.type.getPackedSizeInBytes());
+        return;
+    }
+
+    // The arguments may refer to the parameters that they replace, so they're all evaluated
+    // into temporaries before any parameters are written
+    std::vector<Operand> values;
+
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        auto& type = params[i]->type;
+        auto temp = allocateTemp (type);
+        compileInto (args[i], temp);
+
+        if (needsConversion (args[i]->getType(), type))
+        {
+            auto converted = allocateTemp (type);
+            compileConversion (converted, type, temp, args[i]->getType());
+            temp = converted;
+        }
+
+        values.push_back (temp);
+    }
+
+    for (size_t i = 0; i < args.size(); ++i)
+        emitCopy (getVariableLocation (params[i]), values[i], params[i]->type.getPackedSizeInBytes());
+}
+
+//==============================================================================
+Operand CodeGenerator::getLocation (heart::Expression& e)
+{
+    if (auto v = cast<heart::Variable> (e))
+        return getVariableLocation (*v);
+
+    if (auto a = cast<heart::ArrayElement> (e))
+        return getElementLocation (*a);
+
+    if (auto s = cast<heart::StructElement> (e))
+        return getLocation (s->parent).withOffset (getMemberOffset (s->parent->getType(), s->memberName));
+
+    if (auto c = cast<heart::Constant> (e))
+        return linker.addConstant (c->value);
+
+    if (auto p = cast<heart::ProcessorProperty> (e))
+        return getPropertyLocation (*p);
+
+    auto temp = allocateTemp (e.getType());
+    compileInto (e, temp);
+    return temp;
+}
+
+Operand CodeGenerator::getLocation (heart::Expression& e, const Type& requiredType)
+{
+    auto& type = e.getType();
+
+    if (! needsConversion (type, requiredType))
+        return getLocation (e);
+
+    if (auto c = cast<heart::Constant> (e))
+    {
+        auto value = c->value.tryCastToType (requiredType.removeReferenceIfPresent());
+
+        if (value.isValid())
+            return linker.addConstant (value);
+    }
+
+    auto source = getLocation (e);
+    auto temp = allocateTemp (requiredType);
+    compileConversion (temp, requiredType, source, type);
+    return temp;
+}
+
+Operand CodeGenerator::getVariableLocation (heart::Variable& v)
+{
+    if (v.isState())
+        return linker.getStateVariable (v);
+
+    auto found = variables.find (std::addressof (v));
+    SOUL_ASSERT (found != variables.end());
+    return found->second;
+}
+
+Operand CodeGenerator::getElementLocation (heart::ArrayElement& a)
+{
+    auto& parentType = a.parent->getType();
+    auto elementType = parentType.getElementType();
+    auto elementSize = static_cast<uint32_t> (elementType.getPackedSizeInBytes());
+    auto array = getLocation (a.parent);
+
+    if (parentType.isUnsizedArray())
+    {
+        linker.noteElementSize (elementSize);
+        auto index = a.dynamicIndex != nullptr ? getLocation (*a.dynamicIndex)
+                                               : linker.addConstant (Value::createInt32 (static_cast<int32_t> (a.fixedStartIndex)));
+        auto slot = allocateTemp (sizeof (void*));
+        auto is64Bit = a.dynamicIndex != nullptr && a.dynamicIndex->getType().isInteger64();
+        auto& i = emit (is64Bit ? unsizedElementAddress<int64_t> : unsizedElementAddress<int32_t>);
+        i.dest = slot;
+        i.a = array;
+        i.b = index;
+        i.size = elementSize;
+        return Operand::indirect (slot.offset);
+    }
+
+    if (a.dynamicIndex == nullptr)
+        return array.withOffset (a.fixedStartIndex * elementSize);
+
+    auto arraySize = static_cast<uint32_t> (parentType.isVector() ? parentType.getVectorSize() : parentType.getArraySize());
+    return getDynamicElement (array, *a.dynamicIndex, arraySize, elementSize);
+}
+
+Operand CodeGenerator::getDynamicElement (Operand array, heart::Expression& index, uint32_t arraySize, uint32_t elementSize)
+{
+    if (auto c = cast<heart::Constant> (index))
+    {
+        auto n = c->value.getAsInt64() % static_cast<int64_t> (arraySize);
+        return array.withOffset (static_cast<size_t> (n < 0 ? n + arraySize : n) * elementSize);
+    }
+
+    auto indexLocation = getLocation (index);
+    auto slot = allocateTemp (sizeof (void*));
+    auto& i = emit (index.getType().isInteger64() ? elementAddress<int64_t> : elementAddress<int32_t>);
+    i.dest = slot;
+    i.a = array;
+    i.b = indexLocation;
+    i.count = arraySize;
+    i.size = elementSize;
+    return Operand::indirect (slot.offset);
+}
+
+Operand CodeGenerator::getPropertyLocation (heart::ProcessorProperty& p)
+{
+    if (layout == nullptr)
+        throwError (Errors::notYetImplemented ("processor properties outside a processor"));
+
+    return { Operand::Base::state, layout->propertyOffsets[static_cast<size_t> (p.property)], 0 };
+}
+
+//==============================================================================
+void CodeGenerator::compileInto (heart::Expression& e, Operand dest)
+{
+    if (auto c = cast<heart::TypeCast> (e))
+        return compileCast (*c, dest);
+
+    if (auto u = cast<heart::UnaryOperator> (e))
+        return compileUnaryOp (*u, dest);
+
+    if (auto b = cast<heart::BinaryOperator> (e))
+        return compileBinaryOp (*b, dest);
+
+    if (auto p = cast<heart::PureFunctionCall> (e))
+        return compileCall (p->function, p->arguments, dest);
+
+    emitCopy (dest, getLocation (e), e.getType().getPackedSizeInBytes());
+}
+
+void CodeGenerator::compileCast (heart::TypeCast& cast, Operand dest)
+{
+    if (auto c = soul::cast<heart::Constant> (cast.source))
+    {
+        auto value = c->value.tryCastToType (cast.destType);
+
+        if (value.isValid())
+            return emitCopy (dest, linker.addConstant (value), cast.destType.getPackedSizeInBytes());
+    }
+
+    compileConversion (dest, cast.destType, getLocation (cast.source), cast.source->getType());
+}
+
+void CodeGenerator::compileConversion (Operand dest, const Type& destType, Operand source, const Type& sourceType)
+{
+    auto destSize = destType.getPackedSizeInBytes();
+    auto sourceLayout = ElementLayout::forType (sourceType);
+
+    if (destType.isBoundedInt())
+    {
+        if (sourceLayout.numElements == 1)
+        {
+            if (auto handler = destType.isWrapped() ? selectBoundedIntCast<true>  (sourceLayout.type)
+                                                    : selectBoundedIntCast<false> (sourceLayout.type))
+            {
+                auto& i = emit (handler);
+                i.dest = dest;
+                i.a = source;
+                i.count = static_cast<uint32_t> (destType.getBoundedIntLimit());
+                return;
+            }
+        }
+    }
+    else if (destType.isUnsizedArray())
+    {
+        if (sourceType.isUnsizedArray())
+            return emitCopy (dest, source, destSize);
+
+        if (sourceType.isFixedSizeArray())
+        {
+            auto record = allocateTemp (sizeof (UnsizedArray));
+            auto& i = emit (makeUnsizedArray);
+            i.dest = dest;
+            i.a = source;
+            i.b = record;
+            i.count = static_cast<uint32_t> (sourceType.getArraySize());
+            return;
+        }
+    }
+    else
+    {
+        auto destLayout = ElementLayout::forType (destType);
+
+        if (sourceLayout.isHomogeneous() && destLayout.isHomogeneous())
+        {
+            if (sourceLayout.numElements == destLayout.numElements)
+            {
+                if (sourceLayout.type == destLayout.type)
+                    return emitCopy (dest, source, destSize);
+
+                auto& i = emit (selectConversion<false> (sourceLayout.type, destLayout.type));
+                i.dest = dest;
+                i.a = source;
+                i.count = destLayout.numElements;
+                return;
+            }
+
+            if (sourceLayout.numElements == 1)
+            {
+                auto& i = emit (selectConversion<true> (sourceLayout.type, destLayout.type));
+                i.dest = dest;
+                i.a = source;
+                i.count = destLayout.numElements;
+                return;
+            }
+        }
+        else if (sourceType.getPackedSizeInBytes() == destSize)
+        {
+            return emitCopy (dest, source, destSize);
+        }
+    }
+
+    throwError (Errors::notYetImplemented ("casts from " + sourceType.getDescription() + " to " + destType.getDescription()));
+}
+
+void CodeGenerator::compileUnaryOp (heart::UnaryOperator& u, Operand dest)
+{
+    auto source = getLocation (u.source);
+    auto elements = ElementLayout::forType (u.source->getType());
+
+    if (auto handler = getUnaryOpHandler (u.operation, elements.type))
+    {
+        auto& i = emit (handler);
+        i.dest = dest;
+        i.a = source;
+        i.count = elements.numElements;
+        return;
+    }
+
+    throwError (Errors::notYetImplemented ("unary operators on " + u.source->getType().getDescription()));
+}
+
+void CodeGenerator::compileBinaryOp (heart::BinaryOperator& b, Operand dest)
+{
+    auto types = BinaryOp::getTypes (b.operation, b.lhs->getType(), b.rhs->getType());
+    auto lhs = getLocation (b.lhs, types.operandType);
+    auto rhs = getLocation (b.rhs, types.operandType);
+    auto operands = ElementLayout::forType (types.operandType);
+    auto results = ElementLayout::forType (types.resultType);
+
+    if (operands.isHomogeneous() && operands.numElements == results.numElements)
+    {
+        if (auto handler = getBinaryOpHandler (b.operation, operands.type))
+        {
+            auto& i = emit (handler);
+            i.dest = dest;
+            i.a = lhs;
+            i.b = rhs;
+            i.count = operands.numElements;
+            return;
+        }
+    }
+
+    if (b.operation == BinaryOp::Op::equals || b.operation == BinaryOp::Op::notEquals)
+    {
+        auto& i = emit (b.operation == BinaryOp::Op::equals ? compareBytes<true> : compareBytes<false>);
+        i.dest = dest;
+        i.a = lhs;
+        i.b = rhs;
+        i.size = static_cast<uint32_t> (types.operandType.getPackedSizeInBytes());
+        return;
+    }
+
+    throwError (Errors::notYetImplemented ("binary operators on " + types.operandType.getDescription()));
+}
+
+//==============================================================================
+template <typename ArgList>
+void CodeGenerator::compileCall (heart::Function& fn, const ArgList& args, std::optional<Operand> dest)
+{
+    if (fn.intrinsicType != IntrinsicType::none && compileIntrinsic (fn, args, dest))
+        return;
+
+    if (fn.hasNoBody || fn.blocks.empty() || needsNativeImplementation (fn.intrinsicType))
+        throwError (Errors::notYetImplemented ("calls to " + fn.getReadableName()));
+
+    auto& callee = linker.getCompiledFunction (fn);
+    auto& info = linker.createCallInfo();
+    info.function = std::addressof (callee);
+
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        auto& param = fn.parameters[i].get();
+        auto& arg = args[i].get();
+
+        if (param.type.isReference())
+            info.arguments.push_back ({ getLocation (arg), callee.parameterOffsets[i], static_cast<uint32_t> (sizeof (void*)), true });
+        else
+            info.arguments.push_back ({ getLocation (arg, param.type), callee.parameterOffsets[i], callee.parameterSizes[i], false });
+    }
+
+    auto& i = emit (call);
+    i.data = std::addressof (info);
+    i.count = dest.has_value() ? 1 : 0;
+
+    if (dest.has_value())
+        i.dest = *dest;
+
+    calleeStackSize = std::max (calleeStackSize, callee.stackSize);
+}
+
+template <typename ArgList>
+bool CodeGenerator::compileIntrinsic (heart::Function& fn, const ArgList& args, std::optional<Operand> dest)
+{
+    if (fn.intrinsicType == IntrinsicType::get_array_size)
+    {
+        if (! dest.has_value() || args.size() != 1)
+            return true;
+
+        auto& arrayType = args.front()->getType();
+
+        if (arrayType.isFixedSizeArray() || arrayType.isVector())
+        {
+            auto size = static_cast<int32_t> (arrayType.isVector() ? arrayType.getVectorSize() : arrayType.getArraySize());
+            emitCopy (*dest, linker.addConstant (Value::createInt32 (size)), sizeof (int32_t));
+            return true;
+        }
+
+        auto array = getLocation (args.front());
+        auto& i = emit (getUnsizedArraySize);
+        i.dest = *dest;
+        i.a = array;
+        return true;
+    }
+
+    if (args.empty() || args.size() > 3 || args.size() != fn.parameters.size())
+        return false;
+
+    auto argType = fn.parameters.front()->type.removeConstIfPresent().removeReferenceIfPresent();
+    auto elements = ElementLayout::forType (argType);
+
+    if (! (argType.isPrimitive() || argType.isVector()) || ! elements.isHomogeneous())
+        return false;
+
+    for (auto& p : fn.parameters)
+        if (ElementLayout::forType (p->type) != elements || p->type.isBoundedInt())
+            return false;
+
+    auto native = getNativeIntrinsic (fn.intrinsicType, elements.type, args.size(), argType.isPrimitive());
+
+    if (native.first == nullptr || ElementLayout::forType (fn.returnType) != ElementLayout { native.second, elements.numElements })
+        return false;
+
+    Operand operands[3];
+
+    for (size_t i = 0; i < args.size(); ++i)
+        operands[i] = getLocation (args[i], fn.parameters[i]->type);
+
+    auto& i = emit (native.first);
+    i.dest = dest.has_value() ? *dest : allocateTemp (fn.returnType);
+    i.a = operands[0];
+    i.b = operands[1];
+    i.c = operands[2];
+    i.count = elements.numElements;
+    return true;
+}
+
+//==============================================================================
+/** A linked program that an InterpreterPerformer can hand to others, holding an engine with
+    the shared code and routing, which each of them copies before giving it its own state.
+*/
+struct LinkedProgram  : public Performer::LinkedProgram
+{
+    std::unique_ptr<Engine> engine;
+    std::vector<EndpointDetails> inputs, outputs;
+    std::vector<ExternalVariable> externals;
+    std::vector<bool> activeEndpoints;
+    uint32_t blockSize = 0;
+};
+
+//==============================================================================
+struct InterpreterPerformer  : public Performer
+{
+    InterpreterPerformer() = default;
+    ~InterpreterPerformer() override    { unload(); }
+
+    bool load (CompileMessageList& messageList, const Program& programToLoad) noexcept override
+    {
+        unload();
+
+        try
+        {
+            CompileMessageHandler handler (messageList);
+            program = programToLoad.clone();
+            auto& main = program.getMainProcessorOrThrowError();
+
+            for (auto& i : main.inputs)
+                inputs.push_back (i->getDetails());
+
+            for (auto& o : main.outputs)
+                outputs.push_back (o->getDetails());
+
+            for (auto& v : program.getExternalVariables())
+                externals.push_back ({ program.getExternalVariableName (v), v->type.getExternalType(), v->annotation.toExternalValue() });
+
+            endpointIndex.build (inputs, outputs);
+            activeEndpoints.resize (inputs.size() + outputs.size());
+            loaded = true;
+            return true;
+        }
+        catch (AbortCompilationException) {}
+
+        unload();
+        return false;
+    }
+
+    void unload() noexcept override
+    {
+        engine.reset();
+        linkedProgram.reset();
+        program = {};
+        inputs.clear();
+        outputs.clear();
+        endpointIndex.clear();
+        externals.clear();
+        externalValues.clear();
+        activeEndpoints.clear();
+        memoryUsage = {};
+        loaded = false;
+        linked = false;
+    }
+
+    ArrayView<const EndpointDetails> getInputEndpoints() noexcept override         { return inputs; }
+    ArrayView<const EndpointDetails> getOutputEndpoints() noexcept override        { return outputs; }
+    ArrayView<const ExternalVariable> getExternalVariables() noexcept override     { return externals; }
+
+    bool setExternalVariable (const char* name, const choc::value::ValueView& value) noexcept override
+    {
+        return setExternalVariable (name, value, {});
+    }
+
+    bool setExternalVariable (const char* name, const choc::value::ValueView& value,
+                              std::shared_ptr<const void> dataOwner) noexcept override
+    {
+        if (! loaded || linked)
+            return false;
+
+        for (auto& v : program.getExternalVariables())
+        {
+            if (program.getExternalVariableName (v) == name)
+            {
+                CompileMessageList messageList;
+
+                try
+                {
+                    CompileMessageHandler handler (messageList);
+                    externalValues[name] = Value::fromExternalValue (v->type, value, program.getConstantTable(),
+                                                                     program.getStringDictionary(), std::move (dataOwner));
+                    return true;
+                }
+                catch (AbortCompilationException) {}
+
+                return false;
+            }
+        }
+
+        return false;
+    }
+
+    bool link (CompileMessageList& messageList, const BuildSettings& settings, LinkerCache*) noexcept override
+    {
+        if (! loaded || linked)
+            return false;
+
+        try
+        {
+            CompileMessageHandler handler (messageList);
+            engine = std::make_unique<interpreter::Engine>();
+            engine->code->program = program;
+            interpreter::Linker (program, *engine, settings, externalValues, getConnectedOutputs(), buildMonitor.get()).link();
+            blockSize = settings.maxBlockSize != 0 ? settings.maxBlockSize : 1024;
+            allocateBuffers();
+            runInitFunctions();
+            memoryUsage = engine->getMemoryUsage (false);
+            memoryUsage.programSize = program.getMemoryUsage().getTotal();
+            linked = true;
+            return true;
+        }
+        catch (AbortCompilationException) {}
+
+        engine.reset();
+        return false;
+    }
+
+    std::shared_ptr<const LinkedProgram> getLinkedProgram() noexcept override
+    {
+        if (! linked)
+            return {};
+
+        if (linkedProgram == nullptr)
+        {
+            auto p = std::make_shared<interpreter::LinkedProgram>();
+            p->engine = engine->createCopy();
+            p->inputs = inputs;
+            p->outputs = outputs;
+            p->externals = externals;
+            p->activeEndpoints = activeEndpoints;
+            p->blockSize = blockSize;
+            linkedProgram = std::move (p);
+        }
+
+        return linkedProgram;
+    }
+
+    bool loadLinkedProgram (CompileMessageList&, std::shared_ptr<const LinkedProgram> programToLoad) noexcept override
+    {
+        auto source = std::dynamic_pointer_cast<const interpreter::LinkedProgram> (programToLoad);
+
+        if (source == nullptr)
+            return false;
+
+        unload();
+        engine = source->engine->createCopy();
+        engine->createState();
+        program = engine->code->program;
+        inputs = source->inputs;
+        outputs = source->outputs;
+        externals = source->externals;
+        activeEndpoints = source->activeEndpoints;
+        blockSize = source->blockSize;
+        endpointIndex.build (inputs, outputs);
+        allocateBuffers();
+        memoryUsage = engine->getMemoryUsage (true);
+        memoryUsage.sharedDataSize += program.getMemoryUsage().getTotal();
+        linkedProgram = std::move (source);
+        loaded = true;
+        linked = true;
+        return true;
+    }
+
+    /** If the caller has asked for handles to some of the outputs before linking, then any
+        processors which can only affect the other outputs can be left out. If it hasn't asked
+        for any, it may be planning to do so after linking, so everything has to be kept.
+    */
+    std::vector<bool> getConnectedOutputs() const
+    {
+        std::vector<bool> connected (activeEndpoints.begin() + static_cast<std::ptrdiff_t> (inputs.size()), activeEndpoints.end());
+
+        if (std::find (connected.begin(), connected.end(), true) == connected.end())
+            return {};
+
+        return connected;
+    }
+
+    bool isLoaded() noexcept override      { return loaded; }
+    bool isLinked() noexcept override      { return linked; }
+
+    void reset() noexcept override
+    {
+        if (linked)
+            engine->reset();
+    }
+
+    EndpointHandle getEndpointHandle (const EndpointID& endpointID) noexcept override
+    {
+        if (auto input = endpointIndex.findInput (endpointID))
+            return activateEndpoint (*input);
+
+        if (auto output = endpointIndex.findOutput (endpointID))
+            return activateEndpoint (inputs.size() + *output);
+
+        return {};
+    }
+
+    std::vector<EndpointHandle> getEndpointHandles (ArrayView<const EndpointDetails> endpoints) noexcept override
+    {
+        std::vector<EndpointHandle> handles;
+        handles.reserve (endpoints.size());
+
+        // A part of our own lists can be mapped straight to its handles, without looking up any IDs
+        auto findPositionInList = [&] (const std::vector<EndpointDetails>& list) -> std::optional<size_t>
+        {
+            if (! endpoints.empty() && endpoints.begin() >= list.data() && endpoints.end() <= list.data() + list.size())
+                return static_cast<size_t> (endpoints.begin() - list.data());
+
+            return {};
+        };
+
+        if (auto inputStart = findPositionInList (inputs))
+        {
+            for (size_t i = 0; i < endpoints.size(); ++i)
+                handles.push_back (activateEndpoint (*inputStart + i));
+        }
+        else if (auto outputStart = findPositionInList (outputs))
+        {
+            for (size_t i = 0; i < endpoints.size(); ++i)
+                handles.push_back (activateEndpoint (inputs.size() + *outputStart + i));
+        }
+        else
+        {
+            for (auto& e : endpoints)
+                handles.push_back (getEndpointHandle (e.endpointID));
+        }
+
+        return handles;
+    }
+
+    /** Marks an endpoint as used, given its position in the inputs followed by the outputs, and returns its handle. */
+    EndpointHandle activateEndpoint (size_t position)
+    {
+        activeEndpoints[position] = true;
+        return EndpointHandle::create ((uint32_t) (position + 1));
+    }
+
+    void prepare (uint32_t numFramesToBeRendered) noexcept override
+    {
+        SOUL_ASSERT (linked && numFramesToBeRendered <= blockSize);
+        numFramesPrepared = numFramesToBeRendered;
+
+        for (auto& input : engine->inputs)
+            input.hasFrames = false;
+
+        for (auto& output : engine->outputs)
+        {
+            output.events.clear();
+            output.eventData.clear();
+        }
+    }
+
+    void setNextInputStreamFrames (EndpointHandle handle, const choc::value::ValueView& frameArray) noexcept override
+    {
+        if (auto input = getInput (handle))
+        {
+            auto size = std::min (input->frames.size(), static_cast<size_t> (frameArray.getType().getValueDataSize()));
+            memcpy (input->frames.data(), frameArray.getRawData(), size);
+            input->hasFrames = true;
+            input->isSparse = false;
+        }
+    }
+
+    bool setNextInputStreamChannels (EndpointHandle handle, choc::buffer::ChannelArrayView<const float> channels) noexcept override
+    {
+        if (auto input = getInput (handle))
+        {
+            auto numChannels = channels.getNumChannels();
+            auto numFrames = channels.getNumFrames();
+
+            if (input->layout.type != ElementType::float32 || input->layout.numElements != numChannels
+                 || input->frameSize != numChannels * sizeof (float)
+                 || numFrames != numFramesPrepared || input->frames.size() < numFrames * input->frameSize)
+                return false;
+
+            // The engine reads frames from its own buffer, so the channels are interleaved
+            // straight into that, rather than into a frame array which would then be copied again
+            interleaveChannels (choc::buffer::createInterleavedView (reinterpret_cast<float*> (input->frames.data()),
+                                                                     numChannels, numFrames), channels);
+            input->hasFrames = true;
+            input->isSparse = false;
+            return true;
+        }
+
+        return false;
+    }
+
+    void setSparseInputStreamTarget (EndpointHandle handle, const choc::value::ValueView& targetFrameValue,
+                                     uint32_t numFramesToReachValue, float) noexcept override
+    {
+        if (auto input = getInput (handle))
+        {
+            if (input->frameSize == 0 || targetFrameValue.getType().getValueDataSize() != input->frameSize)
+                return;
+
+            auto slot = engine->memory.data() + input->slotOffset;
+            memcpy (input->sparseTarget.data(), targetFrameValue.getRawData(), input->frameSize);
+            input->isSparse = true;
+
+            if (numFramesToReachValue == 0 || ! input->layout.isHomogeneous())
+            {
+                memcpy (slot, input->sparseTarget.data(), input->frameSize);
+                input->numRampFrames = 0;
+                return;
+            }
+
+            auto elementSize = input->frameSize / input->layout.numElements;
+
+            for (uint32_t i = 0; i < input->layout.numElements; ++i)
+            {
+                auto current = interpreter::readElement (input->layout.type, slot + i * elementSize);
+                auto target = interpreter::readElement (input->layout.type, input->sparseTarget.data() + i * elementSize);
+                input->rampIncrements[i] = (target - current) / numFramesToReachValue;
+            }
+
+            input->numRampFrames = numFramesToReachValue + 1;
+        }
+    }
+
+    void setInputValue (EndpointHandle handle, const choc::value::ValueView& newValue) noexcept override
+    {
+        if (auto input = getInput (handle))
+        {
+            if (input->value.empty() || newValue.getType().getValueDataSize() != input->value.size())
+                return;
+
+            memcpy (input->value.data(), newValue.getRawData(), input->value.size());
+            memcpy (engine->memory.data() + input->slotOffset, input->value.data(), input->value.size());
+        }
+    }
+
+    void addInputEvent (EndpointHandle handle, const choc::value::ValueView& eventData) noexcept override
+    {
+        auto index = getInputIndex (handle);
+
+        if (index < 0)
+            return;
+
+        auto& input = engine->inputs[static_cast<size_t> (index)];
+
+        for (uint32_t i = 0; i < input.types.size(); ++i)
+        {
+            auto& type = input.types[i];
+            auto size = type.getPackedSizeInBytes();
+
+            if (! (input.hasExternalLayout[i] && eventData.getType().getValueDataSize() == size
+                    && eventData.getType() == inputs[static_cast<size_t> (index)].dataTypes[i]))
+                continue;
+
+            queueInputEvent (static_cast<uint32_t> (index), i, eventData.getRawData(), size);
+            return;
+        }
+
+        // Events with strings or a different layout need converting, which may allocate
+        for (uint32_t i = 0; i < input.types.size(); ++i)
+        {
+            CompileMessageList messageList;
+
+            try
+            {
+                CompileMessageHandler handler (messageList);
+                std::lock_guard<std::mutex> l (engine->code->programLock);
+                auto value = Value::fromExternalValue (input.types[i], eventData, program.getConstantTable(), program.getStringDictionary());
+                queueInputEvent (static_cast<uint32_t> (index), i, value.getPackedData(), value.getPackedDataSize());
+                return;
+            }
+            catch (AbortCompilationException) {}
+        }
+    }
+
+    using Performer::addInputEvents;
+
+    void addInputEvents (EndpointHandle handle, const choc::value::Type& eventType,
+                         const void* packedEventData, uint32_t numEvents) noexcept override
+    {
+        auto index = getInputIndex (handle);
+
+        if (index < 0 || numEvents == 0)
+            return;
+
+        auto& input = engine->inputs[static_cast<size_t> (index)];
+        auto size = eventType.getValueDataSize();
+
+        for (uint32_t i = 0; i < input.types.size(); ++i)
+        {
+            if (input.hasExternalLayout[i] && input.types[i].getPackedSizeInBytes() == size
+                 && eventType == inputs[static_cast<size_t> (index)].dataTypes[i])
+            {
+                auto data = static_cast<const char*> (packedEventData);
+
+                for (uint32_t j = 0; j < numEvents; ++j)
+                    queueInputEvent (static_cast<uint32_t> (index), i, data + j * size, size);
+
+                return;
+            }
+        }
+
+        Performer::addInputEvents (handle, eventType, packedEventData, numEvents);
+    }
+
+    choc::value::ValueView getOutputStreamFrames (EndpointHandle handle) noexcept override
+    {
+        if (auto output = getOutput (handle))
+            if (! output->frames.empty())
+                return choc::value::ValueView (choc::value::Type::createArray (outputs[static_cast<size_t> (getOutputIndex (handle))].getFrameType(),
+                                                                               numFramesPrepared),
+                                               output->frames.data(), nullptr);
+
+        return {};
+    }
+
+    choc::value::ValueView getOutputValue (EndpointHandle handle) noexcept override
+    {
+        if (auto output = getOutput (handle))
+            return output->valueView;
+
+        return {};
+    }
+
+    void iterateOutputEvents (EndpointHandle handle, HandleNextOutputEventFn fn) noexcept override
+    {
+        iterateOutputEvents (handle, [] (void* context, uint32_t frameOffset, const choc::value::ValueView& event) -> bool
+                                     {
+                                         return (*static_cast<std::function<bool(uint32_t, const choc::value::ValueView&)>*> (context)) (frameOffset, event);
+                                     },
+                             std::addressof (fn));
+    }
+
+    void iterateOutputEvents (EndpointHandle handle, OutputEventCallback callback, void* context) noexcept override
+    {
+        auto output = getOutput (handle);
+
+        if (output == nullptr)
+            return;
+
+        for (auto& e : output->events)
+        {
+            auto data = output->eventData.data() + e.dataOffset;
+
+            if (output->hasExternalLayout[e.typeIndex])
+            {
+                auto& view = output->eventViews[e.typeIndex];
+                memcpy (output->scratch.data(), data, output->typeSizes[e.typeIndex]);
+
+                if (! callback (context, e.frame, view))
+                    return;
+
+                continue;
+            }
+
+            choc::value::Value value;
+
+            {
+                std::lock_guard<std::mutex> l (engine->code->programLock);
+                value = Value::createFromRawData (output->types[e.typeIndex], data, output->typeSizes[e.typeIndex])
+                          .toExternalValue (program.getConstantTable(), program.getStringDictionary());
+            }
+
+            if (! callback (context, e.frame, value))
+                return;
+        }
+    }
+
+    void advance() noexcept override
+    {
+        SOUL_ASSERT (linked);
+
+        for (size_t i = 0; i < engine->inputs.size(); ++i)
+        {
+            auto& input = engine->inputs[i];
+
+            if (input.declaration->isStreamEndpoint() && ! (input.hasFrames || input.isSparse) && activeEndpoints[i])
+                ++engine->numXRuns;
+        }
+
+        engine->render (numFramesPrepared);
+    }
+
+    bool isEndpointActive (const EndpointID& endpointID) noexcept override
+    {
+        if (auto input = endpointIndex.findInput (endpointID))
+            return activeEndpoints[*input];
+
+        if (auto output = endpointIndex.findOutput (endpointID))
+            return activeEndpoints[inputs.size() + *output];
+
+        return false;
+    }
+
+    void setBuildMonitor (std::shared_ptr<BuildMonitor> m) noexcept override  { buildMonitor = std::move (m); }
+
+    uint32_t getXRuns() noexcept override           { return linked ? engine->numXRuns : 0; }
+    uint32_t getBlockSize() noexcept override       { return blockSize; }
+
+    uint64_t getStateSize() noexcept override       { return linked ? engine->memory.size() : 0; }
+
+    bool saveState (void* dest, uint64_t size) noexcept override
+    {
+        if (! linked || size != engine->memory.size())
+            return false;
+
+        memcpy (dest, engine->memory.data(), engine->memory.size());
+        return true;
+    }
+
+    bool restoreState (const void* data, uint64_t size) noexcept override
+    {
+        if (! linked || size != engine->memory.size())
+            return false;
+
+        memcpy (engine->memory.data(), data, engine->memory.size());
+        engine->restoreInputValues();
+        engine->pendingEvents.clear();
+        engine->pendingEventData.clear();
+        return true;
+    }
+
+    std::vector<StateVariableDetails> getStateVariables() noexcept override
+    {
+        if (! linked)
+            return {};
+
+        return engine->code->stateVariables;
+    }
+
+    MemoryUsage getMemoryUsage() noexcept override  { return memoryUsage; }
+
+    bool hasError() noexcept override               { return linked && engine->stackOverflowed; }
+    const char* getError() noexcept override        { return hasError() ? "Stack overflow" : nullptr; }
+
+private:
+    Program program;
+    std::unique_ptr<interpreter::Engine> engine;
+    std::shared_ptr<const interpreter::LinkedProgram> linkedProgram;
+    std::vector<EndpointDetails> inputs, outputs;
+    EndpointIndex endpointIndex;
+    std::vector<ExternalVariable> externals;
+    std::unordered_map<std::string, Value> externalValues;
+    std::vector<bool> activeEndpoints;
+    std::shared_ptr<BuildMonitor> buildMonitor;
+    MemoryUsage memoryUsage;
+    uint32_t blockSize = 0, numFramesPrepared = 0;
+    bool loaded = false, linked = false;
+
+    //==============================================================================
+    void allocateBuffers()
+    {
+        auto& e = *engine;
+        uint32_t requiredStack = 0;
+
+        for (auto& f : e.code->functions)
+        {
+            auto& compiled = *f.second;
+            auto isRun = compiled.function->functionType.isRun();
+            requiredStack = std::max (requiredStack, isRun ? compiled.stackSize - compiled.frameSize : compiled.stackSize);
+        }
+
+        // A chain of events can call a handler in each instance before returning, so the stack has
+        // room for that, but callEventHandler() also checks for overflows
+        auto stackSize = std::min (static_cast<size_t> (requiredStack) * (e.instances.size() + 1) + 4096,
+                                   static_cast<size_t> (16 * 1024 * 1024));
+        e.stack.resize (std::max (stackSize, static_cast<size_t> (requiredStack) + 4096));
+        e.stackEnd = e.stack.data() + e.stack.size();
+        e.emptyElement.resize (std::max (e.emptyElement.size(), static_cast<size_t> (16)));
+
+        e.pendingEvents.reserve (interpreter::Engine::eventQueueSize);
+        e.pendingEventData.reserve (interpreter::Engine::eventDataSize);
+        e.inputEvents.reserve (interpreter::Engine::eventQueueSize);
+        e.inputEventData.reserve (interpreter::Engine::eventDataSize);
+
+        for (auto& input : e.inputs)
+        {
+            if (input.declaration->isStreamEndpoint())
+            {
+                input.frames.resize (static_cast<size_t> (input.frameSize) * blockSize);
+                input.sparseTarget.resize (input.frameSize);
+                input.rampIncrements.resize (input.layout.numElements);
+            }
+            else if (input.declaration->isValueEndpoint())
+            {
+                input.value.resize (input.frameSize);
+            }
+        }
+
+        for (size_t i = 0; i < e.outputs.size(); ++i)
+        {
+            auto& output = e.outputs[i];
+
+            if (output.declaration->isStreamEndpoint())
+            {
+                output.frames.resize (static_cast<size_t> (output.frameSize) * blockSize);
+            }
+            else if (output.declaration->isValueEndpoint())
+            {
+                output.valueView = choc::value::ValueView (outputs[i].getValueType(), e.memory.data() + output.slotOffset, nullptr);
+            }
+            else
+            {
+                size_t maxSize = 0;
+
+                for (auto size : output.typeSizes)
+                    maxSize = std::max (maxSize, static_cast<size_t> (size));
+
+                output.scratch.resize (std::max (maxSize, static_cast<size_t> (1)));
+                output.events.reserve (interpreter::Engine::eventQueueSize);
+                output.eventData.reserve (interpreter::Engine::eventDataSize);
+
+                for (auto& type : outputs[i].dataTypes)
+                    output.eventViews.push_back (choc::value::ValueView (type, output.scratch.data(), nullptr));
+            }
+        }
+    }
+
+    /** Runs each instance's init function, and keeps the result for reset(). */
+    void runInitFunctions()
+    {
+        auto& e = *engine;
+
+        for (auto& instance : e.instances)
+            if (auto init = instance->layout->initFunction)
+                e.callFunction (*init, instance.get(), e.stack.data());
+
+        e.code->initialMemory = e.memory;
+    }
+
+    int getInputIndex (EndpointHandle handle) const
+    {
+        auto index = static_cast<int> (handle.getRawHandle()) - 1;
+        return index >= 0 && index < static_cast<int> (inputs.size()) ? index : -1;
+    }
+
+    int getOutputIndex (EndpointHandle handle) const
+    {
+        auto index = static_cast<int> (handle.getRawHandle()) - 1 - static_cast<int> (inputs.size());
+        return index >= 0 && index < static_cast<int> (outputs.size()) ? index : -1;
+    }
+
+    interpreter::TopInput* getInput (EndpointHandle handle)
+    {
+        auto index = getInputIndex (handle);
+        return linked && index >= 0 ? std::addressof (engine->inputs[static_cast<size_t> (index)]) : nullptr;
+    }
+
+    interpreter::TopOutput* getOutput (EndpointHandle handle)
+    {
+        auto index = getOutputIndex (handle);
+        return linked && index >= 0 ? std::addressof (engine->outputs[static_cast<size_t> (index)]) : nullptr;
+    }
+
+    void queueInputEvent (uint32_t input, uint32_t typeIndex, const void* data, size_t size)
+    {
+        auto& e = *engine;
+
+        if (e.inputEvents.size() == e.inputEvents.capacity() || e.inputEventData.size() + size > e.inputEventData.capacity())
+        {
+            ++e.numXRuns;
+            return;
+        }
+
+        e.inputEvents.push_back ({ input, typeIndex, static_cast<uint32_t> (e.inputEventData.size()) });
+        auto bytes = static_cast<const uint8_t*> (data);
+        e.inputEventData.insert (e.inputEventData.end(), bytes, bytes + size);
+    }
+};
+
+//==============================================================================
+struct InterpreterPerformerFactory  : public PerformerFactory
+{
+    std::unique_ptr<Performer> createPerformer() override
+    {
+        return std::make_unique<InterpreterPerformer>();
+    }
+};
+
+} // namespace interpreter
+
+std::unique_ptr<PerformerFactory> createInterpreterPerformerFactory()
+{
+    return std::make_unique<interpreter::InterpreterPerformerFactory>();
+}
+
+} // namespace soul
@@ -23,6 +23,58 @@ namespace soul
 
 class LinkerCache;
 
+//==============================================================================
+/** Timing figures for one of the nodes which a performer renders.
+    @see Performer::getNodeTimings()
+*/
+struct NodeTiming
+{
+    std::string name;               ///< The processor instance, or group of instances, that this describes
+    uint64_t numBlocks = 0;         ///< The number of blocks that have been timed
+    uint64_t totalNanoseconds = 0;  ///< The total time spent rendering the node in those blocks
+    uint64_t maxNanoseconds = 0;    ///< The longest time spent rendering the node in a single block
+};
+
+//==============================================================================
+/** Describes where one of a program's state variables lives in the data from Performer::saveState().
+    @see Performer::getStateVariables()
+*/
+struct StateVariableDetails
+{
+    std::string name;       ///< A name which identifies the variable and the processor instance it belongs to
+    std::string type;       ///< A description of the variable's type
+    uint64_t offset = 0;    ///< The position of the variable's data in the saved state
+    uint64_t size = 0;      ///< The number of bytes that the variable occupies
+};
+
+//==============================================================================
+/** Lets the caller of a performer's load() and link() follow their progress, and
+    abandon them part-way through.
+    @see Performer::setBuildMonitor()
+*/
+struct BuildMonitor
+{
+    /** If set, the performer calls this on the thread that is doing the build, with a
+        number between 0 and 1 to say how much of the work has been done.
+    */
+    std::function<void (float progress)> progressCallback;
+
+    /** Asks for the build to be abandoned. This can be called from any thread: the
+        performer will stop at the next point where it's safe to do so, and load() or
+        link() will fail with a "build cancelled" error.
+    */
+    void cancel() noexcept                          { cancelled = true; }
+
+    /** Returns true if cancel() has been called. */
+    bool isCancelled() const noexcept               { return cancelled; }
+
+    /** Called by performers to pass on their progress to the callback, if there is one. */
+    void reportProgress (float progress) const      { if (progressCallback != nullptr) progressCallback (progress); }
+
+private:
+    std::atomic<bool> cancelled { false };
+};
+
 //==============================================================================
 /**
     Abstract base class for a "performer" which can compile and execute a soul::Program.
@@ -73,9 +125,25 @@ public:
     */
     virtual ArrayView<const ExternalVariable> getExternalVariables() noexcept = 0;
 
-    /** Set the value of an external in the loaded program. */
+    /** Set the value of an external in the loaded program.
+        Implementations should place any large tables in the SharedConstantData store (see
+        Value::convertAllHandlesToSharedPointers()), so that instances which are given the same
+        data don't each keep their own copy of it.
+    */
     virtual bool setExternalVariable (const char* name, const choc::value::ValueView& value) noexcept = 0;
 
+    /** Sets the value of an external, where the caller also supplies an object which owns the
+        value's memory. This lets the performer keep a reference to the owner and use large
+        arrays in place, rather than copying them, so the data mustn't be modified while the
+        owner exists. The default implementation just calls setExternalVariable (name, value).
+    */
+    virtual bool setExternalVariable (const char* name, const choc::value::ValueView& value,
+                                      std::shared_ptr<const void> dataOwner) noexcept
+    {
+        (void) dataOwner;
+        return setExternalVariable (name, value);
+    }
+
     /** After loading a program, and optionally connecting up to some of its endpoints,
         link() will complete any preparations needed before the code can be executed.
         If this returns true, then you can safely start calling advance(). If it
@@ -87,6 +155,28 @@ public:
     */
     virtual bool link (CompileMessageList&, const BuildSettings&, LinkerCache*) noexcept = 0;
 
+    /** The read-only part of a linked program, which other performers of the same type can
+        run without loading or linking it again. Each of them keeps its own state.
+        @see getLinkedProgram(), loadLinkedProgram()
+    */
+    struct LinkedProgram
+    {
+        virtual ~LinkedProgram() = default;
+    };
+
+    /** After a successful link(), this may return an object holding the linked program, which
+        can be passed to loadLinkedProgram() on other performers made by the same factory.
+        The default implementation returns nullptr, meaning that sharing isn't supported.
+    */
+    virtual std::shared_ptr<const LinkedProgram> getLinkedProgram() noexcept     { return {}; }
+
+    /** Replaces whatever is loaded with a program that another performer has linked. If this
+        returns true, the performer is in the same state as the original one when it had just
+        been linked, with the same endpoints and external values, but it only allocates its own
+        state and buffers. If it returns false, the caller should load() and link() as normal.
+    */
+    virtual bool loadLinkedProgram (CompileMessageList&, std::shared_ptr<const LinkedProgram>) noexcept   { return false; }
+
     /** Returns true if a program is currently loaded. */
     virtual bool isLoaded() noexcept = 0;
 
@@ -103,9 +193,28 @@ public:
         a handle that can be used later by other methods which need to reference
         an input or output endpoint.
         Will return a null handle if the ID is not found.
+        If handles to any outputs are obtained before link() is called, the performer may treat
+        the outputs that have no handle as unused, and leave out any processors that can only
+        affect those outputs.
     */
     virtual EndpointHandle getEndpointHandle (const EndpointID&) noexcept = 0;
 
+    /** Returns the handles for a list of endpoints, as if getEndpointHandle() had been called
+        for each of them. The list can be all or part of the ArrayView that getInputEndpoints()
+        or getOutputEndpoints() returns, so a host can get the handles for everything it uses
+        in a single call, without copying the lists.
+    */
+    virtual std::vector<EndpointHandle> getEndpointHandles (ArrayView<const EndpointDetails> endpoints) noexcept
+    {
+        std::vector<EndpointHandle> handles;
+        handles.reserve (endpoints.size());
+
+        for (auto& e : endpoints)
+            handles.push_back (getEndpointHandle (e.endpointID));
+
+        return handles;
+    }
+
     /** Indicates that a block of frames is going to be rendered.
 
         Once a program has been loaded and linked, a caller will typically make repeated
@@ -134,10 +243,28 @@ public:
     */
     virtual void setNextInputStreamFrames (EndpointHandle, const choc::value::ValueView& frameArray) noexcept = 0;
 
+    /** Binds a float or float<N> input stream to a block of the caller's non-interleaved channel data.
+        This can be used instead of setNextInputStreamFrames(), and lets a performer read the caller's
+        channels in place rather than needing them to be interleaved into a frame array first. The view
+        must have one channel per element of the stream's frame type and as many frames as were given
+        to prepare(), and it must stay valid until advance() has returned. Whichever of this and
+        setNextInputStreamFrames() was called last before advance() provides the block.
+        If the performer can't take the data in this form, it returns false, and the caller should
+        use setNextInputStreamFrames() instead. The default implementation always returns false.
+    */
+    virtual bool setNextInputStreamChannels (EndpointHandle, choc::buffer::ChannelArrayView<const float>) noexcept
+    {
+        return false;
+    }
+
     /** Sets the next levels for a sparse-stream input.
         After a successful call to prepare(), and before a call to advance(), this should be called
         to set the trajectory for a sparse input stream over the next block. If this is called more
         than once before advance(), only the most recent value is used.
+        Once the target has been reached, the stream stays at that value until a new target or
+        block of frames is given, so a performer can treat it as constant from then on. Callers
+        which know that a stream's frames will all have the same value can also use this with a
+        numFramesToReachValue of 0, to let the performer know that it's constant.
         The EndpointHandle is obtained by calling getEndpointHandle().
     */
     virtual void setSparseInputStreamTarget (EndpointHandle, const choc::value::ValueView& targetFrameValue,
@@ -159,12 +286,78 @@ public:
     */
     virtual void addInputEvent (EndpointHandle, const choc::value::ValueView& eventData) noexcept = 0;
 
+    /** Adds a batch of events to an input queue.
+        This has the same effect as calling addInputEvent() for each event in turn, but lets a
+        performer queue the whole batch in one call. The default implementation simply loops
+        over addInputEvent().
+    */
+    virtual void addInputEvents (EndpointHandle handle, const choc::value::ValueView* events, uint32_t numEvents) noexcept
+    {
+        for (uint32_t i = 0; i < numEvents; ++i)
+            addInputEvent (handle, events[i]);
+    }
+
+    /** Adds a batch of events which are all of the same type, and whose data is packed
+        contiguously, each one taking eventType.getValueDataSize() bytes.
+        This is a bulk alternative to addInputEvents() for callers like MIDI wrappers, which
+        already have their events in packed form. A performer can match the type against the
+        endpoint once for the whole batch, and then copy the data without inspecting each event.
+        The default implementation wraps each event in a ValueView and calls addInputEvent().
+    */
+    virtual void addInputEvents (EndpointHandle handle, const choc::value::Type& eventType,
+                                 const void* packedEventData, uint32_t numEvents) noexcept
+    {
+        auto eventDataSize = eventType.getValueDataSize();
+
+        for (uint32_t i = 0; i < numEvents; ++i)
+            addInputEvent (handle, choc::value::ValueView (eventType, const_cast<char*> (static_cast<const char*> (packedEventData)) + i * eventDataSize, nullptr));
+    }
+
     /** Retrieves the most recent block of frames from an output stream.
         After a successful call to advance(), this may be called to get the block of frames which
         were rendered during that call. A nullptr return value indicates an error.
     */
     virtual choc::value::ValueView getOutputStreamFrames (EndpointHandle) noexcept = 0;
 
+    /** Binds a float or float<N> output stream to the caller's non-interleaved channel buffers for the next block.
+        After a successful call to prepare(), and before a call to advance(), this may be called to have
+        the next block of the stream written straight into the caller's channels, so that they don't need
+        to be copied out of getOutputStreamFrames() afterwards. The view must have one channel per element
+        of the stream's frame type and as many frames as were given to prepare(), and it only applies to
+        that one block.
+        If the performer can't write the data in this form, it returns false, and the caller should read
+        getOutputStreamFrames() after advance() as usual. The default implementation always returns false.
+    */
+    virtual bool setNextOutputStreamChannels (EndpointHandle, choc::buffer::ChannelArrayView<float>) noexcept
+    {
+        return false;
+    }
+
+    /** Returns true if every frame of the last block from an output stream had the same value.
+        After a successful call to advance(), a caller can use this to find out whether a stream was
+        constant (e.g. silent, or a sparse stream which has reached its target) without scanning
+        the frames itself, so that it can skip work which depends on it. The default implementation
+        compares the frames returned by getOutputStreamFrames(), but a performer which already tracks
+        this can override it to answer without looking at the data.
+    */
+    virtual bool isOutputStreamConstant (EndpointHandle handle) noexcept
+    {
+        auto frames = getOutputStreamFrames (handle);
+        auto data = static_cast<const uint8_t*> (frames.getRawData());
+
+        if (data == nullptr || ! frames.isArray())
+            return false;
+
+        auto numFrames = frames.size();
+        auto frameSize = frames.getType().getElementType().getValueDataSize();
+
+        for (uint32_t i = 1; i < numFrames; ++i)
+            if (memcmp (data, data + i * frameSize, frameSize) != 0)
+                return false;
+
+        return true;
+    }
+
     /** Retrieves the current value of the value output.
         After a successful call to advance(), this may be called to get the value of the given output.
         A nullptr return value indicates an error.
@@ -178,6 +371,74 @@ public:
     */
     virtual void iterateOutputEvents (EndpointHandle, HandleNextOutputEventFn) noexcept = 0;
 
+    /** A plain function-pointer callback used by the allocation-free version of iterateOutputEvents().
+        The context is whatever pointer was passed to iterateOutputEvents().
+        @returns true to continue iterating, or false to stop.
+    */
+    using OutputEventCallback = bool(*)(void* context, uint32_t frameOffset, const choc::value::ValueView& event);
+
+    /** Retrieves the last block of events which were emitted by an event output.
+        This does the same job as the std::function version but is safe to call on the audio thread,
+        as it never needs to type-erase or allocate a callback. Performers should override it to call
+        the callback directly. The default forwards it to the std::function version, wrapped in a
+        lambda that only captures two pointers and so fits in std::function's small-object buffer.
+    */
+    virtual void iterateOutputEvents (EndpointHandle handle, OutputEventCallback callback, void* context) noexcept
+    {
+        iterateOutputEvents (handle, [callback, context] (uint32_t frameOffset, const choc::value::ValueView& event) -> bool
+        {
+            return callback (context, frameOffset, event);
+        });
+    }
+
+    /** Iterates the last block of events emitted by an event output, calling the given functor for each one.
+        The functor must have the signature bool (uint32_t frameOffset, const choc::value::ValueView& event).
+        It is passed by reference through the function-pointer version of iterateOutputEvents(), so
+        this never allocates, and the caller's handler can be inlined into the trampoline.
+    */
+    template <typename HandlerFn>
+    void forEachOutputEvent (EndpointHandle handle, HandlerFn&& handler) noexcept
+    {
+        using HandlerType = typename std::remove_reference<HandlerFn>::type;
+
+        iterateOutputEvents (handle,
+                             [] (void* context, uint32_t frameOffset, const choc::value::ValueView& event) -> bool
+                             {
+                                 return (*static_cast<HandlerType*> (context)) (frameOffset, event);
+                             },
+                             const_cast<void*> (static_cast<const void*> (std::addressof (handler))));
+    }
+
+    /** Copies the last block of events emitted by an event output into a caller-supplied buffer.
+        This is a bulk alternative to iterateOutputEvents() for outputs with a single event type.
+        Up to maxEvents events are copied: the frame offset of each one is written to frameOffsets,
+        and its packed data to packedEventData, with each event occupying eventDataSize bytes.
+        Any events whose packed size isn't eventDataSize are skipped.
+        @returns the number of events that were copied.
+    */
+    virtual uint32_t readOutputEvents (EndpointHandle handle, uint32_t* frameOffsets, void* packedEventData,
+                                       uint32_t eventDataSize, uint32_t maxEvents) noexcept
+    {
+        uint32_t numEvents = 0;
+
+        if (maxEvents == 0)
+            return 0;
+
+        forEachOutputEvent (handle, [&] (uint32_t frameOffset, const choc::value::ValueView& event) -> bool
+        {
+            if (event.getType().getValueDataSize() == eventDataSize)
+            {
+                frameOffsets[numEvents] = frameOffset;
+                memcpy (static_cast<char*> (packedEventData) + numEvents * eventDataSize, event.getRawData(), eventDataSize);
+                ++numEvents;
+            }
+
+            return numEvents < maxEvents;
+        });
+
+        return numEvents;
+    }
+
     /** Renders the next block of frames.
 
         Once the caller has called prepare(), a call to advance() will synchronously render the next
@@ -202,6 +463,100 @@ public:
     */
     virtual uint32_t getBlockSize() noexcept = 0;
 
+    /** Turns per-node profiling on or off, and resets any timings that were collected.
+        While it's enabled, the performer measures how long it spends rendering each of its
+        processor instances (or groups of them) inside advance(). Performers which don't
+        support profiling can ignore this.
+    */
+    virtual void setProfilingEnabled (bool /*shouldProfile*/) noexcept {}
+
+    /** Gives the performer a monitor which it should report the progress of any following
+        load() and link() calls to, and check to see whether they've been cancelled.
+        Pass nullptr to remove it. Performers which don't support this can ignore it, in
+        which case their builds will simply run to completion.
+    */
+    virtual void setBuildMonitor (std::shared_ptr<BuildMonitor>) noexcept {}
+
+    /** Returns the timings collected since profiling was enabled.
+        Unlike the other methods, this may be called from another thread while the performer
+        is rendering, so that the figures can be gathered away from the audio thread. The
+        default implementation returns an empty list.
+    */
+    virtual std::vector<NodeTiming> getNodeTimings() noexcept      { return {}; }
+
+    /** Returns the number of bytes needed to hold a copy of the program's internal state, i.e.
+        its processors' state variables such as delay lines and envelopes, or 0 if this performer
+        can't copy its state. The default implementation returns 0.
+    */
+    virtual uint64_t getStateSize() noexcept                                   { return 0; }
+
+    /** Copies the program's internal state into a buffer of getStateSize() bytes.
+        This mustn't be called while advance() is running. The data is raw, so it can only be
+        restored into a performer which has loaded the same program and was linked with the same
+        settings. See PerformerState for a wrapper which checks that.
+        @returns false if the performer isn't linked, or can't copy its state.
+    */
+    virtual bool saveState (void* /*dest*/, uint64_t /*size*/) noexcept       { return false; }
+
+    /** Replaces the program's internal state with one that was copied by saveState().
+        This mustn't be called while advance() is running. Any input events that are queued,
+        and the values and targets of input streams, aren't part of the state.
+        @returns false if the size doesn't match, or the performer can't restore its state.
+    */
+    virtual bool restoreState (const void* /*data*/, uint64_t /*size*/) noexcept  { return false; }
+
+    /** Returns the position of each of the program's state variables in the data from saveState().
+        The names only depend on the program's source, so they can be used to match up the
+        variables of two performers which have linked differently-optimised builds of the same
+        program. Variables whose values can't simply be copied, such as ones holding references to
+        external data, are left out. The default implementation returns an empty list.
+        @see PerformerStateTransfer
+    */
+    virtual std::vector<StateVariableDetails> getStateVariables() noexcept     { return {}; }
+
+    /** A breakdown of the memory that a performer is using for the program it has linked, in bytes.
+        @see getMemoryUsage()
+    */
+    struct MemoryUsage
+    {
+        uint64_t programSize = 0;       ///< The performer's own copy of the program, as measured by Program::getMemoryUsage()
+        uint64_t codeSize = 0;          ///< The code and routing information that was generated by link()
+        uint64_t stateSize = 0;         ///< The processors' state, plus anything else that a running instance needs, such as a stack
+        uint64_t streamBufferSize = 0;  ///< The buffers for the frames and events passing through the endpoints
+        uint64_t constantDataSize = 0;  ///< The performer's copies of the program's constants
+        uint64_t externalDataSize = 0;  ///< The performer's copies of the data supplied for external variables
+
+        /** Blocks of constant or external data from SharedConstantData, which other performers
+            that have loaded the same data will also be using, plus the program, code and data
+            of a program that was loaded with loadLinkedProgram().
+        */
+        uint64_t sharedDataSize = 0;
+
+        /** Returns the total, not including the shared data. */
+        uint64_t getTotal() const
+        {
+            return programSize + codeSize + stateSize + streamBufferSize + constantDataSize + externalDataSize;
+        }
+
+        MemoryUsage& operator+= (const MemoryUsage& other)
+        {
+            programSize      += other.programSize;
+            codeSize         += other.codeSize;
+            stateSize        += other.stateSize;
+            streamBufferSize += other.streamBufferSize;
+            constantDataSize += other.constantDataSize;
+            externalDataSize += other.externalDataSize;
+            sharedDataSize   += other.sharedDataSize;
+            return *this;
+        }
+    };
+
+    /** Returns an estimate of the memory used by the program that the performer has linked.
+        The figures are worked out when the program is linked, so this can be called from any
+        thread. The default implementation returns all zeros.
+    */
+    virtual MemoryUsage getMemoryUsage() noexcept      { return {}; }
+
     /** Returns whether the performer is in an error state
     */
     virtual bool hasError() noexcept = 0;
@@ -238,6 +593,22 @@ public:
         If no entry is found for this key, the method returns 0.
     */
     virtual uint64_t readItem (const char* key, void* destAddress, uint64_t destSize) = 0;
+
+    /** A read-only view of a cached item, whose data remains valid until it is deleted. */
+    struct ItemView
+    {
+        virtual ~ItemView() {}
+
+        virtual const void* getData() const = 0;
+        virtual uint64_t getSize() const = 0;
+    };
+
+    /** Returns a view of an item that can be used without copying it, e.g. a memory-mapped
+        file, so that a performer can link or load code straight from it.
+        If no entry is found for this key, or the cache can't provide a view of it, this
+        returns nullptr, and readItem() should be used instead.
+    */
+    virtual std::unique_ptr<ItemView> getItemView (const char* key)     { (void) key; return {}; }
 };
 
 //==============================================================================
@@ -252,4 +623,13 @@ public:
     virtual std::unique_ptr<Performer> createPerformer() = 0;
 };
 
+//==============================================================================
+/** Creates a factory for performers which run a program by interpreting its HEART.
+
+    These don't need to generate any code at runtime, so they'll work on any platform, at the
+    cost of running more slowly than a JIT-compiled performer. The factory can be passed to
+    createThreadedVenue() like any other.
+*/
+std::unique_ptr<PerformerFactory> createInterpreterPerformerFactory();
+
 } // namespace soul
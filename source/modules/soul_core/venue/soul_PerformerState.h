@@ -0,0 +1,298 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul
+{
+
+//==============================================================================
+/**
+    Saves and restores a Performer's internal state as a self-describing binary blob.
+
+    The blob has a header holding a format version and a key, followed by the raw data from
+    Performer::saveState(). The key should identify the program and the settings that the
+    performer was linked with (see createKey()), so that restore() can refuse a state
+    which was saved from a performer whose state has a different layout.
+
+    The layout is: the 8 byte magic number, a 32-bit format version, a 32-bit key length, the
+    key, a 64-bit state size, and then the state itself. All the integers are little-endian.
+*/
+struct PerformerState
+{
+    static constexpr uint32_t formatVersion = 1;
+
+    /** Returns a key for a performer which has loaded the given program and was linked with
+        the given settings.
+    */
+    static std::string createKey (const Program& program, const BuildSettings& settings)
+    {
+        HashBuilder hash;
+        hash << program.getHash()
+             << std::to_string (settings.maxBlockSize)
+             << std::to_string (settings.maxStateSize);
+        return hash.toString();
+    }
+
+    /** Returns the number of bytes needed to save the performer's state with this key, or 0 if
+        the performer can't save its state.
+    */
+    static uint64_t getSize (Performer& performer, const std::string& key)
+    {
+        auto stateSize = performer.getStateSize();
+
+        if (stateSize == 0)
+            return 0;
+
+        return getHeaderSize (key) + stateSize;
+    }
+
+    /** Writes the performer's state into a buffer which must be at least getSize() bytes.
+        @returns the number of bytes written, or 0 if it failed.
+    */
+    static uint64_t save (Performer& performer, const std::string& key, void* dest, uint64_t destSize)
+    {
+        auto stateSize = performer.getStateSize();
+        auto headerSize = getHeaderSize (key);
+
+        if (stateSize == 0 || dest == nullptr || destSize < headerSize + stateSize)
+            return 0;
+
+        auto d = static_cast<uint8_t*> (dest);
+        memcpy (d, magic, sizeof (magic));
+        d += sizeof (magic);
+        d = writeInt (d, formatVersion);
+        d = writeInt (d, static_cast<uint32_t> (key.length()));
+        memcpy (d, key.data(), key.length());
+        d += key.length();
+        d = writeInt (d, stateSize);
+
+        if (! performer.saveState (d, stateSize))
+            return 0;
+
+        return headerSize + stateSize;
+    }
+
+    /** Saves the performer's state into a new block of memory, which is empty if it failed. */
+    static std::vector<uint8_t> save (Performer& performer, const std::string& key)
+    {
+        std::vector<uint8_t> data (getSize (performer, key));
+
+        if (data.empty() || save (performer, key, data.data(), data.size()) == 0)
+            return {};
+
+        return data;
+    }
+
+    /** Checks that a blob was saved with the same key and format version, and if so, restores
+        the performer's state from it.
+    */
+    static bool restore (Performer& performer, const std::string& key, const void* data, uint64_t size)
+    {
+        auto headerSize = getHeaderSize (key);
+
+        if (data == nullptr || size < headerSize)
+            return false;
+
+        auto d = static_cast<const uint8_t*> (data);
+
+        if (memcmp (d, magic, sizeof (magic)) != 0)
+            return false;
+
+        d += sizeof (magic);
+
+        if (readInt<uint32_t> (d) != formatVersion
+             || readInt<uint32_t> (d + 4) != key.length()
+             || memcmp (d + 8, key.data(), key.length()) != 0)
+            return false;
+
+        d += 8 + key.length();
+        auto stateSize = readInt<uint64_t> (d);
+
+        if (stateSize != size - headerSize)
+            return false;
+
+        return performer.restoreState (d + 8, stateSize);
+    }
+
+private:
+    static constexpr uint8_t magic[8] = { 'S', 'O', 'U', 'L', 'S', 'T', 'A', 'T' };
+
+    static uint64_t getHeaderSize (const std::string& key)
+    {
+        return sizeof (magic) + 4 + 4 + key.length() + 8;
+    }
+
+    template <typename IntType>
+    static uint8_t* writeInt (uint8_t* dest, IntType value)
+    {
+        for (size_t i = 0; i < sizeof (IntType); ++i)
+            *dest++ = static_cast<uint8_t> (value >> (8 * i));
+
+        return dest;
+    }
+
+    template <typename IntType>
+    static IntType readInt (const uint8_t* source)
+    {
+        IntType value = 0;
+
+        for (size_t i = 0; i < sizeof (IntType); ++i)
+            value |= static_cast<IntType> (static_cast<IntType> (source[i]) << (8 * i));
+
+        return value;
+    }
+};
+
+//==============================================================================
+/**
+    Holds a copy of a performer's state as it was straight after linking, so that resetting
+    it is a single copy of the state, rather than re-running all of the program's
+    initialisation code.
+
+    The snapshot is as big as the state itself, so it isn't taken if the state is bigger
+    than the maximum size given to capture(), or if the performer can't save its state.
+    In either case, reset() just calls Performer::reset().
+*/
+struct InitialStateSnapshot
+{
+    static constexpr uint64_t defaultMaxSize = 32 * 1024 * 1024;
+
+    /** Resets a freshly-linked performer and takes a copy of its state. */
+    void capture (Performer& performer, uint64_t maxSize = defaultMaxSize)
+    {
+        clear();
+        auto size = performer.getStateSize();
+
+        if (size == 0 || size > maxSize)
+            return;
+
+        performer.reset();
+        state.resize (static_cast<size_t> (size));
+
+        if (! performer.saveState (state.data(), size))
+            clear();
+    }
+
+    /** Returns the performer to its freshly-linked state. */
+    void reset (Performer& performer) noexcept
+    {
+        if (state.empty() || ! performer.restoreState (state.data(), state.size()))
+            performer.reset();
+    }
+
+    void clear()
+    {
+        state.clear();
+        state.shrink_to_fit();
+    }
+
+    bool isEmpty() const        { return state.empty(); }
+    uint64_t getSize() const    { return state.size(); }
+
+private:
+    std::vector<uint8_t> state;
+};
+
+//==============================================================================
+/**
+    Copies the running state of one performer into another which has linked a different
+    build of the same program, e.g. one that was optimised at a different level.
+
+    The state variables are matched up by name and type using Performer::getStateVariables(),
+    and any which only exist in one of the performers are left alone. Anything that isn't
+    a state variable, such as queued events or a run() function's local variables, isn't
+    carried over, so each processor's run() function starts again from the top.
+
+    All the allocation is done by prepare(), so that apply() can be called on the audio thread
+    between two blocks.
+*/
+struct PerformerStateTransfer
+{
+    /** Works out which parts of the state to copy, and takes a copy of the destination's state.
+        The destination must be linked but not running, although the source may still be
+        rendering while this is called.
+        @returns false if either performer can't describe, save or restore its state.
+    */
+    bool prepare (Performer& source, Performer& dest)
+    {
+        clear();
+        auto sourceVariables = source.getStateVariables();
+        auto destVariables = dest.getStateVariables();
+
+        if (sourceVariables.empty() || destVariables.empty())
+            return false;
+
+        std::unordered_map<std::string, const StateVariableDetails*> sourceVariablesByName;
+
+        for (auto& v : sourceVariables)
+            sourceVariablesByName[v.name] = std::addressof (v);
+
+        for (auto& d : destVariables)
+        {
+            auto found = sourceVariablesByName.find (d.name);
+
+            if (found != sourceVariablesByName.end() && found->second->type == d.type && found->second->size == d.size)
+                copies.push_back ({ found->second->offset, d.offset, d.size });
+        }
+
+        sourceState.resize (static_cast<size_t> (source.getStateSize()));
+        destState.resize (static_cast<size_t> (dest.getStateSize()));
+
+        if (copies.empty() || sourceState.empty() || destState.empty()
+             || ! dest.saveState (destState.data(), destState.size()))
+        {
+            clear();
+            return false;
+        }
+
+        return true;
+    }
+
+    /** Copies the source performer's current state into the destination. Neither of them
+        may be rendering while this is called.
+    */
+    bool apply (Performer& source, Performer& dest) noexcept
+    {
+        if (copies.empty() || ! source.saveState (sourceState.data(), sourceState.size()))
+            return false;
+
+        for (auto& c : copies)
+            memcpy (destState.data() + c.destOffset, sourceState.data() + c.sourceOffset, static_cast<size_t> (c.size));
+
+        return dest.restoreState (destState.data(), destState.size());
+    }
+
+    void clear()
+    {
+        copies.clear();
+        sourceState.clear();
+        destState.clear();
+    }
+
+private:
+    struct Copy
+    {
+        uint64_t sourceOffset, destOffset, size;
+    };
+
+    std::vector<Copy> copies;
+    std::vector<uint8_t> sourceState, destState;
+};
+
+} // namespace soul
@@ -25,247 +25,2448 @@
 namespace soul
 {
 
+/** Sets up the scheduling of the calling thread, which is one of a venue's render threads. */
+static void applyRenderThreadOptions (const ThreadedVenueOptions& options, size_t threadIndex)
+{
+    if (options.realtimePriority > 0)
+        setCurrentThreadRealtimePriority (options.realtimePriority);
+
+    if (options.numaNode >= 0)
+        setCurrentThreadNUMANode (options.numaNode);
+
+    if (! options.cpuCores.empty())
+        setCurrentThreadCPUAffinity ({ options.cpuCores[threadIndex % options.cpuCores.size()] });
+    else if (options.numaNode >= 0)
+        setCurrentThreadCPUAffinity (getNUMANodeCPUCores (static_cast<uint32_t> (options.numaNode)));
+}
+
 //==============================================================================
-struct ThreadedVenue  : public soul::Venue
+/**
+    A Performer which uses the GraphPartitioner to split its program into pieces that
+    don't depend on each other within a block, gives each piece its own performer, and
+    renders them all in parallel on a pool of threads.
+
+    The streams which were cut by the partitioner are copied between performers after
+    each block, and the partitioner has already shortened their delays to allow for that.
+
+    If ThreadedVenueOptions::bypassSilentProcessors is enabled, a partition whose processors
+    all have a "silenceTail" annotation isn't rendered while its inputs have been silent
+    for longer than that tail, and its outputs read as zeros.
+*/
+struct PartitionedPerformer  : public Performer
 {
-    ThreadedVenue (std::unique_ptr<PerformerFactory> p) : performerFactory (std::move (p)) {}
-    ~ThreadedVenue() override {}
+    PartitionedPerformer (PerformerFactory& f, const ThreadedVenueOptions& o)
+        : factory (f), options (o), numRenderThreads (o.numRenderThreads)
+    {
+        SOUL_ASSERT (numRenderThreads > 1 || options.bypassSilentProcessors);
+    }
 
-    std::unique_ptr<Venue::Session> createSession() override
+    ~PartitionedPerformer() override
     {
-        return std::make_unique<ThreadedVenueSession> (*this, performerFactory->createPerformer());
+        unload();
     }
 
-    std::vector<EndpointDetails> getSourceEndpoints() override    { return {}; }
-    std::vector<EndpointDetails> getSinkEndpoints() override      { return {}; }
+    bool load (CompileMessageList& messageList, const Program& programToLoad) noexcept override
+    {
+        unload();
 
-    bool connectSessionInputEndpoint (Venue::Session&, EndpointID, EndpointID) override
+        // The whole program is loaded into one performer to begin with, which provides the endpoint
+        // and external lists. It can only be split up once link() tells us the block size.
+        auto performer = factory.createPerformer();
+
+        if (performer == nullptr || ! performer->load (messageList, programToLoad))
+            return false;
+
+        program = programToLoad;
+        inputs.assign (performer->getInputEndpoints().begin(), performer->getInputEndpoints().end());
+        outputs.assign (performer->getOutputEndpoints().begin(), performer->getOutputEndpoints().end());
+        endpointIndex.build (inputs, outputs);
+        partitions.push_back ({ std::move (performer), {}, {} });
+        return true;
+    }
+
+    void unload() noexcept override
+    {
+        workers.reset();
+        partitions.clear();
+        partitionTimings.reset();
+        links.clear();
+        inputRoutes.clear();
+        sparseInputs.clear();
+        outputRoutes.clear();
+        inputs.clear();
+        outputs.clear();
+        endpointIndex.clear();
+        externalValues.clear();
+        program = {};
+        linked = false;
+    }
+
+    ArrayView<const EndpointDetails> getInputEndpoints() noexcept override     { return inputs; }
+    ArrayView<const EndpointDetails> getOutputEndpoints() noexcept override    { return outputs; }
+
+    ArrayView<const ExternalVariable> getExternalVariables() noexcept override
+    {
+        if (partitions.empty())
+            return {};
+
+        return partitions.front().performer->getExternalVariables();
+    }
+
+    bool setExternalVariable (const char* name, const choc::value::ValueView& value) noexcept override
+    {
+        return setExternalVariable (name, value, {});
+    }
+
+    // The values are kept so that they can be given to the performers of any new partitions
+    // when the program is re-partitioned. If the caller didn't supply an owner, a copy is made.
+    bool setExternalVariable (const char* name, const choc::value::ValueView& value,
+                              std::shared_ptr<const void> dataOwner) noexcept override
+    {
+        if (partitions.empty() || linked || ! partitions.front().performer->setExternalVariable (name, value, dataOwner))
+            return false;
+
+        if (dataOwner != nullptr)
+        {
+            externalValues[name] = { value, std::move (dataOwner) };
+        }
+        else
+        {
+            auto copy = std::make_shared<const choc::value::Value> (value);
+            externalValues[name] = { copy->getView(), copy };
+        }
+
+        return true;
+    }
+
+    bool link (CompileMessageList& messageList, const BuildSettings& settings, LinkerCache* cache) noexcept override
     {
+        if (partitions.empty() || linked)
+            return false;
+
+        try
+        {
+            auto maxPartitions = options.bypassSilentProcessors ? std::numeric_limits<uint32_t>::max() : numRenderThreads;
+            auto result = GraphPartitioner::partition (program, maxPartitions, settings.maxBlockSize);
+
+            if (result.partitions.size() > 1 && ! loadPartitions (messageList, result))
+                return false;
+
+            // A single partition can report its own progress, but when there are several,
+            // each one that gets linked counts as a step
+            if (partitions.size() == 1)
+                partitions.front().performer->setBuildMonitor (buildMonitor);
+
+            for (size_t i = 0; i < partitions.size(); ++i)
+            {
+                if (buildMonitor != nullptr && buildMonitor->isCancelled())
+                {
+                    messageList.add (Errors::buildCancelled());
+                    return false;
+                }
+
+                auto& p = partitions[i];
+                auto ok = p.performer->link (messageList, settings, cache);
+                p.performer->setBuildMonitor ({});
+
+                if (! ok)
+                    return false;
+
+                p.initialState.capture (*p.performer);
+
+                if (buildMonitor != nullptr && partitions.size() > 1)
+                    buildMonitor->reportProgress (static_cast<float> (i + 1) / static_cast<float> (partitions.size()));
+            }
+
+            blockSize = partitions.front().performer->getBlockSize();
+
+            for (auto& p : partitions)
+                blockSize = std::min (blockSize, p.performer->getBlockSize());
+
+            createEndpointRoutes (result);
+            createPartitionTimings (result);
+
+            if (! createLinks (result, settings.maxBlockSize))
+            {
+                messageList.addError ("Failed to connect the partitions of the program", {});
+                return false;
+            }
+
+            createSilenceBypass (result, settings.sampleRate);
+
+            if (partitions.size() > 1 && numRenderThreads > 1)
+                workers = std::make_unique<WorkerThreads> (*this, std::min (numRenderThreads, (uint32_t) partitions.size()) - 1);
+
+            linked = true;
+            return true;
+        }
+        catch (...)
+        {
+            messageList.addError ("Failed to partition the program", {});
+        }
+
         return false;
     }
 
-    bool connectSessionOutputEndpoint (Venue::Session&, EndpointID, EndpointID) override
+    bool isLoaded() noexcept override       { return ! partitions.empty(); }
+    bool isLinked() noexcept override       { return linked; }
+
+    void reset() noexcept override
+    {
+        for (auto& p : partitions)
+        {
+            p.initialState.reset (*p.performer);
+            p.numSilentFrames = 0;
+            p.isBypassed = false;
+        }
+
+        for (auto& l : links)
+            l.reset();
+
+        for (auto& i : sparseInputs)
+            i = {};
+    }
+
+    EndpointHandle getEndpointHandle (const EndpointID& endpointID) noexcept override
+    {
+        if (auto input = endpointIndex.findInput (endpointID))
+            return EndpointHandle::create ((uint32_t) (*input + 1));
+
+        if (auto output = endpointIndex.findOutput (endpointID))
+            return EndpointHandle::create ((uint32_t) (inputs.size() + *output + 1));
+
+        return {};
+    }
+
+    void prepare (uint32_t numFramesToBeRendered) noexcept override
+    {
+        SOUL_ASSERT (linked && numFramesToBeRendered <= blockSize);
+        numFramesPrepared = numFramesToBeRendered;
+
+        for (auto& p : partitions)
+            p.performer->prepare (numFramesToBeRendered);
+    }
+
+    void setNextInputStreamFrames (EndpointHandle handle, const choc::value::ValueView& frameArray) noexcept override
+    {
+        auto routes = getInputRoutes (handle);
+
+        if (auto sparseInput = getSparseInputState (handle))
+        {
+            *sparseInput = {};
+
+            if (! isSilent (frameArray))
+                markActivity (routes);
+        }
+
+        for (auto& r : routes)
+            r.performer->setNextInputStreamFrames (r.handle, frameArray);
+    }
+
+    bool setNextInputStreamChannels (EndpointHandle handle, choc::buffer::ChannelArrayView<const float> channels) noexcept override
+    {
+        auto routes = getInputRoutes (handle);
+
+        for (auto& r : routes)
+            if (! r.performer->setNextInputStreamChannels (r.handle, channels))
+                return false;
+
+        if (auto sparseInput = getSparseInputState (handle))
+        {
+            *sparseInput = {};
+
+            if (! choc::buffer::isAllZero (channels))
+                markActivity (routes);
+        }
+
+        return ! routes.empty();
+    }
+
+    void setSparseInputStreamTarget (EndpointHandle handle, const choc::value::ValueView& targetFrameValue,
+                                     uint32_t numFramesToReachValue, float curveShape) noexcept override
+    {
+        if (auto sparseInput = getSparseInputState (handle))
+        {
+            // The target is kept until it's replaced, so a non-zero one keeps its users active from then on
+            sparseInput->isTargetSilent = isSilent (targetFrameValue);
+            sparseInput->numRampFramesRemaining = numFramesToReachValue;
+        }
+
+        for (auto& r : getInputRoutes (handle))
+            r.performer->setSparseInputStreamTarget (r.handle, targetFrameValue, numFramesToReachValue, curveShape);
+    }
+
+    void setInputValue (EndpointHandle handle, const choc::value::ValueView& newValue) noexcept override
+    {
+        auto routes = getInputRoutes (handle);
+        markActivity (routes);
+
+        for (auto& r : routes)
+            r.performer->setInputValue (r.handle, newValue);
+    }
+
+    void addInputEvent (EndpointHandle handle, const choc::value::ValueView& eventData) noexcept override
+    {
+        auto routes = getInputRoutes (handle);
+        markActivity (routes);
+
+        for (auto& r : routes)
+            r.performer->addInputEvent (r.handle, eventData);
+    }
+
+    void addInputEvents (EndpointHandle handle, const choc::value::ValueView* events, uint32_t numEvents) noexcept override
+    {
+        auto routes = getInputRoutes (handle);
+
+        if (numEvents != 0)
+            markActivity (routes);
+
+        for (auto& r : routes)
+            r.performer->addInputEvents (r.handle, events, numEvents);
+    }
+
+    void addInputEvents (EndpointHandle handle, const choc::value::Type& eventType,
+                         const void* packedEventData, uint32_t numEvents) noexcept override
     {
+        auto routes = getInputRoutes (handle);
+
+        if (numEvents != 0)
+            markActivity (routes);
+
+        for (auto& r : routes)
+            r.performer->addInputEvents (r.handle, eventType, packedEventData, numEvents);
+    }
+
+    choc::value::ValueView getOutputStreamFrames (EndpointHandle handle) noexcept override
+    {
+        if (auto r = getOutputRoute (handle))
+        {
+            if (partitions[r->partition].isBypassed)
+                return getSilentFrames (outputs[handle.getRawHandle() - 1 - inputs.size()].getFrameType());
+
+            return r->performer->getOutputStreamFrames (r->handle);
+        }
+
+        return {};
+    }
+
+    bool setNextOutputStreamChannels (EndpointHandle handle, choc::buffer::ChannelArrayView<float> channels) noexcept override
+    {
+        // A partition which might be bypassed won't write to its outputs, so those are always read back afterwards
+        if (auto r = getOutputRoute (handle))
+            if (! partitions[r->partition].canBypass)
+                return r->performer->setNextOutputStreamChannels (r->handle, channels);
+
+        return false;
+    }
+
+    bool isOutputStreamConstant (EndpointHandle handle) noexcept override
+    {
+        if (auto r = getOutputRoute (handle))
+            return partitions[r->partition].isBypassed || r->performer->isOutputStreamConstant (r->handle);
+
+        return false;
+    }
+
+    choc::value::ValueView getOutputValue (EndpointHandle handle) noexcept override
+    {
+        if (auto r = getOutputRoute (handle))
+            return r->performer->getOutputValue (r->handle);
+
+        return {};
+    }
+
+    void iterateOutputEvents (EndpointHandle handle, HandleNextOutputEventFn fn) noexcept override
+    {
+        if (auto r = getOutputRoute (handle))
+            if (! partitions[r->partition].isBypassed)
+                r->performer->iterateOutputEvents (r->handle, std::move (fn));
+    }
+
+    void iterateOutputEvents (EndpointHandle handle, OutputEventCallback callback, void* context) noexcept override
+    {
+        if (auto r = getOutputRoute (handle))
+            if (! partitions[r->partition].isBypassed)
+                r->performer->iterateOutputEvents (r->handle, callback, context);
+    }
+
+    uint32_t readOutputEvents (EndpointHandle handle, uint32_t* frameOffsets, void* packedEventData,
+                               uint32_t eventDataSize, uint32_t maxEvents) noexcept override
+    {
+        if (auto r = getOutputRoute (handle))
+            if (! partitions[r->partition].isBypassed)
+                return r->performer->readOutputEvents (r->handle, frameOffsets, packedEventData, eventDataSize, maxEvents);
+
+        return 0;
+    }
+
+    void advance() noexcept override
+    {
+        for (auto& l : links)
+            l.sendToDestination (numFramesPrepared);
+
+        if (options.bypassSilentProcessors)
+            updateBypassedPartitions();
+
+        if (workers != nullptr)
+            workers->renderAll();
+        else
+            for (size_t i = 0; i < partitions.size(); ++i)
+                renderPartition (i);
+
+        for (auto& l : links)
+        {
+            if (partitions[l.source.partition].isBypassed)
+                l.readSilence (numFramesPrepared, silence.data());
+            else
+                l.readFromSource (numFramesPrepared);
+        }
+    }
+
+    bool isEndpointActive (const EndpointID& endpointID) noexcept override
+    {
+        for (auto& p : partitions)
+            if (p.performer->isEndpointActive (endpointID))
+                return true;
+
         return false;
     }
 
+    uint32_t getXRuns() noexcept override
+    {
+        uint32_t total = 0;
+
+        for (auto& p : partitions)
+            total += p.performer->getXRuns();
+
+        return total;
+    }
+
+    uint32_t getBlockSize() noexcept override   { return blockSize; }
+
+    void setBuildMonitor (std::shared_ptr<BuildMonitor> m) noexcept override    { buildMonitor = std::move (m); }
+
+    void setProfilingEnabled (bool shouldProfile) noexcept override
+    {
+        profilingEnabled = false;
+
+        for (size_t i = 0; i < partitions.size() && partitionTimings != nullptr; ++i)
+            partitionTimings[i].reset();
+
+        for (auto& p : partitions)
+            p.performer->setProfilingEnabled (shouldProfile);
+
+        profilingEnabled = shouldProfile;
+    }
+
+    std::vector<NodeTiming> getNodeTimings() noexcept override
+    {
+        std::vector<NodeTiming> result;
+
+        for (size_t i = 0; i < partitions.size() && partitionTimings != nullptr; ++i)
+        {
+            auto& timing = partitionTimings[i];
+            result.push_back ({ partitions[i].name, timing.getNumMeasurements(), timing.getTotalNanoseconds(), timing.getMaxNanoseconds() });
+
+            // If the partition's own performer can break its time down further, include its figures too
+            for (auto& t : partitions[i].performer->getNodeTimings())
+                result.push_back (t);
+        }
+
+        return result;
+    }
+
+    MemoryUsage getMemoryUsage() noexcept override
+    {
+        MemoryUsage m;
+
+        // None of this changes after linking, so it's safe to read while the partitions are rendering
+        if (linked)
+        {
+            for (auto& p : partitions)
+                m += p.performer->getMemoryUsage();
+
+            m.programSize += program.getMemoryUsage().getTotal();
+
+            for (auto& l : links)
+                m.streamBufferSize += getVectorMemoryUsage (l.buffer) + getVectorMemoryUsage (l.scratch)
+                                        + getVectorMemoryUsage (l.constantFrame);
+        }
+
+        return m;
+    }
+
+    bool hasError() noexcept override
+    {
+        return getError() != nullptr;
+    }
+
+    const char* getError() noexcept override
+    {
+        for (auto& p : partitions)
+            if (p.performer->hasError())
+                return p.performer->getError();
+
+        return nullptr;
+    }
+
+private:
     //==============================================================================
-    struct ThreadedVenueSession    : public Venue::Session
+    struct Partition
     {
-        ThreadedVenueSession (ThreadedVenue& v, std::unique_ptr<soul::Performer> p)
-            : venue (v), performer (std::move (p))
+        std::unique_ptr<Performer> performer;
+        InitialStateSnapshot initialState;
+        std::string name;
+
+        // If canBypass is set, the partition stops being rendered once its inputs have been silent for silenceTailFrames
+        bool canBypass = false, hasActivity = false, isBypassed = false;
+        uint64_t silenceTailFrames = 0, numSilentFrames = 0;
+    };
+
+    struct EndpointRoute
+    {
+        Performer* performer;
+        EndpointHandle handle;
+        size_t partition;
+    };
+
+    /** The trajectory which was last given to a top-level input stream by setSparseInputStreamTarget(). */
+    struct SparseInputState
+    {
+        bool isTargetSilent = true;
+        uint32_t numRampFramesRemaining = 0;
+
+        bool isSilent() const   { return isTargetSilent && numRampFramesRemaining == 0; }
+    };
+
+    /** Holds the last block's worth of frames from a stream which was cut by the partitioner,
+        as a circular buffer which always contains exactly the link's latency.
+
+        While the source is producing a constant value (e.g. silence), the link counts how many of
+        the most recent frames have had that value. Once the whole buffer is made of them, it stops
+        copying frames, and gives the destination the value as a sparse stream target instead, so
+        that the destination performer knows the stream is constant.
+    */
+    struct Link
+    {
+        EndpointRoute source, dest;
+        choc::value::Type frameType, frameArrayType;
+        size_t frameSize = 0;
+        uint32_t latency = 0, position = 0, numConstantFrames = 0;
+        std::vector<uint8_t> buffer, scratch, constantFrame;
+        bool isDestConstant = false;
+
+        void reset()
         {
-            SOUL_ASSERT (performer != nullptr);
+            std::fill (buffer.begin(), buffer.end(), 0);
+            numConstantFrames = 0;
+            isDestConstant = false;
+        }
+
+        bool isBufferConstant() const   { return numConstantFrames >= latency; }
+
+        bool isSilent() const
+        {
+            return isBufferConstant()
+                    && std::all_of (constantFrame.begin(), constantFrame.end(), [] (uint8_t b) { return b == 0; });
+        }
+
+        void sendToDestination (uint32_t numFrames)
+        {
+            if (isBufferConstant())
+            {
+                if (! isDestConstant)
+                {
+                    dest.performer->setSparseInputStreamTarget (dest.handle, choc::value::ValueView (frameType, constantFrame.data(), nullptr), 0, 0.0f);
+                    isDestConstant = true;
+                }
+
+                return;
+            }
+
+            isDestConstant = false;
+
+            auto firstChunk = std::min (numFrames, latency - position);
+            memcpy (scratch.data(), buffer.data() + position * frameSize, firstChunk * frameSize);
+            memcpy (scratch.data() + firstChunk * frameSize, buffer.data(), (numFrames - firstChunk) * frameSize);
+
+            if (frameArrayType.getNumElements() != numFrames)
+                frameArrayType = choc::value::Type::createArray (frameType, numFrames);
+
+            dest.performer->setNextInputStreamFrames (dest.handle, choc::value::ValueView (frameArrayType, scratch.data(), nullptr));
+        }
+
+        void readFromSource (uint32_t numFrames)
+        {
+            auto frames = source.performer->getOutputStreamFrames (source.handle);
+            auto sourceData = static_cast<const uint8_t*> (frames.getRawData());
+
+            if (sourceData != nullptr)
+                write (sourceData, numFrames, numFrames != 0 && source.performer->isOutputStreamConstant (source.handle));
+            else
+                position = (position + numFrames) % latency;
+        }
+
+        /** Used instead of readFromSource() when the source partition has been bypassed. */
+        void readSilence (uint32_t numFrames, const uint8_t* zeros)
+        {
+            write (zeros, numFrames, numFrames != 0);
         }
 
-        ~ThreadedVenueSession() override
-        {
-            unload();
-            venue.sessionDeleted (this);
-        }
+        void write (const uint8_t* sourceData, uint32_t numFrames, bool isConstant)
+        {
+            if (isConstant)
+            {
+                if (numConstantFrames != 0 && memcmp (constantFrame.data(), sourceData, frameSize) == 0)
+                {
+                    // The buffer is already full of this value, so there's nothing to write
+                    if (isBufferConstant())
+                    {
+                        position = (position + numFrames) % latency;
+                        return;
+                    }
+
+                    numConstantFrames = std::min (latency, numConstantFrames + numFrames);
+                }
+                else
+                {
+                    memcpy (constantFrame.data(), sourceData, frameSize);
+                    numConstantFrames = std::min (latency, numFrames);
+                }
+            }
+            else
+            {
+                numConstantFrames = 0;
+            }
+
+            auto firstChunk = std::min (numFrames, latency - position);
+            memcpy (buffer.data() + position * frameSize, sourceData, firstChunk * frameSize);
+            memcpy (buffer.data(), sourceData + firstChunk * frameSize, (numFrames - firstChunk) * frameSize);
+            position = (position + numFrames) % latency;
+        }
+    };
+
+    //==============================================================================
+    /** A pool of threads which help the calling thread to render the partitions. Each
+        block, every thread grabs the next unrendered partition until there are none left.
+    */
+    struct WorkerThreads
+    {
+        WorkerThreads (PartitionedPerformer& p, uint32_t numThreads) : owner (p)
+        {
+            for (uint32_t i = 0; i < numThreads; ++i)
+            {
+                threads.emplace_back ([this, i]
+                {
+                    // index 0 is the session's own render thread, which joins in with the work
+                    applyRenderThreadOptions (owner.options, i + 1);
+                    std::optional<ScopedDisableDenormals> disableDenormals;
+
+                    if (owner.options.flushDenormalsToZero)
+                        disableDenormals.emplace();
+
+                    run();
+                });
+            }
+        }
+
+        ~WorkerThreads()
+        {
+            {
+                std::lock_guard<std::mutex> lock (mutex);
+                shouldExit = true;
+            }
+
+            wakeUp.notify_all();
+
+            for (auto& t : threads)
+                t.join();
+        }
+
+        void renderAll()
+        {
+            // The count has to be set first, because a thread that's still finishing
+            // the last block may grab a partition as soon as the index is reset
+
+            numPartitionsRemaining = owner.partitions.size();
+            nextPartition = 0;
+
+            {
+                std::lock_guard<std::mutex> lock (mutex);
+                ++blockNumber;
+            }
+
+            wakeUp.notify_all();
+            renderPartitions();
+
+            while (numPartitionsRemaining.load() != 0)
+                std::this_thread::yield();
+        }
+
+    private:
+        PartitionedPerformer& owner;
+        std::vector<std::thread> threads;
+        std::mutex mutex;
+        std::condition_variable wakeUp;
+        uint64_t blockNumber = 0;
+        bool shouldExit = false;
+        std::atomic<size_t> nextPartition { 0 }, numPartitionsRemaining { 0 };
+
+        void run()
+        {
+            uint64_t lastBlockRendered = 0;
+
+            for (;;)
+            {
+                {
+                    std::unique_lock<std::mutex> lock (mutex);
+                    wakeUp.wait (lock, [&] { return shouldExit || blockNumber != lastBlockRendered; });
+
+                    if (shouldExit)
+                        return;
+
+                    lastBlockRendered = blockNumber;
+                }
+
+                renderPartitions();
+            }
+        }
+
+        void renderPartitions()
+        {
+            for (;;)
+            {
+                auto index = nextPartition++;
+
+                if (index >= owner.partitions.size())
+                    return;
+
+                owner.renderPartition (index);
+                --numPartitionsRemaining;
+            }
+        }
+    };
+
+    //==============================================================================
+    PerformerFactory& factory;
+    const ThreadedVenueOptions options;
+    const uint32_t numRenderThreads;
+    Program program;
+    std::vector<Partition> partitions;
+    std::vector<Link> links;
+    std::vector<EndpointDetails> inputs, outputs;
+    EndpointIndex endpointIndex;
+    std::vector<std::vector<EndpointRoute>> inputRoutes;
+    std::vector<EndpointRoute> outputRoutes;
+    std::vector<SparseInputState> sparseInputs;
+    std::vector<uint8_t> silence;
+    std::unordered_map<std::string, std::pair<choc::value::ValueView, std::shared_ptr<const void>>> externalValues;
+    std::unique_ptr<WorkerThreads> workers;
+    std::unique_ptr<ProcessingTimeAccumulator[]> partitionTimings;
+    std::shared_ptr<BuildMonitor> buildMonitor;
+    std::atomic<bool> profilingEnabled { false };
+    uint32_t blockSize = 0, numFramesPrepared = 0;
+    bool linked = false;
+
+    void renderPartition (size_t index) noexcept
+    {
+        if (partitions[index].isBypassed)
+            return;
+
+        SOUL_TRACE_SCOPE ("render", "render partition")
+        auto& performer = *partitions[index].performer;
+
+        if (profilingEnabled)
+        {
+            auto start = std::chrono::steady_clock::now();
+            performer.advance();
+            partitionTimings[index].addMeasurement (std::chrono::steady_clock::now() - start);
+        }
+        else
+        {
+            performer.advance();
+        }
+    }
+
+    void createPartitionTimings (const GraphPartitioner::Result& result)
+    {
+        if (partitions.size() == 1)
+        {
+            if (auto mainProcessor = program.getMainProcessor())
+                partitions.front().name = mainProcessor->originalFullName;
+        }
+        else
+        {
+            for (size_t i = 0; i < partitions.size(); ++i)
+                partitions[i].name = getPartitionName (result.partitions[i]);
+        }
+
+        partitionTimings = std::make_unique<ProcessingTimeAccumulator[]> (partitions.size());
+    }
+
+    /** A partition of a graph is named after the processor instances that it contains. */
+    static std::string getPartitionName (const Program& partition)
+    {
+        auto mainProcessor = partition.getMainProcessor();
+
+        if (mainProcessor == nullptr)
+            return {};
+
+        if (! mainProcessor->isGraph() || mainProcessor->processorInstances.empty())
+            return mainProcessor->originalFullName;
+
+        return joinStrings (mainProcessor->processorInstances, ", ", [] (auto& i) { return i->instanceName; });
+    }
+
+    bool loadPartitions (CompileMessageList& messageList, const GraphPartitioner::Result& result)
+    {
+        partitions.resize (result.partitions.size());
+
+        for (size_t i = 0; i < partitions.size(); ++i)
+        {
+            auto& performer = partitions[i].performer;
+
+            if (performer == nullptr)
+                performer = factory.createPerformer();
+
+            if (performer == nullptr || ! performer->load (messageList, result.partitions[i]))
+                return false;
+
+            for (auto& e : externalValues)
+                for (auto& external : performer->getExternalVariables())
+                    if (external.name == e.first)
+                        performer->setExternalVariable (e.first.c_str(), e.second.first, e.second.second);
+        }
+
+        return true;
+    }
+
+    EndpointRoute createRoute (size_t partition, const EndpointID& endpointID)
+    {
+        auto& performer = *partitions[partition].performer;
+        return { std::addressof (performer), performer.getEndpointHandle (endpointID), partition };
+    }
+
+    void createEndpointRoutes (const GraphPartitioner::Result& result)
+    {
+        inputRoutes.clear();
+        outputRoutes.clear();
+
+        for (auto& i : inputs)
+        {
+            std::vector<EndpointRoute> routes;
+            auto users = result.inputPartitions.find (i.name);
+
+            if (users != result.inputPartitions.end())
+                for (auto partition : users->second)
+                    routes.push_back (createRoute (partition, i.endpointID));
+            else
+                routes.push_back (createRoute (0, i.endpointID));
+
+            inputRoutes.push_back (std::move (routes));
+        }
+
+        for (auto& o : outputs)
+        {
+            auto owner = result.outputPartitions.find (o.name);
+            outputRoutes.push_back (createRoute (owner != result.outputPartitions.end() ? owner->second : 0, o.endpointID));
+        }
+    }
+
+    bool createLinks (const GraphPartitioner::Result& result, uint32_t latency)
+    {
+        links.clear();
+
+        for (auto& l : result.links)
+        {
+            Link link;
+            link.source = createRoute (l.sourcePartition, EndpointID::create ("out:" + l.endpointName));
+            link.dest = createRoute (l.destPartition, EndpointID::create ("in:" + l.endpointName));
+
+            if (! (link.source.handle.isValid() && link.dest.handle.isValid()) || latency < blockSize)
+                return false;
+
+            link.frameType = findDetailsForID (partitions[l.sourcePartition].performer->getOutputEndpoints(),
+                                               EndpointID::create ("out:" + l.endpointName)).getFrameType();
+            link.frameArrayType = choc::value::Type::createArray (link.frameType, blockSize);
+            link.frameSize = link.frameType.getValueDataSize();
+            link.latency = latency;
+            link.buffer.resize (link.frameSize * latency, 0);
+            link.scratch.resize (link.frameSize * latency, 0);
+            link.constantFrame.resize (link.frameSize, 0);
+            links.push_back (std::move (link));
+        }
+
+        return true;
+    }
+
+    //==============================================================================
+    void createSilenceBypass (const GraphPartitioner::Result& result, double sampleRate)
+    {
+        sparseInputs.clear();
+        silence.clear();
+
+        if (! options.bypassSilentProcessors)
+            return;
+
+        sparseInputs.resize (inputs.size());
+        size_t maxFrameSize = 0;
+
+        for (auto& o : outputs)
+            if (isStream (o))
+                maxFrameSize = std::max (maxFrameSize, o.getFrameType().getValueDataSize());
+
+        for (auto& l : links)
+            maxFrameSize = std::max (maxFrameSize, l.frameSize);
+
+        silence.resize (maxFrameSize * blockSize, 0);
+
+        for (size_t i = 0; i < partitions.size(); ++i)
+        {
+            auto tail = getSilenceTailSeconds (result.partitions.size() > 1 ? result.partitions[i] : program);
+            partitions[i].canBypass = tail >= 0;
+            partitions[i].silenceTailFrames = tail > 0 ? (uint64_t) std::ceil (tail * sampleRate) : 0;
+        }
+    }
+
+    /** Returns the longest "silenceTail" annotation of the processors in a partition, or
+        a negative number if any of them doesn't have one.
+    */
+    static double getSilenceTailSeconds (const Program& partition)
+    {
+        auto mainProcessor = partition.getMainProcessor();
+
+        if (mainProcessor == nullptr)
+            return -1.0;
+
+        if (! mainProcessor->isGraph())
+            return getSilenceTailSeconds (*mainProcessor);
+
+        double longest = 0;
+
+        for (auto& i : mainProcessor->processorInstances)
+        {
+            auto module = partition.getModuleWithName (i->sourceName);
+            auto tail = module != nullptr ? getSilenceTailSeconds (*module) : -1.0;
+
+            if (tail < 0)
+                return -1.0;
+
+            longest = std::max (longest, tail);
+        }
+
+        return longest;
+    }
+
+    static double getSilenceTailSeconds (const Module& module)
+    {
+        if (! module.annotation.hasValue ("silenceTail"))
+            return -1.0;
+
+        return std::max (0.0, module.annotation.getDouble ("silenceTail"));
+    }
+
+    /** Decides which partitions to skip in the block that's about to be rendered. A partition is
+        only skipped if it's received nothing but silence for at least its tail length, so that
+        its own output will also have died away by the start of the block.
+    */
+    void updateBypassedPartitions()
+    {
+        for (size_t i = 0; i < sparseInputs.size(); ++i)
+        {
+            auto& input = sparseInputs[i];
+
+            if (! input.isSilent())
+            {
+                markActivity (inputRoutes[i]);
+                input.numRampFramesRemaining -= std::min (input.numRampFramesRemaining, numFramesPrepared);
+            }
+        }
+
+        for (auto& l : links)
+            if (! l.isSilent())
+                partitions[l.dest.partition].hasActivity = true;
+
+        for (auto& p : partitions)
+        {
+            if (p.hasActivity || ! p.canBypass)
+            {
+                p.numSilentFrames = 0;
+                p.isBypassed = false;
+            }
+            else
+            {
+                p.isBypassed = p.numSilentFrames >= p.silenceTailFrames;
+                p.numSilentFrames += numFramesPrepared;
+            }
+
+            p.hasActivity = false;
+        }
+    }
+
+    void markActivity (ArrayView<const EndpointRoute> routes)
+    {
+        for (auto& r : routes)
+            partitions[r.partition].hasActivity = true;
+    }
+
+    static bool isSilent (const choc::value::ValueView& value)
+    {
+        auto data = static_cast<const uint8_t*> (value.getRawData());
+
+        if (data == nullptr)
+            return true;
+
+        return std::all_of (data, data + value.getType().getValueDataSize(), [] (uint8_t b) { return b == 0; });
+    }
+
+    choc::value::ValueView getSilentFrames (const choc::value::Type& frameType)
+    {
+        return choc::value::ValueView (choc::value::Type::createArray (frameType, numFramesPrepared), silence.data(), nullptr);
+    }
+
+    SparseInputState* getSparseInputState (EndpointHandle handle)
+    {
+        auto index = handle.getRawHandle() - 1;
+
+        if (index < sparseInputs.size())
+            return std::addressof (sparseInputs[index]);
+
+        return nullptr;
+    }
+
+    ArrayView<const EndpointRoute> getInputRoutes (EndpointHandle handle) const
+    {
+        auto index = handle.getRawHandle() - 1;
+
+        if (index < inputRoutes.size())
+            return inputRoutes[index];
+
+        return {};
+    }
+
+    const EndpointRoute* getOutputRoute (EndpointHandle handle) const
+    {
+        auto index = handle.getRawHandle() - 1 - inputs.size();
+
+        if (index < outputRoutes.size())
+            return std::addressof (outputRoutes[index]);
+
+        return nullptr;
+    }
+};
+
+//==============================================================================
+struct ThreadedVenue  : public soul::Venue
+{
+    ThreadedVenue (std::unique_ptr<PerformerFactory> p, ThreadedVenueOptions o)
+        : performerFactory (std::move (p)), options (std::move (o)) {}
+
+    ~ThreadedVenue() override {}
+
+    std::unique_ptr<Venue::Session> createSession() override
+    {
+        return std::make_unique<ThreadedVenueSession> (*this, createPerformer());
+    }
+
+    std::unique_ptr<Performer> createPerformer()
+    {
+        if (options.numRenderThreads > 1 || options.bypassSilentProcessors)
+            return std::make_unique<PartitionedPerformer> (*performerFactory, options);
+
+        return performerFactory->createPerformer();
+    }
+
+    std::vector<EndpointDetails> getSourceEndpoints() override    { return {}; }
+    std::vector<EndpointDetails> getSinkEndpoints() override      { return {}; }
+
+    bool connectSessionInputEndpoint (Venue::Session&, EndpointID, EndpointID) override
+    {
+        return false;
+    }
+
+    bool connectSessionOutputEndpoint (Venue::Session&, EndpointID, EndpointID) override
+    {
+        return false;
+    }
+
+    //==============================================================================
+    struct ThreadedVenueSession    : public Venue::Session
+    {
+        ThreadedVenueSession (ThreadedVenue& v, std::unique_ptr<soul::Performer> p)
+            : venue (v), performer (std::move (p)),
+              blocksToRender (static_cast<int> (v.options.renderAheadBlocks) + 2),
+              blocksToDeliver (static_cast<int> (v.options.renderAheadBlocks) + 2)
+        {
+            SOUL_ASSERT (performer != nullptr);
+        }
+
+        ~ThreadedVenueSession() override
+        {
+            unload();
+            venue.sessionDeleted (this);
+        }
+
+        bool load (CompileMessageList& messageList, const Program& p) override
+        {
+            if (p.isEmpty())
+                return false;
+
+            unload();
+            return loadProgram (messageList, p);
+        }
+
+        void loadAsync (const Program& p, BuildProgressFn progress, BuildCompletionFn completion) override
+        {
+            unload();
+            startBuild (std::move (progress), std::move (completion),
+                        [this, p] (CompileMessageList& messageList) { return ! p.isEmpty() && loadProgram (messageList, p); });
+        }
+
+        void cancelBuild() override
+        {
+            if (currentBuild != nullptr)
+                currentBuild->cancel();
+
+            waitForBuildToFinish();
+            currentBuild.reset();
+        }
+
+        void unload() override
+        {
+            cancelBuild();
+            stop();
+            waitForThreadToFinish();
+            cancelOptimisedBuild();
+            performer->unload();
+            loadedProgram = {};
+            endpointIndex.clear();
+            setState (State::empty);
+        }
+
+        bool start() override
+        {
+            if (state != State::linked)
+                return false;
+
+            SOUL_ASSERT (performer->isLinked());
+            waitForThreadToFinish();
+            shouldStop = false;
+            loadMeasurer.reset();
+            blockTimes.reset();
+
+            if (venue.options.renderAheadBlocks > 0)
+            {
+                prepareRenderAhead();
+                renderThread = std::thread ([this] { runRenderAhead(); });
+            }
+            else
+            {
+                renderThread = std::thread ([this] { run(); });
+            }
+
+            setState (State::running);
+            return true;
+        }
+
+        bool isRunning() override
+        {
+            return state == State::running;
+        }
+
+        void stop() override
+        {
+            if (isRunning())
+            {
+                shouldStop = true;
+
+                if (std::this_thread::get_id() != renderThread.get_id()
+                     && std::this_thread::get_id() != callbackThreadID.load())
+                    waitForThreadToFinish();
+
+                totalFramesRendered = 0;
+            }
+        }
+
+        ArrayView<const EndpointDetails> getInputEndpoints() override   { return performer->getInputEndpoints(); }
+        ArrayView<const EndpointDetails> getOutputEndpoints() override  { return performer->getOutputEndpoints(); }
+
+        EndpointHandle getEndpointHandle (const EndpointID& endpointID) override  { return performer->getEndpointHandle (endpointID); }
+        std::vector<EndpointHandle> getEndpointHandles (ArrayView<const EndpointDetails> endpoints) override  { return performer->getEndpointHandles (endpoints); }
+
+        void setNextInputStreamFrames (EndpointHandle handle, const choc::value::ValueView& frameArray) override
+        {
+            if (recordingBlock != nullptr)
+                return recordInput (RenderAheadBlock::InputKind::streamFrames, handle, frameArray, frameArray.size());
+
+            performer->setNextInputStreamFrames (handle, frameArray);
+        }
+
+        bool setNextInputStreamChannels (EndpointHandle handle, choc::buffer::ChannelArrayView<const float> channels) override
+        {
+            if (recordingBlock != nullptr)
+                return false;
+
+            return performer->setNextInputStreamChannels (handle, channels);
+        }
+
+        void setSparseInputStreamTarget (EndpointHandle handle, const choc::value::ValueView& targetFrameValue, uint32_t numFramesToReachValue, float curveShape) override
+        {
+            if (recordingBlock != nullptr)
+                return recordInput (RenderAheadBlock::InputKind::sparseTarget, handle, targetFrameValue, numFramesToReachValue, curveShape);
+
+            performer->setSparseInputStreamTarget (handle, targetFrameValue, numFramesToReachValue, curveShape);
+        }
+
+        void setInputValue (EndpointHandle handle, const choc::value::ValueView& newValue) override
+        {
+            if (recordingBlock != nullptr)
+                return recordInput (RenderAheadBlock::InputKind::value, handle, newValue);
+
+            performer->setInputValue (handle, newValue);
+        }
+
+        void addInputEvent (EndpointHandle handle, const choc::value::ValueView& eventData) override
+        {
+            if (currentCallback != nullptr)
+                currentCallback->countEvents (1);
+
+            if (recordingBlock != nullptr)
+                return recordInput (RenderAheadBlock::InputKind::event, handle, eventData);
+
+            performer->addInputEvent (handle, eventData);
+        }
+
+        choc::value::ValueView getOutputStreamFrames (EndpointHandle handle) override
+        {
+            if (deliveringBlock != nullptr)
+            {
+                auto index = findRenderAheadEndpoint (renderAheadOutputs, handle);
+
+                if (index < 0)
+                    return {};
+
+                auto& endpoint = renderAheadOutputs[static_cast<size_t> (index)];
+                return choc::value::ValueView (endpoint.blockType, deliveringBlock->getFixedData (endpoint.fixedDataOffset), nullptr);
+            }
+
+            return performer->getOutputStreamFrames (handle);
+        }
+
+        void iterateOutputEvents (EndpointHandle handle, Performer::HandleNextOutputEventFn fn) override
+        {
+            if (deliveringBlock != nullptr)
+            {
+                auto index = findRenderAheadEndpoint (renderAheadOutputs, handle);
+                uint64_t numEvents = 0;
+
+                for (auto& e : deliveringBlock->outputEvents)
+                {
+                    if (static_cast<int> (e.endpointIndex) == index)
+                    {
+                        ++numEvents;
+
+                        if (! fn (e.frameOffset, renderAheadOutputs[static_cast<size_t> (index)].eventTypes.getView (e.typeIndex, deliveringBlock->eventData.getData (e.dataOffset))))
+                            break;
+                    }
+                }
+
+                if (currentCallback != nullptr)
+                    currentCallback->countEvents (numEvents);
+
+                return;
+            }
+
+            if (currentCallback == nullptr)
+            {
+                performer->iterateOutputEvents (handle, std::move (fn));
+                return;
+            }
+
+            uint64_t numEvents = 0;
+
+            performer->forEachOutputEvent (handle, [&] (uint32_t frameOffset, const choc::value::ValueView& event) -> bool
+            {
+                ++numEvents;
+                return fn (frameOffset, event);
+            });
+
+            currentCallback->countEvents (numEvents);
+        }
+
+        bool isEndpointActive (const EndpointID& e) override
+        {
+            std::lock_guard<std::mutex> lock (performerLock);
+            return performer->isEndpointActive (e);
+        }
+
+        void setProfilingEnabled (bool shouldProfile) override
+        {
+            std::lock_guard<std::mutex> lock (performerLock);
+            profilingEnabled = shouldProfile;
+            performer->setProfilingEnabled (shouldProfile);
+        }
+
+        std::vector<NodeTiming> getNodeTimings() override
+        {
+            std::lock_guard<std::mutex> lock (performerLock);
+            return performer->getNodeTimings();
+        }
+
+        Performer::MemoryUsage getMemoryUsage() override
+        {
+            std::lock_guard<std::mutex> lock (performerLock);
+            return performer->getMemoryUsage();
+        }
+
+        bool link (CompileMessageList& messageList, const BuildSettings& settings) override
+        {
+            cancelBuild();
+            return linkProgram (messageList, settings);
+        }
+
+        void linkAsync (const BuildSettings& settings, BuildProgressFn progress, BuildCompletionFn completion) override
+        {
+            cancelBuild();
+            startBuild (std::move (progress), std::move (completion),
+                        [this, settings] (CompileMessageList& messageList) { return linkProgram (messageList, settings); });
+        }
+
+        Status getStatus() override
+        {
+            std::lock_guard<std::mutex> lock (performerLock);
+            Status s;
+            s.state = state;
+            s.cpu = loadMeasurer.getCurrentLoad();
+            s.xruns = performer->getXRuns() + renderAheadXRuns.load();
+            return s;
+        }
+
+        Statistics getStatistics() override
+        {
+            std::lock_guard<std::mutex> lock (performerLock);
+            Statistics s;
+            s.xruns = performer->getXRuns() + renderAheadXRuns.load();
+            s.blockTimes = blockTimes.getSnapshot();
+
+            for (auto* callbacks : { &inputCallbacks, &outputCallbacks })
+                for (auto& c : *callbacks)
+                    s.endpoints.push_back ({ c->endpointID, c->numEvents.load (std::memory_order_relaxed) });
+
+            return s;
+        }
+
+        void setStateChangeCallback (StateChangeCallbackFn f) override     { stateChangeCallback = std::move (f); }
+
+        uint32_t getInputToOutputLatency() override                         { return venue.options.renderAheadBlocks * blockSize; }
+
+        uint64_t getTotalFramesRendered() const override                   { return totalFramesRendered; }
+
+        bool setInputEndpointServiceCallback (EndpointID endpoint, EndpointServiceFn callback) override
+        {
+            if (findEndpoint (endpoint, true) == nullptr)
+                return false;
+
+            inputCallbacks.push_back (std::make_unique<EndpointCallback> (endpoint, performer->getEndpointHandle (endpoint), std::move (callback)));
+            return true;
+        }
+
+        bool setOutputEndpointServiceCallback (EndpointID endpoint, EndpointServiceFn callback) override
+        {
+            if (findEndpoint (endpoint, false) == nullptr)
+                return false;
+
+            outputCallbacks.push_back (std::make_unique<EndpointCallback> (endpoint, performer->getEndpointHandle (endpoint), std::move (callback)));
+            return true;
+        }
+
+        bool setInputEndpointServiceCallback (EndpointID endpoint, EndpointServiceFn callback, EndpointFIFOOptions options) override
+        {
+            return addFIFOCallback (inputCallbacks, true, std::move (endpoint), std::move (callback), options);
+        }
+
+        bool setOutputEndpointServiceCallback (EndpointID endpoint, EndpointServiceFn callback, EndpointFIFOOptions options) override
+        {
+            return addFIFOCallback (outputCallbacks, false, std::move (endpoint), std::move (callback), options);
+        }
+
+        bool pushInputFIFOItem (EndpointHandle handle, uint64_t frame, const choc::value::ValueView& value) override
+        {
+            if (auto c = findFIFOCallback (inputCallbacks, handle))
+                return c->fifo->push (frame, value);
+
+            return false;
+        }
+
+        uint32_t pushInputFIFOItems (EndpointHandle handle, uint64_t frame, const choc::value::Type& itemType,
+                                     const void* packedItemData, uint32_t numItems) override
+        {
+            if (auto c = findFIFOCallback (inputCallbacks, handle))
+                return c->fifo->push (frame, itemType, packedItemData, numItems);
+
+            return 0;
+        }
+
+        uint32_t readOutputFIFOItems (EndpointHandle handle, HandleFIFOItemFn handleItem) override
+        {
+            if (auto c = findFIFOCallback (outputCallbacks, handle))
+                return c->fifo->read (std::numeric_limits<uint64_t>::max(), handleItem);
+
+            return 0;
+        }
+
+        std::optional<PackedEndpointLayout> createPackedEndpointLayout (ArrayView<const EndpointID> endpoints) override
+        {
+            if (state != State::linked && state != State::running)
+                return {};
+
+            bool hasInputs = false, hasOutputs = false;
+            PackedEndpointLayout layout;
+
+            for (auto& endpoint : endpoints)
+            {
+                auto input = findEndpoint (endpoint, true);
+                auto isInput = input != nullptr;
+                auto output = isInput ? nullptr : findEndpoint (endpoint, false);
+
+                if (! (isInput || output != nullptr))
+                    return {};
+
+                auto& details = isInput ? *input : *output;
+
+                if (isEvent (details))
+                    return {};
+
+                (isInput ? hasInputs : hasOutputs) = true;
+
+                PackedEndpointLayout::Item item;
+                item.endpointID = endpoint;
+                item.handle = performer->getEndpointHandle (endpoint);
+                item.endpointType = details.endpointType;
+                item.dataType = isStream (details) ? details.getFrameType() : details.getValueType();
+                item.numFrames = isStream (details) ? blockSize : 1;
+                item.offset = (layout.totalSize + 7u) & ~7u;
+                item.size = item.numFrames * static_cast<uint32_t> (item.dataType.getValueDataSize());
+                layout.totalSize = item.offset + item.size;
+                layout.items.push_back (std::move (item));
+            }
+
+            if (hasInputs && hasOutputs)
+                return {};
+
+            return layout;
+        }
+
+        bool setPackedInputCallback (PackedEndpointLayout layout, PackedEndpointServiceFn callback) override
+        {
+            return addPackedCallback (packedInputCallbacks, true, std::move (layout), std::move (callback));
+        }
+
+        bool setPackedOutputCallback (PackedEndpointLayout layout, PackedEndpointServiceFn callback) override
+        {
+            return addPackedCallback (packedOutputCallbacks, false, std::move (layout), std::move (callback));
+        }
+
+    private:
+        ThreadedVenue& venue;
+        std::unique_ptr<Performer> performer;
+        std::thread renderThread, buildThread;
+        std::shared_ptr<BuildMonitor> currentBuild;
+        Program loadedProgram;
+        CPULoadMeasurer loadMeasurer;
+        BlockTimeHistogram blockTimes;
+        StateChangeCallbackFn stateChangeCallback;
+        std::atomic<State> state { State::empty };
+        std::atomic<bool> shouldStop { false };
+        std::atomic<uint64_t> totalFramesRendered { 0 };
+        EndpointIndex endpointIndex;
+        uint32_t blockSize = 0;
+        double sampleRate = 0;
+
+        /** The types of an event or value endpoint, along with a view of each one over a scratch buffer.
+            Items can then be stored as a type index and a block of packed data, and handed back as a
+            view with a single copy, rather than building a new view (and a copy of its type) for each one.
+        */
+        struct PackedEventTypes
+        {
+            PackedEventTypes() = default;
+            PackedEventTypes (PackedEventTypes&&) = default;
+            PackedEventTypes (const PackedEventTypes&) = delete;
+            PackedEventTypes& operator= (PackedEventTypes&&) = default;
+
+            void init (const EndpointDetails& details)
+            {
+                views.clear();
+                sizes.clear();
+                maxDataSize = 0;
+
+                for (auto& type : details.dataTypes)
+                {
+                    sizes.push_back (static_cast<uint32_t> (type.getValueDataSize()));
+                    maxDataSize = std::max (maxDataSize, sizes.back());
+                }
+
+                scratch.resize ((std::max (maxDataSize, 1u) + 7u) / 8u);
+
+                for (auto& type : details.dataTypes)
+                    views.push_back (choc::value::ValueView (type, scratch.data(), nullptr));
+            }
+
+            uint32_t getMaxDataSize() const noexcept                { return maxDataSize; }
+            uint32_t getDataSize (uint32_t typeIndex) const noexcept  { return sizes[typeIndex]; }
+
+            /** Returns the index of a type, or -1 if it isn't one of the endpoint's types.
+                The sizes are checked first, so most mismatches don't need a full comparison.
+            */
+            int findIndex (const choc::value::Type& type) const
+            {
+                auto size = type.getValueDataSize();
+
+                for (size_t i = 0; i < views.size(); ++i)
+                    if (sizes[i] == size && views[i].getType() == type)
+                        return static_cast<int> (i);
+
+                return -1;
+            }
+
+            /** Copies an item's packed data into the scratch buffer, and returns a view of it.
+                The view's contents are only valid until the next call.
+            */
+            const choc::value::ValueView& getView (uint32_t typeIndex, const void* packedData) noexcept
+            {
+                std::memcpy (scratch.data(), packedData, sizes[typeIndex]);
+                return views[typeIndex];
+            }
+
+        private:
+            std::vector<choc::value::ValueView> views;
+            std::vector<uint32_t> sizes;
+            std::vector<uint64_t> scratch;
+            uint32_t maxDataSize = 0;
+        };
+
+        /** A single-reader, single-writer queue of frame-stamped items for an event or value endpoint.
+            Each slot is big enough for the largest of the endpoint's types, and holds the index of
+            the type it contains, so pushing and reading never allocate, and each item only costs a copy
+            of its packed data.
+        */
+        struct EndpointFIFO
+        {
+            EndpointFIFO (const EndpointDetails& details, EndpointFIFOOptions options)
+                : fifo (static_cast<int> (std::max (1u, options.capacity)) + 1),
+                  threshold (options.threshold), isEventEndpoint (isEvent (details))
+            {
+                types.init (details);
+                slotSize = std::max (8u, (types.getMaxDataSize() + 7u) & ~7u);
+
+                auto numSlots = static_cast<size_t> (fifo.getTotalSize());
+                frames.resize (numSlots);
+                typeIndexes.resize (numSlots);
+                data.resize (numSlots * slotSize / 8u);
+                lastValue.resize (slotSize);
+            }
+
+            uint32_t getNumReady() const noexcept       { return static_cast<uint32_t> (fifo.getNumReady()); }
+
+            bool push (uint64_t frame, const choc::value::ValueView& value) noexcept
+            {
+                auto typeIndex = types.findIndex (value.getType());
+                return typeIndex >= 0 && write (frame, static_cast<uint32_t> (typeIndex), value.getRawData(), 1) == 1;
+            }
+
+            /** Pushes a batch of items of the same type, whose data is packed contiguously, returning
+                the number which fitted. The type is only matched once for the whole batch.
+            */
+            uint32_t push (uint64_t frame, const choc::value::Type& type, const void* packedData, uint32_t numItems) noexcept
+            {
+                auto typeIndex = types.findIndex (type);
+                return typeIndex >= 0 ? write (frame, static_cast<uint32_t> (typeIndex), packedData, numItems) : 0;
+            }
+
+            /** Reads items in order until it reaches one whose frame isn't before endFrame. */
+            template <typename HandleItem>
+            uint32_t read (uint64_t endFrame, HandleItem&& handleItem)
+            {
+                uint32_t numRead = 0;
+
+                while (fifo.getNumReady() != 0)
+                {
+                    FIFO::ReadOperation readOp (fifo, 1);
+                    auto slot = static_cast<size_t> (readOp.startIndex1);
+
+                    if (frames[slot] >= endFrame)
+                    {
+                        readOp.cancel();
+                        break;
+                    }
+
+                    handleItem (frames[slot], types.getView (typeIndexes[slot], getSlotData (slot)));
+                    ++numRead;
+                }
+
+                return numRead;
+            }
+
+            /** Pushes an output value if it differs from the last one that was pushed. */
+            bool pushIfChanged (uint64_t frame, const choc::value::ValueView& value) noexcept
+            {
+                auto size = value.getType().getValueDataSize();
+
+                if (hasLastValue && std::memcmp (lastValue.data(), value.getRawData(), size) == 0)
+                    return false;
+
+                if (! push (frame, value))
+                    return false;
+
+                std::memcpy (lastValue.data(), value.getRawData(), size);
+                hasLastValue = true;
+                return true;
+            }
+
+            FIFO fifo;
+            const uint32_t threshold;
+            const bool isEventEndpoint;
+            bool isArmed = true;
+
+        private:
+            PackedEventTypes types;
+            uint32_t slotSize = 8;
+            std::vector<uint64_t> frames;
+            std::vector<uint32_t> typeIndexes;
+            std::vector<uint64_t> data;
+            std::vector<uint8_t> lastValue;
+            bool hasLastValue = false;
+
+            uint8_t* getSlotData (size_t slot)      { return reinterpret_cast<uint8_t*> (data.data()) + slot * slotSize; }
+
+            uint32_t write (uint64_t frame, uint32_t typeIndex, const void* packedData, uint32_t numItems) noexcept
+            {
+                auto numToWrite = std::min (static_cast<int> (numItems), fifo.getFreeSpace());
+
+                if (numToWrite <= 0)
+                    return 0;
+
+                FIFO::WriteOperation writeOp (fifo, numToWrite);
+
+                if (writeOp.failed())
+                    return 0;
+
+                auto size = types.getDataSize (typeIndex);
+                auto source = static_cast<const uint8_t*> (packedData);
+
+                auto writeSlots = [&] (int startSlot, int numSlots)
+                {
+                    for (int i = 0; i < numSlots; ++i)
+                    {
+                        auto slot = static_cast<size_t> (startSlot + i);
+                        frames[slot] = frame;
+                        typeIndexes[slot] = typeIndex;
+                        std::memcpy (getSlotData (slot), source, size);
+                        source += size;
+                    }
+                };
+
+                writeSlots (writeOp.startIndex1, writeOp.blockSize1);
+                writeSlots (0, writeOp.blockSize2);
+                return static_cast<uint32_t> (numToWrite);
+            }
+        };
+
+        struct EndpointCallback
+        {
+            EndpointCallback (EndpointID id, EndpointHandle h, EndpointServiceFn fn)
+                : endpointID (std::move (id)), endpointHandle (h), callback (std::move (fn)) {}
+
+            // Only the render thread changes this, so it doesn't need an atomic increment
+            void countEvents (uint64_t num) noexcept    { numEvents.store (numEvents.load (std::memory_order_relaxed) + num, std::memory_order_relaxed); }
+
+            EndpointID endpointID;
+            EndpointHandle endpointHandle;
+            EndpointServiceFn callback;
+            std::atomic<uint64_t> numEvents { 0 };
+            std::unique_ptr<EndpointFIFO> fifo;
+        };
+
+        std::vector<std::unique_ptr<EndpointCallback>> inputCallbacks, outputCallbacks;
+        EndpointCallback* currentCallback = nullptr;
+
+        /** Holds the buffer for a packed callback, along with a view of each endpoint's part of it. */
+        struct PackedCallback
+        {
+            PackedCallback (PackedEndpointLayout l, PackedEndpointServiceFn fn)
+                : layout (std::move (l)), callback (std::move (fn)), buffer ((layout.totalSize + 7u) / 8u)
+            {
+                for (auto& item : layout.items)
+                {
+                    auto data = getData() + item.offset;
+
+                    if (isStream (item.endpointType))
+                        views.push_back (choc::value::ValueView (choc::value::Type::createArray (item.dataType, item.numFrames), data, nullptr));
+                    else
+                        views.push_back (choc::value::ValueView (item.dataType, data, nullptr));
+                }
+            }
+
+            uint8_t* getData()      { return reinterpret_cast<uint8_t*> (buffer.data()); }
+
+            void sendInputs (Session& session, Performer& p)
+            {
+                callback (session, buffer.data());
+
+                for (size_t i = 0; i < views.size(); ++i)
+                    applyInput (p, layout.items[i], views[i]);
+            }
+
+            void receiveOutputs (Session& session, Performer& p)
+            {
+                captureOutputs (p, getData());
+                callback (session, buffer.data());
+            }
+
+            /** Passes a packed block of input data that isn't in this object's own buffer to the performer. */
+            void applyInputs (Performer& p, uint8_t* data)
+            {
+                for (size_t i = 0; i < views.size(); ++i)
+                    applyInput (p, layout.items[i], choc::value::ValueView (views[i].getType(), data + layout.items[i].offset, nullptr));
+            }
+
+            /** Copies the performer's output data into a packed block. */
+            void captureOutputs (Performer& p, uint8_t* data)
+            {
+                for (auto& item : layout.items)
+                {
+                    auto source = isStream (item.endpointType) ? p.getOutputStreamFrames (item.handle)
+                                                               : p.getOutputValue (item.handle);
+                    auto dest = data + item.offset;
+
+                    if (source.getRawData() != nullptr)
+                        memcpy (dest, source.getRawData(), std::min (static_cast<size_t> (item.size), source.getType().getValueDataSize()));
+                    else
+                        memset (dest, 0, item.size);
+                }
+            }
+
+            static void applyInput (Performer& p, const PackedEndpointLayout::Item& item, const choc::value::ValueView& view)
+            {
+                if (isStream (item.endpointType))
+                    p.setNextInputStreamFrames (item.handle, view);
+                else
+                    p.setInputValue (item.handle, view);
+            }
+
+            PackedEndpointLayout layout;
+            PackedEndpointServiceFn callback;
+            std::vector<uint64_t> buffer;
+            std::vector<choc::value::ValueView> views;
+        };
+
+        std::vector<std::unique_ptr<PackedCallback>> packedInputCallbacks, packedOutputCallbacks;
+
+        bool addPackedCallback (std::vector<std::unique_ptr<PackedCallback>>& list, bool isInput,
+                                PackedEndpointLayout layout, PackedEndpointServiceFn callback)
+        {
+            for (auto& item : layout.items)
+            {
+                auto endpoint = findEndpoint (item.endpointID, isInput);
+
+                if (endpoint == nullptr)
+                    return false;
+
+                auto& details = *endpoint;
+
+                // A layout made before the program was re-linked may no longer match its block size
+                if (isEvent (details) || item.endpointType != details.endpointType
+                     || item.numFrames != (isStream (details) ? blockSize : 1u)
+                     || item.offset + item.size > layout.totalSize)
+                    return false;
+            }
+
+            list.push_back (std::make_unique<PackedCallback> (std::move (layout), std::move (callback)));
+            return true;
+        }
+
+        //==============================================================================
+        /** A growable block of 8-byte aligned data, which is emptied rather than freed between uses. */
+        struct DataArena
+        {
+            size_t add (const void* source, size_t size)
+            {
+                auto offset = used;
+                used += (size + 7u) & ~size_t (7);
+
+                if (space.size() * 8u < used)
+                    space.resize (std::max (used / 8u, space.size() * 2u));
+
+                std::memcpy (getData (offset), source, size);
+                return offset;
+            }
+
+            uint8_t* getData (size_t offset)        { return reinterpret_cast<uint8_t*> (space.data()) + offset; }
+
+            std::vector<uint64_t> space;
+            size_t used = 0;
+        };
+
+        /** In render-ahead mode, one of the ring of blocks which are passed between the callback thread
+            and the render thread. The callback thread records the block's inputs, the render thread plays
+            them into the performer and captures its outputs, and the callback thread then delivers those.
+        */
+        struct RenderAheadBlock
+        {
+            enum class InputKind { streamFrames, sparseTarget, value, event };
+
+            struct Input
+            {
+                InputKind kind;
+                uint32_t endpointIndex, typeIndex, numFrames;
+                float curveShape;
+                size_t dataOffset;
+            };
+
+            struct OutputEvent
+            {
+                uint32_t endpointIndex, frameOffset, typeIndex;
+                size_t dataOffset;
+            };
+
+            uint8_t* getFixedData (size_t offset)   { return reinterpret_cast<uint8_t*> (fixedData.data()) + offset; }
+
+            std::vector<Input> inputs;
+            std::vector<OutputEvent> outputEvents;
+            DataArena inputData, eventData;
+            std::vector<uint64_t> fixedData;   // output streams and values, and the packed callbacks' buffers
+        };
+
+        struct RenderAheadEndpoint
+        {
+            EndpointHandle handle;
+            EndpointDetails details;
+            choc::value::Type blockType;   // a stream's array of frames for one block, or a value's type
+            size_t fixedDataOffset = 0;
+            PackedEventTypes eventTypes;
+        };
+
+        std::vector<RenderAheadBlock> renderAheadBlocks;
+        std::vector<RenderAheadEndpoint> renderAheadInputs, renderAheadOutputs;
+        std::vector<size_t> packedInputOffsets, packedOutputOffsets;
+        FIFO blocksToRender, blocksToDeliver;
+        RenderAheadBlock* recordingBlock = nullptr;
+        RenderAheadBlock* deliveringBlock = nullptr;
+        std::thread callbackThread;
+        std::atomic<std::thread::id> callbackThreadID;
+        std::atomic<uint32_t> renderAheadXRuns { 0 };
+
+        static int findRenderAheadEndpoint (const std::vector<RenderAheadEndpoint>& endpoints, EndpointHandle handle)
+        {
+            for (size_t i = 0; i < endpoints.size(); ++i)
+                if (endpoints[i].handle == handle)
+                    return static_cast<int> (i);
+
+            return -1;
+        }
+
+        /** Works out the layout of the blocks in the ring, and allocates them, before the threads start. */
+        void prepareRenderAhead()
+        {
+            renderAheadInputs.clear();
+            renderAheadOutputs.clear();
+            packedInputOffsets.clear();
+            packedOutputOffsets.clear();
+            renderAheadXRuns = 0;
+            blocksToRender.reset();
+            blocksToDeliver.reset();
+
+            size_t fixedDataSize = 0;
+
+            auto allocateFixedData = [&] (size_t size)
+            {
+                auto offset = fixedDataSize;
+                fixedDataSize += (size + 7u) & ~size_t (7);
+                return offset;
+            };
+
+            auto addEndpoint = [&] (std::vector<RenderAheadEndpoint>& list, const EndpointDetails& details)
+            {
+                RenderAheadEndpoint endpoint;
+                endpoint.handle = performer->getEndpointHandle (details.endpointID);
+                endpoint.details = details;
+
+                if (isEvent (details))
+                {
+                    endpoint.eventTypes.init (details);
+                }
+                else
+                {
+                    endpoint.blockType = isStream (details) ? choc::value::Type::createArray (details.getFrameType(), blockSize)
+                                                            : details.getValueType();
+                    endpoint.fixedDataOffset = allocateFixedData (endpoint.blockType.getValueDataSize());
+                }
+
+                list.push_back (std::move (endpoint));
+            };
+
+            for (auto& details : performer->getInputEndpoints())
+                addEndpoint (renderAheadInputs, details);
+
+            for (auto& c : outputCallbacks)
+                if (c->fifo == nullptr && findRenderAheadEndpoint (renderAheadOutputs, c->endpointHandle) < 0)
+                    addEndpoint (renderAheadOutputs, *findEndpoint (c->endpointID, false));
+
+            for (auto& c : packedInputCallbacks)
+                packedInputOffsets.push_back (allocateFixedData (c->layout.totalSize));
+
+            for (auto& c : packedOutputCallbacks)
+                packedOutputOffsets.push_back (allocateFixedData (c->layout.totalSize));
+
+            renderAheadBlocks.resize (static_cast<size_t> (blocksToRender.getTotalSize()));
+
+            for (auto& b : renderAheadBlocks)
+            {
+                b.fixedData.assign (fixedDataSize / 8u, 0);
+                b.inputs.reserve (renderAheadInputs.size() * 4u);
+                b.outputEvents.reserve (64);
+            }
+        }
+
+        /** Called on the callback thread by the session's input methods, while the input callbacks are making them. */
+        void recordInput (RenderAheadBlock::InputKind kind, EndpointHandle handle, const choc::value::ValueView& value,
+                          uint32_t numFrames = 0, float curveShape = 0)
+        {
+            auto index = findRenderAheadEndpoint (renderAheadInputs, handle);
+
+            if (index < 0 || value.getRawData() == nullptr || value.getType().usesStrings())
+                return;
+
+            uint32_t typeIndex = 0;
+
+            if (kind == RenderAheadBlock::InputKind::event)
+            {
+                auto foundIndex = renderAheadInputs[static_cast<size_t> (index)].eventTypes.findIndex (value.getType());
+
+                if (foundIndex < 0)
+                    return;
+
+                typeIndex = static_cast<uint32_t> (foundIndex);
+            }
+
+            auto dataOffset = recordingBlock->inputData.add (value.getRawData(), value.getType().getValueDataSize());
+            recordingBlock->inputs.push_back ({ kind, static_cast<uint32_t> (index), typeIndex, numFrames, curveShape, dataOffset });
+        }
+
+        /** Runs on the callback thread, making the input callbacks for a block and recording what they provide. */
+        void recordInputs (RenderAheadBlock& block)
+        {
+            block.inputs.clear();
+            block.inputData.used = 0;
+            recordingBlock = std::addressof (block);
+
+            for (auto& c : inputCallbacks)
+                if (c->fifo == nullptr)
+                    serviceEndpoint (*c);
+
+            for (size_t i = 0; i < packedInputCallbacks.size(); ++i)
+                packedInputCallbacks[i]->callback (*this, block.getFixedData (packedInputOffsets[i]));
+
+            recordingBlock = nullptr;
+        }
+
+        /** Runs on the callback thread, giving the output callbacks the data that the render thread captured for a block. */
+        void deliverOutputs (RenderAheadBlock& block)
+        {
+            deliveringBlock = std::addressof (block);
+
+            for (auto& c : outputCallbacks)
+                if (c->fifo == nullptr)
+                    serviceEndpoint (*c);
+
+            for (size_t i = 0; i < packedOutputCallbacks.size(); ++i)
+                packedOutputCallbacks[i]->callback (*this, block.getFixedData (packedOutputOffsets[i]));
+
+            deliveringBlock = nullptr;
+        }
+
+        /** Runs on the render thread, playing a block's recorded inputs into the performer and capturing its outputs. */
+        void renderAheadBlock (RenderAheadBlock& block)
+        {
+            SOUL_TRACE_SCOPE ("render", "render block")
+            loadMeasurer.startMeasurement();
+            auto blockStart = std::chrono::steady_clock::now();
+
+            if (optimisedPerformerReady.load (std::memory_order_acquire))
+                swapInOptimisedPerformer();
+
+            performer->prepare (blockSize);
+            uint64_t blockStartFrame = totalFramesRendered;
+
+            for (auto& c : inputCallbacks)
+                if (c->fifo != nullptr)
+                    serviceInputFIFO (*c, *c->fifo, blockStartFrame + blockSize);
+
+            for (auto& input : block.inputs)
+            {
+                auto& endpoint = renderAheadInputs[input.endpointIndex];
+                auto data = block.inputData.getData (input.dataOffset);
+
+                switch (input.kind)
+                {
+                    case RenderAheadBlock::InputKind::streamFrames:
+                        if (input.numFrames == blockSize)
+                            performer->setNextInputStreamFrames (endpoint.handle, choc::value::ValueView (endpoint.blockType, data, nullptr));
+                        else
+                            performer->setNextInputStreamFrames (endpoint.handle, choc::value::ValueView (choc::value::Type::createArray (endpoint.details.getFrameType(), input.numFrames), data, nullptr));
+
+                        break;
+
+                    case RenderAheadBlock::InputKind::sparseTarget:
+                        performer->setSparseInputStreamTarget (endpoint.handle, choc::value::ValueView (endpoint.details.getFrameType(), data, nullptr),
+                                                               input.numFrames, input.curveShape);
+                        break;
+
+                    case RenderAheadBlock::InputKind::value:
+                        performer->setInputValue (endpoint.handle, choc::value::ValueView (endpoint.blockType, data, nullptr));
+                        break;
+
+                    case RenderAheadBlock::InputKind::event:
+                        performer->addInputEvent (endpoint.handle, endpoint.eventTypes.getView (input.typeIndex, data));
+                        break;
+                }
+            }
+
+            for (size_t i = 0; i < packedInputCallbacks.size(); ++i)
+                packedInputCallbacks[i]->applyInputs (*performer, block.getFixedData (packedInputOffsets[i]));
 
-        bool load (CompileMessageList& messageList, const Program& p) override
-        {
-            if (! p.isEmpty())
+            performer->advance();
+
+            for (auto& c : outputCallbacks)
+                if (c->fifo != nullptr)
+                    serviceOutputFIFO (*c, *c->fifo, blockStartFrame);
+
+            block.outputEvents.clear();
+            block.eventData.used = 0;
+
+            for (uint32_t i = 0; i < renderAheadOutputs.size(); ++i)
             {
-                unload();
+                auto& endpoint = renderAheadOutputs[i];
 
-                if (performer->load (messageList, p))
+                if (isEvent (endpoint.details))
                 {
-                    setState (State::loaded);
-                    return true;
+                    performer->forEachOutputEvent (endpoint.handle, [&] (uint32_t frameOffset, const choc::value::ValueView& event) -> bool
+                    {
+                        auto typeIndex = endpoint.eventTypes.findIndex (event.getType());
+
+                        if (typeIndex >= 0)
+                        {
+                            auto dataOffset = block.eventData.add (event.getRawData(), endpoint.eventTypes.getDataSize (static_cast<uint32_t> (typeIndex)));
+                            block.outputEvents.push_back ({ i, frameOffset, static_cast<uint32_t> (typeIndex), dataOffset });
+                        }
+
+                        return true;
+                    });
+                }
+                else
+                {
+                    auto source = isStream (endpoint.details) ? performer->getOutputStreamFrames (endpoint.handle)
+                                                              : performer->getOutputValue (endpoint.handle);
+                    auto dest = block.getFixedData (endpoint.fixedDataOffset);
+                    auto size = endpoint.blockType.getValueDataSize();
+
+                    if (source.getRawData() != nullptr)
+                        memcpy (dest, source.getRawData(), std::min (size, source.getType().getValueDataSize()));
+                    else
+                        memset (dest, 0, size);
                 }
             }
 
-            return false;
+            for (size_t i = 0; i < packedOutputCallbacks.size(); ++i)
+                packedOutputCallbacks[i]->captureOutputs (*performer, block.getFixedData (packedOutputOffsets[i]));
+
+            totalFramesRendered += blockSize;
+            blockTimes.addMeasurement (std::chrono::steady_clock::now() - blockStart);
+            loadMeasurer.stopMeasurement();
         }
 
-        void unload() override
+        void waitForThreadToFinish()
         {
-            stop();
-            waitForThreadToFinish();
-            performer->unload();
-            setState (State::empty);
+            SOUL_ASSERT (std::this_thread::get_id() != renderThread.get_id());
+
+            if (renderThread.joinable())
+            {
+                renderThread.join();
+                renderThread = {};
+            }
         }
 
-        bool start() override
+        // The performer's state is allocated while it's being loaded and linked, so if the
+        // venue has a NUMA node, that's where those allocations are directed
+        bool loadProgram (CompileMessageList& messageList, const Program& p)
         {
-            if (state != State::linked)
+            ScopedNUMANode numaNode (venue.options.numaNode);
+
+            if (! performer->load (messageList, p))
                 return false;
 
-            SOUL_ASSERT (performer->isLinked());
-            waitForThreadToFinish();
-            shouldStop = false;
-            loadMeasurer.reset();
-            renderThread = std::thread ([this] { run(); });
-            setState (State::running);
+            loadedProgram = p;
+            endpointIndex.build (performer->getInputEndpoints(), performer->getOutputEndpoints());
+            setState (State::loaded);
             return true;
         }
 
-        bool isRunning() override
+        bool linkProgram (CompileMessageList& messageList, const BuildSettings& settings)
         {
-            return state == State::running;
+            ScopedNUMANode numaNode (venue.options.numaNode);
+
+            if (state != State::loaded || ! performer->link (messageList, settings, {}))
+                return false;
+
+            blockSize = performer->getBlockSize();
+            sampleRate = settings.sampleRate;
+            setState (State::linked);
+
+            if (venue.options.tieredCompilation)
+                startOptimisedBuild (settings);
+
+            return true;
         }
 
-        void stop() override
+        //==============================================================================
+        // Tiered compilation: the program is first linked as it was loaded, and then this
+        // thread re-optimises it and builds a second performer, which the render thread
+        // swaps in at the start of a block.
+        std::thread optimiserThread;
+        std::shared_ptr<BuildMonitor> optimisedBuild;
+        std::unique_ptr<Performer> optimisedPerformer, retiredPerformer;
+        PerformerStateTransfer stateTransfer;
+        std::atomic<bool> optimisedPerformerReady { false };
+        std::mutex performerLock;
+        bool profilingEnabled = false;
+
+        void startOptimisedBuild (const BuildSettings& settings)
         {
-            if (isRunning())
+            // The render thread isn't running yet, so this is a safe moment to find out which
+            // endpoints are in use, as the new performer will need to activate the same ones
+            std::vector<std::pair<EndpointID, EndpointHandle>> activeEndpoints;
+
+            for (auto endpoints : { performer->getInputEndpoints(), performer->getOutputEndpoints() })
+                for (auto& e : endpoints)
+                    if (performer->isEndpointActive (e.endpointID))
+                        activeEndpoints.push_back ({ e.endpointID, performer->getEndpointHandle (e.endpointID) });
+
+            auto monitor = std::make_shared<BuildMonitor>();
+            optimisedBuild = monitor;
+
+            optimiserThread = std::thread ([this, monitor, settings, activeEndpoints = std::move (activeEndpoints)]
             {
-                shouldStop = true;
+                if (auto p = createOptimisedPerformer (settings, activeEndpoints, monitor))
+                {
+                    optimisedPerformer = std::move (p);
+                    optimisedPerformerReady.store (true, std::memory_order_release);
+                }
+            });
+        }
 
-                if (std::this_thread::get_id() != renderThread.get_id())
-                    waitForThreadToFinish();
+        std::unique_ptr<Performer> createOptimisedPerformer (BuildSettings settings,
+                                                             const std::vector<std::pair<EndpointID, EndpointHandle>>& activeEndpoints,
+                                                             const std::shared_ptr<BuildMonitor>& monitor)
+        {
+            CompileMessageList messageList;
+            Program program;
 
-                totalFramesRendered = 0;
+            try
+            {
+                CompileMessageHandler handler (messageList);
+                settings.optimisationLevel = venue.options.tieredOptimisationLevel;
+                program = loadedProgram.clone();
+                Compiler::optimise (program, settings);
             }
-        }
+            catch (AbortCompilationException) { return {}; }
 
-        ArrayView<const EndpointDetails> getInputEndpoints() override   { return performer->getInputEndpoints(); }
-        ArrayView<const EndpointDetails> getOutputEndpoints() override  { return performer->getOutputEndpoints(); }
+            ScopedNUMANode numaNode (venue.options.numaNode);
+            auto newPerformer = venue.createPerformer();
 
-        EndpointHandle getEndpointHandle (const EndpointID& endpointID) override  { return performer->getEndpointHandle (endpointID); }
+            if (newPerformer == nullptr || monitor->isCancelled() || ! newPerformer->load (messageList, program))
+                return {};
 
-        void setNextInputStreamFrames (EndpointHandle handle, const choc::value::ValueView& frameArray) override
-        {
-            performer->setNextInputStreamFrames (handle, frameArray);
+            for (auto& e : activeEndpoints)
+                if (newPerformer->getEndpointHandle (e.first) != e.second)
+                    return {};
+
+            newPerformer->setBuildMonitor (monitor);
+
+            if (! newPerformer->link (messageList, settings, {}) || newPerformer->getBlockSize() != blockSize)
+                return {};
+
+            newPerformer->setBuildMonitor ({});
+            newPerformer->setProfilingEnabled (profilingEnabled);
+
+            if (monitor->isCancelled() || ! stateTransfer.prepare (*performer, *newPerformer))
+                return {};
+
+            return newPerformer;
         }
 
-        void setSparseInputStreamTarget (EndpointHandle handle, const choc::value::ValueView& targetFrameValue, uint32_t numFramesToReachValue, float curveShape) override
+        // Called by the render thread between blocks
+        void swapInOptimisedPerformer() noexcept
         {
-            performer->setSparseInputStreamTarget (handle, targetFrameValue, numFramesToReachValue, curveShape);
+            std::unique_lock<std::mutex> lock (performerLock, std::try_to_lock);
+
+            if (! lock.owns_lock())
+                return;  // another thread is using the performer, so try again on the next block
+
+            if (stateTransfer.apply (*performer, *optimisedPerformer))
+            {
+                retiredPerformer = std::move (performer);
+                performer = std::move (optimisedPerformer);
+            }
+
+            optimisedPerformerReady = false;
         }
 
-        void setInputValue (EndpointHandle handle, const choc::value::ValueView& newValue) override
+        void cancelOptimisedBuild()
         {
-            performer->setInputValue (handle, newValue);
+            SOUL_ASSERT (! renderThread.joinable());
+
+            if (optimisedBuild != nullptr)
+                optimisedBuild->cancel();
+
+            if (optimiserThread.joinable())
+                optimiserThread.join();
+
+            optimisedBuild.reset();
+            optimisedPerformerReady = false;
+            optimisedPerformer.reset();
+            retiredPerformer.reset();
+            stateTransfer.clear();
         }
 
-        void addInputEvent (EndpointHandle handle, const choc::value::ValueView& eventData) override
+        void startBuild (BuildProgressFn progress, BuildCompletionFn completion,
+                         std::function<bool (CompileMessageList&)> build)
         {
-            performer->addInputEvent (handle, eventData);
+            waitForBuildToFinish();
+            auto monitor = std::make_shared<BuildMonitor>();
+            monitor->progressCallback = std::move (progress);
+            currentBuild = monitor;
+
+            buildThread = std::thread ([this, monitor, completion = std::move (completion), build = std::move (build)]
+            {
+                CompileMessageList messageList;
+                performer->setBuildMonitor (monitor);
+                auto succeeded = build (messageList);
+                performer->setBuildMonitor ({});
+
+                if (completion != nullptr)
+                    completion (succeeded, messageList);
+            });
         }
 
-        choc::value::ValueView getOutputStreamFrames (EndpointHandle handle) override
+        void waitForBuildToFinish()
         {
-            return performer->getOutputStreamFrames (handle);
+            if (buildThread.joinable())
+            {
+                // If this is being called from a completion callback, the build thread has
+                // nothing left to do once the callback returns, so it can be left to finish
+                if (std::this_thread::get_id() == buildThread.get_id())
+                    buildThread.detach();
+                else
+                    buildThread.join();
+
+                buildThread = {};
+            }
         }
 
-        void iterateOutputEvents (EndpointHandle handle, Performer::HandleNextOutputEventFn fn) override
+        void setState (State newState)
         {
-            performer->iterateOutputEvents (handle, std::move (fn));
+            if (state != newState)
+            {
+                state = newState;
+
+                if (stateChangeCallback != nullptr)
+                    stateChangeCallback (state);
+            }
         }
 
-        bool isEndpointActive (const EndpointID& e) override
+        void handleError (const std::string&)
         {
-            return performer->isEndpointActive (e);
         }
 
-        bool link (CompileMessageList& messageList, const BuildSettings& settings) override
+        /** Returns the details of one of the performer's inputs or outputs, or nullptr if it isn't in that list. */
+        const EndpointDetails* findEndpoint (const EndpointID& endpointID, bool isInput)
         {
-            if (state == State::loaded && performer->link (messageList, settings, {}))
-            {
-                blockSize = performer->getBlockSize();
-                setState (State::linked);
-                return true;
-            }
+            if (auto position = isInput ? endpointIndex.findInput (endpointID) : endpointIndex.findOutput (endpointID))
+                return std::addressof ((isInput ? performer->getInputEndpoints() : performer->getOutputEndpoints())[*position]);
 
-            return false;
+            return nullptr;
         }
 
-        Status getStatus() override
+        void serviceEndpoint (EndpointCallback& c)
         {
-            Status s;
-            s.state = state;
-            s.cpu = loadMeasurer.getCurrentLoad();
-            s.xruns = performer->getXRuns();
-            return s;
+            currentCallback = std::addressof (c);
+            c.callback (*this, c.endpointHandle);
+            currentCallback = nullptr;
         }
 
-        void setStateChangeCallback (StateChangeCallbackFn f) override     { stateChangeCallback = std::move (f); }
-
-        uint64_t getTotalFramesRendered() const override                   { return totalFramesRendered; }
-
-        bool setInputEndpointServiceCallback (EndpointID endpoint, EndpointServiceFn callback) override
+        bool addFIFOCallback (std::vector<std::unique_ptr<EndpointCallback>>& callbacks, bool isInput,
+                              EndpointID endpoint, EndpointServiceFn callback, EndpointFIFOOptions options)
         {
-            if (! containsEndpoint (performer->getInputEndpoints(), endpoint))
+            auto found = findEndpoint (endpoint, isInput);
+
+            if (found == nullptr)
                 return false;
 
-            inputCallbacks.push_back ({ performer->getEndpointHandle (endpoint), std::move (callback) });
-            return true;
-        }
+            auto& details = *found;
 
-        bool setOutputEndpointServiceCallback (EndpointID endpoint, EndpointServiceFn callback) override
-        {
-            if (! containsEndpoint (performer->getOutputEndpoints(), endpoint))
+            if (isStream (details))
                 return false;
 
-            outputCallbacks.push_back ({ performer->getEndpointHandle (endpoint), std::move (callback) });
+            for (auto& type : details.dataTypes)
+                if (type.usesStrings())
+                    return false;
+
+            auto c = std::make_unique<EndpointCallback> (endpoint, performer->getEndpointHandle (endpoint), std::move (callback));
+            c->fifo = std::make_unique<EndpointFIFO> (details, options);
+            callbacks.push_back (std::move (c));
             return true;
         }
 
-    private:
-        ThreadedVenue& venue;
-        std::unique_ptr<Performer> performer;
-        std::thread renderThread;
-        CPULoadMeasurer loadMeasurer;
-        StateChangeCallbackFn stateChangeCallback;
-        std::atomic<State> state { State::empty };
-        std::atomic<bool> shouldStop { false };
-        std::atomic<uint64_t> totalFramesRendered { 0 };
-        uint32_t blockSize = 0;
-
-        struct EndpointCallback
+        static EndpointCallback* findFIFOCallback (std::vector<std::unique_ptr<EndpointCallback>>& callbacks, EndpointHandle handle)
         {
-            EndpointHandle endpointHandle;
-            EndpointServiceFn callback;
-        };
+            for (auto& c : callbacks)
+                if (c->endpointHandle == handle && c->fifo != nullptr)
+                    return c.get();
 
-        std::vector<EndpointCallback> inputCallbacks, outputCallbacks;
+            return nullptr;
+        }
 
-        void waitForThreadToFinish()
+        /** Gives a starved input FIFO's client the chance to top it up, then passes on the items due in this block. */
+        void serviceInputFIFO (EndpointCallback& c, EndpointFIFO& fifo, uint64_t blockEndFrame)
         {
-            SOUL_ASSERT (std::this_thread::get_id() != renderThread.get_id());
+            auto numReady = fifo.getNumReady();
 
-            if (renderThread.joinable())
+            if (numReady > fifo.threshold)
             {
-                renderThread.join();
-                renderThread = {};
+                fifo.isArmed = true;
+            }
+            else if (fifo.isArmed)
+            {
+                fifo.isArmed = false;
+                serviceEndpoint (c);
             }
+
+            if (numReady == 0 && fifo.getNumReady() == 0)
+                return;
+
+            c.countEvents (fifo.read (blockEndFrame, [&] (uint64_t, const choc::value::ValueView& item)
+            {
+                if (fifo.isEventEndpoint)
+                    performer->addInputEvent (c.endpointHandle, item);
+                else
+                    performer->setInputValue (c.endpointHandle, item);
+            }));
         }
 
-        void setState (State newState)
+        /** Queues the block's output events or value change, and calls the client if that's taken the FIFO to its threshold. */
+        void serviceOutputFIFO (EndpointCallback& c, EndpointFIFO& fifo, uint64_t blockStartFrame)
         {
-            if (state != newState)
+            uint64_t numAdded = 0;
+
+            if (fifo.isEventEndpoint)
             {
-                state = newState;
+                performer->forEachOutputEvent (c.endpointHandle, [&] (uint32_t frameOffset, const choc::value::ValueView& event) -> bool
+                {
+                    if (fifo.push (blockStartFrame + frameOffset, event))
+                        ++numAdded;
 
-                if (stateChangeCallback != nullptr)
-                    stateChangeCallback (state);
+                    return true;
+                });
+            }
+            else if (fifo.pushIfChanged (blockStartFrame, performer->getOutputValue (c.endpointHandle)))
+            {
+                numAdded = 1;
+            }
+
+            if (numAdded != 0)
+            {
+                c.countEvents (numAdded);
+
+                if (fifo.getNumReady() >= std::max (1u, fifo.threshold))
+                    serviceEndpoint (c);
             }
         }
 
-        void handleError (const std::string&)
+        /** Waits until it's time to render the next block, as determined by the venue's pacing option. */
+        bool waitForNextBlock (std::chrono::steady_clock::time_point& nextBlockTime)
         {
+            auto& options = venue.options;
+
+            if (options.pacing == ThreadedVenueOptions::Pacing::externalSync)
+                return options.waitForNextBlock == nullptr || options.waitForNextBlock();
+
+            if (options.pacing == ThreadedVenueOptions::Pacing::realtimeClock && sampleRate > 0)
+            {
+                auto blockLength = std::chrono::duration_cast<std::chrono::steady_clock::duration> (std::chrono::duration<double> (blockSize / sampleRate));
+                auto now = std::chrono::steady_clock::now();
+
+                // If rendering has fallen more than a block behind, re-sync rather than trying to catch up
+                if (nextBlockTime < now - blockLength)
+                    nextBlockTime = now;
+
+                std::this_thread::sleep_until (nextBlockTime);
+                nextBlockTime += blockLength;
+            }
+
+            return true;
         }
 
         void run()
         {
+            applyRenderThreadOptions (venue.options, 0);
+            std::optional<ScopedDisableDenormals> disableDenormals;
+
+            if (venue.options.flushDenormalsToZero)
+                disableDenormals.emplace();
+
+            auto nextBlockTime = std::chrono::steady_clock::now();
+
             try
             {
-                while (! shouldStop.load())
+                while (! shouldStop.load() && waitForNextBlock (nextBlockTime))
                 {
+                    SOUL_TRACE_SCOPE ("render", "render block")
                     loadMeasurer.startMeasurement();
+                    auto blockStart = std::chrono::steady_clock::now();
+
+                    if (optimisedPerformerReady.load (std::memory_order_acquire))
+                        swapInOptimisedPerformer();
+
                     performer->prepare (blockSize);
 
+                    uint64_t blockStartFrame = totalFramesRendered;
+
                     for (auto& c : inputCallbacks)
-                        c.callback (*this, c.endpointHandle);
+                    {
+                        if (c->fifo != nullptr)
+                            serviceInputFIFO (*c, *c->fifo, blockStartFrame + blockSize);
+                        else
+                            serviceEndpoint (*c);
+                    }
+
+                    for (auto& c : packedInputCallbacks)
+                        c->sendInputs (*this, *performer);
 
                     performer->advance();
 
                     for (auto& c : outputCallbacks)
-                        c.callback (*this, c.endpointHandle);
+                    {
+                        if (c->fifo != nullptr)
+                            serviceOutputFIFO (*c, *c->fifo, blockStartFrame);
+                        else
+                            serviceEndpoint (*c);
+                    }
+
+                    for (auto& c : packedOutputCallbacks)
+                        c->receiveOutputs (*this, *performer);
 
                     totalFramesRendered += blockSize;
+                    blockTimes.addMeasurement (std::chrono::steady_clock::now() - blockStart);
                     loadMeasurer.stopMeasurement();
                 }
             }
@@ -280,10 +2481,138 @@ struct ThreadedVenue  : public soul::Venue
 
             setState (State::linked);
         }
+
+        /** The render thread's loop in render-ahead mode, which renders each block as soon as its
+            inputs have been recorded. It starts the callback thread, and stops it when it finishes.
+        */
+        void runRenderAhead()
+        {
+            applyRenderThreadOptions (venue.options, 0);
+            std::optional<ScopedDisableDenormals> disableDenormals;
+
+            if (venue.options.flushDenormalsToZero)
+                disableDenormals.emplace();
+
+            callbackThread = std::thread ([this] { runRenderAheadCallbacks(); });
+
+            try
+            {
+                while (! shouldStop.load())
+                {
+                    {
+                        FIFO::ReadOperation read (blocksToRender, 1, std::chrono::high_resolution_clock::now() + std::chrono::milliseconds (100));
+
+                        if (read.failed())
+                            continue;
+
+                        renderAheadBlock (renderAheadBlocks[static_cast<size_t> (read.startIndex1)]);
+                    }
+
+                    // The block is only passed on once the read has finished, so the callback thread
+                    // never sees it delivered while it's still taking up space in blocksToRender
+                    FIFO::WriteOperation write (blocksToDeliver, 1);
+                    SOUL_ASSERT (! write.failed());
+                }
+            }
+            catch (choc::value::Error e)
+            {
+                handleError (e.description);
+            }
+            catch (...)
+            {
+                handleError ("Uncaught exception");
+            }
+
+            shouldStop = true;
+            blocksToDeliver.cancel();
+            callbackThread.join();
+            callbackThread = {};
+            callbackThreadID = std::thread::id();
+            setState (State::linked);
+        }
+
+        /** The callback thread's loop in render-ahead mode. At the pace of the venue's pacing option, it
+            records the inputs for a new block, and delivers the outputs of the block that's
+            renderAheadBlocks behind it.
+        */
+        void runRenderAheadCallbacks()
+        {
+            callbackThreadID = std::this_thread::get_id();
+
+            if (venue.options.realtimePriority > 0)
+                setCurrentThreadRealtimePriority (venue.options.realtimePriority);
+
+            auto nextBlockTime = std::chrono::steady_clock::now();
+            uint32_t numBlocksInFlight = 0;
+
+            try
+            {
+                while (! shouldStop.load() && waitForNextBlock (nextBlockTime))
+                {
+                    {
+                        // There's always space, because a block's slot isn't reused until it has been delivered
+                        FIFO::WriteOperation write (blocksToRender, 1);
+                        SOUL_ASSERT (! write.failed());
+                        recordInputs (renderAheadBlocks[static_cast<size_t> (write.startIndex1)]);
+                    }
+
+                    if (++numBlocksInFlight > venue.options.renderAheadBlocks)
+                    {
+                        if (! deliverNextBlock())
+                            break;
+
+                        --numBlocksInFlight;
+                    }
+                }
+            }
+            catch (choc::value::Error e)
+            {
+                handleError (e.description);
+            }
+            catch (...)
+            {
+                handleError ("Uncaught exception");
+            }
+
+            shouldStop = true;
+            blocksToRender.cancel();
+        }
+
+        bool deliverNextBlock()
+        {
+            {
+                FIFO::ReadOperation read (blocksToDeliver, 1);
+
+                if (! read.failed())
+                {
+                    deliverOutputs (renderAheadBlocks[static_cast<size_t> (read.startIndex1)]);
+                    return true;
+                }
+            }
+
+            // The render thread has fallen behind by the whole render-ahead distance. When the callbacks
+            // aren't paced, that's just the callback thread getting ahead, rather than missing a deadline.
+            if (venue.options.pacing != ThreadedVenueOptions::Pacing::freeRunning)
+                ++renderAheadXRuns;
+
+            while (! (shouldStop.load() || blocksToDeliver.isCancelled()))
+            {
+                FIFO::ReadOperation read (blocksToDeliver, 1, std::chrono::high_resolution_clock::now() + std::chrono::milliseconds (100));
+
+                if (! read.failed())
+                {
+                    deliverOutputs (renderAheadBlocks[static_cast<size_t> (read.startIndex1)]);
+                    return true;
+                }
+            }
+
+            return false;
+        }
     };
 
 private:
     std::unique_ptr<PerformerFactory> performerFactory;
+    const ThreadedVenueOptions options;
     std::vector<Session*> sessions;
 
     void sessionDeleted (ThreadedVenueSession* session)
@@ -292,9 +2621,16 @@ private:
     }
 };
 
-std::unique_ptr<Venue> createThreadedVenue (std::unique_ptr<PerformerFactory> performerFactory)
+std::unique_ptr<Venue> createThreadedVenue (std::unique_ptr<PerformerFactory> performerFactory, ThreadedVenueOptions options)
+{
+    return std::make_unique<ThreadedVenue> (std::move (performerFactory), std::move (options));
+}
+
+std::unique_ptr<Venue> createThreadedVenue (std::unique_ptr<PerformerFactory> performerFactory, uint32_t numRenderThreads)
 {
-    return std::make_unique<ThreadedVenue> (std::move (performerFactory));
+    ThreadedVenueOptions options;
+    options.numRenderThreads = numRenderThreads;
+    return createThreadedVenue (std::move (performerFactory), std::move (options));
 }
 
 } // namespace soul
@@ -70,6 +70,49 @@ public:
         */
         virtual bool link (CompileMessageList&, const BuildSettings&) = 0;
 
+        /** A callback which is given a number between 0 and 1 to show how far a background build has got. */
+        using BuildProgressFn = std::function<void (float progress)>;
+
+        /** A callback which is given the result of a background build, and any messages it produced. */
+        using BuildCompletionFn = std::function<void (bool succeeded, const CompileMessageList&)>;
+
+        /** Starts loading a program on a background thread, and returns without waiting for it.
+            Any program that was already loaded is unloaded first, and any build that was still in
+            progress is cancelled, so a quick succession of calls only finishes the last one.
+            Until the completion callback has been called, the only methods you may call are
+            cancelBuild(), unload(), load() or loadAsync(). Both callbacks are called on the build
+            thread, and the completion callback is called even when the build was cancelled.
+            The default implementation just calls load() and the completion callback before returning.
+        */
+        virtual void loadAsync (const Program& program, BuildProgressFn, BuildCompletionFn completion)
+        {
+            CompileMessageList messageList;
+            auto succeeded = load (messageList, program);
+
+            if (completion != nullptr)
+                completion (succeeded, messageList);
+        }
+
+        /** Starts linking the loaded program on a background thread, and returns without waiting for it.
+            This follows the same rules as loadAsync(), and the progress callback is called as the
+            performer gets through the work. The default implementation just calls link() and the
+            completion callback before returning.
+        */
+        virtual void linkAsync (const BuildSettings& settings, BuildProgressFn, BuildCompletionFn completion)
+        {
+            CompileMessageList messageList;
+            auto succeeded = link (messageList, settings);
+
+            if (completion != nullptr)
+                completion (succeeded, messageList);
+        }
+
+        /** Cancels any background build that is in progress, and waits for it to stop.
+            The performer abandons the build at the next point where it's safe to do so, and the
+            build's completion callback is called with a failure before this returns.
+        */
+        virtual void cancelBuild() {}
+
         /** Instructs the venue to begin playback.
             If no program is linked, this will fail and return false.
         */
@@ -93,6 +136,21 @@ public:
         */
         virtual EndpointHandle getEndpointHandle (const EndpointID&) = 0;
 
+        /** Returns the handles for a list of endpoints, such as the ArrayView that getInputEndpoints()
+            or getOutputEndpoints() returns, as if getEndpointHandle() had been called for each of them.
+            @see Performer::getEndpointHandles
+        */
+        virtual std::vector<EndpointHandle> getEndpointHandles (ArrayView<const EndpointDetails> endpoints)
+        {
+            std::vector<EndpointHandle> handles;
+            handles.reserve (endpoints.size());
+
+            for (auto& e : endpoints)
+                handles.push_back (getEndpointHandle (e.endpointID));
+
+            return handles;
+        }
+
         /** Pushes a block of samples to an input endpoint.
             This should be called to provide the next block of samples for an input stream.
             This method may only be called during a callback attached to setInputEndpointServiceCallback(),
@@ -100,6 +158,14 @@ public:
         */
         virtual void setNextInputStreamFrames (EndpointHandle, const choc::value::ValueView& frameArray) = 0;
 
+        /** Binds an input stream to a block of the caller's non-interleaved channel data.
+            This method may only be called during a callback attached to setInputEndpointServiceCallback(),
+            using the endpoint handle that was provided as an argument to that callback.
+            If it returns false, the data must be passed to setNextInputStreamFrames() instead.
+            @see Performer::setNextInputStreamChannels
+        */
+        virtual bool setNextInputStreamChannels (EndpointHandle, choc::buffer::ChannelArrayView<const float>)    { return false; }
+
         /** Updates the trajectory for a sparse input stream.
             This method may only be called during a callback attached to setInputEndpointServiceCallback(),
             using the endpoint handle that was provided as an argument to that callback.
@@ -166,11 +232,62 @@ public:
         /** Returns the venue's current status. */
         virtual Status getStatus() = 0;
 
+        /** A more detailed set of figures about the session's rendering than the Status provides.
+            @see getStatistics
+        */
+        struct Statistics
+        {
+            uint32_t xruns = 0;
+
+            /** The time taken to render each block, including the endpoint callbacks. */
+            BlockTimeHistogram::Snapshot blockTimes;
+
+            struct EndpointStatistics
+            {
+                EndpointID endpointID;
+                uint64_t numEvents = 0;  ///< The number of events sent to or from the endpoint
+            };
+
+            /** Figures for each endpoint that has a service callback attached. */
+            std::vector<EndpointStatistics> endpoints;
+        };
+
+        /** Returns a snapshot of the session's statistics.
+            The figures are collected without locking the rendering thread, so this is cheap enough
+            to be polled regularly from a monitoring thread.
+        */
+        virtual Statistics getStatistics()      { return {}; }
+
+        /** Turns on or off the measurement of how long each node of the program takes to render.
+            @see Performer::setProfilingEnabled
+        */
+        virtual void setProfilingEnabled (bool /*shouldProfile*/) {}
+
+        /** Returns the per-node timings that have been gathered since profiling was enabled.
+            This can be called from any thread while the session is running.
+            @see Performer::getNodeTimings
+        */
+        virtual std::vector<NodeTiming> getNodeTimings()     { return {}; }
+
+        /** Returns an estimate of the memory used by the program that the session has linked,
+            e.g. so that a host can decide how many sessions will fit on a machine.
+            This can be called from any thread while the session is running.
+            @see Performer::getMemoryUsage
+        */
+        virtual Performer::MemoryUsage getMemoryUsage()     { return {}; }
+
         /** Returns the total number of frames which have been rendered since the venue started running
             its current program.
         */
         virtual uint64_t getTotalFramesRendered() const = 0;
 
+        /** Returns the number of frames of delay between audio arriving at the venue's inputs and
+            the corresponding output reaching its outputs, including any latency added by the
+            audio device. This may change while the session is running, e.g. if the venue
+            changes its block size. Returns 0 if the venue has no audio device or doesn't know.
+        */
+        virtual uint32_t getInputToOutputLatency()      { return 0; }
+
         /** A callback function to indicate that the venue's state has changed.
             @see setStateChangeCallback
         */
@@ -184,11 +301,135 @@ public:
         /** Allows the client code to attach a lambda to be called when the current state changes. */
         virtual void setStateChangeCallback (StateChangeCallbackFn) = 0;
 
-        /** Allows client code to get a callback when the amount of data in an endpoint's FIFO changes. */
+        /** Attaches a callback which is made before every block, to provide the endpoint's data for it.
+            For event and value inputs which change rarely, the overload which takes an
+            EndpointFIFOOptions avoids the cost of a callback per block.
+        */
         virtual bool setInputEndpointServiceCallback (EndpointID, EndpointServiceFn) = 0;
 
-        /** Allows client code to get a callback when the amount of data in an endpoint's FIFO changes. */
+        /** Attaches a callback which is made after every block, to collect the endpoint's data from it.
+            For event and value outputs which change rarely, the overload which takes an
+            EndpointFIFOOptions avoids the cost of a callback per block.
+        */
         virtual bool setOutputEndpointServiceCallback (EndpointID, EndpointServiceFn) = 0;
+
+        //==============================================================================
+        /** Settings for an event or value endpoint whose data is passed through a FIFO, so that
+            its service callback is only made when the FIFO's level crosses a threshold, rather
+            than on every block.
+            @see setInputEndpointServiceCallback, setOutputEndpointServiceCallback
+        */
+        struct EndpointFIFOOptions
+        {
+            uint32_t capacity = 256;    ///< The maximum number of items the FIFO can hold
+            uint32_t threshold = 0;     ///< An input's callback is made when its level falls to this or below, an output's when it rises to this or above
+        };
+
+        /** A function which is given each item as it's read from an endpoint's FIFO, along with
+            the frame at which it was (or is due to be) processed.
+            The view's data may be reused for the next item, so it's only valid during the call, and
+            should be copied if it needs to be kept.
+        */
+        using HandleFIFOItemFn = std::function<void (uint64_t frame, const choc::value::ValueView&)>;
+
+        /** Attaches a FIFO to an input event or value endpoint.
+            Items which are queued with pushInputFIFOItem() are passed to the endpoint in the block
+            which contains their frame. The callback is made on the render thread when the number
+            of items waiting falls to the threshold, so that a client can top it up with a batch,
+            and it then won't be called again until the level has risen above the threshold.
+            Returns false if the endpoint is a stream, if its type contains strings, or if the
+            venue doesn't support FIFOs.
+        */
+        virtual bool setInputEndpointServiceCallback (EndpointID, EndpointServiceFn, EndpointFIFOOptions)     { return false; }
+
+        /** Attaches a FIFO to an output event or value endpoint.
+            Events, and any changes to a value, are added to the FIFO after each block, and the
+            callback is made on the render thread when new items have taken its level to the
+            threshold or above. The items can be read with readOutputFIFOItems().
+            Returns false if the endpoint is a stream, if its type contains strings, or if the
+            venue doesn't support FIFOs.
+        */
+        virtual bool setOutputEndpointServiceCallback (EndpointID, EndpointServiceFn, EndpointFIFOOptions)    { return false; }
+
+        /** Queues an item for an input endpoint which has a FIFO attached, to be passed to it in the
+            block which contains the given frame (or the next block, if that frame has passed).
+            Items must be pushed in frame order, and only one thread at a time may push to each
+            endpoint: either its service callback, or a single client thread.
+            Returns false if the FIFO is full or the value doesn't match one of the endpoint's types.
+        */
+        virtual bool pushInputFIFOItem (EndpointHandle, uint64_t /*frame*/, const choc::value::ValueView&)   { return false; }
+
+        /** Queues a batch of items which all have the same type and frame, and whose data is packed
+            contiguously, each one taking itemType.getValueDataSize() bytes.
+            This is a bulk alternative to pushInputFIFOItem() for high-rate event sources which already
+            have their data in packed form: the type is matched against the endpoint once for the whole
+            batch, and each item then only costs a copy of its data. The same rules about ordering and
+            threads apply. Returns the number of items which fitted into the FIFO.
+        */
+        virtual uint32_t pushInputFIFOItems (EndpointHandle handle, uint64_t frame, const choc::value::Type& itemType,
+                                             const void* packedItemData, uint32_t numItems)
+        {
+            auto itemDataSize = itemType.getValueDataSize();
+
+            for (uint32_t i = 0; i < numItems; ++i)
+                if (! pushInputFIFOItem (handle, frame, choc::value::ValueView (itemType, const_cast<char*> (static_cast<const char*> (packedItemData)) + i * itemDataSize, nullptr)))
+                    return i;
+
+            return numItems;
+        }
+
+        /** Reads and removes all the items waiting in an output endpoint's FIFO, returning the number read.
+            Only one thread at a time may read from each endpoint: either its service callback, or a
+            single client thread.
+        */
+        virtual uint32_t readOutputFIFOItems (EndpointHandle, HandleFIFOItemFn)      { return 0; }
+
+        //==============================================================================
+        /** Describes how the data for a set of stream and value endpoints is packed into one buffer,
+            so that a client with many endpoints can exchange all of their data with a single
+            callback per block, rather than a callback and a call for each endpoint.
+            @see createPackedEndpointLayout, setPackedInputCallback, setPackedOutputCallback
+        */
+        struct PackedEndpointLayout
+        {
+            struct Item
+            {
+                EndpointID endpointID;
+                EndpointHandle handle;
+                EndpointType endpointType;
+                choc::value::Type dataType;     ///< The frame type of a stream, or the type of a value
+                uint32_t numFrames = 0;         ///< The block size for a stream, or 1 for a value
+                uint32_t offset = 0;            ///< The byte offset of the item's data, which is always a multiple of 8
+                uint32_t size = 0;              ///< The number of bytes of packed data, i.e. numFrames * the size of dataType
+            };
+
+            std::vector<Item> items;
+            uint32_t totalSize = 0;             ///< The size in bytes of the whole buffer
+        };
+
+        /** A callback which is given a buffer whose data is arranged as described by a PackedEndpointLayout. */
+        using PackedEndpointServiceFn = std::function<void (Session&, void* packedData)>;
+
+        /** Works out a packed layout for a list of stream and value endpoints, which must be either
+            all inputs or all outputs.
+            This can only be used once the program has been linked, because the size of a stream's
+            data depends on the block size. If any of the endpoints can't be found, or is an event
+            endpoint, this returns an empty optional.
+        */
+        virtual std::optional<PackedEndpointLayout> createPackedEndpointLayout (ArrayView<const EndpointID>)    { return {}; }
+
+        /** Attaches a callback which is called before each block to fill in the data for all the
+            input endpoints in a layout. Once it returns, the buffer's contents are passed to each
+            endpoint, as if setNextInputStreamFrames() or setInputValue() had been called for it.
+            Returns false if the layout isn't one of input endpoints, or the venue doesn't support it.
+        */
+        virtual bool setPackedInputCallback (PackedEndpointLayout, PackedEndpointServiceFn)     { return false; }
+
+        /** Attaches a callback which is called after each block with the data that was rendered for
+            all the output endpoints in a layout.
+            Returns false if the layout isn't one of output endpoints, or the venue doesn't support it.
+        */
+        virtual bool setPackedOutputCallback (PackedEndpointLayout, PackedEndpointServiceFn)    { return false; }
     };
 
     //==============================================================================
@@ -202,8 +443,99 @@ public:
     virtual bool connectSessionOutputEndpoint (Session&, EndpointID outputID, EndpointID venueSinkID) = 0;
 };
 
-/// Create a standard threaded venue where a separate render thread renders the performer
-std::unique_ptr<Venue> createThreadedVenue (std::unique_ptr<PerformerFactory> performerFactory);
+/** Settings which control the way a threaded venue runs its sessions.
+    @see createThreadedVenue
+*/
+struct ThreadedVenueOptions
+{
+    /** If this is more than 1, each session's program is split into independent parts of its
+        main graph, which are rendered in parallel by that many threads.
+    */
+    uint32_t numRenderThreads = 1;
+
+    /** If this is non-zero, the render threads are given a realtime scheduling policy with this
+        priority (1 to 99). This usually needs the process to have suitable permissions, and if it
+        fails, the threads carry on with the default scheduling.
+    */
+    int realtimePriority = 0;
+
+    /** If this isn't empty, the render threads are pinned to these CPU cores. A session's main
+        render thread uses the first core, and any extra render threads take the following ones.
+    */
+    std::vector<uint32_t> cpuCores;
+
+    /** If this isn't negative, each session keeps its work on this NUMA node. The performers'
+        state is allocated on the node's memory when they're loaded and linked, and the render
+        threads prefer its memory for anything they allocate. If cpuCores is empty, the render
+        threads are also pinned to the node's cores. This is currently only supported on Linux,
+        and is ignored elsewhere.
+    */
+    int numaNode = -1;
+
+    enum class Pacing
+    {
+        freeRunning,     ///< Each block is rendered as soon as the previous one has finished
+        realtimeClock,   ///< Blocks are rendered at the rate their sample rate and block size imply
+        externalSync     ///< The waitForNextBlock function is called to decide when to render each block
+    };
+
+    Pacing pacing = Pacing::freeRunning;
+
+    /** When the pacing is Pacing::externalSync, the render thread calls this before each block,
+        and it should block until it's time to render. If it returns false, the session stops.
+    */
+    std::function<bool()> waitForNextBlock;
+
+    /** If this is true, the parts of each session's main graph which are made only of processors
+        that have a "silenceTail" annotation stop being rendered once all their inputs have been silent
+        for that long, and their outputs are filled with zeros until something arrives for them again.
+        The annotation gives the number of seconds it takes for the processor's output to die away
+        after its input goes silent, e.g. processor Reverb [[ silenceTail: 3.0 ]]. Only processors
+        which produce silence (and no events) when their inputs are silent should be annotated.
+        To make the bypassing as fine-grained as possible, the graph is split into as many
+        independent parts as the partitioner can find, even if there's only one render thread.
+    */
+    bool bypassSilentProcessors = false;
+
+    /** If this is true, the render threads run with denormals flushed to zero. */
+    bool flushDenormalsToZero = false;
+
+    /** If this is true, a session starts playing a program as soon as it has been linked, and
+        meanwhile re-optimises a copy of it at tieredOptimisationLevel on a background thread.
+        When that's ready, it replaces the session's performer at the start of a block, taking
+        over the state of the processors (see PerformerStateTransfer). For the quickest start,
+        build the program that you load with an optimisation level of 0. If the performer
+        can't transfer its state, the optimised version is discarded.
+    */
+    bool tieredCompilation = false;
+
+    /** The optimisation level used for the second tier when tieredCompilation is enabled. */
+    int tieredOptimisationLevel = 3;
+
+    /** If this is more than 0, each session's render thread works this many blocks ahead of its
+        per-block endpoint callbacks, which are made on a separate thread paced by the pacing option.
+        The data that the input callbacks provide is recorded into a ring of blocks for the render
+        thread to play, and the output callbacks are given each block's results this many blocks
+        later. This adds renderAheadBlocks * the block size frames of latency, in exchange for being
+        able to absorb that much scheduling jitter in the render thread, so it's only suitable for
+        non-interactive uses such as streaming. If a block still hasn't been rendered when its
+        outputs are due, that's counted as an xrun and the callback thread waits for it.
+        Endpoints with a FIFO (see Venue::Session::EndpointFIFOOptions) are still serviced by the
+        render thread, and values containing strings can't be passed through the ring.
+    */
+    uint32_t renderAheadBlocks = 0;
+};
+
+/** Create a standard threaded venue where a separate render thread renders the performer. */
+std::unique_ptr<Venue> createThreadedVenue (std::unique_ptr<PerformerFactory> performerFactory,
+                                            ThreadedVenueOptions options);
+
+/** Create a standard threaded venue where a separate render thread renders the performer.
+    If numRenderThreads is more than 1, each session's program is split into independent
+    parts of its main graph, which are rendered in parallel by that many threads.
+*/
+std::unique_ptr<Venue> createThreadedVenue (std::unique_ptr<PerformerFactory> performerFactory,
+                                            uint32_t numRenderThreads = 1);
 
 
 } // namespace soul
@@ -54,7 +54,12 @@ namespace soul::patch
                 }
                 else if (isParameterStream (input))
                 {
-                    addInputParameter (input, "Bela::InputParameterStream", name, getParameterId (input, useBelaParameters), minValue, maxValue);
+                    auto parameterId = getParameterId (input, useBelaParameters);
+
+                    if (parameterId < 0 && input->getSingleDataType().isFloat32())
+                        addStaticParameter (input, name, input->annotation.getDouble ("init", minValue));
+                    else
+                        addInputParameter (input, "Bela::InputParameterStream", name, parameterId, minValue, maxValue);
                 }
                 else if (isAudioStream (input))
                 {
@@ -103,6 +108,10 @@ namespace soul::patch
 
                 {
                     auto indent2 = graph.createIndentWithBraces();
+
+                    if (hasAnalogInputs)
+                        graph << "analogInputs = Bela::AnalogInputs;" << newLine;
+
                     graph << parameters.toString();
                 }
 
@@ -111,6 +120,11 @@ namespace soul::patch
 
                 {
                     auto indent2 = graph.createIndentWithBraces();
+
+                    if (hasAnalogInputs)
+                        graph << "audioIn -> analogInputs.audioIn;" << newLine
+                              << newLine;
+
                     graph << connections.toString();
                 }
 
@@ -127,7 +141,8 @@ namespace soul::patch
             if (! useBelaParameters)
                 return (nextParameterId < maxParameters) ? nextParameterId++ :  -1;
 
-            return static_cast<int> (input.annotation.getInt64 ("belaControl", -1));
+            auto id = input.annotation.getInt64 ("belaControl", -1);
+            return id < maxParameters ? static_cast<int> (id) : -1;
         }
 
         bool isParameterAnnotation (const soul::Annotation& annotation)
@@ -182,12 +197,14 @@ namespace soul::patch
         {
             if (parameterId >= 0)
             {
-                parameters << name << "Param = " << type << " (" << std::to_string (parameterChannelOffset + parameterId)
+                parameters << name << "Param = " << type << " (" << std::to_string (parameterId)
                            << ", float(" << minValue << "), float (" << maxValue << "));" << newLine;
 
-                connections << "audioIn -> " << name << "Param.audioIn;" << newLine
+                connections << "analogInputs.analogOut -> " << name << "Param.analogIn;" << newLine
                             << name << "Param.out -> wrappedModule." << name << ";" << newLine
                             << newLine;
+
+                hasAnalogInputs = true;
             }
             else
             {
@@ -199,72 +216,141 @@ namespace soul::patch
             }
         }
 
+        /** A stream parameter which isn't controlled by an analog input only changes when the host
+            sets it, so rather than making the host stream its value, it's exposed as an event
+            which updates a value that's held by the wrapper.
+        */
+        void addStaticParameter (const soul::heart::InputDeclaration& input, const std::string& name, double initialValue)
+        {
+            streams << "input event float " << name << input.annotation.toHEART() << ";" << newLine;
+
+            parameters << name << "Param = Bela::StaticParameter (float (" << initialValue << "));" << newLine;
+
+            connections << name << " -> " << name << "Param.in;" << newLine
+                        << name << "Param.out -> wrappedModule." << name << ";" << newLine
+                        << newLine;
+        }
+
         const soul::Program& program;
 
         choc::text::CodePrinter parameters, connections, streams;
 
         int  nextParameterId              = 0;
         const int maxParameters           = 8;
-        const int  parameterChannelOffset = 2;
+        bool hasAnalogInputs              = false;
 
 
         const std::string namespaceCode = R"(
 namespace Bela
 {
-    let resolution = 16;
+    let resolution = 16;            // The number of frames between each read of the analog inputs
+    let changeThreshold = 0.001f;   // The smallest change in an analog input that gets passed on
 
 //    let inputMaxValue = 0.34f;      // When powered from USB
     let inputMaxValue = 1.0f;       // When powered from 12v (Eurorack)
 
-    processor InputParameterStream (int channel, float min, float max)
+    float scaleInput (float v, float minValue, float maxValue)
+    {
+        let scaledValue = minValue + (maxValue - minValue) * (v / inputMaxValue);
+        return min (maxValue, max (minValue, scaledValue));
+    }
+
+    bool hasChanged (float newValue, float oldValue)
+    {
+        return abs (newValue - oldValue) > changeThreshold;
+    }
+
+    // Reads the analog inputs (channels 2 to 9 of audioIn) once every resolution frames,
+    // and only sends them on when at least one of them has moved
+    processor AnalogInputs
     {
         input stream float<10> audioIn;
-        output stream float out;
+        output event float<8> analogOut;
 
         void run()
         {
+            float<8> lastValues = -1.0f;
+
             loop
             {
-                let i = audioIn[channel] / inputMaxValue;
-                let scaledValue = min + (max - min) * i;
-                let truncatedValue = min (max, max (min, scaledValue));
+                let values = float<8> (audioIn[2:10]);
 
-                loop (resolution)
+                for (int i = 0; i < 8; ++i)
                 {
-                    out << truncatedValue;
-                    advance();
+                    if (hasChanged (values.at (i), lastValues.at (i)))
+                    {
+                        lastValues = values;
+                        analogOut << values;
+                        break;
+                    }
                 }
+
+                loop (resolution)
+                    advance();
+            }
+        }
+    }
+
+    processor InputParameterStream (int channel, float min, float max)
+    {
+        input event float<8> analogIn;
+        output stream float out;
+
+        float currentValue = min;
+
+        event analogIn (float<8> v)
+        {
+            currentValue = scaleInput (v.at (channel), min, max);
+        }
+
+        void run()
+        {
+            loop
+            {
+                out << currentValue;
+                advance();
             }
         }
     }
 
     processor InputParameterEvent (int channel, float min, float max)
     {
-        input stream float<10> audioIn;
+        input event float<8> analogIn;
         output event float out;
 
-        void process (float v)
+        float lastInput = -1.0f;
+
+        event analogIn (float<8> v)
         {
-            let i = v / inputMaxValue;
-            let scaledValue = min + (max - min) * i;
-            let truncatedValue = min (max, max (min, scaledValue));
+            let i = v.at (channel);
+
+            if (hasChanged (i, lastInput))
+            {
+                lastInput = i;
+                out << scaleInput (i, min, max);
+            }
+        }
+    }
+
+    processor StaticParameter (float initialValue)
+    {
+        input event float in;
+        output stream float out;
 
-            out << truncatedValue;
+        float currentValue = initialValue;
+
+        event in (float v)
+        {
+            currentValue = v;
         }
 
         void run()
         {
             loop
             {
-                process (audioIn[channel]);
-
-                loop (resolution)
-                {
-                    advance();
-                }
+                out << currentValue;
+                advance();
             }
-
-            advance();
         }
     }
 
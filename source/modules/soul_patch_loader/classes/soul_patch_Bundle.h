@@ -0,0 +1,287 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+namespace soul::patch
+{
+
+//==============================================================================
+/**
+    The contents of a .soulpatchbundle file, which packs a patch's manifest, source code,
+    view and external files into a single indexed file, optionally along with some
+    pre-compiled programs.
+
+    Loading a patch from a bundle takes a single read, and because the contents of a bundle
+    can't change, none of its files need to be re-scanned or re-read when the patch is
+    polled for changes.
+
+    The layout is:
+      - the 8 bytes "SOULBNDL", followed by a uint32 version number and a uint32 number of entries
+      - for each entry, a uint32 path length, the UTF8 path, then a uint64 offset and a uint64 size
+      - the entry data, at the offsets given in the index, which are relative to the start of the file
+
+    All the integers are little-endian. Paths are relative to the folder that contained the
+    manifest, use forward-slashes, and are normalised to remove any "." or ".." elements.
+*/
+struct PatchBundle
+{
+    static constexpr const char* fileSuffix = ".soulpatchbundle";
+    static constexpr uint32_t currentVersion = 1;
+
+    struct Entry
+    {
+        std::string path;
+        uint64_t offset = 0, size = 0;
+    };
+
+    std::string bundlePath;
+    int64_t lastModificationTime = 0;
+    std::vector<char> data;
+    std::vector<Entry> entries;
+
+    static bool isBundleFile (const std::string& path)     { return endsWith (path, fileSuffix); }
+
+    /** Reads and checks a bundle file, throwing a PatchLoadError if anything's wrong. */
+    static std::shared_ptr<const PatchBundle> load (VirtualFile& file)
+    {
+        auto bundle = std::make_shared<PatchBundle>();
+        bundle->bundlePath = String::Ptr (file.getAbsolutePath()).toString<std::string>();
+        bundle->lastModificationTime = file.getLastModificationTime();
+
+        std::string error;
+        auto content = loadVirtualFileAsMemoryBlock (file, error);
+
+        if (! error.empty())
+            throwPatchLoadError (error);
+
+        bundle->data.assign (content.begin(), content.end());
+        bundle->readIndex();
+        return bundle;
+    }
+
+    /** Packs a set of files into the bundle format. */
+    static std::vector<char> create (const std::vector<std::pair<std::string, std::string>>& pathsAndContent)
+    {
+        std::vector<char> result;
+        auto append = [&] (const void* d, size_t size)  { result.insert (result.end(), static_cast<const char*> (d), static_cast<const char*> (d) + size); };
+
+        append (magicNumber, 8);
+        writeInt (result, currentVersion, 4);
+        writeInt (result, pathsAndContent.size(), 4);
+
+        auto offset = static_cast<uint64_t> (result.size());
+
+        for (auto& f : pathsAndContent)
+            offset += 4 + normalisePath (f.first).length() + 8 + 8;
+
+        for (auto& f : pathsAndContent)
+        {
+            auto path = normalisePath (f.first);
+            writeInt (result, path.length(), 4);
+            append (path.data(), path.length());
+            writeInt (result, offset, 8);
+            writeInt (result, f.second.size(), 8);
+            offset += f.second.size();
+        }
+
+        for (auto& f : pathsAndContent)
+            append (f.second.data(), f.second.size());
+
+        return result;
+    }
+
+    const Entry* findEntry (const std::string& path) const
+    {
+        auto normalised = normalisePath (path);
+
+        for (auto& e : entries)
+            if (e.path == normalised)
+                return std::addressof (e);
+
+        return nullptr;
+    }
+
+    bool isFolder (const std::string& path) const
+    {
+        auto folder = normalisePath (path);
+
+        if (folder.empty())
+            return true;
+
+        for (auto& e : entries)
+            if (startsWith (e.path, folder + "/"))
+                return true;
+
+        return false;
+    }
+
+    /** Returns the name of the manifest file at the top level of the bundle. */
+    std::string findManifest() const
+    {
+        for (auto& e : entries)
+            if (e.path.find ('/') == std::string::npos && endsWith (e.path, getManifestSuffix()))
+                return e.path;
+
+        throwPatchLoadError ("The bundle " + quoteName (bundlePath) + " doesn't contain a patch manifest");
+    }
+
+    /** Pre-compiled programs are stored in entries with names generated by this function,
+        and contain data created by Program::toBinary().
+    */
+    static std::string getCompiledProgramPath (const BuildSettings& settings)
+    {
+        return ".programs/" + std::to_string (settings.sampleRate) + "_" + std::to_string (settings.maxBlockSize);
+    }
+
+    static std::string normalisePath (std::string_view path)
+    {
+        std::vector<std::string> parts;
+        std::string part;
+
+        auto addPart = [&]
+        {
+            if (part == "..")
+            {
+                if (! parts.empty())
+                    parts.pop_back();
+            }
+            else if (! (part.empty() || part == "."))
+            {
+                parts.push_back (part);
+            }
+
+            part.clear();
+        };
+
+        for (auto c : path)
+        {
+            if (c == '/' || c == '\\')
+                addPart();
+            else
+                part += c;
+        }
+
+        addPart();
+        return joinStrings (parts, "/");
+    }
+
+private:
+    static constexpr const char magicNumber[] = "SOULBNDL";
+
+    static void writeInt (std::vector<char>& dest, uint64_t value, int numBytes)
+    {
+        for (int i = 0; i < numBytes; ++i)
+            dest.push_back (static_cast<char> ((value >> (8 * i)) & 0xff));
+    }
+
+    void readIndex()
+    {
+        size_t readPos = 0;
+
+        auto readInt = [&] (int numBytes) -> uint64_t
+        {
+            if (readPos + (size_t) numBytes > data.size())
+                throwPatchLoadError ("The bundle " + quoteName (bundlePath) + " is truncated");
+
+            uint64_t value = 0;
+
+            for (int i = 0; i < numBytes; ++i)
+                value |= static_cast<uint64_t> (static_cast<uint8_t> (data[readPos++])) << (8 * i);
+
+            return value;
+        };
+
+        if (data.size() < 8 || std::memcmp (data.data(), magicNumber, 8) != 0)
+            throwPatchLoadError (quoteName (bundlePath) + " is not a SOUL patch bundle");
+
+        readPos = 8;
+
+        if (readInt (4) != currentVersion)
+            throwPatchLoadError ("The bundle " + quoteName (bundlePath) + " was created by an incompatible version");
+
+        auto numEntries = readInt (4);
+
+        for (uint64_t i = 0; i < numEntries; ++i)
+        {
+            Entry e;
+            auto pathLength = (size_t) readInt (4);
+
+            if (readPos + pathLength > data.size())
+                throwPatchLoadError ("The bundle " + quoteName (bundlePath) + " is truncated");
+
+            e.path = std::string (data.data() + readPos, pathLength);
+            readPos += pathLength;
+            e.offset = readInt (8);
+            e.size = readInt (8);
+
+            if (e.offset > data.size() || e.size > data.size() - e.offset)
+                throwPatchLoadError ("The bundle " + quoteName (bundlePath) + " is truncated");
+
+            entries.push_back (std::move (e));
+        }
+    }
+};
+
+//==============================================================================
+/** A VirtualFile which refers to a file or folder inside a PatchBundle. */
+struct BundledFile final  : public RefCountHelper<VirtualFile, BundledFile>
+{
+    BundledFile (std::shared_ptr<const PatchBundle> b, std::string p)
+        : bundle (std::move (b)), path (PatchBundle::normalisePath (p)), entry (bundle->findEntry (path))
+    {
+    }
+
+    String* getName() override                     { return makeStringPtr (path.substr (path.find_last_of ('/') + 1)); }
+    String* getAbsolutePath() override             { return makeStringPtr (bundle->bundlePath + "/" + path); }
+    int64_t getSize() override                     { return entry != nullptr ? (int64_t) entry->size : 0; }
+    int64_t getLastModificationTime() override     { return entry != nullptr || bundle->isFolder (path) ? bundle->lastModificationTime : -1; }
+
+    VirtualFile* getParent() override
+    {
+        auto lastSlash = path.find_last_of ('/');
+        return new BundledFile (bundle, lastSlash == std::string::npos ? std::string() : path.substr (0, lastSlash));
+    }
+
+    VirtualFile* getChildFile (const char* subPath) override
+    {
+        if (isValidPathString (subPath))
+            return new BundledFile (bundle, path + "/" + subPath);
+
+        return {};
+    }
+
+    int64_t read (uint64_t start, void* targetBuffer, uint64_t size) override
+    {
+        if (targetBuffer == nullptr || entry == nullptr)
+            return -1;
+
+        if (start >= entry->size)
+            return 0;
+
+        auto numToRead = std::min (size, entry->size - start);
+        memcpy (targetBuffer, bundle->data.data() + entry->offset + start, numToRead);
+        return (int64_t) numToRead;
+    }
+
+    const std::shared_ptr<const PatchBundle> bundle;
+    const std::string path;
+    const PatchBundle::Entry* const entry;
+};
+
+}
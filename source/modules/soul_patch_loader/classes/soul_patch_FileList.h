@@ -44,6 +44,7 @@ struct FileList
 {
     VirtualFile::Ptr root;
     std::string manifestName;
+    std::shared_ptr<const PatchBundle> bundle;
     FileState manifest;
     std::vector<FileState> sourceFiles, filesToWatch;
     choc::value::Value manifestJSON;
@@ -58,6 +59,10 @@ struct FileList
 
     void refresh()
     {
+        // the contents of a bundle can't change, so once it has been parsed there's nothing to re-scan
+        if (bundle != nullptr && ! manifestJSON.isVoid())
+            return;
+
         reset();
         findManifestFile();
         parseManifest();
@@ -156,6 +161,17 @@ struct FileList
         return false;
     }
 
+    /** If the patch was loaded from a bundle which contains a pre-compiled program for
+        these settings, this returns its data.
+    */
+    const PatchBundle::Entry* findPrecompiledProgram (const BuildSettings& settings) const
+    {
+        if (bundle != nullptr)
+            return bundle->findEntry (PatchBundle::getCompiledProgramPath (settings));
+
+        return nullptr;
+    }
+
     choc::value::ValueView getExternalsList() const
     {
         return manifestJSON["externals"];
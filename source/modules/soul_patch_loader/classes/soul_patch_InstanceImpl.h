@@ -26,9 +26,12 @@ namespace soul::patch
 */
 struct PatchInstanceImpl final  : public RefCountHelper<PatchInstance, PatchInstanceImpl>
 {
-    PatchInstanceImpl (std::unique_ptr<soul::PerformerFactory> factory, VirtualFile::Ptr f)
+    PatchInstanceImpl (std::unique_ptr<soul::PerformerFactory> factory, VirtualFile::Ptr f,
+                       std::shared_ptr<const PatchBundle> bundle = {})
         : performerFactory (std::move (factory)), root (std::move (f))
     {
+        fileList.bundle = std::move (bundle);
+
         if (auto name = String::Ptr (root->getName()))
         {
             fileList.manifestName = name.toString<std::string>();
@@ -36,6 +39,11 @@ struct PatchInstanceImpl final  : public RefCountHelper<PatchInstance, PatchInst
             if (endsWith (fileList.manifestName, getManifestSuffix()))
                 fileList.root = VirtualFile::Ptr (root->getParent());
         }
+
+        if (auto path = String::Ptr (root->getAbsolutePath()))
+            programCache = PatchPlayerImpl::ProgramCache::getSharedCache (path.toString<std::string>());
+        else
+            programCache = std::make_shared<PatchPlayerImpl::ProgramCache>();
     }
 
     void refreshFileList()
@@ -83,42 +91,264 @@ struct PatchInstanceImpl final  : public RefCountHelper<PatchInstance, PatchInst
                                        ExternalDataProvider* externalDataProvider,
                                        ConsoleMessageHandler* consoleHandler) override
     {
-        PatchPlayer::Ptr patch;
+        PlayerOptions options (config, cache, preprocessor, externalDataProvider, consoleHandler);
+
+        if (auto spare = sparePlayers.take (options))
+            return spare.incrementAndGetPointer();
 
         try
         {
             refreshFileList();
+        }
+        catch (const PatchLoadError& e)
+        {
+            return createErrorPlayer (fileList, *performerFactory, config, e.message).incrementAndGetPointer();
+        }
+
+        auto patch = createPlayer (fileList, *performerFactory, *programCache, options);
+
+        if (patch->isPlayable())
+            sparePlayers.refill (fileList, options);
 
-            auto patchImpl = new PatchPlayerImpl (fileList, config, performerFactory->createPerformer());
-            patch = PatchPlayer::Ptr (patchImpl);
+        return patch.incrementAndGetPointer();
+    }
+
+    void setNumSparePlayers (uint32_t numPlayers) override
+    {
+        sparePlayers.setNumPlayers (numPlayers);
+    }
+
+    //==============================================================================
+    /** The arguments that were passed to compileNewPlayer(). The callbacks are retained, so
+        that spare players can be built with them after the call has returned.
+    */
+    struct PlayerOptions
+    {
+        PlayerOptions (const PatchPlayerConfiguration& c, CompilerCache* cc, SourceFilePreprocessor* p,
+                       ExternalDataProvider* e, ConsoleMessageHandler* h)
+            : config (c), cache (retain (cc)), preprocessor (retain (p)), externalDataProvider (retain (e)), consoleHandler (retain (h))
+        {
+        }
+
+        bool operator== (const PlayerOptions& other) const
+        {
+            return config == other.config
+                    && cache.get() == other.cache.get()
+                    && preprocessor.get() == other.preprocessor.get()
+                    && externalDataProvider.get() == other.externalDataProvider.get()
+                    && consoleHandler.get() == other.consoleHandler.get();
+        }
+
+        PatchPlayerConfiguration config;
+        CompilerCache::Ptr cache;
+        SourceFilePreprocessor::Ptr preprocessor;
+        ExternalDataProvider::Ptr externalDataProvider;
+        ConsoleMessageHandler::Ptr consoleHandler;
+
+    private:
+        template <typename Type>
+        static RefCountingPtr<Type> retain (Type* object)
+        {
+            if (object != nullptr)
+                object->addRef();
+
+            return RefCountingPtr<Type> (object);
+        }
+    };
+
+    static PatchPlayer::Ptr createPlayer (const FileList& fileList, PerformerFactory& factory,
+                                          PatchPlayerImpl::ProgramCache& programCache, const PlayerOptions& options)
+    {
+        // The cache lock also stops spare players being built while another player is compiling
+        std::lock_guard<std::mutex> lock (programCache.lock);
+
+        try
+        {
+            auto patchImpl = new PatchPlayerImpl (fileList, options.config, factory.createPerformer());
+            PatchPlayer::Ptr patch (patchImpl);
 
             soul::BuildSettings settings;
-            settings.sampleRate = config.sampleRate;
-            settings.maxBlockSize = config.maxFramesPerBlock;
+            settings.sampleRate = options.config.sampleRate;
+            settings.maxBlockSize = options.config.maxFramesPerBlock;
+            settings.optimisationLevel = options.config.optimisationLevel;
 
-            patchImpl->compile (settings, cache, preprocessor, externalDataProvider, consoleHandler);
+            patchImpl->compile (settings, options.cache.get(), options.preprocessor.get(),
+                                options.externalDataProvider.get(), options.consoleHandler.get(), std::addressof (programCache));
+            return patch;
         }
         catch (const PatchLoadError& e)
         {
-            auto patchImpl = new PatchPlayerImpl (fileList, config, performerFactory->createPerformer());
-            patch = PatchPlayer::Ptr (patchImpl);
+            return createErrorPlayer (fileList, factory, options.config, e.message);
+        }
+    }
 
-            CompilationMessage cm;
-            cm.fullMessage = makeString (e.message);
-            cm.description = cm.fullMessage;
-            cm.isError = true;
+    static PatchPlayer::Ptr createErrorPlayer (const FileList& fileList, PerformerFactory& factory,
+                                               const PatchPlayerConfiguration& config, const std::string& message)
+    {
+        auto patchImpl = new PatchPlayerImpl (fileList, config, factory.createPerformer());
+        PatchPlayer::Ptr patch (patchImpl);
 
-            patchImpl->compileMessages.push_back (cm);
-            patchImpl->updateCompileMessageStatus();
-        }
+        CompilationMessage cm;
+        cm.fullMessage = makeString (message);
+        cm.description = cm.fullMessage;
+        cm.isError = true;
 
-        return patch.incrementAndGetPointer();
+        patchImpl->compileMessages.push_back (cm);
+        patchImpl->updateCompileMessageStatus();
+        return patch;
     }
 
+    //==============================================================================
+    /** Keeps a set of players that have already been compiled and linked, so that new players
+        can be handed out without waiting for a build. The spares are built one at a time by a
+        job on the shared PatchCompileService, using the file list and options from the last
+        successful compileNewPlayer().
+    */
+    struct SparePlayerPool
+    {
+        SparePlayerPool (PatchInstanceImpl& i) : instance (i)
+        {
+            buildJob.function = [this] { buildSparePlayer(); };
+
+            if (auto path = String::Ptr (instance.root->getAbsolutePath()))
+                buildJob.key = path.toString<std::string>();
+        }
+
+        ~SparePlayerPool()
+        {
+            {
+                std::lock_guard<std::mutex> l (lock);
+                shouldStop = true;
+            }
+
+            if (compileService != nullptr)
+                compileService->removeJob (buildJob);
+        }
+
+        void setNumPlayers (uint32_t newNumPlayers)
+        {
+            std::lock_guard<std::mutex> l (lock);
+            numPlayers = newNumPlayers;
+
+            if (spares.size() > numPlayers)
+                spares.resize (numPlayers);
+
+            startBuildIfNeeded();
+        }
+
+        /** Returns a spare player that was built with these options, if there is one whose
+            files are still up to date.
+        */
+        PatchPlayer::Ptr take (const PlayerOptions& requestedOptions)
+        {
+            std::lock_guard<std::mutex> l (lock);
+
+            if (spares.empty() || options == nullptr || ! (*options == requestedOptions))
+                return {};
+
+            auto spare = std::move (spares.back());
+            spares.pop_back();
+
+            if (spare->needsRebuilding (requestedOptions.config))
+            {
+                // One of the files has changed, so none of the spares can be used, and
+                // they'll only be rebuilt when compileNewPlayer() next succeeds
+                spares.clear();
+                options.reset();
+                return {};
+            }
+
+            Trace::addInstantEvent ("cache", "spare player taken");
+            startBuildIfNeeded();
+            return spare;
+        }
+
+        /** Makes the pool build spares for this file list and these options. */
+        void refill (const FileList& newFileList, const PlayerOptions& newOptions)
+        {
+            std::lock_guard<std::mutex> l (lock);
+
+            if (numPlayers == 0)
+                return;
+
+            if (options == nullptr || ! (*options == newOptions))
+                spares.clear();
+
+            fileList = newFileList;
+            options = std::make_unique<PlayerOptions> (newOptions);
+            ++generation;
+            startBuildIfNeeded();
+        }
+
+    private:
+        PatchInstanceImpl& instance;
+        std::mutex lock;
+        std::shared_ptr<PatchCompileService> compileService;
+        PatchCompileService::Job buildJob;
+        std::vector<PatchPlayer::Ptr> spares;
+        FileList fileList;
+        std::unique_ptr<PlayerOptions> options;
+        uint32_t numPlayers = 0, generation = 0;
+        bool shouldStop = false;
+
+        bool needsAnotherPlayer() const
+        {
+            return ! shouldStop && options != nullptr && spares.size() < numPlayers;
+        }
+
+        // Called with the lock held. The service is only acquired once there's something
+        // to build, so that instances which keep no spares don't start its threads.
+        void startBuildIfNeeded()
+        {
+            if (needsAnotherPlayer())
+            {
+                if (compileService == nullptr)
+                    compileService = PatchCompileService::getSharedInstance();
+
+                compileService->addJob (buildJob);
+            }
+        }
+
+        void buildSparePlayer()
+        {
+            std::unique_lock<std::mutex> l (lock);
+
+            if (! needsAnotherPlayer())
+                return;
+
+            auto buildFileList = fileList;
+            auto buildOptions = *options;
+            auto buildGeneration = generation;
+            l.unlock();
+
+            PatchPlayer::Ptr player;
+
+            {
+                SOUL_TRACE_SCOPE ("patch", "build spare player")
+                player = createPlayer (buildFileList, *instance.performerFactory, *instance.programCache, buildOptions);
+            }
+
+            l.lock();
+
+            if (generation == buildGeneration)
+            {
+                if (player->isPlayable())
+                    spares.push_back (std::move (player));
+                else
+                    options.reset();  // don't keep retrying a build that fails
+            }
+
+            // Re-queues the job, which the service runs again once this call has returned
+            startBuildIfNeeded();
+        }
+    };
+
     std::unique_ptr<soul::PerformerFactory> performerFactory;
     const VirtualFile::Ptr root;
     FileList fileList;
     Description::Ptr description;
+    std::shared_ptr<PatchPlayerImpl::ProgramCache> programCache;
+    SparePlayerPool sparePlayers { *this };
 };
 
 } // namespace soul::patch
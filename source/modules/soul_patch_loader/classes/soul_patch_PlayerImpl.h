@@ -33,6 +33,9 @@ struct PatchPlayerImpl final  : public RefCountHelper<PatchPlayer, PatchPlayerIm
 
     ~PatchPlayerImpl()
     {
+        consoleQueue.reset();
+        detachParameters();
+
         if (performer != nullptr)
         {
             performer->unload();
@@ -73,38 +76,213 @@ struct PatchPlayerImpl final  : public RefCountHelper<PatchPlayer, PatchPlayerIm
             if (! readError.empty())
                 throwPatchLoadError (readError);
 
-            build.sourceFiles.push_back ({ fileState.path, std::move (content) });
+            build.sourceFiles.push_back ({ fileState.path, {}, std::make_shared<const std::string> (std::move (content)) });
         }
     }
 
+    //==============================================================================
+    using ExternalValues = std::vector<std::shared_ptr<const choc::value::Value>>;
+
+    /** Holds on to the program from a previous build, so that a new player can re-use it
+        if none of the top-level declarations in its source code have changed.
+
+        The unoptimised program from the last time the source was compiled is also kept, so
+        that when only the sample rate or block size has changed, a new program can be made
+        by optimising a copy of it for the new settings, instead of compiling the source again.
+
+        The cached programs are never modified, so the players can all use the same ones, and
+        once a player has linked the current program, its performer's linked code is kept too.
+        Players which resolve the same external values can then just load that, and only need
+        to allocate their own state. The players are built while the lock is held.
+
+        When the source has changed, the compiler's incremental cache lets it skip evaluating
+        the initial state of the processors whose declarations haven't been touched.
+    */
+    struct ProgramCache
+    {
+        /** Returns the cache that is shared by all the patch instances which were loaded
+            from the same manifest file, creating one if needed.
+        */
+        static std::shared_ptr<ProgramCache> getSharedCache (const std::string& manifestPath)
+        {
+            static std::mutex registryLock;
+            static std::unordered_map<std::string, std::weak_ptr<ProgramCache>> registry;
+
+            std::lock_guard<std::mutex> l (registryLock);
+
+            for (auto i = registry.begin(); i != registry.end();)
+            {
+                if (i->second.expired())
+                    i = registry.erase (i);
+                else
+                    ++i;
+            }
+
+            auto& entry = registry[manifestPath];
+
+            if (auto existing = entry.lock())
+                return existing;
+
+            auto newCache = std::make_shared<ProgramCache>();
+            entry = newCache;
+            return newCache;
+        }
+
+        bool canReuse (const std::vector<Compiler::DeclarationHash>& hashes, const BuildSettings& settings) const
+        {
+            return ! program.isEmpty()
+                    && ! hashes.empty()
+                    && hashes == declarationHashes
+                    && settings.sampleRate == sampleRate
+                    && settings.maxBlockSize == maxBlockSize;
+        }
+
+        bool canRespecialise (const std::vector<Compiler::DeclarationHash>& hashes) const
+        {
+            return ! unoptimisedProgram.isEmpty()
+                    && ! hashes.empty()
+                    && hashes == unoptimisedDeclarationHashes;
+        }
+
+        std::vector<Compiler::DeclarationHash> declarationHashes, unoptimisedDeclarationHashes;
+        double sampleRate = 0;
+        uint32_t maxBlockSize = 0;
+        std::vector<soul::CompileMessage> messages, unoptimisedMessages;
+        soul::Program program, unoptimisedProgram;
+        Compiler::IncrementalBuildCache incrementalBuild;
+
+        // The linked code for the current program, and what it was linked with
+        std::shared_ptr<const soul::Performer::LinkedProgram> linkedProgram;
+        ExternalValues linkedExternalValues;
+        bool linkedWithConsoleHandler = false;
+        std::string linkedStateKey;
+
+        std::mutex lock;
+    };
+
     soul::Program compileSources (soul::CompileMessageList& messageList,
                                   const BuildSettings& settings,
-                                  SourceFilePreprocessor* preprocessor)
+                                  CompilerCache* cache,
+                                  SourceFilePreprocessor* preprocessor,
+                                  ProgramCache* programCache)
     {
         BuildBundle build;
         addSource (build, preprocessor);
         build.settings = settings;
-        auto program = Compiler::build (messageList, build);
+
+        std::vector<Compiler::DeclarationHash> declarationHashes;
+
+        if (programCache != nullptr)
+        {
+            declarationHashes = Compiler::getTopLevelDeclarationHashes (build);
+
+            if (programCache->canReuse (declarationHashes, settings))
+            {
+                soul::Trace::addInstantEvent ("cache", "program cache hit");
+
+                for (auto& m : programCache->messages)
+                    messageList.add (m);
+
+                return programCache->program;
+            }
+        }
+
+        auto firstMessage = messageList.messages.size();
+        auto program = loadPrecompiledProgram (settings, preprocessor);
+        auto linkerCache = CacheConverter::create (cache);
+
+        if (program.isEmpty() && programCache != nullptr)
+            program = respecialiseCachedProgram (messageList, settings, declarationHashes, *programCache);
+
+        if (program.isEmpty())
+        {
+            soul::Program unoptimised;
+            program = Compiler::build (messageList, build, linkerCache.get(),
+                                       programCache != nullptr ? std::addressof (unoptimised) : nullptr,
+                                       programCache != nullptr ? std::addressof (programCache->incrementalBuild) : nullptr);
+
+            if (! unoptimised.isEmpty())
+            {
+                programCache->unoptimisedDeclarationHashes = declarationHashes;
+                programCache->unoptimisedMessages.assign (messageList.messages.begin() + (std::ptrdiff_t) firstMessage, messageList.messages.end());
+                programCache->unoptimisedProgram = std::move (unoptimised);
+            }
+        }
 
        #if JUCE_BELA
         {
             auto wrappedBuild = build;
             wrappedBuild.sourceFiles.push_back ({ "BelaWrapper", soul::patch::BelaWrapper::build (program) });
             wrappedBuild.settings.mainProcessor = "BelaWrapper";
-            program = Compiler::build (messageList, wrappedBuild);
+            program = Compiler::build (messageList, wrappedBuild, linkerCache.get());
         }
        #endif
 
+        if (programCache != nullptr && ! program.isEmpty())
+        {
+            programCache->declarationHashes = std::move (declarationHashes);
+            programCache->sampleRate = settings.sampleRate;
+            programCache->maxBlockSize = settings.maxBlockSize;
+            programCache->messages.assign (messageList.messages.begin() + (std::ptrdiff_t) firstMessage, messageList.messages.end());
+            programCache->program = program;
+            programCache->linkedProgram.reset();
+            programCache->linkedExternalValues.clear();
+        }
+
         return program;
     }
 
+    // The compiler's output only depends on the sample rate and block size once it has been
+    // optimised, so if just those settings have changed, the unoptimised program from the
+    // last compile can be optimised again without going back to the source.
+    static soul::Program respecialiseCachedProgram (soul::CompileMessageList& messageList,
+                                                    const BuildSettings& settings,
+                                                    const std::vector<Compiler::DeclarationHash>& declarationHashes,
+                                                    ProgramCache& programCache)
+    {
+        if (! programCache.canRespecialise (declarationHashes))
+            return {};
+
+        // The cached copy is left alone, because other players may be using it
+        auto program = programCache.unoptimisedProgram.clone();
+        soul::Trace::addInstantEvent ("cache", "program cache respecialised");
+
+        for (auto& m : programCache.unoptimisedMessages)
+            messageList.add (m);
+
+        if (! Compiler::optimise (messageList, program, settings, std::addressof (programCache.incrementalBuild)))
+            return {};
+
+        return program;
+    }
+
+    // A bundle's contents can't change, so a program that was compiled when the bundle was
+    // made can be used as long as the sources haven't been passed through a preprocessor.
+    soul::Program loadPrecompiledProgram (const BuildSettings& settings, SourceFilePreprocessor* preprocessor)
+    {
+        if (preprocessor == nullptr)
+        {
+            if (auto entry = fileList.findPrecompiledProgram (settings))
+            {
+                soul::Trace::addInstantEvent ("cache", "precompiled program found");
+                soul::CompileMessageList errors;
+                return soul::Program::createFromBinary (errors, fileList.bundle->data.data() + entry->offset, (size_t) entry->size);
+            }
+        }
+
+        return {};
+    }
+
     void compile (soul::CompileMessageList& messageList,
                   const BuildSettings& settings,
                   CompilerCache* cache,
                   SourceFilePreprocessor* preprocessor,
                   ExternalDataProvider* externalDataProvider,
-                  ConsoleMessageHandler* consoleHandler)
+                  ConsoleMessageHandler* consoleHandler,
+                  ProgramCache* programCache)
     {
+        SOUL_TRACE_SCOPE ("patch", "compile patch")
+
         if (performer == nullptr)
             return messageList.addError ("Failed to initialise JIT engine", {});
 
@@ -114,30 +292,86 @@ struct PatchPlayerImpl final  : public RefCountHelper<PatchPlayer, PatchPlayerIm
                 throwPatchLoadError (message.getFullDescription() + "\n" + message.getAnnotatedSourceLine());
         };
 
-        auto program = compileSources (messageList, settings, preprocessor);
+        auto program = compileSources (messageList, settings, cache, preprocessor, programCache);
 
         if (program.isEmpty())
             return messageList.addError ("Empty program", {});
 
+        std::optional<ExternalValues> externalValues;
+
+        if (programCache != nullptr && loadLinkedProgram (messageList, *programCache, externalDataProvider, consoleHandler, externalValues))
+            return;
+
         if (! performer->load (messageList, program))
             return messageList.addError ("Failed to load program", {});
 
+        createCostEstimates (program);
         createBuses();
         createRenderOperations (consoleHandler);
-        resolveExternalVariables (externalDataProvider);
+
+        if (! externalValues)
+            externalValues = resolveExternalVariables (externalDataProvider);
+
+        setExternalVariables (*externalValues);
 
         if (! performer->link (messageList, settings, CacheConverter::create (cache).get()))
             return messageList.addError ("Failed to link", {});
+
+        stateKey = PerformerState::createKey (program, settings);
+        initialState.capture (*performer);
+
+        if (programCache != nullptr)
+        {
+            if (auto linked = performer->getLinkedProgram())
+            {
+                programCache->linkedProgram = std::move (linked);
+                programCache->linkedExternalValues = std::move (*externalValues);
+                programCache->linkedWithConsoleHandler = consoleHandler != nullptr;
+                programCache->linkedStateKey = stateKey;
+            }
+        }
+    }
+
+    /** Tries to give the performer the code that another player linked for the cached
+        program. That's only possible if the externals resolve to the same values, and the
+        render operations ask for the same endpoints, which depends on the console handler.
+        If the externals have been resolved, the values are left in externalValues.
+    */
+    bool loadLinkedProgram (soul::CompileMessageList& messageList, ProgramCache& programCache,
+                            ExternalDataProvider* externalDataProvider, ConsoleMessageHandler* consoleHandler,
+                            std::optional<ExternalValues>& externalValues)
+    {
+        if (programCache.linkedProgram == nullptr
+             || programCache.linkedWithConsoleHandler != (consoleHandler != nullptr)
+             || ! performer->loadLinkedProgram (messageList, programCache.linkedProgram))
+            return false;
+
+        externalValues = resolveExternalVariables (externalDataProvider);
+
+        if (! areSameValues (*externalValues, programCache.linkedExternalValues))
+        {
+            performer->unload();
+            return false;
+        }
+
+        soul::Trace::addInstantEvent ("cache", "linked program shared");
+        createCostEstimates (programCache.program);
+        createBuses();
+        createRenderOperations (consoleHandler);
+        stateKey = programCache.linkedStateKey;
+        initialState.capture (*performer);
+        return true;
     }
 
     void compile (const BuildSettings& settings,
                   CompilerCache* cache,
                   SourceFilePreprocessor* preprocessor,
                   ExternalDataProvider* externalDataProvider,
-                  ConsoleMessageHandler* consoleHandler)
+                  ConsoleMessageHandler* consoleHandler,
+                  ProgramCache* programCache)
     {
         soul::CompileMessageList messageList;
-        compile (messageList, settings, cache, preprocessor, externalDataProvider, consoleHandler);
+        compile (messageList, settings, cache, preprocessor, externalDataProvider, consoleHandler, programCache);
 
         compileMessages.reserve (messageList.messages.size());
 
@@ -167,15 +401,120 @@ struct PatchPlayerImpl final  : public RefCountHelper<PatchPlayer, PatchPlayerIm
             anyErrors = anyErrors || m.isError;
     }
 
-    void resolveExternalVariables (ExternalDataProvider* externalDataProvider)
+    void createCostEstimates (const soul::Program& program)
     {
-        for (auto& ev : performer->getExternalVariables())
+        std::unordered_set<const soul::Module*> modulesDone;
+
+        std::function<void(soul::Module&)> addEstimate = [&] (soul::Module& module)
         {
-            auto value = resolveExternalVariable (externalDataProvider, ev);
+            if (! modulesDone.insert (std::addressof (module)).second)
+                return;
+
+            auto estimate = program.getCostEstimate (module);
+            costEstimates.push_back ({ makeString (module.originalFullName), estimate.stateSize,
+                                       estimate.maxOperationsPerFrame, estimate.maxOperationsPerEvent });
+
+            for (auto& instance : module.processorInstances)
+                if (auto child = program.getModuleWithName (instance->sourceName))
+                    addEstimate (*child);
+        };
+
+        if (auto main = program.getMainProcessor())
+            addEstimate (*main);
+
+        costEstimatesSpan = makeSpan (costEstimates);
+    }
+
+    ExternalValues resolveExternalVariables (ExternalDataProvider* externalDataProvider)
+    {
+        SOUL_TRACE_SCOPE ("patch", "resolve external variables")
+        auto externals = performer->getExternalVariables();
+        auto numExternals = externals.size();
+
+        std::vector<VirtualFile::Ptr> providedFiles (numExternals);
+        ExternalValues values (numExternals);
+        std::vector<std::exception_ptr> errors (numExternals);
+
+        // The data provider may not be thread-safe, so it's asked for its files on this thread,
+        // but the decoding and resampling is shared out between a set of worker threads.
+        if (externalDataProvider != nullptr)
+            for (size_t i = 0; i < numExternals; ++i)
+                providedFiles[i] = VirtualFile::Ptr (externalDataProvider->getExternalFile (externals[i].name.c_str()));
+
+        std::atomic<size_t> nextExternal { 0 };
+
+        auto resolveNextExternals = [&]
+        {
+            for (;;)
+            {
+                auto i = nextExternal++;
+
+                if (i >= numExternals)
+                    break;
+
+                try
+                {
+                    values[i] = resolveExternalVariable (providedFiles[i], externals[i]);
+                }
+                catch (...)
+                {
+                    errors[i] = std::current_exception();
+                }
+            }
+        };
+
+        auto numThreads = std::min (numExternals, static_cast<size_t> (std::max (1u, std::thread::hardware_concurrency())));
+        std::vector<std::thread> threads;
+
+        for (size_t i = 1; i < numThreads; ++i)
+            threads.emplace_back (resolveNextExternals);
+
+        resolveNextExternals();
+
+        for (auto& t : threads)
+            t.join();
 
-            if (! value.isVoid())
-                performer->setExternalVariable (ev.name.c_str(), value);
+        for (auto& error : errors)
+            if (error != nullptr)
+                std::rethrow_exception (error);
+
+        return values;
+    }
+
+    void setExternalVariables (const ExternalValues& values)
+    {
+        auto externals = performer->getExternalVariables();
+
+        for (size_t i = 0; i < values.size(); ++i)
+            if (values[i] != nullptr && ! values[i]->isVoid())
+                performer->setExternalVariable (externals[i].name.c_str(), *values[i], values[i]);
+    }
+
+    /** Values from the same cache entry are the same object, and other values can be compared
+        by their data, unless they contain strings, which only hold a handle.
+    */
+    static bool areSameValues (const ExternalValues& values1, const ExternalValues& values2)
+    {
+        if (values1.size() != values2.size())
+            return false;
+
+        for (size_t i = 0; i < values1.size(); ++i)
+        {
+            auto& v1 = values1[i];
+            auto& v2 = values2[i];
+
+            if (v1 == v2)
+                continue;
+
+            if (v1 == nullptr || v2 == nullptr
+                 || ! (v1->getType() == v2->getType())
+                 || v1->getType().usesStrings()
+                 || v1->getRawDataSize() != v2->getRawDataSize()
+                 || memcmp (v1->getRawData(), v2->getRawData(), v1->getRawDataSize()) != 0)
+                return false;
         }
+
+        return true;
     }
 
     inline choc::value::Value replaceStringsWithFileContent (const choc::value::ValueView& value,
@@ -209,11 +548,14 @@ struct PatchPlayerImpl final  : public RefCountHelper<PatchPlayer, PatchPlayerIm
         return choc::value::Value (value);
     }
 
-    choc::value::Value resolveExternalVariable (ExternalDataProvider* externalDataProvider, const ExternalVariable& ev)
+    // Audio files come from the shared DecodedAudioFileCache, and when an external is just
+    // a single file, the cached value is passed to the performer without being copied. The
+    // performer holds on to the value, so it can refer to the decoded samples in place.
+    std::shared_ptr<const choc::value::Value> resolveExternalVariable (VirtualFile::Ptr providedFile, const ExternalVariable& ev)
     {
-        if (externalDataProvider != nullptr)
-            if (auto file = externalDataProvider->getExternalFile (ev.name.c_str()))
-                return AudioFileToValue::load (VirtualFile::Ptr (file), ev.annotation);
+        SOUL_TRACE_SCOPE ("patch", "load external")
+        if (providedFile != nullptr)
+            return DecodedAudioFileCache::load (std::move (providedFile), ev.annotation);
 
         auto externals = fileList.getExternalsList();
 
@@ -221,14 +563,20 @@ struct PatchPlayerImpl final  : public RefCountHelper<PatchPlayer, PatchPlayerIm
         {
             try
             {
-                return replaceStringsWithFileContent (externals[ev.name],
+                auto external = externals[ev.name];
+
+                if (external.isString())
+                    if (auto file = fileList.checkAndCreateVirtualFile (std::string (external.getString())))
+                        return DecodedAudioFileCache::load (std::move (file), ev.annotation);
+
+                return std::make_shared<const choc::value::Value> (replaceStringsWithFileContent (external,
                                                       [&] (std::string_view s) -> choc::value::Value
                                                       {
                                                           if (auto file = fileList.checkAndCreateVirtualFile (std::string (s)))
-                                                              return AudioFileToValue::load (std::move (file), ev.annotation);
+                                                              return choc::value::Value (*DecodedAudioFileCache::load (std::move (file), ev.annotation));
 
                                                           return choc::value::createString (s);
-                                                      });
+                                                      }));
             }
             catch (const PatchLoadError& error)
             {
@@ -236,6 +584,12 @@ struct PatchPlayerImpl final  : public RefCountHelper<PatchPlayer, PatchPlayerIm
             }
         }
 
+        // Externals with annotations such as [[ sinewave ]] or [[ wavetable, sawtooth ]] are generated
+        auto generated = generateWaveform (ev.annotation);
+
+        if (! generated.isVoid())
+            return std::make_shared<const choc::value::Value> (std::move (generated));
+
         return {};
     }
 
@@ -265,48 +619,237 @@ struct PatchPlayerImpl final  : public RefCountHelper<PatchPlayer, PatchPlayerIm
                                                          + ": " + dump (eventData) + "\n").c_str());
     }
 
+    //==============================================================================
+    /** Passes console messages from the render thread to a ConsoleMessageHandler.
+
+        The render thread only copies each event's time, endpoint, type and raw value data
+        into a preallocated slot, and a background thread turns them into text and calls
+        the handler, so leaving console output in a patch never makes render() allocate or
+        wait for the handler. If the background thread falls behind, or a value is too big
+        to fit in a slot, the message is dropped, and the number of dropped messages is
+        reported along with the next ones to get through.
+    */
+    struct ConsoleMessageQueue
+    {
+        ConsoleMessageQueue (ConsoleMessageHandler& h, double rate)
+            : sampleRate (rate), fifo (numSlots), slots (numSlots)
+        {
+            h.addRef();
+            handler = ConsoleMessageHandler::Ptr (std::addressof (h));
+            thread = std::thread ([this] { run(); });
+        }
+
+        /** Delivers any messages which are still queued before returning. */
+        ~ConsoleMessageQueue()
+        {
+            {
+                std::lock_guard<std::mutex> l (stopLock);
+                shouldStop = true;
+            }
+
+            stopSignal.notify_one();
+            thread.join();
+        }
+
+        /** Called on the render thread, and never allocates or blocks. The endpoint name
+            and the value's string dictionary must outlive this queue.
+        */
+        void push (uint64_t eventTime, const std::string& endpointName, const choc::value::ValueView& eventData)
+        {
+            FIFO::WriteOperation write (fifo, 1);
+
+            if (write.failed())
+                ++numDropped;
+            else
+                slots[(size_t) write.startIndex1].store (eventTime, endpointName, eventData);
+        }
+
+    private:
+        static constexpr int numSlots = 1024;
+        static constexpr size_t maxPackedSize = 224;
+        static constexpr auto deliveryInterval = std::chrono::milliseconds (10);
+
+        struct Slot
+        {
+            uint64_t eventTime = 0;
+            const std::string* endpointName = nullptr;
+            choc::value::StringDictionary* dictionary = nullptr;
+            uint32_t typeSize = 0, dataSize = 0;
+            uint8_t packedData[maxPackedSize];
+
+            // This holds the serialised type, followed by the value's raw data
+            void store (uint64_t time, const std::string& name, const choc::value::ValueView& value)
+            {
+                eventTime = time;
+                endpointName = std::addressof (name);
+                dictionary = value.getDictionary();
+                typeSize = 0;
+                dataSize = 0;
+
+                auto& type = value.getType();
+                auto size = type.getValueDataSize();
+
+                if (type.isVoid() || size > maxPackedSize)
+                    return;
+
+                TypeWriter writer { *this, maxPackedSize - size };
+                type.serialise (writer);
+
+                if (writer.overflowed)
+                {
+                    typeSize = 0;
+                    return;
+                }
+
+                dataSize = (uint32_t) size;
+                std::memcpy (packedData + typeSize, value.getRawData(), size);
+            }
+
+            bool isValid() const    { return typeSize != 0; }
+
+            struct TypeWriter
+            {
+                Slot& slot;
+                size_t maxSize;
+                bool overflowed = false;
+
+                void write (const void* data, size_t size)
+                {
+                    if (overflowed || slot.typeSize + size > maxSize)
+                    {
+                        overflowed = true;
+                        return;
+                    }
+
+                    std::memcpy (slot.packedData + slot.typeSize, data, size);
+                    slot.typeSize += (uint32_t) size;
+                }
+            };
+        };
+
+        ConsoleMessageHandler::Ptr handler;
+        const double sampleRate;
+        FIFO fifo;
+        std::vector<Slot> slots;
+        std::atomic<uint32_t> numDropped { 0 };
+
+        std::thread thread;
+        std::mutex stopLock;
+        std::condition_variable stopSignal;
+        bool shouldStop = false;
+
+        void run()
+        {
+            for (;;)
+            {
+                bool stopping;
+
+                {
+                    std::unique_lock<std::mutex> l (stopLock);
+                    stopping = stopSignal.wait_for (l, deliveryInterval, [this] { return shouldStop; });
+                }
+
+                deliverQueuedMessages();
+
+                if (stopping)
+                    return;
+            }
+        }
+
+        void deliverQueuedMessages()
+        {
+            uint32_t numInvalid = 0;
+            uint64_t lastEventTime = 0;
+
+            while (fifo.getNumReady() > 0)
+            {
+                FIFO::ReadOperation read (fifo, 1);
+                auto& slot = slots[(size_t) read.startIndex1];
+                lastEventTime = slot.eventTime;
+
+                if (slot.isValid())
+                    deliver (slot);
+                else
+                    ++numInvalid;
+            }
+
+            if (auto total = numDropped.exchange (0) + numInvalid)
+                handler->handleConsoleMessage (lastEventTime, "_console",
+                                               ("(" + std::to_string (total) + " console messages were dropped)\n").c_str());
+        }
+
+        void deliver (Slot& slot)
+        {
+            try
+            {
+                choc::value::InputData typeData { slot.packedData, slot.packedData + slot.typeSize };
+                choc::value::ValueView value (choc::value::Type::deserialise (typeData),
+                                              slot.packedData + slot.typeSize, slot.dictionary);
+
+                printConsoleMessage (*slot.endpointName, slot.eventTime, sampleRate, value,
+                                     [this] (uint64_t time, const char* name, const char* message)
+                                     { handler->handleConsoleMessage (time, name, message); });
+            }
+            catch (const choc::value::Error&) {}
+        }
+    };
+
     void createRenderOperations (ConsoleMessageHandler* consoleHandler)
     {
+        detachParameters();
         parameters.clear();
         checkSampleRateAndBlockSize();
 
+        // The queue refers to the endpoint names held by the wrapper, so it has to go
+        // before the wrapper's pipeline gets rebuilt
+        consoleQueue.reset();
+
         decltype (wrapper)::HandleUnusedEventFn handleUnusedEvents;
-        auto sampleRate = config.sampleRate;
 
         if (consoleHandler != nullptr)
         {
-            handleUnusedEvents = [consoleHandler, sampleRate] (uint64_t eventTime, const std::string& endpointName, const choc::value::ValueView& eventData) -> bool
+            consoleQueue = std::make_unique<ConsoleMessageQueue> (*consoleHandler, config.sampleRate);
+
+            handleUnusedEvents = [queue = consoleQueue.get()] (uint64_t eventTime, const std::string& endpointName, const choc::value::ValueView& eventData) -> bool
                                  {
-                                     printConsoleMessage (endpointName, eventTime, sampleRate, eventData,
-                                                          [consoleHandler] (uint64_t time, const char* name, const char* message)
-                                                          { consoleHandler->handleConsoleMessage (time, name, message); });
+                                     queue->push (eventTime, endpointName, eventData);
                                      return true;
                                  };
         }
 
+        wrapper.setAdaptiveBlockSizing (config.isOfflineRender);
         wrapper.buildRenderingPipeline ((uint32_t) config.maxFramesPerBlock,
-                                        [&] (const EndpointDetails& endpoint) -> std::function<const float*()>
+                                        [&] (const EndpointDetails& endpoint, AudioMIDIWrapper::ParameterChangeNotifier notifier) -> const float*
                                         {
-                                            auto param = new ParameterImpl (endpoint);
+                                            auto param = new ParameterImpl (endpoint, notifier);
                                             parameters.push_back (Parameter::Ptr (param));
-                                            return [param] { return param->getValueIfChanged(); };
+                                            return std::addressof (param->value);
                                         },
                                         [] (const EndpointDetails& endpoint) -> uint32_t
                                         {
-                                            return checkRampLength (endpoint.annotation.getValue ("rampFrames"));
+                                            return checkRampLength (endpoint.metadata.rampFrames);
                                         },
                                         std::move (handleUnusedEvents));
 
         parameterSpan = makeSpan (parameters);
     }
 
+    /** Stops the parameters from telling the wrapper about any more changes, in case a
+        client is still holding on to them after the wrapper's pipeline has gone.
+    */
+    void detachParameters()
+    {
+        for (auto& p : parameters)
+            static_cast<ParameterImpl&> (*p).changeNotifier = {};
+    }
+
     //==============================================================================
     void reset() override
     {
-        performer->reset();
+        initialState.reset (*performer);
 
         for (auto& p : parameters)
-            static_cast<ParameterImpl&>(*p).changed = true;
+            static_cast<ParameterImpl&>(*p).changeNotifier.markChanged();
     }
 
     RenderResult render (RenderContext& rc) override
@@ -322,26 +865,96 @@ struct PatchPlayerImpl final  : public RefCountHelper<PatchPlayer, PatchPlayerIm
         // the public patch API headers, so this just checks that the layout is actually the same.
         static_assert (sizeof (MIDIEvent) == sizeof (soul::patch::MIDIMessage));
 
+        // The parameters were given their notifiers in the same order as they appear in the
+        // parameter list, so the automation points can also be passed straight through
+        static_assert (sizeof (AudioMIDIWrapper::ParameterAutomationPoint) == sizeof (soul::patch::ParameterAutomationPoint));
+
         wrapper.render (choc::buffer::createChannelArrayView (rc.inputChannels, rc.numInputChannels, rc.numFrames),
                         choc::buffer::createChannelArrayView (rc.outputChannels, rc.numOutputChannels, rc.numFrames),
                         reinterpret_cast<const MIDIEvent*> (rc.incomingMIDI),
                         reinterpret_cast<MIDIEvent*> (rc.outgoingMIDI),
                         rc.numMIDIMessagesIn,
                         rc.maximumMIDIMessagesOut,
-                        rc.numMIDIMessagesOut);
+                        rc.numMIDIMessagesOut,
+                        reinterpret_cast<const AudioMIDIWrapper::ParameterAutomationPoint*> (rc.parameterAutomation),
+                        rc.numParameterAutomationPoints);
+
+        for (uint32_t i = 0; i < rc.numParameterAutomationPoints; ++i)
+        {
+            auto& point = rc.parameterAutomation[i];
+
+            if (point.parameterIndex < parameters.size())
+                static_cast<ParameterImpl&> (*parameters[point.parameterIndex]).value = point.value;
+        }
 
         return RenderResult::ok;
     }
 
+    void setProfilingEnabled (bool shouldProfile) override
+    {
+        if (performer != nullptr)
+            performer->setProfilingEnabled (shouldProfile);
+    }
+
+    uint64_t saveState (void* dest, uint64_t destSize) override
+    {
+        if (anyErrors)
+            return 0;
+
+        auto size = PerformerState::getSize (*performer, stateKey);
+
+        if (dest == nullptr || destSize < size)
+            return size;
+
+        return PerformerState::save (*performer, stateKey, dest, destSize);
+    }
+
+    bool restoreState (const void* data, uint64_t size) override
+    {
+        return ! anyErrors && PerformerState::restore (*performer, stateKey, data, size);
+    }
+
+    Span<CostEstimate> getCostEstimates() const override            { return costEstimatesSpan; }
+
+    MemoryUsage getMemoryUsage() const override
+    {
+        if (anyErrors || performer == nullptr)
+            return {};
+
+        auto m = performer->getMemoryUsage();
+
+        MemoryUsage result;
+        result.programSize      = m.programSize;
+        result.codeSize         = m.codeSize;
+        result.stateSize        = m.stateSize + initialState.getSize();
+        result.streamBufferSize = m.streamBufferSize;
+        result.constantDataSize = m.constantDataSize;
+        result.externalDataSize = m.externalDataSize;
+        result.sharedDataSize   = m.sharedDataSize;
+        return result;
+    }
+
+    Span<NodeTiming> getNodeTimings() override
+    {
+        nodeTimings.clear();
+
+        if (performer != nullptr)
+            for (auto& t : performer->getNodeTimings())
+                nodeTimings.push_back ({ makeString (t.name), t.numBlocks, t.totalNanoseconds, t.maxNanoseconds });
+
+        return makeSpan (nodeTimings);
+    }
+
     //==============================================================================
     struct ParameterImpl final  : public RefCountHelper<Parameter, ParameterImpl>
     {
-        ParameterImpl (const EndpointDetails& details)  : annotation (details.annotation)
+        ParameterImpl (const EndpointDetails& details, AudioMIDIWrapper::ParameterChangeNotifier notifier)
+            : annotation (details.annotation), changeNotifier (notifier)
         {
             ID = makeString (details.name);
 
-            PatchParameterProperties props (details.name, details.annotation.toExternalValue());
-            name         = makeString (props.name);
+            auto& props = details.metadata;
+            name         = makeString (props.parameterName);
             unit         = makeString (props.unit);
             minValue     = props.minValue;
             maxValue     = props.maxValue;
@@ -371,19 +984,10 @@ struct PatchPlayerImpl final  : public RefCountHelper<PatchPlayer, PatchPlayerIm
             if (value != newValue)
             {
                 value = newValue;
-                changed = true;
+                changeNotifier.markChanged();
             }
         }
 
-        const float* getValueIfChanged()
-        {
-            if (! changed)
-                return nullptr;
-
-            changed = false;
-            return std::addressof (value);
-        }
-
         String* getProperty (const char* propertyName) const override
         {
             if (annotation.hasValue (propertyName))
@@ -403,19 +1007,19 @@ struct PatchPlayerImpl final  : public RefCountHelper<PatchPlayer, PatchPlayerIm
         }
 
         float value = 0;
-        std::atomic<bool> changed { true };
         Annotation annotation;
+        AudioMIDIWrapper::ParameterChangeNotifier changeNotifier;
         std::vector<std::string> propertyNameStrings;
         std::vector<const char*> propertyNameRawStrings;
         Span<const char*> propertyNameSpan;
     };
 
     //==============================================================================
-    static uint32_t checkRampLength (const soul::Value& v)
+    static uint32_t checkRampLength (std::optional<int64_t> rampFrames)
     {
-        if (v.getType().isPrimitive() && (v.getType().isFloatingPoint() || v.getType().isInteger()))
+        if (rampFrames)
         {
-            auto frames = v.getAsInt64();
+            auto frames = *rampFrames;
 
             if (frames < 0)
                 return 0;
@@ -446,10 +1050,16 @@ struct PatchPlayerImpl final  : public RefCountHelper<PatchPlayer, PatchPlayerIm
 
     Span<Bus> inputBusesSpan = {}, outputBusesSpan = {};
     Span<Parameter::Ptr> parameterSpan = {};
+    std::vector<NodeTiming> nodeTimings;
+    std::vector<CostEstimate> costEstimates;
+    Span<CostEstimate> costEstimatesSpan = {};
 
     PatchPlayerConfiguration config;
     std::unique_ptr<soul::Performer> performer;
     AudioMIDIWrapper wrapper;
+    std::unique_ptr<ConsoleMessageQueue> consoleQueue;
+    std::string stateKey;
+    InitialStateSnapshot initialState;
 
     static constexpr int64_t maxRampLength = 0x7fffffff;
 };
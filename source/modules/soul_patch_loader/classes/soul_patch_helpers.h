@@ -22,7 +22,12 @@ namespace soul::patch
 {
 
 //==============================================================================
-bool operator== (PatchPlayerConfiguration s1, PatchPlayerConfiguration s2)    { return s1.sampleRate == s2.sampleRate && s1.maxFramesPerBlock == s2.maxFramesPerBlock; }
+bool operator== (PatchPlayerConfiguration s1, PatchPlayerConfiguration s2)
+{
+    return s1.sampleRate == s2.sampleRate && s1.maxFramesPerBlock == s2.maxFramesPerBlock
+            && s1.isOfflineRender == s2.isOfflineRender && s1.optimisationLevel == s2.optimisationLevel;
+}
+
 bool operator!= (PatchPlayerConfiguration s1, PatchPlayerConfiguration s2)    { return ! (s1 == s2); }
 
 static bool isValidPathString (const char* s)
@@ -58,17 +63,20 @@ struct PatchLoadError
     contains the content.
 
     This will also look at the annotation to work out the required sample rate etc
-    and will attempt to wrangle the data into the format needed
+    and will attempt to wrangle the data into the format needed.
+
+    If resamplerZeroCrossings is non-zero, it overrides the quality that the annotation
+    asks for when the data needs to be resampled.
 */
 struct AudioFileToValue
 {
-    static choc::value::Value load (VirtualFile::Ptr file, const choc::value::ValueView& annotation)
+    static choc::value::Value load (VirtualFile::Ptr file, const choc::value::ValueView& annotation, int resamplerZeroCrossings = 0)
     {
         SOUL_ASSERT (file != nullptr);
         std::string fileName (file->getAbsolutePath()->getCharPointer());
 
         if (auto reader = createAudioFileReader (file))
-            return loadAudioFileAsValue (*reader, fileName, annotation);
+            return loadAudioFileAsValue (*reader, fileName, annotation, resamplerZeroCrossings);
 
         throwPatchLoadError ("Failed to read file " + quoteName (fileName));
         return {};
@@ -78,7 +86,8 @@ private:
     static constexpr unsigned int maxNumChannels = 8;
     static constexpr uint64_t maxNumFrames = 48000 * 60;
 
-    static choc::value::Value loadAudioFileAsValue (juce::AudioFormatReader& reader, const std::string& fileName, const choc::value::ValueView& annotation)
+    static choc::value::Value loadAudioFileAsValue (juce::AudioFormatReader& reader, const std::string& fileName,
+                                                    const choc::value::ValueView& annotation, int resamplerZeroCrossings)
     {
         if (reader.sampleRate > 0)
         {
@@ -94,10 +103,15 @@ private:
             if (numFrames == 0)
                 return {};
 
+            if (annotation["resample"].isVoid() && annotation["sourceChannel"].isVoid())
+                return readAudioFileObject (reader, numSourceChannels, numFrames);
+
             choc::buffer::ChannelArrayBuffer<float> buffer (numSourceChannels, numFrames);
             reader.read (buffer.getView().data.channels, (int) numSourceChannels, 0, (int) numFrames);
 
-            resampleAudioDataIfNeeded (buffer, reader.sampleRate, annotation["resample"]);
+            resampleAudioDataIfNeeded (buffer, reader.sampleRate, annotation["resample"],
+                                       resamplerZeroCrossings != 0 ? resamplerZeroCrossings
+                                                                   : getResamplerZeroCrossings (annotation["resampleQuality"]));
             extractChannelIfNeeded (buffer, annotation["sourceChannel"]);
 
             auto result = convertAudioDataToObject (buffer, reader.sampleRate);
@@ -111,8 +125,64 @@ private:
         return {};
     }
 
+    /** When the data doesn't need any processing, this decodes it a chunk at a time, straight
+        into the frame array of the object that gets returned. That avoids holding a complete
+        decoded copy and then a complete converted copy of a large sample file at the same time.
+    */
+    static choc::value::Value readAudioFileObject (juce::AudioFormatReader& reader, uint32_t numChannels, uint32_t numFrames)
+    {
+        auto objectType = choc::value::Type::createObject ("soul::AudioFile");
+        objectType.addObjectMember ("frames", choc::value::Type::createArrayOfVectors<float> (numFrames, numChannels));
+        objectType.addObjectMember ("sampleRate", choc::value::Type::createFloat64());
+
+        choc::value::Value result (std::move (objectType));
+        result["sampleRate"].set (reader.sampleRate);
+
+        auto frames = choc::buffer::createInterleavedView (static_cast<float*> (result["frames"].getRawData()), numChannels, numFrames);
+
+        constexpr uint32_t framesPerChunk = 32768;
+        choc::buffer::ChannelArrayBuffer<float> chunk (numChannels, std::min (framesPerChunk, numFrames));
+
+        for (uint32_t start = 0; start < numFrames; start += framesPerChunk)
+        {
+            auto numToRead = std::min (framesPerChunk, numFrames - start);
+
+            if (! reader.read (chunk.getView().data.channels, (int) numChannels, (juce::int64) start, (int) numToRead))
+                throwPatchLoadError ("Could not load audio file");
+
+            copy (frames.getFrameRange ({ start, start + numToRead }), chunk.getStart (numToRead));
+        }
+
+        return result;
+    }
+
+public:
+    static constexpr int fastResamplerZeroCrossings    = 16;
+    static constexpr int normalResamplerZeroCrossings  = 50;
+    static constexpr int bestResamplerZeroCrossings    = 100;
+
+    /** The 'resampleQuality' annotation can be "fast", "normal" (the default), "best", or
+        "deferred", which means a fast version to begin with, to be replaced by a normal one
+        later (see DecodedAudioFileCache).
+    */
+    static int getResamplerZeroCrossings (const choc::value::ValueView& quality)
+    {
+        if (quality.isVoid())
+            return normalResamplerZeroCrossings;
+
+        auto name = quality.isString() ? std::string (quality.getString()) : std::string();
+
+        if (name == "fast" || name == "deferred")  return fastResamplerZeroCrossings;
+        if (name == "normal")                      return normalResamplerZeroCrossings;
+        if (name == "best")                        return bestResamplerZeroCrossings;
+
+        throwPatchLoadError ("The value of the 'resampleQuality' annotation must be \"fast\", \"normal\", \"best\" or \"deferred\"");
+    }
+
+private:
     static void resampleAudioDataIfNeeded (choc::buffer::ChannelArrayBuffer<float>& buffer,
-                                           double currentRate, const choc::value::ValueView& resampleRate)
+                                           double currentRate, const choc::value::ValueView& resampleRate,
+                                           int zeroCrossings)
     {
         if (! resampleRate.isVoid())
         {
@@ -132,7 +202,7 @@ private:
                 if (newNumFrames > 0 && newNumFrames < maxNumFrames)
                 {
                     choc::buffer::ChannelArrayBuffer<float> newBuffer (buffer.getNumChannels(), (uint32_t) newNumFrames);
-                    resampleToFit (newBuffer, buffer);
+                    resampleToFit (newBuffer, buffer, zeroCrossings);
                     buffer = std::move (newBuffer);
                     return;
                 }
@@ -175,6 +245,270 @@ private:
     }
 };
 
+//==============================================================================
+/** A process-wide cache of the values that AudioFileToValue produces, so that players
+    which use the same audio file share a single decoded copy instead of each decoding it.
+
+    Entries are keyed on the file's path, size and modification time, along with the
+    annotation properties that affect the decoded data. If several threads ask for the
+    same file at once, only one of them decodes it and the others wait for the result.
+    Once the total size of the cached data goes over a limit, the least recently used
+    entries are dropped, but any players still holding them keep them alive.
+
+    When an external's 'resampleQuality' annotation is "deferred", the first load does a
+    fast, low-quality resample so that the player can start straight away, and the cache
+    then redoes it at normal quality on a background thread. Players that load the file
+    after that has finished get the better version.
+*/
+struct DecodedAudioFileCache
+{
+    static std::shared_ptr<const choc::value::Value> load (VirtualFile::Ptr file, const choc::value::ValueView& annotation)
+    {
+        SOUL_ASSERT (file != nullptr);
+        auto& cache = getInstance();
+        auto key = createKey (*file, annotation);
+        bool isNewEntry = false;
+
+        auto value = cache.findOrLoad (key, [&]
+        {
+            isNewEntry = true;
+            return std::make_shared<const choc::value::Value> (AudioFileToValue::load (file, annotation));
+        });
+
+        if (isNewEntry && isDeferredResample (annotation))
+            cache.addDeferredResample ({ std::move (file), choc::value::Value (annotation), std::move (key) });
+
+        return value;
+    }
+
+    /** Sets the total number of bytes of decoded data that will be kept in the cache. */
+    static void setMaximumSize (size_t newMaxSize)
+    {
+        auto& cache = getInstance();
+        std::lock_guard<std::mutex> lock (cache.lock);
+        cache.maxSize = newMaxSize;
+        cache.trim();
+    }
+
+private:
+    using ValuePtr = std::shared_ptr<const choc::value::Value>;
+
+    struct Entry
+    {
+        std::shared_future<ValuePtr> value;
+        size_t size = 0;
+        std::list<std::string>::iterator recentListPosition;
+    };
+
+    struct DeferredResample
+    {
+        VirtualFile::Ptr file;
+        choc::value::Value annotation;
+        std::string key;
+    };
+
+    std::mutex lock;
+    std::unordered_map<std::string, Entry> entries;
+    std::list<std::string> recentlyUsed;
+    size_t totalSize = 0, maxSize = 512 * 1024 * 1024;
+
+    std::vector<DeferredResample> deferredResamples;
+    std::condition_variable deferredResampleAdded;
+    std::thread deferredResampleThread;
+    bool shouldExit = false;
+
+    DecodedAudioFileCache() = default;
+
+    ~DecodedAudioFileCache()
+    {
+        {
+            std::lock_guard<std::mutex> l (lock);
+            shouldExit = true;
+        }
+
+        deferredResampleAdded.notify_all();
+
+        if (deferredResampleThread.joinable())
+            deferredResampleThread.join();
+    }
+
+    static DecodedAudioFileCache& getInstance()
+    {
+        static DecodedAudioFileCache cache;
+        return cache;
+    }
+
+    static bool isDeferredResample (const choc::value::ValueView& annotation)
+    {
+        auto quality = annotation["resampleQuality"];
+        return ! annotation["resample"].isVoid() && quality.isString() && quality.getString() == "deferred";
+    }
+
+    void addDeferredResample (DeferredResample&& item)
+    {
+        {
+            std::lock_guard<std::mutex> l (lock);
+            deferredResamples.push_back (std::move (item));
+
+            if (! deferredResampleThread.joinable())
+                deferredResampleThread = std::thread ([this] { runDeferredResamples(); });
+        }
+
+        deferredResampleAdded.notify_one();
+    }
+
+    void runDeferredResamples()
+    {
+        std::unique_lock<std::mutex> l (lock);
+
+        for (;;)
+        {
+            deferredResampleAdded.wait (l, [this] { return shouldExit || ! deferredResamples.empty(); });
+
+            if (shouldExit)
+                return;
+
+            auto item = std::move (deferredResamples.front());
+            deferredResamples.erase (deferredResamples.begin());
+            l.unlock();
+
+            ValuePtr newValue;
+
+            try
+            {
+                newValue = std::make_shared<const choc::value::Value> (AudioFileToValue::load (item.file, item.annotation,
+                                                                                               AudioFileToValue::normalResamplerZeroCrossings));
+            }
+            catch (const PatchLoadError&) {}
+
+            l.lock();
+
+            if (newValue != nullptr)
+                replaceValue (item.key, std::move (newValue));
+        }
+    }
+
+    // If the entry has been dropped from the cache in the meantime, there's no point keeping
+    // the new version either
+    void replaceValue (const std::string& key, ValuePtr newValue)
+    {
+        auto entry = entries.find (key);
+
+        if (entry != entries.end() && entry->second.size != 0)
+        {
+            std::promise<ValuePtr> promise;
+            auto newSize = newValue->getRawDataSize();
+            promise.set_value (std::move (newValue));
+
+            entry->second.value = promise.get_future().share();
+            totalSize = totalSize - entry->second.size + newSize;
+            entry->second.size = newSize;
+            trim();
+        }
+    }
+
+    static std::string createKey (VirtualFile& file, const choc::value::ValueView& annotation)
+    {
+        auto getProperty = [&] (const char* name) -> std::string
+        {
+            auto v = annotation[name];
+
+            if (v.isString())
+                return std::string (v.getString());
+
+            return v.isVoid() ? std::string() : std::to_string (v.getWithDefault<double> (0));
+        };
+
+        return String::Ptr (file.getAbsolutePath()).toString<std::string>()
+                + "|" + std::to_string (file.getSize())
+                + "|" + std::to_string (file.getLastModificationTime())
+                + "|" + getProperty ("resample")
+                + "|" + getProperty ("sourceChannel")
+                + "|" + getProperty ("resampleQuality");
+    }
+
+    template <typename LoadFn>
+    ValuePtr findOrLoad (const std::string& key, LoadFn&& loadValue)
+    {
+        std::promise<ValuePtr> promise;
+        std::shared_future<ValuePtr> existingValue;
+
+        {
+            std::lock_guard<std::mutex> l (lock);
+            auto existing = entries.find (key);
+
+            if (existing != entries.end())
+            {
+                recentlyUsed.splice (recentlyUsed.begin(), recentlyUsed, existing->second.recentListPosition);
+                existingValue = existing->second.value;
+            }
+            else
+            {
+                recentlyUsed.push_front (key);
+                entries[key] = { promise.get_future().share(), 0, recentlyUsed.begin() };
+            }
+        }
+
+        if (existingValue.valid())
+            return existingValue.get();
+
+        try
+        {
+            auto value = loadValue();
+            promise.set_value (value);
+
+            std::lock_guard<std::mutex> l (lock);
+            auto entry = entries.find (key);
+
+            if (entry != entries.end())
+            {
+                entry->second.size = value->getRawDataSize();
+                totalSize += entry->second.size;
+                trim();
+            }
+
+            return value;
+        }
+        catch (...)
+        {
+            promise.set_exception (std::current_exception());
+            std::lock_guard<std::mutex> l (lock);
+            remove (key);
+            throw;
+        }
+    }
+
+    void remove (const std::string& key)
+    {
+        auto entry = entries.find (key);
+
+        if (entry != entries.end())
+        {
+            totalSize -= entry->second.size;
+            recentlyUsed.erase (entry->second.recentListPosition);
+            entries.erase (entry);
+        }
+    }
+
+    void trim()
+    {
+        auto i = recentlyUsed.end();
+
+        while (totalSize > maxSize && i != recentlyUsed.begin())
+        {
+            auto entry = entries.find (*--i);
+
+            // entries which are still being loaded have a size of zero, and are left alone
+            if (entry->second.size != 0)
+            {
+                totalSize -= entry->second.size;
+                entries.erase (entry);
+                i = recentlyUsed.erase (i);
+            }
+        }
+    }
+};
+
 //==============================================================================
 /** Wraps a CompilerCache object and presents it as via the LinkerCache interface */
 struct CacheConverter  : public LinkerCache
@@ -199,6 +533,24 @@ struct CacheConverter  : public LinkerCache
         return cache.readItemFromCache (key, destAddress, destSize);
     }
 
+    std::unique_ptr<ItemView> getItemView (const char* key) override
+    {
+        struct View  : public ItemView
+        {
+            View (CompilerCache::ItemView* v) : view (v) {}
+
+            const void* getData() const override    { return view->getData(); }
+            uint64_t getSize() const override       { return view->getSize(); }
+
+            CompilerCache::ItemView::Ptr view;
+        };
+
+        if (auto view = cache.getItemView (key))
+            return std::make_unique<View> (view);
+
+        return {};
+    }
+
     CompilerCache& cache;
 };
 
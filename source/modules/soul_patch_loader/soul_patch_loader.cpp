@@ -22,8 +22,13 @@
 #include "JuceHeader.h"
 
 #include "../../API/soul_patch/helper_classes/soul_patch_Utilities.h"
+#include "../../API/soul_patch/helper_classes/soul_patch_CompileService.h"
+
+#include <future>
+#include <list>
 
 #include "classes/soul_patch_helpers.h"
+#include "classes/soul_patch_Bundle.h"
 #include "classes/soul_patch_FileList.h"
 #include "classes/soul_patch_BelaTransformation.h"
 #include "classes/soul_patch_PlayerImpl.h"
@@ -41,8 +46,26 @@ namespace soul::patch
                                         soul::patch::VirtualFile* file)
     {
         if (file != nullptr && performerFactory != nullptr)
-            return new soul::patch::PatchInstanceImpl (std::move (performerFactory),
-                                                       soul::patch::VirtualFile::Ptr (file));
+        {
+            auto filePtr = soul::patch::VirtualFile::Ptr (file);
+
+            if (PatchBundle::isBundleFile (String::Ptr (filePtr->getName()).toString<std::string>()))
+            {
+                try
+                {
+                    auto bundle = PatchBundle::load (*filePtr);
+                    auto manifest = VirtualFile::Ptr (new BundledFile (bundle, bundle->findManifest()));
+
+                    return new soul::patch::PatchInstanceImpl (std::move (performerFactory), std::move (manifest), std::move (bundle));
+                }
+                catch (const PatchLoadError&)
+                {
+                    // fall through, and let the instance report the problem when it's asked for a description
+                }
+            }
+
+            return new soul::patch::PatchInstanceImpl (std::move (performerFactory), std::move (filePtr));
+        }
 
         return {};
     }
@@ -31,12 +31,13 @@ struct AudioMIDISystem  : private juce::AudioIODeviceCallback,
         if (requirements.sampleRate < 1000.0 || requirements.sampleRate > 48000.0 * 8)
             requirements.sampleRate = 0;
 
-        if (requirements.blockSize < 1 || requirements.blockSize > 2048)
+        if (requirements.blockSize < 1 || requirements.blockSize > static_cast<int> (BuildSettings::maxSupportedBlockSize))
             requirements.blockSize = 0;
 
-        constexpr uint32_t midiFIFOSize = 1024;
-        inputMIDIBuffer.reserve (midiFIFOSize);
-        midiFIFO.reset (midiFIFOSize);
+        isAdaptingBlockSize = requirements.blockSize == 0 && requirements.maxCPULoad > 0;
+
+        midiFIFO.reset (std::max (16u, requirements.midiInputQueueSize));
+        inputMIDIBuffer.reserve (midiFIFO.getCapacity());
         openAudioDevice();
         startTimerHz (3);
     }
@@ -87,6 +88,27 @@ struct AudioMIDISystem  : private juce::AudioIODeviceCallback,
     float getCPULoad() const                    { return loadMeasurer.getCurrentLoad(); }
     int getXRunCount() const                    { return audioDevice != nullptr ? audioDevice->getXRunCount() : -1; }
 
+    /** Counts the incoming MIDI messages that had to be dropped because the queue was full. */
+    uint32_t getNumMIDIOverflows() const        { return numMIDIOverflows.load(); }
+
+    /** Counts the incoming MIDI messages which arrived too late to be played at the right frame,
+        and were moved to the start of the next block instead.
+    */
+    uint32_t getNumLateMIDIMessages() const     { return numLateMIDIMessages.load(); }
+
+    /** Returns the delay in frames between audio arriving at the device's inputs and the
+        result of rendering it reaching the outputs. This is the total of the latencies that the
+        device reports, plus one block for the time taken to fill the input buffer.
+    */
+    uint32_t getInputToOutputLatency() const
+    {
+        if (audioDevice == nullptr || sampleRate == 0)
+            return 0;
+
+        return static_cast<uint32_t> (std::max (0, audioDevice->getInputLatencyInSamples())
+                                        + std::max (0, audioDevice->getOutputLatencyInSamples())) + blockSize;
+    }
+
     int getNumInputChannels() const             { return audioDevice != nullptr ? audioDevice->getActiveInputChannels().countNumberOfSetBits() : 0; }
     int getNumOutputChannels() const            { return audioDevice != nullptr ? audioDevice->getActiveOutputChannels().countNumberOfSetBits() : 0; }
 
@@ -102,21 +124,29 @@ private:
     double sampleRate = 0;
     uint32_t blockSize = 0;
 
+    // When the block size is being chosen automatically, these are the sizes the device offers,
+    // smallest first, and the index of the one that's currently in use
+    bool isAdaptingBlockSize = false;
+    std::vector<int> availableBlockSizes;
+    size_t blockSizeIndex = 0;
+    int xrunsAtStart = 0;
+    static constexpr int minAdaptiveBlockSize = 16;
+
     juce::StringArray lastMidiDevices;
     std::vector<std::unique_ptr<juce::MidiInput>> midiInputs;
     std::chrono::system_clock::time_point lastMIDIDeviceCheckTime, lastKnownActiveCallbackTime;
 
-    using MIDIClock = std::chrono::high_resolution_clock;
-
     struct IncomingMIDIEvent
     {
-        MIDIClock::time_point time;
+        double time; // in seconds, on the same clock as getMIDITimeNow()
         choc::midi::ShortMessage message;
     };
 
-    choc::fifo::SingleReaderSingleWriterFIFO<IncomingMIDIEvent> midiFIFO;
+    // Each MIDI device may call back on its own thread, so this needs to allow multiple writers
+    MultipleWriterFIFO<IncomingMIDIEvent> midiFIFO;
     std::vector<MIDIEvent> inputMIDIBuffer;
-    MIDIClock::time_point lastMIDIBlockTime;
+    double currentBlockStartTime = 0, previousBlockStartTime = 0;
+    std::atomic<uint32_t> numMIDIOverflows { 0 }, numLateMIDIMessages { 0 };
 
     CPULoadMeasurer loadMeasurer;
 
@@ -138,7 +168,9 @@ private:
 
         lastCallbackCount = 0;
         audioCallbackCount = 0;
-        midiFIFO.reset();
+        xrunsAtStart = device->getXRunCount();
+        currentBlockStartTime = 0;
+        discardQueuedMIDI();
 
         loadMeasurer.reset();
 
@@ -203,49 +235,180 @@ private:
            #if JUCE_BELA
             inputMIDIBuffer.push_back ({ 0, m });
            #else
-            midiFIFO.push ({ MIDIClock::now(), m });
+            // JUCE stamps incoming messages with the time that the device reported for them, so
+            // use that rather than the time this callback happens to run, if it's been set
+            auto time = message.getTimeStamp() > 0 ? message.getTimeStamp() : getMIDITimeNow();
+
+            if (! midiFIFO.push ({ time, m }))
+                ++numMIDIOverflows;
            #endif
         }
     }
 
+    static double getMIDITimeNow()
+    {
+        return juce::Time::getMillisecondCounterHiRes() * 0.001;
+    }
+
+    /** Works out the time at which the current block started. Audio callbacks arrive with some
+        jitter, so rather than using the time of each callback, this keeps a running estimate
+        which advances by the length of each block, and is only pulled gradually towards the
+        callback times. If the two drift apart by more than a couple of blocks (e.g. after a
+        dropout), it jumps straight to the callback time.
+    */
+    void updateBlockStartTime (uint32_t numFrames)
+    {
+        auto now = getMIDITimeNow();
+        auto blockLength = numFrames / sampleRate;
+        previousBlockStartTime = currentBlockStartTime;
+
+        if (previousBlockStartTime == 0)
+        {
+            currentBlockStartTime = now;
+            previousBlockStartTime = now - blockLength;
+            return;
+        }
+
+        auto expected = previousBlockStartTime + blockLength;
+        auto error = now - expected;
+
+        if (std::abs (error) > 2.0 * blockLength)
+            currentBlockStartTime = now;
+        else
+            currentBlockStartTime = expected + error * 0.05;
+    }
+
+    /** Moves the queued MIDI into inputMIDIBuffer, sorted by frame.
+        Events are played with a fixed latency of one block: a message which arrived at a given
+        time during the previous block is played at the same offset into this one, so the spacing
+        between messages is preserved exactly, regardless of when the callbacks run.
+    */
     void fillMIDIInputBuffer (uint32_t numFrames)
     {
         inputMIDIBuffer.clear();
-        auto now = MIDIClock::now();
-        using TimeSeconds = std::chrono::duration<double, std::ratio<1, 1>>;
-        auto startOfFrame = lastMIDIBlockTime;
-        lastMIDIBlockTime = now;
+        updateBlockStartTime (numFrames);
 
-        if (midiFIFO.getUsedSlots() != 0)
+        auto capacity = inputMIDIBuffer.capacity();
+        IncomingMIDIEvent e;
+
+        while (inputMIDIBuffer.size() < capacity && midiFIFO.pop (e))
         {
-            auto frameLength = TimeSeconds (1.0 / sampleRate);
-            IncomingMIDIEvent e;
+            auto frame = std::floor ((e.time - previousBlockStartTime) * sampleRate);
+            uint32_t frameIndex;
 
-            while (midiFIFO.pop (e))
+            if (frame < 0)
+            {
+                frameIndex = 0;
+                ++numLateMIDIMessages;
+            }
+            else
             {
-                TimeSeconds timeSinceBufferStart = e.time - startOfFrame;
-                auto frame = static_cast<int> (timeSinceBufferStart.count() / frameLength.count());
+                frameIndex = frame < numFrames ? static_cast<uint32_t> (frame) : numFrames - 1;
+            }
 
-                if (frame < 0)
-                {
-                    if (frame < -40000)
-                        break;
+            // Messages from different devices may be queued out of order, so this keeps the buffer sorted
+            auto insertPos = inputMIDIBuffer.end();
 
-                    frame = 0;
-                }
+            while (insertPos != inputMIDIBuffer.begin() && (insertPos - 1)->frameIndex > frameIndex)
+                --insertPos;
 
-                auto frameIndex = static_cast<uint32_t> (frame) < numFrames ? static_cast<uint32_t> (frame)
-                                                                            : static_cast<uint32_t> (numFrames - 1);
-                inputMIDIBuffer.push_back ({ frameIndex, e.message });
-            }
+            inputMIDIBuffer.insert (insertPos, { frameIndex, e.message });
         }
     }
 
+    void discardQueuedMIDI()
+    {
+        IncomingMIDIEvent e;
+
+        while (midiFIFO.pop (e))
+        {}
+    }
+
     void timerCallback() override
     {
         auto now = std::chrono::system_clock::now();
         checkMIDIDevices (now);
         checkForStalledProcessor (now);
+        checkBlockSize();
+    }
+
+    /** If the block size is being chosen automatically, this moves up to the next size the
+        device supports if the current one is too small to render without risking dropouts.
+        The size only ever goes up, so that it settles rather than bouncing between two sizes.
+    */
+    void checkBlockSize()
+    {
+        if (! isAdaptingBlockSize || audioDevice == nullptr || sampleRate == 0
+             || blockSizeIndex + 1 >= availableBlockSizes.size()
+             || totalFramesProcessed <= numWarmUpFrames)
+            return;
+
+        // Give the load measurement half a second to settle after each change
+        if (audioCallbackCount.load() * static_cast<double> (blockSize) < sampleRate * 0.5)
+            return;
+
+        auto xruns = audioDevice->getXRunCount();
+        auto hadXRun = xruns > 0 && xruns > xrunsAtStart;
+        auto load = getCPULoad();
+
+        if (load > requirements.maxCPULoad || hadXRun)
+        {
+            auto newSize = availableBlockSizes[++blockSizeIndex];
+
+            log ("Increasing block size to " + std::to_string (newSize)
+                   + (hadXRun ? " after an xrun" : " (CPU load " + std::to_string (static_cast<int> (load * 100.0f)) + "%)"));
+
+            audioDevice->close();
+            auto error = openDevice (newSize);
+
+            if (error.isNotEmpty())
+            {
+                log (("Error reopening audio device: " + error).toStdString());
+                isAdaptingBlockSize = false;
+                error = openDevice (availableBlockSizes[--blockSizeIndex]);
+            }
+
+            if (error.isEmpty())
+                audioDevice->start (this);
+        }
+    }
+
+    /** Finds the block sizes the device supports that can be used when choosing one automatically,
+        and returns the smallest, or 0 if there aren't any.
+    */
+    int findAdaptiveBlockSizes()
+    {
+        availableBlockSizes.clear();
+        blockSizeIndex = 0;
+
+        for (auto size : audioDevice->getAvailableBufferSizes())
+            if (size >= minAdaptiveBlockSize && size <= static_cast<int> (BuildSettings::maxSupportedBlockSize))
+                availableBlockSizes.push_back (size);
+
+        std::sort (availableBlockSizes.begin(), availableBlockSizes.end());
+
+        if (availableBlockSizes.empty())
+        {
+            isAdaptingBlockSize = false;
+            return 0;
+        }
+
+        return availableBlockSizes.front();
+    }
+
+    juce::String openDevice (int blockSizeToUse)
+    {
+        auto getBitSetForNumChannels = [] (int num)
+        {
+            juce::BigInteger b;
+            b.setRange (0, num, true);
+            return b;
+        };
+
+        return audioDevice->open (getBitSetForNumChannels (requirements.numInputChannels),
+                                  getBitSetForNumChannels (requirements.numOutputChannels),
+                                  requirements.sampleRate,
+                                  blockSizeToUse);
     }
 
     void checkForStalledProcessor (std::chrono::system_clock::time_point now)
@@ -291,17 +454,8 @@ private:
                                                    });
             }
 
-            auto getBitSetForNumChannels = [] (int num)
-            {
-                juce::BigInteger b;
-                b.setRange (0, num, true);
-                return b;
-            };
-
-            auto error = audioDevice->open (getBitSetForNumChannels (requirements.numInputChannels),
-                                            getBitSetForNumChannels (requirements.numOutputChannels),
-                                            requirements.sampleRate,
-                                            requirements.blockSize);
+            auto error = openDevice (isAdaptingBlockSize ? findAdaptiveBlockSizes()
+                                                         : requirements.blockSize);
 
             if (error.isEmpty())
             {
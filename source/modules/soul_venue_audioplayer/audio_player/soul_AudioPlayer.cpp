@@ -27,18 +27,26 @@ class AudioPlayerVenue   : public soul::Venue,
 {
 public:
     AudioPlayerVenue (Requirements r, std::unique_ptr<PerformerFactory> factory)
-        : audioSystem (std::move (r)),
+        : audioSystem (r),
           performerFactory (std::move (factory))
     {
         createDeviceEndpoints (audioSystem.getNumInputChannels(),
                                audioSystem.getNumOutputChannels());
+
+        maxMixFrames = std::max (audioSystem.getMaxBlockSize(), AudioMIDIWrapper::defaultMaxChunkSize);
+        chunkMIDI.reserve (std::max (16u, r.midiInputQueueSize));
+
+        if (r.numRenderThreads > 1)
+            renderThreads = std::make_unique<RenderThreadPool> (r.numRenderThreads - 1, r.renderThreadPriority);
     }
 
     ~AudioPlayerVenue() override
     {
         SOUL_ASSERT (activeSessions.empty());
         audioSystem.setCallback (nullptr);
+        renderThreads.reset();
         performerFactory.reset();
+        delete renderSessions.exchange (nullptr);
     }
 
     std::unique_ptr<Venue::Session> createSession() override
@@ -80,9 +88,9 @@ public:
     //==============================================================================
     struct AudioPlayerSession   : public Venue::Session
     {
-        AudioPlayerSession (AudioPlayerVenue& v)  : venue (v)
+        AudioPlayerSession (AudioPlayerVenue& v)
+            : venue (v), performer (venue.performerFactory->createPerformer()), operations (*performer)
         {
-            performer = venue.performerFactory->createPerformer();
         }
 
         ~AudioPlayerSession() override
@@ -99,6 +107,7 @@ public:
 
             if (performer->load (messageList, p))
             {
+                endpointIndex.build (performer->getInputEndpoints(), performer->getOutputEndpoints());
                 setState (State::loaded);
                 return true;
             }
@@ -108,11 +117,21 @@ public:
 
         EndpointHandle getEndpointHandle (const EndpointID& endpointID) override  { return performer->getEndpointHandle (endpointID); }
 
+        std::vector<EndpointHandle> getEndpointHandles (ArrayView<const EndpointDetails> endpoints) override
+        {
+            return performer->getEndpointHandles (endpoints);
+        }
+
         void setNextInputStreamFrames (EndpointHandle handle, const choc::value::ValueView& frameArray) override
         {
             performer->setNextInputStreamFrames (handle, frameArray);
         }
 
+        bool setNextInputStreamChannels (EndpointHandle handle, choc::buffer::ChannelArrayView<const float> channels) override
+        {
+            return performer->setNextInputStreamChannels (handle, channels);
+        }
+
         void setSparseInputStreamTarget (EndpointHandle handle, const choc::value::ValueView& targetFrameValue, uint32_t numFramesToReachValue, float curveShape) override
         {
             performer->setSparseInputStreamTarget (handle, targetFrameValue, numFramesToReachValue, curveShape);
@@ -143,6 +162,16 @@ public:
             return performer->isEndpointActive (e);
         }
 
+        void setProfilingEnabled (bool shouldProfile) override
+        {
+            performer->setProfilingEnabled (shouldProfile);
+        }
+
+        std::vector<NodeTiming> getNodeTimings() override
+        {
+            return performer->getNodeTimings();
+        }
+
         bool link (CompileMessageList& messageList, const BuildSettings& settings) override
         {
             maxBlockSize = settings.maxBlockSize;
@@ -189,11 +218,11 @@ public:
         {
             stop();
             performer->unload();
-            preRenderOperations.clear();
-            postRenderOperations.clear();
+            operations.clear();
             inputCallbacks.clear();
             outputCallbacks.clear();
             connections.clear();
+            endpointIndex.clear();
             setState (State::empty);
         }
 
@@ -228,6 +257,7 @@ public:
         void setStateChangeCallback (StateChangeCallbackFn f) override     { stateChangeCallback = std::move (f); }
 
         uint64_t getTotalFramesRendered() const override                   { return totalFramesRendered; }
+        uint32_t getInputToOutputLatency() override                        { return venue.audioSystem.getInputToOutputLatency(); }
 
         bool setInputEndpointServiceCallback (EndpointID endpoint, EndpointServiceFn callback) override
         {
@@ -253,21 +283,20 @@ public:
 
         bool connectInputEndpoint (const EndpointInfo& externalEndpoint, EndpointID inputID)
         {
-            for (auto& details : performer->getInputEndpoints())
+            if (auto position = endpointIndex.findInput (inputID))
             {
-                if (details.endpointID == inputID)
+                auto& details = performer->getInputEndpoints()[*position];
+
+                if (isStream (details) && ! externalEndpoint.isMIDI)
                 {
-                    if (isStream (details) && ! externalEndpoint.isMIDI)
-                    {
-                        connections.push_back ({ externalEndpoint.audioChannelIndex, -1, false, details.endpointID });
-                        return true;
-                    }
+                    connections.push_back ({ externalEndpoint.audioChannelIndex, -1, false, *position });
+                    return true;
+                }
 
-                    if (isEvent (details) && externalEndpoint.isMIDI)
-                    {
-                        connections.push_back ({ -1, -1, true, details.endpointID });
-                        return true;
-                    }
+                if (isEvent (details) && externalEndpoint.isMIDI)
+                {
+                    connections.push_back ({ -1, -1, true, *position });
+                    return true;
                 }
             }
 
@@ -276,15 +305,12 @@ public:
 
         bool connectOutputEndpoint (const EndpointInfo& externalEndpoint, EndpointID outputID)
         {
-            for (auto& details : performer->getOutputEndpoints())
+            if (auto position = endpointIndex.findOutput (outputID))
             {
-                if (details.endpointID == outputID)
+                if (isStream (performer->getOutputEndpoints()[*position]) && ! externalEndpoint.isMIDI)
                 {
-                    if (isStream (details) && ! externalEndpoint.isMIDI)
-                    {
-                        connections.push_back ({ -1, externalEndpoint.audioChannelIndex, false, details.endpointID });
-                        return true;
-                    }
+                    connections.push_back ({ -1, externalEndpoint.audioChannelIndex, false, *position });
+                    return true;
                 }
             }
 
@@ -293,99 +319,83 @@ public:
 
         void buildOperationList()
         {
-            preRenderOperations.clear();
-            postRenderOperations.clear();
+            operations.clear();
 
             for (auto& connection : connections)
             {
-                auto& perf = *performer;
-                auto endpointHandle = performer->getEndpointHandle (connection.endpointID);
-
                 if (connection.isMIDI)
                 {
-                    if (isMIDIEventEndpoint (findDetailsForID (perf.getInputEndpoints(), connection.endpointID)))
-                    {
-                        auto midiEvent = choc::value::createObject ("soul::midi::Message",
-                                                                    "midiBytes", int32_t {});
-
-                        preRenderOperations.push_back ([&perf, endpointHandle, midiEvent] (RenderContext& rc) mutable
-                        {
-                            for (uint32_t i = 0; i < rc.midiInCount; ++i)
-                            {
-                                midiEvent.getObjectMemberAt (0).value.set (rc.midiIn[i].getPackedMIDIData());
-                                perf.addInputEvent (endpointHandle, midiEvent);
-                            }
-                        });
-                    }
+                    auto& details = performer->getInputEndpoints()[connection.endpointPosition];
+
+                    if (isMIDIEventEndpoint (details))
+                        operations.addMIDIInput (details);
                 }
                 else if (connection.audioInputStreamIndex >= 0)
                 {
-                    auto& details = findDetailsForID (perf.getInputEndpoints(), connection.endpointID);
-                    auto& frameType = details.getFrameType();
-                    auto startChannel = static_cast<uint32_t> (connection.audioInputStreamIndex);
-                    auto numChans = frameType.getNumElements();
-
-                    if (frameType.isFloat() || (frameType.isVector() && frameType.getElementType().isFloat()))
-                    {
-                        choc::buffer::InterleavedBuffer<float> interleaved (numChans, maxBlockSize);
-
-                        preRenderOperations.push_back ([&perf, endpointHandle, startChannel, numChans, interleaved] (RenderContext& rc)
-                        {
-                            copy (interleaved, rc.inputChannels.getChannelRange ({ startChannel, startChannel + numChans }));
-
-                            perf.setNextInputStreamFrames (endpointHandle, choc::value::create2DArrayView (interleaved.getView().data.data,
-                                                                                                           interleaved.getNumFrames(),
-                                                                                                           interleaved.getNumChannels()));
-                        });
-                    }
-                    else
-                    {
-                        SOUL_ASSERT_FALSE;
-                    }
+                    operations.addAudioInput (performer->getInputEndpoints()[connection.endpointPosition],
+                                              static_cast<uint32_t> (connection.audioInputStreamIndex), maxBlockSize);
                 }
                 else if (connection.audioOutputStreamIndex >= 0)
                 {
-                    auto& details = findDetailsForID (perf.getOutputEndpoints(), connection.endpointID);
-                    auto& frameType = details.getFrameType();
-                    auto startChannel = static_cast<uint32_t> (connection.audioOutputStreamIndex);
-                    auto numChans = frameType.getNumElements();
+                    operations.addAudioOutput (performer->getOutputEndpoints()[connection.endpointPosition],
+                                               static_cast<uint32_t> (connection.audioOutputStreamIndex));
+                }
+            }
+        }
+
+        /** Allocates the buffer that this session renders into when its output has to be mixed
+            with other sessions, and works out which of its channels need to be mixed.
+        */
+        void prepareMixBuffer (uint32_t numChannels, uint32_t numFrames)
+        {
+            mixBuffer = choc::buffer::ChannelArrayBuffer<float> (numChannels, numFrames);
+            usesOutputChannel.assign (numChannels, false);
+
+            for (auto& connection : connections)
+            {
+                if (connection.audioOutputStreamIndex >= 0)
+                {
+                    auto& details = performer->getOutputEndpoints()[connection.endpointPosition];
+                    auto start = static_cast<uint32_t> (connection.audioOutputStreamIndex);
+                    auto end = std::min (numChannels, start + details.getFrameType().getNumElements());
 
-                    if (frameType.isFloat() || (frameType.isVector() && frameType.getElementType().isFloat()))
-                    {
-                        postRenderOperations.push_back ([&perf, endpointHandle, startChannel, numChans] (RenderContext& rc)
-                        {
-                            copyIntersectionAndClearOutside (rc.outputChannels.getChannelRange ({ startChannel, startChannel + numChans }),
-                                                             getChannelSetFromArray (perf.getOutputStreamFrames (endpointHandle)));
-                        });
-                    }
-                    else
-                    {
-                        SOUL_ASSERT_FALSE;
-                    }
+                    for (auto i = start; i < end; ++i)
+                        usesOutputChannel[i] = true;
                 }
             }
         }
 
+        /** Renders the next block into the mix buffer, leaving the venue to add it to the device output. */
+        void renderToMixBuffer (RenderContext context)
+        {
+            context.outputChannels = mixBuffer.getStart (context.inputChannels.getNumFrames());
+            processBlock (context);
+        }
+
+        void addMixBufferChannel (choc::buffer::ChannelArrayView<float> output, uint32_t channel) const
+        {
+            if (usesOutputChannel[channel])
+                add (output.getChannel (channel), mixBuffer.getView().getChannel (channel).getStart (output.getNumFrames()));
+        }
+
         void processBlock (AudioMIDIWrapper::RenderContext context)
         {
             SOUL_ASSERT (maxBlockSize > 0);
-            auto maxFramesPerBlock = std::min (512u, maxBlockSize);
+            auto maxFramesPerBlock = std::min (AudioMIDIWrapper::defaultMaxChunkSize, maxBlockSize);
             context.totalFramesRendered = totalFramesRendered;
 
             context.iterateInBlocks (maxFramesPerBlock, [&] (RenderContext& rc)
             {
                 performer->prepare (rc.inputChannels.getNumFrames());
 
-                for (auto& op : preRenderOperations)
-                    op (rc);
+                operations.runPreRenderOperations (rc);
 
                 for (auto& c : inputCallbacks)
                     c.callback (*this, c.endpointHandle);
 
                 performer->advance();
 
-                for (auto& op : postRenderOperations)
-                    op (rc);
+                operations.runPostRenderOperations (rc);
 
                 for (auto& c : outputCallbacks)
                     c.callback (*this, c.endpointHandle);
@@ -412,12 +422,14 @@ public:
         {
             int audioInputStreamIndex = -1, audioOutputStreamIndex = -1;
             bool isMIDI = false;
-            EndpointID endpointID;
+            uint32_t endpointPosition = 0;   // the endpoint's index in the performer's input or output list
         };
 
         std::vector<Connection> connections;
-        std::vector<std::function<void(RenderContext&)>> preRenderOperations;
-        std::vector<std::function<void(RenderContext&)>> postRenderOperations;
+        EndpointIndex endpointIndex;
+        AudioMIDIWrapper::RenderOperationList operations;
+        choc::buffer::ChannelArrayBuffer<float> mixBuffer;
+        std::vector<bool> usesOutputChannel;
 
         State state = State::empty;
     };
@@ -428,7 +440,11 @@ public:
         std::lock_guard<decltype(activeSessionLock)> lock (activeSessionLock);
 
         if (! contains (activeSessions, s))
+        {
+            s->prepareMixBuffer (static_cast<uint32_t> (audioSystem.getNumOutputChannels()), maxMixFrames);
             activeSessions.push_back (s);
+            publishActiveSessions();
+        }
 
         audioSystem.setCallback (this);
         return true;
@@ -437,7 +453,9 @@ public:
     bool stopSession (AudioPlayerSession* s)
     {
         std::lock_guard<decltype(activeSessionLock)> lock (activeSessionLock);
-        removeFirst (activeSessions, [=] (AudioPlayerSession* i) { return i == s; });
+
+        if (removeFirst (activeSessions, [=] (AudioPlayerSession* i) { return i == s; }))
+            publishActiveSessions();
 
         if (activeSessions.empty())
             audioSystem.setCallback (nullptr);
@@ -447,6 +465,126 @@ public:
 
 
 private:
+    //==============================================================================
+    /** A pool of threads which the audio callback uses to render sessions, and then to mix
+        their output channels, in parallel. The callback's own thread joins in with the work.
+
+        Each job's tasks are handed out from an atomic counter, and the number of tasks is held
+        in another atomic. The top half of both holds the job number, so a thread which is still
+        finishing off the previous job can't mistakenly pick up a task from the next one.
+    */
+    struct RenderThreadPool
+    {
+        RenderThreadPool (uint32_t numThreads, int priority)
+        {
+            for (uint32_t i = 0; i < numThreads; ++i)
+            {
+                threads.emplace_back ([this, priority]
+                {
+                    if (priority > 0)
+                        setCurrentThreadRealtimePriority (priority);
+
+                    ScopedDisableDenormals disableDenormals;
+                    run();
+                });
+            }
+        }
+
+        ~RenderThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock (mutex);
+                shouldExit = true;
+            }
+
+            wakeUp.notify_all();
+
+            for (auto& t : threads)
+                t.join();
+        }
+
+        /** Calls the task for each index from 0 to numTasks - 1, and returns when they're all done. */
+        template <typename TaskFn>
+        void perform (uint32_t numTasks, TaskFn&& task)
+        {
+            using TaskType = typename std::remove_reference<TaskFn>::type;
+
+            if (numTasks == 0)
+                return;
+
+            taskFn = [] (void* context, uint32_t index) { (*static_cast<TaskType*> (context)) (index); };
+            taskContext = const_cast<void*> (static_cast<const void*> (std::addressof (task)));
+            numTasksRemaining = numTasks;
+
+            uint64_t job;
+
+            {
+                std::lock_guard<std::mutex> lock (mutex);
+                job = ++jobNumber;
+                taskLimit = (job << 32) | numTasks;
+                nextTask = job << 32;
+            }
+
+            wakeUp.notify_all();
+            runTasks (job);
+
+            while (numTasksRemaining.load() != 0)
+                std::this_thread::yield();
+        }
+
+    private:
+        std::vector<std::thread> threads;
+        std::mutex mutex;
+        std::condition_variable wakeUp;
+        uint64_t jobNumber = 0;
+        bool shouldExit = false;
+        std::atomic<uint64_t> nextTask { 0 }, taskLimit { 0 };
+        std::atomic<uint32_t> numTasksRemaining { 0 };
+        void (*taskFn) (void*, uint32_t) = nullptr;
+        void* taskContext = nullptr;
+
+        void run()
+        {
+            uint64_t lastJob = 0;
+
+            for (;;)
+            {
+                {
+                    std::unique_lock<std::mutex> lock (mutex);
+                    wakeUp.wait (lock, [&] { return shouldExit || jobNumber != lastJob; });
+
+                    if (shouldExit)
+                        return;
+
+                    lastJob = jobNumber;
+                }
+
+                runTasks (lastJob);
+            }
+        }
+
+        void runTasks (uint64_t job)
+        {
+            for (;;)
+            {
+                auto next = nextTask++;
+
+                if ((next >> 32) != job)
+                    return;
+
+                auto limit = taskLimit.load();
+
+                if ((limit >> 32) != job || next >= limit)
+                    return;
+
+                taskFn (taskContext, static_cast<uint32_t> (next));
+                --numTasksRemaining;
+            }
+        }
+    };
+
+    using SessionList = std::vector<AudioPlayerSession*>;
+
     //==============================================================================
     AudioMIDISystem audioSystem;
     std::unique_ptr<PerformerFactory> performerFactory;
@@ -456,6 +594,30 @@ private:
     std::recursive_mutex activeSessionLock;
     std::vector<AudioPlayerSession*> activeSessions;
 
+    // The audio callback only ever reads this copy of the list, so that sessions can be
+    // started and stopped without it having to take a lock. See publishActiveSessions().
+    std::atomic<SessionList*> renderSessions { nullptr };
+    std::atomic<uint64_t> renderSequence { 0 };
+
+    std::unique_ptr<RenderThreadPool> renderThreads;
+    std::vector<MIDIEvent> chunkMIDI;
+    uint32_t maxMixFrames = 0;
+
+    /** Gives the audio callback a new copy of the active session list. Once this returns, the
+        callback is guaranteed not to be using the old list, or any session that isn't in the
+        new one. The callback bumps renderSequence before and after each block, so an odd value
+        means a block is being rendered, and may be using the old list.
+    */
+    void publishActiveSessions()
+    {
+        std::unique_ptr<SessionList> oldList (renderSessions.exchange (new SessionList (activeSessions)));
+        auto sequence = renderSequence.load();
+
+        if ((sequence & 1) != 0)
+            while (renderSequence.load() == sequence)
+                std::this_thread::yield();
+    }
+
     //==============================================================================
     void createDeviceEndpoints (int numInputChannels, int numOutputChannels)
     {
@@ -511,7 +673,20 @@ private:
         return result;
     }
 
-    void renderStarting (double, uint32_t) override {}
+    void renderStarting (double, uint32_t newBlockSize) override
+    {
+        std::lock_guard<decltype(activeSessionLock)> lock (activeSessionLock);
+        auto newMaxMixFrames = std::max (newBlockSize, AudioMIDIWrapper::defaultMaxChunkSize);
+
+        if (newMaxMixFrames != maxMixFrames)
+        {
+            maxMixFrames = newMaxMixFrames;
+
+            for (auto s : activeSessions)
+                s->prepareMixBuffer (static_cast<uint32_t> (audioSystem.getNumOutputChannels()), maxMixFrames);
+        }
+    }
+
     void renderStopped() override {}
 
     void render (choc::buffer::ChannelArrayView<const float> input,
@@ -519,12 +694,82 @@ private:
                  const MIDIEvent* midiIn,
                  uint32_t midiInCount) override
     {
-        std::lock_guard<decltype(activeSessionLock)> lock (activeSessionLock);
+        SOUL_TRACE_SCOPE ("render", "audio player block")
+        ++renderSequence;
+
+        if (auto sessions = renderSessions.load())
+        {
+            if (sessions->size() == 1)
+            {
+                // With only one session there's nothing to mix, so it can render straight into the output
+                sessions->front()->processBlock (RenderContext { 0, input, output, midiIn, nullptr, 0, midiInCount, 0, 0 });
+            }
+            else if (! sessions->empty())
+            {
+                auto numFrames = input.getNumFrames();
+
+                if (numFrames <= maxMixFrames)
+                {
+                    renderAndMix (*sessions, input, output, midiIn, midiInCount);
+                }
+                else
+                {
+                    // If the device gives us a bigger block than the mix buffers, it's split up,
+                    // and each chunk gets a copy of its MIDI with the times made relative to it
+                    auto midiEnd = midiIn + midiInCount;
+
+                    for (uint32_t start = 0; start < numFrames; start += maxMixFrames)
+                    {
+                        auto end = std::min (numFrames, start + maxMixFrames);
+                        chunkMIDI.clear();
 
-        auto context = RenderContext { 0, input, output, midiIn, nullptr, 0, midiInCount, 0, 0 };
+                        for (; midiIn != midiEnd && midiIn->frameIndex < end; ++midiIn)
+                            if (chunkMIDI.size() < chunkMIDI.capacity())
+                                chunkMIDI.push_back ({ midiIn->frameIndex - start, midiIn->message });
 
-        for (auto& s : activeSessions)
-            s->processBlock (context);
+                        renderAndMix (*sessions, input.getFrameRange ({ start, end }), output.getFrameRange ({ start, end }),
+                                      chunkMIDI.data(), static_cast<uint32_t> (chunkMIDI.size()));
+                    }
+                }
+            }
+        }
+
+        ++renderSequence;
+    }
+
+    /** Renders each session into its own mix buffer, in parallel if there are render threads,
+        and then adds the buffers into the output, with each output channel summed by one thread.
+    */
+    void renderAndMix (const SessionList& sessions,
+                       choc::buffer::ChannelArrayView<const float> input,
+                       choc::buffer::ChannelArrayView<float> output,
+                       const MIDIEvent* midiIn, uint32_t midiInCount)
+    {
+        auto context = RenderContext { 0, input, {}, midiIn, nullptr, 0, midiInCount, 0, 0 };
+        auto numSessions = static_cast<uint32_t> (sessions.size());
+        auto numChannels = output.getNumChannels();
+
+        auto renderSession = [&] (uint32_t index) { sessions[index]->renderToMixBuffer (context); };
+
+        auto mixChannel = [&] (uint32_t channel)
+        {
+            for (auto s : sessions)
+                s->addMixBufferChannel (output, channel);
+        };
+
+        if (renderThreads != nullptr)
+        {
+            renderThreads->perform (numSessions, renderSession);
+            renderThreads->perform (numChannels, mixChannel);
+        }
+        else
+        {
+            for (uint32_t i = 0; i < numSessions; ++i)
+                renderSession (i);
+
+            for (uint32_t i = 0; i < numChannels; ++i)
+                mixChannel (i);
+        }
     }
 
     static soul::Type getVectorType (int size)    { return (soul::Type::createVector (soul::PrimitiveType::float32, static_cast<size_t> (size))); }
@@ -47,10 +47,33 @@ namespace soul::audioplayer
     struct Requirements
     {
         double sampleRate = 0; // 0 means "default"
-        int blockSize = 0;
+        int blockSize = 0;     // 0 means "choose automatically" - see maxCPULoad
         int numInputChannels = 2;
         int numOutputChannels = 2;
 
+        /** If blockSize is 0, the venue chooses the device's block size itself. It starts with
+            the smallest size that the device supports, and moves up to the next size whenever the
+            measured CPU load goes above this proportion, or the device reports an xrun.
+            If this is 0, the device's default block size is used instead.
+        */
+        float maxCPULoad = 0.7f;
+
+        /** The maximum number of incoming MIDI messages which can be queued between audio callbacks.
+            Any that arrive when the queue is full are dropped, and counted by the venue.
+        */
+        uint32_t midiInputQueueSize = 1024;
+
+        /** If this is more than 1, then when several sessions are running at once, the audio
+            callback renders them in parallel on this many threads (including its own), and
+            mixes their outputs together.
+        */
+        uint32_t numRenderThreads = 1;
+
+        /** If this is non-zero, any extra render threads are given a realtime scheduling policy
+            with this priority (1 to 99), if the process has permission for that.
+        */
+        int renderThreadPriority = 0;
+
         /** The caller can provide a lambda here to handle log messages about audio
             and MIDI devices being opened and closed.
         */
@@ -0,0 +1,1160 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+    A command-line tool which measures the compiler and the patch player, and writes the
+    results as JSON so that they can be compared between builds. See the README.md file
+    in the parent folder for how to build and run it.
+*/
+
+#include "../../../source/modules/soul_core/soul_core.h"
+#include "../../../source/API/soul_patch/API/soul_patch.h"
+#include "../../../source/API/soul_patch/helper_classes/soul_patch_Utilities.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+
+#if defined (__linux__) || defined (__APPLE__)
+ #include <sys/resource.h>
+#endif
+
+namespace benchmark
+{
+
+//==============================================================================
+struct Options
+{
+    std::vector<std::string> inputPaths;
+    std::string outputFile, patchLibraryPath;
+    uint32_t iterations = 5;
+    std::vector<uint32_t> blockSizes { 32, 128, 512, 2048 };
+    double renderSeconds = 10.0;
+    double sampleRate = 48000.0;
+    bool includeSynthetic = true, showHelp = false;
+
+    bool runScaling = false;
+    uint32_t scalingSteps = 4, scalingBlockSize = 256, scalingRenderBlocks = 32;
+    double maxScalingExponent = 1.5;
+};
+
+/** A program to measure, either loaded from a .soul or .soulpatch file, or generated. */
+struct TestProgram
+{
+    std::string name, kind;
+    std::vector<soul::BuildBundle::SourceFile> sourceFiles;
+
+    /** For patches, this is the manifest file that the player should be loaded from. */
+    std::string patchFile;
+
+    /** For generated programs, these hold a manifest and the source files, for the
+        player to load from memory.
+    */
+    std::map<std::string, std::string> patchContents;
+};
+
+//==============================================================================
+static double getSecondsSince (std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double> (std::chrono::steady_clock::now() - start).count();
+}
+
+template <typename Function>
+static double timeCall (Function&& f)
+{
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return getSecondsSince (start);
+}
+
+static double getMedian (std::vector<double> values)
+{
+    if (values.empty())
+        return 0;
+
+    std::sort (values.begin(), values.end());
+    auto mid = values.size() / 2;
+    return (values.size() & 1) != 0 ? values[mid] : (values[mid - 1] + values[mid]) * 0.5;
+}
+
+static std::string formatNumber (double value)
+{
+    std::ostringstream s;
+    s << std::fixed << std::setprecision (2) << value;
+    return s.str();
+}
+
+static void addTimingMembers (choc::value::Value& target, const std::vector<double>& seconds)
+{
+    target.addMember ("medianSeconds", getMedian (seconds));
+    target.addMember ("minSeconds", seconds.empty() ? 0.0 : *std::min_element (seconds.begin(), seconds.end()));
+    target.addMember ("maxSeconds", seconds.empty() ? 0.0 : *std::max_element (seconds.begin(), seconds.end()));
+}
+
+static choc::value::Value createTimingObject (const std::vector<double>& seconds)
+{
+    auto timing = choc::value::createObject ("Timing");
+    addTimingMembers (timing, seconds);
+    return timing;
+}
+
+//==============================================================================
+/** On Linux, the peak resident size can be reset, so each program's high-water mark can
+    be measured on its own. Elsewhere, this is the peak for the whole process so far.
+*/
+static void resetPeakMemory()
+{
+   #if defined (__linux__)
+    std::ofstream ("/proc/self/clear_refs") << "5";
+   #endif
+}
+
+static int64_t getPeakMemoryBytes()
+{
+   #if defined (__linux__)
+    std::ifstream status ("/proc/self/status");
+    std::string line;
+
+    while (std::getline (status, line))
+        if (soul::startsWith (line, "VmHWM:"))
+            return std::stoll (line.substr (6)) * 1024;
+
+    return -1;
+   #elif defined (__APPLE__)
+    rusage usage {};
+    getrusage (RUSAGE_SELF, std::addressof (usage));
+    return static_cast<int64_t> (usage.ru_maxrss);
+   #else
+    return -1;
+   #endif
+}
+
+//==============================================================================
+static std::string loadFile (const std::string& path)
+{
+    std::ifstream in (path, std::ios::binary);
+
+    if (! in)
+        throw std::runtime_error ("Couldn't read " + path);
+
+    std::stringstream content;
+    content << in.rdbuf();
+    return content.str();
+}
+
+static std::string getParentFolder (const std::string& path)
+{
+    auto slash = path.find_last_of ("/\\");
+    return slash == std::string::npos ? std::string() : path.substr (0, slash + 1);
+}
+
+static std::string getFileNameWithoutExtension (const std::string& path)
+{
+    auto name = path.substr (getParentFolder (path).length());
+    return name.substr (0, name.find_last_of ('.'));
+}
+
+static TestProgram loadSOULFile (const std::string& path)
+{
+    TestProgram p;
+    p.name = getFileNameWithoutExtension (path);
+    p.kind = "source";
+    p.sourceFiles.push_back ({ path, loadFile (path) });
+    return p;
+}
+
+static TestProgram loadPatch (const std::string& path)
+{
+    TestProgram p;
+    p.name = getFileNameWithoutExtension (path);
+    p.kind = "patch";
+    p.patchFile = path;
+
+    auto manifest = choc::json::parse (loadFile (path));
+    auto source = manifest["soulPatchV1"]["source"];
+    auto folder = getParentFolder (path);
+
+    auto addSource = [&] (const choc::value::ValueView& file)
+    {
+        auto filePath = folder + std::string (file.getString());
+        p.sourceFiles.push_back ({ filePath, loadFile (filePath) });
+    };
+
+    if (source.isArray())
+    {
+        for (uint32_t i = 0; i < source.size(); ++i)
+            addSource (source[i]);
+    }
+    else
+    {
+        addSource (source);
+    }
+
+    return p;
+}
+
+//==============================================================================
+/** Generates some programs which stress particular parts of the compiler and renderer. */
+struct SyntheticPrograms
+{
+    static std::vector<TestProgram> create()
+    {
+        std::vector<TestProgram> programs;
+
+        for (uint32_t channels : { 1u, 2u, 8u })
+            programs.push_back (createFilterChain (64, channels));
+
+        programs.push_back (createManyModules (200));
+        programs.push_back (createLargeTable (65536));
+        return programs;
+    }
+
+private:
+    static TestProgram createProgram (std::string name, std::string code)
+    {
+        TestProgram p;
+        p.name = "synthetic/" + name;
+        p.kind = "synthetic";
+        p.sourceFiles.push_back ({ name + ".soul", code });
+
+        p.patchContents["Synthetic.soulpatch"] = R"({ "soulPatchV1": { "ID": "dev.soul.benchmark.)" + name
+                                                     + R"(", "version": "1.0", "name": ")" + name
+                                                     + R"(", "source": "Synthetic.soul" } })";
+        p.patchContents["Synthetic.soul"] = std::move (code);
+        return p;
+    }
+
+    /** A long chain of one-pole filters, which measures the per-node overhead. */
+    static TestProgram createFilterChain (uint32_t length, uint32_t channels)
+    {
+        auto type = "float<" + std::to_string (channels) + ">";
+
+        choc::text::CodePrinter code;
+        code << "processor OnePole" << choc::text::CodePrinter::NewLine();
+
+        {
+            auto indent = code.createIndentWithBraces();
+            code << "input stream " << type << " in;" << choc::text::CodePrinter::NewLine()
+                 << "output stream " << type << " out;" << choc::text::CodePrinter::NewLine()
+                 << type << " state;" << choc::text::CodePrinter::NewLine()
+                 << "void run() { loop { state += (in - state) * 0.1f; out << state; advance(); } }" << choc::text::CodePrinter::NewLine();
+        }
+
+        code << choc::text::CodePrinter::BlankLine()
+             << "graph FilterChain  [[ main ]]" << choc::text::CodePrinter::NewLine();
+
+        {
+            auto indent = code.createIndentWithBraces();
+            code << "input stream " << type << " in;" << choc::text::CodePrinter::NewLine()
+                 << "output stream " << type << " out;" << choc::text::CodePrinter::NewLine()
+                 << "let" << choc::text::CodePrinter::NewLine();
+
+            {
+                auto indent2 = code.createIndentWithBraces();
+
+                for (uint32_t i = 0; i < length; ++i)
+                    code << "f" << i << " = OnePole;" << choc::text::CodePrinter::NewLine();
+            }
+
+            code << choc::text::CodePrinter::NewLine()
+                 << "connection" << choc::text::CodePrinter::NewLine();
+
+            auto indent2 = code.createIndentWithBraces();
+            code << "in -> f0.in;" << choc::text::CodePrinter::NewLine();
+
+            for (uint32_t i = 1; i < length; ++i)
+                code << "f" << (i - 1) << ".out -> f" << i << ".in;" << choc::text::CodePrinter::NewLine();
+
+            code << "f" << (length - 1) << ".out -> out;" << choc::text::CodePrinter::NewLine();
+        }
+
+        return createProgram ("filter-chain-" + std::to_string (channels) + "ch", code.toString());
+    }
+
+    /** Lots of small namespaces and processors which refer to each other's structs, which
+        stresses name resolution and the per-module parts of the compiler.
+    */
+    static TestProgram createManyModules (uint32_t numModules)
+    {
+        choc::text::CodePrinter code;
+
+        for (uint32_t i = 0; i < numModules; ++i)
+            code << "namespace ns" << i << " { struct S { float a; int b; float<4> c; }  "
+                 << "S make (float x) { S s; s.a = x; s.b = " << i << "; s.c = x; return s; } }"
+                 << choc::text::CodePrinter::NewLine();
+
+        for (uint32_t i = 0; i < numModules; ++i)
+        {
+            auto next = std::to_string ((i + 1) % numModules);
+
+            code << "processor P" << i << "  [[ main: false ]] { input stream float in; output stream float out; "
+                 << "ns" << i << "::S s1; ns" << next << "::S s2; "
+                 << "void run() { loop { s1 = ns" << i << "::make (in); s2 = ns" << next << "::make (s1.a * 0.5f); "
+                 << "out << s2.a + s1.c[2] + float (s2.b) * 0.0f; advance(); } } }"
+                 << choc::text::CodePrinter::NewLine();
+        }
+
+        code << "graph ManyModules  [[ main ]] { input stream float in; output stream float out; let { ";
+
+        for (uint32_t i = 0; i < numModules; ++i)
+            code << "p" << i << " = P" << i << "; ";
+
+        code << "} connection { in -> p0.in; ";
+
+        for (uint32_t i = 1; i < numModules; ++i)
+            code << "p" << (i - 1) << ".out -> p" << i << ".in; ";
+
+        code << "p" << (numModules - 1) << ".out -> out; } }" << choc::text::CodePrinter::NewLine();
+
+        return createProgram ("many-modules", code.toString());
+    }
+
+    /** A wavetable oscillator with a large literal table, which stresses the tokeniser, the
+        constant folding and the handling of big constants.
+    */
+    static TestProgram createLargeTable (uint32_t tableSize)
+    {
+        choc::text::CodePrinter code;
+        code << "processor LargeTable  [[ main ]] { output stream float out; let table = float[" << tableSize << "] (";
+
+        for (uint32_t i = 0; i < tableSize; ++i)
+            code << (i == 0 ? "" : ", ") << static_cast<float> (std::sin (i * 2.0 * 3.141592653589793 / tableSize));
+
+        code << "); void run() { wrap<" << tableSize << "> i; loop { out << table[i++]; advance(); } } }"
+             << choc::text::CodePrinter::NewLine();
+
+        return createProgram ("large-table", code.toString());
+    }
+};
+
+//==============================================================================
+/** Families of generated programs which can be built at any size, so that the cost of
+    compiling, parsing and rendering them can be compared as they grow. The size of each
+    program is roughly proportional to the number it's given.
+*/
+struct ScalingFamily
+{
+    std::string name, description;
+    uint32_t smallestSize;
+    std::function<std::string(uint32_t)> generate;
+
+    static std::vector<ScalingFamily> getAll()
+    {
+        return { { "processor-count",  "A chain of distinct processors",                     250, createProcessorChain },
+                 { "graph-nesting",    "Graphs nested inside each other to the given depth", 16,  createNestedGraphs },
+                 { "constant-tables",  "A processor with many distinct constant tables",     100, createConstantTables },
+                 { "processor-array",  "A graph with a wide array of processor instances",   32,  createProcessorArray },
+                 { "string-literals",  "A processor with many distinct string literals",     250, createStringLiterals } };
+    }
+
+    /** A trivial program, whose times are subtracted from the others to leave the cost
+        which depends on their size.
+    */
+    static ScalingFamily getBaseline()
+    {
+        return { "baseline", "An empty processor", 1, [] (uint32_t)
+        {
+            return std::string ("processor Empty  [[ main ]] { output stream float out; void run() { loop { out << 0.0f; advance(); } } }");
+        }};
+    }
+
+private:
+    static std::string createProcessorChain (uint32_t numProcessors)
+    {
+        choc::text::CodePrinter code;
+
+        for (uint32_t i = 0; i < numProcessors; ++i)
+            code << "processor P" << i << "  [[ main: false ]] { input stream float in; output stream float out; "
+                 << "float s; void run() { loop { s = s * 0." << (i % 9 + 1) << "f + in * " << (i + 1) << ".0f; out << s; advance(); } } }"
+                 << choc::text::CodePrinter::NewLine();
+
+        code << "graph Chain  [[ main ]] { input stream float in; output stream float out; let { ";
+
+        for (uint32_t i = 0; i < numProcessors; ++i)
+            code << "p" << i << " = P" << i << "; ";
+
+        code << "} connection { in -> p0.in; ";
+
+        for (uint32_t i = 1; i < numProcessors; ++i)
+            code << "p" << (i - 1) << ".out -> p" << i << ".in; ";
+
+        code << "p" << (numProcessors - 1) << ".out -> out; } }" << choc::text::CodePrinter::NewLine();
+        return code.toString();
+    }
+
+    static std::string createNestedGraphs (uint32_t depth)
+    {
+        choc::text::CodePrinter code;
+        code << "processor Stage  [[ main: false ]] { input stream float in; output stream float out; "
+             << "float s; void run() { loop { s = s * 0.5f + in; out << s; advance(); } } }" << choc::text::CodePrinter::NewLine()
+             << "graph G0  [[ main: false ]] { input stream float in; output stream float out; "
+             << "let s = Stage; connection { in -> s.in; s.out -> out; } }" << choc::text::CodePrinter::NewLine();
+
+        for (uint32_t i = 1; i <= depth; ++i)
+            code << "graph G" << i << (i == depth ? "  [[ main ]]" : "  [[ main: false ]]")
+                 << " { input stream float in; output stream float out; let { a = G" << (i - 1) << "; b = Stage; } "
+                 << "connection { in -> a.in; a.out -> b.in; b.out -> out; } }" << choc::text::CodePrinter::NewLine();
+
+        return code.toString();
+    }
+
+    static std::string createConstantTables (uint32_t numTables)
+    {
+        constexpr uint32_t tableSize = 16;
+
+        choc::text::CodePrinter code;
+        code << "processor Tables  [[ main ]]" << choc::text::CodePrinter::NewLine();
+
+        {
+            auto indent = code.createIndentWithBraces();
+            code << "output stream float out;" << choc::text::CodePrinter::NewLine();
+
+            for (uint32_t i = 0; i < numTables; ++i)
+            {
+                code << "let t" << i << " = float[" << tableSize << "] (";
+
+                for (uint32_t j = 0; j < tableSize; ++j)
+                    code << (j == 0 ? "" : ", ") << static_cast<float> (i * tableSize + j) * 0.001f;
+
+                code << ");" << choc::text::CodePrinter::NewLine();
+            }
+
+            code << "void run() { wrap<" << tableSize << "> i; loop { float sum; ";
+
+            for (uint32_t i = 0; i < numTables; ++i)
+                code << "sum += t" << i << "[i]; ";
+
+            code << "out << sum; ++i; advance(); } }" << choc::text::CodePrinter::NewLine();
+        }
+
+        return code.toString();
+    }
+
+    static std::string createProcessorArray (uint32_t numInstances)
+    {
+        choc::text::CodePrinter code;
+        code << "processor Voice  [[ main: false ]] { input stream float in; output stream float out; "
+             << "float s; void run() { loop { s += (in - s) * 0.1f; out << s; advance(); } } }" << choc::text::CodePrinter::NewLine()
+             << "graph Wide  [[ main ]] { input stream float in; output stream float out; let v = Voice[" << numInstances << "]; "
+             << "connection { in -> v.in; v.out -> out; } }" << choc::text::CodePrinter::NewLine();
+        return code.toString();
+    }
+
+    static std::string createStringLiterals (uint32_t numStrings)
+    {
+        choc::text::CodePrinter code;
+        code << "processor Strings  [[ main ]]" << choc::text::CodePrinter::NewLine();
+
+        {
+            auto indent = code.createIndentWithBraces();
+            code << "output stream float out;" << choc::text::CodePrinter::NewLine()
+                 << "void log (int n) { ";
+
+            for (uint32_t i = 0; i < numStrings; ++i)
+                code << "if (n == " << i << ") { console << \"message " << i << "\"; return; } ";
+
+            code << "}" << choc::text::CodePrinter::NewLine()
+                 << "void run() { int counter; loop { if ((counter & 1023) == 0) log (counter >> 10); ++counter; out << 0.0f; advance(); } }"
+                 << choc::text::CodePrinter::NewLine();
+        }
+
+        return code.toString();
+    }
+};
+
+//==============================================================================
+/** Compiles a program several times, collecting the compiler's BuildReport each time,
+    and then measures converting the result to and from HEART and binary.
+*/
+static choc::value::Value runCompileBenchmarks (const TestProgram& program, const Options& options, std::string& error)
+{
+    soul::BuildBundle bundle;
+    bundle.sourceFiles = program.sourceFiles;
+    bundle.settings.sampleRate = options.sampleRate;
+    bundle.settings.maxBlockSize = 1024;
+    bundle.settings.customSettings = choc::value::createObject ("", "buildReport", true);
+
+    std::vector<double> totalTimes;
+    std::vector<std::string> phaseNames;
+    std::vector<uint32_t> phaseDepths;
+    std::map<std::string, std::vector<double>> phaseTimes;
+    std::map<std::string, int64_t> phasePoolBytes;
+    soul::Program compiled;
+
+    for (uint32_t i = 0; i < options.iterations; ++i)
+    {
+        soul::CompileMessageList messages;
+        totalTimes.push_back (timeCall ([&] { compiled = soul::Compiler::build (messages, bundle); }));
+
+        if (compiled.isEmpty())
+        {
+            error = messages.toString();
+            return {};
+        }
+
+        // Phases such as the resolver's iterations can appear more than once in a build, so
+        // they're added up, using their nesting depth as part of the key
+        std::map<std::string, double> totalsForThisBuild;
+
+        for (auto& phase : messages.buildReport.phases)
+        {
+            auto key = std::string (phase.depth * 2, ' ') + phase.name;
+
+            if (phaseTimes.find (key) == phaseTimes.end())
+            {
+                phaseNames.push_back (key);
+                phaseDepths.push_back (phase.depth);
+                phaseTimes[key] = {};
+            }
+
+            totalsForThisBuild[key] += phase.seconds;
+            phasePoolBytes[key] = static_cast<int64_t> (phase.numPoolBytes);
+        }
+
+        for (auto& t : totalsForThisBuild)
+            phaseTimes[t.first].push_back (t.second);
+    }
+
+    auto phases = choc::value::createEmptyArray();
+
+    for (size_t i = 0; i < phaseNames.size(); ++i)
+    {
+        auto& key = phaseNames[i];
+        auto phase = choc::value::createObject ("Phase",
+                                                "name", key.substr (phaseDepths[i] * 2),
+                                                "depth", static_cast<int32_t> (phaseDepths[i]),
+                                                "poolBytes", phasePoolBytes[key]);
+        addTimingMembers (phase, phaseTimes[key]);
+        phases.addArrayElement (phase);
+    }
+
+    std::vector<double> toHEARTTimes, fromHEARTTimes, fromTrustedHEARTTimes, toBinaryTimes, fromBinaryTimes;
+    std::string heart;
+    std::vector<uint8_t> binary;
+
+    for (uint32_t i = 0; i < options.iterations; ++i)
+    {
+        toHEARTTimes.push_back (timeCall ([&] { heart = compiled.toHEART(); }));
+
+        fromHEARTTimes.push_back (timeCall ([&]
+        {
+            soul::CompileMessageList messages;
+            soul::Program::createFromHEART (messages, soul::CodeLocation::createFromString ("benchmark", heart));
+        }));
+
+        fromTrustedHEARTTimes.push_back (timeCall ([&]
+        {
+            soul::CompileMessageList messages;
+            soul::Program::createFromTrustedHEART (messages, soul::CodeLocation::createFromString ("benchmark", heart));
+        }));
+
+        toBinaryTimes.push_back (timeCall ([&] { binary = compiled.toBinary(); }));
+
+        fromBinaryTimes.push_back (timeCall ([&]
+        {
+            soul::CompileMessageList messages;
+            soul::Program::createFromBinary (messages, binary.data(), binary.size());
+        }));
+    }
+
+    return choc::value::createObject ("Compile",
+                                      "iterations", static_cast<int32_t> (options.iterations),
+                                      "build", createTimingObject (totalTimes),
+                                      "phases", phases,
+                                      "heartBytes", static_cast<int64_t> (heart.length()),
+                                      "binaryBytes", static_cast<int64_t> (binary.size()),
+                                      "toHEART", createTimingObject (toHEARTTimes),
+                                      "parseHEART", createTimingObject (fromHEARTTimes),
+                                      "parseTrustedHEART", createTimingObject (fromTrustedHEARTTimes),
+                                      "toBinary", createTimingObject (toBinaryTimes),
+                                      "fromBinary", createTimingObject (fromBinaryTimes));
+}
+
+//==============================================================================
+/** A VirtualFile which serves the generated programs from memory, so that the patch
+    library can load them without anything being written to disk.
+*/
+struct MemoryFile final  : public soul::patch::RefCountHelper<soul::patch::VirtualFile, MemoryFile>
+{
+    MemoryFile (const std::map<std::string, std::string>& f, std::string p) : files (f), path (std::move (p)) {}
+
+    soul::patch::String* getName() override           { return soul::patch::makeStringPtr (path.substr (path.find_last_of ('/') + 1)); }
+    soul::patch::String* getAbsolutePath() override   { return soul::patch::makeStringPtr ("memory:" + path); }
+    soul::patch::VirtualFile* getParent() override    { return new MemoryFile (files, getParentFolder (path)); }
+    int64_t getLastModificationTime() override        { return exists() ? 0 : -1; }
+
+    soul::patch::VirtualFile* getChildFile (const char* subPath) override
+    {
+        return new MemoryFile (files, (path.empty() || path.back() == '/' ? path : path + "/") + subPath);
+    }
+
+    int64_t getSize() override
+    {
+        auto f = files.find (getKey());
+        return f != files.end() ? static_cast<int64_t> (f->second.length()) : -1;
+    }
+
+    int64_t read (uint64_t start, void* dest, uint64_t size) override
+    {
+        auto f = files.find (getKey());
+
+        if (f == files.end() || dest == nullptr)
+            return -1;
+
+        auto& content = f->second;
+
+        if (start >= content.length())
+            return 0;
+
+        auto numToRead = std::min (size, static_cast<uint64_t> (content.length() - start));
+        std::memcpy (dest, content.data() + start, static_cast<size_t> (numToRead));
+        return static_cast<int64_t> (numToRead);
+    }
+
+private:
+    const std::map<std::string, std::string>& files;
+    std::string path;
+
+    std::string getKey() const     { auto start = path.find_first_not_of ('/'); return start == std::string::npos ? std::string() : path.substr (start); }
+    bool exists() const            { return files.find (getKey()) != files.end(); }
+};
+
+//==============================================================================
+/** Renders a patch for a fixed length of audio with each of the block sizes, and reports
+    how much faster than realtime it ran.
+*/
+static choc::value::Value runRenderBenchmarks (soul::patch::SOULPatchLibrary& library, const TestProgram& program,
+                                               const Options& options, std::string& error)
+{
+    soul::patch::PatchInstance::Ptr patch;
+
+    if (! program.patchFile.empty())
+        patch = library.createPatchFromFileBundle (program.patchFile.c_str());
+    else
+        patch = library.createPatchFromFileBundle (soul::patch::VirtualFile::Ptr (new MemoryFile (program.patchContents, "/Synthetic.soulpatch")));
+
+    if (patch == nullptr)
+    {
+        error = "Couldn't load the patch";
+        return {};
+    }
+
+    auto results = choc::value::createEmptyArray();
+    auto isInstrument = patch->getDescription()->isInstrument;
+
+    for (auto blockSize : options.blockSizes)
+    {
+        soul::patch::PatchPlayerConfiguration config;
+        config.sampleRate = options.sampleRate;
+        config.maxFramesPerBlock = blockSize;
+
+        soul::patch::PatchPlayer::Ptr player;
+        auto compileTime = timeCall ([&] { player = soul::patch::PatchPlayer::Ptr (patch->compileNewPlayer (config, nullptr, nullptr, nullptr, nullptr)); });
+
+        if (player == nullptr || ! player->isPlayable())
+        {
+            if (player != nullptr)
+                for (auto& m : player->getCompileMessages())
+                    error += m.fullMessage.toString<std::string>() + "\n";
+
+            if (error.empty())
+                error = "Couldn't compile the patch";
+
+            return {};
+        }
+
+        uint32_t numInputChannels = 0, numOutputChannels = 0;
+
+        for (auto& bus : player->getInputBuses())   numInputChannels  += bus.numChannels;
+        for (auto& bus : player->getOutputBuses())  numOutputChannels += bus.numChannels;
+
+        choc::buffer::ChannelArrayBuffer<float> input (numInputChannels, blockSize), output (numOutputChannels, blockSize);
+        std::mt19937 random (1234);
+        std::uniform_real_distribution<float> noise (-0.5f, 0.5f);
+        choc::buffer::setAllSamples (input, [&] { return noise (random); });
+
+        std::vector<const float*> inputPointers;
+        std::vector<float*> outputPointers;
+
+        for (uint32_t i = 0; i < numInputChannels; ++i)   inputPointers.push_back (input.getView().getChannel (i).data.data);
+        for (uint32_t i = 0; i < numOutputChannels; ++i)  outputPointers.push_back (output.getView().getChannel (i).data.data);
+
+        // Instruments get a chord every half-second, so that there's something to render
+        std::vector<soul::patch::MIDIMessage> midiIn, midiOut (1024);
+        auto framesBetweenNotes = static_cast<uint64_t> (options.sampleRate / 2);
+
+        auto totalFrames = static_cast<uint64_t> (options.renderSeconds * options.sampleRate);
+        uint64_t framesDone = 0, nextNoteFrame = 0;
+        uint8_t nextNote = 48;
+        soul::BlockTimeHistogram blockTimes;
+
+        while (framesDone < totalFrames)
+        {
+            auto numFrames = static_cast<uint32_t> (std::min (totalFrames - framesDone, static_cast<uint64_t> (blockSize)));
+            midiIn.clear();
+
+            if (isInstrument && nextNoteFrame < framesDone + numFrames)
+            {
+                auto frame = static_cast<uint32_t> (nextNoteFrame - framesDone);
+
+                for (int interval : { 0, 4, 7 })
+                    midiIn.push_back ({ frame, { 0x90, static_cast<uint8_t> (nextNote + interval), 100, 0 } });
+
+                nextNote = static_cast<uint8_t> (nextNote == 72 ? 48 : nextNote + 1);
+                nextNoteFrame += framesBetweenNotes;
+            }
+
+            soul::patch::PatchPlayer::RenderContext rc {};
+            rc.inputChannels = inputPointers.data();
+            rc.outputChannels = outputPointers.data();
+            rc.incomingMIDI = midiIn.data();
+            rc.outgoingMIDI = midiOut.data();
+            rc.numFrames = numFrames;
+            rc.numInputChannels = numInputChannels;
+            rc.numOutputChannels = numOutputChannels;
+            rc.numMIDIMessagesIn = static_cast<uint32_t> (midiIn.size());
+            rc.maximumMIDIMessagesOut = static_cast<uint32_t> (midiOut.size());
+
+            auto blockStart = std::chrono::steady_clock::now();
+            player->render (rc);
+            blockTimes.addMeasurement (std::chrono::steady_clock::now() - blockStart);
+
+            framesDone += numFrames;
+        }
+
+        auto times = blockTimes.getSnapshot();
+        auto renderSeconds = times.averageMicroseconds * 1.0e-6 * static_cast<double> (times.numBlocks);
+
+        results.addArrayElement (choc::value::createObject ("Render",
+                                                            "blockSize", static_cast<int32_t> (blockSize),
+                                                            "inputChannels", static_cast<int32_t> (numInputChannels),
+                                                            "outputChannels", static_cast<int32_t> (numOutputChannels),
+                                                            "frames", static_cast<int64_t> (totalFrames),
+                                                            "compileSeconds", compileTime,
+                                                            "renderSeconds", renderSeconds,
+                                                            "realtimeFactor", renderSeconds > 0 ? options.renderSeconds / renderSeconds : 0.0,
+                                                            "nanosecondsPerFrame", renderSeconds * 1.0e9 / static_cast<double> (totalFrames),
+                                                            "averageBlockMicroseconds", times.averageMicroseconds,
+                                                            "p99BlockMicroseconds", times.getPercentileMicroseconds (0.99),
+                                                            "maxBlockMicroseconds", times.maxMicroseconds));
+    }
+
+    return results;
+}
+
+//==============================================================================
+struct ScalingPoint
+{
+    uint32_t size = 0;
+    double buildSeconds = 0, parseHEARTSeconds = 0, renderBlockSeconds = 0;
+    int64_t heartBytes = 0;
+};
+
+/** Builds one size of a scaling program, and measures how long it takes to compile, how long
+    heart::Parser takes to read it back, and how long the interpreter takes to render a block.
+*/
+static ScalingPoint measureScalingPoint (const ScalingFamily& family, uint32_t size, const Options& options)
+{
+    soul::BuildBundle bundle;
+    bundle.sourceFiles.push_back ({ family.name + ".soul", family.generate (size) });
+    bundle.settings.sampleRate = options.sampleRate;
+    bundle.settings.maxBlockSize = options.scalingBlockSize;
+
+    auto throwError = [&] (const std::string& stage, const soul::CompileMessageList& messages)
+    {
+        throw std::runtime_error (family.name + " (" + std::to_string (size) + ") failed to " + stage + ": " + messages.toString());
+    };
+
+    ScalingPoint point;
+    point.size = size;
+    std::vector<double> buildTimes, parseTimes, blockTimes;
+    soul::Program program;
+
+    for (uint32_t i = 0; i < options.iterations; ++i)
+    {
+        soul::CompileMessageList messages;
+        buildTimes.push_back (timeCall ([&] { program = soul::Compiler::build (messages, bundle); }));
+
+        if (program.isEmpty())
+            throwError ("compile", messages);
+    }
+
+    auto heart = program.toHEART();
+    point.heartBytes = static_cast<int64_t> (heart.length());
+
+    for (uint32_t i = 0; i < options.iterations; ++i)
+    {
+        parseTimes.push_back (timeCall ([&]
+        {
+            soul::CompileMessageList messages;
+            soul::Program::createFromHEART (messages, soul::CodeLocation::createFromString ("benchmark", heart));
+        }));
+    }
+
+    auto performer = soul::createInterpreterPerformerFactory()->createPerformer();
+    soul::CompileMessageList messages;
+
+    if (! performer->load (messages, program))                          throwError ("load", messages);
+    if (! performer->link (messages, bundle.settings, nullptr))        throwError ("link", messages);
+
+    std::vector<std::pair<soul::EndpointHandle, choc::value::Value>> inputStreams;
+    std::mt19937 random (1234);
+    std::uniform_real_distribution<float> noise (-0.5f, 0.5f);
+
+    for (auto& input : performer->getInputEndpoints())
+    {
+        if (soul::isStream (input) && input.getFrameType().isFloat32())
+        {
+            auto frames = choc::value::createEmptyArray();
+
+            for (uint32_t i = 0; i < options.scalingBlockSize; ++i)
+                frames.addArrayElement (noise (random));
+
+            inputStreams.push_back ({ performer->getEndpointHandle (input.endpointID), std::move (frames) });
+        }
+    }
+
+    // The first few blocks are left out, as they include the cost of touching the state for the first time
+    for (uint32_t block = 0; block < options.scalingRenderBlocks + 4; ++block)
+    {
+        auto blockTime = timeCall ([&]
+        {
+            performer->prepare (options.scalingBlockSize);
+
+            for (auto& input : inputStreams)
+                performer->setNextInputStreamFrames (input.first, input.second);
+
+            performer->advance();
+        });
+
+        if (block >= 4)
+            blockTimes.push_back (blockTime);
+    }
+
+    point.buildSeconds = getMedian (buildTimes);
+    point.parseHEARTSeconds = getMedian (parseTimes);
+    point.renderBlockSeconds = getMedian (blockTimes);
+    return point;
+}
+
+/** Returns the gradient of the best fit line through the measurements on a log-log scale,
+    after the baseline's fixed cost has been taken off them. A stage whose time grows in
+    proportion to the size of the program gives about 1.0, and one which grows with its
+    square gives about 2.0.
+*/
+static double getScalingExponent (const std::vector<ScalingPoint>& points, const ScalingPoint& baseline,
+                                  double ScalingPoint::* measurement)
+{
+    double n = 0, sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+
+    for (auto& p : points)
+    {
+        auto time = p.*measurement - baseline.*measurement;
+
+        if (time > 0)
+        {
+            auto x = std::log (static_cast<double> (p.size));
+            auto y = std::log (time);
+            n += 1.0; sumX += x; sumY += y; sumXX += x * x; sumXY += x * y;
+        }
+    }
+
+    auto denominator = n * sumXX - sumX * sumX;
+    return n >= 2 && denominator > 0 ? (n * sumXY - sumX * sumY) / denominator : 0.0;
+}
+
+/** Measures each scaling family at a series of doubling sizes, prints a table of the results,
+    and checks whether any stage's cost grows faster than the maximum exponent allows.
+*/
+static choc::value::Value runScalingBenchmarks (const Options& options, bool& foundSuperLinearStage)
+{
+    auto results = choc::value::createEmptyArray();
+    // The first build in the process pays for some one-off setup, so the baseline is measured twice
+    measureScalingPoint (ScalingFamily::getBaseline(), 1, options);
+    auto baseline = measureScalingPoint (ScalingFamily::getBaseline(), 1, options);
+
+    std::cerr << "Scaling baseline: build " << formatNumber (baseline.buildSeconds * 1.0e3) << " ms, parse "
+              << formatNumber (baseline.parseHEARTSeconds * 1.0e3) << " ms, block "
+              << formatNumber (baseline.renderBlockSeconds * 1.0e6) << " us" << std::endl;
+
+    for (auto& family : ScalingFamily::getAll())
+    {
+        std::cerr << "Scaling " << family.name << ": " << family.description << std::endl
+                  << "        size    build ms    parse ms    block us" << std::endl;
+
+        std::vector<ScalingPoint> points;
+        auto pointList = choc::value::createEmptyArray();
+
+        for (uint32_t step = 0; step < options.scalingSteps; ++step)
+        {
+            auto p = measureScalingPoint (family, family.smallestSize << step, options);
+            points.push_back (p);
+
+            std::cerr << std::setw (12) << p.size
+                      << std::setw (12) << formatNumber (p.buildSeconds * 1.0e3)
+                      << std::setw (12) << formatNumber (p.parseHEARTSeconds * 1.0e3)
+                      << std::setw (12) << formatNumber (p.renderBlockSeconds * 1.0e6) << std::endl;
+
+            pointList.addArrayElement (choc::value::createObject ("ScalingPoint",
+                                                                  "size", static_cast<int32_t> (p.size),
+                                                                  "heartBytes", p.heartBytes,
+                                                                  "buildSeconds", p.buildSeconds,
+                                                                  "parseHEARTSeconds", p.parseHEARTSeconds,
+                                                                  "renderBlockSeconds", p.renderBlockSeconds));
+        }
+
+        auto exponents = choc::value::createObject ("ScalingExponents");
+        auto superLinearStages = choc::value::createEmptyArray();
+
+        for (auto& stage : { std::make_pair ("build", &ScalingPoint::buildSeconds),
+                             std::make_pair ("parseHEART", &ScalingPoint::parseHEARTSeconds),
+                             std::make_pair ("render", &ScalingPoint::renderBlockSeconds) })
+        {
+            auto exponent = getScalingExponent (points, baseline, stage.second);
+            exponents.addMember (stage.first, exponent);
+
+            if (exponent > options.maxScalingExponent)
+            {
+                superLinearStages.addArrayElement (stage.first);
+                foundSuperLinearStage = true;
+            }
+
+            std::cerr << "  " << stage.first << " exponent: " << formatNumber (exponent)
+                      << (exponent > options.maxScalingExponent ? "  <-- super-linear" : "") << std::endl;
+        }
+
+        results.addArrayElement (choc::value::createObject ("Scaling",
+                                                            "name", family.name,
+                                                            "description", family.description,
+                                                            "blockSize", static_cast<int32_t> (options.scalingBlockSize),
+                                                            "points", pointList,
+                                                            "exponents", exponents,
+                                                            "superLinearStages", superLinearStages));
+    }
+
+    return results;
+}
+
+//==============================================================================
+static choc::value::Value runBenchmarks (const TestProgram& program, const Options& options,
+                                         soul::patch::SOULPatchLibrary* library)
+{
+    std::cerr << "Running " << program.name << std::endl;
+
+    auto result = choc::value::createObject ("Benchmark",
+                                             "name", program.name,
+                                             "kind", program.kind);
+    resetPeakMemory();
+    std::string error;
+
+    try
+    {
+        auto compile = runCompileBenchmarks (program, options, error);
+
+        if (error.empty())
+        {
+            result.addMember ("compile", compile);
+            result.addMember ("compilePeakMemoryBytes", getPeakMemoryBytes());
+
+            if (library != nullptr && (! program.patchFile.empty() || ! program.patchContents.empty()))
+            {
+                resetPeakMemory();
+                auto render = runRenderBenchmarks (*library, program, options, error);
+
+                if (error.empty())
+                {
+                    result.addMember ("render", render);
+                    result.addMember ("renderPeakMemoryBytes", getPeakMemoryBytes());
+                }
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        error = e.what();
+    }
+
+    if (! error.empty())
+    {
+        std::cerr << "  failed: " << error << std::endl;
+        result.addMember ("error", error);
+    }
+
+    return result;
+}
+
+static void addInputs (std::vector<TestProgram>& programs, const std::string& path)
+{
+    if (soul::endsWith (path, ".soulpatch"))  return programs.push_back (loadPatch (path));
+    if (soul::endsWith (path, ".soul"))       return programs.push_back (loadSOULFile (path));
+
+    throw std::runtime_error ("Expected a .soul or .soulpatch file: " + path);
+}
+
+static void printUsage()
+{
+    std::cerr << "SOULBenchmark [options] files...\n"
+                 "\n"
+                 "Measures compiling, HEART conversion and, if a patch library is given, rendering, for each\n"
+                 ".soul or .soulpatch file and for some generated stress-test programs. The results are\n"
+                 "written as JSON.\n"
+                 "\n"
+                 "  --output=<file>          Write the JSON to this file rather than stdout\n"
+                 "  --iterations=<n>         The number of times to repeat each compile (default 5)\n"
+                 "  --patch-library=<path>   The SOUL_PatchLoader library to use for the render tests\n"
+                 "  --block-sizes=<a,b,..>   The block sizes to render with (default 32,128,512,2048)\n"
+                 "  --render-seconds=<n>     The length of audio to render for each block size (default 10)\n"
+                 "  --sample-rate=<n>        The sample rate to use (default 48000)\n"
+                 "  --no-synthetic           Don't run the generated programs\n"
+                 "  --scaling                Also measure how the compile, HEART parse and interpreter render\n"
+                 "                           times grow as some generated programs get bigger\n"
+                 "  --scaling-steps=<n>      The number of times to double each scaling program's size (default 4)\n"
+                 "  --max-scaling-exponent=<x>  Fail if a time grows faster than size^x (default 1.5)\n"
+                 "  --help                   Show this message\n";
+}
+
+static Options parseOptions (int argc, char** argv)
+{
+    Options options;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg (argv[i]);
+        auto equals = arg.find ('=');
+        auto name = arg.substr (0, equals);
+        auto value = equals == std::string::npos ? std::string() : arg.substr (equals + 1);
+
+        if (name == "--output")                options.outputFile = value;
+        else if (name == "--iterations")       options.iterations = static_cast<uint32_t> (std::max (1, std::stoi (value)));
+        else if (name == "--patch-library")    options.patchLibraryPath = value;
+        else if (name == "--render-seconds")   options.renderSeconds = std::stod (value);
+        else if (name == "--sample-rate")      options.sampleRate = std::stod (value);
+        else if (name == "--no-synthetic")     options.includeSynthetic = false;
+        else if (name == "--scaling")          options.runScaling = true;
+        else if (name == "--scaling-steps")    options.scalingSteps = static_cast<uint32_t> (std::max (2, std::stoi (value)));
+        else if (name == "--max-scaling-exponent")  options.maxScalingExponent = std::stod (value);
+        else if (name == "--help")             options.showHelp = true;
+        else if (name == "--block-sizes")
+        {
+            options.blockSizes.clear();
+
+            for (auto& size : choc::text::splitString (value, ',', false))
+                options.blockSizes.push_back (static_cast<uint32_t> (std::stoul (size)));
+        }
+        else if (soul::startsWith (arg, "--"))
+        {
+            throw std::runtime_error ("Unknown option: " + arg);
+        }
+        else
+        {
+            options.inputPaths.push_back (arg);
+        }
+    }
+
+    return options;
+}
+
+static int run (int argc, char** argv)
+{
+    auto options = parseOptions (argc, argv);
+
+    if (options.showHelp || (options.inputPaths.empty() && ! options.includeSynthetic && ! options.runScaling))
+    {
+        printUsage();
+        return options.showHelp ? 0 : 1;
+    }
+
+    std::vector<TestProgram> programs;
+
+    for (auto& path : options.inputPaths)
+        addInputs (programs, path);
+
+    if (options.includeSynthetic)
+        for (auto& p : SyntheticPrograms::create())
+            programs.push_back (std::move (p));
+
+    std::unique_ptr<soul::patch::SOULPatchLibrary> library;
+
+    if (! options.patchLibraryPath.empty())
+    {
+        library = std::make_unique<soul::patch::SOULPatchLibrary> (options.patchLibraryPath.c_str());
+
+        if (! library->loadedSuccessfully())
+            throw std::runtime_error ("Couldn't load the patch library: " + options.patchLibraryPath);
+    }
+
+    auto results = choc::value::createEmptyArray();
+
+    for (auto& p : programs)
+        results.addArrayElement (runBenchmarks (p, options, library.get()));
+
+    auto report = choc::value::createObject ("BenchmarkReport",
+                                             "soulVersion", soul::getLibraryVersion().toString ("."),
+                                             "iterations", static_cast<int32_t> (options.iterations),
+                                             "sampleRate", options.sampleRate,
+                                             "renderSeconds", options.renderSeconds,
+                                             "benchmarks", results);
+
+    bool foundSuperLinearStage = false;
+
+    if (options.runScaling)
+        report.addMember ("scaling", runScalingBenchmarks (options, foundSuperLinearStage));
+
+    auto json = choc::json::toString (report);
+
+    if (options.outputFile.empty())
+    {
+        std::cout << json << std::endl;
+    }
+    else
+    {
+        std::ofstream out (options.outputFile);
+        out << json << std::endl;
+
+        if (! out)
+            throw std::runtime_error ("Couldn't write to " + options.outputFile);
+    }
+
+    if (foundSuperLinearStage)
+    {
+        std::cerr << "Some stages grew faster than size^" << options.maxScalingExponent << std::endl;
+        return 2;
+    }
+
+    return 0;
+}
+
+} // namespace benchmark
+
+//==============================================================================
+int main (int argc, char** argv)
+{
+    try
+    {
+        return benchmark::run (argc, argv);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        benchmark::printUsage();
+        return 1;
+    }
+}
@@ -0,0 +1,565 @@
+/*
+    _____ _____ _____ __
+   |   __|     |  |  |  |      The SOUL language
+   |__   |  |  |  |  |  |__    Copyright (c) 2019 - ROLI Ltd.
+   |_____|_____|_____|_____|
+
+   The code in this file is provided under the terms of the ISC license:
+
+   Permission to use, copy, modify, and/or distribute this software for any purpose
+   with or without fee is hereby granted, provided that the above copyright notice and
+   this permission notice appear in all copies.
+
+   THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+   TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+   NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+   DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+   IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+   CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+    A command-line tool which checks the C++ that Program::toCpp() generates, by compiling it
+    with the system's compiler, and comparing what it renders with the interpreter's output.
+    See the README.md file in the parent folder for how to build and run it.
+*/
+
+#include "../../../source/modules/soul_core/soul_core.h"
+#include "../../../source/3rdParty/choc/text/choc_JSON.h"
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace cpptest
+{
+
+//==============================================================================
+struct Options
+{
+    std::vector<std::string> inputPaths;
+    std::string compiler = "c++", workFolder = ".";
+    uint32_t blockSize = 256;
+    double seconds = 3.0;
+    double sampleRate = 44100.0;
+    double tolerance = 1.0e-4;
+    bool compileOnly = false, showHelp = false;
+};
+
+struct TestProgram
+{
+    std::string name;
+    std::vector<soul::BuildBundle::SourceFile> sourceFiles;
+};
+
+static constexpr const char* generatedClassName = "GeneratedProgram";
+static constexpr choc::text::CodePrinter::NewLine newLine = {};
+static constexpr choc::text::CodePrinter::BlankLine blankLine = {};
+
+//==============================================================================
+static std::string loadFile (const std::string& path)
+{
+    std::ifstream in (path, std::ios::binary);
+
+    if (! in)
+        throw std::runtime_error ("Couldn't read " + path);
+
+    std::stringstream content;
+    content << in.rdbuf();
+    return content.str();
+}
+
+static void saveFile (const std::string& path, const std::string& content)
+{
+    std::ofstream out (path, std::ios::binary);
+    out << content;
+
+    if (! out)
+        throw std::runtime_error ("Couldn't write to " + path);
+}
+
+static std::string getParentFolder (const std::string& path)
+{
+    auto slash = path.find_last_of ("/\\");
+    return slash == std::string::npos ? std::string() : path.substr (0, slash + 1);
+}
+
+static std::string getFileNameWithoutExtension (const std::string& path)
+{
+    auto name = path.substr (getParentFolder (path).length());
+    return name.substr (0, name.find_last_of ('.'));
+}
+
+static TestProgram loadSOULFile (const std::string& path)
+{
+    TestProgram p;
+    p.name = getFileNameWithoutExtension (path);
+    p.sourceFiles.push_back ({ path, loadFile (path) });
+    return p;
+}
+
+static TestProgram loadPatch (const std::string& path)
+{
+    TestProgram p;
+    p.name = getFileNameWithoutExtension (path);
+
+    auto manifest = choc::json::parse (loadFile (path));
+    auto source = manifest["soulPatchV1"]["source"];
+    auto folder = getParentFolder (path);
+
+    auto addSource = [&] (const choc::value::ValueView& file)
+    {
+        auto filePath = folder + std::string (file.getString());
+        p.sourceFiles.push_back ({ filePath, loadFile (filePath) });
+    };
+
+    if (source.isArray())
+    {
+        for (uint32_t i = 0; i < source.size(); ++i)
+            addSource (source[i]);
+    }
+    else
+    {
+        addSource (source);
+    }
+
+    return p;
+}
+
+//==============================================================================
+/** The inputs that both renderers are given: a sine wave on each channel of each stream, the
+    initial value of each float event parameter, and a note-on and note-off for MIDI inputs.
+*/
+struct Stimulus
+{
+    struct Stream
+    {
+        soul::EndpointDetails details;
+        uint32_t numChannels = 1;
+    };
+
+    struct Event
+    {
+        soul::EndpointDetails details;
+        bool isMIDI = false;
+        float value = 0;
+    };
+
+    std::vector<Stream> streamInputs, streamOutputs;
+    std::vector<Event> events;
+    uint32_t blockSize = 0, numBlocks = 0, noteOffBlock = 0;
+
+    static float getInputSample (uint32_t frame, uint32_t channel)
+    {
+        return std::sin (0.01f * static_cast<float> (frame % 100000u) + static_cast<float> (channel));
+    }
+
+    static constexpr int32_t noteOn = 0x903c64, noteOff = 0x803c00;
+};
+
+static bool isFloatStream (const soul::EndpointDetails& details)
+{
+    auto& frameType = details.getFrameType();
+    return frameType.isFloat32() || (frameType.isVector() && frameType.getElementType().isFloat32());
+}
+
+static Stimulus createStimulus (soul::Performer& performer, const Options& options)
+{
+    Stimulus s;
+    s.blockSize = options.blockSize;
+    s.numBlocks = std::max (2u, static_cast<uint32_t> (options.seconds * options.sampleRate / options.blockSize));
+    s.noteOffBlock = s.numBlocks / 2;
+
+    for (auto& input : performer.getInputEndpoints())
+    {
+        if (soul::isStream (input))
+        {
+            if (! isFloatStream (input))
+                throw std::runtime_error ("Can't compare the non-float stream " + input.name);
+
+            s.streamInputs.push_back ({ input, input.getNumAudioChannels() });
+        }
+        else if (soul::isMIDIEventEndpoint (input))
+        {
+            s.events.push_back ({ input, true, 0 });
+        }
+        else if (soul::isEvent (input) && input.dataTypes.size() == 1 && input.dataTypes.front().isFloat32()
+                  && input.annotation.hasValue ("init"))
+        {
+            s.events.push_back ({ input, false, static_cast<float> (input.annotation.getDouble ("init")) });
+        }
+    }
+
+    for (auto& output : performer.getOutputEndpoints())
+    {
+        if (soul::isStream (output))
+        {
+            if (! isFloatStream (output))
+                throw std::runtime_error ("Can't compare the non-float stream " + output.name);
+
+            s.streamOutputs.push_back ({ output, output.getNumAudioChannels() });
+        }
+    }
+
+    return s;
+}
+
+//==============================================================================
+static std::vector<float> renderWithInterpreter (soul::Performer& performer, const Stimulus& stimulus)
+{
+    std::vector<float> result;
+    std::vector<soul::EndpointHandle> inputHandles, outputHandles, eventHandles;
+
+    for (auto& i : stimulus.streamInputs)    inputHandles.push_back (performer.getEndpointHandle (i.details.endpointID));
+    for (auto& o : stimulus.streamOutputs)   outputHandles.push_back (performer.getEndpointHandle (o.details.endpointID));
+    for (auto& e : stimulus.events)          eventHandles.push_back (performer.getEndpointHandle (e.details.endpointID));
+
+    std::vector<choc::value::Value> inputBlocks;
+
+    for (auto& i : stimulus.streamInputs)
+        inputBlocks.push_back (choc::value::Value (choc::value::Type::createArray (i.details.getFrameType(), stimulus.blockSize)));
+
+    for (uint32_t block = 0; block < stimulus.numBlocks; ++block)
+    {
+        performer.prepare (stimulus.blockSize);
+
+        for (size_t i = 0; i < stimulus.streamInputs.size(); ++i)
+        {
+            auto numChannels = stimulus.streamInputs[i].numChannels;
+            auto data = static_cast<float*> (inputBlocks[i].getRawData());
+
+            for (uint32_t frame = 0; frame < stimulus.blockSize; ++frame)
+                for (uint32_t channel = 0; channel < numChannels; ++channel)
+                    data[frame * numChannels + channel] = Stimulus::getInputSample (block * stimulus.blockSize + frame, channel);
+
+            performer.setNextInputStreamFrames (inputHandles[i], inputBlocks[i]);
+        }
+
+        for (size_t i = 0; i < stimulus.events.size(); ++i)
+        {
+            auto& e = stimulus.events[i];
+
+            if (e.isMIDI && (block == 1 || block == stimulus.noteOffBlock))
+                performer.addInputEvent (eventHandles[i], choc::value::createObject ("soul::midi::Message",
+                                                                                      "midiBytes", block == 1 ? Stimulus::noteOn : Stimulus::noteOff));
+            else if (! e.isMIDI && block == 1)
+                performer.addInputEvent (eventHandles[i], choc::value::createFloat32 (e.value));
+        }
+
+        performer.advance();
+
+        for (size_t i = 0; i < stimulus.streamOutputs.size(); ++i)
+        {
+            auto frames = performer.getOutputStreamFrames (outputHandles[i]);
+            auto data = static_cast<const float*> (frames.getRawData());
+            result.insert (result.end(), data, data + stimulus.blockSize * stimulus.streamOutputs[i].numChannels);
+        }
+    }
+
+    return result;
+}
+
+//==============================================================================
+/** Creates a main() which renders the generated class with the same stimulus as the
+    interpreter, and writes the output streams to a file as raw floats.
+*/
+static std::string createDriver (const std::string& headerName, const std::string& generatedCode, const Stimulus& stimulus)
+{
+    choc::text::CodePrinter out;
+
+    out << "#include \"" << headerName << "\"" << newLine
+        << "#include <cstdio>" << newLine
+        << "#include <type_traits>" << newLine
+        << "#include <vector>" << blankLine
+        << "inline float getInputSample (uint32_t frame, uint32_t channel)" << newLine
+        << "{" << newLine
+        << "    return std::sin (0.01f * static_cast<float> (frame % 100000u) + static_cast<float> (channel));" << newLine
+        << "}" << blankLine
+        << "int main (int argc, char** argv)" << newLine;
+
+    {
+        auto indent = out.createIndentWithBraces();
+
+        out << "if (argc != 2)" << newLine
+            << "    return 1;" << blankLine
+            << "static " << generatedClassName << " program;" << newLine
+            << "program.init();" << blankLine
+            << "const uint32_t blockSize = " << stimulus.blockSize << ";" << newLine;
+
+        for (size_t i = 0; i < stimulus.streamInputs.size(); ++i)
+            out << "std::vector<float> input" << i << " (blockSize * " << stimulus.streamInputs[i].numChannels << ");" << newLine;
+
+        for (size_t i = 0; i < stimulus.streamOutputs.size(); ++i)
+            out << "std::vector<float> output" << i << " (blockSize * " << stimulus.streamOutputs[i].numChannels << ");" << newLine;
+
+        // The context's members are the input streams, then the outputs, then the number of frames
+        std::vector<std::string> members;
+
+        for (size_t i = 0; i < stimulus.streamInputs.size(); ++i)    members.push_back ("in" + std::to_string (i));
+        for (size_t i = 0; i < stimulus.streamOutputs.size(); ++i)   members.push_back ("out" + std::to_string (i));
+
+        out << blankLine
+            << generatedClassName << "::RenderContext context {};" << newLine
+            << "auto& [" << soul::joinStrings (members, ", ") << (members.empty() ? "" : ", ") << "numFrames] = context;" << newLine;
+
+        for (size_t i = 0; i < stimulus.streamInputs.size(); ++i)
+            out << "in" << i << " = reinterpret_cast<std::remove_reference_t<decltype (in" << i << ")>> (input" << i << ".data());" << newLine;
+
+        for (size_t i = 0; i < stimulus.streamOutputs.size(); ++i)
+            out << "out" << i << " = reinterpret_cast<std::remove_reference_t<decltype (out" << i << ")>> (output" << i << ".data());" << newLine;
+
+        out << "numFrames = blockSize;" << blankLine
+            << "auto file = std::fopen (argv[1], \"wb\");" << newLine
+            << "if (file == nullptr)" << newLine
+            << "    return 1;" << blankLine
+            << "for (uint32_t block = 0; block < " << stimulus.numBlocks << "; ++block)" << newLine;
+
+        {
+            auto loopIndent = out.createIndentWithBraces();
+
+            for (size_t i = 0; i < stimulus.streamInputs.size(); ++i)
+                out << "for (uint32_t frame = 0; frame < blockSize; ++frame)" << newLine
+                    << "    for (uint32_t channel = 0; channel < " << stimulus.streamInputs[i].numChannels << "; ++channel)" << newLine
+                    << "        input" << i << "[frame * " << stimulus.streamInputs[i].numChannels
+                    << " + channel] = getInputSample (block * blockSize + frame, channel);" << blankLine;
+
+            for (auto& e : stimulus.events)
+            {
+                auto function = "addInputEvent_" + e.details.name;
+
+                // The generated names only differ from the endpoint names if they clash with something else
+                if (generatedCode.find ("void " + function + " (") == std::string::npos)
+                    throw std::runtime_error ("Couldn't find the generated function " + function);
+
+                if (e.isMIDI)
+                {
+                    out << "if (block == 1)  program." << function << " ({ " << Stimulus::noteOn << " });" << newLine
+                        << "if (block == " << stimulus.noteOffBlock << ")  program." << function << " ({ " << Stimulus::noteOff << " });" << newLine;
+                }
+                else
+                {
+                    std::ostringstream value;
+                    value.precision (9);
+                    value << e.value;
+                    out << "if (block == 1)  program." << function << " (static_cast<float> (" << value.str() << "));" << newLine;
+                }
+            }
+
+            out << blankLine << "program.render (context);" << newLine;
+
+            for (size_t i = 0; i < stimulus.streamOutputs.size(); ++i)
+                out << "std::fwrite (output" << i << ".data(), sizeof (float), output" << i << ".size(), file);" << newLine;
+        }
+
+        out << blankLine
+            << "std::fclose (file);" << newLine
+            << "return 0;" << newLine;
+    }
+
+    return out.toString();
+}
+
+static std::vector<float> loadFloats (const std::string& path)
+{
+    auto data = loadFile (path);
+    std::vector<float> result (data.size() / sizeof (float));
+    std::memcpy (result.data(), data.data(), result.size() * sizeof (float));
+    return result;
+}
+
+static void runCommand (const std::string& command, const std::string& failureMessage)
+{
+    if (std::system (command.c_str()) != 0)
+        throw std::runtime_error (failureMessage);
+}
+
+//==============================================================================
+/** Returns an empty string if the program passed, or a description of the failure. */
+static std::string testProgram (const TestProgram& p, const Options& options)
+{
+    soul::BuildBundle bundle;
+    bundle.sourceFiles = p.sourceFiles;
+    bundle.settings.sampleRate = options.sampleRate;
+    bundle.settings.maxBlockSize = options.blockSize;
+
+    soul::CompileMessageList messages;
+    auto program = soul::Compiler::build (messages, bundle);
+
+    if (messages.hasErrors())
+        return "Failed to compile:\n" + messages.toString();
+
+    auto code = program.toCpp (messages, bundle.settings, generatedClassName);
+
+    if (messages.hasErrors())
+        return "Failed to generate C++:\n" + messages.toString();
+
+    auto base = options.workFolder + "/" + p.name;
+    saveFile (base + ".h", code);
+
+    auto compileDriver = [&] (const std::string& driverCode, const std::string& flags)
+    {
+        saveFile (base + "_driver.cpp", driverCode);
+        runCommand (options.compiler + " -std=c++17 -O1 -Wall -Wextra -Werror " + flags + " \"" + base + "_driver.cpp\"",
+                    "The generated C++ didn't compile without warnings: " + base + ".h");
+    };
+
+    // Externals would need their data to be loaded, so these programs can only be compiled
+    if (options.compileOnly || ! program.getExternalVariables().empty())
+    {
+        compileDriver ("#include \"" + p.name + ".h\"\n\nint main() { static " + generatedClassName + " program; program.init(); }\n",
+                       "-fsyntax-only");
+        return {};
+    }
+
+    auto performer = soul::createInterpreterPerformerFactory()->createPerformer();
+
+    if (! (performer->load (messages, program) && performer->link (messages, bundle.settings, nullptr)))
+        return "The interpreter failed to load the program:\n" + messages.toString();
+
+    auto stimulus = createStimulus (*performer, options);
+    compileDriver (createDriver (p.name + ".h", code, stimulus), "-o \"" + base + "_driver\"");
+
+    runCommand ("\"" + base + "_driver\" \"" + base + ".raw\"", "The generated program failed to run");
+
+    auto expected = renderWithInterpreter (*performer, stimulus);
+    auto actual = loadFloats (base + ".raw");
+
+    if (expected.size() != actual.size())
+        return "Expected " + std::to_string (expected.size()) + " samples, but the generated code rendered " + std::to_string (actual.size());
+
+    double maxDifference = 0;
+    size_t firstBadSample = expected.size();
+
+    for (size_t i = 0; i < expected.size(); ++i)
+    {
+        auto difference = std::abs (static_cast<double> (expected[i]) - static_cast<double> (actual[i]));
+
+        if (std::isnan (actual[i]) != std::isnan (expected[i]) || difference > options.tolerance)
+        {
+            firstBadSample = std::min (firstBadSample, i);
+            maxDifference = std::isnan (difference) ? difference : std::max (maxDifference, difference);
+        }
+    }
+
+    if (firstBadSample != expected.size())
+        return "The output differs from the interpreter's, starting at sample " + std::to_string (firstBadSample)
+                 + " (max difference " + std::to_string (maxDifference) + ")";
+
+    return {};
+}
+
+//==============================================================================
+static void addInputs (std::vector<TestProgram>& programs, const std::string& path)
+{
+    if (soul::endsWith (path, ".soulpatch"))  return programs.push_back (loadPatch (path));
+    if (soul::endsWith (path, ".soul"))       return programs.push_back (loadSOULFile (path));
+
+    throw std::runtime_error ("Expected a .soul or .soulpatch file: " + path);
+}
+
+static void printUsage()
+{
+    std::cerr << "SOULCppGeneratorTest [options] files...\n"
+                 "\n"
+                 "Generates C++ for each .soul or .soulpatch file, compiles it with warnings treated as errors,\n"
+                 "and checks that it renders the same output as the interpreter.\n"
+                 "\n"
+                 "  --compiler=<cmd>         The C++ compiler to use (default c++)\n"
+                 "  --work-folder=<path>     Where to write the generated code and executables (default .)\n"
+                 "  --block-size=<n>         The block size to render with (default 256)\n"
+                 "  --seconds=<n>            The length of audio to render (default 3)\n"
+                 "  --sample-rate=<n>        The sample rate to use (default 44100)\n"
+                 "  --tolerance=<x>          The largest difference allowed between samples (default 0.0001)\n"
+                 "  --compile-only           Only check that the generated code compiles\n"
+                 "  --help                   Show this message\n";
+}
+
+static Options parseOptions (int argc, char** argv)
+{
+    Options options;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg (argv[i]);
+        auto equals = arg.find ('=');
+        auto name = arg.substr (0, equals);
+        auto value = equals == std::string::npos ? std::string() : arg.substr (equals + 1);
+
+        if (name == "--compiler")              options.compiler = value;
+        else if (name == "--work-folder")      options.workFolder = value;
+        else if (name == "--block-size")       options.blockSize = static_cast<uint32_t> (std::max (1, std::stoi (value)));
+        else if (name == "--seconds")          options.seconds = std::stod (value);
+        else if (name == "--sample-rate")      options.sampleRate = std::stod (value);
+        else if (name == "--tolerance")        options.tolerance = std::stod (value);
+        else if (name == "--compile-only")     options.compileOnly = true;
+        else if (name == "--help")             options.showHelp = true;
+        else if (soul::startsWith (arg, "--")) throw std::runtime_error ("Unknown option: " + arg);
+        else                                   options.inputPaths.push_back (arg);
+    }
+
+    return options;
+}
+
+static int run (int argc, char** argv)
+{
+    auto options = parseOptions (argc, argv);
+
+    if (options.showHelp || options.inputPaths.empty())
+    {
+        printUsage();
+        return options.showHelp ? 0 : 1;
+    }
+
+    std::vector<TestProgram> programs;
+
+    for (auto& path : options.inputPaths)
+        addInputs (programs, path);
+
+    int numFailed = 0;
+
+    for (auto& p : programs)
+    {
+        std::string failure;
+
+        try
+        {
+            failure = testProgram (p, options);
+        }
+        catch (const std::exception& e)
+        {
+            failure = e.what();
+        }
+
+        if (failure.empty())
+        {
+            std::cout << "PASS  " << p.name << std::endl;
+        }
+        else
+        {
+            std::cout << "FAIL  " << p.name << ": " << failure << std::endl;
+            ++numFailed;
+        }
+    }
+
+    std::cout << (programs.size() - static_cast<size_t> (numFailed)) << " of " << programs.size() << " passed" << std::endl;
+    return numFailed == 0 ? 0 : 2;
+}
+
+} // namespace cpptest
+
+//==============================================================================
+int main (int argc, char** argv)
+{
+    try
+    {
+        return cpptest::run (argc, argv);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        cpptest::printUsage();
+        return 1;
+    }
+}